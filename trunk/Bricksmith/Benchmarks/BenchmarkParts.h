@@ -0,0 +1,410 @@
+//==============================================================================
+//
+// File:		BenchmarkParts.h
+//
+// Purpose:		Flattens LDraw parts from a library folder into plain lists of
+//				polygons and lines, for the benchmarks that feed real parts to
+//				MeshSmooth. Only what those need is read: geometry and
+//				references, with colors and BFC ignored.
+//
+//				Also the synthetic shapes and views the benchmarks share when
+//				there is no library to hand, and the smoothing they all do.
+//
+//==============================================================================
+#ifndef _BenchmarkParts_
+#define _BenchmarkParts_
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MatrixMathEx.h"
+#include "MeshSmooth.h"
+
+#define MAX_DEPTH		16
+
+// Options for addTorus.
+#define TORUS_TRIANGLES		1		// split each quad into two triangles
+#define TORUS_SEAM_LINES	2		// a loop of lines around the outside
+#define TORUS_RING_LINES	4		// lines around every ring
+
+// One flattened primitive; degree 2 is a line.
+typedef struct
+{
+	int		degree;
+	float	points[4][3];
+
+} Primitive;
+
+// A flattened part: all its polygons, then all its lines.
+typedef struct
+{
+	Primitive	*polygons;
+	int			polygonCount;
+	int			polygonCapacity;
+	Primitive	*lines;
+	int			lineCount;
+	int			lineCapacity;
+	int			missingFiles;
+
+} FlatMesh;
+
+// A smoothed mesh as write_indexed_mesh hands it over; starts and counts are
+// lines, conditional lines, triangles and quads.
+typedef struct
+{
+	int				vertexCount;
+	int				indexCount;
+	float			*vertices;
+	unsigned int	*indices;
+	int				starts[4];
+	int				counts[4];
+
+} SmoothedMesh;
+
+// A named camera, as a model-view-projection matrix.
+typedef struct
+{
+	const char	*name;
+	float		mvp[16];
+
+} View;
+
+
+//========== addPrimitive ======================================================
+//
+// Purpose:		Appends a primitive with points already transformed.
+//
+//==============================================================================
+static inline void addPrimitive(FlatMesh *mesh, int degree, float points[4][3])
+{
+	Primitive	**list		= (degree == 2) ? &mesh->lines : &mesh->polygons;
+	int			*count		= (degree == 2) ? &mesh->lineCount : &mesh->polygonCount;
+	int			*capacity	= (degree == 2) ? &mesh->lineCapacity : &mesh->polygonCapacity;
+
+	if(*count == *capacity)
+	{
+		*capacity	= *capacity ? *capacity * 2 : 1024;
+		*list		= realloc(*list, sizeof(Primitive) * *capacity);
+	}
+	(*list)[*count].degree = degree;
+	memcpy((*list)[*count].points, points, sizeof(float) * 3 * degree);
+	++*count;
+}
+
+
+//========== openPart ==========================================================
+//
+// Purpose:		Opens name from the library's parts, p or p/48 folders, as
+//				LDrawPartLibrary would.
+//
+//==============================================================================
+static inline FILE *openPart(const char *library, const char *name)
+{
+	static const char	*folders[]	= { "parts", "p", "p/48", "models" };
+	char				path[1024];
+	char				lower[256];
+	size_t				counter		= 0;
+	FILE				*file		= NULL;
+
+	for(counter = 0; name[counter] && counter < sizeof(lower) - 1; counter++)
+		lower[counter] = (name[counter] == '\\') ? '/' : (char)tolower((unsigned char)name[counter]);
+	lower[counter] = 0;
+
+	for(counter = 0; counter < sizeof(folders) / sizeof(folders[0]) && file == NULL; counter++)
+	{
+		snprintf(path, sizeof(path), "%s/%s/%s", library, folders[counter], lower);
+		file = fopen(path, "r");
+	}
+	return file;
+}
+
+
+//========== flattenPart =======================================================
+//
+// Purpose:		Adds the geometry of name and everything it references, moved
+//				by the 3x4 matrix m (row major, translation last).
+//
+//==============================================================================
+static inline void flattenPart(FlatMesh *mesh, const char *library, const char *name, const float m[12], int depth)
+{
+	FILE	*file	= NULL;
+	char	line[1024];
+
+	if(depth > MAX_DEPTH || (file = openPart(library, name)) == NULL)
+	{
+		mesh->missingFiles++;
+		return;
+	}
+
+	while(fgets(line, sizeof(line), file))
+	{
+		char	*cursor		= line;
+		long	lineType	= strtol(cursor, &cursor, 10);
+		float	values[12];
+		float	points[4][3];
+		int		counter		= 0;
+		int		point		= 0;
+
+		if(cursor == line || lineType < 1 || lineType > 4)
+			continue;
+
+		strtol(cursor, &cursor, 10); // color
+
+		if(lineType == 1)
+		{
+			char	subName[256];
+			float	child[12];
+
+			for(counter = 0; counter < 12; counter++)
+				values[counter] = strtof(cursor, &cursor);
+			if(sscanf(cursor, " %255[^\r\n]", subName) != 1)
+				continue;
+
+			// values: x y z a b c d e f g h i; child = m * [a b c x; d e f y; g h i z]
+			for(counter = 0; counter < 3; counter++)
+			{
+				const float *row = m + counter * 4;
+				child[counter * 4 + 0] = row[0] * values[3] + row[1] * values[6] + row[2] * values[9];
+				child[counter * 4 + 1] = row[0] * values[4] + row[1] * values[7] + row[2] * values[10];
+				child[counter * 4 + 2] = row[0] * values[5] + row[1] * values[8] + row[2] * values[11];
+				child[counter * 4 + 3] = row[0] * values[0] + row[1] * values[1] + row[2] * values[2] + row[3];
+			}
+			flattenPart(mesh, library, subName, child, depth + 1);
+		}
+		else
+		{
+			for(point = 0; point < lineType; point++)
+			{
+				float p[3];
+
+				for(counter = 0; counter < 3; counter++)
+					p[counter] = strtof(cursor, &cursor);
+				for(counter = 0; counter < 3; counter++)
+					points[point][counter] = m[counter * 4] * p[0] + m[counter * 4 + 1] * p[1] + m[counter * 4 + 2] * p[2] + m[counter * 4 + 3];
+			}
+			addPrimitive(mesh, (int)lineType, points);
+		}
+	}
+	fclose(file);
+}
+
+
+//========== addBox ============================================================
+//
+// Purpose:		An axis-aligned box from min to max: six quads and twelve
+//				edge lines.
+//
+//==============================================================================
+static inline void addBox(FlatMesh *flat, const float min[3], const float max[3])
+{
+	static const int	faces[6][4]		= { { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 },
+											{ 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 } };
+	static const int	edges[12][2]	= { { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, { 0, 2 }, { 1, 3 },
+											{ 4, 6 }, { 5, 7 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+	float				corners[8][3];
+	float				points[4][3];
+	int					counter			= 0;
+	int					corner			= 0;
+
+	for(counter = 0; counter < 8; counter++)
+	{
+		corners[counter][0] = (counter & 4) ? max[0] : min[0];
+		corners[counter][1] = (counter & 2) ? max[1] : min[1];
+		corners[counter][2] = (counter & 1) ? max[2] : min[2];
+	}
+
+	for(counter = 0; counter < 6; counter++)
+	{
+		for(corner = 0; corner < 4; corner++)
+			memcpy(points[corner], corners[faces[counter][corner]], sizeof(float) * 3);
+		addPrimitive(flat, 4, points);
+	}
+	for(counter = 0; counter < 12; counter++)
+	{
+		memcpy(points[0], corners[edges[counter][0]], sizeof(float) * 3);
+		memcpy(points[1], corners[edges[counter][1]], sizeof(float) * 3);
+		addPrimitive(flat, 2, points);
+	}
+}
+
+
+//========== addStud ===========================================================
+//
+// Purpose:		A faceted stud standing on y at x, z: 16 sides, a fan for the
+//				top and its rim outlined. LDraw's up is -y.
+//
+//==============================================================================
+static inline void addStud(FlatMesh *flat, float x, float y, float z)
+{
+	int side = 0;
+
+	for(side = 0; side < 16; side++)
+	{
+		float	a0			= 2 * (float)M_PI * side / 16;
+		float	a1			= 2 * (float)M_PI * (side + 1) / 16;
+		float	x0			= x + 6 * cosf(a0), z0 = z + 6 * sinf(a0);
+		float	x1			= x + 6 * cosf(a1), z1 = z + 6 * sinf(a1);
+		float	wall[4][3]	= { { x0, y, z0 }, { x0, y - 4, z0 }, { x1, y - 4, z1 }, { x1, y, z1 } };
+		float	cap[4][3]	= { { x, y - 4, z }, { x1, y - 4, z1 }, { x0, y - 4, z0 } };
+		float	rim[4][3]	= { { x0, y - 4, z0 }, { x1, y - 4, z1 } };
+
+		addPrimitive(flat, 4, wall);
+		addPrimitive(flat, 3, cap);
+		addPrimitive(flat, 2, rim);
+	}
+}
+
+
+//========== addTorus ==========================================================
+//
+// Purpose:		A torus of rings x tubes quads of the given radius around the
+//				y axis, its tube 0.3 times as thick. options are TORUS_ flags.
+//
+//==============================================================================
+static inline void addTorus(FlatMesh *flat, int rings, int tubes, float radius, int options)
+{
+	int i, j, corner;
+
+	for(i = 0; i < rings; i++)
+	for(j = 0; j < tubes; j++)
+	{
+		float	points[4][3];
+		float	other[4][3];
+		int		steps[4][2]	= { { i, j }, { i, j + 1 }, { i + 1, j + 1 }, { i + 1, j } };
+
+		for(corner = 0; corner < 4; corner++)
+		{
+			float ringAngle	= 2 * (float)M_PI * (steps[corner][0] % rings) / rings;
+			float tubeAngle	= 2 * (float)M_PI * (steps[corner][1] % tubes) / tubes;
+			float distance	= radius + 0.3f * radius * cosf(tubeAngle);
+
+			points[corner][0] = distance * cosf(ringAngle);
+			points[corner][1] = 0.3f * radius * sinf(tubeAngle);
+			points[corner][2] = distance * sinf(ringAngle);
+		}
+
+		if(options & TORUS_TRIANGLES)
+		{
+			memcpy(other[0], points[0], sizeof(float) * 3);
+			memcpy(other[1], points[2], sizeof(float) * 3);
+			memcpy(other[2], points[3], sizeof(float) * 3);
+			addPrimitive(flat, 3, points);
+			addPrimitive(flat, 3, other);
+		}
+		else
+			addPrimitive(flat, 4, points);
+
+		if(options & TORUS_RING_LINES)
+			addPrimitive(flat, 2, points);
+		if((options & TORUS_SEAM_LINES) && j == 0)
+		{
+			memcpy(other[0], points[0], sizeof(float) * 3);
+			memcpy(other[1], points[3], sizeof(float) * 3);
+			addPrimitive(flat, 2, other);
+		}
+	}
+}
+
+
+//========== makeView ==========================================================
+//
+// Purpose:		A 45 degree, 4:3 perspective view from x, y, z, turned by yaw and
+//				tilted down by pitch.
+//
+//==============================================================================
+static inline void makeView(View *view, const char *name, float x, float y, float z, float yaw, float pitch)
+{
+	float	projection[16];
+	float	rotation[16];
+	float	translation[16];
+	float	turned[16];
+	float	modelView[16];
+	float	top		= 10 * tanf(22.5f * (float)M_PI / 180);
+
+	view->name = name;
+
+	buildFrustumMatrix(projection, -top * 4 / 3, top * 4 / 3, -top, top, 10, 100000);
+
+	// LDraw's up is -y; turn it over so the camera's up is up.
+	buildTranslationMatrix(translation, -x, -y, -z);
+	buildRotationMatrix(rotation, yaw, 0, 1, 0);
+	multMatrices(turned, rotation, translation);
+	buildRotationMatrix(rotation, 180 + pitch, 1, 0, 0);
+	multMatrices(modelView, rotation, turned);
+
+	multMatrices(view->mvp, projection, modelView);
+}
+
+
+//========== smoothFlatMesh ====================================================
+//
+// Purpose:		Hands flat to MeshSmooth, all in one gray, and runs the
+//				pipeline up to (not including) the vertex cache optimization,
+//				which some reports time or skip.
+//
+//==============================================================================
+static inline struct Mesh *smoothFlatMesh(const FlatMesh *flat)
+{
+	static const float	color[4]	= { 0.5f, 0.5f, 0.5f, 1.0f };
+	struct Mesh			*mesh		= NULL;
+	int					triCount	= 0;
+	int					counter		= 0;
+
+	for(counter = 0; counter < flat->polygonCount; counter++)
+		triCount += (flat->polygons[counter].degree == 3);
+
+	mesh = create_mesh(triCount, flat->polygonCount - triCount, flat->lineCount, 0);
+	for(counter = 0; counter < flat->polygonCount; counter++)
+	{
+		const Primitive *p = flat->polygons + counter;
+		add_face(mesh, p->points[0], p->points[1], p->points[2], (p->degree == 4) ? p->points[3] : NULL, color, 0);
+	}
+	for(counter = 0; counter < flat->lineCount; counter++)
+		add_face(mesh, flat->lines[counter].points[0], flat->lines[counter].points[1], NULL, NULL, color, 0);
+
+	finish_faces_and_sort(mesh);
+	add_creases(mesh);
+	find_and_remove_t_junctions(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+
+	return mesh;
+}
+
+
+//========== writeSmoothedMesh =================================================
+//
+// Purpose:		Writes out a finished mesh and destroys it. Free the output
+//				with freeSmoothedMesh.
+//
+//==============================================================================
+static inline void writeSmoothedMesh(struct Mesh *mesh, SmoothedMesh *output)
+{
+	int *starts = output->starts;
+	int *counts = output->counts;
+
+	get_final_mesh_counts(mesh, &output->vertexCount, &output->indexCount);
+	output->vertices	= malloc(sizeof(float) * 10 * output->vertexCount);
+	output->indices		= malloc(sizeof(unsigned int) * output->indexCount);
+	write_indexed_mesh(mesh, output->vertexCount, output->vertices, output->indexCount, output->indices, 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+	destroy_mesh(mesh);
+}
+
+
+//========== freeSmoothedMesh ==================================================
+//
+// Purpose:		Frees what writeSmoothedMesh allocated.
+//
+//==============================================================================
+static inline void freeSmoothedMesh(SmoothedMesh *output)
+{
+	free(output->vertices);
+	free(output->indices);
+}
+
+#endif // _BenchmarkParts_
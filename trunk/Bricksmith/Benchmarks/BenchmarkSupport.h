@@ -0,0 +1,59 @@
+//==============================================================================
+//
+// File:		BenchmarkSupport.h
+//
+// Purpose:		Tiny shared helpers for the portable command-line benchmarks in 
+//				this folder. They only depend on POSIX, so they build on the 
+//				Linux boxes as well as on the Mac.
+//
+//==============================================================================
+#ifndef _BenchmarkSupport_
+#define _BenchmarkSupport_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+//========== BenchmarkNow ======================================================
+//
+// Purpose:		Returns a monotonic timestamp in seconds.
+//
+//==============================================================================
+static inline double BenchmarkNow(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+
+//========== BenchmarkRandom ===================================================
+//
+// Purpose:		Deterministic xorshift generator, so every run of a benchmark 
+//				sees the same synthetic input.
+//
+//==============================================================================
+static inline uint32_t BenchmarkRandom(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+
+//========== BenchmarkRandomFloat ==============================================
+//
+// Purpose:		Returns a deterministic float in [low, high).
+//
+//==============================================================================
+static inline float BenchmarkRandomFloat(uint32_t *state, float low, float high)
+{
+	return low + (high - low) * (float)(BenchmarkRandom(state) & 0xFFFFFF) / (float)0x1000000;
+}
+
+#endif // _BenchmarkSupport_
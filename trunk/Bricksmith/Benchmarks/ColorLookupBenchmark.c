@@ -0,0 +1,395 @@
+//==============================================================================
+//
+// File:		ColorLookupBenchmark.c
+//
+// Purpose:		Measures color resolution through the ColorLibrary's color table
+//				against the dictionary lookups it replaced.
+//
+//				The library is populated the way ldconfig.ldr populates the
+//				shared one: about 200 public codes under 512, the dithered
+//				codes 256-511 as private colors, and a handful of file-local
+//				direct colors (0x2RRGGBB codes) in the overflow. Lookups follow
+//				a typical model's mix: mostly 16 and 24, then the common solid
+//				colors, with the odd private or direct color.
+//
+//				The old path boxed each code in a number object and probed the
+//				public dictionary, then the private one. On the Mac that is
+//				measured with CFNumber and CFDictionary; elsewhere a chained
+//				hash table with boxed keys and callbacks stands in for it.
+//
+// Build:		cc -O2 -I../Source/LDraw/Support ColorLookupBenchmark.c
+//					../Source/LDraw/Support/LDrawColorTable.c
+//				(add -framework CoreFoundation on the Mac)
+//
+// Usage:		./a.out [lookup count]
+//
+//==============================================================================
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkSupport.h"
+#include "LDrawColorTable.h"
+
+#ifdef __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+
+#define PUBLIC_COLOR_COUNT		200
+#define DIRECT_COLOR_COUNT		24
+
+// Stand-in for an LDrawColor.
+typedef struct
+{
+	int32_t	code;
+	int32_t	edgeCode;
+	float	rgba[4];
+
+} BenchmarkColor;
+
+static BenchmarkColor	Colors[PUBLIC_COLOR_COUNT + 256 + DIRECT_COLOR_COUNT];
+static int				ColorCount	= 0;
+
+
+#pragma mark -
+#pragma mark DICTIONARY BASELINE
+#pragma mark -
+
+#ifdef __APPLE__
+
+typedef CFMutableDictionaryRef BaselineDictionary;
+
+//========== baselineCreate ====================================================
+//
+// Purpose:		Returns an empty dictionary keyed by CFNumbers.
+//
+//==============================================================================
+static BaselineDictionary baselineCreate(void)
+{
+	return CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+}
+
+
+//========== baselineSet =======================================================
+//
+// Purpose:		Files color under code.
+//
+//==============================================================================
+static void baselineSet(BaselineDictionary dictionary, int32_t code, const void *color)
+{
+	CFNumberRef key = CFNumberCreate(NULL, kCFNumberSInt32Type, &code);
+	CFDictionarySetValue(dictionary, key, color);
+	CFRelease(key);
+}
+
+
+//========== baselineGet =======================================================
+//
+// Purpose:		Boxes the code and probes, as -[NSDictionary objectForKey:] did.
+//
+//==============================================================================
+static const void *baselineGet(BaselineDictionary dictionary, int32_t code)
+{
+	CFNumberRef	key		= CFNumberCreate(NULL, kCFNumberSInt32Type, &code);
+	const void	*color	= CFDictionaryGetValue(dictionary, key);
+	CFRelease(key);
+	return color;
+}
+
+
+//========== baselineFree ======================================================
+//
+// Purpose:		Releases the dictionary and its keys.
+//
+//==============================================================================
+static void baselineFree(BaselineDictionary dictionary)
+{
+	CFRelease(dictionary);
+}
+
+#else
+
+typedef struct BaselineNodeStruct
+{
+	int32_t						*key;
+	const void					*value;
+	struct BaselineNodeStruct	*next;
+
+} BaselineNode;
+
+typedef struct
+{
+	BaselineNode	*buckets[64];
+	uint32_t		(*hash)(const void *key);
+	bool			(*equal)(const void *key1, const void *key2);
+
+} BaselineDictionaryStruct;
+
+typedef BaselineDictionaryStruct *BaselineDictionary;
+
+static uint32_t	baselineHash(const void *key)					{ return (uint32_t)*(const int32_t *)key; }
+static bool		baselineEqual(const void *key1, const void *key2)	{ return *(const int32_t *)key1 == *(const int32_t *)key2; }
+
+
+//========== baselineBox =======================================================
+//
+// Purpose:		Allocates a boxed code, like a non-tagged number object.
+//
+//==============================================================================
+static int32_t *baselineBox(int32_t code)
+{
+	int32_t *box = malloc(sizeof(int32_t));
+	*box = code;
+	return box;
+}
+
+
+//========== baselineCreate ====================================================
+//
+// Purpose:		Returns an empty dictionary.
+//
+//==============================================================================
+static BaselineDictionary baselineCreate(void)
+{
+	BaselineDictionary dictionary = calloc(1, sizeof(BaselineDictionaryStruct));
+	dictionary->hash	= baselineHash;
+	dictionary->equal	= baselineEqual;
+	return dictionary;
+}
+
+
+//========== baselineSet =======================================================
+//
+// Purpose:		Files color under code. Codes are never registered twice here.
+//
+//==============================================================================
+static void baselineSet(BaselineDictionary dictionary, int32_t code, const void *color)
+{
+	int32_t			*key	= baselineBox(code);
+	uint32_t		bucket	= dictionary->hash(key) % 64;
+	BaselineNode	*node	= malloc(sizeof(BaselineNode));
+
+	node->key		= key;
+	node->value		= color;
+	node->next		= dictionary->buckets[bucket];
+	dictionary->buckets[bucket] = node;
+}
+
+
+//========== baselineGet =======================================================
+//
+// Purpose:		Boxes the code and probes through the callbacks.
+//
+//==============================================================================
+static const void *baselineGet(BaselineDictionary dictionary, int32_t code)
+{
+	int32_t			*key	= baselineBox(code);
+	BaselineNode	*node	= dictionary->buckets[dictionary->hash(key) % 64];
+	const void		*color	= NULL;
+
+	for(; node != NULL; node = node->next)
+	{
+		if(dictionary->equal(node->key, key))
+		{
+			color = node->value;
+			break;
+		}
+	}
+	free(key);
+	return color;
+}
+
+
+//========== baselineFree ======================================================
+//
+// Purpose:		Frees the dictionary, its nodes and their boxed keys. The
+//				colors belong to the caller.
+//
+//==============================================================================
+static void baselineFree(BaselineDictionary dictionary)
+{
+	BaselineNode	*node	= NULL;
+	BaselineNode	*next	= NULL;
+	int				bucket	= 0;
+
+	for(bucket = 0; bucket < 64; bucket++)
+	{
+		for(node = dictionary->buckets[bucket]; node != NULL; node = next)
+		{
+			next = node->next;
+			free(node->key);
+			free(node);
+		}
+	}
+	free(dictionary);
+}
+
+#endif
+
+
+#pragma mark -
+#pragma mark BENCHMARK
+#pragma mark -
+
+//========== addColor ==========================================================
+//
+// Purpose:		Makes a color with plausible components.
+//
+//==============================================================================
+static BenchmarkColor *addColor(int32_t code, uint32_t *seed)
+{
+	BenchmarkColor *color = &Colors[ColorCount++];
+
+	color->code		= code;
+	color->edgeCode	= (BenchmarkRandom(seed) % 4 == 0) ? 0 : -1;
+	color->rgba[0]	= BenchmarkRandomFloat(seed, 0, 1);
+	color->rgba[1]	= BenchmarkRandomFloat(seed, 0, 1);
+	color->rgba[2]	= BenchmarkRandomFloat(seed, 0, 1);
+	color->rgba[3]	= 1.0f;
+	return color;
+}
+
+
+//========== complimentOf ======================================================
+//
+// Purpose:		What ColorLibrary works out when a compliment isn't cached: the
+//				edge color's components, or derived ones.
+//
+//==============================================================================
+static void complimentOf(const BenchmarkColor *color, const BenchmarkColor *edgeColor, float *complimentRGBA)
+{
+	int counter = 0;
+
+	if(color->edgeCode >= 0 && edgeColor != NULL)
+	{
+		memcpy(complimentRGBA, edgeColor->rgba, sizeof(color->rgba));
+		return;
+	}
+	for(counter = 0; counter < 3; counter++)
+		complimentRGBA[counter] = (color->rgba[counter] > 0.5f) ? color->rgba[counter] - 0.4f : color->rgba[counter] + 0.4f;
+	complimentRGBA[3] = color->rgba[3];
+}
+
+
+//========== main ==============================================================
+//
+// Purpose:		Builds both structures, then resolves the same stream of codes
+//				(and their compliments) through each.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	size_t				lookupCount		= (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000000;
+	uint32_t			seed			= 0x5EED;
+	int32_t				*codes			= malloc(lookupCount * sizeof(int32_t));
+	int32_t				commonCodes[24]	= { 0 };
+	int32_t				directCodes[DIRECT_COLOR_COUNT];
+	BaselineDictionary	publicColors	= baselineCreate();
+	BaselineDictionary	privateColors	= baselineCreate();
+	LDrawColorTable		*table			= LDrawColorTableCreate();
+	double				startTime		= 0;
+	double				baselineTime	= 0;
+	double				tableTime		= 0;
+	float				checksumA		= 0;
+	float				checksumB		= 0;
+	size_t				index			= 0;
+	int					counter			= 0;
+
+	//---------- Populate ------------------------------------------------------
+
+	for(counter = 0; counter < PUBLIC_COLOR_COUNT; counter++)
+	{
+		// ldconfig's codes are scattered over 0-511, denser at the bottom.
+		int32_t			code	= (counter < 100) ? counter : 100 + (counter - 100) * 4 + 1;
+		BenchmarkColor	*color	= addColor(code, &seed);
+
+		baselineSet(publicColors, code, color);
+		LDrawColorTableInsert(table, code, color);
+		if(counter < 24)
+			commonCodes[counter] = code;
+	}
+	commonCodes[0] = 16;
+	commonCodes[1] = 24;
+	for(counter = 256; counter <= 511; counter++)
+	{
+		BenchmarkColor *color = addColor(counter, &seed);
+
+		baselineSet(privateColors, counter, color);
+		if(LDrawColorTableLookup(table, counter) == NULL)
+			LDrawColorTableInsert(table, counter, color);
+	}
+	for(counter = 0; counter < DIRECT_COLOR_COUNT; counter++)
+	{
+		int32_t			code	= 0x2000000 | (BenchmarkRandom(&seed) & 0xFFFFFF);
+		BenchmarkColor	*color	= addColor(code, &seed);
+
+		baselineSet(publicColors, code, color);
+		LDrawColorTableInsert(table, code, color);
+		directCodes[counter] = code;
+	}
+
+	for(index = 0; index < lookupCount; index++)
+	{
+		uint32_t roll = BenchmarkRandom(&seed) % 100;
+
+		if(roll < 60)		codes[index] = (roll % 2) ? 16 : 24;
+		else if(roll < 95)	codes[index] = commonCodes[BenchmarkRandom(&seed) % 24];
+		else if(roll < 98)	codes[index] = 256 + BenchmarkRandom(&seed) % 256;
+		else				codes[index] = directCodes[BenchmarkRandom(&seed) % DIRECT_COLOR_COUNT];
+	}
+
+	//---------- Dictionaries --------------------------------------------------
+	// Compliments were worked out on every request.
+
+	startTime = BenchmarkNow();
+	for(index = 0; index < lookupCount; index++)
+	{
+		const BenchmarkColor	*color			= baselineGet(publicColors, codes[index]);
+		const BenchmarkColor	*edgeColor		= NULL;
+		float					complimentRGBA[4];
+
+		if(color == NULL)
+			color = baselineGet(privateColors, codes[index]);
+		if(color->edgeCode >= 0)
+			edgeColor = baselineGet(publicColors, color->edgeCode);
+		complimentOf(color, edgeColor, complimentRGBA);
+		checksumA += color->rgba[0] + complimentRGBA[0];
+	}
+	baselineTime = BenchmarkNow() - startTime;
+
+	//---------- Color table ---------------------------------------------------
+
+	startTime = BenchmarkNow();
+	for(index = 0; index < lookupCount; index++)
+	{
+		LDrawColorTableEntry	*entry		= LDrawColorTableLookup(table, codes[index]);
+		const BenchmarkColor	*color		= entry->color;
+		float					complimentRGBA[4];
+
+		if(LDrawColorTableGetCompliment(table, entry, complimentRGBA) == false)
+		{
+			LDrawColorTableEntry *edgeEntry = (color->edgeCode >= 0) ? LDrawColorTableLookup(table, color->edgeCode) : NULL;
+
+			complimentOf(color, edgeEntry ? edgeEntry->color : NULL, complimentRGBA);
+			LDrawColorTableSetCompliment(table, entry, complimentRGBA);
+		}
+		checksumB += color->rgba[0] + complimentRGBA[0];
+	}
+	tableTime = BenchmarkNow() - startTime;
+
+	printf("colors:        %d (%d overflow)\n", ColorCount, (int)table->overflowCount);
+	printf("lookups:       %zu\n", lookupCount);
+	printf("dictionaries:  %8.1f ms  %6.2f ns/lookup\n", baselineTime * 1e3, baselineTime * 1e9 / lookupCount);
+	printf("color table:   %8.1f ms  %6.2f ns/lookup\n", tableTime * 1e3, tableTime * 1e9 / lookupCount);
+	printf("speedup:       %8.1fx\n", baselineTime / tableTime);
+	printf("results match: %s\n", (checksumA == checksumB) ? "yes" : "NO");
+
+	baselineFree(publicColors);
+	baselineFree(privateColors);
+	LDrawColorTableFree(table);
+	free(codes);
+
+	return (checksumA == checksumB) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}//end main
@@ -0,0 +1,176 @@
+//==============================================================================
+//
+// File:		CompactVertexReport.c
+//
+// Purpose:		Reports what compact output (see MeshSmooth.h) saves on each
+//				part's smoothed mesh, and what it costs: the bytes of the
+//				vertex and index tables as write_indexed_mesh writes them and
+//				as compact vertices with narrowed indices, the time taken to
+//				convert, and the worst position and normal error after the
+//				round trip through decode_compact_vertices.
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					CompactVertexReport.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [ldraw folder part.dat ...]
+//				Without a library, reports on synthetic tori and a baseplate.
+//
+//==============================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "MeshSmooth.h"
+
+#define REPEATS			10
+
+
+//========== reportMesh ========================================================
+//
+// Purpose:		Smooths flat, converts it and prints its line of the report.
+//
+//==============================================================================
+static void reportMesh(const char *name, const FlatMesh *flat)
+{
+	struct Mesh				*mesh			= NULL;
+	SmoothedMesh			smoothed;
+	struct compact_bounds	bounds;
+	struct compact_vertex	*compact		= NULL;
+	float					*vertices		= NULL;
+	float					*decoded		= NULL;
+	unsigned int			*indices		= NULL;
+	void					*narrow			= NULL;
+	int						vertexCount		= 0;
+	int						indexCount		= 0;
+	int						indexSize		= 0;
+	int						counter			= 0;
+	int						repeat			= 0;
+	double					start			= 0;
+	double					convertTime		= 0;
+	double					positionError	= 0;
+	double					normalError		= 0;
+	size_t					floatBytes		= 0;
+	size_t					compactBytes	= 0;
+
+	mesh = smoothFlatMesh(flat);
+	optimize_vertex_cache(mesh);
+	writeSmoothedMesh(mesh, &smoothed);
+
+	vertices	= smoothed.vertices;
+	indices		= smoothed.indices;
+	vertexCount	= smoothed.vertexCount;
+	indexCount	= smoothed.indexCount;
+	decoded		= malloc(sizeof(float) * 10 * vertexCount);
+	compact		= malloc(sizeof(struct compact_vertex) * vertexCount);
+	narrow		= malloc(sizeof(unsigned int) * indexCount);
+
+	indexSize = get_compact_index_size(vertexCount);
+
+	start = BenchmarkNow();
+	for(repeat = 0; repeat < REPEATS; repeat++)
+	{
+		get_compact_bounds(vertices, vertexCount, &bounds);
+		write_compact_vertices(vertices, vertexCount, &bounds, compact);
+		write_compact_indices(indices, indexCount, indexSize, narrow);
+	}
+	convertTime = (BenchmarkNow() - start) / REPEATS;
+
+	decode_compact_vertices(compact, vertexCount, &bounds, decoded);
+	for(counter = 0; counter < vertexCount; counter++)
+	{
+		const float	*a		= vertices + counter * 10;
+		const float	*b		= decoded + counter * 10;
+		double		dx		= a[0] - b[0];
+		double		dy		= a[1] - b[1];
+		double		dz		= a[2] - b[2];
+		double		cosine	= a[3] * b[3] + a[4] * b[4] + a[5] * b[5];
+
+		positionError = fmax(positionError, sqrt(dx * dx + dy * dy + dz * dz));
+		if(a[3] != 0 || a[4] != 0 || a[5] != 0)
+			normalError = fmax(normalError, acos(fmin(cosine, 1.0)) * 180.0 / M_PI);
+	}
+
+	floatBytes		= sizeof(float) * 10 * vertexCount + sizeof(unsigned int) * indexCount;
+	compactBytes	= sizeof(struct compact_vertex) * vertexCount + (size_t)indexSize * indexCount;
+
+	printf("%-22s %8d %8d %10zu %10zu  %5.2fx  %7.3f ms  %8.5f  %7.4f\n",
+		   name, vertexCount, indexCount, floatBytes, compactBytes,
+		   (double)floatBytes / compactBytes, convertTime * 1e3, positionError, normalError);
+
+	freeSmoothedMesh(&smoothed);
+	free(decoded);
+	free(compact);
+	free(narrow);
+}
+
+
+//========== addBaseplate ======================================================
+//
+// Purpose:		The studs of a size x size baseplate, one faceted stud on
+//				every 20 LDU square - as wide as parts in the library get.
+//
+//==============================================================================
+static void addBaseplate(FlatMesh *flat, int size)
+{
+	int x, z;
+
+	for(x = 0; x < size; x++)
+	for(z = 0; z < size; z++)
+		addStud(flat, x * 20.0f + 10.0f, 0, z * 20.0f + 10.0f);
+}
+
+
+int main(int argc, const char *argv[])
+{
+	static const float	identity[12]	= { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0 };
+	int					counter			= 0;
+
+	printf("%-22s %8s %8s %10s %10s  %6s  %10s  %8s  %7s\n",
+		   "part", "vertices", "indices", "float B", "compact B", "saved", "convert", "pos LDU", "nrm deg");
+
+	if(argc > 2)
+	{
+		for(counter = 2; counter < argc; counter++)
+		{
+			FlatMesh flat;
+
+			memset(&flat, 0, sizeof(flat));
+			flattenPart(&flat, argv[1], argv[counter], identity, 0);
+			if(flat.missingFiles)
+				fprintf(stderr, "%s: %d files not found\n", argv[counter], flat.missingFiles);
+			if(flat.polygonCount > 0)
+				reportMesh(argv[counter], &flat);
+
+			free(flat.polygons);
+			free(flat.lines);
+		}
+	}
+	else
+	{
+		FlatMesh flat;
+
+		memset(&flat, 0, sizeof(flat));
+		addTorus(&flat, 48, 24, 10.0f, TORUS_RING_LINES);
+		reportMesh("torus 48 x 24, r 10", &flat);
+		free(flat.polygons);
+		free(flat.lines);
+
+		memset(&flat, 0, sizeof(flat));
+		addTorus(&flat, 384, 192, 200.0f, TORUS_RING_LINES);
+		reportMesh("torus 384 x 192, r 200", &flat);
+		free(flat.polygons);
+		free(flat.lines);
+
+		memset(&flat, 0, sizeof(flat));
+		addBaseplate(&flat, 32);
+		reportMesh("baseplate 32 x 32", &flat);
+		free(flat.polygons);
+		free(flat.lines);
+	}
+
+	return 0;
+}
@@ -0,0 +1,332 @@
+//==============================================================================
+//
+// File:		CullBVHBenchmark.c
+//
+// Purpose:		Times culling a 100,000 part city layout, part by part and
+//				through a BVH, from a few views, and checks that:
+//
+//				- every view draws exactly the same parts, with the same cull
+//				  codes, either way - with and without dropping subtrees under
+//				  a pixel;
+//				- that still holds after refitting moved parts, and the tree
+//				  asks to be rebuilt once the moves have loosened it enough.
+//
+//				Part by part is what big models used to do: ask checkCull about
+//				every part, every frame. Through the BVH, one walk of the tree
+//				finds the parts that may be visible and checkCull only looks at
+//				those. The checkCull here is LDrawShaderRenderer's.
+//
+// Build:		cc -O2 -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					CullBVHBenchmark.c
+//					../Source/LDraw/Renderer/LDrawBVH.c
+//					../Source/LDraw/Support/MatrixMathEx.c -lm
+//
+// Usage:		./a.out [parts]
+//
+//==============================================================================
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "LDrawBVH.h"
+#include "MatrixMathEx.h"
+
+#define DEFAULT_PARTS	100000
+#define RUNS			5
+
+#define BLOCKS			40				// city is BLOCKS x BLOCKS blocks
+#define BLOCK_SIZE		400				// LDU, plus a street
+#define STREET_SIZE		160
+
+enum { CULL_SKIP, CULL_BOX, CULL_DRAW };
+
+static const float pixelScale[2] = { 512.0f, 384.0f };
+
+
+//========== checkCull =========================================================
+//
+// Purpose:		LDrawShaderRenderer's checkCull:to:, on one box.
+//
+//==============================================================================
+static int checkCull(const float box[6], const float mvp[16])
+{
+	float	ndc[6];
+	int		xPix, yPix, dim;
+
+	if(box[0] > box[3] || box[1] > box[4] || box[2] > box[5])
+		return CULL_SKIP;
+
+	aabbToClipbox(box, mvp, ndc);
+
+	if(ndc[3] < -1.0f || ndc[4] < -1.0f || ndc[0] > 1.0f || ndc[1] > 1.0f)
+		return CULL_SKIP;
+
+	xPix	= (ndc[3] - ndc[0]) * 512.0;
+	yPix	= (ndc[4] - ndc[1]) * 384.0;
+	dim		= xPix > yPix ? xPix : yPix;
+
+	if(dim < 1)
+		return CULL_SKIP;
+	if(dim < 10)
+		return CULL_BOX;
+
+	return CULL_DRAW;
+
+}//end checkCull
+
+
+//========== makeCity ==========================================================
+//
+// Purpose:		Stacks bricks into a grid of buildings of random heights,
+//				separated by streets. Bricks are 1x1 to 2x4, on the stud grid.
+//
+//==============================================================================
+static float *makeCity(int count)
+{
+	float		*boxes		= (float *)malloc(sizeof(float) * 6 * count);
+	float		heights[BLOCKS * BLOCKS];
+	uint32_t	seed		= 1977;
+	int			counter		= 0;
+
+	for(counter = 0; counter < BLOCKS * BLOCKS; counter++)
+		heights[counter] = 24 * (1 + (int)BenchmarkRandomFloat(&seed, 0, 80));
+
+	for(counter = 0; counter < count; counter++)
+	{
+		float	*box	= boxes + 6 * counter;
+		int		block	= (int)BenchmarkRandomFloat(&seed, 0, BLOCKS * BLOCKS);
+		float	left	= (block % BLOCKS) * (BLOCK_SIZE + STREET_SIZE) - BLOCKS * (BLOCK_SIZE + STREET_SIZE) / 2;
+		float	back	= (block / BLOCKS) * (BLOCK_SIZE + STREET_SIZE) - BLOCKS * (BLOCK_SIZE + STREET_SIZE) / 2;
+		float	width	= 20 * (1 + (int)BenchmarkRandomFloat(&seed, 0, 4));
+		float	depth	= 20 * (1 + (int)BenchmarkRandomFloat(&seed, 0, 2));
+
+		box[0] = left + 20 * (int)BenchmarkRandomFloat(&seed, 0, (BLOCK_SIZE - width) / 20);
+		box[2] = back + 20 * (int)BenchmarkRandomFloat(&seed, 0, (BLOCK_SIZE - depth) / 20);
+		box[1] = -24 * (int)BenchmarkRandomFloat(&seed, 1, heights[block] / 24 + 1);
+		box[3] = box[0] + width;
+		box[4] = box[1] + 24;
+		box[5] = box[2] + depth;
+	}
+
+	return boxes;
+
+}//end makeCity
+
+
+//========== cullEach ==========================================================
+//
+// Purpose:		The old way: checkCull on every part. Returns the time taken.
+//
+//==============================================================================
+static double cullEach(const float *boxes, int count, const float mvp[16], unsigned char *codes)
+{
+	double	start	= BenchmarkNow();
+	int		counter	= 0;
+
+	for(counter = 0; counter < count; counter++)
+		codes[counter] = (unsigned char)checkCull(boxes + 6 * counter, mvp);
+
+	return BenchmarkNow() - start;
+
+}//end cullEach
+
+
+//========== cullTree ==========================================================
+//
+// Purpose:		The new way: checkCull on what the BVH lets through. Parts it
+//				doesn't are left at CULL_SKIP. Returns the time taken, and how
+//				many parts came through the tree in passed.
+//
+//==============================================================================
+static double cullTree(const LDrawBVH *bvh, const float *boxes, const float mvp[16],
+					   const float *scale, int *visible, unsigned char *codes, int *passed)
+{
+	double	start	= BenchmarkNow();
+	int		found	= LDrawBVHCull(bvh, mvp, scale, visible);
+	int		counter	= 0;
+
+	for(counter = 0; counter < found; counter++)
+		codes[visible[counter]] = (unsigned char)checkCull(boxes + 6 * visible[counter], mvp);
+
+	*passed = found;
+	return BenchmarkNow() - start;
+
+}//end cullTree
+
+
+//========== compareCodes ======================================================
+//
+// Purpose:		Checks the BVH drew just what checkCull on every part did.
+//
+//==============================================================================
+static bool compareCodes(const LDrawBVH *bvh, const float *boxes, int count, const View *view,
+						 const float *scale, const char *label)
+{
+	unsigned char	*expected	= (unsigned char *)malloc(count);
+	unsigned char	*actual		= (unsigned char *)calloc(count, 1);
+	int				*visible	= (int *)malloc(sizeof(int) * count);
+	int				wrong		= 0;
+	int				passed		= 0;
+	int				counter		= 0;
+
+	cullEach(boxes, count, view->mvp, expected);
+	cullTree(bvh, boxes, view->mvp, scale, visible, actual, &passed);
+
+	for(counter = 0; counter < count; counter++)
+		wrong += expected[counter] != actual[counter];
+
+	if(wrong)
+		printf("FAILED: %s view, %s: %d parts culled differently\n", view->name, label, wrong);
+
+	free(visible);
+	free(actual);
+	free(expected);
+
+	return wrong == 0;
+
+}//end compareCodes
+
+
+//========== timeView ==========================================================
+//
+// Purpose:		Prints the best times for one view, both ways.
+//
+//==============================================================================
+static void timeView(const LDrawBVH *bvh, const float *boxes, int count, const View *view)
+{
+	unsigned char	*codes		= (unsigned char *)malloc(count);
+	int				*visible	= (int *)malloc(sizeof(int) * count);
+	double			eachBest	= 1e9;
+	double			treeBest	= 1e9;
+	int				tally[3]	= { 0, 0, 0 };
+	int				passed		= 0;
+	int				run			= 0;
+	int				counter		= 0;
+
+	for(run = 0; run < RUNS; run++)
+	{
+		double each, tree;
+
+		each = cullEach(boxes, count, view->mvp, codes);
+		memset(codes, CULL_SKIP, count);
+		tree = cullTree(bvh, boxes, view->mvp, pixelScale, visible, codes, &passed);
+
+		eachBest = each < eachBest ? each : eachBest;
+		treeBest = tree < treeBest ? tree : treeBest;
+	}
+	for(counter = 0; counter < count; counter++)
+		tally[codes[counter]]++;
+
+	printf("  %-9s %6d drawn, %6d boxes, %6d through the tree: "
+		   "each %7.3f ms, BVH %7.3f ms (%.1fx)\n",
+		   view->name, tally[CULL_DRAW], tally[CULL_BOX], passed,
+		   eachBest * 1000, treeBest * 1000, eachBest / treeBest);
+
+	free(visible);
+	free(codes);
+
+}//end timeView
+
+
+//========== main ==============================================================
+//
+// Purpose:		Runs the checks and the timing.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	int			count		= (argc > 1) ? atoi(argv[1]) : DEFAULT_PARTS;
+	float		*boxes		= makeCity(count);
+	float		extent		= BLOCKS * (BLOCK_SIZE + STREET_SIZE) / 2;
+	LDrawBVH	*bvh		= NULL;
+	View		views[4];
+	uint32_t	seed		= 99;
+	double		start		= 0;
+	double		buildTime	= 0;
+	double		updateTime	= 0;
+	bool		passed		= true;
+	int			viewCount	= 4;
+	int			moved		= 0;
+	int			counter		= 0;
+
+	makeView(views + 0, "street", -extent, -60, STREET_SIZE / 2 - 10, -90, 2);
+	makeView(views + 1, "corner", extent * 0.7f, -400, extent * 0.7f, 135, 15);
+	makeView(views + 2, "overview", 0, -6 * extent, -4 * extent, 0, 55);
+	makeView(views + 3, "close", 0, -300, 600, 0, 25);
+
+	start		= BenchmarkNow();
+	bvh			= LDrawBVHCreate(boxes, count);
+	buildTime	= BenchmarkNow() - start;
+
+	printf("%d parts, BVH built in %.2f ms; best of %d:\n", count, buildTime * 1000, RUNS);
+	for(counter = 0; counter < viewCount; counter++)
+	{
+		timeView(bvh, boxes, count, views + counter);
+		passed = compareCodes(bvh, boxes, count, views + counter, pixelScale, "by size") && passed;
+		passed = compareCodes(bvh, boxes, count, views + counter, NULL, "frustum only") && passed;
+	}
+
+	// Nudge one part in a hundred a brick or so, as dragging would.
+	start = BenchmarkNow();
+	for(counter = 0; counter < count; counter += 100)
+	{
+		float *box	= boxes + 6 * counter;
+		float dx	= 20 * (int)BenchmarkRandomFloat(&seed, -3, 4);
+		float dz	= 20 * (int)BenchmarkRandomFloat(&seed, -3, 4);
+
+		box[0] += dx;	box[3] += dx;
+		box[2] += dz;	box[5] += dz;
+		LDrawBVHUpdate(bvh, counter, box);
+		moved++;
+	}
+	updateTime = BenchmarkNow() - start;
+	printf("  refit %d moved parts in %.3f ms (%.2f us each); %s\n", moved, updateTime * 1000,
+		   updateTime * 1e6 / moved, LDrawBVHNeedsRebuild(bvh) ? "needs rebuild" : "still tight");
+	passed = !LDrawBVHNeedsRebuild(bvh) && passed;
+	for(counter = 0; counter < viewCount; counter++)
+		passed = compareCodes(bvh, boxes, count, views + counter, pixelScale, "after refit") && passed;
+
+	// Now scatter parts right across the city until the tree gives up.
+	for(moved = 0; moved < count && !LDrawBVHNeedsRebuild(bvh); moved++)
+	{
+		int		index	= (int)BenchmarkRandomFloat(&seed, 0, count);
+		float	*box	= boxes + 6 * index;
+		float	x		= BenchmarkRandomFloat(&seed, -extent, extent);
+		float	z		= BenchmarkRandomFloat(&seed, -extent, extent);
+
+		box[3] += x - box[0];	box[0] = x;
+		box[5] += z - box[2];	box[2] = z;
+		LDrawBVHUpdate(bvh, index, box);
+	}
+	printf("  tree asked to be rebuilt after %d parts were scattered\n", moved);
+	passed = moved < count && passed;
+	passed = compareCodes(bvh, boxes, count, views + 0, pixelScale, "scattered") && passed;
+
+	// Hidden parts are empty boxes.
+	for(counter = 0; counter < count; counter += 7)
+	{
+		float *box = boxes + 6 * counter;
+
+		box[3] = box[0] - 1;
+		LDrawBVHUpdate(bvh, counter, box);
+	}
+	passed = compareCodes(bvh, boxes, count, views + 2, pixelScale, "hidden") && passed;
+
+	LDrawBVHDestroy(bvh);
+
+	// A single part, and nothing at all.
+	bvh = LDrawBVHCreate(boxes + 6, 1);
+	passed = compareCodes(bvh, boxes + 6, 1, views + 3, pixelScale, "one part") && passed;
+	LDrawBVHDestroy(bvh);
+	passed = LDrawBVHCreate(boxes, 0) == NULL && LDrawBVHCull(NULL, views[0].mvp, NULL, NULL) == 0 && passed;
+
+	free(boxes);
+
+	printf("%s\n", passed ? "PASSED" : "FAILED");
+	return passed ? 0 : 1;
+
+}//end main
@@ -0,0 +1,347 @@
+//==============================================================================
+//
+// File:		DLBuildQueueBenchmark.c
+//
+// Purpose:		Bakes display list meshes on the build queue, the way the
+//				renderer does when it draws boxes until they are ready, and
+//				checks and times it against baking on the spot:
+//
+//				- every queued bake must be exactly the synchronous one, whether
+//				  smoothed or read back from the mesh cache;
+//				- cancelled jobs must be discarded exactly once, whether they
+//				  were queued, running or done, and never finished;
+//				- the render thread's cost of a build must be the submit alone.
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					DLBuildQueueBenchmark.c
+//					../Source/LDraw/Renderer/LDrawDLBuildQueue.c
+//					../Source/LDraw/Renderer/LDrawMeshCache.c
+//					../Source/LDraw/Support/LDrawAtomicWrite.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [threads]
+//				Threads defaults to the queue's own choice.
+//
+//==============================================================================
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "LDrawDLBuildQueue.h"
+#include "MeshSmooth.h"
+
+#define JOB_COUNT		64
+
+// One display list on its way through the queue.
+typedef struct
+{
+	const FlatMesh	*flat;
+	LDrawDLBake		bake;
+	int				builds;
+	int				discards;
+
+} BuildContext;
+
+static const float		meshColors[2][4]	= { { 0.5f, 0.5f, 0.5f, 1.0f }, { 0.8f, 0.1f, 0.1f, 1.0f } };
+static pthread_mutex_t	countLock			= PTHREAD_MUTEX_INITIALIZER;
+
+
+//========== startBake =========================================================
+//
+// Purpose:		Collects flat into a bake as a display list builder would: a
+//				growable mesh and a cache key fed the same faces. Every other
+//				ring of quads goes to a second texture.
+//
+//==============================================================================
+static void startBake(BuildContext *context, const FlatMesh *flat)
+{
+	struct Mesh				*mesh	= create_growable_mesh();
+	LDrawMeshCacheHasher	hasher;
+	int						counter	= 0;
+
+	memset(context, 0, sizeof(*context));
+	context->flat = flat;
+
+	LDrawMeshCacheHasherInit(&hasher, LDrawMeshCacheRemovedTJunctions | LDrawMeshCacheOptimizedVertexCache);
+	for(counter = 0; counter < flat->polygonCount; counter++)
+	{
+		const Primitive	*p		= flat->polygons + counter;
+		const float		*p4		= (p->degree == 4) ? p->points[3] : NULL;
+		int				tid		= (counter / 64) & 1;
+
+		add_face(mesh, p->points[0], p->points[1], p->points[2], p4, meshColors[tid], tid);
+		LDrawMeshCacheHasherAddFace(&hasher, p->points[0], p->points[1], p->points[2], p4, meshColors[tid], tid);
+	}
+	for(counter = 0; counter < flat->lineCount; counter++)
+	{
+		add_face(mesh, flat->lines[counter].points[0], flat->lines[counter].points[1], NULL, NULL, meshColors[0], 0);
+		LDrawMeshCacheHasherAddFace(&hasher, flat->lines[counter].points[0], flat->lines[counter].points[1], NULL, NULL, meshColors[0], 0);
+	}
+
+	LDrawDLBakeInit(&context->bake, mesh, (flat->polygonCount > 64) ? 2 : 1, flat->polygonCount, &hasher);
+}
+
+
+//========== buildJob ==========================================================
+//
+// Purpose:		The queue's build function.
+//
+//==============================================================================
+static void buildJob(void *ref)
+{
+	BuildContext *context = ref;
+
+	LDrawDLBakeRun(&context->bake);
+
+	pthread_mutex_lock(&countLock);
+	context->builds++;
+	pthread_mutex_unlock(&countLock);
+}
+
+
+//========== discardJob ========================================================
+//
+// Purpose:		The queue's discard function.
+//
+//==============================================================================
+static void discardJob(void *ref)
+{
+	BuildContext *context = ref;
+
+	LDrawDLBakeRelease(&context->bake);
+
+	pthread_mutex_lock(&countLock);
+	context->discards++;
+	pthread_mutex_unlock(&countLock);
+}
+
+
+//========== sameBake ==========================================================
+//
+// Purpose:		Returns whether two bakes came out byte for byte the same.
+//
+//==============================================================================
+static bool sameBake(const LDrawDLBake *a, const LDrawDLBake *b)
+{
+	return		a->vertexCount == b->vertexCount
+			&&	a->indexCount == b->indexCount
+			&&	a->textureCount == b->textureCount
+			&&	memcmp(a->lineStarts, b->lineStarts, sizeof(int) * 8 * a->textureCount) == 0
+			&&	memcmp(a->vertices, b->vertices, sizeof(float) * LDRAW_MESH_CACHE_VERTEX_STRIDE * a->vertexCount) == 0
+			&&	memcmp(a->indices, b->indices, sizeof(uint32_t) * a->indexCount) == 0;
+}
+
+
+//========== compareQueued =====================================================
+//
+// Purpose:		Bakes each mesh on the spot, then all of them on the queue at
+//				once, and prints one row per mesh. Returns whether every queued
+//				bake matched.
+//
+//==============================================================================
+static bool compareQueued(LDrawDLBuildQueue *queue, const FlatMesh *flats, const char **names, int count)
+{
+	BuildContext	*sync		= calloc(count, sizeof(BuildContext));
+	BuildContext	*queued		= calloc(count, sizeof(BuildContext));
+	LDrawDLBuildJob	**jobs		= calloc(count, sizeof(LDrawDLBuildJob *));
+	double			*syncTimes	= calloc(count, sizeof(double));
+	double			start		= 0;
+	double			submitTime	= 0;
+	double			syncTotal	= 0;
+	double			queuedTotal	= 0;
+	bool			identical	= true;
+	bool			same		= true;
+	int				counter		= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		startBake(sync + counter, flats + counter);
+		start = BenchmarkNow();
+		LDrawDLBuildJobFinish(LDrawDLBuildQueueSubmit(NULL, buildJob, discardJob, sync + counter));
+		syncTimes[counter] = BenchmarkNow() - start;
+		syncTotal += syncTimes[counter];
+	}
+
+	start = BenchmarkNow();
+	for(counter = 0; counter < count; counter++)
+	{
+		double submitStart = 0;
+
+		startBake(queued + counter, flats + counter);
+		submitStart = BenchmarkNow();
+		jobs[counter] = LDrawDLBuildQueueSubmit(queue, buildJob, discardJob, queued + counter);
+		submitTime += BenchmarkNow() - submitStart;
+	}
+	for(counter = 0; counter < count; counter++)
+		LDrawDLBuildJobFinish(jobs[counter]);
+	queuedTotal = BenchmarkNow() - start;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		same		= sameBake(&sync[counter].bake, &queued[counter].bake) && queued[counter].builds == 1;
+		identical	= identical && same;
+
+		printf("  %-24s %8d faces %10.3f ms  %s%s\n", names[counter], flats[counter].polygonCount,
+			   syncTimes[counter] * 1e3, same ? "identical" : "DIFFERS",
+			   queued[counter].bake.cached ? " (cached)" : "");
+
+		LDrawDLBakeRelease(&sync[counter].bake);
+		LDrawDLBakeRelease(&queued[counter].bake);
+	}
+
+	printf("  on the spot %.3f ms; queued %.3f ms wall, of which %.3f ms submitting\n",
+		   syncTotal * 1e3, queuedTotal * 1e3, submitTime * 1e3);
+
+	free(sync);
+	free(queued);
+	free(jobs);
+	free(syncTimes);
+
+	return identical;
+}
+
+
+//========== checkCancel =======================================================
+//
+// Purpose:		Cancels jobs in every state and makes sure each was either
+//				finished or discarded, exactly once. Returns whether they were.
+//
+//==============================================================================
+static bool checkCancel(LDrawDLBuildQueue *queue, const FlatMesh *flat)
+{
+	BuildContext	contexts[JOB_COUNT];
+	LDrawDLBuildJob	*jobs[JOB_COUNT];
+	bool			finished[JOB_COUNT];
+	bool			correct		= true;
+	int				cancelled	= 0;
+	int				counter		= 0;
+
+	for(counter = 0; counter < JOB_COUNT; counter++)
+	{
+		startBake(contexts + counter, flat);
+		jobs[counter]		= LDrawDLBuildQueueSubmit(queue, buildJob, discardJob, contexts + counter);
+		finished[counter]	= false;
+	}
+
+	// The first few are probably running by now, the rest still queued.
+	for(counter = 0; counter < JOB_COUNT; counter += 2)
+		LDrawDLBuildJobCancel(jobs[counter]);
+
+	// Of the rest, cancel the ones done first, then finish the others.
+	for(counter = 1; counter < JOB_COUNT; counter += 2)
+	{
+		if(LDrawDLBuildJobIsDone(jobs[counter]) && cancelled < JOB_COUNT / 8)
+		{
+			LDrawDLBuildJobCancel(jobs[counter]);
+			cancelled++;
+		}
+		else
+		{
+			LDrawDLBuildJobFinish(jobs[counter]);
+			finished[counter] = true;
+		}
+	}
+
+	// A job cancelled while running is discarded by its worker once it has
+	// been built.
+	for(counter = 0; counter < 10000; counter++)
+	{
+		bool	settled	= true;
+		int		index	= 0;
+
+		pthread_mutex_lock(&countLock);
+		for(index = 0; index < JOB_COUNT; index++)
+			settled = settled && (finished[index] || contexts[index].discards == 1);
+		pthread_mutex_unlock(&countLock);
+
+		if(settled)
+			break;
+		usleep(1000);
+	}
+
+	cancelled = 0;
+	for(counter = 0; counter < JOB_COUNT; counter++)
+	{
+		if(finished[counter])
+		{
+			correct = correct && contexts[counter].builds == 1 && contexts[counter].discards == 0;
+			LDrawDLBakeRelease(&contexts[counter].bake);
+		}
+		else
+		{
+			correct = correct && contexts[counter].builds <= 1 && contexts[counter].discards == 1;
+			cancelled++;
+		}
+	}
+
+	printf("  %d of %d jobs cancelled: %s\n", cancelled, JOB_COUNT, correct ? "each discarded once" : "WRONG");
+
+	return correct;
+}
+
+
+int main(int argc, const char *argv[])
+{
+	static const int	sizes[][2]		= { { 8, 4 }, { 24, 12 }, { 48, 24 }, { 96, 48 }, { 192, 96 }, { 384, 192 } };
+	const int			meshCount		= (int)(sizeof(sizes) / sizeof(sizes[0]));
+	FlatMesh			flats[sizeof(sizes) / sizeof(sizes[0])];
+	char				names[sizeof(sizes) / sizeof(sizes[0])][32];
+	const char			*namePointers[sizeof(sizes) / sizeof(sizes[0])];
+	char				directory[]		= "/tmp/DLBuildQueueBenchmark.XXXXXX";
+	char				command[64];
+	LDrawDLBuildQueue	*queue			= NULL;
+	bool				passed			= true;
+	int					counter			= 0;
+
+	queue = LDrawDLBuildQueueCreate(argc > 1 ? atoi(argv[1]) : 0);
+	if(queue == NULL)
+	{
+		fprintf(stderr, "no workers would start\n");
+		return 1;
+	}
+
+	memset(flats, 0, sizeof(flats));
+	for(counter = 0; counter < meshCount; counter++)
+	{
+		addTorus(flats + counter, sizes[counter][0], sizes[counter][1], 10.0f, TORUS_SEAM_LINES);
+		snprintf(names[counter], sizeof(names[counter]), "torus %d x %d", sizes[counter][0], sizes[counter][1]);
+		namePointers[counter] = names[counter];
+	}
+
+	printf("without the mesh cache:\n");
+	passed &= compareQueued(queue, flats, namePointers, meshCount);
+
+	if(mkdtemp(directory) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	LDrawMeshCacheSetDirectory(directory);
+
+	// The bakes on the spot save the big meshes, so the queued ones read them.
+	printf("with the mesh cache:\n");
+	passed &= compareQueued(queue, flats, namePointers, meshCount);
+
+	LDrawMeshCacheSetDirectory(NULL);
+	snprintf(command, sizeof(command), "rm -rf %s", directory);
+	system(command);
+
+	printf("cancelling:\n");
+	passed &= checkCancel(queue, flats + 3);
+
+	LDrawDLBuildQueueDestroy(queue);
+
+	for(counter = 0; counter < meshCount; counter++)
+	{
+		free(flats[counter].polygons);
+		free(flats[counter].lines);
+	}
+
+	return passed ? 0 : 1;
+}
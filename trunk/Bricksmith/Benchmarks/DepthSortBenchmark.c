@@ -0,0 +1,395 @@
+//==============================================================================
+//
+// File:		DepthSortBenchmark.c
+//
+// Purpose:		Times queueing and sorting 100,000 translucent parts for back
+//				to front drawing, the old way and the new, and checks that:
+//
+//				- the radix sort orders every key exactly as a comparison sort
+//				  would, with ties left in the order they were queued;
+//				- it handles both signs, zeroes, infinities and tiny inputs.
+//
+//				The old way is what the display list sessions used to do: link
+//				each instance onto a list as it is drawn, copy the list to an
+//				array with each depth, and qsort it with a comparator that
+//				truncated depth differences to whole LDraw units. The new way
+//				appends each instance and its depth to flat arrays and radix
+//				sorts (depth, index) pairs.
+//
+// Build:		cc -O2 -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					DepthSortBenchmark.c
+//					../Source/LDraw/Renderer/LDrawDepthSort.c
+//					../Source/LDraw/Support/MatrixMathEx.c -lm
+//
+// Usage:		./a.out [parts]
+//
+//==============================================================================
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkSupport.h"
+#include "LDrawDepthSort.h"
+#include "MatrixMathEx.h"
+
+#define DEFAULT_PARTS	100000
+#define RUNS			5
+
+// A sorted instance as the sessions keep it: display list, texture spec,
+// colors and transform.
+typedef struct
+{
+	void	*dl;
+	int		projection;
+	void	*texture;
+	float	planeS[4];
+	float	planeT[4];
+	float	color[4];
+	float	comp[4];
+	float	transform[16];
+
+} Instance;
+
+// The old linked list node, with the next pointer that became the depth.
+typedef struct OldLinkStruct
+{
+	union
+	{
+		struct OldLinkStruct	*next;
+		float					eval;
+	};
+	Instance					instance;
+
+} OldLink;
+
+
+//========== compareTruncated ==================================================
+//
+// Purpose:		The old comparator.
+//
+//==============================================================================
+static int compareTruncated(const void *lhs, const void *rhs)
+{
+	const OldLink *a = (const OldLink *)lhs;
+	const OldLink *b = (const OldLink *)rhs;
+
+	return a->eval - b->eval;
+
+}//end compareTruncated
+
+
+//========== compareEntries ====================================================
+//
+// Purpose:		A correct, stable comparator to check the radix sort by.
+//
+//==============================================================================
+static int compareEntries(const void *lhs, const void *rhs)
+{
+	const LDrawDepthSortEntry *a = (const LDrawDepthSortEntry *)lhs;
+	const LDrawDepthSortEntry *b = (const LDrawDepthSortEntry *)rhs;
+
+	if(a->key != b->key)
+		return (a->key < b->key) ? -1 : 1;
+	return (a->index < b->index) ? -1 : (a->index > b->index);
+
+}//end compareEntries
+
+
+//========== makeInstances =====================================================
+//
+// Purpose:		Scatters parts through a model 2000 LDU across, on a quarter
+//				LDU grid so plenty share a depth or are within one LDU.
+//
+//==============================================================================
+static Instance *makeInstances(int count)
+{
+	Instance	*instances	= (Instance *)calloc((size_t)count, sizeof(Instance));
+	uint32_t	seed		= 2024;
+	int			counter		= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		Instance *instance = instances + counter;
+
+		buildIdentity(instance->transform);
+		instance->transform[12]	= floorf(BenchmarkRandomFloat(&seed, -1000, 1000) * 4) / 4;
+		instance->transform[13]	= floorf(BenchmarkRandomFloat(&seed, -200, 200) * 4) / 4;
+		instance->transform[14]	= floorf(BenchmarkRandomFloat(&seed, -1000, 1000) * 4) / 4;
+		instance->color[3]		= 0.5f;
+		instance->dl			= instance;
+	}
+
+	return instances;
+
+}//end makeInstances
+
+
+//========== eyeDepth ==========================================================
+//
+// Purpose:		Eye space Z of an instance's origin.
+//
+//==============================================================================
+static inline float eyeDepth(const float modelView[16], const Instance *instance)
+{
+	float origin[4]	= { instance->transform[12], instance->transform[13], instance->transform[14], 1.0f };
+	float eye[4];
+
+	applyMatrix(eye, modelView, origin);
+	return eye[2];
+
+}//end eyeDepth
+
+
+//========== runOld ============================================================
+//
+// Purpose:		Queues, sorts and walks the parts the old way. Returns the
+//				time taken and fills order with the drawing order.
+//
+//==============================================================================
+static double runOld(const float modelView[16], const Instance *instances, int count, int *order)
+{
+	double	start	= BenchmarkNow();
+	OldLink	*pool	= (OldLink *)malloc(sizeof(OldLink) * count);
+	OldLink	*array	= NULL;
+	OldLink	*head	= NULL;
+	OldLink	*link	= NULL;
+	int		counter	= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		link			= pool + counter;
+		link->instance	= instances[counter];
+		link->next		= head;
+		head			= link;
+	}
+
+	array = (OldLink *)malloc(sizeof(OldLink) * count);
+	for(counter = 0, link = head; link; link = link->next, counter++)
+	{
+		array[counter]		= *link;
+		array[counter].eval	= eyeDepth(modelView, &link->instance);
+	}
+	qsort(array, (size_t)count, sizeof(OldLink), compareTruncated);
+
+	for(counter = 0; counter < count; counter++)
+		order[counter] = (int)((const Instance *)array[counter].instance.dl - instances);
+
+	free(array);
+	free(pool);
+
+	return BenchmarkNow() - start;
+
+}//end runOld
+
+
+//========== runNew ============================================================
+//
+// Purpose:		Queues, sorts and walks the parts the new way.
+//
+//==============================================================================
+static double runNew(const float modelView[16], const Instance *instances, int count, int *order)
+{
+	double				start		= BenchmarkNow();
+	int					capacity	= 0;
+	int					queued		= 0;
+	Instance			*sorted		= NULL;
+	LDrawDepthSortEntry	*keys		= NULL;
+	LDrawDepthSortEntry	*scratch	= NULL;
+	int					counter		= 0;
+
+	// Grown as the sessions grow them.
+	for(counter = 0; counter < count; counter++)
+	{
+		if(queued == capacity)
+		{
+			capacity	= capacity ? capacity * 2 : 256;
+			sorted		= (Instance *)realloc(sorted, sizeof(Instance) * capacity);
+			keys		= (LDrawDepthSortEntry *)realloc(keys, sizeof(LDrawDepthSortEntry) * capacity);
+		}
+		sorted[queued]		= instances[counter];
+		keys[queued].key	= eyeDepth(modelView, instances + counter);
+		keys[queued].index	= (uint32_t)queued;
+		queued++;
+	}
+
+	scratch = (LDrawDepthSortEntry *)malloc(sizeof(LDrawDepthSortEntry) * count);
+	LDrawDepthSort(keys, scratch, count);
+
+	for(counter = 0; counter < count; counter++)
+		order[counter] = (int)((const Instance *)sorted[keys[counter].index].dl - instances);
+
+	free(scratch);
+	free(keys);
+	free(sorted);
+
+	return BenchmarkNow() - start;
+
+}//end runNew
+
+
+//========== countMisordered ===================================================
+//
+// Purpose:		Counts neighbours in a drawing order that are nearer before
+//				farther.
+//
+//==============================================================================
+static int countMisordered(const float modelView[16], const Instance *instances, const int *order, int count)
+{
+	int misordered	= 0;
+	int counter		= 0;
+
+	for(counter = 1; counter < count; counter++)
+	{
+		if(eyeDepth(modelView, instances + order[counter - 1]) > eyeDepth(modelView, instances + order[counter]))
+			misordered++;
+	}
+
+	return misordered;
+
+}//end countMisordered
+
+
+//========== checkAgainstQsort =================================================
+//
+// Purpose:		Radix sorts keys and checks the result against a stable
+//				comparison sort.
+//
+//==============================================================================
+static bool checkAgainstQsort(const float *keys, int count, const char *label)
+{
+	LDrawDepthSortEntry	*entries	= (LDrawDepthSortEntry *)malloc(sizeof(LDrawDepthSortEntry) * (count + 1));
+	LDrawDepthSortEntry	*expected	= (LDrawDepthSortEntry *)malloc(sizeof(LDrawDepthSortEntry) * (count + 1));
+	LDrawDepthSortEntry	*scratch	= (LDrawDepthSortEntry *)malloc(sizeof(LDrawDepthSortEntry) * (count + 1));
+	bool				same		= true;
+	int					counter		= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		entries[counter].key	= keys[counter];
+		entries[counter].index	= (uint32_t)counter;
+	}
+	memcpy(expected, entries, sizeof(LDrawDepthSortEntry) * count);
+
+	LDrawDepthSort(entries, scratch, count);
+	qsort(expected, (size_t)count, sizeof(LDrawDepthSortEntry), compareEntries);
+
+	for(counter = 0; counter < count && same; counter++)
+	{
+		// -0 and +0 compare equal but sort apart; the order between them is
+		// still by index within each.
+		same =		entries[counter].index == expected[counter].index
+				||	(entries[counter].key == 0 && expected[counter].key == 0);
+	}
+	printf("  %-24s %6d keys: %s\n", label, count, same ? "ok" : "WRONG");
+
+	free(entries);
+	free(expected);
+	free(scratch);
+
+	return same;
+
+}//end checkAgainstQsort
+
+
+//========== checkEdgeCases ====================================================
+//
+// Purpose:		Small, signed, equal and extreme keys.
+//
+//==============================================================================
+static bool checkEdgeCases(void)
+{
+	const float	specials[]	= { 0.0f, -0.0f, 1.0f, -1.0f, INFINITY, -INFINITY, 1e-30f, -1e-30f,
+								3.5f, -3.5f, 1e30f, -1e30f, 0.25f, -0.25f };
+	float		*keys		= (float *)malloc(sizeof(float) * 5000);
+	uint32_t	seed		= 7;
+	bool		passed		= true;
+	int			counter		= 0;
+
+	passed = checkAgainstQsort(specials, 0, "empty") && passed;
+	passed = checkAgainstQsort(specials, 1, "one") && passed;
+	passed = checkAgainstQsort(specials, (int)(sizeof(specials) / sizeof(float)), "specials") && passed;
+
+	for(counter = 0; counter < 5000; counter++)
+		keys[counter] = -12.5f;
+	passed = checkAgainstQsort(keys, 5000, "all equal") && passed;
+
+	for(counter = 0; counter < 5000; counter++)
+		keys[counter] = specials[BenchmarkRandom(&seed) % (sizeof(specials) / sizeof(float))];
+	passed = checkAgainstQsort(keys, 5000, "repeated specials") && passed;
+
+	for(counter = 0; counter < 5000; counter++)
+		keys[counter] = BenchmarkRandomFloat(&seed, -3000, -10);
+	passed = checkAgainstQsort(keys, 5000, "all in front") && passed;
+	passed = checkAgainstQsort(keys, 31, "insertion sized") && passed;
+
+	for(counter = 0; counter < 5000; counter++)
+		keys[counter] = BenchmarkRandomFloat(&seed, -1, 1) * powf(10, BenchmarkRandomFloat(&seed, -20, 20));
+	passed = checkAgainstQsort(keys, 5000, "wide range") && passed;
+
+	free(keys);
+	return passed;
+
+}//end checkEdgeCases
+
+
+//========== main ==============================================================
+//
+// Purpose:		Runs the checks and the timing.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	int			count		= (argc > 1) ? atoi(argv[1]) : DEFAULT_PARTS;
+	Instance	*instances	= makeInstances(count);
+	int			*oldOrder	= (int *)malloc(sizeof(int) * count);
+	int			*newOrder	= (int *)malloc(sizeof(int) * count);
+	float		*depths		= (float *)malloc(sizeof(float) * count);
+	float		modelView[16];
+	float		rotation[16];
+	float		translation[16];
+	double		oldBest		= 1e9;
+	double		newBest		= 1e9;
+	bool		passed		= true;
+	int			run			= 0;
+	int			counter		= 0;
+
+	// Look at the model from an angle, from well outside it.
+	buildTranslationMatrix(translation, 0, 0, -3000);
+	buildRotationMatrix(rotation, 30, 1, 0, 0);
+	multMatrices(modelView, translation, rotation);
+	buildRotationMatrix(rotation, 40, 0, 1, 0);
+	multMatrices(translation, modelView, rotation);
+	memcpy(modelView, translation, sizeof(modelView));
+
+	for(run = 0; run < RUNS; run++)
+	{
+		double oldTime = runOld(modelView, instances, count, oldOrder);
+		double newTime = runNew(modelView, instances, count, newOrder);
+
+		oldBest = (oldTime < oldBest) ? oldTime : oldBest;
+		newBest = (newTime < newBest) ? newTime : newBest;
+	}
+
+	printf("%d translucent parts, best of %d:\n", count, RUNS);
+	printf("  linked list + qsort:   %7.2f ms, %d neighbours out of order\n",
+		   oldBest * 1000, countMisordered(modelView, instances, oldOrder, count));
+	printf("  flat arrays + radix:   %7.2f ms, %d neighbours out of order\n",
+		   newBest * 1000, countMisordered(modelView, instances, newOrder, count));
+
+	for(counter = 0; counter < count; counter++)
+		depths[counter] = eyeDepth(modelView, instances + counter);
+	passed = countMisordered(modelView, instances, newOrder, count) == 0 && passed;
+	passed = checkAgainstQsort(depths, count, "parts") && passed;
+	passed = checkEdgeCases() && passed;
+
+	free(depths);
+	free(newOrder);
+	free(oldOrder);
+	free(instances);
+
+	printf("%s\n", passed ? "PASSED" : "FAILED");
+	return passed ? 0 : 1;
+
+}//end main
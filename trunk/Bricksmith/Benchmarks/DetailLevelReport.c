@@ -0,0 +1,284 @@
+//==============================================================================
+//
+// File:		DetailLevelReport.c
+//
+// Purpose:		Reports what the display lists' detail levels (see
+//				simplify_indexed_mesh in MeshSmooth.h) save on each part's
+//				smoothed mesh: the triangles left at each level, the time
+//				taken to simplify, and how far the original surface lies from
+//				the simplified one - in LDU, and in pixels at the largest size
+//				the level is drawn.
+//
+//				The levels are built as the display lists build them: for a
+//				part drawn at most N pixels across, the error may be half a
+//				pixel, which is half the part's largest extent over N.
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					DetailLevelReport.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [ldraw folder part.dat ...]
+//				Without a library, reports on a brick, tori and a baseplate.
+//
+//==============================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "MeshSmooth.h"
+
+// As LDrawCoreRenderer.h's LDrawDetailLowPixels and LDrawDetailLowestPixels.
+#define LEVEL_COUNT		2
+static const float		levelPixels[LEVEL_COUNT]	= { 96.0f, 24.0f };
+
+// Surface error is measured from at most this many of the original positions.
+#define ERROR_SAMPLES	4000
+
+
+//========== pointTriangleDistance =============================================
+//
+// Purpose:		Distance from p to the triangle a b c.
+//
+//==============================================================================
+static double pointTriangleDistance(const float *p, const float *a, const float *b, const float *c)
+{
+	double	ab[3], ac[3], ap[3], closest[3];
+	double	d1, d2, d3, d4, d5, d6, va, vb, vc, v, w, denom;
+	int		i;
+
+	for(i = 0; i < 3; i++)
+	{
+		ab[i] = b[i] - a[i];
+		ac[i] = c[i] - a[i];
+		ap[i] = p[i] - a[i];
+	}
+
+	// Ericson, "Real-Time Collision Detection", 5.1.5: find the Voronoi
+	// region of the triangle that p lies in.
+	d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+	d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+	if(d1 <= 0 && d2 <= 0)
+		return sqrt(ap[0] * ap[0] + ap[1] * ap[1] + ap[2] * ap[2]);
+
+	d3 = ab[0] * (p[0] - b[0]) + ab[1] * (p[1] - b[1]) + ab[2] * (p[2] - b[2]);
+	d4 = ac[0] * (p[0] - b[0]) + ac[1] * (p[1] - b[1]) + ac[2] * (p[2] - b[2]);
+	d5 = ab[0] * (p[0] - c[0]) + ab[1] * (p[1] - c[1]) + ab[2] * (p[2] - c[2]);
+	d6 = ac[0] * (p[0] - c[0]) + ac[1] * (p[1] - c[1]) + ac[2] * (p[2] - c[2]);
+
+	vc = d1 * d4 - d3 * d2;
+	vb = d5 * d2 - d1 * d6;
+	va = d3 * d6 - d5 * d4;
+
+	if(d3 >= 0 && d4 <= d3)
+		v = 1, w = 0;
+	else if(d6 >= 0 && d5 <= d6)
+		v = 0, w = 1;
+	else if(vc <= 0 && d1 >= 0 && d3 <= 0)
+		v = d1 / (d1 - d3), w = 0;
+	else if(vb <= 0 && d2 >= 0 && d6 <= 0)
+		v = 0, w = d2 / (d2 - d6);
+	else if(va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+	{
+		w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		v = 1 - w;
+	}
+	else
+	{
+		denom = 1.0 / (va + vb + vc);
+		v = vb * denom;
+		w = vc * denom;
+	}
+
+	for(i = 0; i < 3; i++)
+		closest[i] = a[i] + ab[i] * v + ac[i] * w - p[i];
+
+	return sqrt(closest[0] * closest[0] + closest[1] * closest[1] + closest[2] * closest[2]);
+}
+
+
+//========== surfaceError ======================================================
+//
+// Purpose:		The furthest any sampled vertex of the original triangles lies
+//				from the simplified ones.
+//
+//==============================================================================
+static double surfaceError(const float *vertices, const unsigned int *full, int fullCount,
+						   const unsigned int *simple, int simpleCount)
+{
+	int		step	= fullCount / ERROR_SAMPLES + 1;
+	double	worst	= 0;
+	int		i, t;
+
+	for(i = 0; i < fullCount; i += step)
+	{
+		const float	*p		= vertices + full[i] * 10;
+		double		nearest	= HUGE_VAL;
+
+		for(t = 0; t < simpleCount && nearest > 0; t += 3)
+			nearest = fmin(nearest, pointTriangleDistance(p, vertices + simple[t] * 10,
+														  vertices + simple[t + 1] * 10,
+														  vertices + simple[t + 2] * 10));
+		worst = fmax(worst, nearest);
+	}
+	return worst;
+}
+
+
+//========== reportMesh ========================================================
+//
+// Purpose:		Smooths flat, simplifies it and prints its lines of the report.
+//
+//==============================================================================
+static void reportMesh(const char *name, const FlatMesh *flat)
+{
+	struct Mesh				*mesh			= NULL;
+	SmoothedMesh			smoothed;
+	struct compact_bounds	bounds;
+	float					*vertices		= NULL;
+	unsigned int			*indices		= NULL;
+	unsigned int			*simple			= NULL;
+	unsigned int			*triangles		= NULL;
+	int						triCount		= 0;
+	int						vertexCount		= 0;
+	int						*starts			= smoothed.starts;
+	int						*counts			= smoothed.counts;
+	int						counter			= 0;
+	int						level			= 0;
+	float					extent			= 0;
+
+	mesh = smoothFlatMesh(flat);
+	optimize_vertex_cache(mesh);
+	writeSmoothedMesh(mesh, &smoothed);
+
+	vertices	= smoothed.vertices;
+	indices		= smoothed.indices;
+	vertexCount	= smoothed.vertexCount;
+
+	get_compact_bounds(vertices, vertexCount, &bounds);
+	extent = fmaxf(bounds.scale[0], fmaxf(bounds.scale[1], bounds.scale[2]));
+
+	// The full mesh as triangles, to measure the levels against.
+	triangles = malloc(sizeof(unsigned int) * get_simplified_index_capacity(0, 0, counts[2], counts[3]));
+	memcpy(triangles, indices + starts[2], sizeof(unsigned int) * counts[2]);
+	for(counter = 0; counter < counts[3] / 4; counter++)
+	{
+		const unsigned int	*q	= indices + starts[3] + counter * 4;
+		unsigned int		*t	= triangles + counts[2] + counter * 6;
+		t[0] = q[0]; t[1] = q[1]; t[2] = q[2];
+		t[3] = q[0]; t[4] = q[2]; t[5] = q[3];
+	}
+	triCount = counts[2] / 3 + counts[3] / 4 * 2;
+
+	printf("%-22s %8d tris  %6d lines\n", name, triCount, counts[0] / 2);
+
+	simple = malloc(sizeof(unsigned int) * get_simplified_index_capacity(counts[0], counts[1], counts[2], counts[3]));
+	for(level = 0; level < LEVEL_COUNT; level++)
+	{
+		float	maxError	= extent * 0.5f / levelPixels[level];
+		double	start		= BenchmarkNow();
+		double	elapsed		= 0;
+		double	error		= 0;
+		int		lines		= 0;
+		int		condLines	= 0;
+		int		tris		= 0;
+		int		bad			= 0;
+
+		simplify_indexed_mesh(vertices, vertexCount, indices,
+							  starts[0], counts[0], starts[1], counts[1], starts[2], counts[2], starts[3], counts[3],
+							  maxError, simple, &lines, &condLines, &tris);
+		elapsed = BenchmarkNow() - start;
+
+		for(counter = 0; counter < lines + condLines + tris; counter++)
+			bad += (simple[counter] >= (unsigned int)vertexCount);
+
+		error = surfaceError(vertices, triangles, triCount * 3, simple + lines + condLines, tris);
+
+		printf("  <= %3.0f px  %8d tris (%5.1f%%) %6d lines  %8.2f ms  error %7.4f LDU = %5.3f px%s\n",
+			   levelPixels[level], tris / 3, 100.0 * tris / 3 / triCount, lines / 2, elapsed * 1e3,
+			   error, error / extent * levelPixels[level], bad ? "  BAD INDICES" : "");
+	}
+
+	freeSmoothedMesh(&smoothed);
+	free(simple);
+	free(triangles);
+}
+
+
+//========== addStuds ==========================================================
+//
+// Purpose:		The studs of a width x depth plate, one faceted stud on every
+//				20 LDU square, standing on y = 0.
+//
+//==============================================================================
+static void addStuds(FlatMesh *flat, int width, int depth)
+{
+	int x, z;
+
+	for(x = 0; x < width; x++)
+	for(z = 0; z < depth; z++)
+		addStud(flat, x * 20.0f + 10.0f, 0, z * 20.0f + 10.0f);
+}
+
+
+int main(int argc, const char *argv[])
+{
+	static const float	identity[12]	= { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0 };
+	int					counter			= 0;
+
+	if(argc > 2)
+	{
+		for(counter = 2; counter < argc; counter++)
+		{
+			FlatMesh flat;
+
+			memset(&flat, 0, sizeof(flat));
+			flattenPart(&flat, argv[1], argv[counter], identity, 0);
+			if(flat.missingFiles)
+				fprintf(stderr, "%s: %d files not found\n", argv[counter], flat.missingFiles);
+			if(flat.polygonCount > 0)
+				reportMesh(argv[counter], &flat);
+
+			free(flat.polygons);
+			free(flat.lines);
+		}
+	}
+	else
+	{
+		static const float	brickLo[3]	= { 0, 0, 0 };
+		static const float	brickHi[3]	= { 40, 24, 80 };
+		static const float	plateLo[3]	= { 0, 0, 0 };
+		static const float	plateHi[3]	= { 640, 8, 640 };
+		FlatMesh			flat;
+
+		memset(&flat, 0, sizeof(flat));
+		addBox(&flat, brickLo, brickHi);
+		addStuds(&flat, 2, 4);
+		reportMesh("brick 2 x 4", &flat);
+		free(flat.polygons);
+		free(flat.lines);
+
+		memset(&flat, 0, sizeof(flat));
+		addTorus(&flat, 48, 24, 10.0f, TORUS_SEAM_LINES);
+		reportMesh("torus 48 x 24, r 10", &flat);
+		free(flat.polygons);
+		free(flat.lines);
+
+		memset(&flat, 0, sizeof(flat));
+		addTorus(&flat, 384, 192, 200.0f, TORUS_SEAM_LINES);
+		reportMesh("torus 384 x 192, r 200", &flat);
+		free(flat.polygons);
+		free(flat.lines);
+
+		memset(&flat, 0, sizeof(flat));
+		addBox(&flat, plateLo, plateHi);
+		addStuds(&flat, 32, 32);
+		reportMesh("baseplate 32 x 32", &flat);
+		free(flat.polygons);
+		free(flat.lines);
+	}
+
+	return 0;
+}
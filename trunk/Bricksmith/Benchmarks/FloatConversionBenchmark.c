@@ -0,0 +1,239 @@
+//==============================================================================
+//
+// File:		FloatConversionBenchmark.c
+//
+// Purpose:		Writes and reads back a synthetic LDraw file of geometry lines,
+//				comparing LDrawFloatToChars()/LDrawFloatFromChars() with the
+//				old way of doing it:
+//
+//				* writing: snprintf("%f") with the trailing zeros trimmed, which
+//				  is what +[LDrawUtilities outputStringForFloat:] used to do;
+//				* reading: strtof(), which is what -[NSString floatValue] does.
+//
+//				It also reports how many numbers each writer failed to
+//				preserve, and checks that save -> load -> save is byte-for-byte
+//				identical with the new conversions.
+//
+// Build:		cc -O2 -I../Source/LDraw/Support FloatConversionBenchmark.c
+//					../Source/LDraw/Support/LDrawFloatConversion.c -lm -lpthread
+//
+// Usage:		./a.out [line count]
+//
+//==============================================================================
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkSupport.h"
+#include "LDrawFloatConversion.h"
+
+// Every line is a type 4 quadrilateral: color plus twelve numbers.
+#define VALUES_PER_LINE		12
+
+
+//========== legacyFormat ======================================================
+//
+// Purpose:		The old outputStringForFloat: formatting.
+//
+//==============================================================================
+static size_t legacyFormat(float number, char *buffer)
+{
+	char	formattedFloat[16]	= "";
+	char	*endOfString		= NULL;
+	size_t	length				= 0;
+
+	snprintf(formattedFloat, sizeof(formattedFloat), "%f", number);
+	endOfString = &formattedFloat[strlen(formattedFloat) - 1];
+	while(*endOfString == '0')
+		endOfString--;
+	if(*endOfString != '.')
+		endOfString++;
+	*endOfString = '\0';
+
+	length = strlen(formattedFloat);
+	memcpy(buffer, formattedFloat, length + 1);
+	return length;
+}
+
+
+//========== makeValues ========================================================
+//
+// Purpose:		Fills in plausible coordinates: two thirds are the short
+//				decimals people type, the rest the long ones left behind by
+//				rotating and dragging.
+//
+//==============================================================================
+static void makeValues(float *values, size_t count, uint32_t *seed)
+{
+	size_t	counter	= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		switch(BenchmarkRandom(seed) % 3)
+		{
+			case 0:
+				values[counter] = (float)((int)(BenchmarkRandom(seed) % 401) - 200);
+				break;
+			case 1:
+				values[counter] = (float)((int)(BenchmarkRandom(seed) % 40001) - 20000) / 100.0f;
+				break;
+			default:
+				values[counter] = BenchmarkRandomFloat(seed, -200, 200) * cosf(BenchmarkRandomFloat(seed, 0, 6.3f));
+				break;
+		}
+	}
+}
+
+
+//========== writeFile =========================================================
+//
+// Purpose:		Formats the values as type 4 lines into text, which must be big
+//				enough. Returns the length written.
+//
+//==============================================================================
+static size_t writeFile(const float *values, size_t lineCount, char *text,
+						size_t (*format)(float, char *))
+{
+	size_t	used		= 0;
+	size_t	line		= 0;
+	int		counter		= 0;
+
+	for(line = 0; line < lineCount; line++)
+	{
+		memcpy(text + used, "4 16", 4);
+		used += 4;
+		for(counter = 0; counter < VALUES_PER_LINE; counter++)
+		{
+			text[used++] = ' ';
+			used += format(values[line * VALUES_PER_LINE + counter], text + used);
+		}
+		text[used++] = '\n';
+	}
+
+	return used;
+}
+
+
+//========== readFile ==========================================================
+//
+// Purpose:		Reads the numbers back out of text written by writeFile.
+//
+//==============================================================================
+static void readFile(const char *text, size_t length, float *values, bool useStrtof)
+{
+	size_t	position	= 0;
+	size_t	valueIndex	= 0;
+	int		counter		= 0;
+
+	while(position < length)
+	{
+		position += 5;	// "4 16 "
+		for(counter = 0; counter < VALUES_PER_LINE; counter++)
+		{
+			size_t	used	= 0;
+
+			if(useStrtof)
+			{
+				char *end = NULL;
+				values[valueIndex++]	= strtof(text + position, &end);
+				used					= (size_t)(end - (text + position));
+			}
+			else
+				values[valueIndex++] = LDrawFloatFromChars(text + position, length - position, &used);
+
+			position += used + 1;	// the space or newline
+		}
+	}
+}
+
+
+//========== countChanged ======================================================
+//
+// Purpose:		Returns how many values did not survive the trip.
+//
+//==============================================================================
+static size_t countChanged(const float *original, const float *reread, size_t count)
+{
+	size_t	changed	= 0;
+	size_t	counter	= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		if(original[counter] != reread[counter])
+			changed++;
+	}
+
+	return changed;
+}
+
+
+//========== main ==============================================================
+//
+// Purpose:		Times both writers and both readers over the same values.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	size_t		lineCount		= (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	size_t		valueCount		= lineCount * VALUES_PER_LINE;
+	size_t		textCapacity	= lineCount * (8 + VALUES_PER_LINE * LDRAW_FLOAT_CHARS_MAX);
+	float		*values			= malloc(valueCount * sizeof(float));
+	float		*reread			= malloc(valueCount * sizeof(float));
+	char		*legacyText		= malloc(textCapacity);
+	char		*newText		= malloc(textCapacity);
+	char		*secondText		= malloc(textCapacity);
+	size_t		legacyLength	= 0;
+	size_t		newLength		= 0;
+	size_t		secondLength	= 0;
+	size_t		legacyChanged	= 0;
+	size_t		newChanged		= 0;
+	uint32_t	seed			= 0x4C447261;
+	double		start			= 0;
+	double		legacyWrite		= 0;
+	double		newWrite		= 0;
+	double		legacyRead		= 0;
+	double		newRead			= 0;
+
+	makeValues(values, valueCount, &seed);
+
+	start			= BenchmarkNow();
+	legacyLength	= writeFile(values, lineCount, legacyText, legacyFormat);
+	legacyWrite		= BenchmarkNow() - start;
+
+	start			= BenchmarkNow();
+	newLength		= writeFile(values, lineCount, newText, LDrawFloatToChars);
+	newWrite		= BenchmarkNow() - start;
+
+	start			= BenchmarkNow();
+	readFile(legacyText, legacyLength, reread, true);
+	legacyRead		= BenchmarkNow() - start;
+	legacyChanged	= countChanged(values, reread, valueCount);
+
+	start			= BenchmarkNow();
+	readFile(newText, newLength, reread, false);
+	newRead			= BenchmarkNow() - start;
+	newChanged		= countChanged(values, reread, valueCount);
+
+	// Save what was loaded; it must be the same file.
+	secondLength	= writeFile(reread, lineCount, secondText, LDrawFloatToChars);
+
+	printf("lines:            %zu (%zu numbers)\n", lineCount, valueCount);
+	printf("write %%f+trim:    %8.1f ms  %6.1f ns/number  %6.1f MB  %zu numbers changed\n",
+		   legacyWrite * 1e3, legacyWrite * 1e9 / valueCount, legacyLength / 1e6, legacyChanged);
+	printf("write to_chars:   %8.1f ms  %6.1f ns/number  %6.1f MB  %zu numbers changed\n",
+		   newWrite * 1e3, newWrite * 1e9 / valueCount, newLength / 1e6, newChanged);
+	printf("read strtof:      %8.1f ms  %6.1f ns/number\n", legacyRead * 1e3, legacyRead * 1e9 / valueCount);
+	printf("read from_chars:  %8.1f ms  %6.1f ns/number\n", newRead * 1e3, newRead * 1e9 / valueCount);
+	printf("save-load-save:   %s\n",
+		   (secondLength == newLength && memcmp(secondText, newText, newLength) == 0) ? "identical" : "DIFFERENT");
+
+	free(values);
+	free(reread);
+	free(legacyText);
+	free(newText);
+	free(secondText);
+
+	return (newChanged == 0) ? 0 : 1;
+}
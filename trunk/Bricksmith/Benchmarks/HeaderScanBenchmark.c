@@ -0,0 +1,151 @@
+//==============================================================================
+//
+// File:		HeaderScanBenchmark.c
+//
+// Purpose:		Measures how many models per second can be indexed by header
+//				alone (LDrawReadModelHeader) against opening each one whole and
+//				splitting all its lines, which is the least any full parse
+//				does. A third pass adds the referenced-file scan.
+//
+// Build:		cc -O2 -I../Source/LDraw/Support HeaderScanBenchmark.c
+//					../Source/LDraw/Support/LDrawHeaderScanner.c
+//					../Source/LDraw/Support/LDrawMappedFile.c
+//					../Source/LDraw/Support/LDrawLineTokenizer.c
+//					../Source/LDraw/Support/LDrawFloatConversion.c -lm -lpthread
+//
+// Usage:		./a.out [fileCount]
+//				Writes fileCount synthetic models (default 2000, of 500 to
+//				20 000 lines each) to a temporary folder, times each pass over
+//				them, and removes them.
+//
+//==============================================================================
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BenchmarkSupport.h"
+#include "LDrawHeaderScanner.h"
+#include "LDrawMappedFile.h"
+
+
+//========== writeSyntheticModel ===============================================
+//
+// Purpose:		Writes a model with a typical header followed by lineCount
+//				part references.
+//
+//==============================================================================
+static void writeSyntheticModel(const char *path, size_t lineCount, uint32_t *seed)
+{
+	FILE	*file		= fopen(path, "w");
+	size_t	counter		= 0;
+
+	fprintf(file,	"0 Synthetic Model %u\r\n"
+					"0 Name: %s\r\n"
+					"0 Author: Benchmark\r\n"
+					"0 !LDRAW_ORG Unofficial_Model\r\n"
+					"0 !KEYWORDS synthetic, benchmark\r\n"
+					"\r\n", BenchmarkRandom(seed), path);
+
+	for(counter = 0; counter < lineCount; counter++)
+	{
+		fprintf(file, "1 %u %.3f %.3f %.3f 1 0 0 0 1 0 0 0 1 %u.dat\r\n",
+				BenchmarkRandom(seed) % 64,
+				BenchmarkRandomFloat(seed, -500, 500),
+				BenchmarkRandomFloat(seed, -500, 500),
+				BenchmarkRandomFloat(seed, -500, 500),
+				3000 + BenchmarkRandom(seed) % 40);
+	}
+	fclose(file);
+}
+
+
+//========== countReference ====================================================
+//
+//==============================================================================
+static void countReference(void *context, const char *name, size_t length, bool isSubmodel)
+{
+	(void)name;
+	(void)isSubmodel;
+	*(size_t *)context += length;
+}
+
+
+int main(int argc, const char *argv[])
+{
+	size_t				fileCount	= (argc > 1) ? (size_t)atol(argv[1]) : 2000;
+	char				folder[]	= "/tmp/HeaderScanBenchmarkXXXXXX";
+	char				**paths		= NULL;
+	uint32_t			seed		= 0x2545F491;
+	size_t				counter		= 0;
+	size_t				checksum	= 0;
+	double				start		= 0;
+	double				elapsed		= 0;
+	LDrawModelHeader	header;
+
+	if(mkdtemp(folder) == NULL)
+		return 1;
+
+	paths = calloc(fileCount, sizeof(char *));
+	for(counter = 0; counter < fileCount; counter++)
+	{
+		paths[counter] = malloc(strlen(folder) + 32);
+		sprintf(paths[counter], "%s/model%zu.ldr", folder, counter);
+		writeSyntheticModel(paths[counter], 500 + BenchmarkRandom(&seed) % 19500, &seed);
+	}
+
+	// Header only.
+	start = BenchmarkNow();
+	for(counter = 0; counter < fileCount; counter++)
+	{
+		size_t	length	= 0;
+		char	*bytes	= LDrawReadModelHeader(paths[counter], &header, &length);
+
+		checksum += header.description.length + header.keywordLineCount;
+		free(bytes);
+	}
+	elapsed = BenchmarkNow() - start;
+	printf("header only    %8.1f ms  %10.0f models/min  checksum %zu\n",
+		   elapsed * 1e3, fileCount / elapsed * 60, checksum);
+
+	// Whole file, every line split.
+	checksum	= 0;
+	start		= BenchmarkNow();
+	for(counter = 0; counter < fileCount; counter++)
+	{
+		LDrawMappedFile	*file	= LDrawMappedFileOpen(paths[counter]);
+
+		LDrawScanModelHeader(file->bytes, file->length, true, &header);
+		checksum += header.description.length + header.keywordLineCount;
+		LDrawMappedFileClose(file);
+	}
+	elapsed = BenchmarkNow() - start;
+	printf("whole file     %8.1f ms  %10.0f models/min  checksum %zu\n",
+		   elapsed * 1e3, fileCount / elapsed * 60, checksum);
+
+	// Header plus references.
+	checksum	= 0;
+	start		= BenchmarkNow();
+	for(counter = 0; counter < fileCount; counter++)
+	{
+		LDrawMappedFile	*file	= LDrawMappedFileOpenUnindexed(paths[counter]);
+
+		LDrawScanModelHeader(file->bytes, file->length, true, &header);
+		LDrawScanReferences(file->bytes, file->length, file->encoding, countReference, &checksum);
+		LDrawMappedFileClose(file);
+	}
+	elapsed = BenchmarkNow() - start;
+	printf("references     %8.1f ms  %10.0f models/min  checksum %zu\n",
+		   elapsed * 1e3, fileCount / elapsed * 60, checksum);
+
+	for(counter = 0; counter < fileCount; counter++)
+	{
+		unlink(paths[counter]);
+		free(paths[counter]);
+	}
+	free(paths);
+	rmdir(folder);
+
+	return 0;
+}
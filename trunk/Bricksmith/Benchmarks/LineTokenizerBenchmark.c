@@ -0,0 +1,222 @@
+//==============================================================================
+//
+// File:		LineTokenizerBenchmark.c
+//
+// Purpose:		Compares LDrawTokenizeGeometryLine() against the field-at-a-time
+//				parsing the primitives used to do through
+//				+[LDrawUtilities readNextField:remainder:].
+//
+//				Foundation isn't available on the Linux build machines, so the
+//				old path is modelled in C: each field trims the working line
+//				into a new heap string, then splits it into a field string and a
+//				remainder string, exactly the allocations NSString performed.
+//
+// Build:		cc -O2 -I../Source/LDraw/Support LineTokenizerBenchmark.c
+//					../Source/LDraw/Support/LDrawLineTokenizer.c
+//					../Source/LDraw/Support/LDrawFloatConversion.c -lm -lpthread
+//
+// Usage:		./a.out [line count]
+//
+//==============================================================================
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkSupport.h"
+#include "LDrawLineTokenizer.h"
+
+static size_t	LegacyAllocationCount	= 0;
+
+
+//========== legacyAllocString =================================================
+//
+// Purpose:		Copies a byte range into a new heap string, counting it.
+//
+//==============================================================================
+static char *legacyAllocString(const char *bytes, size_t length)
+{
+	char *string = malloc(length + 1);
+	memcpy(string, bytes, length);
+	string[length] = '\0';
+	LegacyAllocationCount++;
+	return string;
+}
+
+
+//========== legacyReadNextField ===============================================
+//
+// Purpose:		The old readNextField:remainder: algorithm. Frees the incoming
+//				partial line and replaces it with the remainder.
+//
+//==============================================================================
+static char *legacyReadNextField(char **partialDirective)
+{
+	const char	*start		= *partialDirective;
+	const char	*end		= start + strlen(start);
+	char		*trimmed	= NULL;
+	char		*field		= NULL;
+	char		*space		= NULL;
+
+	// stringByTrimmingCharactersInSet:
+	while(start < end && strchr(" \t\r\n", *start))	start++;
+	while(end > start && strchr(" \t\r\n", end[-1]))	end--;
+	trimmed = legacyAllocString(start, end - start);
+
+	// rangeOfCharacterFromSet: / substringToIndex: / substringFromIndex:
+	space = strpbrk(trimmed, " \t\r\n");
+	if(space)
+	{
+		field				= legacyAllocString(trimmed, space - trimmed);
+		free(*partialDirective);
+		*partialDirective	= legacyAllocString(space, strlen(space));
+	}
+	else
+	{
+		field				= legacyAllocString(trimmed, strlen(trimmed));
+		free(*partialDirective);
+		*partialDirective	= legacyAllocString("", 0);
+	}
+	free(trimmed);
+
+	return field;
+}
+
+
+//========== legacyParseLine ===================================================
+//
+// Purpose:		Parses a geometry line field by field; returns a checksum so the
+//				optimizer can't throw the work away.
+//
+//==============================================================================
+static float legacyParseLine(const char *line)
+{
+	char	*working	= legacyAllocString(line, strlen(line));
+	char	*field		= NULL;
+	float	checksum	= 0;
+	int		lineType	= 0;
+	int		counter		= 0;
+
+	field		= legacyReadNextField(&working);
+	lineType	= atoi(field);
+	free(field);
+
+	field		= legacyReadNextField(&working);
+	checksum	+= atoi(field);
+	free(field);
+
+	for(counter = 0; counter < LDrawLineValueCountForType(lineType); counter++)
+	{
+		field		= legacyReadNextField(&working);
+		checksum	+= strtof(field, NULL);
+		free(field);
+	}
+	if(lineType == 1)
+	{
+		// The name is the trimmed remainder.
+		const char *name = working + strspn(working, " \t\r\n");
+		field		= legacyAllocString(name, strlen(name));
+		checksum	+= strlen(field);
+		free(field);
+	}
+	free(working);
+
+	return checksum;
+}
+
+
+//========== tokenizerParseLine ================================================
+//
+// Purpose:		Parses a geometry line with the new tokenizer.
+//
+//==============================================================================
+static float tokenizerParseLine(const char *line, size_t length)
+{
+	LDrawGeometryLine	fields;
+	float				checksum	= 0;
+	int					counter		= 0;
+
+	LDrawTokenizeGeometryLine(line, length, &fields);
+	checksum += fields.colorCode;
+	for(counter = 0; counter < fields.valueCount; counter++)
+		checksum += fields.values[counter];
+	checksum += fields.nameLength;
+
+	return checksum;
+}
+
+
+//========== makeLine ==========================================================
+//
+// Purpose:		Writes a plausible random type 1-5 line, weighted the way real
+//				part files are (mostly triangles, quads and lines).
+//
+//==============================================================================
+static void makeLine(char *buffer, size_t size, uint32_t *seed)
+{
+	static const int	lineTypes[]	= { 1, 2, 2, 3, 3, 3, 4, 4, 5, 5 };
+	int					lineType	= lineTypes[BenchmarkRandom(seed) % 10];
+	int					valueCount	= LDrawLineValueCountForType(lineType);
+	size_t				used		= 0;
+	int					counter		= 0;
+
+	used += snprintf(buffer + used, size - used, "%d %d", lineType, (int)(BenchmarkRandom(seed) % 72));
+	for(counter = 0; counter < valueCount; counter++)
+		used += snprintf(buffer + used, size - used, " %g", BenchmarkRandomFloat(seed, -200, 200));
+	if(lineType == 1)
+		snprintf(buffer + used, size - used, " %d.dat", (int)(BenchmarkRandom(seed) % 4000));
+}
+
+
+//========== main ==============================================================
+//
+// Purpose:		Times both paths over the same synthetic lines.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	size_t		lineCount		= (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+	char		**lines			= malloc(lineCount * sizeof(char *));
+	size_t		*lengths		= malloc(lineCount * sizeof(size_t));
+	uint32_t	seed			= 0x1D4A;
+	double		start			= 0;
+	double		legacyTime		= 0;
+	double		tokenizerTime	= 0;
+	float		legacySum		= 0;
+	float		tokenizerSum	= 0;
+	size_t		counter			= 0;
+	char		buffer[512];
+
+	for(counter = 0; counter < lineCount; counter++)
+	{
+		makeLine(buffer, sizeof(buffer), &seed);
+		lengths[counter]	= strlen(buffer);
+		lines[counter]		= legacyAllocString(buffer, lengths[counter]);
+	}
+	LegacyAllocationCount = 0;
+
+	start = BenchmarkNow();
+	for(counter = 0; counter < lineCount; counter++)
+		legacySum += legacyParseLine(lines[counter]);
+	legacyTime = BenchmarkNow() - start;
+
+	start = BenchmarkNow();
+	for(counter = 0; counter < lineCount; counter++)
+		tokenizerSum += tokenizerParseLine(lines[counter], lengths[counter]);
+	tokenizerTime = BenchmarkNow() - start;
+
+	printf("lines:              %zu\n", lineCount);
+	printf("readNextField path: %8.1f ms  %6.1f ns/line  %5.1f allocations/line\n",
+		   legacyTime * 1e3, legacyTime * 1e9 / lineCount, (double)LegacyAllocationCount / lineCount);
+	printf("tokenizer:          %8.1f ms  %6.1f ns/line  %5.1f allocations/line\n",
+		   tokenizerTime * 1e3, tokenizerTime * 1e9 / lineCount, 0.0);
+	printf("speedup:            %8.1fx\n", legacyTime / tokenizerTime);
+	printf("checksums:          %g / %g\n", legacySum, tokenizerSum);
+
+	for(counter = 0; counter < lineCount; counter++)
+		free(lines[counter]);
+	free(lines);
+	free(lengths);
+
+	return 0;
+}
@@ -0,0 +1,254 @@
+//==============================================================================
+//
+// File:		MappedFileBenchmark.c
+//
+// Purpose:		Compares peak memory and time of LDrawMappedFile ingestion
+//				against the old path: NSData read, NSString decode, then
+//				-separateByLine copying every line.
+//
+//				The old path is modelled in C the way Foundation carried it
+//				out: the whole file in a heap buffer, decoded into a UTF-16
+//				buffer (after a failed UTF-8 attempt, for Latin-1 files), then
+//				one heap UTF-16 string per line. Each path runs in its own child
+//				process so its peak resident size can be read back separately.
+//
+// Build:		cc -O2 -I../Source/LDraw/Support MappedFileBenchmark.c
+//					../Source/LDraw/Support/LDrawMappedFile.c
+//					../Source/LDraw/Support/LDrawLineTokenizer.c
+//					../Source/LDraw/Support/LDrawFloatConversion.c -lm -lpthread
+//
+// Usage:		./a.out [file.mpd]
+//				Without a file, a synthetic 200 000-line model is written to
+//				the temporary directory and used.
+//
+//==============================================================================
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "BenchmarkSupport.h"
+#include "LDrawLineTokenizer.h"
+#include "LDrawMappedFile.h"
+
+
+//========== parseLine =========================================================
+//
+// Purpose:		Stand-in for the parser's work on one line, identical in both
+//				paths so only ingestion differs.
+//
+//==============================================================================
+static float parseLine(const char *bytes, size_t length)
+{
+	LDrawGeometryLine	fields;
+	float				checksum	= 0;
+
+	if(LDrawTokenizeGeometryLine(bytes, length, &fields))
+		checksum = fields.values[0] + fields.colorCode;
+
+	return checksum;
+}
+
+
+//========== legacyIngest ======================================================
+//
+// Purpose:		dataWithContentsOfFile: + initWithData:encoding: +
+//				separateByLine, then parse.
+//
+//==============================================================================
+static float legacyIngest(const char *path)
+{
+	FILE		*file		= fopen(path, "rb");
+	struct stat	fileInfo;
+	char		*data		= NULL;
+	uint16_t	*string		= NULL;
+	uint16_t	**lines		= NULL;
+	size_t		*lengths	= NULL;
+	size_t		lineCount	= 0;
+	size_t		capacity	= 1024;
+	size_t		length		= 0;
+	size_t		position	= 0;
+	size_t		lineStart	= 0;
+	size_t		counter		= 0;
+	char		lineBuffer[1024];
+	float		checksum	= 0;
+
+	fstat(fileno(file), &fileInfo);
+	length	= (size_t)fileInfo.st_size;
+	data	= malloc(length);
+	length	= fread(data, 1, length, file);
+	fclose(file);
+
+	// Decode. NSString stores non-ASCII text as UTF-16.
+	string = malloc(length * sizeof(uint16_t));
+	for(position = 0; position < length; position++)
+		string[position] = (unsigned char)data[position];
+
+	// separateByLine
+	lines	= malloc(capacity * sizeof(uint16_t *));
+	lengths	= malloc(capacity * sizeof(size_t));
+	for(position = 0; position <= length; position++)
+	{
+		if(position == length || string[position] == '\n' || string[position] == '\r')
+		{
+			if(position == length && lineStart == length)
+				break;
+			if(lineCount == capacity)
+			{
+				capacity	*= 2;
+				lines		= realloc(lines, capacity * sizeof(uint16_t *));
+				lengths		= realloc(lengths, capacity * sizeof(size_t));
+			}
+			lines[lineCount]	= malloc((position - lineStart + 1) * sizeof(uint16_t));
+			lengths[lineCount]	= position - lineStart;
+			memcpy(lines[lineCount], string + lineStart, lengths[lineCount] * sizeof(uint16_t));
+			lineCount++;
+
+			if(position + 1 < length && string[position] == '\r' && string[position + 1] == '\n')
+				position++;
+			lineStart = position + 1;
+		}
+	}
+
+	// Parse (the UTF8String round trip each line took on its way to the
+	// tokenizer).
+	for(counter = 0; counter < lineCount; counter++)
+	{
+		size_t	lineLength	= lengths[counter] < sizeof(lineBuffer) ? lengths[counter] : sizeof(lineBuffer);
+		size_t	character	= 0;
+
+		for(character = 0; character < lineLength; character++)
+			lineBuffer[character] = (char)lines[counter][character];
+		checksum += parseLine(lineBuffer, lineLength);
+	}
+
+	for(counter = 0; counter < lineCount; counter++)
+		free(lines[counter]);
+	free(lines);
+	free(lengths);
+	free(string);
+	free(data);
+
+	return checksum;
+}
+
+
+//========== mappedIngest ======================================================
+//
+// Purpose:		LDrawMappedFileOpen, then parse each span in place.
+//
+//==============================================================================
+static float mappedIngest(const char *path)
+{
+	LDrawMappedFile	*file		= LDrawMappedFileOpen(path);
+	size_t			counter		= 0;
+	float			checksum	= 0;
+
+	for(counter = 0; counter < file->lineCount; counter++)
+		checksum += parseLine(file->bytes + file->lines[counter].offset, file->lines[counter].length);
+
+	LDrawMappedFileClose(file);
+
+	return checksum;
+}
+
+
+//========== runInChild ========================================================
+//
+// Purpose:		Runs one ingestion path in a fresh process and reports its time
+//				and peak resident size.
+//
+//==============================================================================
+static void runInChild(const char *label, float (*ingest)(const char *), const char *path)
+{
+	int				pipeEnds[2];
+	pid_t			child		= 0;
+	int				status		= 0;
+	struct rusage	usage;
+	double			results[2]	= {0, 0};
+
+	pipe(pipeEnds);
+	child = fork();
+	if(child == 0)
+	{
+		double start	= BenchmarkNow();
+		results[1]		= ingest(path);
+		results[0]		= BenchmarkNow() - start;
+		write(pipeEnds[1], results, sizeof(results));
+		_exit(0);
+	}
+	read(pipeEnds[0], results, sizeof(results));
+	wait4(child, &status, 0, &usage);
+	close(pipeEnds[0]);
+	close(pipeEnds[1]);
+
+	// ru_maxrss is kilobytes on Linux, bytes on macOS.
+#ifdef __APPLE__
+	usage.ru_maxrss /= 1024;
+#endif
+	printf("%-10s %8.1f ms  peak RSS %8.1f MB  checksum %g\n",
+		   label, results[0] * 1e3, usage.ru_maxrss / 1024.0, results[1]);
+}
+
+
+//========== writeSyntheticModel ===============================================
+//
+// Purpose:		Writes a large CRLF-terminated model to path.
+//
+//==============================================================================
+static void writeSyntheticModel(const char *path, size_t lineCount)
+{
+	FILE		*file		= fopen(path, "wb");
+	uint32_t	seed		= 0x5EED;
+	size_t		counter		= 0;
+
+	fprintf(file, "0 FILE main.ldr\r\n0 Synthetic benchmark model\r\n");
+	for(counter = 0; counter < lineCount; counter++)
+	{
+		fprintf(file, "1 %d %.3f %.3f %.3f 1 0 0 0 1 0 0 0 1 %d.dat\r\n",
+				(int)(BenchmarkRandom(&seed) % 72),
+				BenchmarkRandomFloat(&seed, -2000, 2000),
+				BenchmarkRandomFloat(&seed, -2000, 2000),
+				BenchmarkRandomFloat(&seed, -2000, 2000),
+				(int)(BenchmarkRandom(&seed) % 4000));
+	}
+	fclose(file);
+}
+
+
+//========== main ==============================================================
+//
+// Purpose:		Runs both ingestion paths over the same file.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	char		syntheticPath[]	= "/tmp/MappedFileBenchmark.XXXXXX";
+	const char	*path			= NULL;
+	struct stat	fileInfo;
+
+	if(argc > 1)
+		path = argv[1];
+	else
+	{
+		close(mkstemp(syntheticPath));
+		writeSyntheticModel(syntheticPath, 200000);
+		path = syntheticPath;
+	}
+
+	stat(path, &fileInfo);
+	printf("file: %s (%.1f MB)\n", path, fileInfo.st_size / (1024.0 * 1024.0));
+
+	runInChild("legacy", legacyIngest, path);
+	runInChild("mapped", mappedIngest, path);
+
+	if(path == syntheticPath)
+		unlink(syntheticPath);
+
+	return 0;
+}
@@ -0,0 +1,265 @@
+//==============================================================================
+//
+// File:		MeshCacheBenchmark.c
+//
+// Purpose:		Times building a display list's mesh the way the builders do
+//				with the smoothed mesh cache: cold (key, smooth, write the
+//				tables and save the entry) and warm (key, open the entry and
+//				copy it out). Also checks that the warm mesh is exactly the
+//				cold one.
+//
+//				The tori run from well below LDRAW_MESH_CACHE_MINIMUM_FACES to
+//				the size of a big baseplate.
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					MeshCacheBenchmark.c
+//					../Source/LDraw/Renderer/LDrawMeshCache.c
+//					../Source/LDraw/Support/LDrawAtomicWrite.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [ldraw folder part.dat ...]
+//				Without a library, runs on synthetic tori.
+//
+//==============================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "LDrawMeshCache.h"
+#include "MeshSmooth.h"
+
+#define REPEATS			5
+
+// One mesh as the display list gets it.
+typedef struct
+{
+	int				vertexCount;
+	int				indexCount;
+	float			*vertices;
+	unsigned int	*indices;
+	int				ranges[8];		// line, cond line, tri and quad starts and counts
+
+} MeshOutput;
+
+static const float	meshColor[4]	= { 0.5f, 0.5f, 0.5f, 1.0f };
+
+
+//========== meshKey ===========================================================
+//
+// Purpose:		The key the builders would compute for flat.
+//
+//==============================================================================
+static LDrawMeshCacheKey meshKey(const FlatMesh *flat)
+{
+	LDrawMeshCacheHasher	hasher;
+	int						counter	= 0;
+
+	LDrawMeshCacheHasherInit(&hasher, LDrawMeshCacheRemovedTJunctions | LDrawMeshCacheOptimizedVertexCache);
+	for(counter = 0; counter < flat->polygonCount; counter++)
+	{
+		const Primitive *p = flat->polygons + counter;
+		LDrawMeshCacheHasherAddFace(&hasher, p->points[0], p->points[1], p->points[2], (p->degree == 4) ? p->points[3] : NULL, meshColor, 0);
+	}
+	for(counter = 0; counter < flat->lineCount; counter++)
+		LDrawMeshCacheHasherAddFace(&hasher, flat->lines[counter].points[0], flat->lines[counter].points[1], NULL, NULL, meshColor, 0);
+
+	return LDrawMeshCacheHasherFinish(&hasher);
+}
+
+
+//========== buildCold =========================================================
+//
+// Purpose:		Smooths flat and saves it to the cache in directory.
+//
+//==============================================================================
+static MeshOutput buildCold(const FlatMesh *flat, const char *directory)
+{
+	MeshOutput			output;
+	struct Mesh			*mesh		= NULL;
+	int					triCount	= 0;
+	int					counter		= 0;
+	int					*r			= output.ranges;
+	char				path[1024];
+	LDrawMeshCacheKey	key;
+
+	for(counter = 0; counter < flat->polygonCount; counter++)
+		triCount += (flat->polygons[counter].degree == 3);
+
+	key = meshKey(flat);
+
+	mesh = create_mesh(triCount, flat->polygonCount - triCount, flat->lineCount, 0);
+	for(counter = 0; counter < flat->polygonCount; counter++)
+	{
+		const Primitive *p = flat->polygons + counter;
+		add_face(mesh, p->points[0], p->points[1], p->points[2], (p->degree == 4) ? p->points[3] : NULL, meshColor, 0);
+	}
+	for(counter = 0; counter < flat->lineCount; counter++)
+		add_face(mesh, flat->lines[counter].points[0], flat->lines[counter].points[1], NULL, NULL, meshColor, 0);
+
+	finish_faces_and_sort(mesh);
+	add_creases(mesh);
+	find_and_remove_t_junctions(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+	optimize_vertex_cache(mesh);
+
+	get_final_mesh_counts(mesh, &output.vertexCount, &output.indexCount);
+	output.vertices	= malloc(sizeof(float) * 10 * output.vertexCount);
+	output.indices	= malloc(sizeof(unsigned int) * output.indexCount);
+	write_indexed_mesh(mesh, output.vertexCount, output.vertices, output.indexCount, output.indices, 0,
+					   r + 0, r + 1, r + 2, r + 3, r + 4, r + 5, r + 6, r + 7);
+	destroy_mesh(mesh);
+
+	LDrawMeshCachePathForKey(directory, key, path, sizeof(path));
+	LDrawMeshCacheEntryWrite(path, key, output.vertexCount, output.vertices, output.indexCount, output.indices, 1,
+							 r + 0, r + 1, r + 2, r + 3, r + 4, r + 5, r + 6, r + 7);
+
+	return output;
+}
+
+
+//========== buildWarm =========================================================
+//
+// Purpose:		Loads flat's smoothed mesh from the cache in directory. Returns
+//				an empty mesh on a miss.
+//
+//==============================================================================
+static MeshOutput buildWarm(const FlatMesh *flat, const char *directory)
+{
+	MeshOutput			output;
+	LDrawMeshCacheEntry	*entry		= NULL;
+	int					*r			= output.ranges;
+	char				path[1024];
+	LDrawMeshCacheKey	key;
+
+	memset(&output, 0, sizeof(output));
+
+	key = meshKey(flat);
+	LDrawMeshCachePathForKey(directory, key, path, sizeof(path));
+	entry = LDrawMeshCacheEntryOpen(path, key, 1);
+
+	if(entry != NULL)
+	{
+		output.vertexCount	= entry->header->vertexCount;
+		output.indexCount	= entry->header->indexCount;
+		output.vertices		= malloc(sizeof(float) * 10 * output.vertexCount);
+		output.indices		= malloc(sizeof(unsigned int) * output.indexCount);
+		memcpy(output.vertices, entry->vertices, sizeof(float) * 10 * output.vertexCount);
+		memcpy(output.indices, entry->indices, sizeof(unsigned int) * output.indexCount);
+		LDrawMeshCacheEntryGetRanges(entry, r + 0, r + 1, r + 2, r + 3, r + 4, r + 5, r + 6, r + 7);
+		LDrawMeshCacheEntryClose(entry);
+	}
+
+	return output;
+}
+
+
+//========== compareBuilds =====================================================
+//
+// Purpose:		Prints one row of the report. Returns whether the warm mesh
+//				matched the cold one every time.
+//
+//==============================================================================
+static int compareBuilds(const char *name, const FlatMesh *flat, const char *directory)
+{
+	double		coldTime	= 0;
+	double		warmTime	= 0;
+	double		start		= 0;
+	int			identical	= 1;
+	int			repeat		= 0;
+	MeshOutput	cold;
+	MeshOutput	warm;
+
+	for(repeat = 0; repeat < REPEATS; repeat++)
+	{
+		start = BenchmarkNow();
+		cold = buildCold(flat, directory);
+		coldTime += BenchmarkNow() - start;
+
+		start = BenchmarkNow();
+		warm = buildWarm(flat, directory);
+		warmTime += BenchmarkNow() - start;
+
+		identical = identical
+				&&	cold.vertexCount == warm.vertexCount
+				&&	cold.indexCount == warm.indexCount
+				&&	memcmp(cold.ranges, warm.ranges, sizeof(cold.ranges)) == 0
+				&&	memcmp(cold.vertices, warm.vertices, sizeof(float) * 10 * cold.vertexCount) == 0
+				&&	memcmp(cold.indices, warm.indices, sizeof(unsigned int) * cold.indexCount) == 0;
+
+		free(cold.vertices);
+		free(cold.indices);
+		free(warm.vertices);
+		free(warm.indices);
+	}
+
+	printf("%-24s %8d %10.3f ms %10.3f ms %8.1fx  %s\n", name, flat->polygonCount,
+		   coldTime / REPEATS * 1e3, warmTime / REPEATS * 1e3, coldTime / warmTime,
+		   identical ? "identical" : "DIFFERS");
+
+	return identical;
+}
+
+
+int main(int argc, const char *argv[])
+{
+	static const float	identity[12]	= { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0 };
+	char				directory[]		= "/tmp/MeshCacheBenchmark.XXXXXX";
+	char				command[64];
+	int					allIdentical	= 1;
+	int					counter			= 0;
+
+	if(mkdtemp(directory) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+
+	printf("%-24s %8s %13s %13s %9s\n", "mesh", "faces", "cold", "warm", "speedup");
+
+	if(argc > 2)
+	{
+		for(counter = 2; counter < argc; counter++)
+		{
+			FlatMesh flat;
+
+			memset(&flat, 0, sizeof(flat));
+			flattenPart(&flat, argv[1], argv[counter], identity, 0);
+			if(flat.missingFiles)
+				fprintf(stderr, "%s: %d files not found\n", argv[counter], flat.missingFiles);
+			if(flat.polygonCount > 0)
+				allIdentical &= compareBuilds(argv[counter], &flat, directory);
+
+			free(flat.polygons);
+			free(flat.lines);
+		}
+	}
+	else
+	{
+		static const int	sizes[][2]	= { { 8, 4 }, { 16, 8 }, { 24, 12 }, { 48, 24 }, { 192, 96 }, { 384, 192 } };
+
+		for(counter = 0; counter < (int)(sizeof(sizes) / sizeof(sizes[0])); counter++)
+		{
+			FlatMesh	flat;
+			char		name[64];
+
+			memset(&flat, 0, sizeof(flat));
+			addTorus(&flat, sizes[counter][0], sizes[counter][1], 10.0f, TORUS_SEAM_LINES);
+			snprintf(name, sizeof(name), "torus %d x %d", sizes[counter][0], sizes[counter][1]);
+			allIdentical &= compareBuilds(name, &flat, directory);
+
+			free(flat.polygons);
+			free(flat.lines);
+		}
+	}
+
+	snprintf(command, sizeof(command), "rm -rf %s", directory);
+	system(command);
+
+	return allIdentical ? 0 : 1;
+}
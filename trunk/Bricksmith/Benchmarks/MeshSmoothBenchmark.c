@@ -0,0 +1,252 @@
+//==============================================================================
+//
+// File:		MeshSmoothBenchmark.c
+//
+// Purpose:		Times each stage of MeshSmooth on one thread and on all of
+//				them, and checks that both produce exactly the same mesh.
+//
+//				The mesh is a synthetic baseplate: a grid of studs (walls,
+//				triangle-fan tops and edge lines) on a plate whose top is
+//				coarser than its walls, so that there are T junctions to find.
+//				Stud tops are nudged by less than the weld distance so that
+//				vertices have to be snapped together.
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer MeshSmoothBenchmark.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [studs per side] [threads]
+//				Defaults to a 48 x 48 baseplate and one thread per core.
+//
+//==============================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkSupport.h"
+#include "MeshSmooth.h"
+
+#define STUD_SIDES		16
+#define STUD_RADIUS		6.0f
+#define STUD_HEIGHT		4.0f
+#define CELL			20.0f
+#define PLATE_HEIGHT	8.0f
+
+enum
+{
+	STAGE_FINISH_FACES,
+	STAGE_CREASES,
+	STAGE_T_JUNCTIONS,
+	STAGE_JOIN,
+	STAGE_SMOOTH,
+	STAGE_MERGE,
+	STAGE_WRITE,
+	STAGE_COUNT
+};
+
+static const char *stageNames[STAGE_COUNT] =
+{
+	"finish_faces_and_sort",
+	"add_creases",
+	"find_and_remove_t_junctions",
+	"finish_creases_and_join",
+	"smooth_vertices",
+	"merge_vertices",
+	"write_indexed_mesh",
+};
+
+// One smoothed mesh, as written out.
+typedef struct
+{
+	int				vertexCount;
+	int				indexCount;
+	float			*vertices;
+	unsigned int	*indices;
+	int				starts[8];
+	int				counts[8];
+
+} MeshOutput;
+
+
+//========== addBaseplate ======================================================
+//
+// Purpose:		Adds the synthetic baseplate to mesh, or if mesh is NULL, just
+//				counts its tris, quads and lines.
+//
+//==============================================================================
+static void addBaseplate(struct Mesh *mesh, int studs, int *triCount, int *quadCount, int *lineCount)
+{
+	const float	plateColor[4]	= { 0.3f, 0.6f, 0.2f, 1.0f };
+	const float	studColor[4]	= { 0.3f, 0.6f, 0.2f, 1.0f };
+	float		size			= studs * CELL;
+	uint32_t	seed			= 0x9E3779B9;
+	int			x, z, s, pass;
+
+	*triCount = *quadCount = *lineCount = 0;
+
+	// Polygons first, then lines.
+	for(pass = 0; pass < 2; pass++)
+	{
+		// Plate top: one quad per cell.
+		for(x = 0; x < studs && pass == 0; x++)
+		for(z = 0; z < studs; z++)
+		{
+			float p1[3] = { x * CELL,			0, z * CELL };
+			float p2[3] = { x * CELL,			0, (z + 1) * CELL };
+			float p3[3] = { (x + 1) * CELL,	0, (z + 1) * CELL };
+			float p4[3] = { (x + 1) * CELL,	0, z * CELL };
+			if(mesh) add_face(mesh, p1, p2, p3, p4, plateColor, 0);
+			++*quadCount;
+		}
+
+		// Plate walls, subdivided twice as finely as the top: T junctions.
+		for(x = 0; x < studs * 2 && pass == 0; x++)
+		{
+			float a = x * CELL / 2, b = (x + 1) * CELL / 2;
+			float walls[4][4][3] =
+			{
+				{ { a, 0, 0 },		{ b, 0, 0 },		{ b, PLATE_HEIGHT, 0 },		{ a, PLATE_HEIGHT, 0 } },
+				{ { b, 0, size },	{ a, 0, size },		{ a, PLATE_HEIGHT, size },	{ b, PLATE_HEIGHT, size } },
+				{ { 0, 0, b },		{ 0, 0, a },		{ 0, PLATE_HEIGHT, a },		{ 0, PLATE_HEIGHT, b } },
+				{ { size, 0, a },	{ size, 0, b },		{ size, PLATE_HEIGHT, b },	{ size, PLATE_HEIGHT, a } },
+			};
+			for(s = 0; s < 4; s++)
+			{
+				if(mesh) add_face(mesh, walls[s][0], walls[s][1], walls[s][2], walls[s][3], plateColor, 0);
+				++*quadCount;
+			}
+		}
+
+		// Studs.
+		for(x = 0; x < studs; x++)
+		for(z = 0; z < studs; z++)
+		{
+			float	cx		= (x + 0.5f) * CELL;
+			float	cz		= (z + 0.5f) * CELL;
+			float	center[3]	= { cx, -STUD_HEIGHT, cz };
+
+			for(s = 0; s < STUD_SIDES; s++)
+			{
+				float	a0		= 2 * (float)M_PI * s / STUD_SIDES;
+				float	a1		= 2 * (float)M_PI * (s + 1) / STUD_SIDES;
+				float	jitter	= BenchmarkRandomFloat(&seed, -0.001f, 0.001f);
+				float	b0[3]	= { cx + STUD_RADIUS * cosf(a0), 0, cz + STUD_RADIUS * sinf(a0) };
+				float	b1[3]	= { cx + STUD_RADIUS * cosf(a1), 0, cz + STUD_RADIUS * sinf(a1) };
+				float	t0[3]	= { b0[0] + jitter, -STUD_HEIGHT, b0[2] };
+				float	t1[3]	= { b1[0], -STUD_HEIGHT, b1[2] };
+
+				if(pass == 0)
+				{
+					if(mesh) add_face(mesh, b0, b1, t1, t0, studColor, 0);
+					if(mesh) add_face(mesh, t0, t1, center, NULL, studColor, 0);
+					++*quadCount;
+					++*triCount;
+				}
+				else
+				{
+					if(mesh) add_face(mesh, b0, b1, NULL, NULL, studColor, 0);
+					if(mesh) add_face(mesh, t0, t1, NULL, NULL, studColor, 0);
+					*lineCount += 2;
+				}
+			}
+		}
+	}
+}
+
+
+//========== smoothBaseplate ===================================================
+//
+// Purpose:		Builds and smooths the baseplate with the given number of
+//				threads, adding each stage's time to stageTimes.
+//
+//==============================================================================
+static MeshOutput smoothBaseplate(int studs, int threads, double stageTimes[STAGE_COUNT])
+{
+	MeshOutput		output;
+	struct Mesh		*mesh		= NULL;
+	int				triCount	= 0;
+	int				quadCount	= 0;
+	int				lineCount	= 0;
+	double			start		= 0;
+
+	memset(&output, 0, sizeof(output));
+	set_smoothing_thread_count(threads);
+
+	addBaseplate(NULL, studs, &triCount, &quadCount, &lineCount);
+	mesh = create_mesh(triCount, quadCount, lineCount, 0);
+	addBaseplate(mesh, studs, &triCount, &quadCount, &lineCount);
+
+	start = BenchmarkNow();
+	finish_faces_and_sort(mesh);				stageTimes[STAGE_FINISH_FACES]	+= BenchmarkNow() - start;	start = BenchmarkNow();
+	add_creases(mesh);							stageTimes[STAGE_CREASES]		+= BenchmarkNow() - start;	start = BenchmarkNow();
+	find_and_remove_t_junctions(mesh);			stageTimes[STAGE_T_JUNCTIONS]	+= BenchmarkNow() - start;	start = BenchmarkNow();
+	finish_creases_and_join(mesh);				stageTimes[STAGE_JOIN]			+= BenchmarkNow() - start;	start = BenchmarkNow();
+	smooth_vertices(mesh);						stageTimes[STAGE_SMOOTH]		+= BenchmarkNow() - start;	start = BenchmarkNow();
+	merge_vertices(mesh);						stageTimes[STAGE_MERGE]			+= BenchmarkNow() - start;	start = BenchmarkNow();
+
+	get_final_mesh_counts(mesh, &output.vertexCount, &output.indexCount);
+	output.vertices	= malloc(sizeof(float) * 10 * output.vertexCount);
+	output.indices	= malloc(sizeof(unsigned int) * output.indexCount);
+	write_indexed_mesh(mesh, output.vertexCount, output.vertices, output.indexCount, output.indices, 0,
+					   output.starts + 0, output.counts + 0, output.starts + 1, output.counts + 1,
+					   output.starts + 2, output.counts + 2, output.starts + 3, output.counts + 3);
+	stageTimes[STAGE_WRITE] += BenchmarkNow() - start;
+
+	destroy_mesh(mesh);
+
+	return output;
+}
+
+
+//========== sameOutput ========================================================
+//
+// Purpose:		Returns whether two smoothed meshes are bit-for-bit identical.
+//
+//==============================================================================
+static int sameOutput(const MeshOutput *a, const MeshOutput *b)
+{
+	return	a->vertexCount == b->vertexCount
+		&&	a->indexCount == b->indexCount
+		&&	memcmp(a->starts, b->starts, sizeof(a->starts)) == 0
+		&&	memcmp(a->counts, b->counts, sizeof(a->counts)) == 0
+		&&	memcmp(a->vertices, b->vertices, sizeof(float) * 10 * a->vertexCount) == 0
+		&&	memcmp(a->indices, b->indices, sizeof(unsigned int) * a->indexCount) == 0;
+}
+
+
+int main(int argc, const char *argv[])
+{
+	int			studs			= (argc > 1) ? atoi(argv[1]) : 48;
+	int			threads			= (argc > 2) ? atoi(argv[2]) : 0;
+	double		serial[STAGE_COUNT]		= { 0 };
+	double		parallel[STAGE_COUNT]	= { 0 };
+	double		serialTotal		= 0;
+	double		parallelTotal	= 0;
+	MeshOutput	serialMesh;
+	MeshOutput	parallelMesh;
+	int			stage			= 0;
+	int			identical		= 0;
+
+	serialMesh		= smoothBaseplate(studs, 1, serial);
+	parallelMesh	= smoothBaseplate(studs, threads, parallel);
+	identical		= sameOutput(&serialMesh, &parallelMesh);
+
+	printf("%d x %d baseplate: %d vertices, %d indices\n\n", studs, studs, serialMesh.vertexCount, serialMesh.indexCount);
+	printf("%-28s %10s %10s %8s\n", "stage", "1 thread", "parallel", "speedup");
+	for(stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		printf("%-28s %8.1f ms %8.1f ms %7.2fx\n", stageNames[stage],
+			   serial[stage] * 1e3, parallel[stage] * 1e3, serial[stage] / parallel[stage]);
+		serialTotal		+= serial[stage];
+		parallelTotal	+= parallel[stage];
+	}
+	printf("%-28s %8.1f ms %8.1f ms %7.2fx\n\n", "total", serialTotal * 1e3, parallelTotal * 1e3, serialTotal / parallelTotal);
+	printf("output %s\n", identical ? "identical" : "DIFFERS");
+
+	free(serialMesh.vertices);
+	free(serialMesh.indices);
+	free(parallelMesh.vertices);
+	free(parallelMesh.indices);
+
+	return identical ? 0 : 1;
+}
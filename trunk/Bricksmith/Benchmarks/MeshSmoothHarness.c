@@ -0,0 +1,1404 @@
+//==============================================================================
+//
+// File:		MeshSmoothHarness.c
+//
+// Purpose:		Runs meshes through the whole MeshSmooth pipeline and reports,
+//				for each, the time every stage took, the vertices and indices
+//				written and the weld ratio (distinct output positions over
+//				distinct input points). With --check it also checks each
+//				output, and exits non-zero if any mesh fails:
+//
+//				  - every index names a vertex, and nothing is NaN
+//				  - every line and conditional line that went in comes out
+//				  - the polygons cover the same area as the input's
+//				  - every vertex is within welding reach of an input point
+//				  - polygon normals are unit length, or zero for slivers
+//				  - one thread or several, SIMD or scalar: the same bytes
+//
+//				Meshes come from geometry dumps (LDraw files holding only the
+//				types 2 to 5 lines a display list collects; other lines are
+//				skipped), from parts flattened out of an LDraw library, from
+//				synthesized studs, tubes and curved slopes, or from seeded
+//				random fuzz meshes. Failing meshes can be saved as dumps and
+//				fed back in.
+//
+//				Built with METAL defined, quads are split into triangles and
+//				conditional lines are kept, as the Metal display list does;
+//				otherwise quads stay quads and conditional lines are dropped,
+//				as the OpenGL one does.
+//
+// Build:		see CMakeLists.txt, or
+//				cc -O2 -DNDEBUG -ffp-contract=off -I../Source/LDraw/Renderer
+//					-I../Source/LDraw/Support MeshSmoothHarness.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [options] [dump.ldr ...]
+//				  --check				check every output
+//				  --synthetic			add the synthesized meshes
+//				  --fuzz count			add count fuzz meshes
+//				  --seed seed			seed of the first fuzz mesh (1)
+//				  --library folder		the names that follow are parts in
+//										that library rather than dumps
+//				  --repeat count		time the fastest of count runs
+//				  --save-failures folder	write failing meshes there
+//
+//==============================================================================
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "MeshSmooth.h"
+
+// How far an output vertex may be from every input point.  Welding moves a
+// vertex to the middle of points at most EPSI (0.005) apart; chains of them
+// can reach a little further.
+#define WELD_REACH			0.02f
+
+// Normals are unit length to within this, or zero.
+#define NORMAL_TOLERANCE	1e-3f
+
+#ifndef METAL
+#define METAL 0
+#endif
+
+// The pipeline's stages, each timed on its own.
+enum
+{
+	stageSort,
+	stageCreases,
+	stageTJunctions,
+	stageJoin,
+	stageSmooth,
+	stageMerge,
+	stageVertexCache,
+	stageWrite,
+	stageCount
+};
+
+static const char *stageNames[stageCount] = { "sort", "crease", "tjunc", "join", "smooth", "merge", "vcache", "write" };
+
+// One line of a geometry dump.
+typedef struct
+{
+	int		type;			// LDraw line type: 2 line, 3 triangle, 4 quad, 5 conditional line.
+	int		color;			// LDraw color code.
+	float	points[4][3];
+
+} DumpFace;
+
+typedef struct
+{
+	char		name[256];
+	DumpFace	*faces;
+	int			count;
+	int			capacity;
+
+} Dump;
+
+// What write_indexed_mesh wrote, and how long it took to get there.
+typedef struct
+{
+	int				vertexCount;
+	int				indexCount;
+	float			*vertices;
+	unsigned int	*indices;
+	int				starts[4];		// Lines, conditional lines, triangles, quads.
+	int				counts[4];
+	double			times[stageCount];
+
+} MeshOutput;
+
+// Points hashed into cells as big as the welding reach.
+typedef struct
+{
+	int		bucketCount;
+	int		*bucketStarts;
+	float	(*points)[3];
+
+} PointGrid;
+
+typedef struct
+{
+	int			check;
+	int			repeat;
+	const char	*failureFolder;
+
+	int			meshes;
+	int			failures;
+	double		times[stageCount];
+
+} Options;
+
+
+#pragma mark -
+#pragma mark DUMPS
+#pragma mark -
+
+//========== addDumpFace =======================================================
+//
+// Purpose:		Appends one line to a dump.
+//
+//==============================================================================
+static void addDumpFace(Dump *dump, int type, int color, const float points[][3])
+{
+	DumpFace	*face			= NULL;
+	int			pointCount		= (type == 2) ? 2 : (type == 3) ? 3 : 4;
+
+	if(dump->count == dump->capacity)
+	{
+		dump->capacity	= dump->capacity ? dump->capacity * 2 : 1024;
+		dump->faces		= realloc(dump->faces, sizeof(DumpFace) * dump->capacity);
+	}
+	face = dump->faces + dump->count++;
+	memset(face, 0, sizeof(DumpFace));
+	face->type	= type;
+	face->color	= color;
+	memcpy(face->points, points, sizeof(float) * 3 * pointCount);
+}
+
+
+//========== resetDump =========================================================
+//
+// Purpose:		Empties a dump and names it for its next mesh.
+//
+//==============================================================================
+static void resetDump(Dump *dump, const char *name)
+{
+	snprintf(dump->name, sizeof(dump->name), "%s", name);
+	dump->count = 0;
+}
+
+
+//========== readDump ==========================================================
+//
+// Purpose:		Reads a geometry dump.  Returns 0 if the file can't be opened.
+//
+//==============================================================================
+static int readDump(Dump *dump, const char *path)
+{
+	FILE		*file		= fopen(path, "r");
+	const char	*name		= strrchr(path, '/');
+	char		line[1024];
+
+	if(file == NULL)
+		return 0;
+
+	resetDump(dump, name ? name + 1 : path);
+
+	while(fgets(line, sizeof(line), file))
+	{
+		char	*cursor		= line;
+		long	lineType	= strtol(cursor, &cursor, 10);
+		float	points[4][3];
+		int		color		= 0;
+		int		counter		= 0;
+
+		if(cursor == line || lineType < 2 || lineType > 5)
+			continue;
+
+		color = (int)strtol(cursor, &cursor, 10);
+		for(counter = 0; counter < ((lineType == 2) ? 6 : (lineType == 3) ? 9 : 12); counter++)
+			points[counter / 3][counter % 3] = strtof(cursor, &cursor);
+
+		addDumpFace(dump, (int)lineType, color, points);
+	}
+	fclose(file);
+	return 1;
+}
+
+
+//========== writeDump =========================================================
+//
+// Purpose:		Writes a dump that readDump reads back exactly.
+//
+//==============================================================================
+static int writeDump(const Dump *dump, const char *path)
+{
+	FILE	*file		= fopen(path, "w");
+	int		counter		= 0;
+	int		point		= 0;
+
+	if(file == NULL)
+		return 0;
+
+	fprintf(file, "0 %s\n", dump->name);
+	for(counter = 0; counter < dump->count; counter++)
+	{
+		const DumpFace *face = dump->faces + counter;
+
+		fprintf(file, "%d %d", face->type, face->color);
+		for(point = 0; point < ((face->type == 2) ? 2 : (face->type == 3) ? 3 : 4); point++)
+			fprintf(file, " %.9g %.9g %.9g", face->points[point][0], face->points[point][1], face->points[point][2]);
+		fprintf(file, "\n");
+	}
+	fclose(file);
+	return 1;
+}
+
+
+//========== addFlatMesh =======================================================
+//
+// Purpose:		Adds a flattened part, its polygons in color 16 and its lines
+//				in 24.
+//
+//==============================================================================
+static void addFlatMesh(Dump *dump, const FlatMesh *flat)
+{
+	int counter = 0;
+
+	for(counter = 0; counter < flat->polygonCount; counter++)
+		addDumpFace(dump, flat->polygons[counter].degree, 16, flat->polygons[counter].points);
+	for(counter = 0; counter < flat->lineCount; counter++)
+		addDumpFace(dump, 2, 24, flat->lines[counter].points);
+}
+
+
+#pragma mark -
+#pragma mark SYNTHESIZED MESHES
+#pragma mark -
+
+//========== setPoint ==========================================================
+//
+// Purpose:		Fills in one point.
+//
+//==============================================================================
+static void setPoint(float point[3], float x, float y, float z)
+{
+	point[0] = x;
+	point[1] = y;
+	point[2] = z;
+}
+
+
+//========== addCylinder =======================================================
+//
+// Purpose:		The wall of an upright cylinder from y down to y - height, as
+//				LDraw's cylinder primitives draw it: a quad and a conditional
+//				line per side.  Facing in flips the quads.
+//
+//==============================================================================
+static void addCylinder(Dump *dump, float x, float y, float z, float radius, float height, int sides, int facingIn)
+{
+	int side = 0;
+
+	for(side = 0; side < sides; side++)
+	{
+		float	before	= 2 * (float)M_PI * (side - 1) / sides;
+		float	start	= 2 * (float)M_PI * side / sides;
+		float	end		= 2 * (float)M_PI * (side + 1) / sides;
+		float	quad[4][3];
+		float	condLine[4][3];
+
+		setPoint(quad[0], x + radius * cosf(start), y, z + radius * sinf(start));
+		setPoint(quad[1], x + radius * cosf(end), y, z + radius * sinf(end));
+		setPoint(quad[2], x + radius * cosf(end), y - height, z + radius * sinf(end));
+		setPoint(quad[3], x + radius * cosf(start), y - height, z + radius * sinf(start));
+		if(facingIn)
+		{
+			float swap[3];
+			memcpy(swap, quad[1], sizeof(swap));
+			memcpy(quad[1], quad[3], sizeof(swap));
+			memcpy(quad[3], swap, sizeof(swap));
+		}
+		addDumpFace(dump, 4, 16, quad);
+
+		setPoint(condLine[0], x + radius * cosf(start), y, z + radius * sinf(start));
+		setPoint(condLine[1], x + radius * cosf(start), y - height, z + radius * sinf(start));
+		setPoint(condLine[2], x + radius * cosf(before), y, z + radius * sinf(before));
+		setPoint(condLine[3], x + radius * cosf(end), y, z + radius * sinf(end));
+		addDumpFace(dump, 5, 24, condLine);
+	}
+}
+
+
+//========== addRing ===========================================================
+//
+// Purpose:		A flat ring at height y between two radii, with an edge line
+//				around the outside; an inner radius of 0 makes a disc.
+//
+//==============================================================================
+static void addRing(Dump *dump, float x, float y, float z, float outer, float inner, int sides, int facingUp)
+{
+	int side = 0;
+
+	for(side = 0; side < sides; side++)
+	{
+		float	start	= 2 * (float)M_PI * side / sides;
+		float	end		= 2 * (float)M_PI * (side + 1) / sides;
+		float	points[4][3];
+
+		setPoint(points[0], x + inner * cosf(start), y, z + inner * sinf(start));
+		setPoint(points[1], x + outer * cosf(start), y, z + outer * sinf(start));
+		setPoint(points[2], x + outer * cosf(end), y, z + outer * sinf(end));
+		setPoint(points[3], x + inner * cosf(end), y, z + inner * sinf(end));
+		if(facingUp)
+		{
+			float swap[3];
+			memcpy(swap, points[1], sizeof(swap));
+			memcpy(points[1], points[3], sizeof(swap));
+			memcpy(points[3], swap, sizeof(swap));
+		}
+		if(inner > 0)
+			addDumpFace(dump, 4, 16, points);
+		else
+			addDumpFace(dump, 3, 16, (facingUp ? points + 1 : points));
+
+		setPoint(points[0], x + outer * cosf(start), y, z + outer * sinf(start));
+		setPoint(points[1], x + outer * cosf(end), y, z + outer * sinf(end));
+		addDumpFace(dump, 2, 24, points);
+	}
+}
+
+
+//========== addPrimitiveStud ==================================================
+//
+// Purpose:		A stud standing on y as stud.dat builds it from LDraw's
+//				primitives: a 16-sided cylinder with its conditional lines, a
+//				disc underneath and one on top.
+//
+//==============================================================================
+static void addPrimitiveStud(Dump *dump, float x, float y, float z)
+{
+	addCylinder(dump, x, y, z, 6, 4, 16, 0);
+	addRing(dump, x, y, z, 6, 0, 16, 0);
+	addRing(dump, x, y - 4, z, 6, 0, 16, 1);
+}
+
+
+//========== addTube ===========================================================
+//
+// Purpose:		An anti-stud tube hanging from y - height down to y: outer and
+//				inner walls and the ring at the bottom.
+//
+//==============================================================================
+static void addTube(Dump *dump, float x, float y, float z, float height)
+{
+	addCylinder(dump, x, y, z, 8, height, 16, 0);
+	addCylinder(dump, x, y, z, 6, height, 16, 1);
+	addRing(dump, x, y, z, 8, 6, 16, 0);
+	addRing(dump, x, y, z, 6, 0, 16, 0);
+}
+
+
+//========== addBrick ==========================================================
+//
+// Purpose:		A brick or plate columns x rows studs in size, with studs on
+//				top and tubes underneath.
+//
+//==============================================================================
+static void addBrick(Dump *dump, int columns, int rows, float height)
+{
+	float		min[3]		= { 0, 0, 0 };
+	float		max[3]		= { 20.0f * columns, height, 20.0f * rows };
+	int			column		= 0;
+	int			row			= 0;
+	FlatMesh	box;
+
+	memset(&box, 0, sizeof(box));
+	addBox(&box, min, max);
+	addFlatMesh(dump, &box);
+	free(box.polygons);
+	free(box.lines);
+
+	for(column = 0; column < columns; column++)
+	for(row = 0; row < rows; row++)
+		addPrimitiveStud(dump, 20.0f * column + 10, 0, 20.0f * row + 10);
+
+	for(column = 1; column < columns; column++)
+	for(row = 1; row < rows; row++)
+		addTube(dump, 20.0f * column, height, 20.0f * row, height - 4);
+}
+
+
+//========== addCurvedSlope ====================================================
+//
+// Purpose:		A quarter cylinder of the given radius lying along x, with
+//				flat sides and back: the curve of a curved slope brick, in
+//				segments quads with conditional lines between them.
+//
+//==============================================================================
+static void addCurvedSlope(Dump *dump, float width, float radius, int segments)
+{
+	float	points[4][3];
+	float	center[3]	= { 0, 0, radius };
+	int		segment		= 0;
+	int		side		= 0;
+
+	for(segment = 0; segment < segments; segment++)
+	{
+		float	before	= 0.5f * (float)M_PI * (segment - 1) / segments;
+		float	start	= 0.5f * (float)M_PI * segment / segments;
+		float	end		= 0.5f * (float)M_PI * (segment + 1) / segments;
+
+		setPoint(points[0], 0, -radius * sinf(start), radius - radius * cosf(start));
+		setPoint(points[1], 0, -radius * sinf(end), radius - radius * cosf(end));
+		setPoint(points[2], width, -radius * sinf(end), radius - radius * cosf(end));
+		setPoint(points[3], width, -radius * sinf(start), radius - radius * cosf(start));
+		addDumpFace(dump, 4, 4, points);
+
+		if(segment > 0)
+		{
+			setPoint(points[1], width, -radius * sinf(start), radius - radius * cosf(start));
+			setPoint(points[2], 0, -radius * sinf(before), radius - radius * cosf(before));
+			setPoint(points[3], 0, -radius * sinf(end), radius - radius * cosf(end));
+			addDumpFace(dump, 5, 24, points);
+		}
+
+		for(side = 0; side < 2; side++)
+		{
+			float x = side ? width : 0;
+
+			setPoint(points[0], x, center[1], center[2]);
+			setPoint(points[side ? 1 : 2], x, -radius * sinf(start), radius - radius * cosf(start));
+			setPoint(points[side ? 2 : 1], x, -radius * sinf(end), radius - radius * cosf(end));
+			addDumpFace(dump, 3, 4, points);
+
+			memcpy(points[0], points[1], sizeof(float) * 3);
+			memcpy(points[1], points[2], sizeof(float) * 3);
+			addDumpFace(dump, 2, 24, points);
+		}
+	}
+
+	// The flat bottom and back, and their edges.
+	setPoint(points[0], 0, 0, 0);
+	setPoint(points[1], width, 0, 0);
+	setPoint(points[2], width, 0, radius);
+	setPoint(points[3], 0, 0, radius);
+	addDumpFace(dump, 4, 4, points);
+	setPoint(points[0], 0, 0, radius);
+	setPoint(points[1], width, 0, radius);
+	setPoint(points[2], width, -radius, radius);
+	setPoint(points[3], 0, -radius, radius);
+	addDumpFace(dump, 4, 4, points);
+
+	for(side = 0; side < 3; side++)
+	{
+		float y = (side == 2) ? -radius : 0;
+		float z = (side == 0) ? 0 : radius;
+
+		setPoint(points[0], 0, y, z);
+		setPoint(points[1], width, y, z);
+		addDumpFace(dump, 2, 24, points);
+	}
+}
+
+
+//========== synthesizeMesh ====================================================
+//
+// Purpose:		Builds synthesized mesh number index into dump.  Returns 0
+//				past the last one.
+//
+//==============================================================================
+static int synthesizeMesh(Dump *dump, int index)
+{
+	switch(index)
+	{
+		case 0:
+			resetDump(dump, "stud");
+			addPrimitiveStud(dump, 0, 0, 0);
+			return 1;
+
+		case 1:
+			resetDump(dump, "tube");
+			addTube(dump, 0, 0, 0, 20);
+			return 1;
+
+		case 2:
+			resetDump(dump, "curved slope");
+			addCurvedSlope(dump, 40, 40, 16);
+			return 1;
+
+		case 3:
+			resetDump(dump, "brick 2 x 4");
+			addBrick(dump, 2, 4, 24);
+			return 1;
+
+		case 4:
+			resetDump(dump, "plate 32 x 32");
+			addBrick(dump, 32, 32, 8);
+			return 1;
+	}
+	return 0;
+}
+
+
+#pragma mark -
+#pragma mark FUZZING
+#pragma mark -
+
+//========== fuzzPoint =========================================================
+//
+// Purpose:		A point of the fuzz mesh's height field, nudged now and then
+//				by less than the weld distance.
+//
+//==============================================================================
+static void fuzzPoint(float point[3], const float *heights, int size, float cell, int i, int j, uint32_t *state, int jitter)
+{
+	setPoint(point, i * cell, heights[i * (size + 1) + j], j * cell);
+
+	if(jitter && (BenchmarkRandom(state) & 3) == 0)
+	{
+		point[0] += BenchmarkRandomFloat(state, -0.004f, 0.004f);
+		point[1] += BenchmarkRandomFloat(state, -0.004f, 0.004f);
+		point[2] += BenchmarkRandomFloat(state, -0.004f, 0.004f);
+	}
+}
+
+
+//========== addCell ===========================================================
+//
+// Purpose:		One cell of a fuzz mesh: a quad if it is flat, otherwise two
+//				triangles.
+//
+//==============================================================================
+static void addCell(Dump *dump, int color, int bumpy, const float points[4][3])
+{
+	float second[3][3];
+
+	if(!bumpy)
+	{
+		addDumpFace(dump, 4, color, points);
+		return;
+	}
+	memcpy(second[0], points[0], sizeof(float) * 3);
+	memcpy(second[1], points[2], sizeof(float) * 3);
+	memcpy(second[2], points[3], sizeof(float) * 3);
+	addDumpFace(dump, 3, color, points);
+	addDumpFace(dump, 3, color, second);
+}
+
+
+//========== fuzzMesh ==========================================================
+//
+// Purpose:		A random grid of cells, flat (in quads) or bumpy (in
+//				triangles), where cells may be missing, split in two (leaving
+//				T junctions with their neighbors), doubled, flipped, left
+//				degenerate or recolored, corners are nudged by less than the
+//				weld distance, and edges get lines and conditional lines.
+//				Some meshes also get studs, slivers or far-away coordinates.
+//
+//==============================================================================
+static void fuzzMesh(Dump *dump, uint32_t seed)
+{
+	static const float	cells[3]	= { 1, 4, 20 };
+	uint32_t			state		= seed * 2654435761u ^ 0x5bd1e995u;
+	int					size		= 0;
+	float				cell		= 0;
+	int					bumpy		= 0;
+	int					jitter		= 0;
+	float				*heights	= NULL;
+	float				offset[3]	= { 0, 0, 0 };
+	int					i			= 0;
+	int					j			= 0;
+	int					counter		= 0;
+	char				name[32];
+
+	if(state == 0)
+		state = 1;
+
+	snprintf(name, sizeof(name), "fuzz %u", seed);
+	resetDump(dump, name);
+
+	size	= 1 + BenchmarkRandom(&state) % 24;
+	cell	= cells[BenchmarkRandom(&state) % 3];
+	bumpy	= BenchmarkRandom(&state) & 1;
+	jitter	= (BenchmarkRandom(&state) % 3) != 0;
+	heights	= calloc((size + 1) * (size + 1), sizeof(float));
+
+	if(bumpy)
+		for(counter = 0; counter < (size + 1) * (size + 1); counter++)
+			heights[counter] = BenchmarkRandomFloat(&state, -cell, cell);
+
+	for(i = 0; i < size; i++)
+	for(j = 0; j < size; j++)
+	{
+		int		choice	= BenchmarkRandom(&state) % 16;
+		int		color	= (choice == 6) ? 4 : 16;
+		float	corners[4][3];
+		float	points[4][3];
+
+		fuzzPoint(corners[0], heights, size, cell, i, j, &state, jitter);
+		fuzzPoint(corners[1], heights, size, cell, i + 1, j, &state, jitter);
+		fuzzPoint(corners[2], heights, size, cell, i + 1, j + 1, &state, jitter);
+		fuzzPoint(corners[3], heights, size, cell, i, j + 1, &state, jitter);
+
+		if(choice == 0)
+			continue;
+
+		if(choice == 1)
+		{
+			// A corner repeated: the face is a line.
+			memcpy(points, corners, sizeof(points));
+			memcpy(points[2], points[1], sizeof(float) * 3);
+			addDumpFace(dump, 3, color, points);
+		}
+		else if(choice == 2)
+		{
+			// Split down the middle; the neighbors get T junctions.
+			for(counter = 0; counter < 3; counter++)
+			{
+				points[0][counter] = corners[0][counter];
+				points[1][counter] = 0.5f * (corners[0][counter] + corners[1][counter]);
+				points[2][counter] = 0.5f * (corners[3][counter] + corners[2][counter]);
+				points[3][counter] = corners[3][counter];
+			}
+			addCell(dump, color, bumpy, points);
+			memcpy(points[0], points[1], sizeof(float) * 3);
+			memcpy(points[3], points[2], sizeof(float) * 3);
+			memcpy(points[1], corners[1], sizeof(float) * 3);
+			memcpy(points[2], corners[2], sizeof(float) * 3);
+			addCell(dump, color, bumpy, points);
+		}
+		else
+		{
+			// Flipped cells wind the other way; doubled ones go in twice.
+			for(counter = 0; counter < 4; counter++)
+				memcpy(points[counter], corners[(choice == 3) ? 3 - counter : counter], sizeof(float) * 3);
+			addCell(dump, color, bumpy, points);
+			if(choice == 4)
+				addCell(dump, color, bumpy, points);
+		}
+
+		// Lines along the cell's near edges, conditional lines on the rest.
+		if((BenchmarkRandom(&state) & 3) == 0)
+			addDumpFace(dump, 2, 24, corners);
+		if((BenchmarkRandom(&state) & 7) == 0 && j > 0)
+		{
+			memcpy(points[0], corners[0], sizeof(float) * 3);
+			memcpy(points[1], corners[1], sizeof(float) * 3);
+			fuzzPoint(points[2], heights, size, cell, i, j - 1, &state, 0);
+			memcpy(points[3], corners[3], sizeof(float) * 3);
+			addDumpFace(dump, 5, 24, points);
+		}
+	}
+
+	// Studs on a flat mesh, standing on cell corners.
+	if(!bumpy && (BenchmarkRandom(&state) & 1))
+		for(counter = BenchmarkRandom(&state) % 8; counter > 0; counter--)
+			addPrimitiveStud(dump, cell * (BenchmarkRandom(&state) % (size + 1)), 0, cell * (BenchmarkRandom(&state) % (size + 1)));
+
+	// Slivers smaller than the weld distance.
+	if((BenchmarkRandom(&state) & 3) == 0)
+		for(counter = BenchmarkRandom(&state) % 16; counter > 0; counter--)
+		{
+			float points[3][3];
+
+			setPoint(points[0], BenchmarkRandomFloat(&state, 0, size * cell), BenchmarkRandomFloat(&state, -cell, cell), BenchmarkRandomFloat(&state, 0, size * cell));
+			setPoint(points[1], points[0][0] + 0.002f, points[0][1], points[0][2]);
+			setPoint(points[2], points[0][0], points[0][1] + 0.002f, points[0][2] + 0.001f);
+			addDumpFace(dump, 3, 16, points);
+		}
+
+	// Far from the origin, where floats are coarse.
+	if((BenchmarkRandom(&state) & 7) == 0)
+	{
+		offset[0] = 10000;
+		offset[2] = -5000;
+	}
+	for(counter = 0; counter < dump->count; counter++)
+	{
+		DumpFace *face = dump->faces + counter;
+
+		for(i = 0; i < 4; i++)
+			for(j = 0; j < 3; j++)
+				face->points[i][j] += offset[j];
+	}
+	free(heights);
+}
+
+
+#pragma mark -
+#pragma mark SMOOTHING
+#pragma mark -
+
+//========== colorForCode ======================================================
+//
+// Purpose:		A made-up RGBA for an LDraw color code; all that matters to
+//				the smoother is which codes are the same.
+//
+//==============================================================================
+static void colorForCode(int code, float color[4])
+{
+	uint32_t hash = (uint32_t)code * 2654435761u;
+
+	color[0] = (float)((hash >> 8) & 0xFF) / 255.0f;
+	color[1] = (float)((hash >> 16) & 0xFF) / 255.0f;
+	color[2] = (float)((hash >> 24) & 0xFF) / 255.0f;
+	color[3] = 1.0f;
+}
+
+
+//========== smoothDump ========================================================
+//
+// Purpose:		Feeds a dump to the smoother as this flavor's display list
+//				would, runs every stage and writes the mesh out.
+//
+//==============================================================================
+static MeshOutput smoothDump(const Dump *dump)
+{
+	MeshOutput		output;
+	struct Mesh		*mesh			= NULL;
+	int				triCount		= 0;
+	int				quadCount		= 0;
+	int				lineCount		= 0;
+	int				condLineCount	= 0;
+	int				counter			= 0;
+	int				pass			= 0;
+	double			start			= 0;
+
+	memset(&output, 0, sizeof(output));
+
+	for(counter = 0; counter < dump->count; counter++)
+	{
+		switch(dump->faces[counter].type)
+		{
+			case 2:		lineCount++;		break;
+			case 3:		triCount++;			break;
+		#if METAL
+			case 4:		triCount += 2;		break;
+			case 5:		condLineCount++;	break;
+		#else
+			case 4:		quadCount++;		break;
+		#endif
+		}
+	}
+
+	mesh = create_mesh(triCount, quadCount, lineCount, condLineCount);
+
+	// Polygons first, then lines.
+	for(pass = 0; pass < 2; pass++)
+		for(counter = 0; counter < dump->count; counter++)
+		{
+			const DumpFace	*face	= dump->faces + counter;
+			const float		(*p)[3]	= (const float (*)[3])face->points;
+			float			color[4];
+
+			colorForCode(face->color, color);
+
+			if(pass == 0 && face->type == 3)
+				add_face(mesh, p[0], p[1], p[2], NULL, color, 0);
+			else if(pass == 0 && face->type == 4)
+			{
+			#if METAL
+				add_face(mesh, p[0], p[1], p[2], NULL, color, 0);
+				add_face(mesh, p[0], p[2], p[3], NULL, color, 0);
+			#else
+				add_face(mesh, p[0], p[1], p[2], p[3], color, 0);
+			#endif
+			}
+			else if(pass == 1 && face->type == 2)
+				add_face(mesh, p[0], p[1], NULL, NULL, color, 0);
+		#if METAL
+			else if(pass == 1 && face->type == 5)
+				add_face(mesh, p[0], p[1], p[2], p[3], color, 0);
+		#endif
+		}
+
+	start = BenchmarkNow();
+	finish_faces_and_sort(mesh);
+	output.times[stageSort] = BenchmarkNow() - start;
+
+	start = BenchmarkNow();
+	add_creases(mesh);
+	output.times[stageCreases] = BenchmarkNow() - start;
+
+	start = BenchmarkNow();
+	find_and_remove_t_junctions(mesh);
+	output.times[stageTJunctions] = BenchmarkNow() - start;
+
+	start = BenchmarkNow();
+	finish_creases_and_join(mesh);
+	output.times[stageJoin] = BenchmarkNow() - start;
+
+	start = BenchmarkNow();
+	smooth_vertices(mesh);
+	output.times[stageSmooth] = BenchmarkNow() - start;
+
+	start = BenchmarkNow();
+	merge_vertices(mesh);
+	output.times[stageMerge] = BenchmarkNow() - start;
+
+	start = BenchmarkNow();
+	optimize_vertex_cache(mesh);
+	output.times[stageVertexCache] = BenchmarkNow() - start;
+
+	start = BenchmarkNow();
+	get_final_mesh_counts(mesh, &output.vertexCount, &output.indexCount);
+	output.vertices	= malloc(sizeof(float) * 10 * (output.vertexCount + 1));
+	output.indices	= malloc(sizeof(unsigned int) * (output.indexCount + 1));
+	write_indexed_mesh(mesh, output.vertexCount, output.vertices, output.indexCount, output.indices, 0,
+					   output.starts + 0, output.counts + 0, output.starts + 1, output.counts + 1,
+					   output.starts + 2, output.counts + 2, output.starts + 3, output.counts + 3);
+	output.times[stageWrite] = BenchmarkNow() - start;
+
+	destroy_mesh(mesh);
+
+	return output;
+}
+
+
+//========== freeOutput ========================================================
+//
+// Purpose:		Releases what smoothDump allocated.
+//
+//==============================================================================
+static void freeOutput(MeshOutput *output)
+{
+	free(output->vertices);
+	free(output->indices);
+	output->vertices	= NULL;
+	output->indices		= NULL;
+}
+
+
+//========== sameOutput ========================================================
+//
+// Purpose:		Returns whether two runs wrote exactly the same bytes.
+//
+//==============================================================================
+static int sameOutput(const MeshOutput *a, const MeshOutput *b)
+{
+	return	a->vertexCount == b->vertexCount
+		&&	a->indexCount == b->indexCount
+		&&	memcmp(a->starts, b->starts, sizeof(a->starts)) == 0
+		&&	memcmp(a->counts, b->counts, sizeof(a->counts)) == 0
+		&&	memcmp(a->vertices, b->vertices, sizeof(float) * 10 * a->vertexCount) == 0
+		&&	memcmp(a->indices, b->indices, sizeof(unsigned int) * a->indexCount) == 0;
+}
+
+
+#pragma mark -
+#pragma mark CHECKS
+#pragma mark -
+
+//========== comparePoints =====================================================
+//
+// Purpose:		qsort order for points, x then y then z.
+//
+//==============================================================================
+static int comparePoints(const void *a, const void *b)
+{
+	const float *p = a;
+	const float *q = b;
+	int			axis;
+
+	for(axis = 0; axis < 3; axis++)
+	{
+		if(p[axis] < q[axis])	return -1;
+		if(p[axis] > q[axis])	return 1;
+	}
+	return 0;
+}
+
+
+//========== countDistinct =====================================================
+//
+// Purpose:		Counts the distinct points in a list, sorting it.
+//
+//==============================================================================
+static int countDistinct(float (*points)[3], int count)
+{
+	int distinct	= 0;
+	int counter		= 0;
+
+	qsort(points, count, sizeof(float) * 3, comparePoints);
+	for(counter = 0; counter < count; counter++)
+		if(counter == 0 || comparePoints(points[counter - 1], points[counter]) != 0)
+			distinct++;
+	return distinct;
+}
+
+
+//========== inputPoints =======================================================
+//
+// Purpose:		Returns every point that smoothDump fed the smoother.
+//
+//==============================================================================
+static float (*inputPoints(const Dump *dump, int *outCount))[3]
+{
+	float	(*points)[3]	= malloc(sizeof(float) * 3 * 4 * (dump->count + 1));
+	int		count			= 0;
+	int		counter			= 0;
+	int		point			= 0;
+
+	for(counter = 0; counter < dump->count; counter++)
+	{
+		const DumpFace	*face		= dump->faces + counter;
+		int				pointCount	= (face->type == 2) ? 2 : (face->type == 3) ? 3 : 4;
+
+	#if !METAL
+		if(face->type == 5)
+			continue;
+	#endif
+		for(point = 0; point < pointCount; point++)
+			memcpy(points[count++], face->points[point], sizeof(float) * 3);
+	}
+	*outCount = count;
+	return points;
+}
+
+
+//========== gridCell ==========================================================
+//
+// Purpose:		The weld-reach-sized cell holding a coordinate.
+//
+//==============================================================================
+static int gridCell(float coordinate)
+{
+	return (int)floorf(coordinate / WELD_REACH);
+}
+
+
+//========== gridBucket ========================================================
+//
+// Purpose:		The bucket a cell hashes to.
+//
+//==============================================================================
+static int gridBucket(const PointGrid *grid, int x, int y, int z)
+{
+	uint32_t hash = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u;
+	return (int)(hash % (uint32_t)grid->bucketCount);
+}
+
+
+//========== buildGrid =========================================================
+//
+// Purpose:		Hashes points into weld-reach cells, counting sort style.
+//
+//==============================================================================
+static PointGrid buildGrid(float (*points)[3], int count)
+{
+	PointGrid	grid;
+	int			*buckets	= malloc(sizeof(int) * (count + 1));
+	int			counter		= 0;
+
+	grid.bucketCount	= count * 2 + 1;
+	grid.bucketStarts	= calloc(grid.bucketCount + 1, sizeof(int));
+	grid.points			= malloc(sizeof(float) * 3 * (count + 1));
+
+	for(counter = 0; counter < count; counter++)
+	{
+		buckets[counter] = gridBucket(&grid, gridCell(points[counter][0]), gridCell(points[counter][1]), gridCell(points[counter][2]));
+		grid.bucketStarts[buckets[counter] + 1]++;
+	}
+	for(counter = 0; counter < grid.bucketCount; counter++)
+		grid.bucketStarts[counter + 1] += grid.bucketStarts[counter];
+	for(counter = 0; counter < count; counter++)
+		memcpy(grid.points[grid.bucketStarts[buckets[counter]]++], points[counter], sizeof(float) * 3);
+
+	// Placing walked each start to the next bucket's; walk them back.
+	for(counter = grid.bucketCount; counter > 0; counter--)
+		grid.bucketStarts[counter] = grid.bucketStarts[counter - 1];
+	grid.bucketStarts[0] = 0;
+
+	free(buckets);
+	return grid;
+}
+
+
+//========== isNearGrid ========================================================
+//
+// Purpose:		Returns whether any point in the grid is within weld reach.
+//
+//==============================================================================
+static int isNearGrid(const PointGrid *grid, const float point[3])
+{
+	int x, y, z, counter;
+
+	for(x = gridCell(point[0]) - 1; x <= gridCell(point[0]) + 1; x++)
+	for(y = gridCell(point[1]) - 1; y <= gridCell(point[1]) + 1; y++)
+	for(z = gridCell(point[2]) - 1; z <= gridCell(point[2]) + 1; z++)
+	{
+		int bucket = gridBucket(grid, x, y, z);
+
+		for(counter = grid->bucketStarts[bucket]; counter < grid->bucketStarts[bucket + 1]; counter++)
+		{
+			float dx = grid->points[counter][0] - point[0];
+			float dy = grid->points[counter][1] - point[1];
+			float dz = grid->points[counter][2] - point[2];
+
+			if(dx * dx + dy * dy + dz * dz <= WELD_REACH * WELD_REACH)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+
+//========== triangleArea ======================================================
+//
+// Purpose:		The area of a triangle, in double to keep big meshes exact
+//				enough.
+//
+//==============================================================================
+static double triangleArea(const float *a, const float *b, const float *c)
+{
+	double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+
+	return 0.5 * sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+}
+
+
+//========== distance ==========================================================
+//
+// Purpose:		The distance between two points.
+//
+//==============================================================================
+static double distance(const float *a, const float *b)
+{
+	double d[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	return sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+
+
+//========== checkOutput =======================================================
+//
+// Purpose:		Checks one mesh's output against its input, describing the
+//				first problem found.  Returns 1 if there is none.
+//
+//==============================================================================
+static int checkOutput(const Dump *dump, const MeshOutput *output, char *problem, size_t size)
+{
+	static const int	sizes[4]		= { 2, 4, 3, 4 };
+	static const char	*kinds[4]		= { "line", "conditional line", "triangle", "quad" };
+	int					expected[4]		= { 0, 0, 0, 0 };
+	double				inputArea		= 0;
+	double				outputArea		= 0;
+	double				areaTolerance	= 1e-4;
+	float				(*points)[3]	= NULL;
+	int					pointCount		= 0;
+	PointGrid			grid;
+	int					total			= 0;
+	int					counter			= 0;
+	int					kind			= 0;
+	int					corner			= 0;
+
+	for(kind = 0; kind < 4; kind++)
+	{
+		if(output->counts[kind] % sizes[kind] != 0 || output->starts[kind] < 0
+		|| output->counts[kind] < 0 || output->starts[kind] + output->counts[kind] > output->indexCount)
+		{
+			snprintf(problem, size, "%s range %d + %d is broken", kinds[kind], output->starts[kind], output->counts[kind]);
+			return 0;
+		}
+		total += output->counts[kind];
+	}
+	if(total != output->indexCount)
+	{
+		snprintf(problem, size, "ranges hold %d of %d indices", total, output->indexCount);
+		return 0;
+	}
+
+	for(counter = 0; counter < output->indexCount; counter++)
+		if(output->indices[counter] >= (unsigned int)output->vertexCount)
+		{
+			snprintf(problem, size, "index %d is %u, past %d vertices", counter, output->indices[counter], output->vertexCount);
+			return 0;
+		}
+
+	for(counter = 0; counter < output->vertexCount * 10; counter++)
+		if(!isfinite(output->vertices[counter]))
+		{
+			snprintf(problem, size, "vertex %d is not a number", counter / 10);
+			return 0;
+		}
+
+	// Lines and conditional lines are never merged away.
+	for(counter = 0; counter < dump->count; counter++)
+	{
+		const DumpFace *face = dump->faces + counter;
+
+		if(face->type == 2)
+			expected[0]++;
+	#if METAL
+		else if(face->type == 5)
+			expected[1]++;
+	#endif
+		else if(face->type == 3 || face->type == 4)
+		{
+			inputArea		+= triangleArea(face->points[0], face->points[1], face->points[2]);
+			areaTolerance	+= WELD_REACH * (distance(face->points[0], face->points[1]) + distance(face->points[1], face->points[2]));
+			if(face->type == 4)
+			{
+				inputArea		+= triangleArea(face->points[0], face->points[2], face->points[3]);
+				areaTolerance	+= WELD_REACH * (distance(face->points[2], face->points[3]) + distance(face->points[3], face->points[0]));
+			}
+			else
+				areaTolerance	+= WELD_REACH * distance(face->points[2], face->points[0]);
+		}
+	}
+	for(kind = 0; kind < 2; kind++)
+		if(output->counts[kind] / sizes[kind] != expected[kind])
+		{
+			snprintf(problem, size, "%d %ss went in but %d came out", expected[kind], kinds[kind], output->counts[kind] / sizes[kind]);
+			return 0;
+		}
+
+	// Polygons: the area they cover, and their normals.
+	for(kind = 2; kind < 4; kind++)
+		for(counter = output->starts[kind]; counter < output->starts[kind] + output->counts[kind]; counter += sizes[kind])
+		{
+			const unsigned int *polygon = output->indices + counter;
+
+			outputArea += triangleArea(output->vertices + polygon[0] * 10, output->vertices + polygon[1] * 10, output->vertices + polygon[2] * 10);
+			if(kind == 3)
+				outputArea += triangleArea(output->vertices + polygon[0] * 10, output->vertices + polygon[2] * 10, output->vertices + polygon[3] * 10);
+
+			for(corner = 0; corner < sizes[kind]; corner++)
+			{
+				const float *normal = output->vertices + polygon[corner] * 10 + 3;
+				float		length	= sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+				if(length != 0 && fabsf(length - 1) > NORMAL_TOLERANCE)
+				{
+					snprintf(problem, size, "vertex %u's normal is %g long", polygon[corner], length);
+					return 0;
+				}
+			}
+		}
+	if(fabs(outputArea - inputArea) > areaTolerance)
+	{
+		snprintf(problem, size, "the polygons cover %g, not %g", outputArea, inputArea);
+		return 0;
+	}
+
+	// Welding and T junction removal only ever move vertices a little.
+	points	= inputPoints(dump, &pointCount);
+	grid	= buildGrid(points, pointCount);
+	for(counter = 0; counter < output->vertexCount; counter++)
+		if(!isNearGrid(&grid, output->vertices + counter * 10))
+		{
+			const float *v = output->vertices + counter * 10;
+
+			snprintf(problem, size, "vertex %d at %g %g %g is nowhere near the input", counter, v[0], v[1], v[2]);
+			break;
+		}
+	free(grid.bucketStarts);
+	free(grid.points);
+	free(points);
+
+	return counter == output->vertexCount;
+}
+
+
+//========== weldRatio =========================================================
+//
+// Purpose:		Distinct output positions over distinct input points.
+//
+//==============================================================================
+static double weldRatio(const Dump *dump, const MeshOutput *output)
+{
+	float	(*points)[3]	= NULL;
+	int		pointCount		= 0;
+	int		inputDistinct	= 0;
+	int		outputDistinct	= 0;
+	int		counter			= 0;
+
+	points			= inputPoints(dump, &pointCount);
+	inputDistinct	= countDistinct(points, pointCount);
+
+	points = realloc(points, sizeof(float) * 3 * (output->vertexCount + 1));
+	for(counter = 0; counter < output->vertexCount; counter++)
+		memcpy(points[counter], output->vertices + counter * 10, sizeof(float) * 3);
+	outputDistinct = countDistinct(points, output->vertexCount);
+
+	free(points);
+	return inputDistinct ? (double)outputDistinct / inputDistinct : 1.0;
+}
+
+
+#pragma mark -
+#pragma mark HARNESS
+#pragma mark -
+
+//========== runMesh ===========================================================
+//
+// Purpose:		Smooths, times, reports and optionally checks one mesh.
+//
+//==============================================================================
+static void runMesh(const Dump *dump, Options *options)
+{
+	MeshOutput	output;
+	char		problem[256]	= "";
+	int			passed			= 1;
+	int			polygons		= 0;
+	int			lines			= 0;
+	int			counter			= 0;
+	int			stage			= 0;
+	double		total			= 0;
+
+	set_smoothing_thread_count(0);
+	set_smoothing_simd_enabled(1);
+
+	output = smoothDump(dump);
+	for(counter = 1; counter < options->repeat; counter++)
+	{
+		MeshOutput again = smoothDump(dump);
+
+		for(stage = 0; stage < stageCount; stage++)
+			if(again.times[stage] < output.times[stage])
+				output.times[stage] = again.times[stage];
+		freeOutput(&again);
+	}
+
+	if(options->check)
+	{
+		MeshOutput	oneThread;
+		MeshOutput	scalar;
+
+		passed = checkOutput(dump, &output, problem, sizeof(problem));
+
+		set_smoothing_thread_count(1);
+		oneThread = smoothDump(dump);
+		set_smoothing_simd_enabled(0);
+		scalar = smoothDump(dump);
+
+		if(passed && !sameOutput(&output, &oneThread))
+		{
+			snprintf(problem, sizeof(problem), "one thread writes a different mesh");
+			passed = 0;
+		}
+		if(passed && !sameOutput(&oneThread, &scalar))
+		{
+			snprintf(problem, sizeof(problem), "the scalar code writes a different mesh");
+			passed = 0;
+		}
+		freeOutput(&oneThread);
+		freeOutput(&scalar);
+	}
+
+	for(counter = 0; counter < dump->count; counter++)
+	{
+		polygons	+= (dump->faces[counter].type == 3 || dump->faces[counter].type == 4);
+		lines		+= (dump->faces[counter].type == 2 || dump->faces[counter].type == 5);
+	}
+
+	printf("%-20.20s %7d %7d %7d %8d  %5.3f ", dump->name, polygons, lines, output.vertexCount, output.indexCount, weldRatio(dump, &output));
+	for(stage = 0; stage < stageCount; stage++)
+	{
+		printf(" %6.2f", output.times[stage] * 1e3);
+		options->times[stage]	+= output.times[stage];
+		total					+= output.times[stage];
+	}
+	printf(" %7.2f\n", total * 1e3);
+
+	options->meshes++;
+	if(!passed)
+	{
+		printf("  FAILED: %s\n", problem);
+		options->failures++;
+
+		if(options->failureFolder)
+		{
+			char path[1024];
+			char name[256];
+
+			for(counter = 0; dump->name[counter]; counter++)
+				name[counter] = (dump->name[counter] == ' ' || dump->name[counter] == '/') ? '-' : dump->name[counter];
+			name[counter] = 0;
+
+			snprintf(path, sizeof(path), "%s/%s%s", options->failureFolder, name, strstr(name, ".ldr") ? "" : ".ldr");
+			if(writeDump(dump, path))
+				printf("  saved as %s\n", path);
+		}
+	}
+	freeOutput(&output);
+}
+
+
+//========== main ==============================================================
+//
+// Purpose:		Runs the meshes named on the command line.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	static const float	identity[12]	= { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+	Options				options;
+	Dump				dump;
+	const char			*library		= NULL;
+	int					synthetic		= 0;
+	int					fuzzCount		= 0;
+	uint32_t			seed			= 1;
+	int					counter			= 0;
+	int					stage			= 0;
+	double				total			= 0;
+
+	memset(&options, 0, sizeof(options));
+	memset(&dump, 0, sizeof(dump));
+	options.repeat = 1;
+
+	printf("%-20s %7s %7s %7s %8s  %5s ", METAL ? "mesh (Metal)" : "mesh (OpenGL)", "polys", "lines", "verts", "indices", "weld");
+	for(stage = 0; stage < stageCount; stage++)
+		printf(" %6s", stageNames[stage]);
+	printf(" %7s\n", "ms");
+
+	for(counter = 1; counter < argc; counter++)
+	{
+		if(strcmp(argv[counter], "--check") == 0)
+			options.check = 1;
+		else if(strcmp(argv[counter], "--synthetic") == 0)
+			synthetic = 1;
+		else if(strcmp(argv[counter], "--fuzz") == 0 && counter + 1 < argc)
+			fuzzCount = atoi(argv[++counter]);
+		else if(strcmp(argv[counter], "--seed") == 0 && counter + 1 < argc)
+			seed = (uint32_t)strtoul(argv[++counter], NULL, 10);
+		else if(strcmp(argv[counter], "--repeat") == 0 && counter + 1 < argc)
+			options.repeat = atoi(argv[++counter]) > 0 ? atoi(argv[counter]) : 1;
+		else if(strcmp(argv[counter], "--save-failures") == 0 && counter + 1 < argc)
+			options.failureFolder = argv[++counter];
+		else if(strcmp(argv[counter], "--library") == 0 && counter + 1 < argc)
+			library = argv[++counter];
+		else if(library)
+		{
+			FlatMesh flat;
+
+			memset(&flat, 0, sizeof(flat));
+			flattenPart(&flat, library, argv[counter], identity, 0);
+			resetDump(&dump, argv[counter]);
+			addFlatMesh(&dump, &flat);
+			if(flat.missingFiles)
+				printf("%s: %d files missing\n", argv[counter], flat.missingFiles);
+			runMesh(&dump, &options);
+			free(flat.polygons);
+			free(flat.lines);
+		}
+		else if(readDump(&dump, argv[counter]))
+			runMesh(&dump, &options);
+		else
+		{
+			printf("%s: can't read\n", argv[counter]);
+			options.failures++;
+		}
+	}
+
+	if(synthetic)
+		for(counter = 0; synthesizeMesh(&dump, counter); counter++)
+			runMesh(&dump, &options);
+
+	for(counter = 0; counter < fuzzCount; counter++)
+	{
+		fuzzMesh(&dump, seed + counter);
+		runMesh(&dump, &options);
+	}
+
+	printf("%-20s %7d %7s %7s %8s  %5s ", "total", options.meshes, "", "", "", "");
+	for(stage = 0; stage < stageCount; stage++)
+	{
+		printf(" %6.2f", options.times[stage] * 1e3);
+		total += options.times[stage];
+	}
+	printf(" %7.2f\n", total * 1e3);
+
+	if(options.check)
+		printf("%d of %d meshes failed\n", options.failures, options.meshes);
+
+	free(dump.faces);
+	return options.failures ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+//==============================================================================
+//
+// File:		MeshSmoothSIMDBenchmark.c
+//
+// Purpose:		Times the MeshSmooth stages that have SIMD kernels with and
+//				without them, and checks that both produce exactly the same
+//				mesh.
+//
+//				The mesh is a grid of finely tessellated tori - alternately
+//				quads and triangles, with an edge line around each - so that
+//				nearly every vertex is smoothed and most of them merge.
+//
+// Build:		cc -O2 -DNDEBUG -ffp-contract=off -I../Source/LDraw/Renderer
+//					MeshSmoothSIMDBenchmark.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [tori per side]
+//				Defaults to 12 x 12 tori of 48 x 24 faces each.
+//
+//==============================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkSupport.h"
+#include "MeshSmooth.h"
+
+#define RING_SIDES		48
+#define TUBE_SIDES		24
+#define RING_RADIUS		10.0f
+#define TUBE_RADIUS		3.0f
+#define SPACING			30.0f
+#define REPEATS			3
+
+enum
+{
+	STAGE_FINISH_FACES,
+	STAGE_CREASES_AND_JOIN,
+	STAGE_SMOOTH,
+	STAGE_MERGE,
+	STAGE_WRITE,
+	STAGE_COUNT
+};
+
+static const char *stageNames[STAGE_COUNT] =
+{
+	"finish_faces_and_sort",
+	"creases and join",
+	"smooth_vertices",
+	"merge_vertices",
+	"write_indexed_mesh",
+};
+
+// One smoothed mesh, as written out.
+typedef struct
+{
+	int				vertexCount;
+	int				indexCount;
+	float			*vertices;
+	unsigned int	*indices;
+
+} MeshOutput;
+
+
+//========== torusPoint ========================================================
+//
+// Purpose:		The point at ring step i, tube step j of the torus at (x, z).
+//
+//==============================================================================
+static void torusPoint(float point[3], float x, float z, int i, int j)
+{
+	float ringAngle	= 2 * (float)M_PI * (i % RING_SIDES) / RING_SIDES;
+	float tubeAngle	= 2 * (float)M_PI * (j % TUBE_SIDES) / TUBE_SIDES;
+	float distance	= RING_RADIUS + TUBE_RADIUS * cosf(tubeAngle);
+
+	point[0] = x + distance * cosf(ringAngle);
+	point[1] = TUBE_RADIUS * sinf(tubeAngle);
+	point[2] = z + distance * sinf(ringAngle);
+}
+
+
+//========== addTori ===========================================================
+//
+// Purpose:		Adds the tori to mesh, or if mesh is NULL, just counts their
+//				tris, quads and lines.
+//
+//==============================================================================
+static void addTori(struct Mesh *mesh, int tori, int *triCount, int *quadCount, int *lineCount)
+{
+	const float	color[4]	= { 0.8f, 0.1f, 0.1f, 1.0f };
+	int			x, z, i, j, pass;
+
+	*triCount = *quadCount = *lineCount = 0;
+
+	// Polygons first, then lines.
+	for(pass = 0; pass < 2; pass++)
+	for(x = 0; x < tori; x++)
+	for(z = 0; z < tori; z++)
+	{
+		for(i = 0; i < RING_SIDES; i++)
+		{
+			float p1[3], p2[3], p3[3], p4[3];
+
+			if(pass == 1)
+			{
+				torusPoint(p1, x * SPACING, z * SPACING, i, 0);
+				torusPoint(p2, x * SPACING, z * SPACING, i + 1, 0);
+				if(mesh) add_face(mesh, p1, p2, NULL, NULL, color, 0);
+				++*lineCount;
+				continue;
+			}
+
+			for(j = 0; j < TUBE_SIDES; j++)
+			{
+				torusPoint(p1, x * SPACING, z * SPACING, i, j);
+				torusPoint(p2, x * SPACING, z * SPACING, i, j + 1);
+				torusPoint(p3, x * SPACING, z * SPACING, i + 1, j + 1);
+				torusPoint(p4, x * SPACING, z * SPACING, i + 1, j);
+
+				if((x + z) % 2 == 0)
+				{
+					if(mesh) add_face(mesh, p1, p2, p3, p4, color, 0);
+					++*quadCount;
+				}
+				else
+				{
+					if(mesh) add_face(mesh, p1, p2, p3, NULL, color, 0);
+					if(mesh) add_face(mesh, p1, p3, p4, NULL, color, 0);
+					*triCount += 2;
+				}
+			}
+		}
+	}
+}
+
+
+//========== smoothTori ========================================================
+//
+// Purpose:		Builds and smooths the tori, adding each stage's time to
+//				stageTimes.
+//
+//==============================================================================
+static MeshOutput smoothTori(int tori, int simd, double stageTimes[STAGE_COUNT])
+{
+	MeshOutput		output;
+	struct Mesh		*mesh		= NULL;
+	int				triCount	= 0;
+	int				quadCount	= 0;
+	int				lineCount	= 0;
+	int				starts[4];
+	int				counts[4];
+	double			start		= 0;
+
+	set_smoothing_simd_enabled(simd);
+
+	addTori(NULL, tori, &triCount, &quadCount, &lineCount);
+	mesh = create_mesh(triCount, quadCount, lineCount, 0);
+	addTori(mesh, tori, &triCount, &quadCount, &lineCount);
+
+	start = BenchmarkNow();
+	finish_faces_and_sort(mesh);				stageTimes[STAGE_FINISH_FACES]		+= BenchmarkNow() - start;	start = BenchmarkNow();
+	add_creases(mesh);
+	finish_creases_and_join(mesh);				stageTimes[STAGE_CREASES_AND_JOIN]	+= BenchmarkNow() - start;	start = BenchmarkNow();
+	smooth_vertices(mesh);						stageTimes[STAGE_SMOOTH]			+= BenchmarkNow() - start;	start = BenchmarkNow();
+	merge_vertices(mesh);						stageTimes[STAGE_MERGE]				+= BenchmarkNow() - start;	start = BenchmarkNow();
+
+	get_final_mesh_counts(mesh, &output.vertexCount, &output.indexCount);
+	output.vertices	= malloc(sizeof(float) * 10 * output.vertexCount);
+	output.indices	= malloc(sizeof(unsigned int) * output.indexCount);
+	write_indexed_mesh(mesh, output.vertexCount, output.vertices, output.indexCount, output.indices, 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+	stageTimes[STAGE_WRITE] += BenchmarkNow() - start;
+
+	destroy_mesh(mesh);
+
+	return output;
+}
+
+
+int main(int argc, const char *argv[])
+{
+	int			tori				= (argc > 1) ? atoi(argv[1]) : 12;
+	double		scalar[STAGE_COUNT]	= { 0 };
+	double		simd[STAGE_COUNT]	= { 0 };
+	double		scalarTotal			= 0;
+	double		simdTotal			= 0;
+	int			identical			= 1;
+	int			repeat				= 0;
+	int			stage				= 0;
+	MeshOutput	scalarMesh;
+	MeshOutput	simdMesh;
+
+	// Threads would only blur the comparison.
+	set_smoothing_thread_count(1);
+
+	for(repeat = 0; repeat < REPEATS; repeat++)
+	{
+		scalarMesh	= smoothTori(tori, 0, scalar);
+		simdMesh	= smoothTori(tori, 1, simd);
+
+		identical = identical
+				&&	scalarMesh.vertexCount == simdMesh.vertexCount
+				&&	scalarMesh.indexCount == simdMesh.indexCount
+				&&	memcmp(scalarMesh.vertices, simdMesh.vertices, sizeof(float) * 10 * scalarMesh.vertexCount) == 0
+				&&	memcmp(scalarMesh.indices, simdMesh.indices, sizeof(unsigned int) * scalarMesh.indexCount) == 0;
+
+		if(repeat + 1 < REPEATS)
+		{
+			free(scalarMesh.vertices);
+			free(scalarMesh.indices);
+			free(simdMesh.vertices);
+			free(simdMesh.indices);
+		}
+	}
+
+	printf("%d x %d tori: %d vertices, %d indices\n\n", tori, tori, scalarMesh.vertexCount, scalarMesh.indexCount);
+	printf("%-28s %10s %10s %8s\n", "stage", "scalar", "SIMD", "speedup");
+	for(stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		printf("%-28s %8.1f ms %8.1f ms %7.2fx\n", stageNames[stage],
+			   scalar[stage] / REPEATS * 1e3, simd[stage] / REPEATS * 1e3, scalar[stage] / simd[stage]);
+		scalarTotal	+= scalar[stage];
+		simdTotal	+= simd[stage];
+	}
+	printf("%-28s %8.1f ms %8.1f ms %7.2fx\n\n", "total", scalarTotal / REPEATS * 1e3, simdTotal / REPEATS * 1e3, scalarTotal / simdTotal);
+	printf("output %s\n", identical ? "identical" : "DIFFERS");
+
+	free(scalarMesh.vertices);
+	free(scalarMesh.indices);
+	free(simdMesh.vertices);
+	free(simdMesh.indices);
+
+	return identical ? 0 : 1;
+}
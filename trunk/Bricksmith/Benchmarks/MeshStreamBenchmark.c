@@ -0,0 +1,290 @@
+//==============================================================================
+//
+// File:		MeshStreamBenchmark.c
+//
+// Purpose:		Compares the two ways a display list builder can hand its
+//				primitives to MeshSmooth, and checks that both give exactly the
+//				same mesh:
+//
+//				  linked	as the builders used to: each primitive is copied
+//							into a pool-allocated link of 10-float vertices and
+//							queued per kind; at the end the lists are walked
+//							once to count and again to call add_face.
+//				  streamed	each primitive goes straight to add_face on a
+//							growable mesh, in the order it arrives.
+//
+//				The primitives arrive as a collector sees them: each quad
+//				followed by its edge lines, so lines and polygons interleave.
+//				(Build it without METAL, which would take the quads for
+//				conditional lines.)
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer MeshStreamBenchmark.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [grid size]
+//				Defaults to a 256 x 256 grid of quads.
+//
+//==============================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkSupport.h"
+#include "MeshSmooth.h"
+
+#define REPEATS			5
+#define VERT_STRIDE		10
+#define POOL_PAGE		(256 * 1024)
+
+// The builders' vertex link: a count followed by VERT_STRIDE floats per vertex.
+typedef struct Link
+{
+	struct Link	*next;
+	int			vcount;
+	float		data[0];
+
+} Link;
+
+// A bump allocator standing in for LDrawBDP.
+typedef struct Page
+{
+	struct Page	*next;
+	size_t		used;
+	char		bytes[POOL_PAGE];
+
+} Page;
+
+typedef struct
+{
+	Page	*pages;
+	Link	*quadHead, *quadTail;
+	Link	*lineHead, *lineTail;
+
+} LinkedBuilder;
+
+typedef struct
+{
+	int				vertexCount;
+	int				indexCount;
+	float			*vertices;
+	unsigned int	*indices;
+
+} MeshOutput;
+
+static const float	color[4]	= { 0.2f, 0.4f, 0.8f, 1.0f };
+
+
+//========== poolAllocate ======================================================
+//
+// Purpose:		Carves size bytes off the current page.
+//
+//==============================================================================
+static void *poolAllocate(LinkedBuilder *builder, size_t size)
+{
+	void *result = NULL;
+
+	size = (size + 15) & ~(size_t)15;
+	if(builder->pages == NULL || builder->pages->used + size > POOL_PAGE)
+	{
+		Page *page = malloc(sizeof(Page));
+		page->next		= builder->pages;
+		page->used		= 0;
+		builder->pages	= page;
+	}
+	result = builder->pages->bytes + builder->pages->used;
+	builder->pages->used += size;
+
+	return result;
+}
+
+
+//========== queueLink =========================================================
+//
+// Purpose:		Copies a primitive into a new link, the way LDrawDLBuilderAddQuad
+//				and LDrawDLBuilderAddLine do.
+//
+//==============================================================================
+static void queueLink(LinkedBuilder *builder, Link **head, Link **tail, const float *points, int count)
+{
+	static const float	normal[3]	= { 0, 1, 0 };
+	Link				*link		= poolAllocate(builder, sizeof(Link) + sizeof(float) * VERT_STRIDE * count);
+	int					i;
+
+	link->next		= NULL;
+	link->vcount	= count;
+	for(i = 0; i < count; i++)
+	{
+		memcpy(link->data + VERT_STRIDE * i,		points + 3 * i,	sizeof(float) * 3);
+		memcpy(link->data + VERT_STRIDE * i + 3,	normal,			sizeof(float) * 3);
+		memcpy(link->data + VERT_STRIDE * i + 6,	color,			sizeof(float) * 4);
+	}
+
+	if(*tail)
+		(*tail)->next = link;
+	else
+		*head = link;
+	*tail = link;
+}
+
+
+//========== emitGrid ==========================================================
+//
+// Purpose:		Delivers a bumpy grid of quads, each followed by the lines on
+//				its left and front edges, to whichever builder is given.
+//
+//==============================================================================
+static void emitGrid(int size, LinkedBuilder *linked, struct Mesh *streamed)
+{
+	int x, z;
+
+	for(x = 0; x < size; x++)
+	for(z = 0; z < size; z++)
+	{
+		float quad[12] =
+		{
+			x,		sinf(x * 0.2f) * cosf(z * 0.2f),				z,
+			x,		sinf(x * 0.2f) * cosf((z + 1) * 0.2f),			z + 1,
+			x + 1,	sinf((x + 1) * 0.2f) * cosf((z + 1) * 0.2f),	z + 1,
+			x + 1,	sinf((x + 1) * 0.2f) * cosf(z * 0.2f),			z,
+		};
+		float left[6]	= { quad[0], quad[1], quad[2], quad[3], quad[4], quad[5] };
+		float front[6]	= { quad[0], quad[1], quad[2], quad[9], quad[10], quad[11] };
+
+		if(linked)
+		{
+			queueLink(linked, &linked->quadHead, &linked->quadTail, quad, 4);
+			if(x == 0)	queueLink(linked, &linked->lineHead, &linked->lineTail, left, 2);
+			if(z == 0)	queueLink(linked, &linked->lineHead, &linked->lineTail, front, 2);
+		}
+		else
+		{
+			add_face(streamed, quad, quad + 3, quad + 6, quad + 9, color, 0);
+			if(x == 0)	add_face(streamed, left, left + 3, NULL, NULL, color, 0);
+			if(z == 0)	add_face(streamed, front, front + 3, NULL, NULL, color, 0);
+		}
+	}
+}
+
+
+//========== finishMesh ========================================================
+//
+// Purpose:		Runs the rest of the pipeline and writes the mesh out.
+//
+//==============================================================================
+static MeshOutput finishMesh(struct Mesh *mesh)
+{
+	MeshOutput	output;
+	int			starts[4];
+	int			counts[4];
+
+	add_creases(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+
+	get_final_mesh_counts(mesh, &output.vertexCount, &output.indexCount);
+	output.vertices	= malloc(sizeof(float) * 10 * output.vertexCount);
+	output.indices	= malloc(sizeof(unsigned int) * output.indexCount);
+	write_indexed_mesh(mesh, output.vertexCount, output.vertices, output.indexCount, output.indices, 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+	destroy_mesh(mesh);
+
+	return output;
+}
+
+
+//========== buildLinked =======================================================
+//
+// Purpose:		Collects into linked lists, then counts and adds. Adds the time
+//				up to and including finish_faces_and_sort to inputTime.
+//
+//==============================================================================
+static MeshOutput buildLinked(int size, double *inputTime)
+{
+	LinkedBuilder	builder;
+	struct Mesh		*mesh		= NULL;
+	Link			*link		= NULL;
+	int				quadCount	= 0;
+	int				lineCount	= 0;
+	double			start		= BenchmarkNow();
+
+	memset(&builder, 0, sizeof(builder));
+	emitGrid(size, &builder, NULL);
+
+	for(link = builder.quadHead; link; link = link->next)	quadCount++;
+	for(link = builder.lineHead; link; link = link->next)	lineCount++;
+
+	mesh = create_mesh(0, quadCount, lineCount, 0);
+	for(link = builder.quadHead; link; link = link->next)
+		add_face(mesh, link->data, link->data + 10, link->data + 20, link->data + 30, link->data + 6, 0);
+	for(link = builder.lineHead; link; link = link->next)
+		add_face(mesh, link->data, link->data + 10, NULL, NULL, link->data + 6, 0);
+
+	while(builder.pages)
+	{
+		Page *next = builder.pages->next;
+		free(builder.pages);
+		builder.pages = next;
+	}
+
+	finish_faces_and_sort(mesh);
+	*inputTime += BenchmarkNow() - start;
+
+	return finishMesh(mesh);
+}
+
+
+//========== buildStreamed =====================================================
+//
+// Purpose:		Feeds a growable mesh directly. Adds the time up to and
+//				including finish_faces_and_sort to inputTime.
+//
+//==============================================================================
+static MeshOutput buildStreamed(int size, double *inputTime)
+{
+	double		start	= BenchmarkNow();
+	struct Mesh	*mesh	= create_growable_mesh();
+
+	emitGrid(size, NULL, mesh);
+	finish_faces_and_sort(mesh);
+	*inputTime += BenchmarkNow() - start;
+
+	return finishMesh(mesh);
+}
+
+
+int main(int argc, const char *argv[])
+{
+	int			size			= (argc > 1) ? atoi(argv[1]) : 256;
+	double		linkedTime		= 0;
+	double		streamedTime	= 0;
+	int			identical		= 1;
+	int			repeat			= 0;
+
+	set_smoothing_thread_count(1);
+
+	for(repeat = 0; repeat < REPEATS; repeat++)
+	{
+		MeshOutput	linked		= buildLinked(size, &linkedTime);
+		MeshOutput	streamed	= buildStreamed(size, &streamedTime);
+
+		identical = identical
+				&&	linked.vertexCount == streamed.vertexCount
+				&&	linked.indexCount == streamed.indexCount
+				&&	memcmp(linked.vertices, streamed.vertices, sizeof(float) * 10 * linked.vertexCount) == 0
+				&&	memcmp(linked.indices, streamed.indices, sizeof(unsigned int) * linked.indexCount) == 0;
+
+		free(linked.vertices);
+		free(linked.indices);
+		free(streamed.vertices);
+		free(streamed.indices);
+	}
+
+	printf("%d x %d quads, input through finish_faces_and_sort:\n", size, size);
+	printf("  linked    %8.2f ms\n", linkedTime / REPEATS * 1e3);
+	printf("  streamed  %8.2f ms  (%.2fx)\n", streamedTime / REPEATS * 1e3, linkedTime / streamedTime);
+	printf("output %s\n", identical ? "identical" : "DIFFERS");
+
+	return identical ? 0 : 1;
+}
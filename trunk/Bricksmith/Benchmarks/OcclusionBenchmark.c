@@ -0,0 +1,417 @@
+//==============================================================================
+//
+// File:		OcclusionBenchmark.c
+//
+// Purpose:		Times culling the hidden parts of a dense model - a four storey
+//				brick building, furnished inside, in a yard - from a few views,
+//				after the BVH has culled to the frustum, and checks that:
+//
+//				- no part the occlusion drops can be seen. What can be seen is
+//				  found by drawing every box the frustum lets through into a
+//				  buffer four times finer each way, and noting which box is
+//				  nearest at each texel. The model is boxes all through, so
+//				  this holds exactly; in a real model parts can be seen
+//				  through gaps in other parts' boxes (see LDrawOcclusion.h);
+//				- it drops some parts where the walls hide the inside.
+//
+//				The statistics are the ones LDrawOcclusion keeps, as a renderer
+//				handed the occlusion would see them.
+//
+// Build:		cc -O2 -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					OcclusionBenchmark.c
+//					../Source/LDraw/Renderer/LDrawOcclusion.c
+//					../Source/LDraw/Renderer/LDrawBVH.c
+//					../Source/LDraw/Support/MatrixMathEx.c -lm
+//
+// Usage:		./a.out [interior parts per storey]
+//
+//==============================================================================
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "LDrawBVH.h"
+#include "LDrawOcclusion.h"
+#include "MatrixMathEx.h"
+
+#define DEFAULT_FURNISHING	2500
+#define RUNS				5
+
+#define STOREYS				4
+#define LAYERS				6				// brick courses per storey
+#define HALF_WIDTH			480				// LDU; the building is 48 studs square
+#define WALL				40				// LDU; walls are 2 studs thick
+#define YARD_PARTS			1000
+
+#define REFERENCE_SCALE		4				// reference buffer texels per occlusion texel, each way
+
+typedef struct
+{
+	float	*boxes;
+	int		count;
+	int		capacity;
+
+} Scene;
+
+static const float pixelScale[2] = { 512.0f, 384.0f };
+
+
+//========== addPart ===========================================================
+//
+// Purpose:		Adds a part's box, from min x y z to max x y z.
+//
+//==============================================================================
+static void addPart(Scene *scene, float x0, float y0, float z0, float x1, float y1, float z1)
+{
+	float *box;
+
+	if(scene->count == scene->capacity)
+	{
+		scene->capacity	= scene->capacity ? 2 * scene->capacity : 1024;
+		scene->boxes	= (float *)realloc(scene->boxes, sizeof(float) * 6 * scene->capacity);
+	}
+	box = scene->boxes + 6 * scene->count++;
+
+	box[0] = x0;	box[1] = y0;	box[2] = z0;
+	box[3] = x1;	box[4] = y1;	box[5] = z1;
+
+}//end addPart
+
+
+//========== addCourse =========================================================
+//
+// Purpose:		Lays one course of 2x4 bricks along a wall, from along0 to
+//				along1 on x (or on z, if alongZ), with 2x2s to finish the ends
+//				of staggered courses.
+//
+//==============================================================================
+static void addCourse(Scene *scene, bool alongZ, float along0, float along1, float across, float top, bool stagger)
+{
+	float start = along0;
+
+	while(start < along1)
+	{
+		float length	= (stagger && start == along0) ? 40 : 80;
+		float end		= start + length < along1 ? start + length : along1;
+
+		if(alongZ)
+			addPart(scene, across, top, start, across + WALL, top + 24, end);
+		else
+			addPart(scene, start, top, across, end, top + 24, across + WALL);
+		start = end;
+	}
+
+}//end addCourse
+
+
+//========== makeBuilding ======================================================
+//
+// Purpose:		A baseplate with a brick building on it, its storeys floored
+//				with 4x4 plates and furnished with stacks of small bricks, and
+//				small parts scattered about the yard in front of it.
+//
+// Notes:		LDraw's up is -y.
+//
+//==============================================================================
+static Scene makeBuilding(int furnishing)
+{
+	Scene		scene	= { NULL, 0, 0 };
+	float		inside	= HALF_WIDTH - WALL;
+	uint32_t	seed	= 1955;
+	int			storey, layer, counter;
+	float		x, z;
+
+	addPart(&scene, -2 * HALF_WIDTH, 0, -2 * HALF_WIDTH, 2 * HALF_WIDTH, 4, 2 * HALF_WIDTH);
+
+	for(layer = 0; layer < STOREYS * LAYERS; layer++)
+	{
+		float	top		= -24 * (layer + 1);
+		bool	stagger	= layer % 2;
+
+		addCourse(&scene, false, -HALF_WIDTH, HALF_WIDTH, -HALF_WIDTH, top, stagger);
+		addCourse(&scene, false, -HALF_WIDTH, HALF_WIDTH, inside, top, !stagger);
+		addCourse(&scene, true, -inside, inside, -HALF_WIDTH, top, !stagger);
+		addCourse(&scene, true, -inside, inside, inside, top, stagger);
+	}
+
+	for(storey = 0; storey < STOREYS; storey++)
+	{
+		float floor		= -24 * LAYERS * storey;
+		float ceiling	= -24 * LAYERS * (storey + 1);
+
+		// The floor above, or the roof.
+		for(x = -inside; x < inside; x += 80)
+			for(z = -inside; z < inside; z += 80)
+				addPart(&scene, x, ceiling, z, x + 80, ceiling + 8, z + 80);
+
+		for(counter = 0; counter < furnishing; counter++)
+		{
+			float	width	= 20 * (1 + (int)BenchmarkRandomFloat(&seed, 0, 2));
+			float	left	= -inside + 20 * (int)BenchmarkRandomFloat(&seed, 0, (2 * inside - width) / 20);
+			float	back	= -inside + 20 * (int)BenchmarkRandomFloat(&seed, 0, 2 * inside / 20 - 1);
+			float	bottom	= floor - 24 * (int)BenchmarkRandomFloat(&seed, 0, 4);
+
+			addPart(&scene, left, bottom - 24, back, left + width, bottom, back + 20);
+		}
+	}
+
+	for(counter = 0; counter < YARD_PARTS; counter++)
+	{
+		float left	= 20 * (int)BenchmarkRandomFloat(&seed, -2 * HALF_WIDTH / 20, 2 * HALF_WIDTH / 20 - 1);
+		float back	= 20 * (int)BenchmarkRandomFloat(&seed, -2 * HALF_WIDTH / 20, -HALF_WIDTH / 20 - 3);
+
+		addPart(&scene, left, -24, back, left + 20, 0, back + 20);
+	}
+
+	return scene;
+
+}//end makeBuilding
+
+
+//========== drawReference =====================================================
+//
+// Purpose:		Draws a box's faces into the reference buffer, each texel
+//				keeping the index of the nearest box at its center. Boxes not
+//				wholly in front of the eye are left out, which can only let
+//				more boxes be seen.
+//
+//==============================================================================
+static void drawReference(const float box[6], int index, const float m[16],
+						  int width, int height, float *depths, int *owners)
+{
+	static const int faces[6][4] = {
+		{ 0, 2, 6, 4 }, { 1, 3, 7, 5 },
+		{ 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+		{ 0, 1, 3, 2 }, { 4, 5, 7, 6 }
+	};
+	double	corners[8][3];
+	int		corner, face, edge;
+
+	for(corner = 0; corner < 8; corner++)
+	{
+		double x = box[(corner & 1) ? 3 : 0];
+		double y = box[(corner & 2) ? 4 : 1];
+		double z = box[(corner & 4) ? 5 : 2];
+		double w = m[3] * x + m[7] * y + m[11] * z + m[15];
+
+		if(!(w > 0))
+			return;
+
+		corners[corner][0] = ((m[0] * x + m[4] * y + m[8]  * z + m[12]) / w + 1) * 0.5 * width;
+		corners[corner][1] = ((m[1] * x + m[5] * y + m[9]  * z + m[13]) / w + 1) * 0.5 * height;
+		corners[corner][2] =  (m[2] * x + m[6] * y + m[10] * z + m[14]) / w;
+	}
+
+	for(face = 0; face < 6; face++)
+	{
+		double	*p[4];
+		double	low[2]	= { DBL_MAX, DBL_MAX };
+		double	high[2]	= { -DBL_MAX, -DBL_MAX };
+		double	area	= 0;
+		double	det, a, b, c;
+		int		row, column;
+
+		for(corner = 0; corner < 4; corner++)
+		{
+			p[corner] = corners[faces[face][corner]];
+			if(p[corner][0] < low[0])	low[0] = p[corner][0];
+			if(p[corner][1] < low[1])	low[1] = p[corner][1];
+			if(p[corner][0] > high[0])	high[0] = p[corner][0];
+			if(p[corner][1] > high[1])	high[1] = p[corner][1];
+		}
+		for(edge = 0; edge < 4; edge++)
+			area += p[edge][0] * p[(edge + 1) % 4][1] - p[(edge + 1) % 4][0] * p[edge][1];
+
+		det = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) - (p[2][0] - p[0][0]) * (p[1][1] - p[0][1]);
+		if(fabs(det) < 1e-9)
+			continue;
+		a = ((p[1][2] - p[0][2]) * (p[2][1] - p[0][1]) - (p[2][2] - p[0][2]) * (p[1][1] - p[0][1])) / det;
+		b = ((p[1][0] - p[0][0]) * (p[2][2] - p[0][2]) - (p[2][0] - p[0][0]) * (p[1][2] - p[0][2])) / det;
+		c = p[0][2] - a * p[0][0] - b * p[0][1];
+
+		for(row = low[1] < 0 ? 0 : (int)low[1]; row < height && row <= high[1]; row++)
+		{
+			for(column = low[0] < 0 ? 0 : (int)low[0]; column < width && column <= high[0]; column++)
+			{
+				double	cx		= column + 0.5;
+				double	cy		= row + 0.5;
+				bool	inside	= true;
+				double	depth;
+
+				for(edge = 0; edge < 4 && inside; edge++)
+				{
+					double *p0 = p[edge];
+					double *p1 = p[(edge + 1) % 4];
+
+					inside = ((p1[0] - p0[0]) * (cy - p0[1]) - (p1[1] - p0[1]) * (cx - p0[0])) * area >= 0;
+				}
+				depth = a * cx + b * cy + c;
+				if(inside && depth < depths[row * width + column])
+				{
+					depths[row * width + column] = depth;
+					owners[row * width + column] = index;
+				}
+			}
+		}
+	}
+
+}//end drawReference
+
+
+//========== findSeen ==========================================================
+//
+// Purpose:		Marks the boxes among items that are nearest somewhere in the
+//				reference buffer.
+//
+//==============================================================================
+static void findSeen(const float *boxes, const int *items, int count, const float mvp[16], bool *seen)
+{
+	int		width	= LDRAW_OCCLUSION_WIDTH * REFERENCE_SCALE;
+	int		height	= LDRAW_OCCLUSION_HEIGHT * REFERENCE_SCALE;
+	float	*depths	= (float *)malloc(sizeof(float) * width * height);
+	int		*owners	= (int *)malloc(sizeof(int) * width * height);
+	int		counter	= 0;
+
+	for(counter = 0; counter < width * height; counter++)
+	{
+		depths[counter] = FLT_MAX;
+		owners[counter] = -1;
+	}
+	for(counter = 0; counter < count; counter++)
+		drawReference(boxes + 6 * items[counter], items[counter], mvp, width, height, depths, owners);
+
+	for(counter = 0; counter < width * height; counter++)
+	{
+		if(owners[counter] >= 0)
+			seen[owners[counter]] = true;
+	}
+
+	free(owners);
+	free(depths);
+
+}//end findSeen
+
+
+//========== runView ===========================================================
+//
+// Purpose:		Times the BVH and then the occlusion on one view, prints what
+//				each did, and checks the occlusion dropped nothing that can be
+//				seen. Returns false if it did.
+//
+//==============================================================================
+static bool runView(const LDrawBVH *bvh, const float *boxes, int count, const View *view,
+					int *culledOut)
+{
+	LDrawOcclusion		*occlusion	= LDrawOcclusionCreate(LDRAW_OCCLUSION_WIDTH, LDRAW_OCCLUSION_HEIGHT);
+	LDrawOcclusionStats	stats;
+	int					*frustum	= (int *)malloc(sizeof(int) * count);
+	int					*kept		= (int *)malloc(sizeof(int) * count);
+	bool				*seen		= (bool *)calloc(count, sizeof(bool));
+	bool				*left		= (bool *)calloc(count, sizeof(bool));
+	double				bvhBest		= 1e9;
+	double				occludeBest	= 1e9;
+	int					passed		= 0;
+	int					remaining	= 0;
+	int					hidden		= 0;
+	int					wrong		= 0;
+	int					run			= 0;
+	int					counter		= 0;
+
+	for(run = 0; run < RUNS; run++)
+	{
+		double start = BenchmarkNow();
+		double middle;
+
+		passed		= LDrawBVHCull(bvh, view->mvp, pixelScale, frustum);
+		middle		= BenchmarkNow();
+		memcpy(kept, frustum, sizeof(int) * passed);
+		remaining	= LDrawOcclusionCull(occlusion, view->mvp, boxes, kept, passed);
+
+		bvhBest		= fmin(bvhBest, middle - start);
+		occludeBest	= fmin(occludeBest, BenchmarkNow() - middle);
+	}
+	stats = LDrawOcclusionGetStats(occlusion);
+
+	findSeen(boxes, frustum, passed, view->mvp, seen);
+	for(counter = 0; counter < remaining; counter++)
+		left[kept[counter]] = true;
+	for(counter = 0; counter < passed; counter++)
+	{
+		int item = frustum[counter];
+
+		hidden	+= !seen[item];
+		wrong	+= seen[item] && !left[item];
+	}
+
+	printf("  %-8s %5d through the BVH, %5d hidden; %4d occluders, %5d culled (%3.0f%% of hidden): "
+		   "BVH %6.3f ms, occlusion %6.3f ms\n",
+		   view->name, passed, hidden, stats.occluders / stats.passes, stats.culled / stats.passes,
+		   hidden ? 100.0 * (passed - remaining) / hidden : 0.0, bvhBest * 1000, occludeBest * 1000);
+	if(wrong)
+		printf("FAILED: %s view: %d parts that can be seen were culled\n", view->name, wrong);
+
+	*culledOut = passed - remaining;
+
+	free(left);
+	free(seen);
+	free(kept);
+	free(frustum);
+	LDrawOcclusionDestroy(occlusion);
+
+	return wrong == 0;
+
+}//end runView
+
+
+//========== main ==============================================================
+//
+// Purpose:		Runs the views.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	int				furnishing	= (argc > 1) ? atoi(argv[1]) : DEFAULT_FURNISHING;
+	Scene			scene		= makeBuilding(furnishing);
+	LDrawBVH		*bvh		= LDrawBVHCreate(scene.boxes, scene.count);
+	LDrawOcclusion	*occlusion	= NULL;
+	View			views[4];
+	bool			passed		= true;
+	int				culled[4];
+	int				items[2]	= { 0, 1 };
+	int				counter		= 0;
+
+	makeView(views + 0, "front", 0, -200, -2400, 0, 5);
+	makeView(views + 1, "aerial", 0, -2400, -1800, 0, 45);
+	makeView(views + 2, "corner", -1400, -500, -1400, -45, 12);
+	makeView(views + 3, "inside", 0, -110, -420, 0, 8);
+
+	printf("%d parts, %dx%d occlusion buffer; best of %d:\n", scene.count,
+		   LDRAW_OCCLUSION_WIDTH, LDRAW_OCCLUSION_HEIGHT, RUNS);
+	for(counter = 0; counter < 4; counter++)
+		passed = runView(bvh, scene.boxes, scene.count, views + counter, culled + counter) && passed;
+
+	// From outside, the walls hide the inside.
+	if(culled[0] == 0 || culled[1] == 0 || culled[2] == 0)
+	{
+		printf("FAILED: nothing culled from outside\n");
+		passed = false;
+	}
+
+	// Too few to bother, and nothing to draw.
+	occlusion = LDrawOcclusionCreate(LDRAW_OCCLUSION_WIDTH, LDRAW_OCCLUSION_HEIGHT);
+	passed = LDrawOcclusionCull(occlusion, views[0].mvp, scene.boxes, items, 1) == 1 && passed;
+	passed = LDrawOcclusionCull(occlusion, views[0].mvp, scene.boxes, items, 0) == 0 && passed;
+	LDrawOcclusionDestroy(occlusion);
+
+	LDrawBVHDestroy(bvh);
+	free(scene.boxes);
+
+	printf("%s\n", passed ? "PASSED" : "FAILED");
+	return passed ? 0 : 1;
+
+}//end main
@@ -0,0 +1,457 @@
+//==============================================================================
+//
+// File:		PartCacheBenchmark.c
+//
+// Purpose:		Measures what the compiled part cache saves at launch.
+//
+//				A synthetic library is written to the temporary directory: a
+//				set of primitives, and parts made of their own geometry plus
+//				references to those primitives. Then:
+//
+//				1. Cold start: every part is read the way the part library
+//				   reads it without a cache (map, tokenize, load each
+//				   referenced primitive once, flatten it into the part with its
+//				   transform) and its cache entry is written.
+//				2. Some parts, and one primitive, are edited, as a library
+//				   update would.
+//				3. Warm start: every part is looked up in the cache; stale or
+//				   missing entries are rebuilt as in step 1.
+//
+//				Parse and flatten costs here are the C core only; in the
+//				application the cold path also builds and sorts Objective-C
+//				directives, so real savings are larger.
+//
+// Build:		cc -O2 -I../Source/LDraw/Support PartCacheBenchmark.c
+//					../Source/LDraw/Support/LDrawPartCacheFile.c
+//					../Source/LDraw/Support/LDrawAtomicWrite.c
+//					../Source/LDraw/Support/LDrawMappedFile.c
+//					../Source/LDraw/Support/LDrawLineTokenizer.c
+//					../Source/LDraw/Support/LDrawFloatConversion.c -lm -lpthread
+//
+// Usage:		./a.out [part count]
+//
+//==============================================================================
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BenchmarkSupport.h"
+#include "LDrawLineTokenizer.h"
+#include "LDrawMappedFile.h"
+#include "LDrawPartCacheFile.h"
+
+#define PRIMITIVE_COUNT			64
+#define PRIMITIVE_LINES			120
+#define PART_LINES				150
+#define PART_REFERENCES			8
+#define EDITED_PART_INTERVAL	20		// every 20th part is edited (5%)
+
+// A part's geometry as it is being flattened.
+typedef struct
+{
+	LDrawCachedPrimitive	*primitives;
+	size_t					count;
+	size_t					capacity;
+	float					boundsMinimum[3];
+	float					boundsMaximum[3];
+	char					dependencies[PART_REFERENCES + 1][PATH_MAX];
+	size_t					dependencyCount;
+
+} FlatPart;
+
+static char			LibraryPath[PATH_MAX];
+static FlatPart		*LoadedPrimitives[PRIMITIVE_COUNT];
+
+
+//========== formatPath ========================================================
+//
+// Purpose:		snprintf into a PATH_MAX buffer. A path which doesn't fit would
+//				quietly name some other file, so the benchmark stops instead.
+//
+//==============================================================================
+static void formatPath(char path[PATH_MAX], const char *format, ...)
+{
+	va_list	arguments;
+	int		length		= 0;
+
+	va_start(arguments, format);
+	length = vsnprintf(path, PATH_MAX, format, arguments);
+	va_end(arguments);
+
+	if(length < 0 || length >= PATH_MAX)
+	{
+		fprintf(stderr, "path too long: %s...\n", path);
+		exit(1);
+	}
+}
+
+
+//========== appendPrimitive ===================================================
+//
+// Purpose:		Adds a primitive to the part, growing its bounds.
+//
+//==============================================================================
+static void appendPrimitive(FlatPart *part, const LDrawCachedPrimitive *primitive, int vertexCount)
+{
+	int counter = 0;
+	int axis	= 0;
+
+	if(part->count == part->capacity)
+	{
+		part->capacity		= (part->capacity > 0) ? part->capacity * 2 : 256;
+		part->primitives	= realloc(part->primitives, part->capacity * sizeof(LDrawCachedPrimitive));
+	}
+	part->primitives[part->count++] = *primitive;
+
+	for(counter = 0; counter < vertexCount; counter++)
+	{
+		for(axis = 0; axis < 3; axis++)
+		{
+			if(primitive->vertices[counter][axis] < part->boundsMinimum[axis])
+				part->boundsMinimum[axis] = primitive->vertices[counter][axis];
+			if(primitive->vertices[counter][axis] > part->boundsMaximum[axis])
+				part->boundsMaximum[axis] = primitive->vertices[counter][axis];
+		}
+	}
+}
+
+
+//========== parseFile =========================================================
+//
+// Purpose:		Reads one library file into a flat part: its own geometry, then
+//				each referenced primitive transformed into place.
+//
+//==============================================================================
+static FlatPart *parseFile(const char *path)
+{
+	LDrawMappedFile		*file		= LDrawMappedFileOpen(path);
+	FlatPart			*part		= calloc(1, sizeof(FlatPart));
+	LDrawGeometryLine	fields;
+	size_t				line		= 0;
+	int					counter		= 0;
+
+	for(counter = 0; counter < 3; counter++)
+	{
+		part->boundsMinimum[counter] = 1e30f;
+		part->boundsMaximum[counter] = -1e30f;
+	}
+	formatPath(part->dependencies[part->dependencyCount++], "%s", path);
+
+	for(line = 0; file != NULL && line < file->lineCount; line++)
+	{
+		const char				*bytes		= file->bytes + file->lines[line].offset;
+		LDrawCachedPrimitive	primitive;
+
+		if(LDrawTokenizeGeometryLine(bytes, file->lines[line].length, &fields) == false)
+			continue;
+
+		memset(&primitive, 0, sizeof(primitive));
+		primitive.colorIndex = 0;	// a one-entry color table; colors aren't the point here
+
+		if(fields.lineType == 1)
+		{
+			// name is "pNN.dat"
+			int			index		= atoi(fields.name + 1) % PRIMITIVE_COUNT;
+			FlatPart	*referenced	= LoadedPrimitives[index];
+			size_t		source		= 0;
+			float		*m			= fields.values;
+
+			if(referenced == NULL)
+			{
+				char primitivePath[PATH_MAX];
+				formatPath(primitivePath, "%s/p%d.dat", LibraryPath, index);
+				referenced = parseFile(primitivePath);
+				LoadedPrimitives[index] = referenced;
+			}
+			formatPath(part->dependencies[part->dependencyCount++], "%s", referenced->dependencies[0]);
+
+			for(source = 0; source < referenced->count; source++)
+			{
+				LDrawCachedPrimitive	transformed	= referenced->primitives[source];
+				int						vertex		= 0;
+
+				for(vertex = 0; vertex < 4; vertex++)
+				{
+					float *v = referenced->primitives[source].vertices[vertex];
+
+					transformed.vertices[vertex][0] = m[3] * v[0] + m[4]  * v[1] + m[5]  * v[2] + m[0];
+					transformed.vertices[vertex][1] = m[6] * v[0] + m[7]  * v[1] + m[8]  * v[2] + m[1];
+					transformed.vertices[vertex][2] = m[9] * v[0] + m[10] * v[1] + m[11] * v[2] + m[2];
+				}
+				appendPrimitive(part, &transformed, 4);
+			}
+		}
+		else
+		{
+			int vertexCount = (fields.lineType == 2) ? 2 : (fields.lineType == 3) ? 3 : 4;
+
+			for(counter = 0; counter < vertexCount * 3; counter++)
+				primitive.vertices[counter / 3][counter % 3] = fields.values[counter];
+			appendPrimitive(part, &primitive, vertexCount);
+		}
+	}
+
+	LDrawMappedFileClose(file);
+
+	return part;
+}
+
+
+//========== freePart ==========================================================
+//
+// Purpose:		Releases a flat part.
+//
+//==============================================================================
+static void freePart(FlatPart *part)
+{
+	if(part != NULL)
+	{
+		free(part->primitives);
+		free(part);
+	}
+}
+
+
+//========== storePart =========================================================
+//
+// Purpose:		Writes a flat part's cache entry.
+//
+//==============================================================================
+static void storePart(const FlatPart *part, const char *entryPath)
+{
+	LDrawPartCacheHeader	header;
+	LDrawCachedDependency	dependencies[PART_REFERENCES + 1];
+	LDrawCachedColor		color;
+	char					strings[(PART_REFERENCES + 1) * PATH_MAX];
+	size_t					stringsLength	= 0;
+	size_t					counter			= 0;
+
+	memset(&header, 0, sizeof(header));
+	memset(&color, 0, sizeof(color));
+
+	for(counter = 0; counter < part->dependencyCount; counter++)
+	{
+		size_t length = strlen(part->dependencies[counter]);
+
+		LDrawFileStampForPath(part->dependencies[counter], &dependencies[counter].stamp);
+		dependencies[counter].path.offset	= (uint32_t)stringsLength;
+		dependencies[counter].path.length	= (uint32_t)length;
+		memcpy(strings + stringsLength, part->dependencies[counter], length);
+		stringsLength += length;
+	}
+
+	color.colorCode				= 16;
+	color.isLibraryColor		= 1;
+	header.dependencyCount		= (uint32_t)part->dependencyCount;
+	header.colorCount			= 1;
+	header.quadrilateralCount	= (uint32_t)part->count;
+	header.stringsLength		= (uint32_t)stringsLength;
+	memcpy(header.boundsMinimum, part->boundsMinimum, sizeof(header.boundsMinimum));
+	memcpy(header.boundsMaximum, part->boundsMaximum, sizeof(header.boundsMaximum));
+
+	LDrawPartCacheEntryWrite(entryPath, &header, dependencies, &color, part->primitives, strings);
+}
+
+
+//========== loadFromCache =====================================================
+//
+// Purpose:		Returns a copy of the part's primitives from its cache entry,
+//				or NULL on a miss.
+//
+//==============================================================================
+static FlatPart *loadFromCache(const char *partPath, const char *entryPath)
+{
+	LDrawPartCacheEntry	*entry	= LDrawPartCacheEntryOpen(entryPath);
+	FlatPart			*part	= NULL;
+	size_t				length	= 0;
+	const char			*path	= NULL;
+
+	if(entry == NULL)
+		return NULL;
+
+	path = LDrawPartCacheEntryString(entry, entry->dependencies[0].path, &length);
+	if(		length == strlen(partPath)
+	   &&	memcmp(path, partPath, length) == 0
+	   &&	LDrawPartCacheEntryIsCurrent(entry) )
+	{
+		part				= calloc(1, sizeof(FlatPart));
+		part->count			= entry->header->quadrilateralCount;
+		part->capacity		= part->count;
+		part->primitives	= malloc(part->count * sizeof(LDrawCachedPrimitive));
+		memcpy(part->primitives, entry->primitives, part->count * sizeof(LDrawCachedPrimitive));
+		memcpy(part->boundsMinimum, entry->header->boundsMinimum, sizeof(part->boundsMinimum));
+		memcpy(part->boundsMaximum, entry->header->boundsMaximum, sizeof(part->boundsMaximum));
+	}
+
+	LDrawPartCacheEntryClose(entry);
+
+	return part;
+}
+
+
+//========== writeRandomGeometry ===============================================
+//
+// Purpose:		Appends count random type 2-5 lines to file.
+//
+//==============================================================================
+static void writeRandomGeometry(FILE *file, int count, uint32_t *seed)
+{
+	int line	= 0;
+	int counter	= 0;
+
+	for(line = 0; line < count; line++)
+	{
+		int lineType	= 2 + (int)(BenchmarkRandom(seed) % 4);
+		int valueCount	= LDrawLineValueCountForType(lineType);
+
+		fprintf(file, "%d %d", lineType, (lineType == 2 || lineType == 5) ? 24 : 16);
+		for(counter = 0; counter < valueCount; counter++)
+			fprintf(file, " %g", BenchmarkRandomFloat(seed, -20, 20));
+		fputc('\n', file);
+	}
+}
+
+
+//========== runPass ===========================================================
+//
+// Purpose:		Loads every part, from the cache where possible. Returns the
+//				number of hits.
+//
+//==============================================================================
+static int runPass(int partCount, bool useCache, double *secondsOut, size_t *primitivesOut)
+{
+	char	partPath[PATH_MAX];
+	char	entryPath[PATH_MAX];
+	int		hits		= 0;
+	int		index		= 0;
+	double	start		= BenchmarkNow();
+
+	*primitivesOut = 0;
+	memset(LoadedPrimitives, 0, sizeof(LoadedPrimitives));
+
+	for(index = 0; index < partCount; index++)
+	{
+		FlatPart *part = NULL;
+
+		formatPath(partPath, "%s/part%d.dat", LibraryPath, index);
+		formatPath(entryPath, "%s/cache/%016llx.bspc", LibraryPath,
+				   (unsigned long long)LDrawPartCacheKeyForPath(partPath));
+
+		if(useCache)
+			part = loadFromCache(partPath, entryPath);
+
+		if(part != NULL)
+			hits++;
+		else
+		{
+			part = parseFile(partPath);
+			storePart(part, entryPath);
+		}
+
+		*primitivesOut += part->count;
+		freePart(part);
+	}
+
+	for(index = 0; index < PRIMITIVE_COUNT; index++)
+		freePart(LoadedPrimitives[index]);
+
+	*secondsOut = BenchmarkNow() - start;
+
+	return hits;
+}
+
+
+//========== main ==============================================================
+//
+// Purpose:		Builds the library, runs cold and warm starts, and reports.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	int			partCount		= (argc > 1) ? atoi(argv[1]) : 2000;
+	uint32_t	seed			= 0x50415254;
+	char		path[PATH_MAX];
+	double		coldTime		= 0;
+	double		warmTime		= 0;
+	double		hotTime			= 0;
+	size_t		coldPrimitives	= 0;
+	size_t		warmPrimitives	= 0;
+	size_t		hotPrimitives	= 0;
+	int			warmHits		= 0;
+	int			hotHits			= 0;
+	int			index			= 0;
+	int			counter			= 0;
+	FILE		*file			= NULL;
+
+	formatPath(LibraryPath, "%s/PartCacheBenchmark.%d",
+			   getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", (int)getpid());
+	mkdir(LibraryPath, 0755);
+	formatPath(path, "%s/cache", LibraryPath);
+	mkdir(path, 0755);
+
+	for(index = 0; index < PRIMITIVE_COUNT; index++)
+	{
+		formatPath(path, "%s/p%d.dat", LibraryPath, index);
+		file = fopen(path, "w");
+		fprintf(file, "0 Primitive %d\n", index);
+		writeRandomGeometry(file, PRIMITIVE_LINES, &seed);
+		fclose(file);
+	}
+	for(index = 0; index < partCount; index++)
+	{
+		formatPath(path, "%s/part%d.dat", LibraryPath, index);
+		file = fopen(path, "w");
+		fprintf(file, "0 Part %d\n0 Name: part%d.dat\n", index, index);
+		writeRandomGeometry(file, PART_LINES, &seed);
+		for(counter = 0; counter < PART_REFERENCES; counter++)
+		{
+			fprintf(file, "1 16 %g %g %g 1 0 0 0 1 0 0 0 1 p%d.dat\n",
+					BenchmarkRandomFloat(&seed, -40, 40), BenchmarkRandomFloat(&seed, -40, 40),
+					BenchmarkRandomFloat(&seed, -40, 40), (int)(BenchmarkRandom(&seed) % PRIMITIVE_COUNT));
+		}
+		fclose(file);
+	}
+
+	// 1. Cold
+	runPass(partCount, false, &coldTime, &coldPrimitives);
+
+	// 2. Edit 5% of the parts and one primitive. Appending changes the size,
+	//    so the stamps differ even on file systems with coarse timestamps.
+	for(index = 0; index < partCount; index += EDITED_PART_INTERVAL)
+	{
+		formatPath(path, "%s/part%d.dat", LibraryPath, index);
+		file = fopen(path, "a");
+		fputs("0 // edited\n", file);
+		fclose(file);
+	}
+	formatPath(path, "%s/p0.dat", LibraryPath);
+	file = fopen(path, "a");
+	fputs("0 // edited\n", file);
+	fclose(file);
+
+	// 3. Warm, with the edits; then again with everything current.
+	warmHits	= runPass(partCount, true, &warmTime, &warmPrimitives);
+	hotHits		= runPass(partCount, true, &hotTime, &hotPrimitives);
+
+	printf("parts:                 %d (%d primitive files, %.0f flattened primitives per part)\n",
+		   partCount, PRIMITIVE_COUNT, (double)coldPrimitives / partCount);
+	printf("cold (parse + store):  %8.1f ms  %6.1f us/part\n", coldTime * 1e3, coldTime * 1e6 / partCount);
+	printf("warm after edits:      %8.1f ms  %6.1f us/part  hit rate %5.1f%%\n",
+		   warmTime * 1e3, warmTime * 1e6 / partCount, 100.0 * warmHits / partCount);
+	printf("warm, all current:     %8.1f ms  %6.1f us/part  hit rate %5.1f%%\n",
+		   hotTime * 1e3, hotTime * 1e6 / partCount, 100.0 * hotHits / partCount);
+	printf("speedup (all current): %8.1fx\n", coldTime / hotTime);
+	printf("primitives match:      %s\n",
+		   (warmPrimitives == coldPrimitives && hotPrimitives == coldPrimitives) ? "yes" : "NO");
+
+	formatPath(path, "rm -rf '%s'", LibraryPath);
+	if(system(path) != 0)
+		fprintf(stderr, "could not remove %s\n", LibraryPath);
+
+	return 0;
+}
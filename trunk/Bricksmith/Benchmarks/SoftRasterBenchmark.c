@@ -0,0 +1,386 @@
+//==============================================================================
+//
+// File:		SoftRasterBenchmark.c
+//
+// Purpose:		Renders a synthetic model of 5,000 bricks at 1080p with the
+//				software rasterizer, timing it on one thread and on many, and
+//				checks that:
+//
+//				- the image is exactly the same whatever the thread count;
+//				- triangles sharing an edge never both draw a pixel on it, and
+//				  a rectangle covers exactly the pixels it should;
+//				- the depth test keeps the nearest face whatever the order;
+//				- translucent instances blend back to front.
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					SoftRasterBenchmark.c
+//					../Source/LDraw/Renderer/LDrawSoftRaster.c
+//					../Source/LDraw/Renderer/LDrawDLBuildQueue.c
+//					../Source/LDraw/Renderer/LDrawMeshCache.c
+//					../Source/LDraw/Support/LDrawAtomicWrite.c
+//					../Source/LDraw/Renderer/LDrawDepthSort.c
+//					../Source/LDraw/Renderer/MeshSmooth.c
+//					../Source/LDraw/Support/MatrixMathEx.c -lm -lpthread
+//
+// Usage:		./a.out [threads] [image.png|image.ppm]
+//				Threads defaults to one per core, but at least 4 so the
+//				comparison means something on small machines.
+//
+//==============================================================================
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "LDrawSoftRaster.h"
+#include "MatrixMathEx.h"
+
+#define BRICK_COUNT		5000
+#define IMAGE_WIDTH		1920
+#define IMAGE_HEIGHT	1080
+
+// Meta colors, as the parser hands them over for LDraw's 16 and 24.
+static const float	currentColor[4]		= { 0, 0, 0, 0 };
+static const float	complementColor[4]	= { 1, 0, 0, 0 };
+
+
+//========== addFlatMesh =======================================================
+//
+// Purpose:		Hands flat's polygons to builder in the current color and its
+//				lines in the complement color.
+//
+//==============================================================================
+static void addFlatMesh(LDrawSoftDLBuilder *builder, const FlatMesh *flat)
+{
+	int counter;
+
+	for(counter = 0; counter < flat->polygonCount; counter++)
+	{
+		const Primitive *p = flat->polygons + counter;
+
+		if(p->degree == 4)
+			LDrawSoftDLBuilderAddQuad(builder, (const float *)p->points, currentColor);
+		else
+			LDrawSoftDLBuilderAddTri(builder, (const float *)p->points, currentColor);
+	}
+	for(counter = 0; counter < flat->lineCount; counter++)
+		LDrawSoftDLBuilderAddLine(builder, (const float *)flat->lines[counter].points, complementColor);
+
+}//end addFlatMesh
+
+
+//========== makeBrick =========================================================
+//
+// Purpose:		A width x depth brick in LDraw units: 20 per stud, 24 high, top
+//				at y = 0 and y pointing down.
+//
+//==============================================================================
+static LDrawSoftDL *makeBrick(int width, int depth)
+{
+	LDrawSoftDLBuilder	*builder	= LDrawSoftDLBuilderCreate();
+	FlatMesh			flat;
+	float				low[3]		= { 0, 0, 0 };
+	float				high[3]		= { 20.0f * width, 24, 20.0f * depth };
+	int					x, z;
+
+	memset(&flat, 0, sizeof(flat));
+	addBox(&flat, low, high);
+	for(x = 0; x < width; x++)
+	for(z = 0; z < depth; z++)
+		addStud(&flat, 20.0f * x + 10, 0, 20.0f * z + 10);
+
+	addFlatMesh(builder, &flat);
+	free(flat.polygons);
+	free(flat.lines);
+
+	return LDrawSoftDLBuilderFinish(builder);
+
+}//end makeBrick
+
+
+//========== drawModel =========================================================
+//
+// Purpose:		Draws the brick field - a few layers of randomly colored and
+//				sized bricks, one in eleven translucent - into framebuffer.
+//
+//==============================================================================
+static void drawModel(LDrawSoftFramebuffer *framebuffer, LDrawSoftDL *bricks[3])
+{
+	static const float	clear[4]	= { 1, 1, 1, 1 };
+	static const float	black[4]	= { 0.02f, 0.02f, 0.02f, 1 };
+	const int			across		= 50;
+	float				modelView[16];
+	float				projection[16];
+	float				rotation[16];
+	float				translation[16];
+	float				aspect		= (float)IMAGE_WIDTH / IMAGE_HEIGHT;
+	uint32_t			seed		= 12345;
+	LDrawSoftSession	*session	= NULL;
+	int					counter		= 0;
+
+	LDrawSoftFramebufferClear(framebuffer, clear);
+
+	// Look down on the field from above one corner.
+	buildTranslationMatrix(translation, 0, 0, -2600);
+	buildRotationMatrix(rotation, 35, 1, 0, 0);
+	multMatrices(modelView, translation, rotation);
+	buildRotationMatrix(rotation, 45, 0, 1, 0);
+	multMatrices(translation, modelView, rotation);
+	buildTranslationMatrix(rotation, -across * 20.0f, 0, -across * 20.0f);
+	multMatrices(modelView, translation, rotation);
+	buildFrustumMatrix(projection, -0.5f * aspect, 0.5f * aspect, -0.5f, 0.5f, 1, 10000);
+
+	session = LDrawSoftSessionCreate(framebuffer, modelView, projection);
+	for(counter = 0; counter < BRICK_COUNT; counter++)
+	{
+		int		kind		= (int)(BenchmarkRandom(&seed) % 3);
+		int		layer		= counter / (across * across);
+		int		cell		= counter % (across * across);
+		float	color[4]	= { BenchmarkRandomFloat(&seed, 0.1f, 1),
+								BenchmarkRandomFloat(&seed, 0.1f, 1),
+								BenchmarkRandomFloat(&seed, 0.1f, 1),
+								(counter % 11 == 0) ? 0.5f : 1.0f };
+		float	transform[16];
+
+		buildTranslationMatrix(transform, (cell % across) * 40.0f, -24.0f * layer, (cell / across) * 40.0f);
+		LDrawSoftSessionDraw(session, bricks[kind], color, black, transform, false);
+	}
+	LDrawSoftSessionDrawAndDestroy(session);
+
+}//end drawModel
+
+
+//========== checkDeterminism ==================================================
+//
+// Purpose:		Draws the model on one thread and on threadCount, times both
+//				and returns whether the images are the same. The last image is
+//				left in framebuffer.
+//
+//==============================================================================
+static bool checkDeterminism(LDrawSoftFramebuffer *framebuffer, LDrawSoftDL *bricks[3], int threadCount)
+{
+	LDrawSoftFramebuffer	*single		= LDrawSoftFramebufferCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+	size_t					pixelCount	= (size_t)IMAGE_WIDTH * IMAGE_HEIGHT;
+	double					start		= 0;
+	double					singleTime	= 0;
+	double					multiTime	= 0;
+	bool					same		= false;
+
+	LDrawSoftRasterSetThreadCount(1);
+	start = BenchmarkNow();
+	drawModel(single, bricks);
+	singleTime = BenchmarkNow() - start;
+
+	LDrawSoftRasterSetThreadCount(threadCount);
+	start = BenchmarkNow();
+	drawModel(framebuffer, bricks);
+	multiTime = BenchmarkNow() - start;
+
+	same =		memcmp(single->pixels, framebuffer->pixels, pixelCount * 4) == 0
+			&&	memcmp(single->depths, framebuffer->depths, pixelCount * sizeof(float)) == 0;
+
+	printf("%d bricks at %dx%d: %.1f ms on 1 thread, %.1f ms on %d\n",
+		   BRICK_COUNT, IMAGE_WIDTH, IMAGE_HEIGHT, singleTime * 1000, multiTime * 1000, threadCount);
+	printf("  images %s\n", same ? "identical" : "DIFFER");
+
+	LDrawSoftFramebufferDestroy(single);
+	return same;
+
+}//end checkDeterminism
+
+
+//========== drawFlat ==========================================================
+//
+// Purpose:		Draws one display list with a pixel-for-unit orthographic
+//				camera over a black framebuffer.
+//
+//==============================================================================
+static void drawFlat(LDrawSoftFramebuffer *framebuffer, LDrawSoftDL *dl, const float color[4])
+{
+	static const float	black[4]	= { 0, 0, 0, 1 };
+	float				identity[16];
+	float				projection[16];
+	LDrawSoftSession	*session	= NULL;
+
+	buildIdentity(identity);
+	buildOrthoMatrix(projection, 0, framebuffer->width, framebuffer->height, 0, -100, 100);
+
+	LDrawSoftFramebufferClear(framebuffer, black);
+	session = LDrawSoftSessionCreate(framebuffer, identity, projection);
+	LDrawSoftSessionDraw(session, dl, color, color, identity, false);
+	LDrawSoftSessionDrawAndDestroy(session);
+
+}//end drawFlat
+
+
+//========== checkCoverage =====================================================
+//
+// Purpose:		Draws a translucent rectangle and a translucent disc made of a
+//				fan of triangles. A pixel drawn twice would blend twice, so
+//				every lit pixel must come out the same, and the rectangle must
+//				cover exactly its area.
+//
+//==============================================================================
+static bool checkCoverage(void)
+{
+	const float				half[4]		= { 0.5f, 0.5f, 0.5f, 0.5f };
+	LDrawSoftFramebuffer	*framebuffer	= LDrawSoftFramebufferCreate(128, 96);
+	LDrawSoftDLBuilder		*builder	= LDrawSoftDLBuilderCreate();
+	LDrawSoftDL				*rectangle	= NULL;
+	LDrawSoftDL				*disc		= NULL;
+	float					quad[12]	= { 8, 8, 0,  8, 72, 0,  100, 72, 0,  100, 8, 0 };
+	uint8_t					lit[4]		= { 0 };
+	int						litCount	= 0;
+	int						oddCount	= 0;
+	int						pass, side, counter;
+
+	LDrawSoftDLBuilderAddQuad(builder, quad, half);
+	rectangle = LDrawSoftDLBuilderFinish(builder);
+
+	builder = LDrawSoftDLBuilderCreate();
+	for(side = 0; side < 37; side++)
+	{
+		float a0		= 2 * (float)M_PI * side / 37;
+		float a1		= 2 * (float)M_PI * (side + 1) / 37;
+		float tri[9]	= { 64.3f, 47.9f, 0,
+							64.3f + 40.7f * cosf(a1), 47.9f + 40.7f * sinf(a1), 0,
+							64.3f + 40.7f * cosf(a0), 47.9f + 40.7f * sinf(a0), 0 };
+
+		LDrawSoftDLBuilderAddTri(builder, tri, half);
+	}
+	disc = LDrawSoftDLBuilderFinish(builder);
+
+	for(pass = 0; pass < 2; pass++)
+	{
+		drawFlat(framebuffer, pass ? disc : rectangle, half);
+
+		litCount = 0;
+		for(counter = 0; counter < framebuffer->width * framebuffer->height; counter++)
+		{
+			const uint8_t *pixel = framebuffer->pixels + counter * 4;
+
+			if(pixel[0] == 0)
+				continue;
+			if(litCount++ == 0)
+				memcpy(lit, pixel, 4);
+			else if(memcmp(lit, pixel, 4) != 0)
+				oddCount++;
+		}
+		printf("  %s: %d pixels lit, %d drawn more than once\n", pass ? "disc" : "rectangle", litCount, oddCount);
+		if(pass == 0 && litCount != 92 * 64)
+			oddCount++;
+	}
+
+	LDrawSoftDLDestroy(rectangle);
+	LDrawSoftDLDestroy(disc);
+	LDrawSoftFramebufferDestroy(framebuffer);
+
+	return oddCount == 0 && litCount > 0;
+
+}//end checkCoverage
+
+
+//========== checkOrdering =====================================================
+//
+// Purpose:		Draws a red square, then a blue one behind it, then a
+//				translucent green one in front: the centre must come out red
+//				under green.
+//
+//==============================================================================
+static bool checkOrdering(void)
+{
+	const float				colors[3][4]	= { { 0.8f, 0, 0, 1 }, { 0, 0, 0.8f, 1 }, { 0, 0.8f, 0, 0.5f } };
+	const float				depths[3]		= { 10, -10, 20 };
+	LDrawSoftFramebuffer	*framebuffer	= LDrawSoftFramebufferCreate(32, 32);
+	LDrawSoftDLBuilder		*builder	= LDrawSoftDLBuilderCreate();
+	LDrawSoftDL				*square		= NULL;
+	LDrawSoftSession		*session	= NULL;
+	float					quad[12]	= { 4, 4, 0,  4, 28, 0,  28, 28, 0,  28, 4, 0 };
+	float					identity[16];
+	float					projection[16];
+	const uint8_t			*centre		= NULL;
+	bool					passed		= false;
+	int						counter		= 0;
+
+	// One meta-colored square, drawn three times at different depths.
+	LDrawSoftDLBuilderAddQuad(builder, quad, currentColor);
+	square = LDrawSoftDLBuilderFinish(builder);
+
+	buildIdentity(identity);
+	buildOrthoMatrix(projection, 0, 32, 32, 0, -100, 100);
+	session = LDrawSoftSessionCreate(framebuffer, identity, projection);
+	for(counter = 0; counter < 3; counter++)
+	{
+		float transform[16];
+
+		buildTranslationMatrix(transform, 0, 0, depths[counter]);
+		LDrawSoftSessionDraw(session, square, colors[counter], colors[counter], transform, false);
+	}
+	LDrawSoftSessionDrawAndDestroy(session);
+
+	// Lit head-on: 0.8 x 1.1 = 0.88, then half of it under half green.
+	centre = framebuffer->pixels + (16 * 32 + 16) * 4;
+	passed = (centre[0] == 112 && centre[1] == 112 && centre[2] == 0);
+	printf("  ordering: centre is %d %d %d\n", centre[0], centre[1], centre[2]);
+
+	LDrawSoftDLDestroy(square);
+	LDrawSoftFramebufferDestroy(framebuffer);
+
+	return passed;
+
+}//end checkOrdering
+
+
+//========== main ==============================================================
+//
+// Purpose:		Runs the checks and the timing, and writes the image if asked.
+//
+//==============================================================================
+int main(int argc, const char *argv[])
+{
+	LDrawSoftFramebuffer	*framebuffer	= LDrawSoftFramebufferCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+	LDrawSoftDL				*bricks[3]		= { NULL, NULL, NULL };
+	int						threadCount		= (argc > 1) ? atoi(argv[1]) : 0;
+	const char				*path			= (argc > 2) ? argv[2] : NULL;
+	double					start			= BenchmarkNow();
+	bool					passed			= true;
+	int						counter			= 0;
+
+	if(threadCount <= 0)
+		threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(threadCount < 4)
+		threadCount = 4;
+
+	bricks[0] = makeBrick(1, 1);
+	bricks[1] = makeBrick(2, 2);
+	bricks[2] = makeBrick(2, 4);
+	printf("built 3 bricks in %.1f ms\n", (BenchmarkNow() - start) * 1000);
+
+	passed = checkDeterminism(framebuffer, bricks, threadCount) && passed;
+
+	LDrawSoftRasterSetThreadCount(threadCount);
+	passed = checkCoverage() && passed;
+	passed = checkOrdering() && passed;
+
+	if(path)
+	{
+		size_t	length	= strlen(path);
+		bool	ppm		= length > 4 && strcmp(path + length - 4, ".ppm") == 0;
+		bool	written	= ppm ? LDrawSoftFramebufferWritePPM(framebuffer, path) : LDrawSoftFramebufferWritePNG(framebuffer, path);
+
+		printf("%s %s\n", written ? "wrote" : "could not write", path);
+		passed = written && passed;
+	}
+
+	for(counter = 0; counter < 3; counter++)
+		LDrawSoftDLDestroy(bricks[counter]);
+	LDrawSoftFramebufferDestroy(framebuffer);
+
+	printf("%s\n", passed ? "PASSED" : "FAILED");
+	return passed ? 0 : 1;
+
+}//end main
@@ -0,0 +1,209 @@
+//==============================================================================
+//
+// File:		VertexCacheReport.c
+//
+// Purpose:		Reports how well the GPU's post-transform vertex cache is used
+//				by each part's smoothed mesh, written as write_indexed_mesh
+//				orders it by default and after optimize_vertex_cache.
+//
+//				ACMR is the average number of vertices transformed per
+//				triangle (lower is better; 0.5 is the limit for a big regular
+//				mesh). ATVR is the number transformed per unique vertex (1.0 is
+//				the best possible). Both are measured against a FIFO cache of
+//				16 and of 32 entries. Quads count as the two triangles the GPU
+//				splits them into.
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					VertexCacheReport.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [ldraw folder part.dat ...]
+//				Without a library, reports on synthetic tori.
+//
+//==============================================================================
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "MeshSmooth.h"
+
+// What one ordering of a part achieves.
+typedef struct
+{
+	int		triangles;
+	int		vertices;		// Unique vertices used by the tris and quads.
+	int		misses[2];		// Transforms with a 16- and a 32-entry cache.
+	double	optimizeTime;
+
+} CacheStats;
+
+
+//========== simulateFIFO ======================================================
+//
+// Purpose:		Feeds one triangle's indices through a FIFO cache, counting
+//				the vertices that have to be transformed. stamp holds the
+//				insertion count at which each vertex last went in, or -1.
+//
+//==============================================================================
+static int simulateFIFO(const unsigned int *triangle, int size, int *head, int *stamp)
+{
+	int misses = 0;
+	int corner = 0;
+
+	for(corner = 0; corner < 3; corner++)
+	{
+		unsigned int	vertex	= triangle[corner];
+		int				slot	= stamp[vertex];
+
+		// A vertex is cached if it went in within the last size insertions.
+		if(slot >= 0 && *head - slot < size)
+			continue;
+
+		stamp[vertex]	= *head;
+		*head			+= 1;
+		misses++;
+	}
+	return misses;
+}
+
+
+//========== measureMesh =======================================================
+//
+// Purpose:		Smooths flat and measures its tris and quads.
+//
+//==============================================================================
+static CacheStats measureMesh(const FlatMesh *flat, int optimize)
+{
+	static const int	cacheSizes[2]	= { 16, 32 };
+	CacheStats			stats;
+	struct Mesh			*mesh			= NULL;
+	SmoothedMesh		smoothed;
+	int					counter			= 0;
+	int					vertexCount		= 0;
+	int					*starts			= smoothed.starts;
+	int					*counts			= smoothed.counts;
+	unsigned int		*indices		= NULL;
+	int					cache			= 0;
+
+	memset(&stats, 0, sizeof(stats));
+
+	mesh = smoothFlatMesh(flat);
+
+	if(optimize)
+	{
+		double start = BenchmarkNow();
+		optimize_vertex_cache(mesh);
+		stats.optimizeTime = BenchmarkNow() - start;
+	}
+
+	writeSmoothedMesh(mesh, &smoothed);
+	indices		= smoothed.indices;
+	vertexCount	= smoothed.vertexCount;
+
+	for(cache = 0; cache < 2; cache++)
+	{
+		int				*stamp	= malloc(sizeof(int) * vertexCount);
+		int				head	= 0;
+		int				index	= 0;
+
+		for(counter = 0; counter < vertexCount; counter++)
+			stamp[counter] = -1;
+
+		for(index = starts[2]; index < starts[2] + counts[2]; index += 3)
+			stats.misses[cache] += simulateFIFO(indices + index, cacheSizes[cache], &head, stamp);
+
+		for(index = starts[3]; index < starts[3] + counts[3]; index += 4)
+		{
+			unsigned int	*quad		= indices + index;
+			unsigned int	second[3]	= { quad[0], quad[2], quad[3] };
+
+			stats.misses[cache] += simulateFIFO(quad, cacheSizes[cache], &head, stamp);
+			stats.misses[cache] += simulateFIFO(second, cacheSizes[cache], &head, stamp);
+		}
+
+		stats.vertices = 0;
+		for(counter = 0; counter < vertexCount; counter++)
+			stats.vertices += (stamp[counter] >= 0);
+		free(stamp);
+	}
+	stats.triangles = counts[2] / 3 + counts[3] / 2;
+
+	freeSmoothedMesh(&smoothed);
+
+	return stats;
+}
+
+
+//========== reportMesh ========================================================
+//
+// Purpose:		Prints one part's line of the report.
+//
+//==============================================================================
+static void reportMesh(const char *name, const FlatMesh *flat)
+{
+	CacheStats	before	= measureMesh(flat, 0);
+	CacheStats	after	= measureMesh(flat, 1);
+
+	printf("%-22s %8d %8d  %5.3f %5.3f  %5.3f %5.3f  %5.3f %5.3f  %7.2f ms\n",
+		   name, before.triangles, before.vertices,
+		   (double)before.misses[0] / before.triangles, (double)after.misses[0] / after.triangles,
+		   (double)before.misses[1] / before.triangles, (double)after.misses[1] / after.triangles,
+		   (double)before.misses[1] / before.vertices, (double)after.misses[1] / after.vertices,
+		   after.optimizeTime * 1e3);
+}
+
+
+int main(int argc, const char *argv[])
+{
+	static const float	identity[12]	= { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0 };
+	int					counter			= 0;
+
+	printf("%-22s %8s %8s  %-11s  %-11s  %-11s  %s\n", "", "", "", "ACMR 16", "ACMR 32", "ATVR 32", "");
+	printf("%-22s %8s %8s  %5s %5s  %5s %5s  %5s %5s  %10s\n",
+		   "part", "tris", "vertices", "was", "now", "was", "now", "was", "now", "optimize");
+
+	if(argc > 2)
+	{
+		for(counter = 2; counter < argc; counter++)
+		{
+			FlatMesh flat;
+
+			memset(&flat, 0, sizeof(flat));
+			flattenPart(&flat, argv[1], argv[counter], identity, 0);
+			if(flat.missingFiles)
+				fprintf(stderr, "%s: %d files not found\n", argv[counter], flat.missingFiles);
+			if(flat.polygonCount > 0)
+				reportMesh(argv[counter], &flat);
+
+			free(flat.polygons);
+			free(flat.lines);
+		}
+	}
+	else
+	{
+		static const struct { const char *name; int rings, tubes, triangles; } tori[] =
+		{
+			{ "torus 48 x 24 quads",	48,		24,		0 },
+			{ "torus 48 x 24 tris",		48,		24,		1 },
+			{ "torus 192 x 96 quads",	192,	96,		0 },
+			{ "torus 192 x 96 tris",	192,	96,		1 },
+		};
+
+		for(counter = 0; counter < (int)(sizeof(tori) / sizeof(tori[0])); counter++)
+		{
+			FlatMesh flat;
+
+			memset(&flat, 0, sizeof(flat));
+			addTorus(&flat, tori[counter].rings, tori[counter].tubes, 10.0f, tori[counter].triangles ? TORUS_TRIANGLES : 0);
+			reportMesh(tori[counter].name, &flat);
+
+			free(flat.polygons);
+			free(flat.lines);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,224 @@
+//==============================================================================
+//
+// File:		WeldIndexBenchmark.c
+//
+// Purpose:		Times MeshSmooth's vertex welding (finish_faces_and_sort) with
+//				the R-tree and with the spatial hash, and checks that both
+//				weld the same rings by comparing the smoothed output.
+//
+//				Given an LDraw library, each named part is flattened into one
+//				mesh, the way the part cache does. Without one, the meshes are
+//				synthetic: grids of quads whose shared corners are each nudged
+//				by less than the weld distance, as sub-part transforms do.
+//
+// Build:		cc -O2 -DNDEBUG -I../Source/LDraw/Renderer -I../Source/LDraw/Support
+//					WeldIndexBenchmark.c
+//					../Source/LDraw/Renderer/MeshSmooth.c -lm -lpthread
+//
+// Usage:		./a.out [ldraw folder part.dat ...]
+//				e.g. ./a.out ~/ldraw 3811.dat 4186.dat 44343.dat 3001.dat
+//
+//==============================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkParts.h"
+#include "BenchmarkSupport.h"
+#include "MeshSmooth.h"
+
+#define REPEATS			5
+
+// The same output comparison as MeshSmoothBenchmark.
+typedef struct
+{
+	int				vertexCount;
+	int				indexCount;
+	float			*vertices;
+	unsigned int	*indices;
+
+} MeshOutput;
+
+
+//========== makeSyntheticMesh =================================================
+//
+// Purpose:		A size x size grid of unit-ish quads, each with its own copy of
+//				the shared corners, each copy nudged by up to 0.002 LDU.
+//
+//==============================================================================
+static void makeSyntheticMesh(FlatMesh *mesh, int size, uint32_t *seed)
+{
+	int x, z, corner, axis;
+
+	for(x = 0; x < size; x++)
+	for(z = 0; z < size; z++)
+	{
+		float	points[4][3]	=
+		{
+			{ x * 4.0f,			0, z * 4.0f },
+			{ x * 4.0f,			0, (z + 1) * 4.0f },
+			{ (x + 1) * 4.0f,	0, (z + 1) * 4.0f },
+			{ (x + 1) * 4.0f,	0, z * 4.0f },
+		};
+
+		for(corner = 0; corner < 4; corner++)
+		for(axis = 0; axis < 3; axis++)
+			points[corner][axis] += BenchmarkRandomFloat(seed, -0.001f, 0.001f);
+
+		addPrimitive(mesh, 4, points);
+		if(x == 0 || z == 0)
+			addPrimitive(mesh, 2, points);
+	}
+}
+
+
+//========== buildMesh =========================================================
+//
+// Purpose:		Hands the flattened part to MeshSmooth.
+//
+//==============================================================================
+static struct Mesh *buildMesh(const FlatMesh *flat, enum weld_index weldIndex)
+{
+	static const float	color[4]	= { 0.5f, 0.5f, 0.5f, 1.0f };
+	int					triCount	= 0;
+	int					counter		= 0;
+	struct Mesh			*mesh		= NULL;
+
+	for(counter = 0; counter < flat->polygonCount; counter++)
+		triCount += (flat->polygons[counter].degree == 3);
+
+	mesh = create_mesh_with_weld_index(triCount, flat->polygonCount - triCount, flat->lineCount, 0, weldIndex);
+
+	for(counter = 0; counter < flat->polygonCount; counter++)
+	{
+		const Primitive *p = flat->polygons + counter;
+		add_face(mesh, p->points[0], p->points[1], p->points[2], (p->degree == 4) ? p->points[3] : NULL, color, 0);
+	}
+	for(counter = 0; counter < flat->lineCount; counter++)
+		add_face(mesh, flat->lines[counter].points[0], flat->lines[counter].points[1], NULL, NULL, color, 0);
+
+	return mesh;
+}
+
+
+//========== smoothMesh ========================================================
+//
+// Purpose:		Runs the whole pipeline the way the builders do, T junction
+//				removal included, and returns the output, adding the weld time
+//				to weldTime. Neither weld index survives welding, so everything
+//				after it must come out the same with both.
+//
+//==============================================================================
+static MeshOutput smoothMesh(const FlatMesh *flat, enum weld_index weldIndex, double *weldTime)
+{
+	struct Mesh	*mesh	= buildMesh(flat, weldIndex);
+	MeshOutput	output;
+	int			starts[4];
+	int			counts[4];
+	double		start	= BenchmarkNow();
+
+	finish_faces_and_sort(mesh);
+	*weldTime += BenchmarkNow() - start;
+
+	add_creases(mesh);
+	find_and_remove_t_junctions(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+
+	get_final_mesh_counts(mesh, &output.vertexCount, &output.indexCount);
+	output.vertices	= malloc(sizeof(float) * 10 * output.vertexCount);
+	output.indices	= malloc(sizeof(unsigned int) * output.indexCount);
+	write_indexed_mesh(mesh, output.vertexCount, output.vertices, output.indexCount, output.indices, 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+	destroy_mesh(mesh);
+
+	return output;
+}
+
+
+//========== compareIndexes ====================================================
+//
+// Purpose:		Prints one row of the report. Returns whether the two indexes
+//				agreed.
+//
+//==============================================================================
+static int compareIndexes(const char *name, const FlatMesh *flat)
+{
+	double		rtreeTime	= 0;
+	double		gridTime	= 0;
+	int			identical	= 1;
+	int			repeat		= 0;
+
+	for(repeat = 0; repeat < REPEATS; repeat++)
+	{
+		MeshOutput	rtree	= smoothMesh(flat, weld_index_rtree, &rtreeTime);
+		MeshOutput	grid	= smoothMesh(flat, weld_index_grid, &gridTime);
+
+		identical = identical
+				&&	rtree.vertexCount == grid.vertexCount
+				&&	rtree.indexCount == grid.indexCount
+				&&	memcmp(rtree.vertices, grid.vertices, sizeof(float) * 10 * rtree.vertexCount) == 0
+				&&	memcmp(rtree.indices, grid.indices, sizeof(unsigned int) * rtree.indexCount) == 0;
+
+		free(rtree.vertices);
+		free(rtree.indices);
+		free(grid.vertices);
+		free(grid.indices);
+	}
+
+	printf("%-24s %9d %9.2f ms %9.2f ms %7.2fx  %s\n", name, flat->polygonCount * 4 + flat->lineCount * 2,
+		   rtreeTime / REPEATS * 1e3, gridTime / REPEATS * 1e3, rtreeTime / gridTime,
+		   identical ? "identical" : "DIFFERS");
+
+	return identical;
+}
+
+
+int main(int argc, const char *argv[])
+{
+	static const float	identity[12]	= { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0 };
+	int					allIdentical	= 1;
+	int					counter			= 0;
+
+	printf("%-24s %9s %12s %12s %8s\n", "mesh", "vertices", "R-tree", "grid", "speedup");
+
+	if(argc > 2)
+	{
+		for(counter = 2; counter < argc; counter++)
+		{
+			FlatMesh flat;
+
+			memset(&flat, 0, sizeof(flat));
+			flattenPart(&flat, argv[1], argv[counter], identity, 0);
+			if(flat.missingFiles)
+				fprintf(stderr, "%s: %d files not found\n", argv[counter], flat.missingFiles);
+			if(flat.polygonCount > 0)
+				allIdentical &= compareIndexes(argv[counter], &flat);
+
+			free(flat.polygons);
+			free(flat.lines);
+		}
+	}
+	else
+	{
+		static const int	sizes[]	= { 16, 64, 256 };
+		uint32_t			seed	= 0x6A09E667;
+
+		for(counter = 0; counter < (int)(sizeof(sizes) / sizeof(sizes[0])); counter++)
+		{
+			FlatMesh	flat;
+			char		name[64];
+
+			memset(&flat, 0, sizeof(flat));
+			makeSyntheticMesh(&flat, sizes[counter], &seed);
+			snprintf(name, sizeof(name), "synthetic %d x %d", sizes[counter], sizes[counter]);
+			allIdentical &= compareIndexes(name, &flat);
+
+			free(flat.polygons);
+			free(flat.lines);
+		}
+	}
+
+	return allIdentical ? 0 : 1;
+}
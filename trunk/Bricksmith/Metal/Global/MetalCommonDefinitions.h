@@ -18,6 +18,10 @@
 
 // Stride of our vertices - we always write  X Y Z   NX NY NZ   R G B A
 #define VERT_STRIDE 10
+// Display lists hand the GPU compact vertices instead (see MeshSmooth.h): the
+// position quantized to 16 bits within the part's bounds, an octahedral normal
+// and an RGBA8 color - 16 bytes rather than VERT_STRIDE floats.
+#define COMPACT_VERTICES 1
 // The number of float values in InstanceInput struct
 #define InstanceInputLength 24
 // The size in bytes of InstanceInput struct
@@ -33,6 +37,7 @@ typedef enum BufferIndex {
 	BufferIndexPerInstanceData  		= 1,
 	BufferIndexVertexUniforms      		= 2,
 	BufferIndexTexturePlane      		= 3,
+	BufferIndexVertexDecode				= 4,
 	BufferIndexFragmentUniforms 		= 0
 } BufferIndex;
 
@@ -64,6 +69,12 @@ typedef struct InstanceInput {
 	vector_float4	color_compliment;
 } InstanceInput;
 
+// How to decode a display list's compact vertices: position = offset + position * scale.
+typedef struct VertexDecode {
+	vector_float4	offset;
+	vector_float4	scale;
+} VertexDecode;
+
 // Texture plane generation data for automatic texture coordinate generation
 typedef struct TexturePlaneData {
 	vector_float4	plane_s;
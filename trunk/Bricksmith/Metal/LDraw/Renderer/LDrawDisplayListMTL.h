@@ -55,8 +55,19 @@ struct	LDrawDLSession;
 // Display list creation API.
 struct LDrawDLBuilder *	LDrawDLBuilderCreate(void);
 struct LDrawDL *		LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx);
+void					LDrawDLBuilderDestroy(struct LDrawDLBuilder * ctx);
 void					LDrawDLDestroy(struct LDrawDL * dl);
 
+// Finishing in the background: Prepare does everything but the upload and may
+// run on any thread, as may Destroy.  Finish then only has to upload.  The
+// face count is a guide to how long Prepare will take.
+int						LDrawDLBuilderGetFaceCount(struct LDrawDLBuilder * ctx);
+void					LDrawDLBuilderPrepare(struct LDrawDLBuilder * ctx);
+
+// Detail levels: the DL to draw in place of dl at one of the LDrawCoreRenderer
+// detail levels.  This is dl itself if it has nothing simpler.
+struct LDrawDL *		LDrawDLGetDetail(struct LDrawDL * dl, int detail);
+
 // Display list mesh accumulation APIs.
 void					LDrawDLBuilderSetTex(struct LDrawDLBuilder * ctx, struct LDrawTextureSpec * spec);
 void					LDrawDLBuilderAddTri(struct LDrawDLBuilder * ctx, const float v[9], float n[3], float c[4]);
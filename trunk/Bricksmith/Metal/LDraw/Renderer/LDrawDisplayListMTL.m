@@ -14,6 +14,9 @@
 #import "LDrawDisplayListMTL.h"
 #import "LDrawCoreRenderer.h"
 #import "LDrawBDPAllocator.h"
+#import "LDrawDLBuildQueue.h"
+#import "LDrawDepthSort.h"
+#import "LDrawMeshCache.h"
 #import "LDrawShaderRenderer.h"
 #import "MeshSmooth.h"
 #import "MetalGPU.h"
@@ -62,10 +65,11 @@ const int MSAASampleCount = 4;
 
 	DEFERRED DARWING FOR Z SORTING
 	
-	When a DL does not have to be drawn immediately and has translucency, we always try to save it to the sorted list.
+	When a DL does not have to be drawn immediately and has translucency, we always try to save it to the sorted array, along
+	with the eye-space depth of its local origin.
 	
-	Then when the session is destroyed, we sort all of these "sort-deferred" DLs by their local origin and draw back to front.
-	This helps keep translucency looking good.
+	Then when the session is destroyed, we sort all of these "sort-deferred" DLs by that depth (see LDrawDepthSort.h) and draw
+	back to front.  This helps keep translucency looking good.
 
 */
 
@@ -81,6 +85,12 @@ const int MSAASampleCount = 4;
 
 #define INST_BUFFER_SIZE (1024 * 1024)	// 1MB initial size for instance buffers
 
+// Display lists of at least this many triangles get simplified detail levels.
+// A level is kept only if it has at most this fraction of the next finer
+// level's triangles.
+#define DETAIL_MIN_TRIS 128
+#define DETAIL_MAX_RATIO 0.75f
+
 enum {
 	dl_has_alpha = 1,		// At least one prim in this DL has translucency.
 	dl_has_meta = 2,		// At least one prim in this DL uses a meta-color and thus MIGHT pick up translucency from parent state during draw.
@@ -116,6 +126,14 @@ struct LDrawDLPerTex {
 	uint32_t				tri_count;
 };
 
+// Where one detail level's indices sit in the block LDrawDLSimplifyDetails returns.
+struct LDrawDLDetailRange {
+	int						start;
+	int						line_count;
+	int						cond_line_count;
+	int						tri_count;
+};
+
 // DL draw instance: this stores one request to draw an un-textured DL for instancing.
 // current color/compliment color, transform, and a next ptr to build a linked list.
 struct LDrawDLInstance {
@@ -138,9 +156,16 @@ struct LDrawDL {
 	int						instance_count;
 	int						flags;				// See flags defs above.
 	id<MTLBuffer> 			vertexBuffer;		// Single buffer containing all geometry in the DL.
+#if COMPACT_VERTICES
+	struct VertexDecode		vertexDecode;		// Bounds the compact positions were quantized to.
+#endif
 #if WANT_SMOOTH
 	id<MTLBuffer> 			indexBuffer;		// Single buffer containing all mesh indices.
+	MTLIndexType			indexType;			// 16-bit indices when the vertices can all be numbered in 16 bits.
+	NSUInteger				indexSize;
 #endif
+	struct LDrawDL *		owner;				// For a detail level, the DL it simplifies - it owns the buffers.
+	struct LDrawDL *		details[detail_count];	// Simpler copies to draw when small; NULL where not worth having.
 	int						tex_count;			// Number of per-textures; untex case is always first if present.
 	#if WANT_STATS
 	int						vrt_count;
@@ -161,8 +186,13 @@ struct LDrawDL {
 // GPU Gems 2.)
 struct LDrawDLSegment {
 	id<MTLBuffer> 			vertexBuffer;		// Vertex buffer of the brick we are going to draw - contains the actual brick mesh.
+#if COMPACT_VERTICES
+	struct VertexDecode		vertexDecode;
+#endif
 #if WANT_SMOOTH
 	id<MTLBuffer> 			indexBuffer;
+	MTLIndexType			indexType;
+	NSUInteger				indexSize;
 #endif
 	struct LDrawDLPerTex *	dl;					// Ptr to the per-tex info for that brick - only untexed bricks get instanced, so we only have one "per tex", by definition.
 	float *					inst_base;			// Buffer-relative ptr to the instance data base in the instance buffer.
@@ -171,14 +201,10 @@ struct LDrawDLSegment {
 };
 	
 
-// The sorted instance link is a 'full' instance (DL, color/comp, transform and texture) used for drawing DLs that are going to be Z sorted.  
+// The sorted instance is a 'full' instance (DL, color/comp, transform and texture) used for drawing DLs that are going to be Z sorted.  
 // Unlike the faster harder instancing, we keep tex state around because we might draw ANY DL (even a multitextured one) to get the Z sort
 // right.
-struct LDrawDLSortedInstanceLink {
-	union {
-		struct LDrawDLSortedInstanceLink *	next;			// DURING draw, we keep a linked list of these guys off of the session as we go.
-		float								eval;			// At the end of draw, when we need to sort, we copy to a fixed size array and sort.
-	};														// Maybe someday we could merge-sort the linked list, but use qsort for now to get shipped.
+struct LDrawDLSortedInstance {
 	struct	LDrawDL *						dl;
 	struct LDrawTextureSpec					spec;
 	float									color[4];
@@ -210,8 +236,10 @@ struct LDrawDLSession {
 	int									dl_count;
 	int									total_instance_count;	// Used in calculation the size of instance buffer
 
-	struct LDrawDLSortedInstanceLink *	sorted_head;			// Linked list + count for DLs being drawn later to Z sort.
-	int									sort_count;
+	struct LDrawDLSortedInstance *		sorted;					// DLs being drawn later to Z sort, in the order drawn, with their
+	LDrawDepthSortEntry *				sort_keys;				// eye space Z.  Grown with realloc, so the arrays can be sorted
+	int									sort_count;				// in place and never copied from a list.
+	int									sort_capacity;
 
 	float								model_view[16];			// Model-view matrix, used to Z sort translucent objects.
 	unsigned int						inst_ring;				// If using more than one instancing buffer, this tells which one we use.
@@ -224,7 +252,11 @@ struct LDrawDLSession {
 //========== Structures for BUILDING a buffer =============================
 
 
-// As we build our buffer, we keep sets of vertices in a linked list. When done
+// When smoothing, every primitive goes straight into one growable mesh as it
+// is added - the mesh stores its faces in blocks that grow as needed, so there
+// is nothing for us to keep.
+//
+// Otherwise, as we build our buffer, we keep sets of vertices in a linked list. When done
 // we copy them into our buffer. The linked list lets us add vertices a little
 // at a time without expensive array resizes. Since the linked list comes
 // from a BDP locality is actually pretty good.
@@ -238,17 +270,23 @@ struct	LDrawDLBuilderVertexLink {
 
 
 // Build structure per texture.  Textures are kept in a linked list during build
-// since we don't know how many we will have.  Each type of drawing (line, cond_line, tri)
+// since we don't know how many we will have.  When smoothing, a texture just
+// remembers the texture ID its faces were given in the mesh (-1 until it gets its
+// first face).  Otherwise each type of drawing (line, cond_line, tri)
 // is kept in a singly linked list of vertex links so that we can copy them consecutively when done.
 struct LDrawDLBuilderPerTex {
 	struct LDrawDLBuilderPerTex *		next;
 	struct LDrawTextureSpec				spec;
+#if WANT_SMOOTH
+	int									tid;
+#else
 	struct LDrawDLBuilderVertexLink *	tri_head;
 	struct LDrawDLBuilderVertexLink *	tri_tail;
 	struct LDrawDLBuilderVertexLink *	line_head;
 	struct LDrawDLBuilderVertexLink *	line_tail;
 	struct LDrawDLBuilderVertexLink *	cond_line_head;
 	struct LDrawDLBuilderVertexLink *	cond_line_tail;
+#endif
 };
 
 
@@ -256,11 +294,29 @@ struct LDrawDLBuilderPerTex {
 // linked list of textures (which in turn contain the geometry.  So the entire
 // structure just accumulates data in a set of linked lists, then cleans and saves
 // the data carefully when we are done.
+//
+// When smoothing, the geometry instead accumulates in the mesh, and - if the mesh
+// cache is on - in the cache key, which has to see the faces in the same order.
+// LDrawDLBuilderPrepare then bakes the mesh down to the tables the buffers are
+// filled from, which may happen on another thread.
 struct	LDrawDLBuilder {
 	int								flags;
 	struct LDrawBDP *				alloc;
 	struct LDrawDLBuilderPerTex *	head;
 	struct LDrawDLBuilderPerTex *	cur;
+#if WANT_SMOOTH
+	struct Mesh *					mesh;
+	int								tex_count;		// Texture IDs handed out so far.
+	int								poly_count;		// Tris, to decide whether to cache.
+	int								hashing;
+	LDrawMeshCacheHasher			hasher;
+	int								prepared;		// The mesh went into bake.
+	LDrawDLBake						bake;
+	struct compact_bounds			bounds;
+	struct LDrawDLDetailRange		detail_ranges[detail_count];
+	uint32_t *						detail_indices;
+	int								detail_total;
+#endif
 };
 
 
@@ -366,21 +422,6 @@ static void setup_tex_spec(struct LDrawTextureSpec * spec,
 }//end setup_tex_spec
 
 
-//========== compare_sorted_link =================================================
-//
-// Purpose:	Functor to compare two sorted instances by their "eval" value, which
-//			is eye space Z right now. API fits C qsort.
-//
-//================================================================================
-static int compare_sorted_link(const void * lhs, const void * rhs)
-{
-	const struct LDrawDLSortedInstanceLink * a = (const struct LDrawDLSortedInstanceLink *) lhs;
-	const struct LDrawDLSortedInstanceLink * b = (const struct LDrawDLSortedInstanceLink *) rhs;
-	return a->eval - b->eval;
-
-}//end compare_sorted_link
-
-
 //========== saveForSortDraw =====================================================
 //
 // Purpose:	Save DL for later sorting drawing.
@@ -399,19 +440,37 @@ static void saveForSortDraw(struct LDrawDLSession *		session,
 	session->stats.num_vert_srt += dl->vrt_count;
 #endif
 
-	// Build a sorted link, copy the instance data to it, and link it up to our session for later processing.
-	struct LDrawDLSortedInstanceLink * link = LDrawBDPAllocate(session->alloc, sizeof(struct LDrawDLSortedInstanceLink));
-	link->next = session->sorted_head;
-	session->sorted_head = link;
-	link->dl = dl;
-	memcpy(link->color,cur_color,sizeof(float)*4);
-	memcpy(link->comp,cmp_color,sizeof(float)*4);
-	memcpy(link->transform,transform,sizeof(float)*16);
-	session->sort_count++;
+	if(session->sort_count == session->sort_capacity)
+	{
+		session->sort_capacity = session->sort_capacity ? session->sort_capacity * 2 : 256;
+		session->sorted = (struct LDrawDLSortedInstance *) realloc(session->sorted, sizeof(struct LDrawDLSortedInstance) * session->sort_capacity);
+		session->sort_keys = (LDrawDepthSortEntry *) realloc(session->sort_keys, sizeof(LDrawDepthSortEntry) * session->sort_capacity);
+	}
+
+	// Copy the instance data, and key it by the eye space Z of its origin.
+	struct LDrawDLSortedInstance * inst = session->sorted + session->sort_count;
+	LDrawDepthSortEntry * key = session->sort_keys + session->sort_count;
+
+	inst->dl = dl;
+	memcpy(inst->color,cur_color,sizeof(float)*4);
+	memcpy(inst->comp,cmp_color,sizeof(float)*4);
+	memcpy(inst->transform,transform,sizeof(float)*16);
 	if(spec)
-		memcpy((void*)&link->spec, (void*)spec, sizeof(struct LDrawTextureSpec));
+		memcpy((void*)&inst->spec, (void*)spec, sizeof(struct LDrawTextureSpec));
 	else
-		memset((void*)&link->spec, 0, sizeof(struct LDrawTextureSpec));
+		memset((void*)&inst->spec, 0, sizeof(struct LDrawTextureSpec));
+
+	simd_float4x4 modelView = simd_matrix4x4_from_array(session->model_view);
+	simd_float4 v = simd_make_float4(transform[12],
+									 transform[13],
+									 transform[14], 1.0f);
+
+	simd_float4 v_eye = simd_mul(modelView, v);
+
+	key->key = v_eye.z;
+	key->index = session->sort_count;
+
+	session->sort_count++;
 
 }//end saveForSortDraw
 
@@ -499,6 +558,9 @@ static void immediateDraw(id<MTLRenderCommandEncoder>	renderEncoder,
 
 	// Bind our DL buffer and set up ptrs.
 	[renderEncoder setVertexBuffer:dl->vertexBuffer offset:0 atIndex:BufferIndexInstanceInvariantData];
+	#if COMPACT_VERTICES
+	[renderEncoder setVertexBytes:&dl->vertexDecode length:sizeof(struct VertexDecode) atIndex:BufferIndexVertexDecode];
+	#endif
 
 	struct LDrawDLPerTex * tptr = dl->texes;
 
@@ -512,17 +574,17 @@ static void immediateDraw(id<MTLRenderCommandEncoder>	renderEncoder,
 		if(tptr->line_count)
 			[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeLine
 									  indexCount:tptr->line_count
-									   indexType:MTLIndexTypeUInt32
+									   indexType:dl->indexType
 									 indexBuffer:dl->indexBuffer
-							   indexBufferOffset:tptr->line_off * sizeof(uint32_t)
+							   indexBufferOffset:tptr->line_off * dl->indexSize
 								   instanceCount:1];
 
 		if(tptr->cond_line_count)
 			[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeLine
 									  indexCount:tptr->cond_line_count
-									   indexType:MTLIndexTypeUInt32
+									   indexType:dl->indexType
 									 indexBuffer:dl->indexBuffer
-							   indexBufferOffset:tptr->cond_line_off * sizeof(uint32_t)
+							   indexBufferOffset:tptr->cond_line_off * dl->indexSize
 								   instanceCount:1];
 		#else
 		if(tptr->line_count)
@@ -549,17 +611,17 @@ static void immediateDraw(id<MTLRenderCommandEncoder>	renderEncoder,
 			if(tptr->line_count)
 				[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeLine
 										  indexCount:tptr->line_count
-										   indexType:MTLIndexTypeUInt32
+										   indexType:dl->indexType
 										 indexBuffer:dl->indexBuffer
-								   indexBufferOffset:tptr->line_off * sizeof(uint32_t)
+								   indexBufferOffset:tptr->line_off * dl->indexSize
 									   instanceCount:1];
 
 			if(tptr->tri_count)
 				[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
 										  indexCount:tptr->tri_count
-										   indexType:MTLIndexTypeUInt32
+										   indexType:dl->indexType
 										 indexBuffer:dl->indexBuffer
-								   indexBufferOffset:tptr->tri_off * sizeof(uint32_t)];
+								   indexBufferOffset:tptr->tri_off * dl->indexSize];
 			#else
 			if(tptr->line_count)
 				[renderEncoder drawPrimitives:MTLPrimitiveTypeLine
@@ -615,8 +677,13 @@ static void writeHardwareInstanceData(struct LDrawDLSegment	*	segment,
 
 	if (inst_count > 0) {
 		if (segment->vertexBuffer != dl->vertexBuffer) segment->vertexBuffer = dl->vertexBuffer;
+#if COMPACT_VERTICES
+		segment->vertexDecode = dl->vertexDecode;
+#endif
 #if WANT_SMOOTH
 		segment->indexBuffer = dl->indexBuffer;
+		segment->indexType = dl->indexType;
+		segment->indexSize = dl->indexSize;
 #endif
 		segment->dl = &dl->texes[0];
 	}
@@ -646,21 +713,287 @@ struct LDrawDLBuilder * LDrawDLBuilderCreate(void)
 	
 	bld->alloc = alloc;
 	bld->flags = 0;
+
+	#if WANT_SMOOTH
+	untex->tid = -1;
+	bld->mesh = create_growable_mesh();
+	bld->tex_count = 0;
+	bld->poly_count = 0;
+	bld->hashing = LDrawMeshCacheGetDirectory() != NULL;
+	if(bld->hashing)
+		LDrawMeshCacheHasherInit(&bld->hasher, LDrawMeshCacheRemovedTJunctions | LDrawMeshCacheOptimizedVertexCache);
+	bld->prepared = 0;
+	bld->detail_indices = NULL;
+	bld->detail_total = 0;
+	#endif
 	
 	return bld;
 
 }//end LDrawDLBuilderCreate
 
 
+#if WANT_SMOOTH
+//========== add_builder_face ====================================================
+//
+// Purpose:	Hand one primitive in the current texture to the mesh smoother and
+//			the mesh cache's key.
+//
+//================================================================================
+static void add_builder_face(struct LDrawDLBuilder * ctx, const float * p1, const float * p2, const float * p3, const float * p4, const float c[4])
+{
+	if(ctx->cur->tid < 0)
+		ctx->cur->tid = ctx->tex_count++;
+
+	add_face(ctx->mesh, p1, p2, p3, p4, c, ctx->cur->tid);
+	if(ctx->hashing)
+		LDrawMeshCacheHasherAddFace(&ctx->hasher, p1, p2, p3, p4, c, ctx->cur->tid);
+
+}//end add_builder_face
+
+
+//========== pack_cond_lines =====================================================
+//
+// Purpose:	Keep only the two ends of each conditional line, in place.  Returns
+//			the new index count.
+//
+//================================================================================
+static int pack_cond_lines(volatile uint32_t * indices, int count)
+{
+	volatile uint32_t * in_ptr = indices;
+	volatile uint32_t * out_ptr = indices;
+	for (int i = 0; i < count; i += 4) {
+		*out_ptr++ = *in_ptr++;
+		*out_ptr++ = *in_ptr++;
+		in_ptr++;
+		in_ptr++;
+	}
+	return count / 2;
+
+}//end pack_cond_lines
+
+
+#if COMPACT_VERTICES
+//========== LDrawDLSimplifyDetails ==============================================
+//
+// Purpose:	Simplify a DL's one untextured mesh for each lower detail level, to
+//			within half a pixel at the level's screen size.  Returns a malloc'd
+//			block holding the levels' indices back to back, conditional lines
+//			already packed, or NULL if no level was worth keeping.
+//
+// Notes:	Each level must drop enough of the next finer level's triangles to
+//			pay for its indices; a level's range has a start of -1 if not.
+//
+//			Every range starts on an even index, and the total is even, so that
+//			16-bit indices keep the buffer offsets 4-byte aligned.
+//
+//================================================================================
+static uint32_t * LDrawDLSimplifyDetails(const float *					vertices,
+										 int							vertex_count,
+										 const volatile uint32_t *		indices,
+										 const struct compact_bounds *	bounds,
+										 int							line_start,
+										 int							line_count,
+										 int							cond_line_start,
+										 int							cond_line_count,
+										 int							tri_start,
+										 int							tri_count,
+										 struct LDrawDLDetailRange		out_ranges[detail_count],
+										 int *							out_total)
+{
+	static const float	pixels[detail_count] = { 0.0f, LDrawDetailLowPixels, LDrawDetailLowestPixels };
+	float				extent = MAX(bounds->scale[0], MAX(bounds->scale[1], bounds->scale[2]));
+	int					finer_tris = tri_count;
+	int					capacity = get_simplified_index_capacity(line_count, cond_line_count, tri_count, 0) + 1;
+	uint32_t *			block = NULL;
+	int					total = 0;
+
+	for(int d = 0; d < detail_count; ++d)
+		out_ranges[d].start = -1;
+	*out_total = 0;
+
+	if(finer_tris / 3 < DETAIL_MIN_TRIS)
+		return NULL;
+
+	block = (uint32_t *) malloc(sizeof(uint32_t) * capacity * (detail_count - 1));
+	for(int d = detail_low; d < detail_count; ++d)
+	{
+		uint32_t *	level = block + total;
+		int			lines, cond_lines, tris;
+
+		simplify_indexed_mesh(vertices, vertex_count, indices,
+							  line_start, line_count,
+							  cond_line_start, cond_line_count,
+							  tri_start, tri_count,
+							  0, 0,
+							  extent * 0.5f / pixels[d],
+							  level, &lines, &cond_lines, &tris);
+
+		if(tris > finer_tris * DETAIL_MAX_RATIO)
+			continue;
+
+		// Pack the conditional lines as the full mesh's are, and close the gap
+		// that leaves before the triangles.
+		int packed = pack_cond_lines(level + lines, cond_lines);
+		memmove(level + lines + packed, level + lines + cond_lines, sizeof(uint32_t) * tris);
+
+		out_ranges[d].start = total;
+		out_ranges[d].line_count = lines;
+		out_ranges[d].cond_line_count = packed;
+		out_ranges[d].tri_count = tris;
+		total += lines + packed + tris;
+		total += total & 1;
+		finer_tris = tris;
+	}
+
+	if(total == 0)
+	{
+		free(block);
+		return NULL;
+	}
+	*out_total = total;
+	return block;
+
+}//end LDrawDLSimplifyDetails
+
+
+//========== LDrawDLCreateDetail =================================================
+//
+// Purpose:	Make the DL for one detail level of owner: it shares owner's
+//			buffers and draws range, which starts at index off.
+//
+//================================================================================
+static struct LDrawDL * LDrawDLCreateDetail(struct LDrawDL * owner, uint32_t off, const struct LDrawDLDetailRange * range)
+{
+	struct LDrawDL * dl = (struct LDrawDL *) calloc(1, sizeof(struct LDrawDL) + sizeof(struct LDrawDLPerTex));
+
+	dl->flags			= owner->flags;
+	dl->vertexBuffer	= owner->vertexBuffer;
+	dl->vertexDecode	= owner->vertexDecode;
+	dl->indexBuffer		= owner->indexBuffer;
+	dl->indexType		= owner->indexType;
+	dl->indexSize		= owner->indexSize;
+	dl->owner			= owner;
+	dl->tex_count		= 1;
+	#if WANT_STATS
+	dl->vrt_count		= owner->vrt_count;
+	dl->idx_count		= range->line_count + range->cond_line_count + range->tri_count;
+	#endif
+
+	struct LDrawDLPerTex * tex = dl->texes;
+	memcpy((void*)&tex->spec, (void*)&owner->texes[0].spec, sizeof(struct LDrawTextureSpec));
+	tex->line_off			= off;
+	tex->line_count			= range->line_count;
+	tex->cond_line_off		= off + range->line_count;
+	tex->cond_line_count	= range->cond_line_count;
+	tex->tri_off			= off + range->line_count + range->cond_line_count;
+	tex->tri_count			= range->tri_count;
+
+	return dl;
+
+}//end LDrawDLCreateDetail
+#endif
+#endif
+
+
+//========== LDrawDLBuilderGetFaceCount ==========================================
+//
+// Purpose:	Return how many tris and quads a builder has collected - a guide to
+//			how long finishing it will take.
+//
+//================================================================================
+int LDrawDLBuilderGetFaceCount(struct LDrawDLBuilder * ctx)
+{
+#if WANT_SMOOTH
+	return ctx->poly_count;
+#else
+	return 0;
+#endif
+}//end LDrawDLBuilderGetFaceCount
+
+
+//========== LDrawDLBuilderPrepare ===============================================
+//
+// Purpose:	Do all of the CPU work of finishing a DL ahead of time: smooth the
+//			mesh (or fetch it from the mesh cache), then work out its compact
+//			format and detail levels.
+//
+// Notes:	This touches no Metal objects, so it may run on any thread - but
+//			nothing else may use the builder while it does.
+//			LDrawDLBuilderFinish calls it itself if no one has, and is then
+//			left with packing and narrowing indices in the staging buffer, and
+//			the upload.
+//
+//================================================================================
+void LDrawDLBuilderPrepare(struct LDrawDLBuilder * ctx)
+{
+#if WANT_SMOOTH
+	if(ctx->prepared || ctx->tex_count == 0)
+		return;
+
+	LDrawDLBakeInit(&ctx->bake, ctx->mesh, ctx->tex_count, ctx->poly_count, ctx->hashing ? &ctx->hasher : NULL);
+	ctx->mesh = NULL;
+	ctx->prepared = 1;
+
+	LDrawDLBakeRun(&ctx->bake);
+
+	#if COMPACT_VERTICES
+	const LDrawDLBake * bake = &ctx->bake;
+	struct LDrawDLBuilderPerTex * s;
+
+	get_compact_bounds(bake->vertices, bake->vertexCount, &ctx->bounds);
+
+	// A DL that is one untextured mesh gets simpler copies of it to draw when
+	// it is small on screen.  They are simplified before the conditional lines
+	// are packed, and their indices go after the mesh's own.
+	if(ctx->tex_count == 1)
+	{
+		for(s = ctx->head; s && s->tid < 0; s = s->next)
+			;
+		if(s && s->spec.tex_obj == nil)
+			ctx->detail_indices = LDrawDLSimplifyDetails(bake->vertices, bake->vertexCount, bake->indices, &ctx->bounds,
+														 bake->lineStarts[0], bake->lineCounts[0],
+														 bake->conditionalLineStarts[0], bake->conditionalLineCounts[0],
+														 bake->triangleStarts[0], bake->triangleCounts[0],
+														 ctx->detail_ranges, &ctx->detail_total);
+	}
+	#endif
+#endif
+}//end LDrawDLBuilderPrepare
+
+
+//========== LDrawDLBuilderDestroy ===============================================
+//
+// Purpose:	Throw a builder away without making a DL of it.  Like
+//			LDrawDLBuilderPrepare, this is safe on any thread.
+//
+//================================================================================
+void LDrawDLBuilderDestroy(struct LDrawDLBuilder * ctx)
+{
+#if WANT_SMOOTH
+	if(ctx->prepared)
+		LDrawDLBakeRelease(&ctx->bake);
+	if(ctx->mesh)
+		destroy_mesh(ctx->mesh);
+	free(ctx->detail_indices);
+#endif
+	LDrawBDPDestroy(ctx->alloc);
+
+}//end LDrawDLBuilderDestroy
+
+
 //========== LDrawDLBuilderFinish ================================================
 //
 // Purpose:	Take all of the accumulated data in a DL and bake it down to one
 //			final form.
 //
-// Notes:	The DL is, while being built, a series of linked lists in a BDP for
-//			speed. The finished DL is a malloc'd block of memory, pre-sized to
-//			fit the DL perfectly, and one buffer. So this routine does the counting,
-//			final allocations, and copying.
+// Notes:	The DL is, while being built, a growable mesh (or, without smoothing, a
+//			series of linked lists in a BDP) for speed. The finished DL is a
+//			malloc'd block of memory, pre-sized to fit the DL perfectly, and one
+//			buffer. So this routine does the smoothing (or counting), final
+//			allocations, and copying.
+//
+//			When smoothing, LDrawDLBuilderPrepare may already have done the
+//			slow part on another thread.
 //
 //================================================================================
 struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
@@ -670,46 +1003,27 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
 	#endif
 
-	int total_texes = 0;
-	int total_tris = 0;
-	int total_quads = 0;
-	int total_lines = 0;
-	int total_cond_lines = 0;
-
+	// Every non-empty texture got a texture ID with its first face.
+	int total_texes = ctx->tex_count;
 
-	struct LDrawDLBuilderVertexLink * l;
 	struct LDrawDLBuilderPerTex * s;
 
-	// Count up the total vertices we will need, for buffer space, as well
-	// as the total distinct non-empty textures.
-	for(s = ctx->head; s; s = s->next)
-	{
-		if(s->tri_head || s->line_head || s->cond_line_head)
-			++total_texes;
-
-		for(l = s->tri_head; l; l = l->next)
-		{
-			total_tris++;
-		}
-		for(l = s->line_head; l; l = l->next)
-		{
-			total_lines++;
-		}
-		for(l = s->cond_line_head; l; l = l->next)
-		{
-			total_cond_lines++;
-		}
-	}
-
 	// No non-empty textures?  Bail out early - nuke our
 	// context and get out.  Client code knows we get NO DL, rather than
 	// an empty one.
 	if(total_texes == 0)
 	{
-		LDrawBDPDestroy(ctx->alloc);
+		LDrawDLBuilderDestroy(ctx);
 		return NULL;
 	}
 
+	// Smoothing is the slow part; it is done here unless it was done ahead.
+	LDrawDLBuilderPrepare(ctx);
+
+	const LDrawDLBake * bake = &ctx->bake;
+	int total_vertices = bake->vertexCount;
+	int total_indices = bake->indexCount;
+
 	// Alloc DL structure with extra storage for variable-sized tex array.
 	// Use calloc to prevent undefined values and EXC_BAD_ACCESS issue.
 	struct LDrawDL * dl = (struct LDrawDL *) calloc(1, sizeof(struct LDrawDL) + sizeof(struct LDrawDLPerTex) * total_texes);
@@ -720,84 +1034,44 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	dl->instance_tail = NULL;
 	dl->instance_count = 0;
 
+	// Detail levels, if any, are added once the mesh is written.
+	dl->owner = NULL;
+	memset(dl->details, 0, sizeof(dl->details));
+
 	dl->tex_count = total_texes;
 
 	struct LDrawDLPerTex * cur_tex = dl->texes;
 	dl->flags = ctx->flags;
 
-	// We use one mesh for the entire DL, even if it has multiple textures.  We have to
-	// do this because we want smoothing across triangles that do not share the same
-	// texture.  (Key use case: minifig faces are part textured, part untextured.)
-	//
-	// So instead each face gets a texture ID (tid), which is an index that we will tie
-	// to our texture list.  The mesh smoother remembers this and dumps out the tris in
-	// tid order later.
-
-	struct Mesh * M = create_mesh(total_tris, total_quads, total_lines, total_cond_lines);
-
-
-	// Now: walk our building textures - for each non-empty one, we will copy it into
-	// the tex array and push its vertices.
-	int ti = 0;
-	for(s = ctx->head; s; s = s->next)
-	{
-		if(s->tri_head == NULL && s->line_head == NULL && s->cond_line_head == NULL)
-			continue;
-
-		if(s->spec.tex_obj != nil)
-			dl->flags |= dl_has_tex;
-
-		for(l = s->tri_head; l; l = l->next)
-		{
-			add_face(M,
-				l->data, l->data+10,l->data+20,NULL,
-				l->data+6,ti);
-		}
-
-		++ti;
-	}
-
-	ti = 0;
-	for(s = ctx->head; s; s = s->next)
-	{
-		if(s->tri_head == NULL && s->line_head == NULL && s->cond_line_head == NULL)
-			continue;
-
-		if(s->spec.tex_obj != nil)
-			dl->flags |= dl_has_tex;
-
-		for(l = s->line_head; l; l = l->next)
-		{
-			add_face(M,l->data,l->data+10,NULL,NULL,l->data+6,ti);
-		}
-
-		for(l = s->cond_line_head; l; l = l->next)
-		{
-			add_face(M,l->data,l->data+10,l->data+20,l->data+30,l->data+6,ti);
-		}
-
-		++ti;
-	}
-
-
-	finish_faces_and_sort(M);
-	add_creases(M);
-	find_and_remove_t_junctions(M);
-	finish_creases_and_join(M);
-	smooth_vertices(M);
-	merge_vertices(M);
-
-	int total_vertices, total_indices;
-	get_final_mesh_counts(M,&total_vertices,&total_indices);
-
 	id<MTLDevice> device = MetalGPU.device;
 
+	// The ranges are packed below, so they get copied out of the bake.
+	int * line_start		= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
+	int * line_count		= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
+	int * cond_line_start	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
+	int * cond_line_count	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
+	int * tri_start			= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
+	int * tri_count			= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
+
+	memcpy(line_start,		bake->lineStarts,				sizeof(int) * total_texes);
+	memcpy(line_count,		bake->lineCounts,				sizeof(int) * total_texes);
+	memcpy(cond_line_start,	bake->conditionalLineStarts,	sizeof(int) * total_texes);
+	memcpy(cond_line_count,	bake->conditionalLineCounts,	sizeof(int) * total_texes);
+	memcpy(tri_start,		bake->triangleStarts,			sizeof(int) * total_texes);
+	memcpy(tri_count,		bake->triangleCounts,			sizeof(int) * total_texes);
+
 	// PERFORMANCE OPTIMIZATION: Use private storage for GPU buffers with staging buffers for CPU writes
 	// This eliminates CPU-GPU synchronization overhead and improves cache performance.
 
-	// Create staging buffers (shared) for CPU writes
+	// Create staging buffers (shared) for CPU writes.  The index staging buffer
+	// always holds 32-bit indices; they are narrowed in place once the
+	// conditional lines are packed.
 
+#if COMPACT_VERTICES
+	NSUInteger vertexBufferSize	= total_vertices * sizeof(struct compact_vertex);
+#else
 	NSUInteger vertexBufferSize	= total_vertices * sizeof(float) * VERT_STRIDE;
+#endif
 	NSUInteger indexBufferSize	= total_indices * sizeof(uint32_t);
 
 	id<MTLBuffer> stagingVertexBuffer = [device newBufferWithLength:vertexBufferSize
@@ -809,66 +1083,70 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	stagingIndexBuffer.label = @"Staging index buffer";
 
 
+	// Write data to staging buffers
+
+	volatile uint32_t	*index_ptr	= (volatile uint32_t *)[stagingIndexBuffer contents];
+	memcpy((void *) index_ptr, bake->indices, indexBufferSize);
+
+	uint32_t *			detail_indices = NULL;
+	int					detail_total = 0;
+
+#if COMPACT_VERTICES
+	write_compact_vertices(bake->vertices, total_vertices, &ctx->bounds,
+						   (volatile struct compact_vertex *)[stagingVertexBuffer contents]);
+	dl->vertexDecode.offset	= simd_make_float4(ctx->bounds.offset[0], ctx->bounds.offset[1], ctx->bounds.offset[2], 0.0f);
+	dl->vertexDecode.scale	= simd_make_float4(ctx->bounds.scale[0], ctx->bounds.scale[1], ctx->bounds.scale[2], 1.0f);
+
+	detail_indices = ctx->detail_indices;
+	detail_total = ctx->detail_total;
+#else
+	memcpy([stagingVertexBuffer contents], bake->vertices, vertexBufferSize);
+#endif
+
+	if (*cond_line_count > 0)
+		*cond_line_count = pack_cond_lines(index_ptr + *cond_line_start, *cond_line_count);
+
+	// 16-bit indices when every vertex can be numbered in 16 bits.  Index
+	// buffer offsets must stay 4-byte aligned, though, so a mesh with a range
+	// starting on an odd index keeps 32-bit indices.
+	int index_size = get_compact_index_size(total_vertices);
+	for(int ti = 0; ti < total_texes && index_size == 2; ++ti)
+	{
+		if((line_start[ti] | cond_line_start[ti] | tri_start[ti]) & 1)
+			index_size = 4;
+	}
+	write_compact_indices(index_ptr, total_indices, index_size, index_ptr);
+
+	dl->indexType = (index_size == 2) ? MTLIndexTypeUInt16 : MTLIndexTypeUInt32;
+	dl->indexSize = index_size;
+	indexBufferSize = total_indices * index_size;
+
+	// The detail levels' indices start on the next even index after the mesh's.
+	int detail_base = (total_indices + 1) & ~1;
+	id<MTLBuffer> stagingDetailBuffer = nil;
+	if(detail_indices)
+	{
+		write_compact_indices(detail_indices, detail_total, index_size, detail_indices);
+		stagingDetailBuffer = [device newBufferWithBytes:detail_indices
+												  length:detail_total * index_size
+												 options:MTLResourceStorageModeShared];
+		stagingDetailBuffer.label = @"Staging detail index buffer";
+	}
+
+
 	// Create GPU buffers (private) for optimal GPU access
 
 	id<MTLBuffer> vertexBuffer = [device newBufferWithLength:vertexBufferSize
 													 options:MTLResourceStorageModePrivate];
 	vertexBuffer.label = @"Vertex buffer";
 	
-	id<MTLBuffer> indexBuffer = [device newBufferWithLength:indexBufferSize
+	id<MTLBuffer> indexBuffer = [device newBufferWithLength:(detail_indices ? (detail_base + detail_total) * index_size : indexBufferSize)
 													options:MTLResourceStorageModePrivate];
 	indexBuffer.label = @"Index buffer";
 	
 	dl->vertexBuffer = vertexBuffer;
 	dl->indexBuffer = indexBuffer;
 
-
-	// Write data to staging buffers
-
-	volatile float		*vertex_ptr	= (volatile float *)[stagingVertexBuffer contents];
-	volatile uint32_t	*index_ptr	= (volatile uint32_t *)[stagingIndexBuffer contents];
-
-
-	// Grab variable size arrays for the start/offsets of each sub-part of our big pile-o-mesh...
-	// the mesher will give us back our tris sorted by texture.
-
-	int * line_start	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * line_count	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * cond_line_start = (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * cond_line_count = (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * tri_start		= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * tri_count		= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * quad_start	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * quad_count	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-
-	write_indexed_mesh(
-		M,
-		total_vertices,
-		vertex_ptr,
-		total_indices,
-		index_ptr,
-		0,
-		line_start,
-		line_count,
-		cond_line_start,
-		cond_line_count,
-		tri_start,
-		tri_count,
-		quad_start,
-		quad_count);
-
-	if (*cond_line_count > 0) {
-		volatile uint32_t * in_ptr = index_ptr + *cond_line_start;
-		volatile uint32_t * out_ptr = in_ptr;
-		for (int i = 0; i < *cond_line_count; i += 4) {
-			*out_ptr++ = *in_ptr++;
-			*out_ptr++ = *in_ptr++;
-			in_ptr++;
-			in_ptr++;
-		}
-		*cond_line_count /= 2;
-	}
-
 	// PERFORMANCE OPTIMIZATION: Copy data from staging buffers to GPU buffers using blit encoder
 	// This ensures data is in GPU-optimal memory (private storage) for fast access.
 	// Reuse existing blit command queue instead of creating a new one each time.
@@ -897,19 +1175,32 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 			  destinationOffset:0
 						   size:indexBufferSize];
 
+	if(stagingDetailBuffer)
+	{
+		[blitEncoder copyFromBuffer:stagingDetailBuffer
+					   sourceOffset:0
+						   toBuffer:indexBuffer
+				  destinationOffset:detail_base * index_size
+							   size:detail_total * index_size];
+	}
+
 	[blitEncoder endEncoding];
 	[copyCommandBuffer commit];
 	[copyCommandBuffer waitUntilCompleted];
 	
 	// Staging buffers will be released when they go out of scope
 
-	ti = 0;
-
+	// Texture IDs went out in the order faces arrived; the DL keeps its textures
+	// in the order they were set up, as it always has.
 	for(s = ctx->head; s; s = s->next)
 	{
-		if(s->tri_head == NULL && s->line_head == NULL && s->cond_line_head == NULL)
+		int ti = s->tid;
+		if(ti < 0)
 			continue;
 
+		if(s->spec.tex_obj != nil)
+			dl->flags |= dl_has_tex;
+
 		memcpy((void*)&cur_tex->spec, (void*)&s->spec, sizeof(struct LDrawTextureSpec));
 
 		cur_tex->line_off			= line_start[ti];
@@ -919,19 +1210,27 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 		cur_tex->cond_line_count	= cond_line_count[ti];
 		cur_tex->tri_count			= tri_count[ti];
 
-		++ti;
 		++cur_tex;
 	}
 
-	destroy_mesh(M);
-
 	#if WANT_STATS
 	dl->vrt_count = total_vertices;
 	dl->idx_count = total_indices;
 	#endif
 
-	// Release the BDP that contains all of the build-related junk.
-	LDrawBDPDestroy(ctx->alloc);
+#if COMPACT_VERTICES
+	if(detail_indices)
+	{
+		for(int d = detail_low; d < detail_count; ++d)
+		{
+			if(ctx->detail_ranges[d].start >= 0)
+				dl->details[d] = LDrawDLCreateDetail(dl, detail_base + ctx->detail_ranges[d].start, &ctx->detail_ranges[d]);
+		}
+	}
+#endif
+
+	// Release the baked tables and the BDP that contains all of the build-related junk.
+	LDrawDLBuilderDestroy(ctx);
 
 	#if TIME_SMOOTHING
 	NSTimeInterval endTime = [NSDate timeIntervalSinceReferenceDate];
@@ -980,6 +1279,10 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	dl->instance_tail = NULL;
 	dl->instance_count = 0;
 
+	// Detail levels need indices, so unsmoothed DLs have none.
+	dl->owner = NULL;
+	memset(dl->details, 0, sizeof(dl->details));
+
 	dl->tex_count = total_texes;
 
 	#if WANT_STATS
@@ -990,7 +1293,11 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	// PERFORMANCE OPTIMIZATION: Use private storage for GPU buffers with staging buffers for CPU writes
 
 	id<MTLDevice> device		= MetalGPU.device;
+#if COMPACT_VERTICES
+	NSUInteger vertexBufferSize	= total_vertices * sizeof(struct compact_vertex);
+#else
 	NSUInteger vertexBufferSize	= total_vertices * sizeof(float) * VERT_STRIDE;
+#endif
 
 	// Create staging buffer (shared) for CPU writes
 	id<MTLBuffer> stagingVertexBuffer = [device newBufferWithLength:vertexBufferSize
@@ -1004,9 +1311,15 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	
 	dl->vertexBuffer = vertexBuffer;
 
-	// Write data to staging buffer
+	// Write data to staging buffer - or, for compact vertices, gather the
+	// floats first and quantize them once we know their bounds.
 
+#if COMPACT_VERTICES
+	float * vertices = (float *) malloc(total_vertices * sizeof(float) * VERT_STRIDE);
+	volatile float * buf_ptr = vertices;
+#else
 	volatile float * buf_ptr = (volatile float *)[stagingVertexBuffer contents];
+#endif
 
 	int cur_v = 0;
 	struct LDrawDLPerTex * cur_tex = dl->texes;
@@ -1048,6 +1361,16 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 		++cur_tex;
 	}
 
+#if COMPACT_VERTICES
+	struct compact_bounds bounds;
+	get_compact_bounds(vertices, total_vertices, &bounds);
+	write_compact_vertices(vertices, total_vertices, &bounds,
+						   (volatile struct compact_vertex *)[stagingVertexBuffer contents]);
+	dl->vertexDecode.offset	= simd_make_float4(bounds.offset[0], bounds.offset[1], bounds.offset[2], 0.0f);
+	dl->vertexDecode.scale	= simd_make_float4(bounds.scale[0], bounds.scale[1], bounds.scale[2], 1.0f);
+	free(vertices);
+#endif
+
 	// PERFORMANCE OPTIMIZATION: Copy data from staging buffer to GPU buffer using blit encoder
 	// This ensures data is in GPU-optimal memory (private storage) for fast access.
 	// Reuse existing blit command queue instead of creating a new one each time.
@@ -1085,14 +1408,42 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 
 
 
+//========== LDrawDLGetDetail ====================================================
+//
+// Purpose:	The DL to draw dl with at a detail level: the level's own DL, or
+//			the next finer one that dl has.
+//
+//================================================================================
+struct LDrawDL * LDrawDLGetDetail(struct LDrawDL * dl, int detail)
+{
+	for(; detail > detail_full; --detail)
+	{
+		if(dl->details[detail])
+			return dl->details[detail];
+	}
+	return dl;
+
+}//end LDrawDLGetDetail
+
+
 //========== LDrawDLDestroy ======================================================
 //
 // Purpose: free a display list - release GL and system memory.
 //
+// Notes:	A DL goes together with its detail levels, which share its buffers -
+//			so none of them goes until a session is done with all of them.
+//
 //================================================================================
 void LDrawDLDestroy(struct LDrawDL * dl)
 {
-	if(dl->instance_head != NULL)
+	if(dl->owner)
+		dl = dl->owner;
+
+	BOOL in_use = (dl->instance_head != NULL);
+	for(int d = detail_low; d < detail_count; ++d)
+		in_use = in_use || (dl->details[d] && dl->details[d]->instance_head != NULL);
+
+	if(in_use)
 	{
 		// Special case: if our DL is destroyed WHILE a session is using it for
 		// deferred drawing, we do NOT destroy it - we mark it for destruction
@@ -1101,6 +1452,11 @@ void LDrawDLDestroy(struct LDrawDL * dl)
 		// a silly way to get 'immediate' drawing.  In this case, the session
 		// may have intentionally deferred the DL.
 		dl->flags |= dl_needs_destroy;
+		for(int d = detail_low; d < detail_count; ++d)
+		{
+			if(dl->details[d])
+				dl->details[d]->flags |= dl_needs_destroy;
+		}
 		return;
 	}
 	// Make sure that no instances from a session are queued to this list; if we
@@ -1109,6 +1465,9 @@ void LDrawDLDestroy(struct LDrawDL * dl)
 	// reason inval a DL mid-draw, which is usually a sign of coding error.
 	assert(dl->instance_head == NULL);
 
+	for(int d = detail_low; d < detail_count; ++d)
+		free(dl->details[d]);
+
 	free(dl);
 
 }//end LDrawDLDestroy
@@ -1141,6 +1500,9 @@ void LDrawDLBuilderSetTex(struct LDrawDLBuilder * ctx, struct LDrawTextureSpec *
 		struct LDrawDLBuilderPerTex * new_tex = (struct LDrawDLBuilderPerTex *) LDrawBDPAllocate(ctx->alloc,sizeof(struct LDrawDLBuilderPerTex));
 		memset((void*)new_tex, 0, sizeof(struct LDrawDLBuilderPerTex));
 		memcpy((void*)&new_tex->spec, (void*)spec, sizeof(struct LDrawTextureSpec));
+		#if WANT_SMOOTH
+		new_tex->tid = -1;
+		#endif
 		prev->next = new_tex;
 		ctx->cur = new_tex;
 	}
@@ -1155,7 +1517,8 @@ void LDrawDLBuilderSetTex(struct LDrawDLBuilder * ctx, struct LDrawTextureSpec *
 // Notes:	This routine 'sniffs' the alpha as it goes by and keeps the DL flags
 //			correct - this is how a DL "knows" if it is translucent.
 //
-//			We accumulate the tri by allocating a 3-vertex DL link and queueing it
+//			When smoothing, the tri goes straight into the mesh.  Otherwise we
+//			accumulate the tri by allocating a 3-vertex DL link and queueing it
 //			onto the triangle list for the current texture.
 //
 //================================================================================
@@ -1164,6 +1527,13 @@ void LDrawDLBuilderAddTri(struct LDrawDLBuilder * ctx, const float v[9], float n
 	// Alpha = 0 means meta color.  0 < Alpha < 1 means translucency.	
 		 if(c[3] == 0.0f)	ctx->flags |= dl_has_meta;
 	else if(c[3] != 1.0f)	ctx->flags |= dl_has_alpha;
+
+	#if WANT_SMOOTH
+
+	add_builder_face(ctx, v, v+3, v+6, NULL, c);
+	++ctx->poly_count;
+
+	#else
 	
 	int i;
 	struct LDrawDLBuilderVertexLink * nl = (struct LDrawDLBuilderVertexLink *) LDrawBDPAllocate(ctx->alloc, sizeof(struct LDrawDLBuilderVertexLink) + sizeof(float) * VERT_STRIDE * 3);
@@ -1187,6 +1557,7 @@ void LDrawDLBuilderAddTri(struct LDrawDLBuilder * ctx, const float v[9], float n
 		ctx->cur->tri_tail = nl;
 	}
 
+	#endif
 }//end LDrawDLBuilderAddTri
 
 
@@ -1202,6 +1573,14 @@ void LDrawDLBuilderAddQuad(struct LDrawDLBuilder * ctx, const float v[12], float
 
 	// Convert quad to triangles
 
+	#if WANT_SMOOTH
+
+	add_builder_face(ctx, v, v+3, v+6, NULL, c);
+	add_builder_face(ctx, v, v+6, v+9, NULL, c);
+	ctx->poly_count += 2;
+
+	#else
+
 	int i;
 	struct LDrawDLBuilderVertexLink * nl = (struct LDrawDLBuilderVertexLink *) LDrawBDPAllocate(ctx->alloc, sizeof(struct LDrawDLBuilderVertexLink) + sizeof(float) * VERT_STRIDE * 3);
 	nl->next = NULL;
@@ -1249,6 +1628,7 @@ void LDrawDLBuilderAddQuad(struct LDrawDLBuilder * ctx, const float v[12], float
 		ctx->cur->tri_tail = nl;
 	}
 
+	#endif
 }//end LDrawDLBuilderAddQuad
 
 
@@ -1262,6 +1642,12 @@ void LDrawDLBuilderAddLine(struct LDrawDLBuilder * ctx, const float v[6], float
 		 if(c[3] == 0.0f)	ctx->flags |= dl_has_meta;
 	else if(c[3] != 1.0f)	ctx->flags |= dl_has_alpha;
 
+	#if WANT_SMOOTH
+
+	add_builder_face(ctx, v, v+3, NULL, NULL, c);
+
+	#else
+
 	int i;
 	struct LDrawDLBuilderVertexLink * nl = (struct LDrawDLBuilderVertexLink *) LDrawBDPAllocate(ctx->alloc, sizeof(struct LDrawDLBuilderVertexLink) + sizeof(float) * VERT_STRIDE * 2);
 	nl->next = NULL;
@@ -1283,7 +1669,8 @@ void LDrawDLBuilderAddLine(struct LDrawDLBuilder * ctx, const float v[6], float
 		ctx->cur->line_head = nl;
 		ctx->cur->line_tail = nl;
 	}
-	
+
+	#endif
 }//end LDrawDLBuilderAddLine
 
 
@@ -1297,6 +1684,12 @@ void LDrawDLBuilderAddCondLine(struct LDrawDLBuilder * ctx, const float v[12], f
 		 if(c[3] == 0.0f)	ctx->flags |= dl_has_meta;
 	else if(c[3] != 1.0f)	ctx->flags |= dl_has_alpha;
 
+	#if WANT_SMOOTH
+
+	add_builder_face(ctx, v, v+3, v+6, v+9, c);
+
+	#else
+
 	int i;
 	struct LDrawDLBuilderVertexLink * nl = (struct LDrawDLBuilderVertexLink *) LDrawBDPAllocate(ctx->alloc, sizeof(struct LDrawDLBuilderVertexLink) + sizeof(float) * VERT_STRIDE * 4);
 	nl->next = NULL;
@@ -1318,7 +1711,8 @@ void LDrawDLBuilderAddCondLine(struct LDrawDLBuilder * ctx, const float v[12], f
 		ctx->cur->cond_line_head = nl;
 		ctx->cur->cond_line_tail = nl;
 	}
-	
+
+	#endif
 }//end LDrawDLBuilderAddCondLine
 
 
@@ -1339,8 +1733,10 @@ struct LDrawDLSession * LDrawDLSessionCreate(const float model_view[16])
 	session->dl_head = NULL;
 	session->dl_count = 0;
 	session->total_instance_count = 0;
-	session->sorted_head = NULL;
+	session->sorted = NULL;
+	session->sort_keys = NULL;
 	session->sort_count = 0;
+	session->sort_capacity = 0;
 	#if WANT_STATS
 	memset(&session->stats,0,sizeof(session->stats));
 	#endif
@@ -1424,6 +1820,9 @@ void LDrawDLSessionDrawAndDestroy(id<MTLRenderCommandEncoder> renderEncoder, str
 			
 				// Immediate mode instancing - we draw now!  So bind up the mesh of this DL.
 				[renderEncoder setVertexBuffer:dl->vertexBuffer offset:0 atIndex:BufferIndexInstanceInvariantData];
+				#if COMPACT_VERTICES
+				[renderEncoder setVertexBytes:&dl->vertexDecode length:sizeof(struct VertexDecode) atIndex:BufferIndexVertexDecode];
+				#endif
 
 				// Now walk the instance list...push instance data as set of bytes (which is faster than setting a real buffer) and draw.
 				for(inst = dl->instance_head; inst; inst = inst->next)
@@ -1448,16 +1847,16 @@ void LDrawDLSessionDrawAndDestroy(id<MTLRenderCommandEncoder> renderEncoder, str
 					if(tptr->line_count)
 						[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeLine
 												  indexCount:tptr->line_count
-												   indexType:MTLIndexTypeUInt32
+												   indexType:dl->indexType
 												 indexBuffer:dl->indexBuffer
-										   indexBufferOffset:tptr->line_off * sizeof(uint32_t)];
+										   indexBufferOffset:tptr->line_off * dl->indexSize];
 
 					if(tptr->tri_count)
 						[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
 												  indexCount:tptr->tri_count
-												   indexType:MTLIndexTypeUInt32
+												   indexType:dl->indexType
 												 indexBuffer:dl->indexBuffer
-										   indexBufferOffset:tptr->tri_off * sizeof(uint32_t)
+										   indexBufferOffset:tptr->tri_off * dl->indexSize
 										   instanceCount:1];
 					#else
 					if(tptr->line_count)
@@ -1533,31 +1932,34 @@ void LDrawDLSessionDrawAndDestroy(id<MTLRenderCommandEncoder> renderEncoder, str
 			for(s = segments; s < cur_segment; ++s)
 			{
 				[renderEncoder setVertexBuffer:s->vertexBuffer offset:0 atIndex:BufferIndexInstanceInvariantData];
+				#if COMPACT_VERTICES
+				[renderEncoder setVertexBytes:&s->vertexDecode length:sizeof(struct VertexDecode) atIndex:BufferIndexVertexDecode];
+				#endif
 				[renderEncoder setVertexBufferOffset:(NSUInteger)s->inst_base atIndex:BufferIndexPerInstanceData];
 
 				#if WANT_SMOOTH	
 				if(s->dl->line_count)
 					[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeLine
 											  indexCount:s->dl->line_count
-											   indexType:MTLIndexTypeUInt32
+											   indexType:s->indexType
 											 indexBuffer:s->indexBuffer
-									   indexBufferOffset:s->dl->line_off * sizeof(uint32_t)
+									   indexBufferOffset:s->dl->line_off * s->indexSize
 										   instanceCount:s->inst_count];
 
 				if(s->dl->cond_line_count && s->is_wireframe)
 					[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeLine
 											  indexCount:s->dl->cond_line_count
-											   indexType:MTLIndexTypeUInt32
+											   indexType:s->indexType
 											 indexBuffer:s->indexBuffer
-									   indexBufferOffset:s->dl->cond_line_off * sizeof(uint32_t)
+									   indexBufferOffset:s->dl->cond_line_off * s->indexSize
 										   instanceCount:s->inst_count];
 
 				if(s->dl->tri_count && !s->is_wireframe)
 					[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
 											  indexCount:s->dl->tri_count
-											   indexType:MTLIndexTypeUInt32
+											   indexType:s->indexType
 											 indexBuffer:s->indexBuffer
-									   indexBufferOffset:s->dl->tri_off * sizeof(uint32_t)
+									   indexBufferOffset:s->dl->tri_off * s->indexSize
 										   instanceCount:s->inst_count];
 				#else
 				if(s->dl->line_count)
@@ -1579,40 +1981,22 @@ void LDrawDLSessionDrawAndDestroy(id<MTLRenderCommandEncoder> renderEncoder, str
 	// MAIN LOOP 3: sorted deferred drawing (!)
 	// transparent parts
 
-	struct LDrawDLSortedInstanceLink * l;
-	if(session->sorted_head)
+	if(session->sort_count)
 	{
-		// If we have any sorting to do, allocate an array of the size of all sorted geometry for sorting purposes.
-		struct LDrawDLSortedInstanceLink * arr = (struct LDrawDLSortedInstanceLink *) LDrawBDPAllocate(session->alloc,sizeof(struct LDrawDLSortedInstanceLink) * session->sort_count);
-		struct LDrawDLSortedInstanceLink * p = arr;		
-		
-		// Copy each sorted instance into our array.  "Eval" is the measurement of distance - calculate eye-space Z and use that.
-		for(l = session->sorted_head; l; l = l->next)
-		{
-			memcpy((void*)p, (void*)l, sizeof(struct LDrawDLSortedInstanceLink));
-
-			simd_float4x4 modelView = simd_matrix4x4_from_array(session->model_view);
-			simd_float4 v = simd_make_float4(l->transform[12],
-											 l->transform[13],
-											 l->transform[14], 1.0f);
-
-			simd_float4 v_eye = simd_mul(modelView, v);
-
-			p->eval = v_eye.z;
-			++p;
-		}
-		
-		// Now: sort our array ascending to get far to near in eye space.
-		qsort(arr,session->sort_count,sizeof(struct LDrawDLSortedInstanceLink),compare_sorted_link);
+		// Sort ascending to get far to near in eye space.  Instances at the same depth stay in the order
+		// they were drawn.
+		LDrawDepthSortEntry * scratch = (LDrawDepthSortEntry *) LDrawBDPAllocate(session->alloc,sizeof(LDrawDepthSortEntry) * session->sort_count);
+		LDrawDepthSort(session->sort_keys,scratch,session->sort_count);
 
 		struct InstanceInput instData;
 
 		// NOW we can walk our sorted array and draw each brick, 1x1.  This code is a rehash of the "draw now" 
 		// code in LDrawDLDraw and could be factored.
-		l = arr;
 		int lc;
 		for(lc = 0; lc < session->sort_count; ++lc)
 		{
+			const struct LDrawDLSortedInstance * l = session->sorted + session->sort_keys[lc].index;
+
 			instData.transform_x = simd_make_float4(l->transform[0], l->transform[4], l->transform[8],  l->transform[12]);
 			instData.transform_y = simd_make_float4(l->transform[1], l->transform[5], l->transform[9],  l->transform[13]);
 			instData.transform_z = simd_make_float4(l->transform[2], l->transform[6], l->transform[10], l->transform[14]);
@@ -1626,6 +2010,9 @@ void LDrawDLSessionDrawAndDestroy(id<MTLRenderCommandEncoder> renderEncoder, str
 
 			dl = l->dl;
 			[renderEncoder setVertexBuffer:dl->vertexBuffer offset:0 atIndex:BufferIndexInstanceInvariantData];
+			#if COMPACT_VERTICES
+			[renderEncoder setVertexBytes:&dl->vertexDecode length:sizeof(struct VertexDecode) atIndex:BufferIndexVertexDecode];
+			#endif
 
 			struct LDrawDLPerTex * tptr = dl->texes;
 			
@@ -1643,17 +2030,17 @@ void LDrawDLSessionDrawAndDestroy(id<MTLRenderCommandEncoder> renderEncoder, str
 				if(tptr->line_count)
 					[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeLine
 											  indexCount:tptr->line_count
-											   indexType:MTLIndexTypeUInt32
+											   indexType:dl->indexType
 											 indexBuffer:dl->indexBuffer
-									   indexBufferOffset:tptr->line_off * sizeof(uint32_t)
+									   indexBufferOffset:tptr->line_off * dl->indexSize
 										   instanceCount:1];
 
 				if(tptr->tri_count)
 					[renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
 											  indexCount:tptr->tri_count
-											   indexType:MTLIndexTypeUInt32
+											   indexType:dl->indexType
 											 indexBuffer:dl->indexBuffer
-									   indexBufferOffset:tptr->tri_off * sizeof(uint32_t)
+									   indexBufferOffset:tptr->tri_off * dl->indexSize
 										   instanceCount:1];
 				#else
 				if(tptr->line_count)
@@ -1667,7 +2054,6 @@ void LDrawDLSessionDrawAndDestroy(id<MTLRenderCommandEncoder> renderEncoder, str
 									  vertexCount:tptr->tri_count];
 				#endif
 			}
-			++l;
 		}
 	}
 	
@@ -1686,6 +2072,8 @@ void LDrawDLSessionDrawAndDestroy(id<MTLRenderCommandEncoder> renderEncoder, str
 	// Finally done - all allocations for session (including our own obj) come from a BDP, so cleanup is quick.  
 	// Instance buffer remains to be reused.
 	// DLs themselves live on beyond session.
+	free(session->sorted);
+	free(session->sort_keys);
 	LDrawBDPDestroy(session->alloc);
 	
 }//end LDrawDLSessionDrawAndDestroy
@@ -28,6 +28,7 @@
 #include "MetalCommonDefinitions.h"
 
 #import "LDrawShaderRendererMTL.h"
+#import "MeshSmooth.h"
 #import "MetalGPU.h"
 #import "MetalUtilities.h"
 #import "SIMDConversions.h"
@@ -81,6 +82,21 @@ static NSUInteger					_currentUniformBufferIndex = 0;
 	// Set up vertex descriptor
 	MTLVertexDescriptor *vertexDescriptor = [MTLVertexDescriptor new];
 
+#if COMPACT_VERTICES
+	vertexDescriptor.attributes[VertexAttributePosition].format = MTLVertexFormatUShort4Normalized;
+	vertexDescriptor.attributes[VertexAttributePosition].offset = offsetof(struct compact_vertex, position);
+	vertexDescriptor.attributes[VertexAttributePosition].bufferIndex = BufferIndexInstanceInvariantData;
+
+	vertexDescriptor.attributes[VertexAttributeNormal].format = MTLVertexFormatShort2Normalized;
+	vertexDescriptor.attributes[VertexAttributeNormal].offset = offsetof(struct compact_vertex, normal);
+	vertexDescriptor.attributes[VertexAttributeNormal].bufferIndex = BufferIndexInstanceInvariantData;
+
+	vertexDescriptor.attributes[VertexAttributeColor].format = MTLVertexFormatUChar4Normalized;
+	vertexDescriptor.attributes[VertexAttributeColor].offset = offsetof(struct compact_vertex, color);
+	vertexDescriptor.attributes[VertexAttributeColor].bufferIndex = BufferIndexInstanceInvariantData;
+
+	vertexDescriptor.layouts[BufferIndexInstanceInvariantData].stride = sizeof(struct compact_vertex);
+#else
 	vertexDescriptor.attributes[VertexAttributePosition].format = MTLVertexFormatFloat3;
 	vertexDescriptor.attributes[VertexAttributePosition].offset = 0;
 	vertexDescriptor.attributes[VertexAttributePosition].bufferIndex = BufferIndexInstanceInvariantData;
@@ -94,6 +110,7 @@ static NSUInteger					_currentUniformBufferIndex = 0;
 	vertexDescriptor.attributes[VertexAttributeColor].bufferIndex = BufferIndexInstanceInvariantData;
 
 	vertexDescriptor.layouts[BufferIndexInstanceInvariantData].stride = VERT_STRIDE * sizeof(float);
+#endif
 	vertexDescriptor.layouts[BufferIndexInstanceInvariantData].stepRate = 1;
 	vertexDescriptor.layouts[BufferIndexInstanceInvariantData].stepFunction = MTLVertexStepFunctionPerVertex;
 
@@ -378,6 +395,7 @@ static NSUInteger					_currentUniformBufferIndex = 0;
 																	  scale:[self zoomPercentageForGL] / 100.
 																  modelView:[camera getModelView]
 																 projection:[camera getProjection]];
+	[ren setOcclusion:[self occlusionForFrame]];
 
 	[self->fileBeingDrawn drawSelf:ren];
 
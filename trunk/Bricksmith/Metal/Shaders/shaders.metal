@@ -14,11 +14,30 @@ using namespace metal;
 
 // Vertex shader
 
+#if COMPACT_VERTICES
+// Normalized by the vertex fetch; position.w is 0 for vertices without a normal.
+struct VertexInput {
+	float4	position	[[attribute(VertexAttributePosition)]];
+	float2	normal		[[attribute(VertexAttributeNormal)]];
+	float4	color		[[attribute(VertexAttributeColor)]];
+};
+
+// Octahedral normal decode - the inverse of write_compact_vertices.
+static float3 decode_normal(float2 oct)
+{
+	float3 n = float3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * select(float2(-1.0), float2(1.0), n.xy >= 0.0);
+	}
+	return normalize(n);
+}
+#else
 struct VertexInput {
 	float4	position	[[attribute(VertexAttributePosition)]];
 	float3	normal		[[attribute(VertexAttributeNormal)]];
 	float4	color		[[attribute(VertexAttributeColor)]];
 };
+#endif
 
 struct VertexOutput {
 	float4	position [[position]];
@@ -33,20 +52,31 @@ vertex VertexOutput vertexShader(VertexInput				in		[[stage_in]],
 								 device const InstanceInput	*inst	[[buffer(BufferIndexPerInstanceData)]],
 								 constant VertexUniform&	uni		[[buffer(BufferIndexVertexUniforms)]],
 								 constant TexturePlaneData&	texGen	[[buffer(BufferIndexTexturePlane)]],
+#if COMPACT_VERTICES
+								 constant VertexDecode&		decode	[[buffer(BufferIndexVertexDecode)]],
+#endif
 								 uint						iid		[[instance_id]])
 {
 	VertexOutput out;
 
+#if COMPACT_VERTICES
+	float4 position = float4(decode.offset.xyz + in.position.xyz * decode.scale.xyz, 1.0);
+	float3 normal = (in.position.w == 0.0) ? float3(0.0) : decode_normal(in.normal);
+#else
+	float4 position = in.position;
+	float3 normal = in.normal;
+#endif
+
 	float4 pos_obj;
-	pos_obj.x = dot(in.position, inst[iid].transform_x);
-	pos_obj.y = dot(in.position, inst[iid].transform_y);
-	pos_obj.z = dot(in.position, inst[iid].transform_z);
-	pos_obj.w = dot(in.position, inst[iid].transform_w);
+	pos_obj.x = dot(position, inst[iid].transform_x);
+	pos_obj.y = dot(position, inst[iid].transform_y);
+	pos_obj.z = dot(position, inst[iid].transform_z);
+	pos_obj.w = dot(position, inst[iid].transform_w);
 
 	float3 norm_obj;
-	norm_obj.x = dot(in.normal, inst[iid].transform_x.xyz);
-	norm_obj.y = dot(in.normal, inst[iid].transform_y.xyz);
-	norm_obj.z = dot(in.normal, inst[iid].transform_z.xyz);
+	norm_obj.x = dot(normal, inst[iid].transform_x.xyz);
+	norm_obj.y = dot(normal, inst[iid].transform_y.xyz);
+	norm_obj.z = dot(normal, inst[iid].transform_z.xyz);
 
 	out.normal_eye = normalize(uni.normal_matrix * norm_obj);
 	float4 eye_pos = uni.model_view_matrix * pos_obj;
@@ -61,13 +91,13 @@ vertex VertexOutput vertexShader(VertexInput				in		[[stage_in]],
 	out.color.a = col.a;
 	out.color.rgb = col.rgb;
 
-	if (in.normal.x == 0.0 && in.normal.y == 0.0 && in.normal.z == 0.0) {
+	if (normal.x == 0.0 && normal.y == 0.0 && normal.z == 0.0) {
 		out.color = col;
 	};
 
 	float2 tex_coord;
-	tex_coord.x = dot(texGen.plane_s, in.position);
-	tex_coord.y = dot(texGen.plane_t, in.position);
+	tex_coord.x = dot(texGen.plane_s, position);
+	tex_coord.y = dot(texGen.plane_t, position);
 	out.tex_coord = float2(tex_coord.x, 1.0 - tex_coord.y);
 
 	return out;
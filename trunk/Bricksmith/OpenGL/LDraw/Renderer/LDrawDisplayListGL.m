@@ -9,6 +9,9 @@
 #import "LDrawDisplayListGL.h"
 #import "LDrawCoreRenderer.h"
 #import "LDrawBDPAllocator.h"
+#import "LDrawDLBuildQueue.h"
+#import "LDrawDepthSort.h"
+#import "LDrawMeshCache.h"
 #import "LDrawShaderRenderer.h"
 #import "MatrixMathEx.h"
 #import "MeshSmooth.h"
@@ -24,12 +27,13 @@
 // This turns on normal smoothing.
 #define WANT_SMOOTH 1
 
+// This stores smoothed meshes as 16-byte compact vertices (see MeshSmooth.h)
+// with 16-bit indices where they fit, rather than 40-byte float vertices and
+// 32-bit indices.  Requires WANT_SMOOTH.
+#define WANT_COMPACT_VERTICES 1
+
 // This times smoothing of parts.
 #define TIME_SMOOTHING 0
-
-#if WANT_SMOOTH
-static const GLuint * idx_null = NULL;
-#endif
 /*
 
 	INSTANCING IMPLEMENTATION NOTES
@@ -62,10 +66,11 @@ static const GLuint * idx_null = NULL;
 	
 	DEFERRED DARWING FOR Z SORTING
 	
-	When a DL does not have to be drawn immediately and has translucency, we always try to save it to the sorted list.
+	When a DL does not have to be drawn immediately and has translucency, we always try to save it to the sorted array, along
+	with the eye-space depth of its local origin.
 	
-	Then when the session is destroyed, we sort all of these "sort-deferred" DLs by their local origin and draw back to front.
-	This helps keep translucency looking good.
+	Then when the session is destroyed, we sort all of these "sort-deferred" DLs by that depth (see LDrawDepthSort.h) and draw
+	back to front.  This helps keep translucency looking good.
 
 */
 
@@ -123,6 +128,34 @@ static int inst_ring_last = 0;
 
 //========== DISPLAY LIST DATA STRUCTURES ========================================
 
+#if WANT_SMOOTH && WANT_COMPACT_VERTICES
+// Display lists of at least this many triangles (quads count as two) get
+// simplified detail levels.  A level is kept only if it has at most this
+// fraction of the next finer level's triangles.
+#define DETAIL_MIN_TRIS 128
+#define DETAIL_MAX_RATIO 0.75f
+
+// Where one detail level's indices sit in the block LDrawDLSimplifyDetails
+// returns.
+struct LDrawDLDetailRange {
+	int						start;
+	int						line_count;
+	int						tri_count;
+};
+#endif
+
+#if WANT_SMOOTH
+// How to read a smoothed DL's buffers: the index type, and the decode
+// attributes for the shader - position = offset + position * scale, where a
+// scale.w of 1 means compact vertices and 0 means floats.
+struct LDrawDLMeshFormat {
+	GLenum					idx_type;
+	GLsizei					idx_size;
+	GLfloat					offset[4];
+	GLfloat					scale[4];
+};
+#endif
+
 // Per-texture mesh info.  Texture spec plus the offset/count into a single VBO for the lines, tris and quads to draw.
 // This is used in a finished DL.
 struct LDrawDLPerTex {
@@ -158,7 +191,10 @@ struct LDrawDL {
 	GLuint					geo_vbo;				// Single VBO containing all geometry in the DL.
 #if WANT_SMOOTH
 	GLuint					idx_vbo;				// Single VBO containing all mesh indices.
+	struct LDrawDLMeshFormat format;				// Layout of the two VBOs.
 #endif
+	struct LDrawDL *		owner;					// For a detail level, the DL it simplifies - it owns the VBOs.
+	struct LDrawDL *		details[detail_count];	// Simpler copies to draw when small; NULL where not worth having.
 	int						tex_count;				// Number of per-textures; untex case is always first if present.
 	#if WANT_STATS
 	int						vrt_count;
@@ -181,6 +217,7 @@ struct LDrawDLSegment {
 	GLuint					geo_vbo;			// VBO of the brick we are going to draw - contains the actual brick mesh.
 #if WANT_SMOOTH
 	GLuint					idx_vbo;
+	struct LDrawDLMeshFormat format;			// Copied, like the VBOs, since the DL may be gone by the time we draw.
 #endif
 	struct LDrawDLPerTex *	dl;					// Ptr to the per-tex info for that brick - only untexed bricks get instanced, so we only have one "per tex", by definition.
 	float *					inst_base;			// VBO-relative ptr to the instance data base in the instance VBO.
@@ -188,14 +225,10 @@ struct LDrawDLSegment {
 };
 	
 
-// The sorted instance link is a 'full' instance (DL, color/comp, transform and texture) used for drawing DLs that are going to be Z sorted.  
+// The sorted instance is a 'full' instance (DL, color/comp, transform and texture) used for drawing DLs that are going to be Z sorted.  
 // Unlike the faster harder instancing, we keep tex state around because we might draw ANY DL (even a multitextured one) to get the Z sort
 // right.
-struct LDrawDLSortedInstanceLink {
-	union {
-		struct LDrawDLSortedInstanceLink *	next;				// DURING draw, we keep a linked list of these guys off of the session as we go.
-		float								eval;				// At the end of draw, when we need to sort, we copy to a fixed size array and sort.
-	};															// Maybe someday we could merge-sort the linked list, but use qsort for now to get shipped.
+struct LDrawDLSortedInstance {
 	struct	LDrawDL *						dl;
 	struct LDrawTextureSpec					spec;
 	GLfloat									color[4];
@@ -226,19 +259,215 @@ struct LDrawDLSession {
 	struct LDrawDL *					dl_head;				// Linked list of all DLs that will be instance-drawn, with count.
 	int									dl_count;
 	
-	struct LDrawDLSortedInstanceLink *	sorted_head;			// Linked list + count for DLs being drawn later to Z sort.
-	int									sort_count;
+	struct LDrawDLSortedInstance *		sorted;					// DLs being drawn later to Z sort, in the order drawn, with their
+	LDrawDepthSortEntry *				sort_keys;				// eye space Z.  Grown with realloc, so the arrays can be sorted
+	int									sort_count;				// in place and never copied from a list.
+	int									sort_capacity;
 
 	GLfloat								model_view[16];			// Model-view matrix, used to Z sort translucent objects.
 	GLuint								inst_ring;				// If using more than one instancing buffer, this tells which one we use.
 };
 
 
+#if WANT_SMOOTH
+
+#if !WANT_COMPACT_VERTICES
+//========== LDrawDLSetFloatFormat ===============================================
+//
+// Purpose:	Describe a mesh as write_indexed_mesh writes it: 10 floats per
+//			vertex and 32-bit indices.
+//
+//================================================================================
+static void LDrawDLSetFloatFormat(struct LDrawDLMeshFormat * format)
+{
+	format->idx_type = GL_UNSIGNED_INT;
+	format->idx_size = sizeof(GLuint);
+	format->offset[0] = format->offset[1] = format->offset[2] = format->offset[3] = 0.0f;
+	format->scale[0] = format->scale[1] = format->scale[2] = 1.0f;
+	format->scale[3] = 0.0f;
+}//end LDrawDLSetFloatFormat
+
+#else
+//========== LDrawDLSetCompactFormat =============================================
+//
+// Purpose:	Describe a mesh of compact vertices quantized across bounds, with
+//			indices idx_size bytes wide.
+//
+//================================================================================
+static void LDrawDLSetCompactFormat(struct LDrawDLMeshFormat * format, const struct compact_bounds * bounds, int idx_size)
+{
+	format->idx_type = (idx_size == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	format->idx_size = idx_size;
+	copy_vec3(format->offset, bounds->offset);
+	copy_vec3(format->scale, bounds->scale);
+	format->offset[3] = 0.0f;
+	format->scale[3] = 1.0f;
+}//end LDrawDLSetCompactFormat
+#endif
+
+
+//========== LDrawDLBindVertexFormat =============================================
+//
+// Purpose:	Point the vertex attributes at the currently bound geometry VBO,
+//			and hand the shader what it needs to decode it.
+//
+//================================================================================
+static void LDrawDLBindVertexFormat(const struct LDrawDLMeshFormat * format)
+{
+	if(format->scale[3] != 0.0f)
+	{
+		// Compact: 16-bit position + lit flag, octahedral normal, RGBA8 - all normalized by the GL.
+		GLsizei stride = sizeof(struct compact_vertex);
+		glVertexAttribPointer(attr_position, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (const GLvoid *) offsetof(struct compact_vertex, position));
+		glVertexAttribPointer(attr_normal, 2, GL_SHORT, GL_TRUE, stride, (const GLvoid *) offsetof(struct compact_vertex, normal));
+		glVertexAttribPointer(attr_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const GLvoid *) offsetof(struct compact_vertex, color));
+	}
+	else
+	{
+		float * p = NULL;
+		glVertexAttribPointer(attr_position, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p);
+		glVertexAttribPointer(attr_normal, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+3);
+		glVertexAttribPointer(attr_color, 4, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+6);
+	}
+	glVertexAttrib4fv(attr_position_offset, format->offset);
+	glVertexAttrib4fv(attr_position_scale, format->scale);
+}//end LDrawDLBindVertexFormat
+
+
+//========== LDrawDLIndexPointer =================================================
+//
+// Purpose:	The VBO-relative "pointer" to index number off.
+//
+//================================================================================
+static const GLvoid * LDrawDLIndexPointer(const struct LDrawDLMeshFormat * format, GLuint off)
+{
+	return (const GLvoid *) ((const char *) NULL + (size_t) off * format->idx_size);
+}//end LDrawDLIndexPointer
+
+
+#if WANT_COMPACT_VERTICES
+//========== LDrawDLSimplifyDetails ==============================================
+//
+// Purpose:	Simplify a DL's one untextured mesh for each lower detail level, to
+//			within half a pixel at the level's screen size.  Returns a malloc'd
+//			block holding the levels' indices back to back, or NULL if no level
+//			was worth keeping.
+//
+// Notes:	Each level must drop enough of the next finer level's triangles to
+//			pay for its indices; a level's range has a start of -1 if not.
+//
+//================================================================================
+static GLuint * LDrawDLSimplifyDetails(
+									const GLfloat *					vertices,
+									int								vertex_count,
+									const GLuint *					indices,
+									const struct compact_bounds *	bounds,
+									int								line_start,
+									int								line_count,
+									int								tri_start,
+									int								tri_count,
+									int								quad_start,
+									int								quad_count,
+									struct LDrawDLDetailRange		out_ranges[detail_count],
+									int *							out_total)
+{
+	static const float	pixels[detail_count] = { 0.0f, LDrawDetailLowPixels, LDrawDetailLowestPixels };
+	float				extent = MAX(bounds->scale[0], MAX(bounds->scale[1], bounds->scale[2]));
+	int					finer_tris = tri_count + quad_count / 4 * 6;
+	int					capacity = get_simplified_index_capacity(line_count, 0, tri_count, quad_count);
+	GLuint *			block = NULL;
+	int					total = 0;
+	int					d;
+
+	for(d = 0; d < detail_count; ++d)
+		out_ranges[d].start = -1;
+	*out_total = 0;
+
+	if(finer_tris / 3 < DETAIL_MIN_TRIS)
+		return NULL;
+
+	block = (GLuint *) malloc(sizeof(GLuint) * capacity * (detail_count - 1));
+	for(d = detail_low; d < detail_count; ++d)
+	{
+		int lines, cond_lines, tris;
+		simplify_indexed_mesh(
+			vertices, vertex_count, indices,
+			line_start, line_count,
+			0, 0,
+			tri_start, tri_count,
+			quad_start, quad_count,
+			extent * 0.5f / pixels[d],
+			block + total, &lines, &cond_lines, &tris);
+
+		if(tris > finer_tris * DETAIL_MAX_RATIO)
+			continue;
+
+		out_ranges[d].start = total;
+		out_ranges[d].line_count = lines;
+		out_ranges[d].tri_count = tris;
+		total += lines + tris;
+		finer_tris = tris;
+	}
+
+	if(total == 0)
+	{
+		free(block);
+		return NULL;
+	}
+	*out_total = total;
+	return block;
+}//end LDrawDLSimplifyDetails
+
+
+//========== LDrawDLCreateDetail =================================================
+//
+// Purpose:	Make the DL for one detail level of owner: it shares owner's VBOs
+//			and draws the indices from off on, lines first.
+//
+//================================================================================
+static struct LDrawDL * LDrawDLCreateDetail(struct LDrawDL * owner, GLuint off, int line_count, int tri_count)
+{
+	struct LDrawDL * dl = (struct LDrawDL *) malloc(sizeof(struct LDrawDL) + sizeof(struct LDrawDLPerTex));
+
+	dl->next_dl = NULL;
+	dl->instance_head = NULL;
+	dl->instance_tail = NULL;
+	dl->instance_count = 0;
+	dl->flags = owner->flags;
+	dl->geo_vbo = owner->geo_vbo;
+	dl->idx_vbo = owner->idx_vbo;
+	dl->format = owner->format;
+	dl->owner = owner;
+	memset(dl->details, 0, sizeof(dl->details));
+	dl->tex_count = 1;
+	#if WANT_STATS
+	dl->vrt_count = owner->vrt_count;
+	dl->idx_count = line_count + tri_count;
+	#endif
+
+	memcpy(&dl->texes[0].spec, &owner->texes[0].spec, sizeof(struct LDrawTextureSpec));
+	dl->texes[0].line_off = off;
+	dl->texes[0].line_count = line_count;
+	dl->texes[0].tri_off = off + line_count;
+	dl->texes[0].tri_count = tri_count;
+	dl->texes[0].quad_off = off + line_count + tri_count;
+	dl->texes[0].quad_count = 0;
+
+	return dl;
+}//end LDrawDLCreateDetail
+#endif
+
+#endif
+
 
 //========== Dastructures for BUILDING a VBO ==============================
 
 
-// As we build our VBO, we keep sets of vertices in a linked list.  When done
+// When smoothing, every primitive goes straight into one growable mesh as it
+// is added - the mesh stores its faces in blocks that grow as needed, so there
+// is nothing for us to keep.
+//
+// Otherwise, as we build our VBO, we keep sets of vertices in a linked list.  When done
 // we copy them into our VBO.  The linked list lets us add vertices a little 
 // at a time without expensive array resizes.  Since the linked list comes
 // from a BDP locality is actually pretty good.
@@ -252,11 +481,16 @@ struct	LDrawDLBuilderVertexLink {
 
 
 // Build structure per texture.  Textures are kept in a linked list during build
-// since we don't know how many we will have.  Each type of drawing (line, tri, quad)
+// since we don't know how many we will have.  When smoothing, a texture just
+// remembers the texture ID its faces were given in the mesh (-1 until it gets its
+// first face).  Otherwise each type of drawing (line, tri, quad)
 // is kept in a singly linked list of vertex links so that we can copy them consecutively when done.
 struct LDrawDLBuilderPerTex {
 	struct LDrawDLBuilderPerTex *		next;
 	struct LDrawTextureSpec				spec;
+#if WANT_SMOOTH
+	int									tid;
+#else
 	struct LDrawDLBuilderVertexLink *	tri_head;
 	struct LDrawDLBuilderVertexLink *	tri_tail;
 	struct LDrawDLBuilderVertexLink *	quad_head;
@@ -265,6 +499,7 @@ struct LDrawDLBuilderPerTex {
 	struct LDrawDLBuilderVertexLink *	line_tail;
 	struct LDrawDLBuilderVertexLink *	cond_line_head;
 	struct LDrawDLBuilderVertexLink *	cond_line_tail;
+#endif
 };
 
 
@@ -272,14 +507,54 @@ struct LDrawDLBuilderPerTex {
 // linked list of textures (which in turn contain the geomtry.  So the entire
 // structure just accumulates data in a set of linked lists, then cleans and saves
 // the data carefully hwen we are done.
+//
+// When smoothing, the geometry instead accumulates in the mesh, and - if the mesh
+// cache is on - in the cache key, which has to see the faces in the same order.
+// LDrawDLBuilderPrepare then bakes the mesh down to the tables the VBOs are
+// filled from, which may happen on another thread.
 struct	LDrawDLBuilder {
 	int								flags;
 	struct LDrawBDP *				alloc;
 	struct LDrawDLBuilderPerTex *	head;
 	struct LDrawDLBuilderPerTex *	cur;
+#if WANT_SMOOTH
+	struct Mesh *					mesh;
+	int								tex_count;		// Texture IDs handed out so far.
+	int								poly_count;		// Tris and quads, to decide whether to cache.
+	int								hashing;
+	LDrawMeshCacheHasher			hasher;
+	int								prepared;		// The mesh went into bake.
+	LDrawDLBake						bake;
+#if WANT_COMPACT_VERTICES
+	struct compact_bounds			bounds;
+	struct LDrawDLDetailRange		detail_ranges[detail_count];
+	GLuint *						detail_indices;
+	int								detail_total;
+#endif
+#endif
 };
 
 
+#if WANT_SMOOTH
+//========== add_builder_face ====================================================
+//
+// Purpose:	Hand one primitive in the current texture to the mesh smoother and
+//			the mesh cache's key.
+//
+//================================================================================
+static void add_builder_face(struct LDrawDLBuilder * ctx, const GLfloat * p1, const GLfloat * p2, const GLfloat * p3, const GLfloat * p4, const GLfloat c[4])
+{
+	if(ctx->cur->tid < 0)
+		ctx->cur->tid = ctx->tex_count++;
+
+	add_face(ctx->mesh, p1, p2, p3, p4, c, ctx->cur->tid);
+	if(ctx->hashing)
+		LDrawMeshCacheHasherAddFace(&ctx->hasher, p1, p2, p3, p4, c, ctx->cur->tid);
+
+}//end add_builder_face
+#endif
+
+
 
 //========== LDrawDLBuilderCreate ================================================
 //
@@ -300,6 +575,21 @@ struct LDrawDLBuilder * LDrawDLBuilderCreate(void)
 	
 	bld->alloc = alloc;
 	bld->flags = 0;
+
+	#if WANT_SMOOTH
+	untex->tid = -1;
+	bld->mesh = create_growable_mesh();
+	bld->tex_count = 0;
+	bld->poly_count = 0;
+	bld->hashing = LDrawMeshCacheGetDirectory() != NULL;
+	if(bld->hashing)
+		LDrawMeshCacheHasherInit(&bld->hasher, LDrawMeshCacheRemovedTJunctions | LDrawMeshCacheOptimizedVertexCache);
+	bld->prepared = 0;
+	#if WANT_COMPACT_VERTICES
+	bld->detail_indices = NULL;
+	bld->detail_total = 0;
+	#endif
+	#endif
 	
 	return bld;
 }//end LDrawDLBuilderCreate
@@ -329,6 +619,9 @@ void LDrawDLBuilderSetTex(struct LDrawDLBuilder * ctx, struct LDrawTextureSpec *
 		struct LDrawDLBuilderPerTex * new_tex = (struct LDrawDLBuilderPerTex *) LDrawBDPAllocate(ctx->alloc,sizeof(struct LDrawDLBuilderPerTex));
 		memset(new_tex,0,sizeof(struct LDrawDLBuilderPerTex));
 		memcpy(&new_tex->spec,spec,sizeof(struct LDrawTextureSpec));
+		#if WANT_SMOOTH
+		new_tex->tid = -1;
+		#endif
 		prev->next = new_tex;
 		ctx->cur = new_tex;
 	}
@@ -343,7 +636,8 @@ void LDrawDLBuilderSetTex(struct LDrawDLBuilder * ctx, struct LDrawTextureSpec *
 // Notes:	This routine 'sniffs' the alpha as it goes by and keeps the DL flags
 //			correct - this is how a DL "knows" if it is translucent.
 //
-//			We accumulate the tri by allocating a 3-vertex DL link and queueing it
+//			When smoothing, the tri goes straight into the mesh.  Otherwise we
+//			accumulate the tri by allocating a 3-vertex DL link and queueing it
 //			onto the triangle list for the current texture.
 //
 //================================================================================
@@ -352,6 +646,13 @@ void LDrawDLBuilderAddTri(struct LDrawDLBuilder * ctx, const GLfloat v[9], GLflo
 	// Alpha = 0 means meta color.  0 < Alpha < 1 means translucency.	
 		 if(c[3] == 0.0f)	ctx->flags |= dl_has_meta;
 	else if(c[3] != 1.0f)	ctx->flags |= dl_has_alpha;
+
+	#if WANT_SMOOTH
+
+	add_builder_face(ctx, v, v+3, v+6, NULL, c);
+	++ctx->poly_count;
+
+	#else
 	
 	int i;
 	struct LDrawDLBuilderVertexLink * nl = (struct LDrawDLBuilderVertexLink *) LDrawBDPAllocate(ctx->alloc, sizeof(struct LDrawDLBuilderVertexLink) + sizeof(GLfloat) * VERT_STRIDE * 3);
@@ -374,6 +675,8 @@ void LDrawDLBuilderAddTri(struct LDrawDLBuilder * ctx, const GLfloat v[9], GLflo
 		ctx->cur->tri_head = nl;
 		ctx->cur->tri_tail = nl;
 	}
+
+	#endif
 }//end LDrawDLBuilderAddTri
 
 
@@ -387,7 +690,18 @@ void LDrawDLBuilderAddQuad(struct LDrawDLBuilder * ctx, const GLfloat v[12], GLf
 		 if(c[3] == 0.0f)	ctx->flags |= dl_has_meta;
 	else if(c[3] != 1.0f)	ctx->flags |= dl_has_alpha;
 
-	#if ONLY_USE_TRIS
+	#if WANT_SMOOTH && ONLY_USE_TRIS
+
+	add_builder_face(ctx, v, v+3, v+6, NULL, c);
+	add_builder_face(ctx, v, v+6, v+9, NULL, c);
+	ctx->poly_count += 2;
+
+	#elif WANT_SMOOTH
+
+	add_builder_face(ctx, v, v+3, v+6, v+9, c);
+	++ctx->poly_count;
+
+	#elif ONLY_USE_TRIS
 
 	int i;
 	struct LDrawDLBuilderVertexLink * nl = (struct LDrawDLBuilderVertexLink *) LDrawBDPAllocate(ctx->alloc, sizeof(struct LDrawDLBuilderVertexLink) + sizeof(GLfloat) * VERT_STRIDE * 3);
@@ -475,6 +789,12 @@ void LDrawDLBuilderAddLine(struct LDrawDLBuilder * ctx, const GLfloat v[6], GLfl
 		 if(c[3] == 0.0f)	ctx->flags |= dl_has_meta;
 	else if(c[3] != 1.0f)	ctx->flags |= dl_has_alpha;
 
+	#if WANT_SMOOTH
+
+	add_builder_face(ctx, v, v+3, NULL, NULL, c);
+
+	#else
+
 	int i;
 	struct LDrawDLBuilderVertexLink * nl = (struct LDrawDLBuilderVertexLink *) LDrawBDPAllocate(ctx->alloc, sizeof(struct LDrawDLBuilderVertexLink) + sizeof(GLfloat) * VERT_STRIDE * 2);
 	nl->next = NULL;
@@ -496,6 +816,8 @@ void LDrawDLBuilderAddLine(struct LDrawDLBuilder * ctx, const GLfloat v[6], GLfl
 		ctx->cur->line_head = nl;
 		ctx->cur->line_tail = nl;
 	}
+
+	#endif
 }//end LDrawDLBuilderAddLine
 
 
@@ -511,15 +833,105 @@ void LDrawDLBuilderAddCondLine(struct LDrawDLBuilder * ctx, const GLfloat v[6],
 }//end LDrawDLBuilderAddCondLine
 
 
+//========== LDrawDLBuilderGetFaceCount ==========================================
+//
+// Purpose:	Return how many tris and quads a builder has collected - a guide to
+//			how long finishing it will take.
+//
+//================================================================================
+int LDrawDLBuilderGetFaceCount(struct LDrawDLBuilder * ctx)
+{
+#if WANT_SMOOTH
+	return ctx->poly_count;
+#else
+	return 0;
+#endif
+}//end LDrawDLBuilderGetFaceCount
+
+
+//========== LDrawDLBuilderPrepare ===============================================
+//
+// Purpose:	Do all of the CPU work of finishing a DL ahead of time: smooth the
+//			mesh (or fetch it from the mesh cache), then work out its compact
+//			format and detail levels.
+//
+// Notes:	This touches no GL state, so it may run on any thread - but nothing
+//			else may use the builder while it does.  LDrawDLBuilderFinish calls
+//			it itself if no one has, and is then left with only the upload.
+//
+//================================================================================
+void LDrawDLBuilderPrepare(struct LDrawDLBuilder * ctx)
+{
+#if WANT_SMOOTH
+	if(ctx->prepared || ctx->tex_count == 0)
+		return;
+
+	LDrawDLBakeInit(&ctx->bake, ctx->mesh, ctx->tex_count, ctx->poly_count, ctx->hashing ? &ctx->hasher : NULL);
+	ctx->mesh = NULL;
+	ctx->prepared = 1;
+
+	LDrawDLBakeRun(&ctx->bake);
+
+	#if WANT_COMPACT_VERTICES
+	const LDrawDLBake * bake = &ctx->bake;
+	struct LDrawDLBuilderPerTex * s;
+
+	get_compact_bounds(bake->vertices, bake->vertexCount, &ctx->bounds);
+
+	// A DL that is one untextured mesh gets simpler copies of it to draw when
+	// it is small on screen.  Their indices go after the mesh's own.
+	if(ctx->tex_count == 1)
+	{
+		for(s = ctx->head; s && s->tid < 0; s = s->next)
+			;
+		if(s && s->spec.tex_obj == 0)
+			ctx->detail_indices = LDrawDLSimplifyDetails(
+									bake->vertices, bake->vertexCount, bake->indices, &ctx->bounds,
+									bake->lineStarts[0], bake->lineCounts[0],
+									bake->triangleStarts[0], bake->triangleCounts[0],
+									bake->quadrilateralStarts[0], bake->quadrilateralCounts[0],
+									ctx->detail_ranges, &ctx->detail_total);
+	}
+	#endif
+#endif
+}//end LDrawDLBuilderPrepare
+
+
+//========== LDrawDLBuilderDestroy ===============================================
+//
+// Purpose:	Throw a builder away without making a DL of it.  Like
+//			LDrawDLBuilderPrepare, this is safe on any thread.
+//
+//================================================================================
+void LDrawDLBuilderDestroy(struct LDrawDLBuilder * ctx)
+{
+#if WANT_SMOOTH
+	if(ctx->prepared)
+		LDrawDLBakeRelease(&ctx->bake);
+	if(ctx->mesh)
+		destroy_mesh(ctx->mesh);
+	#if WANT_COMPACT_VERTICES
+	free(ctx->detail_indices);
+	#endif
+#endif
+	LDrawBDPDestroy(ctx->alloc);
+
+}//end LDrawDLBuilderDestroy
+
+
 //========== LDrawDLBuilderFinish ================================================
 //
 // Purpose:	Take all of the accumulated data in a DL and bake it down to one
 //			final form.
 //
-// Notes:	The DL is, while being built, a series of linked lists in a BDP for
-//			speed.  The finished DL is a malloc'd block of memory, pre-sized to
-//			fit the DL perfectly, and one VBO.  So this routine does the counting,
-//			final allocations, and copying.
+// Notes:	The DL is, while being built, a growable mesh (or, without smoothing, a
+//			series of linked lists in a BDP) for speed.  The finished DL is a
+//			malloc'd block of memory, pre-sized to fit the DL perfectly, and one
+//			VBO.  So this routine does the smoothing (or counting), final
+//			allocations, and copying.
+//
+//			When smoothing, LDrawDLBuilderPrepare may already have done all but
+//			the copying on another thread.
 //
 //================================================================================
 struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
@@ -529,46 +941,27 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
 	#endif
 
-	int total_texes = 0;
-	int total_tris = 0;
-	int total_quads = 0;
-	int total_lines = 0;
-	int total_cond_lines = 0;
+	// Every non-empty texture got a texture ID with its first face.
+	int total_texes = ctx->tex_count;
 
-
-	struct LDrawDLBuilderVertexLink * l;
 	struct LDrawDLBuilderPerTex * s;
 	
-	// Count up the total vertices we will need, for VBO space, as well
-	// as the total distinct non-empty textures.
-	for(s = ctx->head; s; s = s->next)
-	{
-		if(s->tri_head || s->line_head || s->quad_head)
-			++total_texes;
-
-		for(l = s->tri_head; l; l = l->next)
-		{
-			total_tris++;
-		}
-		for(l = s->quad_head; l; l = l->next)
-		{
-			total_quads++;
-		}
-		for(l = s->line_head; l; l = l->next)
-		{
-			total_lines++;
-		}
-	}
-	
 	// No non-empty textures?  Bail out early - nuke our
 	// context and get out.  Client code knows we get NO DL, rather than 
 	// an empty one.
 	if(total_texes == 0)
 	{
-		LDrawBDPDestroy(ctx->alloc);
+		LDrawDLBuilderDestroy(ctx);
 		return NULL;
 	}
 	
+	// Smoothing is the slow part; it is done here unless it was done ahead.
+	LDrawDLBuilderPrepare(ctx);
+
+	const LDrawDLBake * bake = &ctx->bake;
+	int total_vertices = bake->vertexCount;
+	int total_indices = bake->indexCount;
+
 	// Malloc DL structure with extra storage for variable-sized tex array.
 	struct LDrawDL * dl = (struct LDrawDL *) malloc(sizeof(struct LDrawDL) + sizeof(struct LDrawDLPerTex) * total_texes);
 	
@@ -577,150 +970,93 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	dl->instance_head = NULL;
 	dl->instance_tail = NULL;
 	dl->instance_count = 0;
+
+	// Detail levels, if any, are added once the mesh is written.
+	dl->owner = NULL;
+	memset(dl->details, 0, sizeof(dl->details));
 	
 	dl->tex_count = total_texes;
 
 	struct LDrawDLPerTex * cur_tex = dl->texes;	
 	dl->flags = ctx->flags;
 
-	// We use one mesh for the entire DL, even if it has multiple textures.  We have to
-	// do this because we wnat smoothing across triangles that do not share the same
-	// texture.  (Key use case: minifig faces are part textured, part untextured.)
-	//
-	// So instead each face gets a texture ID (tid), which is an index that we will tie
-	// to our texture list.  The mesh smoother remembers this and dumps out the tris in
-	// tid order later.
-
-	struct Mesh * M = create_mesh(total_tris,total_quads,total_lines,total_cond_lines);
-
-
-	// Now: walk our building textures - for each non-empty one, we will copy it into
-	// the tex array and push its vertices.
-	int ti = 0;
-	for(s = ctx->head; s; s = s->next)
-	{
-		if(s->tri_head == NULL && s->line_head == NULL && s->quad_head == NULL)
-			continue;
-		if(s->spec.tex_obj != 0)
-			dl->flags |= dl_has_tex;
-
-		for(l = s->tri_head; l; l = l->next)
-		{
-			add_face(M,
-				l->data, l->data+10,l->data+20,NULL,
-				l->data+6,ti);
-		}
-
-		for(l = s->quad_head; l; l = l->next)
-		{
-			add_face(M,
-				l->data, l->data+10,l->data+20,l->data+30,
-				l->data+6,ti);
-		}
-
-		++ti;
-	}
-
-	ti = 0;
-	for(s = ctx->head; s; s = s->next)
-	{
-		if(s->tri_head == NULL && s->line_head == NULL && s->quad_head == NULL)
-			continue;
-		if(s->spec.tex_obj != 0)
-			dl->flags |= dl_has_tex;
-
-		for(l = s->line_head; l; l = l->next)
-		{
-			add_face(M,l->data,l->data+10,NULL,NULL,l->data+6,ti);
-		}
-		
-		++ti;
-	}
-
-
-	finish_faces_and_sort(M);
-	add_creases(M);
-	find_and_remove_t_junctions(M);
-	finish_creases_and_join(M);
-	smooth_vertices(M);
-	merge_vertices(M);
-	
-	int total_vertices, total_indices;
-	get_final_mesh_counts(M,&total_vertices,&total_indices);
-
 	glGenBuffers(1,&dl->geo_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, dl->geo_vbo);
 	glGenBuffers(1,&dl->idx_vbo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dl->idx_vbo);
 
+#if WANT_COMPACT_VERTICES
+	LDrawDLSetCompactFormat(&dl->format, &ctx->bounds, get_compact_index_size(total_vertices));
+
+	glBufferData(GL_ARRAY_BUFFER, total_vertices * sizeof(struct compact_vertex), NULL, GL_STATIC_DRAW);
+	volatile struct compact_vertex * vertex_ptr = (volatile struct compact_vertex *) glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+	write_compact_vertices(bake->vertices, total_vertices, &ctx->bounds, vertex_ptr);
+
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (total_indices + ctx->detail_total) * dl->format.idx_size, NULL, GL_STATIC_DRAW);
+	volatile void * index_ptr = glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
+	write_compact_indices(bake->indices, total_indices, dl->format.idx_size, index_ptr);
+	if(ctx->detail_indices)
+		write_compact_indices(ctx->detail_indices, ctx->detail_total, dl->format.idx_size,
+							  (volatile char *) index_ptr + (size_t) total_indices * dl->format.idx_size);
+#else
+	LDrawDLSetFloatFormat(&dl->format);
+
 	glBufferData(GL_ARRAY_BUFFER, total_vertices * sizeof(GLfloat) * VERT_STRIDE, NULL, GL_STATIC_DRAW);
 	volatile GLfloat * vertex_ptr = (volatile GLfloat *) glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+	memcpy((void *) vertex_ptr, bake->vertices, total_vertices * sizeof(GLfloat) * VERT_STRIDE);
 
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, total_indices * sizeof(GLuint), NULL, GL_STATIC_DRAW);
 	volatile GLuint * index_ptr = (volatile GLuint *) glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
-	
-	// Grab variable size arrays for the start/offsets of each sub-part of our big pile-o-mesh...
-	// the mesher will give us back our tris sorted by texture.
-	
-	int * line_start	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * line_count	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * cond_line_start = (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * cond_line_count = (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * tri_start		= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * tri_count		= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * quad_start	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-	int * quad_count	= (int *) LDrawBDPAllocate(ctx->alloc, sizeof(int) * total_texes);
-
-	write_indexed_mesh(
-		M,
-		total_vertices,
-		vertex_ptr,
-		total_indices,
-		index_ptr,
-		0,
-		line_start,
-		line_count,
-		cond_line_start,
-		cond_line_count,
-		tri_start,
-		tri_count,
-		quad_start,
-		quad_count);
-
-	ti = 0;
-	
+	memcpy((void *) index_ptr, bake->indices, total_indices * sizeof(GLuint));
+#endif
+
+	// Texture IDs went out in the order faces arrived; the DL keeps its textures
+	// in the order they were set up, as it always has.
 	for(s = ctx->head; s; s = s->next)
 	{
-		if(s->tri_head == NULL && s->line_head == NULL && s->quad_head == NULL)
+		int ti = s->tid;
+		if(ti < 0)
 			continue;
+		if(s->spec.tex_obj != 0)
+			dl->flags |= dl_has_tex;
 
 		memcpy(&cur_tex->spec, &s->spec, sizeof(struct LDrawTextureSpec));
 		
-		cur_tex->quad_off = quad_start[ti];
-		cur_tex->line_off = line_start[ti];
-		cur_tex->tri_off = tri_start[ti];
-		cur_tex->quad_count = quad_count[ti];
-		cur_tex->line_count = line_count[ti];
-		cur_tex->tri_count = tri_count[ti];
+		cur_tex->quad_off = bake->quadrilateralStarts[ti];
+		cur_tex->line_off = bake->lineStarts[ti];
+		cur_tex->tri_off = bake->triangleStarts[ti];
+		cur_tex->quad_count = bake->quadrilateralCounts[ti];
+		cur_tex->line_count = bake->lineCounts[ti];
+		cur_tex->tri_count = bake->triangleCounts[ti];
 		
-		++ti;
 		++cur_tex;
 	}
 
-	destroy_mesh(M);
-
 	#if WANT_STATS
 	dl->vrt_count = total_vertices;
 	dl->idx_count = total_indices;
 	#endif	
-	
+
+#if WANT_COMPACT_VERTICES
+	if(ctx->detail_indices)
+	{
+		int d;
+		for(d = detail_low; d < detail_count; ++d)
+		{
+			if(ctx->detail_ranges[d].start >= 0)
+				dl->details[d] = LDrawDLCreateDetail(dl, total_indices + ctx->detail_ranges[d].start,
+													 ctx->detail_ranges[d].line_count, ctx->detail_ranges[d].tri_count);
+		}
+	}
+#endif
+
 	glUnmapBuffer(GL_ARRAY_BUFFER);
 	glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
 	glBindBuffer(GL_ARRAY_BUFFER,0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
 
-	// Release the BDP that contains all of the build-related junk.
-	LDrawBDPDestroy(ctx->alloc);
+	// Release the baked tables and the BDP that contains all of the build-related junk.
+	LDrawDLBuilderDestroy(ctx);
 
 	#if TIME_SMOOTHING
 	NSTimeInterval endTime = [NSDate timeIntervalSinceReferenceDate];			
@@ -770,6 +1106,10 @@ struct LDrawDL * LDrawDLBuilderFinish(struct LDrawDLBuilder * ctx)
 	dl->instance_head = NULL;
 	dl->instance_tail = NULL;
 	dl->instance_count = 0;
+
+	// Detail levels need indices, so unsmoothed DLs have none.
+	dl->owner = NULL;
+	memset(dl->details, 0, sizeof(dl->details));
 	
 	dl->tex_count = total_texes;
 	
@@ -891,8 +1231,10 @@ struct LDrawDLSession * LDrawDLSessionCreate(const GLfloat model_view[16])
 	session->alloc = alloc;
 	session->dl_head = NULL;
 	session->dl_count = 0;
-	session->sorted_head = NULL;
+	session->sorted = NULL;
+	session->sort_keys = NULL;
 	session->sort_count = 0;
+	session->sort_capacity = 0;
 	#if WANT_STATS
 	memset(&session->stats,0,sizeof(session->stats));
 	#endif
@@ -904,18 +1246,50 @@ struct LDrawDLSession * LDrawDLSessionCreate(const GLfloat model_view[16])
 }//end LDrawDLSessionCreate
 
 
-//========== compare_sorted_link =================================================
+//========== save_sorted_instance ================================================
+//
+// Purpose:	Record a translucent instance to draw once everything opaque is
+//			down, keyed by how far away it is.
 //
-// Purpose:	Functor to compare two sorted instances by their "eval" value, which
-//			is eye space Z right now. API fits C qsort.
+// Notes:	The key is the eye space Z of the instance's origin, taken now
+//			while the transform is at hand.
 //
 //================================================================================
-static int compare_sorted_link(const void * lhs, const void * rhs)
+static void save_sorted_instance(struct LDrawDLSession *		session,
+								 struct LDrawDL *				dl,
+								 struct LDrawTextureSpec *		spec,
+								 const GLfloat 					cur_color[4],
+								 const GLfloat 					cmp_color[4],
+								 const GLfloat					transform[16])
 {
-	const struct LDrawDLSortedInstanceLink * a = (const struct LDrawDLSortedInstanceLink *) lhs;
-	const struct LDrawDLSortedInstanceLink * b = (const struct LDrawDLSortedInstanceLink *) rhs;
-	return a->eval - b->eval;
-}//end compare_sorted_link
+	if(session->sort_count == session->sort_capacity)
+	{
+		session->sort_capacity = session->sort_capacity ? session->sort_capacity * 2 : 256;
+		session->sorted = (struct LDrawDLSortedInstance *) realloc(session->sorted, sizeof(struct LDrawDLSortedInstance) * session->sort_capacity);
+		session->sort_keys = (LDrawDepthSortEntry *) realloc(session->sort_keys, sizeof(LDrawDepthSortEntry) * session->sort_capacity);
+	}
+
+	struct LDrawDLSortedInstance * inst = session->sorted + session->sort_count;
+	LDrawDepthSortEntry * key = session->sort_keys + session->sort_count;
+
+	inst->dl = dl;
+	memcpy(inst->color,cur_color,sizeof(GLfloat)*4);
+	memcpy(inst->comp,cmp_color,sizeof(GLfloat)*4);
+	memcpy(inst->transform,transform,sizeof(GLfloat)*16);
+	if(spec)
+		memcpy(&inst->spec,spec,sizeof(struct LDrawTextureSpec));
+	else
+		memset(&inst->spec,0,sizeof(struct LDrawTextureSpec));
+
+	float origin[4] = { transform[12], transform[13], transform[14], 1.0f };
+	float origin_eye[4];
+	applyMatrix(origin_eye,session->model_view,origin);
+	key->key = origin_eye[2];
+	key->index = session->sort_count;
+
+	session->sort_count++;
+
+}//end save_sorted_instance
 
 
 //========== LDrawDLSessionDrawAndDestroy ========================================
@@ -961,6 +1335,7 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 				cur_segment->geo_vbo = dl->geo_vbo;
 				#if WANT_SMOOTH
 				cur_segment->idx_vbo = dl->idx_vbo;
+				cur_segment->format = dl->format;
 				#endif
 				cur_segment->dl = &dl->texes[0];
 				cur_segment->inst_base = NULL; 
@@ -1014,11 +1389,13 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 				glBindBuffer(GL_ARRAY_BUFFER,dl->geo_vbo);
 				#if WANT_SMOOTH
 				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,dl->idx_vbo);
-				#endif
+				LDrawDLBindVertexFormat(&dl->format);
+				#else
 				float * p = NULL;
 				glVertexAttribPointer(attr_position, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p);
 				glVertexAttribPointer(attr_normal, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+3);
 				glVertexAttribPointer(attr_color, 4, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+6);
+				#endif
 
 				// Now walk the instance list...push instance data into attributes in immediate mode and draw.
 				for(inst = dl->instance_head; inst; inst = inst->next)
@@ -1034,11 +1411,11 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 					
 					#if WANT_SMOOTH
 					if(tptr->line_count)
-						glDrawElements(GL_LINES,tptr->line_count,GL_UNSIGNED_INT,idx_null+tptr->line_off);
+						glDrawElements(GL_LINES,tptr->line_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->line_off));
 					if(tptr->tri_count)
-						glDrawElements(GL_TRIANGLES,tptr->tri_count,GL_UNSIGNED_INT,idx_null+tptr->tri_off);
+						glDrawElements(GL_TRIANGLES,tptr->tri_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->tri_off));
 					if(tptr->quad_count)
-						glDrawElements(GL_QUADS,tptr->quad_count,GL_UNSIGNED_INT,idx_null+tptr->quad_off);
+						glDrawElements(GL_QUADS,tptr->quad_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->quad_off));
 					#else
 					if(tptr->line_count)
 						glDrawArrays(GL_LINES,tptr->line_off,tptr->line_count);
@@ -1096,29 +1473,31 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 				glBindBuffer(GL_ARRAY_BUFFER,s->geo_vbo);
 				#if WANT_SMOOTH
 				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,s->idx_vbo);
-				#endif
+				LDrawDLBindVertexFormat(&s->format);
+				#else
 				float * p = NULL;
 				glVertexAttribPointer(attr_position, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p);
 				glVertexAttribPointer(attr_normal, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+3);
 				glVertexAttribPointer(attr_color, 4, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+6);
+				#endif
 
 				glBindBuffer(GL_ARRAY_BUFFER,inst_vbo_ring[session->inst_ring]);
 
-				p = s->inst_base;
-				glVertexAttribPointer(attr_color_current, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), p  );
-				glVertexAttribPointer(attr_color_compliment, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), p+4);
-				glVertexAttribPointer(attr_transform_x, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), p+8);
-				glVertexAttribPointer(attr_transform_y, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), p+12);
-				glVertexAttribPointer(attr_transform_z, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), p+16);
-				glVertexAttribPointer(attr_transform_w, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), p+20);
+				float * inst_p = s->inst_base;
+				glVertexAttribPointer(attr_color_current, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), inst_p  );
+				glVertexAttribPointer(attr_color_compliment, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), inst_p+4);
+				glVertexAttribPointer(attr_transform_x, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), inst_p+8);
+				glVertexAttribPointer(attr_transform_y, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), inst_p+12);
+				glVertexAttribPointer(attr_transform_z, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), inst_p+16);
+				glVertexAttribPointer(attr_transform_w, 4, GL_FLOAT, GL_FALSE, 24 * sizeof(GLfloat), inst_p+20);
 				
 				#if WANT_SMOOTH	
 				if(s->dl->line_count)
-					glDrawElementsInstancedARB(GL_LINES,s->dl->line_count,GL_UNSIGNED_INT,idx_null+s->dl->line_off, s->inst_count);
+					glDrawElementsInstancedARB(GL_LINES,s->dl->line_count,s->format.idx_type,LDrawDLIndexPointer(&s->format,s->dl->line_off), s->inst_count);
 				if(s->dl->tri_count)
-					glDrawElementsInstancedARB(GL_TRIANGLES,s->dl->tri_count,GL_UNSIGNED_INT,idx_null+s->dl->tri_off, s->inst_count);
+					glDrawElementsInstancedARB(GL_TRIANGLES,s->dl->tri_count,s->format.idx_type,LDrawDLIndexPointer(&s->format,s->dl->tri_off), s->inst_count);
 				if(s->dl->quad_count)
-					glDrawElementsInstancedARB(GL_QUADS,s->dl->quad_count,GL_UNSIGNED_INT,idx_null+s->dl->quad_off, s->inst_count);
+					glDrawElementsInstancedARB(GL_QUADS,s->dl->quad_count,s->format.idx_type,LDrawDLIndexPointer(&s->format,s->dl->quad_off), s->inst_count);
 				#else
 				if(s->dl->line_count)
 					glDrawArraysInstancedARB(GL_LINES,s->dl->line_off,s->dl->line_count, s->inst_count);
@@ -1148,36 +1527,19 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 
 	// MAIN LOOP 3: sorted deferred drawing (!)
 
-	struct LDrawDLSortedInstanceLink * l;
-	if(session->sorted_head)
+	if(session->sort_count)
 	{
-		// If we have any sorting to do, allocate an array of the size of all sorted geometry for sorting purposes.
-		struct LDrawDLSortedInstanceLink * arr = (struct LDrawDLSortedInstanceLink *) LDrawBDPAllocate(session->alloc,sizeof(struct LDrawDLSortedInstanceLink) * session->sort_count);
-		struct LDrawDLSortedInstanceLink * p = arr;		
-		
-		// Copy each sorted instance into our array.  "Eval" is the measurement of distance - calculate eye-space Z and use that.
-		for(l = session->sorted_head; l; l = l->next)
-		{
-			float v[4] = { 
-				l->transform[12], 
-				l->transform[13],
-				l->transform[14], 1.0f };
-			memcpy(p,l,sizeof(struct LDrawDLSortedInstanceLink));
-			float v_eye[4];
-			applyMatrix(v_eye,session->model_view,v);
-			p->eval = v_eye[2];
-			++p;
-		}
-		
-		// Now: sort our array ascending to get far to near in eye space.
-		qsort(arr,session->sort_count,sizeof(struct LDrawDLSortedInstanceLink),compare_sorted_link);
+		// Sort ascending to get far to near in eye space.  Instances at the same depth stay in the order
+		// they were drawn.
+		LDrawDepthSortEntry * scratch = (LDrawDepthSortEntry *) LDrawBDPAllocate(session->alloc,sizeof(LDrawDepthSortEntry) * session->sort_count);
+		LDrawDepthSort(session->sort_keys,scratch,session->sort_count);
 		
 		// NOW we can walk our sorted array and draw each brick, 1x1.  This code is a rehash of the "draw now" 
 		// code in LDrawDLDraw and could be factored.
-		l = arr;
 		int lc;
 		for(lc = 0; lc < session->sort_count; ++lc)
-		{			
+		{
+			const struct LDrawDLSortedInstance * l = session->sorted + session->sort_keys[lc].index;
 			int i;
 			for(i = 0; i < 4; ++i)
 				glVertexAttrib4f(attr_transform_x+i,l->transform[i],l->transform[4+i],l->transform[8+i],l->transform[12+i]);
@@ -1188,11 +1550,13 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 			glBindBuffer(GL_ARRAY_BUFFER,dl->geo_vbo);
 			#if WANT_SMOOTH
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,dl->idx_vbo);
-			#endif
+			LDrawDLBindVertexFormat(&dl->format);
+			#else
 			float * p = NULL;
 			glVertexAttribPointer(attr_position, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p);
 			glVertexAttribPointer(attr_normal, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+3);
 			glVertexAttribPointer(attr_color, 4, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+6);
+			#endif
 			
 			struct LDrawDLPerTex * tptr = dl->texes;
 			
@@ -1208,11 +1572,11 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 				
 				#if WANT_SMOOTH
 				if(tptr->line_count)
-					glDrawElements(GL_LINES,tptr->line_count,GL_UNSIGNED_INT,idx_null+tptr->line_off);
+					glDrawElements(GL_LINES,tptr->line_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->line_off));
 				if(tptr->tri_count)
-					glDrawElements(GL_TRIANGLES,tptr->tri_count,GL_UNSIGNED_INT,idx_null+tptr->tri_off);
+					glDrawElements(GL_TRIANGLES,tptr->tri_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->tri_off));
 				if(tptr->quad_count)
-					glDrawElements(GL_QUADS,tptr->quad_count,GL_UNSIGNED_INT,idx_null+tptr->quad_off);
+					glDrawElements(GL_QUADS,tptr->quad_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->quad_off));
 				#else
 				if(tptr->line_count)
 					glDrawArrays(GL_LINES,tptr->line_off,tptr->line_count);
@@ -1222,7 +1586,6 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 					glDrawArrays(GL_QUADS,tptr->quad_off,tptr->quad_count);
 				#endif				
 			}
-			++l;
 		}
 	}
 	
@@ -1246,6 +1609,8 @@ void LDrawDLSessionDrawAndDestroy(struct LDrawDLSession * session)
 	// Finally done - all allocations for session (including our own obj) come from a BDP, so cleanup is quick.  
 	// Instance VBO remains to be reused.
 	// DLs themselves live on beyond session.
+	free(session->sorted);
+	free(session->sort_keys);
 	LDrawBDPDestroy(session->alloc);
 	
 }//end LDrawDLSessionDrawAndDestroy
@@ -1288,19 +1653,7 @@ void LDrawDLDraw(
 				session->stats.num_vert_srt += dl->vrt_count;
 			#endif
 		
-			// Build a sorted link, copy the instance data to it, and link it up to our session for later processing.
-			struct LDrawDLSortedInstanceLink * link = LDrawBDPAllocate(session->alloc, sizeof(struct LDrawDLSortedInstanceLink));
-			link->next = session->sorted_head;
-			session->sorted_head = link;
-			link->dl = dl;
-			memcpy(link->color,cur_color,sizeof(GLfloat)*4);
-			memcpy(link->comp,cmp_color,sizeof(GLfloat)*4);
-			memcpy(link->transform,transform,sizeof(GLfloat)*16);
-			session->sort_count++;
-			if(spec)
-				memcpy(&link->spec,spec,sizeof(struct LDrawTextureSpec));
-			else
-				memset(&link->spec,0,sizeof(struct LDrawTextureSpec));
+			save_sorted_instance(session,dl,spec,cur_color,cmp_color,transform);
 			return;
 		}
 
@@ -1363,11 +1716,13 @@ void LDrawDLDraw(
 	glBindBuffer(GL_ARRAY_BUFFER,dl->geo_vbo);
 	#if WANT_SMOOTH
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,dl->idx_vbo);
-	#endif
+	LDrawDLBindVertexFormat(&dl->format);
+	#else
 	float * p = NULL;
 	glVertexAttribPointer(attr_position, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p);
 	glVertexAttribPointer(attr_normal, 3, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+3);
 	glVertexAttribPointer(attr_color, 4, GL_FLOAT, GL_FALSE, VERT_STRIDE * sizeof(GLfloat), p+6);
+	#endif
 	
 	struct LDrawDLPerTex * tptr = dl->texes;
 	
@@ -1376,11 +1731,11 @@ void LDrawDLDraw(
 		// Special case: one untextured mesh - just draw.
 		#if WANT_SMOOTH
 		if(tptr->line_count)
-			glDrawElements(GL_LINES,tptr->line_count,GL_UNSIGNED_INT,idx_null+tptr->line_off);
+			glDrawElements(GL_LINES,tptr->line_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->line_off));
 		if(tptr->tri_count)
-			glDrawElements(GL_TRIANGLES,tptr->tri_count,GL_UNSIGNED_INT,idx_null+tptr->tri_off);
+			glDrawElements(GL_TRIANGLES,tptr->tri_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->tri_off));
 		if(tptr->quad_count)
-			glDrawElements(GL_QUADS,tptr->quad_count,GL_UNSIGNED_INT,idx_null+tptr->quad_off);
+			glDrawElements(GL_QUADS,tptr->quad_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->quad_off));
 		#else
 		if(tptr->line_count)
 			glDrawArrays(GL_LINES,tptr->line_off,tptr->line_count);
@@ -1406,11 +1761,11 @@ void LDrawDLDraw(
 
 			#if WANT_SMOOTH			
 			if(tptr->line_count)
-				glDrawElements(GL_LINES,tptr->line_count,GL_UNSIGNED_INT,idx_null+tptr->line_off);
+				glDrawElements(GL_LINES,tptr->line_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->line_off));
 			if(tptr->tri_count)
-				glDrawElements(GL_TRIANGLES,tptr->tri_count,GL_UNSIGNED_INT,idx_null+tptr->tri_off);
+				glDrawElements(GL_TRIANGLES,tptr->tri_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->tri_off));
 			if(tptr->quad_count)
-				glDrawElements(GL_QUADS,tptr->quad_count,GL_UNSIGNED_INT,idx_null+tptr->quad_off);
+				glDrawElements(GL_QUADS,tptr->quad_count,dl->format.idx_type,LDrawDLIndexPointer(&dl->format,tptr->quad_off));
 			#else
 			if(tptr->line_count)
 				glDrawArrays(GL_LINES,tptr->line_off,tptr->line_count);
@@ -1427,14 +1782,44 @@ void LDrawDLDraw(
 }//end LDrawDLDraw
 
 
+//========== LDrawDLGetDetail ====================================================
+//
+// Purpose:	The DL to draw dl with at a detail level: the level's own DL, or
+//			the next finer one that dl has.
+//
+//================================================================================
+struct LDrawDL * LDrawDLGetDetail(struct LDrawDL * dl, int detail)
+{
+	for(; detail > detail_full; --detail)
+	{
+		if(dl->details[detail])
+			return dl->details[detail];
+	}
+	return dl;
+
+}//end LDrawDLGetDetail
+
+
 //========== LDrawDLDestroy ======================================================
 //
 // Purpose: free a display list - release GL and system memory.
 //
+// Notes:	A DL goes together with its detail levels, which share its VBOs -
+//			so none of them goes until a session is done with all of them.
+//
 //================================================================================	
 void LDrawDLDestroy(struct LDrawDL * dl)
 {
-	if(dl->instance_head != NULL)
+	int d;
+
+	if(dl->owner)
+		dl = dl->owner;
+
+	int in_use = (dl->instance_head != NULL);
+	for(d = detail_low; d < detail_count; ++d)
+		in_use = in_use || (dl->details[d] && dl->details[d]->instance_head != NULL);
+
+	if(in_use)
 	{
 		// Special case: if our DL is destroyed WHILE a session is using it for
 		// deferred drawing, we do NOT destroy it - we mark it for destruction
@@ -1443,6 +1828,11 @@ void LDrawDLDestroy(struct LDrawDL * dl)
 		// a silly way to get 'immediate' drawing.  In this case, the session
 		// may have intentionally deferred the DL.
 		dl->flags |= dl_needs_destroy;
+		for(d = detail_low; d < detail_count; ++d)
+		{
+			if(dl->details[d])
+				dl->details[d]->flags |= dl_needs_destroy;
+		}
 		return;
 	}
 	// Make sure that no instances from a session are queued to this list; if we
@@ -1451,6 +1841,9 @@ void LDrawDLDestroy(struct LDrawDL * dl)
 	// reason inval a DL mid-draw, which is usually a sign of coding error.
 	assert(dl->instance_head == NULL);
 
+	for(d = detail_low; d < detail_count; ++d)
+		free(dl->details[d]);
+
 	#if WANT_SMOOTH
 	glDeleteBuffers(1,&dl->idx_vbo);
 	#endif
@@ -36,7 +36,9 @@ static const char * attribs[] = {
 	"transform_w",
 	"color_current",
 	"color_compliment",
-	"texture_mix", NULL };
+	"texture_mix",
+	"position_offset",
+	"position_scale", NULL };
 
 
 @implementation LDrawShaderRenderer (OpenGL)
@@ -72,6 +74,8 @@ static const char * attribs[] = {
 	
 	[[[ColorLibrary sharedColorLibrary] colorForCode:LDrawCurrentColor] getColorRGBA:color_now];
 	glVertexAttrib1f(attr_texture_mix,0.0f);
+	glVertexAttrib4f(attr_position_offset,0.0f,0.0f,0.0f,0.0f);	// Float vertices until a display list says otherwise.
+	glVertexAttrib4f(attr_position_scale,1.0f,1.0f,1.0f,0.0f);
 	complimentColor(color_now, compl_now);
 	
 	// Set up the basic transform to be identity - our transform is on top of the MVP matrix.
@@ -242,6 +246,8 @@ static const char * attribs[] = {
 		glVertexAttrib4f(attr_transform_x+i,transform_now[i],transform_now[4+i],transform_now[8+i],transform_now[12+i]);
 
 	glVertexAttrib4f(attr_color,0.50,0.53,1.00,1.00);		// Nice lavendar color for the whole sphere.
+	glVertexAttrib4f(attr_position_offset,0.0f,0.0f,0.0f,0.0f);	// The sphere's vertices are plain floats.
+	glVertexAttrib4f(attr_position_scale,1.0f,1.0f,1.0f,0.0f);
 	
 	glBindVertexArrayAPPLE(vaoTag);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, vboVertexCount);
@@ -217,6 +217,7 @@
 
 	// DRAW!
 	LDrawShaderRenderer * ren = [[LDrawShaderRenderer alloc] initWithScale:[self zoomPercentageForGL]/100. modelView:[camera getModelView] projection:[camera getProjection]];
+	[ren setOcclusion:[self occlusionForFrame]];
 	[self->fileBeingDrawn drawSelf:ren];
 	[ren release];
 
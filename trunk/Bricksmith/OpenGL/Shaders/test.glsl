@@ -19,19 +19,38 @@ varying vec4	position_eye;
 	attribute	vec4	color_current;
 	attribute	vec4	color_compliment;
 	attribute	float	texture_mix;
+	attribute	vec4	position_offset;
+	attribute	vec4	position_scale;
+
+	// Compact vertices (see MeshSmooth.h) carry the normal octahedral-encoded.
+	vec3 decode_normal(vec2 oct)
+	{
+		vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+		if (n.z < 0.0)
+			n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		return normalize(n);
+	}
 	
 	void main (void)
 	{
+		// Float vertices come with an offset of 0 and a scale of (1,1,1,0);
+		// compact ones with their part's bounding box and a w of 1.  A compact
+		// position's w is 0 for vertices without a normal.
+		vec4	pos_local = vec4(position_offset.xyz + position.xyz * position_scale.xyz, 1.0);
+		vec3	norm_local = normal;
+		if (position_scale.w != 0.0)
+			norm_local = (position.w == 0.0) ? vec3(0) : decode_normal(normal.xy);
+
 		vec4	pos_obj = vec4(
-								dot(position, transform_x),
-								dot(position, transform_y),
-								dot(position, transform_z),
-								dot(position, transform_w));
+								dot(pos_local, transform_x),
+								dot(pos_local, transform_y),
+								dot(pos_local, transform_z),
+								dot(pos_local, transform_w));
 
 		vec3	norm_obj = vec3(
-								dot(normal, transform_x.xyz),
-								dot(normal, transform_y.xyz),
-								dot(normal, transform_z.xyz));
+								dot(norm_local, transform_x.xyz),
+								dot(norm_local, transform_y.xyz),
+								dot(norm_local, transform_z.xyz));
 	
 				normal_eye = normalize(gl_NormalMatrix * norm_obj);
 		vec4	eye_pos = gl_ModelViewMatrix * pos_obj;
@@ -46,7 +65,7 @@ varying vec4	position_eye;
 		gl_FrontColor.a = col.a;
 		gl_FrontColor.rgb = col.rgb;
 				 
-		if(normal == vec3(0))
+		if(norm_local == vec3(0))
 			gl_FrontColor = col;
 			
 //		gl_FrontColor.rgb = norm_obj;
@@ -55,8 +74,8 @@ varying vec4	position_eye;
 			vec4	eye_plane_t = gl_ObjectPlaneT[0];
 				 
 		tex_coord = vec2(
-					dot(eye_plane_s, position),
-					dot(eye_plane_t, position));
+					dot(eye_plane_s, pos_local),
+					dot(eye_plane_t, pos_local));
 					
 		tex_mix = texture_mix;
 	}
@@ -348,7 +348,18 @@ void AppendChoicesToNewItem(
 	[progressPanel showProgressPanel];
 
 	//do the actual loading.
-	success = [super readFromURL:absoluteURL ofType:typeName error:outError];
+	// Map local files rather than reading them; the parser works on the file 
+	// bytes in place. 
+	if([absoluteURL isFileURL] == YES)
+	{
+		NSData *data = [NSData dataWithContentsOfURL:absoluteURL
+											 options:NSDataReadingMappedIfSafe
+											   error:outError];
+		if(data != nil)
+			success = [self readFromData:data ofType:typeName error:outError];
+	}
+	else
+		success = [super readFromURL:absoluteURL ofType:typeName error:outError];
 	
 	[progressPanel close];
 	
@@ -430,7 +441,6 @@ void AppendChoicesToNewItem(
 			   ofType:(NSString *)typeName
 				error:(NSError **)outError
 {
-	NSString    	   *fileContents    = [LDrawUtilities stringFromFileData:data];
 	__block	LDrawFile  *newFile         = nil;
 	__block	BOOL        success         = NO;
 	__block NSError    *blockError      = nil;
@@ -448,7 +458,7 @@ void AppendChoicesToNewItem(
 			CFAbsoluteTime  startTime   = CFAbsoluteTimeGetCurrent();
 			CFTimeInterval  parseTime   = 0;
 			
-			newFile     = [LDrawFile parseFromFileContents:fileContents];
+			newFile     = [LDrawFile parseFromFileData:data];
 			parseTime   = CFAbsoluteTimeGetCurrent() - startTime;
 			
 #if DEBUG
@@ -819,6 +819,7 @@
 	NSString        *partSansWhitespace     = nil;
 	NSMutableArray  *matchingParts          = nil;
 	NSString        *searchSansWhitespace   = [searchString ams_stringByRemovingWhitespace];
+	NSSet           *keywordMatches         = nil;
 	
 	if([searchString length] == 0)
 	{
@@ -829,6 +830,10 @@
 	{
 		matchingParts = [NSMutableArray array];
 		
+		// Keywords are shared by many parts; the catalog checks each distinct 
+		// one just once. 
+		keywordMatches = [self->partLibrary partNamesWithKeywordContaining:searchSansWhitespace];
+		
 		NSArray * searchWords = [searchString componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
 		NSUInteger wordCount = [searchWords count];
 		
@@ -870,21 +875,8 @@
 						matches = FALSE;
 				}
 				
-				if(matches)
+				if(matches || [keywordMatches containsObject:partNumber])
 					[matchingParts addObject:record];
-				else
-				{
-					NSArray *keywords = [record objectForKey:PART_KEYWORDS_KEY];
-					
-					for(NSString* keyword in keywords)
-					{
-						if([[keyword ams_stringByRemovingWhitespace] ams_containsString:searchSansWhitespace options:NSCaseInsensitiveSearch])
-						{
-							[matchingParts addObject:record];
-							break;
-						}
-					}
-				}
 			}
 		}
 	}//end else we have to search
@@ -48,9 +48,7 @@
 			 inRange:(NSRange)range
 		 parentGroup:(dispatch_group_t)parentGroup
 {
-	NSString                *workingLine            = [lines objectAtIndex:range.location];
-	NSString                *parsedField            = nil;
-	Point3                  workingVertex           = ZeroPoint3;
+	LDrawGeometryLine       fields;
 	LDrawColor				*parsedColor			= nil;
 	
 	// Our superclass is LDrawLine, which has its own unique syntax, so we can't 
@@ -61,70 +59,26 @@
 	// raise an exception. We don't want this to happen here.
 	@try
 	{
-		//Read in the line code and advance past it.
-		parsedField = [LDrawUtilities readNextField:  workingLine
-										  remainder: &workingLine ];
 		//Only attempt to create the part if this is a valid line.
-		if([parsedField integerValue] == 5)
+		if(		[LDrawUtilities readGeometryLineAtIndex:range.location inLines:lines fields:&fields name:NULL] == YES
+		   &&	fields.lineType == 5 )
 		{
 			//Read in the color code.
 			// (color)
-			parsedField = [LDrawUtilities readNextField:  workingLine
-											  remainder: &workingLine ];
-			parsedColor = [LDrawUtilities parseColorFromField:parsedField];
+			parsedColor = [LDrawUtilities parseColorFromGeometryLine:&fields];
 			[self setLDrawColor:parsedColor];
 			
 			//Read Vertex 1.
-			// (x1)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.x = [parsedField floatValue];
-			// (y1)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.y = [parsedField floatValue];
-			// (z1)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.z = [parsedField floatValue];
+			[self setVertex1:V3Make(fields.values[0], fields.values[1], fields.values[2])];
 			
-			[self setVertex1:workingVertex];
-				
 			//Read Vertex 2.
-			// (x2)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.x = [parsedField floatValue];
-			// (y2)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.y = [parsedField floatValue];
-			// (z2)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.z = [parsedField floatValue];
-			
-			[self setVertex2:workingVertex];
+			[self setVertex2:V3Make(fields.values[3], fields.values[4], fields.values[5])];
 			
 			//Read Conditonal Vertex 1.
-			// (x3)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.x = [parsedField floatValue];
-			// (y3)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.y = [parsedField floatValue];
-			// (z3)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.z = [parsedField floatValue];
-			
-			[self setConditionalVertex1:workingVertex];
+			[self setConditionalVertex1:V3Make(fields.values[6], fields.values[7], fields.values[8])];
 			
 			//Read Conditonal Vertex 2.
-			// (x4)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.x = [parsedField floatValue];
-			// (y4)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.y = [parsedField floatValue];
-			// (z4)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.z = [parsedField floatValue];
-			
-			[self setConditionalVertex2:workingVertex];
+			[self setConditionalVertex2:V3Make(fields.values[9], fields.values[10], fields.values[11])];
 		}
 		else
 			@throw [NSException exceptionWithName:@"BricksmithParseException" reason:@"Bad conditional line syntax" userInfo:nil];
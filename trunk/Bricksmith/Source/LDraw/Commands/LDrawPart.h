@@ -52,6 +52,9 @@ typedef enum PartType {
 
 @property (strong) NSString * group;		// MLCAD group name or nil
 
+//Initialization
+- (id) initWithLines:(NSArray *)lines inRange:(NSRange)range parentGroup:(dispatch_group_t)parentGroup parseReference:(BOOL)shouldParse;
+
 //Directives
 - (void) drawBoundsWithColor:(LDrawColor *)drawingColor;
 - (NSString *) write;
@@ -66,6 +69,7 @@ typedef enum PartType {
 - (Matrix4) transformationMatrix;
 - (void) setDisplayName:(NSString *)newPartName;
 - (void) setDisplayName:(NSString *)newPartName parse:(BOOL)shouldParse inGroup:(dispatch_group_t)parentGroup;
+- (void) parseReferenceInGroup:(dispatch_group_t)parentGroup;
 - (void) setTransformComponents:(TransformComponents)newComponents;
 - (void) setTransformationMatrix:(Matrix4 *)newMatrix;
 
@@ -27,6 +27,7 @@
 #import "MacLDraw.h"
 #import "LDrawColor.h"
 #import "LDrawFile.h"
+#import "LDrawLineArray.h"
 #import "LDrawModel.h"
 #import "LDrawPaths.h"
 #import "LDrawStep.h"
@@ -122,11 +123,32 @@ int floatNearGrid(float v, float grid, float epsi)
 			 inRange:(NSRange)range
 		 parentGroup:(dispatch_group_t)parentGroup
 {
-	NSString    *workingLine    = [lines objectAtIndex:range.location];
-	NSString    *prevLine       = range.location > 0 ? [lines objectAtIndex:range.location - 1] : nil;
-	NSString    *parsedField    = nil;
-	Matrix4     transformation  = IdentityMatrix4;
-	LDrawColor  *parsedColor    = nil;
+	return [self initWithLines:lines inRange:range parentGroup:parentGroup parseReference:YES];
+	
+}//end initWithLines:inRange:parentGroup:
+
+
+//========== initWithLines:inRange:parentGroup:parseReference: =================
+//
+// Purpose:		Parses the part line. If shouldParse is NO, the model the part 
+//				refers to is not loaded; the caller must send 
+//				-parseReferenceInGroup: later. 
+//
+// Notes:		Without the reference load, this touches no shared state, so it 
+//				is safe to call from many threads at once (see 
+//				LDrawGeometryBatch). 
+//
+//==============================================================================
+- (id) initWithLines:(NSArray *)lines
+			 inRange:(NSRange)range
+		 parentGroup:(dispatch_group_t)parentGroup
+	  parseReference:(BOOL)shouldParse
+{
+	NSString            *prevLine       = range.location > 0 ? [lines objectAtIndex:range.location - 1] : nil;
+	NSString            *partName       = nil;
+	LDrawGeometryLine   fields;
+	Matrix4             transformation  = IdentityMatrix4;
+	LDrawColor          *parsedColor    = nil;
 	
 	self = [super initWithLines:lines inRange:range parentGroup:parentGroup];
 	
@@ -134,65 +156,38 @@ int floatNearGrid(float v, float grid, float epsi)
 	// raise an exception. We don't want this to happen here.
 	@try
 	{
-		//Read in the line code and advance past it.
-		parsedField = [LDrawUtilities readNextField:  workingLine
-										  remainder: &workingLine ];
 		//Only attempt to create the part if this is a valid line.
-		if([parsedField integerValue] == 1)
+		if(		[LDrawUtilities readGeometryLineAtIndex:range.location inLines:lines fields:&fields name:&partName] == YES
+		   &&	fields.lineType == 1 )
 		{
 			//Read in the color code.
 			// (color)
-			parsedField = [LDrawUtilities readNextField:  workingLine
-											  remainder: &workingLine ];
-			parsedColor = [LDrawUtilities parseColorFromField:parsedField];
+			parsedColor = [LDrawUtilities parseColorFromGeometryLine:&fields];
 			[self setLDrawColor:parsedColor];
 			
 			//Read position.
-			// (x)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[3][0] = [parsedField floatValue];
-			// (y)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[3][1] = [parsedField floatValue];
-			// (z)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[3][2] = [parsedField floatValue];
-			
+			// (x y z)
+			transformation.element[3][0] = fields.values[0];
+			transformation.element[3][1] = fields.values[1];
+			transformation.element[3][2] = fields.values[2];
 			
 			//Read Transformation X.
-			// (a)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[0][0] = [parsedField floatValue];
-			// (b)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[1][0] = [parsedField floatValue];
-			// (c)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[2][0] = [parsedField floatValue];
-			
+			// (a b c)
+			transformation.element[0][0] = fields.values[3];
+			transformation.element[1][0] = fields.values[4];
+			transformation.element[2][0] = fields.values[5];
 			
 			//Read Transformation Y.
-			// (d)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[0][1] = [parsedField floatValue];
-			// (e)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[1][1] = [parsedField floatValue];
-			// (f)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[2][1] = [parsedField floatValue];
-			
+			// (d e f)
+			transformation.element[0][1] = fields.values[6];
+			transformation.element[1][1] = fields.values[7];
+			transformation.element[2][1] = fields.values[8];
 			
 			//Read Transformation Z.
-			// (g)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[0][2] = [parsedField floatValue];
-			// (h)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[1][2] = [parsedField floatValue];
-			// (i)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			transformation.element[2][2] = [parsedField floatValue];
+			// (g h i)
+			transformation.element[0][2] = fields.values[9];
+			transformation.element[1][2] = fields.values[10];
+			transformation.element[2][2] = fields.values[11];
 			
 			//finish off the corner of the matrix.
 			transformation.element[3][3] = 1;
@@ -200,10 +195,10 @@ int floatNearGrid(float v, float grid, float epsi)
 			[self setTransformationMatrix:&transformation];
 			
 			//Read Part Name
-			// (part.dat) -- It can have spaces (for MPD models), so we just use the whole 
-			// rest of the line.
-			[self setDisplayName:[workingLine stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]]
-						   parse:YES
+			// (part.dat) -- It can have spaces (for MPD models), so the 
+			// tokenizer hands back the whole rest of the line.
+			[self setDisplayName:partName
+						   parse:shouldParse
 						 inGroup:parentGroup];
 			
 			self.group = [LDrawUtilities parseGroup:prevLine];
@@ -223,7 +218,7 @@ int floatNearGrid(float v, float grid, float epsi)
 	
 	return self;
 	
-}//end initWithLines:inRange:
+}//end initWithLines:inRange:parentGroup:parseReference:
 
 
 //========== initWithCoder: ====================================================
@@ -873,7 +868,6 @@ To work, this needs to multiply the modelViewGLMatrix by the part transform.
 				inGroup:(dispatch_group_t)parentGroup
 {
 	NSString            *newReferenceName   = [newPartName lowercaseString];
-	dispatch_group_t    parseGroup          = NULL;
 
 	displayName = newPartName;
 	
@@ -891,7 +885,24 @@ To work, this needs to multiply the modelViewGLMatrix by the part transform.
 	// we don't know what kind of thing we are, checking the cache type will
 	// always return unresolved.  But I don't think I want to force-resolve 
 	// here - resolving later prevents thrash.
-	if(shouldParse == YES && newPartName != nil && [newPartName length] > 0)
+	if(shouldParse == YES)
+	{
+		[self parseReferenceInGroup:parentGroup];
+	}
+	
+}//end setDisplayName:
+
+
+//========== parseReferenceInGroup: ============================================
+//
+// Purpose:		Pre-loads the model the part refers to, if there is one.
+//
+//==============================================================================
+- (void) parseReferenceInGroup:(dispatch_group_t)parentGroup
+{
+	dispatch_group_t    parseGroup          = NULL;
+	
+	if(displayName != nil && [displayName length] > 0)
 	{
 #if USE_BLOCKS
 		// Create a parsing group if needed.
@@ -910,7 +921,7 @@ To work, this needs to multiply the modelViewGLMatrix by the part transform.
 #endif	
 	}
 	
-}//end setDisplayName:
+}//end parseReferenceInGroup:
 
 
 //========== setTransformComponents: ===========================================
@@ -1708,16 +1719,14 @@ To work, this needs to multiply the modelViewGLMatrix by the part transform.
 		// of this - this is just a one-time look at a file for a one-time migration
 		// operation.
 		NSString    *partPath       = [[LDrawPaths sharedPaths] pathForPartName:referenceName];
-		NSString *  fileContents    = [LDrawUtilities stringFromFile:partPath];
-		NSArray * 	lines           = [fileContents separateByLine];
+		LDrawLineStream *stream     = [LDrawLineStream streamFromFile:partPath];
 		
 		dispatch_group_t parseGroup = NULL;
 #if USE_BLOCKS
 		parseGroup 					= dispatch_group_create();
 #endif
-		LDrawFile * parsedFile      = [[LDrawFile alloc] initWithLines:lines
-															   inRange:NSMakeRange(0, [lines count])
-														   parentGroup:parseGroup];
+		LDrawFile * parsedFile      = [[LDrawFile alloc] initWithLineStream:stream
+															        parentGroup:parseGroup];
 
 #if USE_BLOCKS
 		// The part parser is insanely dangerous: it parses on a dispatch group and fills in your
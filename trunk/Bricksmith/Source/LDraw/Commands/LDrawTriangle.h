@@ -31,9 +31,11 @@
 - (Point3) vertex1;
 - (Point3) vertex2;
 - (Point3) vertex3;
+- (Vector3) normal;
 -(void) setVertex1:(Point3)newVertex;
 -(void) setVertex2:(Point3)newVertex;
 -(void) setVertex3:(Point3)newVertex;
+-(void) setNormal:(Vector3)newNormal;
 
 //Utilities
 - (void) recomputeNormal;
@@ -49,10 +49,8 @@
 			 inRange:(NSRange)range
 		 parentGroup:(dispatch_group_t)parentGroup
 {
-	NSString    *workingLine    = [lines objectAtIndex:range.location];
-	NSString    *parsedField    = nil;
-	Point3      workingVertex   = ZeroPoint3;
-	LDrawColor  *parsedColor    = nil;
+	LDrawGeometryLine   fields;
+	LDrawColor          *parsedColor    = nil;
 	
 	self = [super initWithLines:lines inRange:range parentGroup:parentGroup];
 	
@@ -60,57 +58,23 @@
 	// raise an exception. We don't want this to happen here.
 	@try
 	{
-		//Read in the line code and advance past it.
-		parsedField = [LDrawUtilities readNextField:  workingLine
-										  remainder: &workingLine ];
 		//Only attempt to create the part if this is a valid line.
-		if([parsedField integerValue] == 3)
+		if(		[LDrawUtilities readGeometryLineAtIndex:range.location inLines:lines fields:&fields name:NULL] == YES
+		   &&	fields.lineType == 3 )
 		{
 			//Read in the color code.
 			// (color)
-			parsedField = [LDrawUtilities readNextField:  workingLine
-											  remainder: &workingLine ];
-			parsedColor = [LDrawUtilities parseColorFromField:parsedField];
+			parsedColor = [LDrawUtilities parseColorFromGeometryLine:&fields];
 			[self setLDrawColor:parsedColor];
 			
 			//Read Vertex 1.
-			// (x1)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.x = [parsedField floatValue];
-			// (y1)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.y = [parsedField floatValue];
-			// (z1)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.z = [parsedField floatValue];
+			[self setVertex1:V3Make(fields.values[0], fields.values[1], fields.values[2])];
 			
-			[self setVertex1:workingVertex];
-				
 			//Read Vertex 2.
-			// (x2)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.x = [parsedField floatValue];
-			// (y2)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.y = [parsedField floatValue];
-			// (z2)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.z = [parsedField floatValue];
-			
-			[self setVertex2:workingVertex];
+			[self setVertex2:V3Make(fields.values[3], fields.values[4], fields.values[5])];
 			
 			//Read Vertex 3.
-			// (x3)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.x = [parsedField floatValue];
-			// (y3)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.y = [parsedField floatValue];
-			// (z3)
-			parsedField = [LDrawUtilities readNextField:workingLine  remainder: &workingLine ];
-			workingVertex.z = [parsedField floatValue];
-			
-			[self setVertex3:workingVertex];
+			[self setVertex3:V3Make(fields.values[6], fields.values[7], fields.values[8])];
 		}
 		else
 			@throw [NSException exceptionWithName:@"BricksmithParseException" reason:@"Bad triangle syntax" userInfo:nil];
@@ -553,6 +517,15 @@
 }//end vertex3
 
 
+//========== normal ============================================================
+//==============================================================================
+- (Vector3) normal
+{
+	return self->normal;
+	
+}//end normal
+
+
 #pragma mark -
 
 //========== setSelected: ======================================================
@@ -645,6 +618,22 @@
 }//end setVertex3:
 
 
+//========== setNormal: ========================================================
+//
+// Purpose:		Overrides the normal computed from the vertices. Flattening
+//				transforms normals rather than recomputing them (they differ in
+//				sign under mirroring), so a saved flattened triangle must
+//				restore its normal after its vertices.
+//
+//==============================================================================
+-(void) setNormal:(Vector3)newNormal
+{
+	self->normal = newNormal;
+	[self invalCache:DisplayList];
+	
+}//end setNormal:
+
+
 #pragma mark -
 #pragma mark ACTIONS
 #pragma mark -
@@ -13,6 +13,7 @@
 #import "LDrawContainer.h"
 
 // forward declarations
+@class LDrawLineStream;
 @class LDrawMPDModel;
 
 
@@ -37,6 +38,8 @@
 + (LDrawFile *) file;
 + (LDrawFile *) fileFromContentsAtPath:(NSString *)path;
 + (LDrawFile *) parseFromFileContents:(NSString *) fileContents;
++ (LDrawFile *) parseFromFileData:(NSData *)fileData;
+- (id) initWithLineStream:(LDrawLineStream *)stream parentGroup:(dispatch_group_t)parentGroup;
 
 // Directives
 - (void) collectColorsFromConfig;
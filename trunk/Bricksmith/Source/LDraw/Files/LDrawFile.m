@@ -20,6 +20,7 @@
 
 #import "MacLDraw.h"
 #import  LDrawDirectiveGPU_h
+#import "LDrawLineArray.h"
 #import "LDrawMPDModel.h"
 #import "LDrawPart.h"
 #import "LDrawUtilities.h"
@@ -58,15 +59,18 @@
 //
 // Purpose:		Reads a file from the specified path. 
 //
+// Notes:		The file is mapped and split into submodels as it is read; it is 
+//				never decoded into one big string, nor indexed all at once. 
+//
 //------------------------------------------------------------------------------
 + (LDrawFile *) fileFromContentsAtPath:(NSString *)path
 {
-	NSString	*fileContents	= [LDrawUtilities stringFromFile:path];
-	LDrawFile	*parsedFile		= nil;
+	LDrawLineStream	*stream			= [LDrawLineStream streamFromFile:path];
+	LDrawFile		*parsedFile		= nil;
 	
-	if(fileContents != nil)
+	if(stream != nil)
 	{
-		parsedFile = [LDrawFile parseFromFileContents:fileContents];
+		parsedFile = [LDrawFile parseFromLineStream:stream];
 		[parsedFile setPath:path];
 	}
 		
@@ -79,18 +83,60 @@
 //
 // Purpose:		Reads a file out of the raw file contents. 
 //
+// Notes:		The string is parsed from its UTF-8 bytes, which split into the 
+//				same lines -separateByLine would give without an array of them 
+//				all. 
+//
 //------------------------------------------------------------------------------
 + (LDrawFile *) parseFromFileContents:(NSString *) fileContents
 {
-	LDrawFile   *newFile    = nil;
-	NSArray     *lines      = [fileContents separateByLine];
+	return [LDrawFile parseFromFileData:[fileContents dataUsingEncoding:NSUTF8StringEncoding]];
 	
-	newFile = [[LDrawFile alloc] initWithLines:lines
-									   inRange:NSMakeRange(0, [lines count]) ];
+}//end parseFromFileContents:allowThreads:
+
+
+//---------- parseFromFileData: --------------------------------------[static]--
+//
+// Purpose:		Reads a file out of its raw bytes, without decoding them into a 
+//				string first. 
+//
+//------------------------------------------------------------------------------
++ (LDrawFile *) parseFromFileData:(NSData *)fileData
+{
+	LDrawLineStream	*stream		= [LDrawLineStream streamFromData:fileData];
+	LDrawFile		*newFile	= nil;
+	
+	if(stream != nil)
+		newFile = [LDrawFile parseFromLineStream:stream];
 	
 	return newFile;
 	
-}//end parseFromFileContents:allowThreads:
+}//end parseFromFileData:
+
+
+//---------- parseFromLineStream: ------------------------------------[static]--
+//
+// Purpose:		Performs a blocking parse of the stream. 
+//
+//------------------------------------------------------------------------------
++ (LDrawFile *) parseFromLineStream:(LDrawLineStream *)stream
+{
+	LDrawFile			*newFile	= nil;
+	dispatch_group_t	group		= NULL;
+	
+#if USE_BLOCKS
+	group = dispatch_group_create();
+#endif
+
+	newFile = [[LDrawFile alloc] initWithLineStream:stream parentGroup:group];
+	
+#if USE_BLOCKS
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+#endif
+	
+	return newFile;
+	
+}//end parseFromLineStream:
 
 
 #pragma mark -
@@ -229,6 +275,92 @@
 }//end initWithLines:inRange:
 
 
+//========== initWithLineStream:parentGroup: ===================================
+//
+// Purpose:		Parses the MPD models out of the stream. If it holds a single 
+//				non-MPD model, it will be wrapped in an MPD model. 
+//
+// Notes:		Each submodel's lines are handed off for parsing as soon as the 
+//				stream finds the end of them, so on a large file the first 
+//				models are being parsed while the later ones are still being 
+//				read. Only one submodel's worth of lines is ever indexed ahead 
+//				of the parsers. 
+//
+//==============================================================================
+- (id) initWithLineStream:(LDrawLineStream *)stream
+			  parentGroup:(dispatch_group_t)parentGroup
+{
+	LDrawLineArray		*modelLines		= [LDrawMPDModel linesOfModelFromStream:stream];
+	NSMutableArray		*parsedModels	= [NSMutableArray array];
+	
+	// An empty file has no models; same as an empty range of lines. 
+	if(modelLines == nil)
+		return nil;
+	
+	self = [self init];
+	if(self)
+	{
+		dispatch_group_t    dispatchGroup = NULL;
+#if USE_BLOCKS		
+		dispatch_queue_t    queue           = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);	
+							dispatchGroup   = dispatch_group_create();
+
+		if(parentGroup != NULL)
+			dispatch_group_enter(parentGroup);
+#endif
+		
+		do
+		{
+			// Each model's parse gets a box of its own to put its result in. 
+			// The boxes are only ever touched by one thread at a time, unlike 
+			// parsedModels. 
+			NSMutableArray *parsedModel = [NSMutableArray arrayWithCapacity:1];
+			
+			[parsedModels addObject:parsedModel];
+#if USE_BLOCKS			
+			dispatch_group_async(dispatchGroup, queue,
+			^{
+#endif			
+				LDrawMPDModel *newModel = [[LDrawMPDModel alloc] initWithLines:modelLines
+																	   inRange:NSMakeRange(0, [modelLines count])
+																   parentGroup:dispatchGroup];
+				if(newModel != nil)
+					[parsedModel addObject:newModel];
+#if USE_BLOCKS
+			});
+#endif			
+			
+			modelLines = [LDrawMPDModel linesOfModelFromStream:stream];
+		}
+		while(modelLines != nil);
+
+#if USE_BLOCKS		
+		dispatch_group_notify(dispatchGroup,queue,
+		^{
+#endif		
+			// Add all the models in order
+			for(NSArray *parsedModel in parsedModels)
+			{
+				for(LDrawMPDModel *currentModel in parsedModel)
+					[self addSubmodel:currentModel];
+			}
+			
+			if([[self submodels] count] > 0)
+				[self setActiveModel:[[self submodels] objectAtIndex:0]];
+
+#if USE_BLOCKS			
+			if(parentGroup != NULL)
+				dispatch_group_leave(parentGroup);
+			
+		});
+#endif		
+	}
+	
+	return self;
+
+}//end initWithLineStream:parentGroup:
+
+
 //========== initWithCoder: ====================================================
 //
 // Purpose:		Reads a representation of this object from the given coder,
@@ -0,0 +1,64 @@
+//==============================================================================
+//
+// File:		LDrawGeometryBatch.h
+//
+// Purpose:		Parses the type 1-5 lines of a model on all cores at once.
+//
+//				As a model's steps are read, each one reserves a slot for every
+//				geometry line it contains and hands the line to the batch
+//				instead of parsing it. Once the whole model has been read, the
+//				batch parses everything it was given in parallel and drops each
+//				new directive into its slot, so the steps end up exactly as if
+//				they had been parsed line by line.
+//
+//				The lines are pooled across all the steps of the model, so a
+//				huge single-step model and a model with thousands of tiny steps
+//				parallelize equally well.
+//
+//==============================================================================
+#import <Foundation/Foundation.h>
+
+@class LDrawDirective;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// A geometry line waiting to be parsed.
+typedef struct
+{
+	__unsafe_unretained Class	commandClass;
+	NSRange						range;
+	LDrawDirective * __strong	*slot;			// where the parsed directive goes
+
+} LDrawPendingDirective;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// LDrawGeometryBatch
+//
+////////////////////////////////////////////////////////////////////////////////
+@interface LDrawGeometryBatch : NSObject
+{
+	NSArray					*lines;
+	dispatch_group_t		parentGroup;
+
+	LDrawPendingDirective	*pending;
+	NSUInteger				pendingCount;
+	NSUInteger				pendingCapacity;
+}
+
+// Initialization
+- (id) initWithLines:(NSArray *)lines parentGroup:(dispatch_group_t)parentGroup;
+
+// Parsing
+- (void) addDirectiveOfClass:(Class)commandClass
+					 inRange:(NSRange)range
+						slot:(LDrawDirective * __strong *)slot;
+- (void) parse;
+
+@end
@@ -0,0 +1,168 @@
+//==============================================================================
+//
+// File:		LDrawGeometryBatch.m
+//
+// Purpose:		Parses the type 1-5 lines of a model on all cores at once.
+//
+// Notes:		Only geometry lines are batched. Meta-commands can reach shared
+//				state (textures load images, LSynth consults its configuration)
+//				so they are still parsed in order on the calling thread.
+//
+//				Part lines are parsed without pre-loading the model they refer
+//				to, since the part library is not thread-safe. Those loads are
+//				made afterwards, on the calling thread, in file order.
+//
+//==============================================================================
+#import "LDrawGeometryBatch.h"
+
+#import "LDrawPart.h"
+
+// Fewest lines worth handing to another thread. Below this the dispatch
+// overhead outweighs the parsing.
+#define MINIMUM_CHUNK_SIZE		128
+
+// Aim for this many chunks per core, so that a core which finishes early can
+// pick up work left over from one that is slower (larger parts, page faults).
+#define CHUNKS_PER_CORE			8
+
+
+@implementation LDrawGeometryBatch
+
+#pragma mark -
+#pragma mark INITIALIZATION
+#pragma mark -
+
+//========== initWithLines:parentGroup: ========================================
+//
+// Purpose:		Creates an empty batch for lines of the given file.
+//
+//==============================================================================
+- (id) initWithLines:(NSArray *)linesIn parentGroup:(dispatch_group_t)parentGroupIn
+{
+	self = [super init];
+
+	if(self)
+	{
+		lines			= linesIn;
+		parentGroup		= parentGroupIn;
+		pending			= NULL;
+		pendingCount	= 0;
+		pendingCapacity	= 0;
+	}
+
+	return self;
+
+}//end initWithLines:parentGroup:
+
+
+#pragma mark -
+#pragma mark PARSING
+#pragma mark -
+
+//========== addDirectiveOfClass:inRange:slot: =================================
+//
+// Purpose:		Queues the directive in range for parsing. The result will be
+//				stored in *slot when -parse is called.
+//
+//==============================================================================
+- (void) addDirectiveOfClass:(Class)commandClass
+					 inRange:(NSRange)range
+						slot:(LDrawDirective * __strong *)slot
+{
+	if(pendingCount == pendingCapacity)
+	{
+		pendingCapacity	= MAX(256, pendingCapacity * 2);
+		pending			= realloc(pending, pendingCapacity * sizeof(LDrawPendingDirective));
+	}
+
+	pending[pendingCount].commandClass	= commandClass;
+	pending[pendingCount].range			= range;
+	pending[pendingCount].slot			= slot;
+	pendingCount += 1;
+
+}//end addDirectiveOfClass:inRange:slot:
+
+
+//========== parse =============================================================
+//
+// Purpose:		Parses every queued directive. Returns once they are all done.
+//
+// Notes:		dispatch_apply hands chunks out to the global queue's threads
+//				as they become free, so uneven chunks balance themselves.
+//
+//==============================================================================
+- (void) parse
+{
+	LDrawPendingDirective	*directives		= pending;
+	NSArray					*parseLines		= lines;
+	NSUInteger				count			= pendingCount;
+	NSUInteger				coreCount		= [[NSProcessInfo processInfo] activeProcessorCount];
+	NSUInteger				chunkSize		= MAX(MINIMUM_CHUNK_SIZE, count / (coreCount * CHUNKS_PER_CORE));
+	NSUInteger				chunkCount		= (count + chunkSize - 1) / chunkSize;
+	NSUInteger				counter			= 0;
+	Class					partClass		= [LDrawPart class];
+
+	void (^parseChunk)(size_t) = ^(size_t chunk)
+	{
+		@autoreleasepool
+		{
+			NSUInteger	start	= chunk * chunkSize;
+			NSUInteger	end		= MIN(start + chunkSize, count);
+			NSUInteger	index	= 0;
+
+			for(index = start; index < end; index++)
+			{
+				LDrawPendingDirective	*directive	= directives + index;
+
+				if(directive->commandClass == partClass)
+				{
+					*directive->slot = [[LDrawPart alloc] initWithLines:parseLines
+																inRange:directive->range
+															parentGroup:NULL
+														 parseReference:NO];
+				}
+				else
+				{
+					*directive->slot = [[directive->commandClass alloc] initWithLines:parseLines
+																			  inRange:directive->range
+																		  parentGroup:NULL];
+				}
+			}
+		}
+	};
+
+	if(chunkCount > 1)
+		dispatch_apply(chunkCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), parseChunk);
+	else if(chunkCount == 1)
+		parseChunk(0);
+
+	// Now that we're back on one thread, pull in the models the parts refer
+	// to, in the order they appear in the file.
+	for(counter = 0; counter < count; counter++)
+	{
+		if(directives[counter].commandClass == partClass)
+			[(LDrawPart *)*directives[counter].slot parseReferenceInGroup:parentGroup];
+	}
+
+	pendingCount = 0;
+
+}//end parse
+
+
+#pragma mark -
+#pragma mark DESTRUCTOR
+#pragma mark -
+
+//========== dealloc ===========================================================
+//
+// Purpose:		Frees the queue.
+//
+//==============================================================================
+- (void) dealloc
+{
+	free(pending);
+
+}//end dealloc
+
+
+@end
@@ -12,6 +12,9 @@
 #import "LDrawDirective.h"
 #import "LDrawModel.h"
 
+@class LDrawLineArray;
+@class LDrawLineStream;
+
 @interface LDrawMPDModel : LDrawModel <NSCoding>
 {
 	@private
@@ -22,6 +25,7 @@
 }
 
 + (id) model;
++ (LDrawLineArray *) linesOfModelFromStream:(LDrawLineStream *)stream;
 
 // Directives
 - (NSString *) writeModel;
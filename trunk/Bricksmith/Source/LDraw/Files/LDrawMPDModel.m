@@ -26,6 +26,7 @@
 
 #import "LDrawFile.h"
 #import "LDrawKeywords.h"
+#import "LDrawLineArray.h"
 #import "LDrawUtilities.h"
 #import "StringCategory.h"
 
@@ -189,6 +190,54 @@
 
 #pragma mark -
 
+//---------- linesOfModelFromStream: ---------------------------------[static]--
+//
+// Purpose:		Reads the lines of the next model in the stream, by the same 
+//				rules as +rangeOfDirectiveBeginningAtIndex:inLines:maxIndex:. 
+//				Returns nil at the end of the file. 
+//
+// Notes:		The model's lines are tested as they come off the stream, and 
+//				nothing after its end has been read when this returns. So the 
+//				model can be handed off for parsing while the rest of the file 
+//				is still being split. 
+//
+//------------------------------------------------------------------------------
++ (LDrawLineArray *) linesOfModelFromStream:(LDrawLineStream *)stream
+{
+	const char	*bytes		= NULL;
+	size_t		length		= 0;
+	BOOL		isMPDModel	= NO;
+	
+	bytes = [stream nextLineWithLength:&length];
+	if(bytes == NULL)
+		return nil;
+	
+	// See if we have to look for MPD syntax.
+	isMPDModel = LDrawLineIsMetaCommand(bytes, length, [LDRAW_MPD_SUBMODEL_START UTF8String]);
+	
+	while((bytes = [stream nextLineWithLength:&length]) != NULL)
+	{
+		// Non-MPD models just go to the end of the file. MPD models can end 
+		// with 0 NOFILE, or they can just stop where the next model starts. 
+		if(isMPDModel == NO)
+			continue;
+		
+		if(LDrawLineIsMetaCommand(bytes, length, [LDRAW_MPD_SUBMODEL_END UTF8String]))
+		{
+			break;
+		}
+		else if(LDrawLineIsMetaCommand(bytes, length, [LDRAW_MPD_SUBMODEL_START UTF8String]))
+		{
+			[stream putBackLine];
+			break;
+		}
+	}
+	
+	return [stream takeLines];
+	
+}//end linesOfModelFromStream:
+
+
 //---------- rangeOfDirectiveBeginningAtIndex:inLines:maxIndex: ------[static]--
 //
 // Purpose:		Returns the range from the beginning to the end of the model.
@@ -198,9 +247,7 @@
 									 inLines:(NSArray *)lines
 									maxIndex:(NSUInteger)maxIndex
 {
-	NSString    *firstLine      = nil;
 	BOOL        isMPDModel      = NO;
-	NSString    *currentLine    = nil;
 	NSRange     testRange       = NSMakeRange(index, maxIndex - index + 1);
 	NSRange     modelRange      = testRange;
 	NSUInteger	counter			= 0;
@@ -209,8 +256,7 @@
 	if(testRange.length > 1)
 	{
 		// See if we have to look for MPD syntax.
-		firstLine = [lines objectAtIndex:testRange.location];
-		isMPDModel = [[self class] lineIsMPDModelStart:firstLine modelName:NULL];
+		isMPDModel = [LDrawUtilities lineAtIndex:testRange.location inLines:lines isMetaCommand:LDRAW_MPD_SUBMODEL_START];
 		
 		// Find the end of the MPD model. MPD models can end with 0 NOFILE, or 
 		// they can just stop where the next model starts. 
@@ -222,14 +268,12 @@
 		
 			for(counter = testRange.location + 1; counter < NSMaxRange(testRange); counter++)
 			{
-				currentLine = [lines objectAtIndex:counter];
-				
-				if([[self class] lineIsMPDModelEnd:currentLine])
+				if([LDrawUtilities lineAtIndex:counter inLines:lines isMetaCommand:LDRAW_MPD_SUBMODEL_END])
 				{
 					modelEndIndex = counter;
 					break;
 				}
-				else if([[self class] lineIsMPDModelStart:currentLine modelName:NULL])
+				else if([LDrawUtilities lineAtIndex:counter inLines:lines isMetaCommand:LDRAW_MPD_SUBMODEL_START])
 				{
 					modelEndIndex = counter - 1;
 					break;
@@ -41,6 +41,16 @@
 													// some drawing on library parts.
 	LDrawDLHandle			dl;						// Cached DL if we have one.
 	LDrawDLCleanup_f		dl_dtor;
+	LDrawDLBuildHandle		dl_build;				// Replacement DL still being built, if any.
+	LDrawDLBuildCancel_f	dl_build_cancel;
+	
+	struct LDrawBVHStruct	*partBVH;				// Bounds of our parts, to cull them all at once.
+	BOOL					partBVHChecked;			// YES once we've looked - small models have none.
+	NSArray					*bvhParts;				// The part behind each BVH item...
+	NSArray					*bvhOthers;				// ...and every other directive in the steps drawn.
+	NSMapTable				*bvhItems;				// BVH item of each part.
+	NSMutableIndexSet		*bvhMoved;				// Items whose bounds changed since the last refit.
+	int						*bvhVisible;			// Room for every item, for the renderer to cull into.
 }
 
 //Initialization
@@ -78,6 +88,7 @@
 - (NSUInteger) maxStepIndexToOutput;
 - (NSUInteger) numberElements;
 - (void) optimizeStructure;
+- (void) setOptimizedSteps:(NSArray *)newSteps boundingBox:(Box3)bounds;
 - (NSUInteger) parseHeaderFromLines:(NSArray *)lines beginningAtIndex:(NSUInteger)index;
 - (BOOL) line:(NSString *)line isValidForHeader:(NSString *)headerKey info:(NSString**)infoPtr;
 
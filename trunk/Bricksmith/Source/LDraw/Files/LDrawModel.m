@@ -19,10 +19,12 @@
 #import <string.h>
 
 #import "ColorLibrary.h"
+#import "LDrawBVH.h"
 #import "LDrawColor.h"
 #import "LDrawConditionalLine.h"
 #import  LDrawDirectiveGPU_h
 #import "LDrawFile.h"
+#import "LDrawGeometryBatch.h"
 #import "LDrawKeywords.h"
 #import "LDrawLine.h"
 #import "LDrawQuadrilateral.h"
@@ -43,6 +45,19 @@
 
 #define NO_CULL_SMALL_BRICKS 1
 
+// Small bricks are drawn from simplified detail levels of their display lists.
+// The levels stay within half a pixel of the real thing, so unlike culling
+// this doesn't change what the benchmarks measure - but it can be turned off
+// to compare.
+#define NO_DETAIL_LEVELS 0
+
+// Models with at least this many parts in the steps being drawn keep a BVH of
+// their parts' bounds, and find the parts that are on screen with one walk of
+// it rather than by drawing every part and letting each cull itself.  Parts
+// off screen are then skipped even with NO_CULL_SMALL_BRICKS; too-small ones
+// only without.  0 turns the BVH off.
+#define PART_BVH_MINIMUM 64
+
 @implementation LDrawModel
 
 
@@ -123,6 +138,8 @@
 	NSUInteger			maxLineIndex		= 0;
 	NSUInteger			insertIndex			= 0;
 	__strong LDrawStep	**substeps			= NULL;
+	LDrawGeometryBatch	*batch				= nil;
+	NSUInteger			counter				= 0;
 	
 	//Start with a nice blank model.
 	self = [super initWithLines:lines inRange:range parentGroup:parentGroup];
@@ -137,62 +154,47 @@
 	contentStartIndex   = [self parseHeaderFromLines:lines beginningAtIndex:range.location];
 	maxLineIndex        = NSMaxRange(range) - 1;
 
-	dispatch_group_t	modelDispatchGroup = NULL;
-#if USE_BLOCKS
-	modelDispatchGroup = dispatch_group_create();
-	dispatch_queue_t	queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-	if(parentGroup != NULL)
-		dispatch_group_enter(parentGroup);
-#endif
 	// Parse out steps. Each time we run into a new 0 STEP command, we finish 
-	// the current step. 
+	// the current step. The geometry of every step is parsed together, in 
+	// parallel, once all the steps have been read. 
+	batch = [[LDrawGeometryBatch alloc] initWithLines:lines parentGroup:parentGroup];
 	do
 	{
 		stepRange   = [LDrawStep rangeOfDirectiveBeginningAtIndex:contentStartIndex inLines:lines maxIndex:maxLineIndex];
-#if USE_BLOCKS
-		dispatch_group_async(modelDispatchGroup,queue,
-		^{
-#endif
-			LDrawStep * newStep     = [[LDrawStep alloc] initWithLines:lines inRange:stepRange parentGroup:modelDispatchGroup];
-			substeps[insertIndex] = newStep;
-#if USE_BLOCKS
-		});
-#endif
+		
+		substeps[insertIndex] = [[LDrawStep alloc] initWithLines:lines
+														 inRange:stepRange
+													 parentGroup:parentGroup
+												   geometryBatch:batch];
 		++insertIndex;
 
 		contentStartIndex = NSMaxRange(stepRange);
 		
 	}
 	while(contentStartIndex < NSMaxRange(range));
+	
+	[batch parse];
 		
-#if USE_BLOCKS
-	dispatch_group_notify(modelDispatchGroup,queue,
-	^{
-#endif
-		NSUInteger      counter				= 0;
-		for(counter = 0; counter < insertIndex; counter++)
-		{
-			LDrawStep * step = substeps[counter];
-			
-			[self addStep:step];
-			
-			// Tell ARC to release the object
-			substeps[counter] = nil;
-		}
+	for(counter = 0; counter < insertIndex; counter++)
+	{
+		LDrawStep * step = substeps[counter];
+		
+		[step finishParsing];
+		[self addStep:step];
+		
+		// Tell ARC to release the object
+		substeps[counter] = nil;
+	}
 
-		free(substeps);
-			
-		// Degenerate case: utterly empty file. Create one empty step, because it is 
-		// illegal to have a 0-step model in Bricksmith. 
-		if([[self steps] count] == 0)
-		{
-			[self addStep];
-		}
-#if USE_BLOCKS
-		if(parentGroup != NULL)
-			dispatch_group_leave(parentGroup);
-	});
-#endif	
+	free(substeps);
+		
+	// Degenerate case: utterly empty file. Create one empty step, because it is 
+	// illegal to have a 0-step model in Bricksmith. 
+	if([[self steps] count] == 0)
+	{
+		[self addStep];
+	}
+	
 	return self;
 	
 }//end initWithLines:inRange:
@@ -281,6 +283,13 @@
 //				collection is not recursive.  We count on the library being 
 //				flattened to ensure one VBO per library part.
 //
+//				Smoothing a big DL takes long enough to stall the UI, so the
+//				renderer does it in the background; until the DL is ready we
+//				draw our bounding box instead.
+//
+//				Big models only draw the parts that are on screen, culled all
+//				at once through a BVH of their bounds.
+//
 //================================================================================
 - (void) drawSelf:(id<LDrawCoreRenderer>)renderer
 {
@@ -288,7 +297,9 @@
 	// on the GPU not eating data fast enough, _not_ on CPU.  So burning a
 	// tiny bit of CPU time per part to cull draw calls is a win!
 	
-	#if !NO_CULL_SMALL_BRICKS
+	// The same check picks the detail level our DL is drawn at.
+	
+	#if !NO_CULL_SMALL_BRICKS || !NO_DETAIL_LEVELS
 	
 	Box3	my_bounds = [self boundingBox3];
 	
@@ -297,6 +308,7 @@
 	
 	int cull_result = [renderer checkCull:minxyz to:maxxyz];
 
+	#if !NO_CULL_SMALL_BRICKS
 	if(cull_result == cull_skip)
 		return;
 		
@@ -305,36 +317,65 @@
 		[renderer drawBoxFrom:minxyz to:maxxyz];
 		return;
 	}
+	#else
+	(void) cull_result;
+	#endif
 
 	#endif
 
 	// DL cache control: we may have to throw out our old DL if it has gone
-	// stale. EITHER WAY we mark our DL bit as validated per the rules of
-	// the observable protocol.
-	if(dl)
+	// stale - and the one being built, which is just as stale, and our parts'
+	// BVH, since parts may have come or gone. EITHER WAY we mark our DL bit
+	// as validated per the rules of the observable protocol.
+	if([self revalCache:DisplayList] == DisplayList)
 	{
-		if([self revalCache:DisplayList] == DisplayList)
+		if(dl_build)
+		{
+			dl_build_cancel(dl_build);
+			dl_build_cancel = NULL;
+			dl_build = NULL;
+		}
+		if(dl)
 		{
 			dl_dtor(dl);
 			dl_dtor = NULL;
 			dl = NULL;
 		}
-	} else
-		[self revalCache:DisplayList];
+		[self discardPartBVH];
+	}
 		
 	// Now: if we do not have a DL (no DL or we threw it out because it
-	// was invalid) build one now: get a collector and call "collect" on
-	// ourselves, which will walk our tree picking up primitives.
-	if(!dl)
+	// was invalid) and none is on the way, start one: get a collector and
+	// call "collect" on ourselves, which will walk our tree picking up
+	// primitives.  Collecting has to happen here - directives aren't
+	// thread-safe - but the renderer finishes the DL in the background.
+	if(!dl && !dl_build)
 	{
 		id<LDrawCollector> collector = [renderer beginDL];
 		[self collectSelf:collector];
-		[renderer endDL:&dl cleanupFunc:&dl_dtor];
+		dl_build = [renderer endDLInBackground:&dl_build_cancel];
 	}
 	
-	// Finally: if we have a DL (cached or brand new, draw it!!)
+	// Once the new DL is done it is swapped in whole.  (Small DLs are done
+	// straight away.)
+	if(dl_build && [renderer takeDL:dl_build handle:&dl cleanupFunc:&dl_dtor])
+	{
+		dl_build_cancel = NULL;
+		dl_build = NULL;
+	}
+	
+	// Finally: if we have a DL (cached or brand new, draw it!!) - or if it
+	// is still being built, a box in its place.
 	if(dl)
 		[renderer drawDL:dl];	
+	else if(dl_build)
+	{
+		Box3	build_bounds = [self boundingBox3];
+		float	build_min[3] = { build_bounds.min.x, build_bounds.min.y, build_bounds.min.z };
+		float	build_max[3] = { build_bounds.max.x, build_bounds.max.y, build_bounds.max.z };
+		
+		[renderer drawBoxFrom:build_min to:build_max];
+	}
 
 	if (!isOptimized)
 	{
@@ -345,16 +386,24 @@
 		// - Drag handles for selected primitives.
 		// Library parts are guaranteed to be only steps of primitives,
 		// so there is no need for this.
+		//
+		// Big models skip the steps and go straight to the parts
+		// their BVH says are on screen.
 		
-		NSArray     *steps              = [self subdirectives];
-		NSUInteger  maxIndex            = [self maxStepIndexToOutput];
-		LDrawStep   *currentDirective   = nil;
-		NSUInteger  counter             = 0;
-		
-		for(counter = 0; counter <= maxIndex; counter++)
+		if([self revalPartBVH])
+			[self drawPartsWithBVH:renderer];
+		else
 		{
-			currentDirective = [steps objectAtIndex:counter];
-			[currentDirective drawSelf:renderer];
+			NSArray     *steps              = [self subdirectives];
+			NSUInteger  maxIndex            = [self maxStepIndexToOutput];
+			LDrawStep   *currentDirective   = nil;
+			NSUInteger  counter             = 0;
+			
+			for(counter = 0; counter <= maxIndex; counter++)
+			{
+				currentDirective = [steps objectAtIndex:counter];
+				[currentDirective drawSelf:renderer];
+			}
 		}
 		
 		// And: if we are currently dragging directives, those 
@@ -1400,6 +1449,38 @@
 }//end optimizeStructure
 
 
+//========== setOptimizedSteps:boundingBox: ====================================
+//
+// Purpose:		Replaces the model's contents with steps already arranged the
+//				way -optimizeStructure would arrange them. The part cache uses
+//				this to rebuild a library part without parsing or flattening
+//				it again.
+//
+//				bounds must be the bounding box of the steps; it is trusted
+//				rather than recomputed.
+//
+//==============================================================================
+- (void) setOptimizedSteps:(NSArray *)newSteps boundingBox:(Box3)bounds
+{
+	NSInteger	counter		= 0;
+	
+	for(counter = ([[self subdirectives] count] - 1); counter >= 0; counter--)
+	{
+		[self removeDirectiveAtIndex:counter];
+	}
+	for(LDrawStep *step in newSteps)
+	{
+		[self addDirective:step];
+	}
+	
+	isOptimized = TRUE;
+	
+	self->cachedBounds = bounds;
+	[self revalCache:CacheFlagBounds];
+	
+}//end setOptimizedSteps:boundingBox:
+
+
 //========== parseHeaderFromLines:beginningAtIndex: ============================
 //
 // Purpose:		Given lines from an LDraw document, fill in the model header 
@@ -1549,6 +1630,210 @@
 }//end registerUndoActions:
 
 
+#pragma mark -
+#pragma mark PART BVH
+#pragma mark -
+
+//========== buildPartBVH ======================================================
+//
+// Purpose:		Gathers up the parts in the steps we draw and, if there are
+//				enough of them to be worth it, builds a BVH of their bounds.
+//
+// Notes:		We observe our parts ourselves, as well as through their steps,
+//				so that when one moves we know which.
+//
+//==============================================================================
+- (void) buildPartBVH
+{
+	NSArray         *steps          = [self subdirectives];
+	NSUInteger      maxIndex        = [self maxStepIndexToOutput];
+	NSMutableArray  *parts          = [NSMutableArray array];
+	NSMutableArray  *others         = [NSMutableArray array];
+	LDrawDirective  *directive      = nil;
+	float           *boxes          = NULL;
+	NSUInteger      partCount       = 0;
+	NSUInteger      counter         = 0;
+	
+	self->partBVHChecked = YES;
+	
+	if(PART_BVH_MINIMUM == 0 || [steps count] == 0)
+		return;
+	
+	for(counter = 0; counter <= maxIndex; counter++)
+	{
+		for(directive in [[steps objectAtIndex:counter] subdirectives])
+		{
+			if([directive isKindOfClass:[LDrawPart class]])
+				[parts addObject:directive];
+			else
+				[others addObject:directive];
+		}
+	}
+	
+	partCount = [parts count];
+	if(partCount < PART_BVH_MINIMUM)
+		return;
+	
+	self->bvhItems = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality
+										   valueOptions:NSPointerFunctionsStrongMemory];
+	
+	boxes = malloc(sizeof(float) * 6 * partCount);
+	for(counter = 0; counter < partCount; counter++)
+	{
+		LDrawPart	*part		= [parts objectAtIndex:counter];
+		Box3		bounds		= [part boundingBox3];
+		float		*box		= boxes + 6 * counter;
+		
+		box[0] = bounds.min.x;	box[1] = bounds.min.y;	box[2] = bounds.min.z;
+		box[3] = bounds.max.x;	box[4] = bounds.max.y;	box[5] = bounds.max.z;
+		
+		[self->bvhItems setObject:[NSNumber numberWithUnsignedInteger:counter] forKey:part];
+		[part addObserver:self];
+	}
+	
+	self->partBVH		= LDrawBVHCreate(boxes, (int)partCount);
+	self->bvhParts		= parts;
+	self->bvhOthers		= others;
+	self->bvhMoved		= [NSMutableIndexSet indexSet];
+	self->bvhVisible	= malloc(sizeof(int) * partCount);
+	
+	free(boxes);
+	
+}//end buildPartBVH
+
+
+//========== revalPartBVH ======================================================
+//
+// Purpose:		Brings our BVH up to date - building it the first time, and
+//				refitting the parts that have moved since - and returns whether
+//				we have one.
+//
+// Notes:		Moving parts loosens the tree, so once the BVH says it has got
+//				slow it is built again from scratch.
+//
+//==============================================================================
+- (BOOL) revalPartBVH
+{
+	NSUInteger	item	= 0;
+	
+	if(self->partBVHChecked == NO)
+		[self buildPartBVH];
+	
+	if(self->partBVH == NULL)
+		return NO;
+	
+	for(item = [self->bvhMoved firstIndex]; item != NSNotFound; item = [self->bvhMoved indexGreaterThanIndex:item])
+	{
+		Box3	bounds	= [[self->bvhParts objectAtIndex:item] boundingBox3];
+		float	box[6]	= { bounds.min.x, bounds.min.y, bounds.min.z, bounds.max.x, bounds.max.y, bounds.max.z };
+		
+		LDrawBVHUpdate(self->partBVH, (int)item, box);
+	}
+	[self->bvhMoved removeAllIndexes];
+	
+	if(LDrawBVHNeedsRebuild(self->partBVH))
+	{
+		[self discardPartBVH];
+		[self buildPartBVH];
+	}
+	
+	return self->partBVH != NULL;
+	
+}//end revalPartBVH
+
+
+//========== drawPartsWithBVH: =================================================
+//
+// Purpose:		Draws what is in the steps we show, as drawing each step would,
+//				except for the parts the renderer culls through our BVH.
+//
+// Notes:		Parts that come through still cull themselves as usual, which
+//				also picks their detail levels.
+//
+//==============================================================================
+- (void) drawPartsWithBVH:(id<LDrawCoreRenderer>)renderer
+{
+	LDrawDirective	*directive		= nil;
+	int				visibleCount	= 0;
+	int				counter			= 0;
+	
+	for(directive in self->bvhOthers)
+		[directive drawSelf:renderer];
+	
+	visibleCount = [renderer cullBVH:self->partBVH visible:self->bvhVisible dropTiny:!NO_CULL_SMALL_BRICKS];
+	
+	for(counter = 0; counter < visibleCount; counter++)
+		[[self->bvhParts objectAtIndex:self->bvhVisible[counter]] drawSelf:renderer];
+	
+}//end drawPartsWithBVH:
+
+
+//========== discardPartBVH ====================================================
+//
+// Purpose:		Throws out our BVH and stops watching the parts in it.  The
+//				next draw looks at our parts afresh.
+//
+//==============================================================================
+- (void) discardPartBVH
+{
+	LDrawPart	*part	= nil;
+	
+	for(part in self->bvhParts)
+		[part removeObserver:self];
+	
+	LDrawBVHDestroy(self->partBVH);
+	free(self->bvhVisible);
+	
+	self->partBVH			= NULL;
+	self->bvhVisible		= NULL;
+	self->bvhParts			= nil;
+	self->bvhOthers			= nil;
+	self->bvhItems			= nil;
+	self->bvhMoved			= nil;
+	self->partBVHChecked	= NO;
+	
+}//end discardPartBVH
+
+
+//========== statusInvalidated:who: ============================================
+//
+// Purpose:		Our parts call this directly when their bounds change, so that
+//				we can refit them in the BVH; the step they are in tells us
+//				anything we need to know for ourselves.  Everything else is
+//				handled as containers do.
+//
+//==============================================================================
+- (void) statusInvalidated:(CacheFlagsT) flags who:(id<LDrawObservable>) observable
+{
+	NSNumber	*item	= [self->bvhItems objectForKey:observable];
+	
+	if(item != nil)
+		[self->bvhMoved addIndex:[item unsignedIntegerValue]];
+	else
+		[super statusInvalidated:flags who:observable];
+	
+}//end statusInvalidated:who:
+
+
+#pragma mark -
+#pragma mark DESTRUCTOR
+#pragma mark -
+
+//========== dealloc ===========================================================
+//
+// Purpose:		Gives up on a DL still being built for us; no one else knows
+//				about it.  Our parts must also forget us.
+//
+//==============================================================================
+- (void) dealloc
+{
+	if(dl_build)
+		dl_build_cancel(dl_build);
+	[self discardPartBVH];
+
+}//end dealloc
+
+
 //- (void) invalCache:(CacheFlagsT) flags
 //{
 //	if(dl)
@@ -19,6 +19,7 @@
 // LDrawDirectiveDidChangeNotification is sent out by the base container class.
 #define LDrawStepDidChangeNotification				@"LDrawStepDidChangeNotification"
 
+@class LDrawGeometryBatch;
 @class LDrawModel;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -64,6 +65,10 @@ typedef enum
 	LDrawStepFlavorT	stepFlavor; //defaults to LDrawStepAnyDirectives
 	LDrawColorT			colorOfAllDirectives;
 	
+	// Parsing state; only used until -finishParsing.
+	LDrawDirective * __strong	*pendingDirectives;
+	NSUInteger					pendingDirectiveCount;
+	
 	//Inherited from the superclasses:
 	//NSMutableArray	*containedObjects; //the commands that make up the step.
 	//LDrawContainer	*enclosingDirective; //weak link to enclosing model.
@@ -72,6 +77,11 @@ typedef enum
 //Initialization
 + (id) emptyStep;
 + (id) emptyStepWithFlavor:(LDrawStepFlavorT) flavorType;
+- (id) initWithLines:(NSArray *)lines
+			 inRange:(NSRange)range
+		 parentGroup:(dispatch_group_t)parentGroup
+	   geometryBatch:(LDrawGeometryBatch *)batch;
+- (void) finishParsing;
 
 //Directives
 - (NSString *) writeWithStepCommand:(BOOL) flag;
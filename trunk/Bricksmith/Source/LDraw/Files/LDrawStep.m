@@ -32,6 +32,7 @@
 #endif
 
 #import  LDrawDirectiveGPU_h
+#import "LDrawGeometryBatch.h"
 #import "LDrawKeywords.h"
 #import "LDrawModel.h"
 #import "LDrawMPDModel.h"
@@ -107,38 +108,49 @@
 - (id) initWithLines:(NSArray *)lines
 			 inRange:(NSRange)range
 		 parentGroup:(dispatch_group_t)parentGroup
+{
+	LDrawGeometryBatch	*batch	= [[LDrawGeometryBatch alloc] initWithLines:lines parentGroup:parentGroup];
+	
+	self = [self initWithLines:lines inRange:range parentGroup:parentGroup geometryBatch:batch];
+	
+	[batch parse];
+	[self finishParsing];
+	
+	return self;
+	
+}//end initWithLines:inRange:parentGroup:
+
+
+//========== initWithLines:inRange:parentGroup:geometryBatch: ==================
+//
+// Purpose:		Reads a step beginning at the specified line of LDraw code, 
+//				queueing its geometry lines in batch instead of parsing them. 
+//
+//				The step is not complete until the batch has been parsed and 
+//				-finishParsing has been called. This lets a model parse the 
+//				geometry of all its steps at once. 
+//
+//==============================================================================
+- (id) initWithLines:(NSArray *)lines
+			 inRange:(NSRange)range
+		 parentGroup:(dispatch_group_t)parentGroup
+	   geometryBatch:(LDrawGeometryBatch *)batch
 {
 	NSString				*currentLine        = nil;
 	Class					CommandClass        = Nil;
 	NSRange					commandRange        = range;
-	__strong LDrawDirective	**directives        = NULL;
 	NSUInteger				lineIndex           = 0;
-	NSUInteger				insertIndex         = 0;
+	BOOL					isGeometry			= NO;
 		
 	self = [super initWithLines:lines inRange:range parentGroup:parentGroup];
 	
 	// Creation a C array of retained pointers under ARC
 	// (see Transitioning to ARC Release Notes for details)
-	directives = (__strong LDrawDirective **)calloc(range.length, sizeof(LDrawDirective *));
+	pendingDirectives		= (__strong LDrawDirective **)calloc(range.length, sizeof(LDrawDirective *));
+	pendingDirectiveCount	= 0;
 
 	cachedBounds = InvalidBox;
 	
-	dispatch_group_t    stepDispatchGroup   = NULL;
-#if USE_BLOCKS
-	dispatch_queue_t    queue               = NULL;	
-	
-	// Create a group for the multithreaded parsing of the step contents.
-	queue               = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);	
-	stepDispatchGroup   = dispatch_group_create();
-	
-	// Prevent the owning group from completing until the step is finished 
-	// asynchronously parsing its contents. 
-	if(parentGroup != NULL)
-	{
-		dispatch_group_enter(parentGroup);
-	}
-#endif	
-
 	// Parse out the STEP command
 	if(range.length > 0)
 	{
@@ -167,40 +179,42 @@
 	lineIndex = range.location;
 	while(lineIndex < NSMaxRange(range))
 	{
-		currentLine = [lines objectAtIndex:lineIndex];
-		if([currentLine length] > 0)
+		// Geometry lines (the vast majority) are recognized without building 
+		// a string for them, and are parsed later by the batch. 
+		CommandClass	= [LDrawUtilities classForGeometryLineAtIndex:lineIndex inLines:lines];
+		isGeometry		= (CommandClass != Nil);
+		currentLine		= nil;
+		if(isGeometry == NO)
+			currentLine = [lines objectAtIndex:lineIndex];
+
+		if(isGeometry == YES || [currentLine length] > 0)
 		{
-			if ([currentLine isMatchedByRegex:GROUP_REGEX_PATTERN]) {
+			if (currentLine != nil && [currentLine isMatchedByRegex:GROUP_REGEX_PATTERN]) {
 				
 				// Skip group directive because we handle it for header
 				lineIndex += 1;
 				continue;
 			}
 			
-			CommandClass = [LDrawUtilities classForDirectiveBeginningWithLine:currentLine];
+			if(isGeometry == NO)
+				CommandClass = [LDrawUtilities classForDirectiveBeginningWithLine:currentLine];
 			commandRange = [CommandClass rangeOfDirectiveBeginningAtIndex:lineIndex
 																  inLines:lines
 																 maxIndex:NSMaxRange(range) - 1];
-#if USE_BLOCKS
-			// Parse (multithreaded)
-			dispatch_group_async(stepDispatchGroup, queue,
-			^{
-#endif
-				// Parse but disallow multithreading for subparsing. LDraw 
-				// objects be be deeply recursive, which means we would pile 
-				// up a lot of dispatch_group_wait calls, resulting in so 
-				// many threads we run out of stack space. 
-				LDrawDirective *newDirective = [[CommandClass alloc] initWithLines:lines inRange:commandRange parentGroup:stepDispatchGroup];
-				
-				// Store non-retaining, but *thread-safe* container 
-				// (NSMutableArray is NOT). Since it doesn't retain, we mustn't 
-				// autorelease newDirective. 
-				directives[insertIndex] = newDirective;
-#if USE_BLOCKS
-			});
-#endif
-			lineIndex     = NSMaxRange(commandRange);
-			insertIndex += 1;
+			if(isGeometry == YES)
+			{
+				[batch addDirectiveOfClass:CommandClass
+								   inRange:commandRange
+									  slot:&pendingDirectives[pendingDirectiveCount]];
+			}
+			else
+			{
+				// Meta-commands are parsed right away, in order. 
+				pendingDirectives[pendingDirectiveCount] = [[CommandClass alloc] initWithLines:lines inRange:commandRange parentGroup:parentGroup];
+			}
+			
+			lineIndex				= NSMaxRange(commandRange);
+			pendingDirectiveCount	+= 1;
 		}
 		else
 		{
@@ -209,38 +223,39 @@
 
 	}
 	
-#if USE_BLOCKS
-	dispatch_group_notify(stepDispatchGroup, queue,
-	^{
-#endif
-		NSUInteger      counter             = 0;
-		LDrawDirective  *currentDirective   = nil;
+	return self;
+	
+}//end initWithLines:inRange:parentGroup:geometryBatch:
 
-		// Add the accumulated directives *in order*
-		for(counter = 0; counter < insertIndex; counter++)
-		{
-			currentDirective = directives[counter];
-			
-			[self addDirective:currentDirective];
-			
-			// Tell ARC to release the object
-			directives[counter] = nil;
-		}
-		free(directives);
+
+//========== finishParsing =====================================================
+//
+// Purpose:		Adds the directives read by 
+//				-initWithLines:inRange:parentGroup:geometryBatch: to the step, 
+//				in file order. The batch must have been parsed. 
+//
+//==============================================================================
+- (void) finishParsing
+{
+	NSUInteger      counter             = 0;
+	LDrawDirective  *currentDirective   = nil;
+
+	// Add the accumulated directives *in order*
+	for(counter = 0; counter < pendingDirectiveCount; counter++)
+	{
+		currentDirective = pendingDirectives[counter];
 		
-#if USE_BLOCKS
-		// Now that the step is complete, we can release our lock on the 
-		// parent group and allow it to finish. 
-		if(parentGroup != NULL)
-		{
-			dispatch_group_leave(parentGroup);
-		}
-	});
-#endif
+		[self addDirective:currentDirective];
+		
+		// Tell ARC to release the object
+		pendingDirectives[counter] = nil;
+	}
+	free(pendingDirectives);
 	
-	return self;
+	pendingDirectives		= NULL;
+	pendingDirectiveCount	= 0;
 	
-}//end initWithLines:inRange:
+}//end finishParsing
 
 
 //========== initWithCoder: ====================================================
@@ -315,7 +330,6 @@
 									 inLines:(NSArray *)lines
 									maxIndex:(NSUInteger)maxIndex
 {
-	NSString    *currentLine    = nil;
 	NSUInteger  counter         = 0;
 	NSRange     testRange       = NSMakeRange(index, maxIndex - index + 1);
 	NSInteger	stepLength		= 0;
@@ -325,16 +339,17 @@
 	// or they simply go all the way to the end of the file. 
 	// Convert each non-step-delimiter line into a directive, and add it to this 
 	// step. 
+	// This looks at every line in the model, so it tests the raw line rather 
+	// than building a string for each one. 
 	for(counter = testRange.location; counter < NSMaxRange(testRange); counter++)
 	{
-		currentLine = [lines objectAtIndex:counter];
 		stepLength++;
 		
 		// See if the line is a step delimiter. If the delimiter doesn't exist, 
 		// it's implied (such as in a 1-step model). Otherwise, it marks the end 
 		// of the step. 
-		if(		[[self class] lineIsStepTerminator:currentLine]
-		   ||	[[self class] lineIsRotationStepTerminator:currentLine] )
+		if(		[LDrawUtilities lineAtIndex:counter inLines:lines isMetaCommand:LDRAW_STEP_TERMINATOR]
+		   ||	[LDrawUtilities lineAtIndex:counter inLines:lines isMetaCommand:LDRAW_ROTATION_STEP_TERMINATOR] )
 		{
 			// Nothing more to parse. Stop.
 			break;
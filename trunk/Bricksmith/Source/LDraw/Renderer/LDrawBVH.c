@@ -0,0 +1,667 @@
+//==============================================================================
+//
+// File:		LDrawBVH.c
+//
+// Purpose:		A bounding volume hierarchy for culling many boxes at once.
+//
+// Notes:		The tree is binary, built top down by the surface area heuristic
+//				over 16 bins of box centers, with up to four items in a leaf.
+//				Building sorts the items in place, so every node - not just the
+//				leaves - owns one contiguous run of them, and a subtree wholly
+//				on screen is emitted as a single copy.
+//
+//				Culling goes down the tree with a mask of the planes a node is
+//				not yet known to be inside of; a child only tests the planes its
+//				parent straddled. The planes are the four sides of the view plus
+//				w = 0, which is behind the near plane but - unlike it - the same
+//				for OpenGL's depth range and Metal's.
+//
+//				Updates refit the nodes above the item from their children,
+//				stopping as soon as a node's box doesn't change. The summed area
+//				of all the nodes is kept as they change; it is what the tree
+//				costs to walk, so once it has doubled since the build it is time
+//				to build again.
+//
+//==============================================================================
+#include "LDrawBVH.h"
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEAF_SIZE			4
+#define BIN_COUNT			16
+#define PLANE_COUNT			5
+#define ALL_PLANES			((1 << PLANE_COUNT) - 1)
+#define REBUILD_GROWTH		2.0		// rebuild at this multiple of the built area
+#define LOCAL_STACK			64
+
+typedef struct LDrawBVHNodeStruct
+{
+	float	box[6];
+	int		child;			// first of two adjacent children; -1 in a leaf
+	int		parent;			// -1 at the root
+	int		first;			// this node's run of items
+	int		count;
+
+} LDrawBVHNode;
+
+struct LDrawBVHStruct
+{
+	int				count;
+	float			*boxes;			// 6 per item, by item
+	int				*items;			// item indices in tree order
+	int				*leafOf;		// each item's leaf
+	LDrawBVHNode	*nodes;
+	int				nodeCount;
+	int				depth;			// deepest node; root is 1
+	double			area;			// summed surface area of all nodes
+	double			builtArea;
+};
+
+typedef struct LDrawBVHBinStruct
+{
+	float	box[6];
+	int		count;
+
+} LDrawBVHBin;
+
+typedef struct LDrawBVHVisitStruct
+{
+	int		node;
+	int		mask;					// planes the node may still cross
+
+} LDrawBVHVisit;
+
+
+#pragma mark -
+#pragma mark Boxes
+#pragma mark -
+
+//========== setEmpty ==========================================================
+//
+// Purpose:		Makes a box that unions with anything to give that thing.
+//
+//==============================================================================
+static inline void setEmpty(float box[6])
+{
+	box[0] = box[1] = box[2] = FLT_MAX;
+	box[3] = box[4] = box[5] = -FLT_MAX;
+
+}//end setEmpty
+
+
+//========== isEmpty ===========================================================
+//
+// Purpose:		True if the box holds no points at all.
+//
+//==============================================================================
+static inline int isEmpty(const float box[6])
+{
+	return box[0] > box[3] || box[1] > box[4] || box[2] > box[5];
+
+}//end isEmpty
+
+
+//========== unionBox ==========================================================
+//
+// Purpose:		Grows box to cover other too.
+//
+//==============================================================================
+static inline void unionBox(float box[6], const float other[6])
+{
+	int axis;
+
+	for(axis = 0; axis < 3; axis++)
+	{
+		if(other[axis] < box[axis])				box[axis] = other[axis];
+		if(other[axis + 3] > box[axis + 3])		box[axis + 3] = other[axis + 3];
+	}
+
+}//end unionBox
+
+
+//========== surfaceArea =======================================================
+//
+// Purpose:		The box's surface area, which is proportional to the chance a
+//				random view ray - or view frustum edge - passes through it.
+//
+//==============================================================================
+static inline double surfaceArea(const float box[6])
+{
+	double dx, dy, dz;
+
+	if(isEmpty(box))
+		return 0;
+
+	dx = box[3] - box[0];
+	dy = box[4] - box[1];
+	dz = box[5] - box[2];
+
+	return 2 * (dx * dy + dy * dz + dz * dx);
+
+}//end surfaceArea
+
+
+//========== storeBox ==========================================================
+//
+// Purpose:		Copies an item's box in, giving every empty box the same form.
+//
+//==============================================================================
+static void storeBox(LDrawBVH *bvh, int index, const float box[6])
+{
+	float *stored = bvh->boxes + 6 * index;
+
+	if(isEmpty(box))
+		setEmpty(stored);
+	else
+		memcpy(stored, box, sizeof(float) * 6);
+
+}//end storeBox
+
+
+//========== nodeBounds ========================================================
+//
+// Purpose:		Works out a node's box from its items, or from its children.
+//
+//==============================================================================
+static void nodeBounds(const LDrawBVH *bvh, const LDrawBVHNode *node, float box[6])
+{
+	int counter;
+
+	setEmpty(box);
+
+	if(node->child >= 0)
+	{
+		unionBox(box, bvh->nodes[node->child].box);
+		unionBox(box, bvh->nodes[node->child + 1].box);
+	}
+	else
+	{
+		for(counter = 0; counter < node->count; counter++)
+			unionBox(box, bvh->boxes + 6 * bvh->items[node->first + counter]);
+	}
+
+}//end nodeBounds
+
+
+#pragma mark -
+#pragma mark Building
+#pragma mark -
+
+//========== centerOf ==========================================================
+//
+// Purpose:		Twice an item's center along one axis; empty boxes sit at 0.
+//
+//==============================================================================
+static inline float centerOf(const LDrawBVH *bvh, int item, int axis)
+{
+	const float *box = bvh->boxes + 6 * item;
+
+	return isEmpty(box) ? 0.0f : box[axis] + box[axis + 3];
+
+}//end centerOf
+
+
+//========== binOf =============================================================
+//
+// Purpose:		Which of the bins spread over [low, low + extent) a center is in.
+//
+//==============================================================================
+static inline int binOf(float center, float low, float extent)
+{
+	int bin = (int)((center - low) / extent * BIN_COUNT);
+
+	return bin < 0 ? 0 : (bin >= BIN_COUNT ? BIN_COUNT - 1 : bin);
+
+}//end binOf
+
+
+//========== findSplit =========================================================
+//
+// Purpose:		Sorts a node's items into the two children that cost least to
+//				walk by the surface area heuristic, and returns how many go into
+//				the first. The split is always along the axis the centers are
+//				most spread on; returns 0 if they are all in the same place.
+//
+//==============================================================================
+static int findSplit(LDrawBVH *bvh, int first, int count)
+{
+	LDrawBVHBin	bins[BIN_COUNT];
+	float		rightBoxes[BIN_COUNT][6];
+	int			rightCounts[BIN_COUNT];
+	float		low[3]		= { FLT_MAX, FLT_MAX, FLT_MAX };
+	float		high[3]		= { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float		leftBox[6];
+	float		extent		= 0;
+	double		bestCost	= DBL_MAX;
+	int			bestBin		= -1;
+	int			leftCount	= 0;
+	int			axis		= 0;
+	int			counter		= 0;
+	int			bin			= 0;
+	int			*lo			= NULL;
+	int			*hi			= NULL;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		int item = bvh->items[first + counter];
+
+		for(bin = 0; bin < 3; bin++)
+		{
+			float center = centerOf(bvh, item, bin);
+
+			if(center < low[bin])	low[bin] = center;
+			if(center > high[bin])	high[bin] = center;
+		}
+	}
+	for(bin = 0; bin < 3; bin++)
+	{
+		if(high[bin] - low[bin] > extent)
+		{
+			extent	= high[bin] - low[bin];
+			axis	= bin;
+		}
+	}
+	if(!(extent > 0))
+		return 0;
+
+	for(bin = 0; bin < BIN_COUNT; bin++)
+	{
+		setEmpty(bins[bin].box);
+		bins[bin].count = 0;
+	}
+	for(counter = 0; counter < count; counter++)
+	{
+		int item = bvh->items[first + counter];
+
+		bin = binOf(centerOf(bvh, item, axis), low[axis], extent);
+		unionBox(bins[bin].box, bvh->boxes + 6 * item);
+		bins[bin].count++;
+	}
+
+	// Everything right of each bin boundary, then sweep the left side over.
+	setEmpty(rightBoxes[BIN_COUNT - 1]);
+	unionBox(rightBoxes[BIN_COUNT - 1], bins[BIN_COUNT - 1].box);
+	rightCounts[BIN_COUNT - 1] = bins[BIN_COUNT - 1].count;
+	for(bin = BIN_COUNT - 2; bin > 0; bin--)
+	{
+		memcpy(rightBoxes[bin], rightBoxes[bin + 1], sizeof(rightBoxes[bin]));
+		unionBox(rightBoxes[bin], bins[bin].box);
+		rightCounts[bin] = rightCounts[bin + 1] + bins[bin].count;
+	}
+
+	setEmpty(leftBox);
+	for(bin = 0; bin < BIN_COUNT - 1; bin++)
+	{
+		double cost;
+
+		unionBox(leftBox, bins[bin].box);
+		leftCount += bins[bin].count;
+		if(leftCount == 0 || rightCounts[bin + 1] == 0)
+			continue;
+
+		cost = surfaceArea(leftBox) * leftCount + surfaceArea(rightBoxes[bin + 1]) * rightCounts[bin + 1];
+		if(cost < bestCost)
+		{
+			bestCost	= cost;
+			bestBin		= bin;
+		}
+	}
+	if(bestBin < 0)
+		return 0;
+
+	// Partition in place around the chosen boundary.
+	lo = bvh->items + first;
+	hi = bvh->items + first + count - 1;
+	while(lo <= hi)
+	{
+		if(binOf(centerOf(bvh, *lo, axis), low[axis], extent) <= bestBin)
+			lo++;
+		else
+		{
+			int swap = *lo;
+
+			*lo		= *hi;
+			*hi		= swap;
+			hi--;
+		}
+	}
+
+	return (int)(lo - (bvh->items + first));
+
+}//end findSplit
+
+
+//========== buildNode =========================================================
+//
+// Purpose:		Fills in a node over a run of items and builds its subtree.
+//
+//==============================================================================
+static void buildNode(LDrawBVH *bvh, int index, int parent, int first, int count, int depth)
+{
+	LDrawBVHNode	*node	= bvh->nodes + index;
+	int				split	= 0;
+	int				counter	= 0;
+
+	node->child		= -1;
+	node->parent	= parent;
+	node->first		= first;
+	node->count		= count;
+	nodeBounds(bvh, node, node->box);
+	bvh->area		+= surfaceArea(node->box);
+
+	if(depth > bvh->depth)
+		bvh->depth = depth;
+
+	if(count > LEAF_SIZE)
+	{
+		split = findSplit(bvh, first, count);
+
+		// Centers all in one place: any split is as good as another.
+		if(split == 0)
+			split = count / 2;
+	}
+
+	if(split == 0)
+	{
+		for(counter = 0; counter < count; counter++)
+			bvh->leafOf[bvh->items[first + counter]] = index;
+		return;
+	}
+
+	node->child		= bvh->nodeCount;
+	bvh->nodeCount	+= 2;
+
+	buildNode(bvh, node->child, index, first, split, depth + 1);
+	buildNode(bvh, node->child + 1, index, first + split, count - split, depth + 1);
+
+}//end buildNode
+
+
+#pragma mark -
+#pragma mark Public
+#pragma mark -
+
+//========== LDrawBVHCreate ====================================================
+//
+// Purpose:		Builds a BVH over count boxes of six floats each.
+//
+//==============================================================================
+LDrawBVH * LDrawBVHCreate(const float *boxes, int count)
+{
+	LDrawBVH	*bvh		= NULL;
+	int			counter		= 0;
+
+	if(count <= 0)
+		return NULL;
+
+	bvh = (LDrawBVH *)calloc(1, sizeof(LDrawBVH));
+	bvh->count	= count;
+	bvh->boxes	= (float *)malloc(sizeof(float) * 6 * count);
+	bvh->items	= (int *)malloc(sizeof(int) * count);
+	bvh->leafOf	= (int *)malloc(sizeof(int) * count);
+	bvh->nodes	= (LDrawBVHNode *)malloc(sizeof(LDrawBVHNode) * 2 * count);
+
+	for(counter = 0; counter < count; counter++)
+	{
+		storeBox(bvh, counter, boxes + 6 * counter);
+		bvh->items[counter] = counter;
+	}
+
+	bvh->nodeCount = 1;
+	buildNode(bvh, 0, -1, 0, count, 1);
+	bvh->builtArea = bvh->area;
+
+	return bvh;
+
+}//end LDrawBVHCreate
+
+
+//========== LDrawBVHDestroy ===================================================
+//
+// Purpose:		Frees the tree and its copy of the boxes.
+//
+//==============================================================================
+void LDrawBVHDestroy(LDrawBVH *bvh)
+{
+	if(bvh == NULL)
+		return;
+
+	free(bvh->boxes);
+	free(bvh->items);
+	free(bvh->leafOf);
+	free(bvh->nodes);
+	free(bvh);
+
+}//end LDrawBVHDestroy
+
+
+//========== LDrawBVHCount =====================================================
+//
+// Purpose:		How many items the tree was built over.
+//
+//==============================================================================
+int LDrawBVHCount(const LDrawBVH *bvh)
+{
+	return bvh ? bvh->count : 0;
+
+}//end LDrawBVHCount
+
+
+//========== LDrawBVHBoxes =====================================================
+//
+// Purpose:		The items' boxes, 6 floats each, by item.
+//
+//==============================================================================
+const float * LDrawBVHBoxes(const LDrawBVH *bvh)
+{
+	return bvh->boxes;
+
+}//end LDrawBVHBoxes
+
+
+//========== LDrawBVHUpdate ====================================================
+//
+// Purpose:		Gives one item a new box and refits the nodes above it.
+//
+//==============================================================================
+void LDrawBVHUpdate(LDrawBVH *bvh, int index, const float box[6])
+{
+	int node = bvh->leafOf[index];
+
+	storeBox(bvh, index, box);
+
+	while(node >= 0)
+	{
+		LDrawBVHNode	*current	= bvh->nodes + node;
+		float			refit[6];
+
+		nodeBounds(bvh, current, refit);
+		if(memcmp(refit, current->box, sizeof(refit)) == 0)
+			break;
+
+		bvh->area += surfaceArea(refit) - surfaceArea(current->box);
+		memcpy(current->box, refit, sizeof(refit));
+
+		node = current->parent;
+	}
+
+}//end LDrawBVHUpdate
+
+
+//========== LDrawBVHNeedsRebuild ==============================================
+//
+// Purpose:		True once updates have made the tree markedly slower to walk
+//				than a new one would be.
+//
+//==============================================================================
+bool LDrawBVHNeedsRebuild(const LDrawBVH *bvh)
+{
+	return bvh->area > bvh->builtArea * REBUILD_GROWTH;
+
+}//end LDrawBVHNeedsRebuild
+
+
+//========== classify ==========================================================
+//
+// Purpose:		Tests a box against the planes in mask. Returns -1 if it is
+//				wholly outside any of them; otherwise the planes it crosses.
+//
+//==============================================================================
+static inline int classify(const float box[6], const float planes[PLANE_COUNT][4], int mask)
+{
+	int plane;
+
+	for(plane = 0; plane < PLANE_COUNT; plane++)
+	{
+		const float	*p = planes[plane];
+		float		outer, inner;
+
+		if(!(mask & (1 << plane)))
+			continue;
+
+		// The corners farthest along the plane's normal, and against it.
+		outer	= p[3] + p[0] * box[p[0] > 0 ? 3 : 0]
+					   + p[1] * box[p[1] > 0 ? 4 : 1]
+					   + p[2] * box[p[2] > 0 ? 5 : 2];
+		if(outer < 0)
+			return -1;
+
+		inner	= p[3] + p[0] * box[p[0] > 0 ? 0 : 3]
+					   + p[1] * box[p[1] > 0 ? 1 : 4]
+					   + p[2] * box[p[2] > 0 ? 2 : 5];
+		if(inner >= 0)
+			mask &= ~(1 << plane);
+	}
+
+	return mask;
+
+}//end classify
+
+
+//========== isUnderAPixel =====================================================
+//
+// Purpose:		True if a box wholly in front of the eye projects to less than
+//				a pixel across and up - the test checkCull skips boxes by.
+//
+//==============================================================================
+static int isUnderAPixel(const float box[6], const float m[16], const float pixelScale[2])
+{
+	float	low[2]	= { FLT_MAX, FLT_MAX };
+	float	high[2]	= { -FLT_MAX, -FLT_MAX };
+	int		corner;
+
+	for(corner = 0; corner < 8; corner++)
+	{
+		float x = box[(corner & 1) ? 3 : 0];
+		float y = box[(corner & 2) ? 4 : 1];
+		float z = box[(corner & 4) ? 5 : 2];
+		float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+		float ndc[2];
+		int	  axis;
+
+		if(!(w > 0))
+			return 0;
+
+		ndc[0] = (m[0] * x + m[4] * y + m[8] * z + m[12]) / w;
+		ndc[1] = (m[1] * x + m[5] * y + m[9] * z + m[13]) / w;
+		for(axis = 0; axis < 2; axis++)
+		{
+			if(ndc[axis] < low[axis])	low[axis] = ndc[axis];
+			if(ndc[axis] > high[axis])	high[axis] = ndc[axis];
+		}
+	}
+
+	return (high[0] - low[0]) * pixelScale[0] < 1.0f
+		&& (high[1] - low[1]) * pixelScale[1] < 1.0f;
+
+}//end isUnderAPixel
+
+
+//========== LDrawBVHCull ======================================================
+//
+// Purpose:		Lists the items that may be on screen through mvp.
+//
+// Notes:		mvp is column major, as OpenGL has it; plane i of clip space
+//				comes from row 3 plus or minus row i.
+//
+//==============================================================================
+int LDrawBVHCull(const LDrawBVH *bvh, const float mvp[16], const float pixelScale[2], int *visible)
+{
+	LDrawBVHVisit	localStack[LOCAL_STACK];
+	LDrawBVHVisit	*stack		= localStack;
+	float			planes[PLANE_COUNT][4];
+	int				top			= 0;
+	int				found		= 0;
+	int				counter		= 0;
+
+	if(bvh == NULL)
+		return 0;
+
+	for(counter = 0; counter < 4; counter++)
+	{
+		float w = mvp[4 * counter + 3];
+
+		planes[0][counter] = w + mvp[4 * counter + 0];		// left
+		planes[1][counter] = w - mvp[4 * counter + 0];		// right
+		planes[2][counter] = w + mvp[4 * counter + 1];		// bottom
+		planes[3][counter] = w - mvp[4 * counter + 1];		// top
+		planes[4][counter] = w;								// in front of the eye
+	}
+
+	// Only the far child is ever waiting at each level.
+	if(bvh->depth + 1 > LOCAL_STACK)
+		stack = (LDrawBVHVisit *)malloc(sizeof(LDrawBVHVisit) * (bvh->depth + 1));
+
+	stack[top].node = 0;
+	stack[top].mask = ALL_PLANES;
+	top++;
+
+	while(top > 0)
+	{
+		LDrawBVHVisit		visit	= stack[--top];
+		const LDrawBVHNode	*node	= bvh->nodes + visit.node;
+		int					mask	= classify(node->box, planes, visit.mask);
+
+		if(mask < 0 || isEmpty(node->box))
+			continue;
+
+		if(mask == 0)
+		{
+			// Wholly on screen: everything under here is visible, unless it is
+			// all too small to see.
+			if(pixelScale && isUnderAPixel(node->box, mvp, pixelScale))
+				continue;
+
+			memcpy(visible + found, bvh->items + node->first, sizeof(int) * node->count);
+			found += node->count;
+		}
+		else if(node->child < 0)
+		{
+			for(counter = 0; counter < node->count; counter++)
+			{
+				int			item	= bvh->items[node->first + counter];
+				const float	*box	= bvh->boxes + 6 * item;
+
+				if(!isEmpty(box) && classify(box, planes, mask) >= 0)
+					visible[found++] = item;
+			}
+		}
+		else
+		{
+			stack[top].node		= node->child + 1;
+			stack[top].mask		= mask;
+			top++;
+			stack[top].node		= node->child;
+			stack[top].mask		= mask;
+			top++;
+		}
+	}
+
+	if(stack != localStack)
+		free(stack);
+
+	return found;
+
+}//end LDrawBVHCull
@@ -0,0 +1,59 @@
+//==============================================================================
+//
+// File:		LDrawBVH.h
+//
+// Purpose:		A bounding volume hierarchy for culling many boxes at once.
+//
+//				A big model - a city layout runs to 100,000 parts - used to ask
+//				the renderer about every one of its parts each frame, whether
+//				any of them were on screen or not. Instead the model keeps a
+//				BVH of its parts' bounds, and one walk of it per frame finds the
+//				parts that may be visible: subtrees off screen are dropped
+//				whole, subtrees wholly on screen are taken whole, and only the
+//				parts near the edges of the view are looked at one at a time.
+//
+//				The frustum test is conservative - it never drops a box that the
+//				renderer's checkCull would draw - so the caller still runs
+//				checkCull on what comes back, for screen size and detail level.
+//				There is no far plane, because checkCull has none either.
+//
+//				Boxes are six floats, min x y z then max x y z, in whatever
+//				coordinates the matrix handed to LDrawBVHCull takes to clip
+//				space. A box with a min greater than its max is empty: it never
+//				makes a node visible, though it can come back along with the
+//				rest of a node that is - checkCull turns it down in any case.
+//
+//==============================================================================
+#ifndef _LDrawBVH_
+#define _LDrawBVH_
+
+#include <stdbool.h>
+
+typedef struct LDrawBVHStruct	LDrawBVH;
+
+
+// Builds a BVH over count boxes, which are copied; box i is item i from then
+// on. Returns NULL if count is zero.
+LDrawBVH *	LDrawBVHCreate(const float *boxes, int count);
+void		LDrawBVHDestroy(LDrawBVH *bvh);
+
+int			LDrawBVHCount(const LDrawBVH *bvh);
+
+// The items' boxes as stored, empty ones with min greater than max.
+const float *	LDrawBVHBoxes(const LDrawBVH *bvh);
+
+// Moves one item's box and refits the nodes above it. The tree keeps its shape,
+// so after enough moves it gets loose; NeedsRebuild says when it has got loose
+// enough to be worth building again.
+void		LDrawBVHUpdate(LDrawBVH *bvh, int index, const float box[6]);
+bool		LDrawBVHNeedsRebuild(const LDrawBVH *bvh);
+
+// Writes the index of every item that may be on screen through mvp to visible,
+// which must have room for all the items, and returns how many there are.
+//
+// pixelScale, if not NULL, is pixels per unit of normalized device coordinates
+// along x and y: whole subtrees whose projection is under a pixel both ways
+// are then dropped, as checkCull would drop each of their items.
+int			LDrawBVHCull(const LDrawBVH *bvh, const float mvp[16], const float pixelScale[2], int *visible);
+
+#endif // _LDrawBVH_
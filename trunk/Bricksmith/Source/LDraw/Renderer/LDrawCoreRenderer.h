@@ -29,6 +29,19 @@ enum {					// Culling codes from renderer culling checks.
 	cull_draw			// Draw, the object is on screen and big.
 };
 
+enum {					// Detail levels a display list can be drawn at, picked by the renderer's culling checks.
+	detail_full,		// Every polygon.
+	detail_low,			// Simplified to look the same up to LDrawDetailLowPixels across.
+	detail_lowest,		// Simplified to look the same up to LDrawDetailLowestPixels across.
+	detail_count
+};
+
+// Screen sizes (in the culling check's pixels) at or below which an object is
+// drawn at a lower detail level.  Each level is simplified to within half a
+// pixel at its size.
+#define LDrawDetailLowPixels		96
+#define LDrawDetailLowestPixels		24
+
 
 struct	LDrawTextureSpec {
 	int		projection;
@@ -61,6 +74,20 @@ struct	LDrawTextureSpec {
 typedef void *	LDrawDLHandle;									// Opaque handle to some kinf of cached drawing representation.
 typedef void (* LDrawDLCleanup_f)(LDrawDLHandle  who);			// Cleanup function associated with a given DL.
 
+// A display list can also be finished in the background.  Until it is taken, the directive holds a
+// build handle instead, and a function to give up on the build with if it is no longer wanted.
+
+typedef void *	LDrawDLBuildHandle;								// Opaque handle to a display list still being built.
+typedef void (* LDrawDLBuildCancel_f)(LDrawDLBuildHandle who);	// Gives up on a build, wherever it has got to.
+
+// Posted on the main thread when background builds have finished, so that views can redraw to
+// take them.  Coalesced; no object or userInfo.
+#define LDrawDLBuildDidFinishNotification	@"LDrawDLBuildDidFinishNotification"
+
+// Big models cull their parts through a bounding volume hierarchy; see LDrawBVH.h.
+
+struct LDrawBVHStruct;
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // 
@@ -110,9 +137,17 @@ typedef void (* LDrawDLCleanup_f)(LDrawDLHandle  who);			// Cleanup function ass
 - (void) popMatrix;
 
 // Returns a cull code indicating whether the AABB from minXYZ to maxXYZ is on screen and big enough
-// to be worth drawing.
+// to be worth drawing.  The AABB's screen size also picks the detail level the next drawDL: uses.
 - (int) checkCull:(float *)minXYZ to:(float *)maxXYZ;
 
+// Culls a whole BVH of AABBs in the current transform's coordinates in one walk.  The indices of
+// the boxes that may be on screen go into visible, which has room for all of them, and the count
+// comes back.  This only stands in for checkCull's frustum test - and, with dropTiny, its test for
+// boxes under a pixel - so the boxes that come back still need checkCull for their cull codes.
+// Renderers that were handed an occlusion (see LDrawOcclusion.h) also leave out boxes it finds
+// hidden behind the others.
+- (int) cullBVH:(struct LDrawBVHStruct *)bvh visible:(int *)visible dropTiny:(BOOL)dropTiny;
+
 // This draws a plane AABB cube in the current color from minXYZ to maxXYZ.
 // It can be used for cheap bouding-box approximations of small bricks.
 - (void) drawBoxFrom:(float *)minXyz to:(float *)maxXyz;
@@ -143,5 +178,13 @@ typedef void (* LDrawDLCleanup_f)(LDrawDLHandle  who);			// Cleanup function ass
 
 - (void) drawDL:(LDrawDLHandle)dl;
 
+// Background builds.  endDLInBackground closes a display list like endDL, but leaves the slow part
+// of finishing it to worker threads.  takeDL returns NO while the build is still going, then
+// finishes it on the calling thread and hands back the display list (NULL if it was empty), after
+// which the build handle is gone.  The cancel function needs no renderer, so it can be called from
+// anywhere - dealloc included.
+- (LDrawDLBuildHandle) endDLInBackground:(LDrawDLBuildCancel_f *)cancelFunc;
+- (BOOL) takeDL:(LDrawDLBuildHandle)build handle:(LDrawDLHandle *)outHandle cleanupFunc:(LDrawDLCleanup_f *)func;
+
 @end
 
@@ -0,0 +1,470 @@
+//==============================================================================
+//
+// File:		LDrawDLBuildQueue.c
+//
+// Purpose:		Baking of display list meshes, and the worker pool that runs
+//				it in the background.
+//
+// Notes:		One lock guards the whole queue, jobs included. It is only held
+//				to move a job between states, never while one is being built.
+//
+//==============================================================================
+#include "LDrawDLBuildQueue.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "MeshSmooth.h"
+
+typedef enum
+{
+	LDrawDLBuildJobQueued,
+	LDrawDLBuildJobRunning,
+	LDrawDLBuildJobDone
+
+} LDrawDLBuildJobState;
+
+
+struct LDrawDLBuildJobStruct
+{
+	LDrawDLBuildQueue		*queue;			// NULL if run on the submitting thread
+	LDrawDLBuildFunction	build;
+	LDrawDLBuildFunction	discard;
+	void					*context;
+	LDrawDLBuildJobState	state;
+	bool					cancelled;		// discard when build returns
+	LDrawDLBuildJob			*next;			// while queued
+
+};
+
+
+struct LDrawDLBuildQueueStruct
+{
+	pthread_mutex_t			lock;
+	pthread_cond_t			workAvailable;
+	pthread_cond_t			jobDone;
+
+	LDrawDLBuildJob			*head;
+	LDrawDLBuildJob			*tail;
+	int						outstanding;	// submitted, not yet finished or cancelled
+	bool					stopping;
+
+	int						threadCount;
+	pthread_t				threads[LDRAW_DL_BUILD_QUEUE_MAXIMUM_THREADS];
+
+};
+
+
+#pragma mark -
+#pragma mark BAKING
+#pragma mark -
+
+//========== LDrawDLBakeInit ===================================================
+//
+// Purpose:		Sets up a bake of the given mesh.
+//
+//==============================================================================
+void LDrawDLBakeInit(LDrawDLBake *bake,
+					 struct Mesh *mesh,
+					 int textureCount,
+					 int faceCount,
+					 const LDrawMeshCacheHasher *hasher)
+{
+	int	*ranges	= (int *)calloc((size_t)textureCount * 8, sizeof(int));
+
+	bake->vertexCount				= 0;
+	bake->indexCount				= 0;
+	bake->vertices					= NULL;
+	bake->indices					= NULL;
+
+	bake->lineStarts				= ranges;
+	bake->lineCounts				= ranges + textureCount;
+	bake->conditionalLineStarts		= ranges + textureCount * 2;
+	bake->conditionalLineCounts		= ranges + textureCount * 3;
+	bake->triangleStarts			= ranges + textureCount * 4;
+	bake->triangleCounts			= ranges + textureCount * 5;
+	bake->quadrilateralStarts		= ranges + textureCount * 6;
+	bake->quadrilateralCounts		= ranges + textureCount * 7;
+
+	bake->mesh						= mesh;
+	bake->textureCount				= textureCount;
+	bake->faceCount					= faceCount;
+	bake->hashing					= (hasher != NULL);
+	if(hasher)
+		bake->hasher = *hasher;
+	bake->writtenVertices			= NULL;
+	bake->writtenIndices			= NULL;
+	bake->cached					= NULL;
+
+}//end LDrawDLBakeInit
+
+
+//========== LDrawDLBakeRun ====================================================
+//
+// Purpose:		Smooths the mesh and writes out its tables - or, for a big mesh
+//				smoothed before, in this session or an earlier one, maps them
+//				straight from the mesh cache.
+//
+// Notes:		We use one mesh for the entire DL, even if it has multiple
+//				textures, so that smoothing carries across triangles of
+//				different textures. (Key use case: minifig faces are part
+//				textured, part untextured.) The mesh writes its primitives out
+//				grouped by texture ID.
+//
+//==============================================================================
+void LDrawDLBakeRun(LDrawDLBake *bake)
+{
+	const char		*cacheDirectory	= LDrawMeshCacheGetDirectory();
+	char			cachePath[PATH_MAX];
+	LDrawMeshCacheKey cacheKey		= { 0, 0 };
+	bool			wantCache		= false;
+	struct Mesh		*mesh			= bake->mesh;
+
+	if(bake->hashing && cacheDirectory && bake->faceCount >= LDRAW_MESH_CACHE_MINIMUM_FACES)
+	{
+		cacheKey	= LDrawMeshCacheHasherFinish(&bake->hasher);
+		wantCache	= LDrawMeshCachePathForKey(cacheDirectory, cacheKey, cachePath, sizeof(cachePath));
+		if(wantCache)
+			bake->cached = LDrawMeshCacheEntryOpen(cachePath, cacheKey, (uint32_t)bake->textureCount);
+	}
+
+	if(bake->cached)
+	{
+		bake->vertexCount	= (int)bake->cached->header->vertexCount;
+		bake->indexCount	= (int)bake->cached->header->indexCount;
+		bake->vertices		= bake->cached->vertices;
+		bake->indices		= bake->cached->indices;
+		LDrawMeshCacheEntryGetRanges(bake->cached,
+			bake->lineStarts, bake->lineCounts,
+			bake->conditionalLineStarts, bake->conditionalLineCounts,
+			bake->triangleStarts, bake->triangleCounts,
+			bake->quadrilateralStarts, bake->quadrilateralCounts);
+	}
+	else
+	{
+		finish_faces_and_sort(mesh);
+		add_creases(mesh);
+		find_and_remove_t_junctions(mesh);
+		finish_creases_and_join(mesh);
+		smooth_vertices(mesh);
+		merge_vertices(mesh);
+		optimize_vertex_cache(mesh);
+
+		get_final_mesh_counts(mesh, &bake->vertexCount, &bake->indexCount);
+
+		bake->writtenVertices	= (float *)malloc((size_t)bake->vertexCount * LDRAW_MESH_CACHE_VERTEX_STRIDE * sizeof(float));
+		bake->writtenIndices	= (uint32_t *)malloc((size_t)bake->indexCount * sizeof(uint32_t));
+
+		write_indexed_mesh(mesh,
+						   bake->vertexCount, bake->writtenVertices,
+						   bake->indexCount, bake->writtenIndices,
+						   0,
+						   bake->lineStarts, bake->lineCounts,
+						   bake->conditionalLineStarts, bake->conditionalLineCounts,
+						   bake->triangleStarts, bake->triangleCounts,
+						   bake->quadrilateralStarts, bake->quadrilateralCounts);
+
+		if(wantCache)
+			LDrawMeshCacheEntryWrite(cachePath, cacheKey,
+				(uint32_t)bake->vertexCount, bake->writtenVertices,
+				(uint32_t)bake->indexCount, bake->writtenIndices,
+				(uint32_t)bake->textureCount,
+				bake->lineStarts, bake->lineCounts,
+				bake->conditionalLineStarts, bake->conditionalLineCounts,
+				bake->triangleStarts, bake->triangleCounts,
+				bake->quadrilateralStarts, bake->quadrilateralCounts);
+
+		bake->vertices	= bake->writtenVertices;
+		bake->indices	= bake->writtenIndices;
+	}
+
+	// The faces are not needed any more.
+	destroy_mesh(mesh);
+	bake->mesh = NULL;
+
+}//end LDrawDLBakeRun
+
+
+//========== LDrawDLBakeRelease ================================================
+//
+// Purpose:		Frees the bake's tables, and its mesh if it never ran.
+//
+//==============================================================================
+void LDrawDLBakeRelease(LDrawDLBake *bake)
+{
+	if(bake->mesh)
+		destroy_mesh(bake->mesh);
+	if(bake->cached)
+		LDrawMeshCacheEntryClose(bake->cached);
+	free(bake->writtenVertices);
+	free(bake->writtenIndices);
+	free(bake->lineStarts);
+
+	bake->mesh				= NULL;
+	bake->cached			= NULL;
+	bake->writtenVertices	= NULL;
+	bake->writtenIndices	= NULL;
+	bake->vertices			= NULL;
+	bake->indices			= NULL;
+	bake->lineStarts		= NULL;
+
+}//end LDrawDLBakeRelease
+
+
+#pragma mark -
+#pragma mark WORKERS
+#pragma mark -
+
+//========== buildWorker =======================================================
+//
+// Purpose:		Thread body: builds queued jobs until the queue stops.
+//
+// Notes:		The pool already spreads its jobs over the cores, so each worker
+//				runs MeshSmooth's stages for its own mesh by itself.
+//
+//==============================================================================
+static void *buildWorker(void *ref)
+{
+	LDrawDLBuildQueue	*queue	= ref;
+	LDrawDLBuildJob		*job	= NULL;
+
+	set_smoothing_thread_count_for_this_thread(1);
+
+	pthread_mutex_lock(&queue->lock);
+	while(true)
+	{
+		while(queue->head == NULL && !queue->stopping)
+			pthread_cond_wait(&queue->workAvailable, &queue->lock);
+		if(queue->head == NULL)
+			break;
+
+		job			= queue->head;
+		queue->head	= job->next;
+		if(queue->head == NULL)
+			queue->tail = NULL;
+		job->next	= NULL;
+		job->state	= LDrawDLBuildJobRunning;
+
+		pthread_mutex_unlock(&queue->lock);
+		job->build(job->context);
+		pthread_mutex_lock(&queue->lock);
+
+		if(job->cancelled)
+		{
+			pthread_mutex_unlock(&queue->lock);
+			job->discard(job->context);
+			free(job);
+			pthread_mutex_lock(&queue->lock);
+		}
+		else
+		{
+			job->state = LDrawDLBuildJobDone;
+			pthread_cond_broadcast(&queue->jobDone);
+		}
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+
+}//end buildWorker
+
+
+//========== LDrawDLBuildQueueCreate ===========================================
+//
+// Purpose:		Starts a pool of workers. Returns NULL if none would start.
+//
+//==============================================================================
+LDrawDLBuildQueue *LDrawDLBuildQueueCreate(int threadCount)
+{
+	LDrawDLBuildQueue	*queue	= NULL;
+	int					counter	= 0;
+
+	if(threadCount <= 0)
+		threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	if(threadCount < 1)
+		threadCount = 1;
+	if(threadCount > LDRAW_DL_BUILD_QUEUE_MAXIMUM_THREADS)
+		threadCount = LDRAW_DL_BUILD_QUEUE_MAXIMUM_THREADS;
+
+	queue = (LDrawDLBuildQueue *)calloc(1, sizeof(LDrawDLBuildQueue));
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->workAvailable, NULL);
+	pthread_cond_init(&queue->jobDone, NULL);
+
+	for(counter = 0; counter < threadCount; counter++)
+	{
+		if(pthread_create(queue->threads + queue->threadCount, NULL, buildWorker, queue) == 0)
+			queue->threadCount++;
+	}
+
+	if(queue->threadCount == 0)
+	{
+		LDrawDLBuildQueueDestroy(queue);
+		queue = NULL;
+	}
+
+	return queue;
+
+}//end LDrawDLBuildQueueCreate
+
+
+//========== LDrawDLBuildQueueDestroy ==========================================
+//
+// Purpose:		Stops the workers and frees the queue.
+//
+//==============================================================================
+void LDrawDLBuildQueueDestroy(LDrawDLBuildQueue *queue)
+{
+	int	counter	= 0;
+
+	pthread_mutex_lock(&queue->lock);
+	assert(queue->outstanding == 0);
+	queue->stopping = true;
+	pthread_cond_broadcast(&queue->workAvailable);
+	pthread_mutex_unlock(&queue->lock);
+
+	for(counter = 0; counter < queue->threadCount; counter++)
+		pthread_join(queue->threads[counter], NULL);
+
+	pthread_cond_destroy(&queue->jobDone);
+	pthread_cond_destroy(&queue->workAvailable);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue);
+
+}//end LDrawDLBuildQueueDestroy
+
+
+//========== LDrawDLBuildQueueSubmit ===========================================
+//
+// Purpose:		Queues a build of context, or without a queue, builds it now.
+//
+//==============================================================================
+LDrawDLBuildJob *LDrawDLBuildQueueSubmit(LDrawDLBuildQueue *queue,
+										 LDrawDLBuildFunction build,
+										 LDrawDLBuildFunction discard,
+										 void *context)
+{
+	LDrawDLBuildJob	*job	= (LDrawDLBuildJob *)calloc(1, sizeof(LDrawDLBuildJob));
+
+	job->queue		= queue;
+	job->build		= build;
+	job->discard	= discard;
+	job->context	= context;
+
+	if(queue == NULL)
+	{
+		build(context);
+		job->state = LDrawDLBuildJobDone;
+	}
+	else
+	{
+		job->state = LDrawDLBuildJobQueued;
+
+		pthread_mutex_lock(&queue->lock);
+		if(queue->tail)
+			queue->tail->next = job;
+		else
+			queue->head = job;
+		queue->tail = job;
+		queue->outstanding++;
+		pthread_cond_signal(&queue->workAvailable);
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	return job;
+
+}//end LDrawDLBuildQueueSubmit
+
+
+//========== LDrawDLBuildJobIsDone =============================================
+//
+// Purpose:		Returns whether Finish would return without waiting.
+//
+//==============================================================================
+bool LDrawDLBuildJobIsDone(LDrawDLBuildJob *job)
+{
+	LDrawDLBuildQueue	*queue	= job->queue;
+	bool				done	= false;
+
+	if(queue == NULL)
+		return true;
+
+	pthread_mutex_lock(&queue->lock);
+	done = (job->state == LDrawDLBuildJobDone);
+	pthread_mutex_unlock(&queue->lock);
+
+	return done;
+
+}//end LDrawDLBuildJobIsDone
+
+
+//========== LDrawDLBuildJobFinish =============================================
+//
+// Purpose:		Waits for the job to be built, frees it and returns its context.
+//
+//==============================================================================
+void *LDrawDLBuildJobFinish(LDrawDLBuildJob *job)
+{
+	LDrawDLBuildQueue	*queue		= job->queue;
+	void				*context	= job->context;
+
+	if(queue)
+	{
+		pthread_mutex_lock(&queue->lock);
+		while(job->state != LDrawDLBuildJobDone)
+			pthread_cond_wait(&queue->jobDone, &queue->lock);
+		queue->outstanding--;
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	free(job);
+
+	return context;
+
+}//end LDrawDLBuildJobFinish
+
+
+//========== LDrawDLBuildJobCancel =============================================
+//
+// Purpose:		Gives up on a job. A queued one is never built; a running one
+//				is left to its worker to discard.
+//
+//==============================================================================
+void LDrawDLBuildJobCancel(LDrawDLBuildJob *job)
+{
+	LDrawDLBuildQueue	*queue	= job->queue;
+	LDrawDLBuildJob		*prior	= NULL;
+
+	if(queue)
+	{
+		pthread_mutex_lock(&queue->lock);
+		queue->outstanding--;
+		if(job->state == LDrawDLBuildJobRunning)
+		{
+			job->cancelled = true;
+			pthread_mutex_unlock(&queue->lock);
+			return;
+		}
+		if(job->state == LDrawDLBuildJobQueued)
+		{
+			if(queue->head == job)
+				queue->head = job->next;
+			else
+			{
+				for(prior = queue->head; prior->next != job; prior = prior->next)
+					;
+				prior->next = job->next;
+			}
+			if(queue->tail == job)
+				queue->tail = prior;
+		}
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	job->discard(job->context);
+	free(job);
+
+}//end LDrawDLBuildJobCancel
@@ -0,0 +1,120 @@
+//==============================================================================
+//
+// File:		LDrawDLBuildQueue.h
+//
+// Purpose:		Building display lists off the render thread.
+//
+//				Finishing a display list has two halves. Baking smooths the
+//				collected faces (see MeshSmooth.h) into the vertex table, index
+//				table and per-texture ranges that write_indexed_mesh outputs, or
+//				reads them back from the mesh cache. It is all CPU work, takes
+//				seconds for a big model, and needs nothing from the GPU. The
+//				upload then copies the tables into GPU buffers, which has to
+//				happen on the render thread but is quick.
+//
+//				The build queue runs baking on a pool of worker threads, so a
+//				renderer can hand a display list off, draw something cheap in
+//				its place, and upload it once the job is done.
+//
+//				The workers smooth their meshes serially. Otherwise MeshSmooth
+//				would start a thread per core for every big mesh, on top of a
+//				pool which is already spread over the cores.
+//
+//==============================================================================
+#ifndef _LDrawDLBuildQueue_
+#define _LDrawDLBuildQueue_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "LDrawMeshCache.h"
+
+struct Mesh;
+
+// Upper limit on workers, however many cores there are.
+#define LDRAW_DL_BUILD_QUEUE_MAXIMUM_THREADS	8
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// One display list's mesh, from collected faces to the tables its buffers are
+// filled from.
+typedef struct LDrawDLBakeStruct
+{
+	// Results, valid once LDrawDLBakeRun returns. Vertices are
+	// LDRAW_MESH_CACHE_VERTEX_STRIDE floats each; each range array has one
+	// slot per texture ID.
+	int						vertexCount;
+	int						indexCount;
+	const float				*vertices;
+	const uint32_t			*indices;
+
+	int						*lineStarts;
+	int						*lineCounts;
+	int						*conditionalLineStarts;
+	int						*conditionalLineCounts;
+	int						*triangleStarts;
+	int						*triangleCounts;
+	int						*quadrilateralStarts;
+	int						*quadrilateralCounts;
+
+	// Private.
+	struct Mesh				*mesh;
+	int						textureCount;
+	int						faceCount;
+	bool					hashing;
+	LDrawMeshCacheHasher	hasher;
+	float					*writtenVertices;
+	uint32_t				*writtenIndices;
+	LDrawMeshCacheEntry		*cached;
+
+} LDrawDLBake;
+
+
+// A display list builder's entry point for a job. Runs on a worker thread.
+typedef void (*LDrawDLBuildFunction)(void *context);
+
+typedef struct LDrawDLBuildQueueStruct	LDrawDLBuildQueue;
+typedef struct LDrawDLBuildJobStruct	LDrawDLBuildJob;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Baking. Init takes over the mesh, which must have had its faces added with
+// texture IDs 0 to textureCount - 1. Pass the hasher the faces went through to
+// use the mesh cache, or NULL not to. Run may be called on any thread; Release
+// frees everything, whether or not it ran.
+void					LDrawDLBakeInit(LDrawDLBake *bake,
+										struct Mesh *mesh,
+										int textureCount,
+										int faceCount,
+										const LDrawMeshCacheHasher *hasher);
+void					LDrawDLBakeRun(LDrawDLBake *bake);
+void					LDrawDLBakeRelease(LDrawDLBake *bake);
+
+// Workers. A thread count of 0 means one less than the number of cores. Every
+// job must be finished or cancelled before the queue is destroyed.
+LDrawDLBuildQueue *		LDrawDLBuildQueueCreate(int threadCount);
+void					LDrawDLBuildQueueDestroy(LDrawDLBuildQueue *queue);
+
+// Jobs run in the order they were submitted. A NULL queue runs the job on the
+// calling thread, so the job comes back done. The context belongs to the job
+// until Finish hands it back; Cancel gives it to discard instead, right away
+// or, if the job is running, once build returns. Either way the job is freed.
+LDrawDLBuildJob *		LDrawDLBuildQueueSubmit(LDrawDLBuildQueue *queue,
+												LDrawDLBuildFunction build,
+												LDrawDLBuildFunction discard,
+												void *context);
+bool					LDrawDLBuildJobIsDone(LDrawDLBuildJob *job);
+void *					LDrawDLBuildJobFinish(LDrawDLBuildJob *job);
+void					LDrawDLBuildJobCancel(LDrawDLBuildJob *job);
+
+#endif // _LDrawDLBuildQueue_
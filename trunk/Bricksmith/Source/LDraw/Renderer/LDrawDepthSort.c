@@ -0,0 +1,133 @@
+//==============================================================================
+//
+// File:		LDrawDepthSort.c
+//
+// Purpose:		A stable radix sort of translucent instances by depth.
+//
+// Notes:		A float's bits compare as unsigned integers in the same order as
+//				the floats themselves once negative values have all their bits
+//				flipped and positive ones just the sign bit. The sort then takes
+//				three passes of 11 bits each, least significant first; a pass
+//				whose digit is the same for every key is skipped, which is
+//				common since a scene's depths share their sign and much of
+//				their exponent.
+//
+//==============================================================================
+#include "LDrawDepthSort.h"
+
+#include <string.h>
+
+#define DIGIT_BITS		11
+#define DIGIT_COUNT		(1 << DIGIT_BITS)
+#define PASS_COUNT		3				// 33 bits covers all 32
+
+// Below this many entries an insertion sort beats clearing the histograms.
+#define SMALL_SORT		32
+
+
+//========== sortableBits ======================================================
+//
+// Purpose:		Returns a key's bits, rearranged to sort as unsigned integers.
+//
+//==============================================================================
+static inline uint32_t sortableBits(float key)
+{
+	uint32_t	bits	= 0;
+
+	memcpy(&bits, &key, sizeof(bits));
+	return bits ^ ((uint32_t)((int32_t)bits >> 31) | 0x80000000u);
+
+}//end sortableBits
+
+
+//========== insertionSort =====================================================
+//
+// Purpose:		Stable sort for a handful of entries.
+//
+//==============================================================================
+static void insertionSort(LDrawDepthSortEntry *entries, int count)
+{
+	int	counter	= 0;
+
+	for(counter = 1; counter < count; counter++)
+	{
+		LDrawDepthSortEntry	entry	= entries[counter];
+		uint32_t			bits	= sortableBits(entry.key);
+		int					slot	= counter;
+
+		while(slot > 0 && sortableBits(entries[slot - 1].key) > bits)
+		{
+			entries[slot] = entries[slot - 1];
+			slot--;
+		}
+		entries[slot] = entry;
+	}
+
+}//end insertionSort
+
+
+//========== LDrawDepthSort ====================================================
+//
+// Purpose:		Sorts entries by ascending key, stably.
+//
+//==============================================================================
+void LDrawDepthSort(LDrawDepthSortEntry *entries, LDrawDepthSortEntry *scratch, int count)
+{
+	uint32_t			histograms[PASS_COUNT][DIGIT_COUNT];
+	LDrawDepthSortEntry	*source			= entries;
+	LDrawDepthSortEntry	*destination	= scratch;
+	int					pass			= 0;
+	int					counter			= 0;
+
+	if(count < SMALL_SORT)
+	{
+		insertionSort(entries, count);
+		return;
+	}
+
+	// Count every digit of every key in one read.
+	memset(histograms, 0, sizeof(histograms));
+	for(counter = 0; counter < count; counter++)
+	{
+		uint32_t bits = sortableBits(entries[counter].key);
+
+		histograms[0][bits & (DIGIT_COUNT - 1)]++;
+		histograms[1][(bits >> DIGIT_BITS) & (DIGIT_COUNT - 1)]++;
+		histograms[2][bits >> (2 * DIGIT_BITS)]++;
+	}
+
+	for(pass = 0; pass < PASS_COUNT; pass++)
+	{
+		uint32_t	*histogram	= histograms[pass];
+		int			shift		= pass * DIGIT_BITS;
+		uint32_t	offset		= 0;
+		int			digit		= 0;
+
+		// Every key has the same digit: this pass would change nothing.
+		if(histogram[(sortableBits(source[0].key) >> shift) & (DIGIT_COUNT - 1)] == (uint32_t)count)
+			continue;
+
+		// Turn the counts into starting offsets.
+		for(digit = 0; digit < DIGIT_COUNT; digit++)
+		{
+			uint32_t digitCount = histogram[digit];
+
+			histogram[digit]	= offset;
+			offset				+= digitCount;
+		}
+
+		for(counter = 0; counter < count; counter++)
+		{
+			uint32_t bits = sortableBits(source[counter].key);
+
+			destination[histogram[(bits >> shift) & (DIGIT_COUNT - 1)]++] = source[counter];
+		}
+
+		source		= destination;
+		destination	= (destination == scratch) ? entries : scratch;
+	}
+
+	if(source != entries)
+		memcpy(entries, source, sizeof(LDrawDepthSortEntry) * count);
+
+}//end LDrawDepthSort
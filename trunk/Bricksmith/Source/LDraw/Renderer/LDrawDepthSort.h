@@ -0,0 +1,33 @@
+//==============================================================================
+//
+// File:		LDrawDepthSort.h
+//
+// Purpose:		Orders translucent instances by depth for drawing back to front.
+//
+//				Sessions record one entry per translucent instance as it is
+//				drawn: its eye space Z and its index in the session's own
+//				instance array. The entries are then sorted with a stable LSD
+//				radix sort on the bits of the keys, so instances at the same
+//				depth keep the order they were drawn in, and depths that differ
+//				by any amount - not just by a whole LDraw unit - are ordered.
+//
+//==============================================================================
+#ifndef _LDrawDepthSort_
+#define _LDrawDepthSort_
+
+#include <stdint.h>
+
+typedef struct LDrawDepthSortEntryStruct
+{
+	float		key;			// eye space Z; more negative is farther
+	uint32_t	index;			// the instance, in the order it was drawn
+
+} LDrawDepthSortEntry;
+
+
+// Sorts count entries by ascending key - far to near in eye space - keeping
+// entries with equal keys in their original order. Scratch must have room for
+// count entries; the result is left in entries. NaN keys sort to the ends.
+void	LDrawDepthSort(LDrawDepthSortEntry *entries, LDrawDepthSortEntry *scratch, int count);
+
+#endif // _LDrawDepthSort_
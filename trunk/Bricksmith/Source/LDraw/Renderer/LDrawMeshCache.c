@@ -0,0 +1,626 @@
+//==============================================================================
+//
+// File:		LDrawMeshCache.c
+//
+// Purpose:		Keys, reading, writing and pruning of smoothed mesh entries.
+//
+// Notes:		The key is two independent 64-bit hashes fed the same words, so
+//				two different meshes would have to collide in both to be
+//				confused. Nothing in an entry is trusted until its sizes have
+//				been checked against the length of the file.
+//
+//==============================================================================
+#include "LDrawMeshCache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "LDrawAtomicWrite.h"
+#include "MeshSmooth.h"
+
+#define MESH_CACHE_EXTENSION	".bsmc"
+
+#define MIX_SEED				0x9E3779B97F4A7C15ULL
+#define MIX_MULTIPLIER_1		0x87C37B91114253D5ULL
+#define MIX_MULTIPLIER_2		0x4CF5AD432745937FULL
+
+// Set once at launch, before any display list is built.
+static char *meshCacheDirectory = NULL;
+
+// One entry, while deciding which to prune.
+typedef struct
+{
+	char		*path;
+	int64_t		size;
+	int64_t		lastUse;
+
+} PruneCandidate;
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== rotateLeft ========================================================
+//
+// Purpose:		Rotates a 64-bit word left by count bits.
+//
+//==============================================================================
+static inline uint64_t rotateLeft(uint64_t value, int count)
+{
+	return (value << count) | (value >> (64 - count));
+}
+
+
+//========== finalMix ==========================================================
+//
+// Purpose:		Spreads every input bit over the whole hash (MurmurHash3's
+//				finalizer).
+//
+//==============================================================================
+static uint64_t finalMix(uint64_t hash)
+{
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+
+//========== hashWord ==========================================================
+//
+// Purpose:		Feeds one 32-bit word to both lanes of the key.
+//
+//==============================================================================
+static inline void hashWord(LDrawMeshCacheHasher *hasher, uint32_t word)
+{
+	hasher->lanes[0]	= (hasher->lanes[0] ^ word) * LDRAW_FNV_PRIME;
+	hasher->lanes[1]	= rotateLeft(hasher->lanes[1] ^ (word * MIX_MULTIPLIER_1), 31) * MIX_MULTIPLIER_2;
+	hasher->length		+= 1;
+}
+
+
+//========== hashFloats ========================================================
+//
+// Purpose:		Feeds the bit patterns of count floats to the key. (Two floats
+//				which compare equal but differ in bits, like 0 and -0, only
+//				cost a miss.)
+//
+//==============================================================================
+static void hashFloats(LDrawMeshCacheHasher *hasher, const float *values, int count)
+{
+	uint32_t	word	= 0;
+	int			counter	= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		memcpy(&word, values + counter, sizeof(word));
+		hashWord(hasher, word);
+	}
+}
+
+
+//========== entryLength =======================================================
+//
+// Purpose:		Returns the number of bytes an entry with the header's counts
+//				occupies, or SIZE_MAX if the counts are absurd.
+//
+//==============================================================================
+static size_t entryLength(const LDrawMeshCacheHeader *header)
+{
+	uint64_t	total	= 0;
+
+	total	=	sizeof(LDrawMeshCacheHeader)
+			+	(uint64_t)header->vertexCount * LDRAW_MESH_CACHE_VERTEX_STRIDE * sizeof(float)
+			+	(uint64_t)header->indexCount * sizeof(uint32_t)
+			+	(uint64_t)header->textureCount * sizeof(LDrawMeshCacheRanges);
+
+	return (total > SIZE_MAX / 2) ? SIZE_MAX : (size_t)total;
+
+}//end entryLength
+
+
+//========== rangesAreValid ====================================================
+//
+// Purpose:		Makes sure every range lies inside the index table, so that a
+//				damaged entry can't send the renderer off the end of it.
+//
+//==============================================================================
+static bool rangesAreValid(const LDrawMeshCacheHeader *header, const LDrawMeshCacheRanges *ranges)
+{
+	uint32_t	texture	= 0;
+	int			kind	= 0;
+
+	for(texture = 0; texture < header->textureCount; texture++)
+	{
+		const int32_t *startsAndCounts = &ranges[texture].lineStart;
+
+		for(kind = 0; kind < 4; kind++)
+		{
+			int32_t	start	= startsAndCounts[kind * 2];
+			int32_t	count	= startsAndCounts[kind * 2 + 1];
+
+			if(start < 0 || count < 0 || (uint64_t)start + (uint64_t)count > header->indexCount)
+				return false;
+		}
+	}
+
+	return true;
+
+}//end rangesAreValid
+
+
+//========== indicesAreValid ===================================================
+//
+// Purpose:		Makes sure every index names a vertex in the vertex table, so
+//				that a damaged entry can't send the GPU off the end of it.
+//
+//==============================================================================
+static bool indicesAreValid(const LDrawMeshCacheHeader *header, const uint32_t *indices)
+{
+	uint32_t	counter	= 0;
+
+	for(counter = 0; counter < header->indexCount; counter++)
+	{
+		if(indices[counter] >= header->vertexCount)
+			return false;
+	}
+
+	return true;
+
+}//end indicesAreValid
+
+
+//========== comparePruneCandidates ============================================
+//
+// Purpose:		qsort callback ordering entries least recently used first.
+//
+//==============================================================================
+static int comparePruneCandidates(const void *first, const void *second)
+{
+	const PruneCandidate	*candidate1	= first;
+	const PruneCandidate	*candidate2	= second;
+
+	if(candidate1->lastUse != candidate2->lastUse)
+		return (candidate1->lastUse < candidate2->lastUse) ? -1 : 1;
+
+	return strcmp(candidate1->path, candidate2->path);
+}
+
+
+#pragma mark -
+#pragma mark LOCATION
+#pragma mark -
+
+//========== LDrawMeshCacheSetDirectory ========================================
+//
+// Purpose:		Turns caching on, keeping entries in directory, or off if
+//				directory is NULL.
+//
+// Notes:		Not thread-safe; call it before any display list is built.
+//
+//==============================================================================
+void LDrawMeshCacheSetDirectory(const char *directory)
+{
+	free(meshCacheDirectory);
+	meshCacheDirectory = NULL;
+
+	if(directory != NULL)
+	{
+		if(mkdir(directory, 0755) != 0 && errno != EEXIST)
+			return;
+		meshCacheDirectory = strdup(directory);
+	}
+
+}//end LDrawMeshCacheSetDirectory
+
+
+//========== LDrawMeshCacheGetDirectory ========================================
+//
+// Purpose:		Returns where entries are kept, or NULL if caching is off.
+//
+//==============================================================================
+const char *LDrawMeshCacheGetDirectory(void)
+{
+	return meshCacheDirectory;
+}
+
+
+#pragma mark -
+#pragma mark KEYS
+#pragma mark -
+
+//========== LDrawMeshCacheHasherInit ==========================================
+//
+// Purpose:		Starts the key for a mesh: the stages it goes through and the
+//				smoother's parameters.
+//
+// Notes:		The mesh's counts aren't part of it; each face's degree is, and
+//				so the counts follow from the faces. This lets a builder that
+//				streams its faces (see create_growable_mesh) hash them as they
+//				arrive.
+//
+//==============================================================================
+void LDrawMeshCacheHasherInit(LDrawMeshCacheHasher *hasher, uint32_t stages)
+{
+	struct smoothing_parameters	parameters;
+
+	get_smoothing_parameters(&parameters);
+
+	hasher->lanes[0]	= LDRAW_FNV_OFFSET_BASIS;
+	hasher->lanes[1]	= MIX_SEED;
+	hasher->length		= 0;
+
+	hashWord(hasher, LDRAW_MESH_CACHE_VERSION);
+	hashWord(hasher, (uint32_t)parameters.version);
+	hashFloats(hasher, &parameters.weld_distance, 1);
+	hashFloats(hasher, &parameters.crease_cosine, 1);
+	hashWord(hasher, (uint32_t)parameters.flags);
+	hashWord(hasher, stages);
+
+}//end LDrawMeshCacheHasherInit
+
+
+//========== LDrawMeshCacheHasherAddFace =======================================
+//
+// Purpose:		Adds one face to the key, with the same arguments as add_face.
+//
+//==============================================================================
+void LDrawMeshCacheHasherAddFace(LDrawMeshCacheHasher *hasher,
+								 const float p1[3],
+								 const float p2[3],
+								 const float p3[3],
+								 const float p4[3],
+								 const float color[4],
+								 int tid)
+{
+	uint32_t	degree	= (p4 != NULL) ? 4 : (p3 != NULL) ? 3 : 2;
+
+	hashWord(hasher, degree);
+	hashWord(hasher, (uint32_t)tid);
+	hashFloats(hasher, p1, 3);
+	hashFloats(hasher, p2, 3);
+	if(p3 != NULL)
+		hashFloats(hasher, p3, 3);
+	if(p4 != NULL)
+		hashFloats(hasher, p4, 3);
+	hashFloats(hasher, color, 4);
+
+}//end LDrawMeshCacheHasherAddFace
+
+
+//========== LDrawMeshCacheHasherFinish ========================================
+//
+// Purpose:		Returns the key for everything added so far.
+//
+//==============================================================================
+LDrawMeshCacheKey LDrawMeshCacheHasherFinish(const LDrawMeshCacheHasher *hasher)
+{
+	LDrawMeshCacheKey	key;
+
+	key.low		= finalMix(hasher->lanes[0] ^ hasher->length);
+	key.high	= finalMix(hasher->lanes[1] + hasher->length * MIX_MULTIPLIER_1);
+
+	return key;
+
+}//end LDrawMeshCacheHasherFinish
+
+
+#pragma mark -
+#pragma mark NAMING
+#pragma mark -
+
+//========== LDrawMeshCachePathForKey ==========================================
+//
+// Purpose:		An entry is named for its key, in hex.
+//
+//==============================================================================
+bool LDrawMeshCachePathForKey(const char *directory, LDrawMeshCacheKey key, char *pathOut, size_t pathSize)
+{
+	int	length	= snprintf(pathOut, pathSize, "%s/%016llx%016llx" MESH_CACHE_EXTENSION, directory,
+						   (unsigned long long)key.high, (unsigned long long)key.low);
+
+	return length > 0 && (size_t)length < pathSize;
+
+}//end LDrawMeshCachePathForKey
+
+
+#pragma mark -
+#pragma mark READING
+#pragma mark -
+
+//========== LDrawMeshCacheEntryOpen ===========================================
+//
+// Purpose:		Maps the entry at path and locates its sections, marking it
+//				as recently used.
+//
+//==============================================================================
+LDrawMeshCacheEntry *LDrawMeshCacheEntryOpen(const char *path, LDrawMeshCacheKey key, uint32_t textureCount)
+{
+	int							fileDescriptor	= open(path, O_RDONLY | O_CLOEXEC);
+	struct stat					fileInfo;
+	void						*mapping		= MAP_FAILED;
+	size_t						length			= 0;
+	const LDrawMeshCacheHeader	*header			= NULL;
+	const char					*section		= NULL;
+	LDrawMeshCacheEntry			*entry			= NULL;
+
+	if(fileDescriptor < 0)
+		return NULL;
+
+	if(		fstat(fileDescriptor, &fileInfo) != 0
+	   ||	S_ISREG(fileInfo.st_mode) == false
+	   ||	(size_t)fileInfo.st_size < sizeof(LDrawMeshCacheHeader) )
+	{
+		close(fileDescriptor);
+		return NULL;
+	}
+	length	= (size_t)fileInfo.st_size;
+	mapping	= mmap(NULL, length, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+
+	// Pruning goes by modification time, so a use is a modification.
+	if(mapping != MAP_FAILED)
+		futimes(fileDescriptor, NULL);
+	close(fileDescriptor);
+
+	if(mapping == MAP_FAILED)
+		return NULL;
+
+	header = mapping;
+	if(		header->magic			!= LDRAW_MESH_CACHE_MAGIC
+	   ||	header->version			!= LDRAW_MESH_CACHE_VERSION
+	   ||	header->headerSize		!= sizeof(LDrawMeshCacheHeader)
+	   ||	header->vertexStride	!= LDRAW_MESH_CACHE_VERTEX_STRIDE
+	   ||	header->key.low			!= key.low
+	   ||	header->key.high		!= key.high
+	   ||	header->textureCount	!= textureCount
+	   ||	entryLength(header)		!= length )
+	{
+		munmap(mapping, length);
+		return NULL;
+	}
+
+	entry = calloc(1, sizeof(LDrawMeshCacheEntry));
+	if(entry == NULL)
+	{
+		munmap(mapping, length);
+		return NULL;
+	}
+
+	section				= (const char *)mapping + sizeof(LDrawMeshCacheHeader);
+	entry->mapping		= mapping;
+	entry->length		= length;
+	entry->header		= header;
+
+	entry->vertices		= (const float *)section;
+	section				+= (size_t)header->vertexCount * LDRAW_MESH_CACHE_VERTEX_STRIDE * sizeof(float);
+	entry->indices		= (const uint32_t *)section;
+	section				+= (size_t)header->indexCount * sizeof(uint32_t);
+	entry->ranges		= (const LDrawMeshCacheRanges *)section;
+
+	if(		rangesAreValid(header, entry->ranges) == false
+	   ||	indicesAreValid(header, entry->indices) == false )
+	{
+		LDrawMeshCacheEntryClose(entry);
+		return NULL;
+	}
+
+	return entry;
+
+}//end LDrawMeshCacheEntryOpen
+
+
+//========== LDrawMeshCacheEntryGetRanges ======================================
+//
+// Purpose:		Copies out each texture ID's ranges, in the arrays
+//				write_indexed_mesh would have filled.
+//
+//==============================================================================
+void LDrawMeshCacheEntryGetRanges(const LDrawMeshCacheEntry *entry,
+								  int lineStarts[], int lineCounts[],
+								  int conditionalLineStarts[], int conditionalLineCounts[],
+								  int triangleStarts[], int triangleCounts[],
+								  int quadrilateralStarts[], int quadrilateralCounts[])
+{
+	uint32_t	texture	= 0;
+
+	for(texture = 0; texture < entry->header->textureCount; texture++)
+	{
+		const LDrawMeshCacheRanges *ranges = entry->ranges + texture;
+
+		lineStarts[texture]				= ranges->lineStart;
+		lineCounts[texture]				= ranges->lineCount;
+		conditionalLineStarts[texture]	= ranges->conditionalLineStart;
+		conditionalLineCounts[texture]	= ranges->conditionalLineCount;
+		triangleStarts[texture]			= ranges->triangleStart;
+		triangleCounts[texture]			= ranges->triangleCount;
+		quadrilateralStarts[texture]	= ranges->quadrilateralStart;
+		quadrilateralCounts[texture]	= ranges->quadrilateralCount;
+	}
+
+}//end LDrawMeshCacheEntryGetRanges
+
+
+//========== LDrawMeshCacheEntryClose ==========================================
+//
+// Purpose:		Unmaps the entry. Pointers into it are invalid afterwards.
+//
+//==============================================================================
+void LDrawMeshCacheEntryClose(LDrawMeshCacheEntry *entry)
+{
+	if(entry != NULL)
+	{
+		munmap(entry->mapping, entry->length);
+		free(entry);
+	}
+}
+
+
+#pragma mark -
+#pragma mark WRITING
+#pragma mark -
+
+//========== LDrawMeshCacheEntryWrite ==========================================
+//
+// Purpose:		Saves an entry to path, replacing any entry already there.
+//
+//==============================================================================
+bool LDrawMeshCacheEntryWrite(const char *path,
+							  LDrawMeshCacheKey key,
+							  uint32_t vertexCount,
+							  const float *vertices,
+							  uint32_t indexCount,
+							  const uint32_t *indices,
+							  uint32_t textureCount,
+							  const int lineStarts[], const int lineCounts[],
+							  const int conditionalLineStarts[], const int conditionalLineCounts[],
+							  const int triangleStarts[], const int triangleCounts[],
+							  const int quadrilateralStarts[], const int quadrilateralCounts[])
+{
+	LDrawMeshCacheHeader	header;
+	LDrawMeshCacheRanges	*ranges			= calloc(textureCount ? textureCount : 1, sizeof(LDrawMeshCacheRanges));
+	uint32_t				texture			= 0;
+	bool					success			= false;
+
+	if(ranges == NULL)
+		return false;
+
+	for(texture = 0; texture < textureCount; texture++)
+	{
+		ranges[texture].lineStart				= lineStarts[texture];
+		ranges[texture].lineCount				= lineCounts[texture];
+		ranges[texture].conditionalLineStart	= conditionalLineStarts[texture];
+		ranges[texture].conditionalLineCount	= conditionalLineCounts[texture];
+		ranges[texture].triangleStart			= triangleStarts[texture];
+		ranges[texture].triangleCount			= triangleCounts[texture];
+		ranges[texture].quadrilateralStart		= quadrilateralStarts[texture];
+		ranges[texture].quadrilateralCount		= quadrilateralCounts[texture];
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic		= LDRAW_MESH_CACHE_MAGIC;
+	header.version		= LDRAW_MESH_CACHE_VERSION;
+	header.headerSize	= sizeof(LDrawMeshCacheHeader);
+	header.vertexStride	= LDRAW_MESH_CACHE_VERTEX_STRIDE;
+	header.key			= key;
+	header.vertexCount	= vertexCount;
+	header.indexCount	= indexCount;
+	header.textureCount	= textureCount;
+
+	LDrawWriteSection		sections[]		=
+	{
+		{ &header,			sizeof(header) },
+		{ vertices,			(size_t)vertexCount * LDRAW_MESH_CACHE_VERTEX_STRIDE * sizeof(float) },
+		{ indices,			(size_t)indexCount * sizeof(uint32_t) },
+		{ ranges,			(size_t)textureCount * sizeof(LDrawMeshCacheRanges) },
+	};
+
+	// Two windows may build the same part at once; LDrawAtomicWrite gives
+	// each writer its own temporary file.
+	success = LDrawAtomicWrite(path, sections, sizeof(sections) / sizeof(sections[0]));
+	free(ranges);
+
+	return success;
+
+}//end LDrawMeshCacheEntryWrite
+
+
+#pragma mark -
+#pragma mark HOUSEKEEPING
+#pragma mark -
+
+//========== LDrawMeshCachePrune ===============================================
+//
+// Purpose:		Deletes the least recently used entries in directory until the
+//				rest fit in maximumBytes.
+//
+// Notes:		Keys change whenever a model is edited, so without this the
+//				cache would only ever grow.
+//
+//==============================================================================
+void LDrawMeshCachePrune(const char *directory, uint64_t maximumBytes)
+{
+	DIR				*folder			= opendir(directory);
+	struct dirent	*item			= NULL;
+	PruneCandidate	*candidates		= NULL;
+	size_t			count			= 0;
+	size_t			capacity		= 0;
+	size_t			counter			= 0;
+	uint64_t		totalBytes		= 0;
+	size_t			extensionLength	= strlen(MESH_CACHE_EXTENSION);
+
+	if(folder == NULL)
+		return;
+
+	while((item = readdir(folder)) != NULL)
+	{
+		size_t		nameLength	= strlen(item->d_name);
+		char		*path		= NULL;
+		struct stat	fileInfo;
+
+		if(		nameLength <= extensionLength
+		   ||	strcmp(item->d_name + nameLength - extensionLength, MESH_CACHE_EXTENSION) != 0 )
+		{
+			continue;
+		}
+
+		path = malloc(strlen(directory) + nameLength + 2);
+		if(path == NULL)
+			break;
+		sprintf(path, "%s/%s", directory, item->d_name);
+
+		if(stat(path, &fileInfo) != 0 || S_ISREG(fileInfo.st_mode) == false)
+		{
+			free(path);
+			continue;
+		}
+
+		if(count == capacity)
+		{
+			size_t			newCapacity		= capacity ? capacity * 2 : 256;
+			PruneCandidate	*newCandidates	= realloc(candidates, newCapacity * sizeof(PruneCandidate));
+
+			if(newCandidates == NULL)
+			{
+				free(path);
+				break;
+			}
+			candidates	= newCandidates;
+			capacity	= newCapacity;
+		}
+
+		candidates[count].path		= path;
+		candidates[count].size		= (int64_t)fileInfo.st_size;
+		candidates[count].lastUse	= (int64_t)fileInfo.st_mtime;
+		totalBytes					+= (uint64_t)fileInfo.st_size;
+		count++;
+	}
+	closedir(folder);
+
+	if(totalBytes > maximumBytes)
+	{
+		qsort(candidates, count, sizeof(PruneCandidate), comparePruneCandidates);
+
+		for(counter = 0; counter < count && totalBytes > maximumBytes; counter++)
+		{
+			if(unlink(candidates[counter].path) == 0)
+				totalBytes -= (uint64_t)candidates[counter].size;
+		}
+	}
+
+	for(counter = 0; counter < count; counter++)
+		free(candidates[counter].path);
+	free(candidates);
+
+}//end LDrawMeshCachePrune
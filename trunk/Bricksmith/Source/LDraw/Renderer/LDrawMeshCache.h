@@ -0,0 +1,181 @@
+//==============================================================================
+//
+// File:		LDrawMeshCache.h
+//
+// Purpose:		A persistent, content-addressed cache of smoothed meshes.
+//
+//				Smoothing a display list's primitives (see MeshSmooth.h) is by
+//				far the most expensive part of building it, and a library part
+//				smooths to the same mesh every time. So the display list
+//				builders save what write_indexed_mesh produced - the vertex
+//				table, the index table and each texture's ranges within it -
+//				and next time only have to copy it into their buffers.
+//
+//				An entry is named by a 128-bit hash of everything that decides
+//				the smoothed mesh: each face in the order it was added, with its
+//				texture ID and color; the smoother's own parameters (EPSI, the
+//				crease angle, and so on); and which of the optional stages the
+//				builder ran. Change any of them and the key changes, so entries
+//				never have to be invalidated - stale ones simply stop being
+//				asked for, and are eventually pruned.
+//
+//				The layout is the native in-memory layout, so a mapped entry is
+//				copied straight out. Entries written by a different version or
+//				on a machine of different byte order are rejected.
+//
+//==============================================================================
+#ifndef _LDrawMeshCache_
+#define _LDrawMeshCache_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LDRAW_MESH_CACHE_MAGIC			0x434D5342		// "BSMC" read little-endian
+#define LDRAW_MESH_CACHE_VERSION		1
+#define LDRAW_MESH_CACHE_VERTEX_STRIDE	10				// xyz, normal, color
+
+// Smaller meshes smooth in a fraction of a millisecond; saving them would
+// mostly fill the folder with tiny entries, like the throwaway display lists
+// built while dragging.
+#define LDRAW_MESH_CACHE_MINIMUM_FACES	128
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// The optional MeshSmooth stages a mesh went through.
+typedef enum
+{
+	LDrawMeshCacheRemovedTJunctions			= 1 << 0,	// find_and_remove_t_junctions
+	LDrawMeshCacheOptimizedVertexCache		= 1 << 1	// optimize_vertex_cache
+
+} LDrawMeshCacheStages;
+
+
+typedef struct LDrawMeshCacheKeyStruct
+{
+	uint64_t	low;
+	uint64_t	high;
+
+} LDrawMeshCacheKey;
+
+
+// Accumulates a key. Treat as opaque.
+typedef struct LDrawMeshCacheHasherStruct
+{
+	uint64_t	lanes[2];
+	uint64_t	length;
+
+} LDrawMeshCacheHasher;
+
+
+// Where one texture ID's primitives lie in the index table, as
+// write_indexed_mesh reports them.
+typedef struct LDrawMeshCacheRangesStruct
+{
+	int32_t		lineStart;
+	int32_t		lineCount;
+	int32_t		conditionalLineStart;
+	int32_t		conditionalLineCount;
+	int32_t		triangleStart;
+	int32_t		triangleCount;
+	int32_t		quadrilateralStart;
+	int32_t		quadrilateralCount;
+
+} LDrawMeshCacheRanges;
+
+
+typedef struct LDrawMeshCacheHeaderStruct
+{
+	uint32_t			magic;
+	uint32_t			version;
+	uint32_t			headerSize;
+	uint32_t			vertexStride;
+
+	LDrawMeshCacheKey	key;			// catches a renamed or colliding file
+
+	uint32_t			vertexCount;
+	uint32_t			indexCount;
+	uint32_t			textureCount;
+	uint32_t			reserved;
+
+} LDrawMeshCacheHeader;
+
+
+// A cache entry, mapped for reading. The sections point into the mapping.
+typedef struct LDrawMeshCacheEntryStruct
+{
+	void						*mapping;
+	size_t						length;
+
+	const LDrawMeshCacheHeader	*header;
+	const float					*vertices;
+	const uint32_t				*indices;
+	const LDrawMeshCacheRanges	*ranges;		// one per texture ID
+
+} LDrawMeshCacheEntry;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Location. Caching is off until a directory is set; pass NULL to turn it off
+// again. The directory is created if it is missing.
+void					LDrawMeshCacheSetDirectory(const char *directory);
+const char *			LDrawMeshCacheGetDirectory(void);
+
+// Keys. Start with the stages the mesh will go through, then add every face
+// exactly as it is given to add_face. The number of textures isn't hashed;
+// LDrawMeshCacheEntryOpen checks it instead.
+void					LDrawMeshCacheHasherInit(LDrawMeshCacheHasher *hasher, uint32_t stages);
+void					LDrawMeshCacheHasherAddFace(LDrawMeshCacheHasher *hasher,
+													const float p1[3],
+													const float p2[3],
+													const float p3[3],
+													const float p4[3],
+													const float color[4],
+													int tid);
+LDrawMeshCacheKey		LDrawMeshCacheHasherFinish(const LDrawMeshCacheHasher *hasher);
+
+// Naming. Writes the entry's path within directory; returns false if it
+// doesn't fit.
+bool					LDrawMeshCachePathForKey(const char *directory, LDrawMeshCacheKey key, char *pathOut, size_t pathSize);
+
+// Reading. Open returns NULL if the file is missing, truncated, written by
+// another version, for another key or number of textures, or has a range or
+// index out of bounds.
+LDrawMeshCacheEntry *	LDrawMeshCacheEntryOpen(const char *path, LDrawMeshCacheKey key, uint32_t textureCount);
+void					LDrawMeshCacheEntryGetRanges(const LDrawMeshCacheEntry *entry,
+													 int lineStarts[], int lineCounts[],
+													 int conditionalLineStarts[], int conditionalLineCounts[],
+													 int triangleStarts[], int triangleCounts[],
+													 int quadrilateralStarts[], int quadrilateralCounts[]);
+void					LDrawMeshCacheEntryClose(LDrawMeshCacheEntry *entry);
+
+// Writing. Takes the tables and ranges just as write_indexed_mesh output them.
+// The entry is written to a temporary file and renamed into place, so readers
+// never see half of it.
+bool					LDrawMeshCacheEntryWrite(const char *path,
+												 LDrawMeshCacheKey key,
+												 uint32_t vertexCount,
+												 const float *vertices,
+												 uint32_t indexCount,
+												 const uint32_t *indices,
+												 uint32_t textureCount,
+												 const int lineStarts[], const int lineCounts[],
+												 const int conditionalLineStarts[], const int conditionalLineCounts[],
+												 const int triangleStarts[], const int triangleCounts[],
+												 const int quadrilateralStarts[], const int quadrilateralCounts[]);
+
+// Housekeeping. Deletes the least recently used entries until the directory
+// holds no more than maximumBytes of them. Opening an entry counts as a use.
+void					LDrawMeshCachePrune(const char *directory, uint64_t maximumBytes);
+
+#endif // _LDrawMeshCache_
@@ -0,0 +1,593 @@
+//==============================================================================
+//
+// File:		LDrawOcclusion.c
+//
+// Purpose:		Culling parts hidden behind other parts, on the CPU.
+//
+// Notes:		Depths are normalized device Z, which is affine in screen space
+//				across any flat polygon, so a box face's depth over a texel is a
+//				plane and its farthest point is at one of the texel's corners.
+//
+//				Occluders are drawn the way a GPU would, into the texels whose
+//				centers they cover, so the faces of boxes that butt up against
+//				each other - bricks in a wall - leave no cracks between them.
+//				Each such texel gets the farthest depth of the face's plane over
+//				it and its neighbours. Then every texel takes the farthest of
+//				itself and its eight neighbours, which keeps only texels inside
+//				the occluders whole, and gives them a depth no nearer than that
+//				of any occluder seen over them.
+//				The pyramid above keeps the farthest of each four texels below,
+//				so a box nearer than the pyramid anywhere over its footprint
+//				may be seen.
+//
+//				Texels are measured from the bottom left of the view, as in
+//				normalized device coordinates.
+//
+//==============================================================================
+#include "LDrawOcclusion.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define MAX_OCCLUDERS		512			// biggest boxes on screen drawn per pass
+#define MIN_OCCLUDER_AREA	16.0f		// texels a box's screen rectangle must cover
+#define MAX_LEVELS			16
+#define DEPTH_SLACK			1e-6f		// hides rounding in the occluders' depths
+
+// Where a box lands on screen.
+typedef struct LDrawOcclusionFootprintStruct
+{
+	float	x0, y0, x1, y1;				// screen rectangle, in texels
+	float	nearest;					// nearest normalized device Z
+	float	area;						// of the rectangle, in texels
+	int		inFront;					// every corner in front of the eye
+
+} LDrawOcclusionFootprint;
+
+struct LDrawOcclusionStruct
+{
+	int							width;
+	int							height;
+	int							levelCount;
+	int							levelWidths[MAX_LEVELS];
+	int							levelHeights[MAX_LEVELS];
+	int							levelOffsets[MAX_LEVELS];
+	float						*depths;			// every level, finest first
+	float						*drawn;				// the occluders, before widening
+
+	LDrawOcclusionFootprint		*footprints;		// one per item of a pass
+	int							capacity;
+	int							occluders[MAX_OCCLUDERS];	// min-heap by area
+
+	LDrawOcclusionStats			stats;
+};
+
+// Each box face's corners, in order around it. Corner bits are x, y, z.
+static const int faceCorners[6][4] = {
+	{ 0, 2, 6, 4 }, { 1, 3, 7, 5 },
+	{ 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+	{ 0, 1, 3, 2 }, { 4, 5, 7, 6 }
+};
+
+
+#pragma mark -
+#pragma mark Projection
+#pragma mark -
+
+//========== projectBox ========================================================
+//
+// Purpose:		Takes a box's corners to texel x, y and normalized device Z.
+//				Returns false, leaving the corners undefined, if any of them is
+//				not in front of the eye.
+//
+//==============================================================================
+static int projectBox(const LDrawOcclusion *occlusion, const float box[6], const float m[16], double corners[8][3])
+{
+	int corner;
+
+	for(corner = 0; corner < 8; corner++)
+	{
+		double x = box[(corner & 1) ? 3 : 0];
+		double y = box[(corner & 2) ? 4 : 1];
+		double z = box[(corner & 4) ? 5 : 2];
+		double w = m[3] * x + m[7] * y + m[11] * z + m[15];
+
+		if(!(w > 0))
+			return 0;
+
+		corners[corner][0] = ((m[0] * x + m[4] * y + m[8]  * z + m[12]) / w + 1) * 0.5 * occlusion->width;
+		corners[corner][1] = ((m[1] * x + m[5] * y + m[9]  * z + m[13]) / w + 1) * 0.5 * occlusion->height;
+		corners[corner][2] =  (m[2] * x + m[6] * y + m[10] * z + m[14]) / w;
+	}
+
+	return 1;
+
+}//end projectBox
+
+
+//========== measureBox ========================================================
+//
+// Purpose:		Works out a box's footprint.
+//
+//==============================================================================
+static void measureBox(const LDrawOcclusion *occlusion, const float box[6], const float m[16],
+					   LDrawOcclusionFootprint *footprint)
+{
+	double	corners[8][3];
+	double	low[3]		= { DBL_MAX, DBL_MAX, DBL_MAX };
+	double	high[3]		= { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	int		corner, axis;
+
+	footprint->inFront = !(box[0] > box[3] || box[1] > box[4] || box[2] > box[5])
+					  && projectBox(occlusion, box, m, corners);
+	if(!footprint->inFront)
+	{
+		footprint->area = 0;
+		return;
+	}
+
+	for(corner = 0; corner < 8; corner++)
+	{
+		for(axis = 0; axis < 3; axis++)
+		{
+			if(corners[corner][axis] < low[axis])	low[axis] = corners[corner][axis];
+			if(corners[corner][axis] > high[axis])	high[axis] = corners[corner][axis];
+		}
+	}
+
+	footprint->x0		= low[0];
+	footprint->y0		= low[1];
+	footprint->x1		= high[0];
+	footprint->y1		= high[1];
+	footprint->nearest	= low[2];
+	footprint->area		= (high[0] - low[0]) * (high[1] - low[1]);
+
+}//end measureBox
+
+
+#pragma mark -
+#pragma mark Drawing Occluders
+#pragma mark -
+
+//========== drawConvex ========================================================
+//
+// Purpose:		Draws a convex polygon, in either winding: each texel whose
+//				center is inside it takes the farthest depth of the polygon's
+//				plane over the texel and its neighbours, if that is nearer than
+//				what it has.
+//
+// Notes:		Depth is z = plane[0] x + plane[1] y + plane[2]. Texel (i, j)
+//				spans [i, i + 1] x [j, j + 1]. Centers right on an edge are
+//				inside, so polygons sharing the edge both draw them.
+//
+//==============================================================================
+static void drawConvex(LDrawOcclusion *occlusion, const double points[][2], int count, const double plane[3])
+{
+	double	area		= 0;
+	double	low			= DBL_MAX;
+	double	high		= -DBL_MAX;
+	double	spread		= 1.5 * (fabs(plane[0]) + fabs(plane[1]));
+	double	sign		= 0;
+	int		row, rowFirst, rowLast;
+	int		edge;
+
+	for(edge = 0; edge < count; edge++)
+	{
+		const double *p0 = points[edge];
+		const double *p1 = points[(edge + 1) % count];
+
+		area += p0[0] * p1[1] - p1[0] * p0[1];
+		if(p0[1] < low)		low = p0[1];
+		if(p0[1] > high)	high = p0[1];
+	}
+	if(fabs(area) < 1e-9)
+		return;
+	sign = area > 0 ? 1 : -1;
+
+	rowFirst	= (int)ceil(low - 0.5);
+	rowLast		= (int)floor(high - 0.5);
+	if(rowFirst < 0)						rowFirst = 0;
+	if(rowLast > occlusion->height - 1)		rowLast = occlusion->height - 1;
+
+	for(row = rowFirst; row <= rowLast; row++)
+	{
+		double	cy		= row + 0.5;
+		double	left	= 0.5;
+		double	right	= occlusion->width - 0.5;
+		float	*drawn	= occlusion->drawn + row * occlusion->width;
+		int		column, columnFirst, columnLast;
+
+		// sign * cross(p1 - p0, c - p0) >= 0 keeps the center inside; it is
+		// linear in the center's x.
+		for(edge = 0; edge < count && left <= right; edge++)
+		{
+			const double	*p0		= points[edge];
+			const double	*p1		= points[(edge + 1) % count];
+			double			dx		= p1[0] - p0[0];
+			double			dy		= p1[1] - p0[1];
+			double			slope	= -sign * dy;
+			double			bound	= -sign * (dx * (cy - p0[1]) + dy * p0[0]);
+
+			if(slope > 0)
+			{
+				if(bound / slope > left)	left = bound / slope;
+			}
+			else if(slope < 0)
+			{
+				if(bound / slope < right)	right = bound / slope;
+			}
+			else if(bound > 0)
+				right = -1;
+		}
+		if(left > right)
+			continue;
+
+		columnFirst	= (int)ceil(left - 0.5);
+		columnLast	= (int)floor(right - 0.5);
+		for(column = columnFirst; column <= columnLast; column++)
+		{
+			float depth = plane[0] * (column + 0.5) + plane[1] * cy + plane[2] + spread;
+
+			if(depth < drawn[column])
+				drawn[column] = depth;
+		}
+	}
+
+}//end drawConvex
+
+
+//========== drawOccluder ======================================================
+//
+// Purpose:		Draws a box's faces.
+//
+//==============================================================================
+static void drawOccluder(LDrawOcclusion *occlusion, const float box[6], const float m[16])
+{
+	double	corners[8][3];
+	int		face, corner;
+
+	if(!projectBox(occlusion, box, m, corners))
+		return;
+
+	for(face = 0; face < 6; face++)
+	{
+		const int	*indices	= faceCorners[face];
+		double		points[4][2];
+		double		plane[3];
+		double		*p0			= corners[indices[0]];
+		double		*p1			= corners[indices[1]];
+		double		*p2			= corners[indices[2]];
+		double		det			= (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p2[0] - p0[0]) * (p1[1] - p0[1]);
+
+		// Edge on; the faces around it have its texels.
+		if(fabs(det) < 1e-9)
+			continue;
+
+		plane[0] = ((p1[2] - p0[2]) * (p2[1] - p0[1]) - (p2[2] - p0[2]) * (p1[1] - p0[1])) / det;
+		plane[1] = ((p1[0] - p0[0]) * (p2[2] - p0[2]) - (p2[0] - p0[0]) * (p1[2] - p0[2])) / det;
+		plane[2] = p0[2] - plane[0] * p0[0] - plane[1] * p0[1];
+
+		for(corner = 0; corner < 4; corner++)
+		{
+			points[corner][0] = corners[indices[corner]][0];
+			points[corner][1] = corners[indices[corner]][1];
+		}
+		drawConvex(occlusion, (const double (*)[2])points, 4, plane);
+	}
+
+}//end drawOccluder
+
+
+//========== buildPyramid ======================================================
+//
+// Purpose:		Fills the finest level with the farthest of each drawn texel
+//				and its neighbours, and each coarser level with the farthest of
+//				the (up to) four texels under each of its texels.
+//
+// Notes:		Nothing can be seen off the edge of the view, so neighbours
+//				there don't count.
+//
+//==============================================================================
+static void buildPyramid(LDrawOcclusion *occlusion)
+{
+	int width	= occlusion->width;
+	int height	= occlusion->height;
+	int level, row, column;
+
+	for(row = 0; row < height; row++)
+	{
+		int rowFirst	= row > 0 ? row - 1 : row;
+		int rowLast		= row < height - 1 ? row + 1 : row;
+
+		for(column = 0; column < width; column++)
+		{
+			int		columnFirst	= column > 0 ? column - 1 : column;
+			int		columnLast	= column < width - 1 ? column + 1 : column;
+			float	depth		= -FLT_MAX;
+			int		x, y;
+
+			for(y = rowFirst; y <= rowLast; y++)
+			{
+				for(x = columnFirst; x <= columnLast; x++)
+				{
+					if(occlusion->drawn[y * width + x] > depth)
+						depth = occlusion->drawn[y * width + x];
+				}
+			}
+			occlusion->depths[row * width + column] = depth;
+		}
+	}
+
+	for(level = 1; level < occlusion->levelCount; level++)
+	{
+		const float	*fine		= occlusion->depths + occlusion->levelOffsets[level - 1];
+		float		*coarse		= occlusion->depths + occlusion->levelOffsets[level];
+		int			fineWidth	= occlusion->levelWidths[level - 1];
+		int			fineHeight	= occlusion->levelHeights[level - 1];
+
+		for(row = 0; row < occlusion->levelHeights[level]; row++)
+		{
+			for(column = 0; column < occlusion->levelWidths[level]; column++)
+			{
+				int		x		= column * 2;
+				int		y		= row * 2;
+				float	depth	= fine[y * fineWidth + x];
+
+				if(x + 1 < fineWidth && fine[y * fineWidth + x + 1] > depth)
+					depth = fine[y * fineWidth + x + 1];
+				if(y + 1 < fineHeight)
+				{
+					if(fine[(y + 1) * fineWidth + x] > depth)
+						depth = fine[(y + 1) * fineWidth + x];
+					if(x + 1 < fineWidth && fine[(y + 1) * fineWidth + x + 1] > depth)
+						depth = fine[(y + 1) * fineWidth + x + 1];
+				}
+				coarse[row * occlusion->levelWidths[level] + column] = depth;
+			}
+		}
+	}
+
+}//end buildPyramid
+
+
+#pragma mark -
+#pragma mark Testing
+#pragma mark -
+
+//========== isHidden ==========================================================
+//
+// Purpose:		True if a footprint is behind the pyramid everywhere over it.
+//
+// Notes:		The test is made at the finest level where the footprint
+//				spans at most two texels each way.
+//
+//==============================================================================
+static int isHidden(const LDrawOcclusion *occlusion, const LDrawOcclusionFootprint *footprint)
+{
+	const float	*depths;
+	float		farthest	= -FLT_MAX;
+	int			x0, y0, x1, y1;
+	int			level		= 0;
+	int			row, column;
+
+	if(!footprint->inFront)
+		return 0;
+	if(		footprint->x1 < 0 || footprint->x0 >= occlusion->width
+	   ||	footprint->y1 < 0 || footprint->y0 >= occlusion->height)
+		return 0;
+
+	x0 = footprint->x0 < 0 ? 0 : (int)footprint->x0;
+	y0 = footprint->y0 < 0 ? 0 : (int)footprint->y0;
+	x1 = footprint->x1 >= occlusion->width  ? occlusion->width  - 1 : (int)footprint->x1;
+	y1 = footprint->y1 >= occlusion->height ? occlusion->height - 1 : (int)footprint->y1;
+
+	while((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)
+		level++;
+
+	depths = occlusion->depths + occlusion->levelOffsets[level];
+	for(row = y0 >> level; row <= y1 >> level; row++)
+	{
+		for(column = x0 >> level; column <= x1 >> level; column++)
+		{
+			float depth = depths[row * occlusion->levelWidths[level] + column];
+
+			if(depth > farthest)
+				farthest = depth;
+		}
+	}
+
+	return footprint->nearest > farthest + DEPTH_SLACK;
+
+}//end isHidden
+
+
+#pragma mark -
+#pragma mark Occluder Heap
+#pragma mark -
+
+//========== siftDown ==========================================================
+//
+// Purpose:		Restores the min-heap of occluders, by footprint area, below
+//				slot.
+//
+//==============================================================================
+static void siftDown(LDrawOcclusion *occlusion, int size, int slot)
+{
+	int *heap = occlusion->occluders;
+
+	while(2 * slot + 1 < size)
+	{
+		int child = 2 * slot + 1;
+		int swap;
+
+		if(		child + 1 < size
+		   &&	occlusion->footprints[heap[child + 1]].area < occlusion->footprints[heap[child]].area)
+			child++;
+		if(occlusion->footprints[heap[slot]].area <= occlusion->footprints[heap[child]].area)
+			break;
+
+		swap		= heap[slot];
+		heap[slot]	= heap[child];
+		heap[child]	= swap;
+		slot		= child;
+	}
+
+}//end siftDown
+
+
+//========== chooseOccluders ===================================================
+//
+// Purpose:		Keeps the items with the biggest footprints in the heap and
+//				returns how many there are.
+//
+//==============================================================================
+static int chooseOccluders(LDrawOcclusion *occlusion, int count)
+{
+	int *heap	= occlusion->occluders;
+	int size	= 0;
+	int counter	= 0;
+	int slot	= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		float area = occlusion->footprints[counter].area;
+
+		if(area < MIN_OCCLUDER_AREA)
+			continue;
+
+		if(size < MAX_OCCLUDERS)
+		{
+			// Sift up.
+			for(slot = size++; slot > 0 && occlusion->footprints[heap[(slot - 1) / 2]].area > area; slot = (slot - 1) / 2)
+				heap[slot] = heap[(slot - 1) / 2];
+			heap[slot] = counter;
+		}
+		else if(area > occlusion->footprints[heap[0]].area)
+		{
+			heap[0] = counter;
+			siftDown(occlusion, size, 0);
+		}
+	}
+
+	return size;
+
+}//end chooseOccluders
+
+
+#pragma mark -
+#pragma mark Public
+#pragma mark -
+
+//========== LDrawOcclusionCreate ==============================================
+//
+// Purpose:		Makes an occlusion culler with a depth buffer of the given size.
+//
+//==============================================================================
+LDrawOcclusion * LDrawOcclusionCreate(int width, int height)
+{
+	LDrawOcclusion	*occlusion	= (LDrawOcclusion *)calloc(1, sizeof(LDrawOcclusion));
+	int				total		= 0;
+	int				level		= 0;
+
+	occlusion->width	= width;
+	occlusion->height	= height;
+
+	for(level = 0; level < MAX_LEVELS; level++)
+	{
+		occlusion->levelWidths[level]	= level ? (occlusion->levelWidths[level - 1] + 1) / 2 : width;
+		occlusion->levelHeights[level]	= level ? (occlusion->levelHeights[level - 1] + 1) / 2 : height;
+		occlusion->levelOffsets[level]	= total;
+		total += occlusion->levelWidths[level] * occlusion->levelHeights[level];
+		occlusion->levelCount = level + 1;
+
+		if(occlusion->levelWidths[level] == 1 && occlusion->levelHeights[level] == 1)
+			break;
+	}
+	occlusion->depths	= (float *)malloc(sizeof(float) * total);
+	occlusion->drawn	= (float *)malloc(sizeof(float) * width * height);
+
+	return occlusion;
+
+}//end LDrawOcclusionCreate
+
+
+//========== LDrawOcclusionDestroy =============================================
+//
+// Purpose:		Frees the culler.
+//
+//==============================================================================
+void LDrawOcclusionDestroy(LDrawOcclusion *occlusion)
+{
+	if(occlusion == NULL)
+		return;
+
+	free(occlusion->footprints);
+	free(occlusion->drawn);
+	free(occlusion->depths);
+	free(occlusion);
+
+}//end LDrawOcclusionDestroy
+
+
+//========== LDrawOcclusionCull ================================================
+//
+// Purpose:		Drops the items hidden behind the biggest of them.
+//
+//==============================================================================
+int LDrawOcclusionCull(LDrawOcclusion *occlusion, const float mvp[16],
+					   const float *boxes, int *items, int count)
+{
+	int		occluderCount	= 0;
+	int		kept			= 0;
+	int		counter			= 0;
+
+	if(count <= 1)
+		return count;
+
+	if(count > occlusion->capacity)
+	{
+		occlusion->capacity		= count;
+		occlusion->footprints	= (LDrawOcclusionFootprint *)realloc(occlusion->footprints,
+																	 sizeof(LDrawOcclusionFootprint) * count);
+	}
+
+	for(counter = 0; counter < count; counter++)
+		measureBox(occlusion, boxes + 6 * items[counter], mvp, occlusion->footprints + counter);
+
+	occluderCount = chooseOccluders(occlusion, count);
+
+	occlusion->stats.passes++;
+	occlusion->stats.tested		+= count;
+	occlusion->stats.occluders	+= occluderCount;
+	if(occluderCount == 0)
+		return count;
+
+	for(counter = 0; counter < occlusion->width * occlusion->height; counter++)
+		occlusion->drawn[counter] = FLT_MAX;
+	for(counter = 0; counter < occluderCount; counter++)
+		drawOccluder(occlusion, boxes + 6 * items[occlusion->occluders[counter]], mvp);
+	buildPyramid(occlusion);
+
+	for(counter = 0; counter < count; counter++)
+	{
+		if(!isHidden(occlusion, occlusion->footprints + counter))
+			items[kept++] = items[counter];
+	}
+	occlusion->stats.culled += count - kept;
+
+	return kept;
+
+}//end LDrawOcclusionCull
+
+
+//========== LDrawOcclusionGetStats ============================================
+//
+// Purpose:		Returns the running totals.
+//
+//==============================================================================
+LDrawOcclusionStats LDrawOcclusionGetStats(const LDrawOcclusion *occlusion)
+{
+	return occlusion->stats;
+
+}//end LDrawOcclusionGetStats
@@ -0,0 +1,57 @@
+//==============================================================================
+//
+// File:		LDrawOcclusion.h
+//
+// Purpose:		Culling parts hidden behind other parts, on the CPU, before they
+//				are ever queued for the GPU.
+//
+//				Dense models - MOCs with solid walls - spend most of their GPU
+//				time on bricks nobody can see. Given the parts that survived
+//				frustum culling, this picks the biggest of them on screen as
+//				occluders, draws their bounding boxes into a small depth buffer,
+//				builds a pyramid of the farthest depth in each block of it, and
+//				then drops every part whose bounding box is wholly behind the
+//				pyramid over the box's footprint.
+//
+//				The depth buffer is itself conservative - a texel only takes the
+//				occluders' depth where they cover all of it, and then their
+//				farthest depth there - but the occluders are boxes. A part
+//				seen through a gap in an occluder's box - a window, an arch, the
+//				open underside of a brick - can be dropped. So this is optional:
+//				renderers only do it when handed an occlusion, which counts what
+//				it did so the gain can be weighed up.
+//
+//==============================================================================
+#ifndef _LDrawOcclusion_
+#define _LDrawOcclusion_
+
+// The depth buffer's size; it covers the view, whatever the view's aspect.
+#define LDRAW_OCCLUSION_WIDTH		256
+#define LDRAW_OCCLUSION_HEIGHT		128
+
+typedef struct LDrawOcclusionStruct	LDrawOcclusion;
+
+// What culling has done since the occlusion was created.
+typedef struct LDrawOcclusionStatsStruct
+{
+	int		passes;				// calls to LDrawOcclusionCull
+	int		tested;				// parts tested
+	int		occluders;			// parts drawn into the depth buffer
+	int		culled;				// parts found hidden and dropped
+
+} LDrawOcclusionStats;
+
+
+LDrawOcclusion *	LDrawOcclusionCreate(int width, int height);
+void				LDrawOcclusionDestroy(LDrawOcclusion *occlusion);
+
+// Drops the hidden parts from items, a list of count indices into boxes (6
+// floats each: min x y z, max x y z), keeping the rest in order. Returns how
+// many are left. The depth buffer starts afresh on every call, with occluders
+// from among these items only. mvp takes the boxes to clip space.
+int					LDrawOcclusionCull(LDrawOcclusion *occlusion, const float mvp[16],
+									   const float *boxes, int *items, int count);
+
+LDrawOcclusionStats	LDrawOcclusionGetStats(const LDrawOcclusion *occlusion);
+
+#endif // _LDrawOcclusion_
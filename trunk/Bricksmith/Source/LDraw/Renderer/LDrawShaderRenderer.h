@@ -33,6 +33,8 @@ enum {
 	attr_color_current,
 	attr_color_compliment,
 	attr_texture_mix,
+	attr_position_offset,	// Decodes compact vertices; see LDrawDLSetVertexFormat.
+	attr_position_scale,
 	attr_count
 };
 
@@ -54,6 +56,7 @@ struct	LDrawDragHandleInstance {
 
 struct	LDrawDLBuilder;
 struct	LDrawBDP;
+struct	LDrawOcclusionStruct;
 struct	LDrawDragHandleInstance;
 
 @interface LDrawShaderRenderer : NSObject<LDrawCoreRenderer,LDrawCollector> {
@@ -68,6 +71,8 @@ struct	LDrawDragHandleInstance;
 
 	int								wire_frame_count;								// wire frame stack is just a count.
 
+	int								detail_now;										// Detail level for the next DL drawn, from the last cull check.
+
 
 	struct LDrawTextureSpec			tex_stack[TEXTURE_STACK_DEPTH];					// Texture stack from push/pop texture.
 	int								texture_stack_top;
@@ -87,9 +92,16 @@ struct	LDrawDragHandleInstance;
 	struct LDrawDragHandleInstance *drag_handles;									// List of drag handles - deferred to draw at the end for perf and correct scaling.
 	float							scale;											// Needed to code Allen's res-independent drag handles...someday get this from viewport?
 
+	struct LDrawOcclusionStruct *	occlusion;										// Not ours; culls hidden parts after the BVH, if set.
+
 
 	// Metal
 	RenderEncoder					_renderEncoder;
 }
 
+// Parts cullBVH: finds on screen are then tested against the biggest of them,
+// and the hidden ones dropped; see LDrawOcclusion.h.  The occlusion is not ours.
+// NULL, the default, turns it off.
+- (void) setOcclusion:(struct LDrawOcclusionStruct *)newOcclusion;
+
 @end
@@ -11,6 +11,9 @@
 #import "GPU.h"
 #import  LDrawDisplayList_h
 #import "LDrawBDPAllocator.h"
+#import "LDrawBVH.h"
+#import "LDrawDLBuildQueue.h"
+#import "LDrawOcclusion.h"
 #import  LDrawShaderRendererGPU_h
 #import "MatrixMathEx.h"
 #import "ColorLibrary.h"
@@ -49,6 +52,86 @@ static void set_color4fv(float * c, float storage[4])
 }//end set_color4fv
 
 
+// Display lists with fewer faces than this finish in well under a millisecond,
+// so they are built on the spot rather than drawn as a box for a frame.
+#define BACKGROUND_BUILD_MIN_FACES 512
+
+
+//========== shared_build_queue ==================================================
+//
+// Purpose:	Return the worker pool every renderer builds its DLs on.
+//
+//================================================================================
+static LDrawDLBuildQueue * shared_build_queue(void)
+{
+	static LDrawDLBuildQueue *	queue = NULL;
+	static dispatch_once_t		once;
+
+	dispatch_once(&once, ^{
+		queue = LDrawDLBuildQueueCreate(0);
+	});
+	return queue;
+
+}//end shared_build_queue
+
+
+//========== prepare_builder =====================================================
+//
+// Purpose:	Build job for a DL that is built on the spot.
+//
+//================================================================================
+static void prepare_builder(void * ctx)
+{
+	LDrawDLBuilderPrepare((struct LDrawDLBuilder *) ctx);
+
+}//end prepare_builder
+
+
+//========== prepare_builder_in_background =======================================
+//
+// Purpose:	Build job for a DL handed to the workers: once it is prepared, let
+//			the views know they can redraw to take it.
+//
+//================================================================================
+static void prepare_builder_in_background(void * ctx)
+{
+	LDrawDLBuilderPrepare((struct LDrawDLBuilder *) ctx);
+
+	dispatch_async(dispatch_get_main_queue(), ^{
+		[[NSNotificationQueue defaultQueue]
+				enqueueNotification:[NSNotification notificationWithName:LDrawDLBuildDidFinishNotification object:nil]
+					   postingStyle:NSPostASAP
+					   coalesceMask:NSNotificationCoalescingOnName
+						   forModes:nil];
+	});
+
+}//end prepare_builder_in_background
+
+
+//========== discard_builder =====================================================
+//
+// Purpose:	Clean up a DL build that was cancelled.
+//
+//================================================================================
+static void discard_builder(void * ctx)
+{
+	LDrawDLBuilderDestroy((struct LDrawDLBuilder *) ctx);
+
+}//end discard_builder
+
+
+//========== cancel_build ========================================================
+//
+// Purpose:	The LDrawDLBuildCancel_f for our build handles.
+//
+//================================================================================
+static void cancel_build(LDrawDLBuildHandle who)
+{
+	LDrawDLBuildJobCancel((LDrawDLBuildJob *) who);
+
+}//end cancel_build
+
+
 
 //================================================================================
 @implementation LDrawShaderRenderer
@@ -100,13 +183,16 @@ static void set_color4fv(float * c, float storage[4])
 //			bounding cube (in MV coordinates) is now entirely out of clip bounds.
 //
 // Notes:	we also look at the screen-space size of the box to decide if we can
-//			cull it because it's tiny or replace it with a box.
+//			cull it because it's tiny or replace it with a box, and which detail
+//			level the next DL we draw should use.
 //
 // TODO:	change hard-coded values to be compensated for aspect ratio, etc.
 //
 //================================================================================
 - (int) checkCull:(float *)minXYZ to:(float *)maxXYZ
 {
+	detail_now = detail_full;
+
 	if (minXYZ[0] > maxXYZ[0] ||
 		minXYZ[1] > maxXYZ[1] ||
 		minXYZ[2] > maxXYZ[2])		return cull_skip;
@@ -127,6 +213,11 @@ static void set_color4fv(float * c, float storage[4])
 	int x_pix = (aabb_ndc[3] - aabb_ndc[0]) * 512.0;
 	int y_pix = (aabb_ndc[4] - aabb_ndc[1]) * 384.0;
 	int dim = MAX(x_pix,y_pix);
+
+	if(dim <= LDrawDetailLowestPixels)
+		detail_now = detail_lowest;
+	else if(dim <= LDrawDetailLowPixels)
+		detail_now = detail_low;
 	
 	if(dim < 1)
 		return cull_skip;
@@ -137,6 +228,38 @@ static void set_color4fv(float * c, float storage[4])
 }//end pushMatrix:to:
 
 
+//========== cullBVH:visible:dropTiny: ===========================================
+//
+// Purpose: cull a whole BVH of bounding boxes against the current transform at
+//			once.  The pixel scale is checkCull's, so the two agree on what is
+//			too small to see.
+//
+//================================================================================
+- (int) cullBVH:(struct LDrawBVHStruct *)bvh visible:(int *)visible dropTiny:(BOOL)dropTiny
+{
+	static const float pixel_scale[2] = { 512.0f, 384.0f };
+
+	int count = LDrawBVHCull(bvh, cull_now, dropTiny ? pixel_scale : NULL, visible);
+
+	if(occlusion)
+		count = LDrawOcclusionCull(occlusion, cull_now, LDrawBVHBoxes(bvh), visible, count);
+
+	return count;
+}//end cullBVH:visible:dropTiny:
+
+
+//========== setOcclusion: =======================================================
+//
+// Purpose: cull the parts hidden behind other parts in cullBVH:, or stop doing
+//			so if newOcclusion is NULL.
+//
+//================================================================================
+- (void) setOcclusion:(struct LDrawOcclusionStruct *)newOcclusion
+{
+	occlusion = newOcclusion;
+}//end setOcclusion:
+
+
 //========== drawBoxFrom:to: =====================================================
 //
 // Purpose: draw an axis-aligned cube of a given size.
@@ -469,18 +592,87 @@ static void set_color4fv(float * c, float storage[4])
 }//end endDL:cleanupFunc:
 
 
+//========== endDLInBackground: ==================================================
+//
+// Purpose:	close off a DL, leaving smoothing it to the build queue.
+//
+// Notes:	The workers only ever see the builder, never the directives, so
+//			nothing else needs to be thread-safe.  Small DLs are prepared right
+//			here; their builds come back already done.
+//
+//================================================================================
+- (LDrawDLBuildHandle) endDLInBackground:(LDrawDLBuildCancel_f *)cancelFunc
+{
+	assert(dl_stack_top > 0);
+	struct LDrawDLBuilder * builder = dl_now;
+	LDrawDLBuildQueue * queue = NULL;
+	LDrawDLBuildJob * job = NULL;
+
+	--dl_stack_top;
+	dl_now = dl_stack[dl_stack_top];
+
+	if(builder)
+	{
+		if(LDrawDLBuilderGetFaceCount(builder) >= BACKGROUND_BUILD_MIN_FACES)
+			queue = shared_build_queue();
+
+		if(queue)
+			job = LDrawDLBuildQueueSubmit(queue, prepare_builder_in_background, discard_builder, builder);
+		else
+			job = LDrawDLBuildQueueSubmit(NULL, prepare_builder, discard_builder, builder);
+	}
+
+	*cancelFunc = cancel_build;
+	return (LDrawDLBuildHandle) job;
+
+}//end endDLInBackground:
+
+
+//========== takeDL:handle:cleanupFunc: ==========================================
+//
+// Purpose:	Finish a background build if it is ready - which leaves only the
+//			upload to do on this thread.
+//
+//================================================================================
+- (BOOL) takeDL:(LDrawDLBuildHandle)build handle:(LDrawDLHandle *)outHandle cleanupFunc:(LDrawDLCleanup_f *)func
+{
+	LDrawDLBuildJob * job = (LDrawDLBuildJob *) build;
+
+	if(!LDrawDLBuildJobIsDone(job))
+		return NO;
+
+	struct LDrawDLBuilder * builder = (struct LDrawDLBuilder *) LDrawDLBuildJobFinish(job);
+
+	*outHandle = (LDrawDLHandle)[self builderFinish:builder];
+	*func = (LDrawDLCleanup_f) LDrawDLDestroy;
+
+	return YES;
+
+}//end takeDL:handle:cleanupFunc:
+
+
 //========== drawDL: =============================================================
 //
 // Purpose:	draw a DL using the current state.  We pass this to our DL session 
 //			that sorts out how to actually do tihs.
 //
+// Notes:	The last cull check picks the detail level; it applies to this one
+//			DL only.
+//
 //================================================================================
 - (void) drawDL:(LDrawDLHandle)dl
 {
+	struct LDrawDL * draw_dl = (struct LDrawDL *) dl;
+
+	// Wire frames show the mesh itself, so they always get all of it.
+	if(detail_now != detail_full && wire_frame_count == 0)
+		draw_dl = LDrawDLGetDetail(draw_dl, detail_now);
+	detail_now = detail_full;
+
 	LDrawDLDraw(
 		_renderEncoder,
 		session,
-		(struct LDrawDL *) dl,
+		draw_dl,
 		&tex_now,
 		color_now,
 		compl_now,
@@ -0,0 +1,1916 @@
+//==============================================================================
+//
+// File:		LDrawSoftRaster.c
+//
+// Purpose:		A tile-based software rasterizer for display lists.
+//
+// Notes:		Positions are snapped to 1/16 pixel and triangles are filled by
+//				integer edge functions with a top-left rule, so neighbouring
+//				triangles never both draw, or both miss, a pixel on their shared
+//				edge. Pixel centres are at half-integer coordinates.
+//
+//				A session draws in batches of instances, so the primitives
+//				waiting to be filled never take more than a bounded amount of
+//				memory however big the model.
+//
+//==============================================================================
+#include "LDrawSoftRaster.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "LDrawDLBuildQueue.h"
+#include "LDrawDepthSort.h"
+#include "LDrawMeshCache.h"
+#include "MatrixMathEx.h"
+#include "MeshSmooth.h"
+
+#if !defined(MIN)
+	#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+#if !defined(MAX)
+	#define MAX(a, b)	((a) > (b) ? (a) : (b))
+#endif
+
+// Display list flags, as the GPU display lists keep them.
+#define SOFT_DL_HAS_ALPHA		1		// Some colors are translucent.
+#define SOFT_DL_HAS_META		2		// Some colors are the current or complement color.
+
+// Lighting, as LDrawRendererGL sets it up for the shaders.
+#define LIGHT_AMBIENT			0.3f
+#define LIGHT_DIFFUSE			0.8f
+
+// Fixed point positions.
+#define SUBPIXEL_BITS			4
+#define SUBPIXEL_ONE			(1 << SUBPIXEL_BITS)
+
+// Primitives reaching further out than this many half-screens from the centre
+// are clipped, which keeps the edge functions well within 64 bits.
+#define GUARD_BAND				64.0f
+
+// Lines lying on a face are drawn over it.
+#define LINE_DEPTH_BIAS			0.00002f
+
+// Primitives set up per batch of instances.
+#define BATCH_PRIMITIVES		(1 << 19)
+
+// Clip space outcodes.
+enum
+{
+	OUT_LEFT	= 1 << 0,
+	OUT_RIGHT	= 1 << 1,
+	OUT_BOTTOM	= 1 << 2,
+	OUT_TOP		= 1 << 3,
+	OUT_NEAR	= 1 << 4,
+	OUT_FAR		= 1 << 5,
+	OUT_GUARD	= 1 << 6,
+
+	OUT_FRUSTUM	= OUT_LEFT | OUT_RIGHT | OUT_BOTTOM | OUT_TOP | OUT_NEAR | OUT_FAR,
+	OUT_CLIP	= OUT_NEAR | OUT_GUARD
+};
+
+// Most vertices a triangle can have after clipping against the near plane and
+// the four sides of the guard band.
+#define CLIP_MAXIMUM_VERTICES	8
+
+
+struct LDrawSoftDLBuilderStruct
+{
+	struct Mesh				*mesh;
+	int						faceCount;		// tris and quads
+	int						primitiveCount;	// lines too
+	int						flags;
+	bool					hashing;
+	LDrawMeshCacheHasher	hasher;
+	bool					prepared;		// the mesh went into bake
+	LDrawDLBake				bake;
+
+};
+
+
+struct LDrawSoftDLStruct
+{
+	LDrawDLBake				bake;
+	int						flags;
+	int						lineStart;		// index ranges
+	int						lineCount;
+	int						triangleStart;
+	int						triangleCount;
+	int						quadrilateralStart;
+	int						quadrilateralCount;
+
+};
+
+
+// One request to draw a display list.
+typedef struct
+{
+	const LDrawSoftDL		*dl;
+	float					color[4];
+	float					complement[4];
+	float					transform[16];
+	bool					wireFrame;
+
+} SoftInstance;
+
+
+typedef struct
+{
+	SoftInstance			*instances;
+	int						count;
+	int						capacity;
+
+} SoftInstanceList;
+
+
+struct LDrawSoftSessionStruct
+{
+	LDrawSoftFramebuffer	*framebuffer;
+	float					modelView[16];
+	float					projection[16];
+	SoftInstanceList		opaque;
+	SoftInstanceList		translucent;
+
+};
+
+
+// A transformed and lit vertex.
+typedef struct
+{
+	float					clip[4];
+	float					screen[3];
+	uint32_t				color;			// RGBA, red in the low byte
+	int						outcode;
+
+} SoftVertex;
+
+
+// A line or triangle ready to fill, in screen space.
+typedef struct
+{
+	float					x[3];
+	float					y[3];
+	float					z[3];
+	uint32_t				color[3];
+	int						vertexCount;
+
+} SoftPrimitive;
+
+
+typedef struct
+{
+	uint32_t				*items;
+	int						count;
+	int						capacity;
+
+} SoftBin;
+
+
+// What one thread sets up: its share of a batch's instances, in order.
+typedef struct
+{
+	int						firstInstance;
+	int						endInstance;
+	SoftPrimitive			*primitives;
+	int						primitiveCount;
+	int						primitiveCapacity;
+	SoftVertex				*vertices;
+	int						vertexCapacity;
+	SoftBin					*bins;			// one per tile
+
+} SoftSlice;
+
+
+// Drawing one list of instances.
+typedef struct
+{
+	LDrawSoftSession		*session;
+	LDrawSoftFramebuffer	*framebuffer;
+	const SoftInstance		*instances;
+	bool					blend;
+	int						tilesAcross;
+	int						tilesDown;
+	int						sliceCount;
+	SoftSlice				slices[LDRAW_SOFT_RASTER_MAXIMUM_THREADS];
+
+} SoftPass;
+
+
+// A parallel-for, as MeshSmooth runs its stages: work(ref, task) is called once
+// for each task in [0, taskCount), on any thread.
+typedef struct
+{
+	void					(*work)(void *ref, int task);
+	void					*ref;
+	int						taskCount;
+	int						nextTask;		// claimed atomically
+
+} SoftParallelJob;
+
+
+// 0 means one thread per core.
+static int softThreadCount = 0;
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== LDrawSoftRasterSetThreadCount =====================================
+//
+// Purpose:		Sets how many threads draw.
+//
+//==============================================================================
+void LDrawSoftRasterSetThreadCount(int threadCount)
+{
+	softThreadCount = threadCount;
+
+}//end LDrawSoftRasterSetThreadCount
+
+
+//========== getThreadCount ====================================================
+//
+// Purpose:		Returns the number of threads to draw on.
+//
+//==============================================================================
+static int getThreadCount(void)
+{
+	int	count	= softThreadCount;
+
+	if(count <= 0)
+		count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	return MAX(1, MIN(count, LDRAW_SOFT_RASTER_MAXIMUM_THREADS));
+
+}//end getThreadCount
+
+
+//========== parallelWorker ====================================================
+//
+// Purpose:		Thread body for runParallel: keeps claiming tasks until there
+//				are none left.
+//
+//==============================================================================
+static void *parallelWorker(void *ref)
+{
+	SoftParallelJob	*job	= (SoftParallelJob *)ref;
+	int				task	= 0;
+
+	while((task = __atomic_fetch_add(&job->nextTask, 1, __ATOMIC_RELAXED)) < job->taskCount)
+		job->work(job->ref, task);
+
+	return NULL;
+
+}//end parallelWorker
+
+
+//========== runParallel =======================================================
+//
+// Purpose:		Runs taskCount tasks across up to threadCount threads, the
+//				calling one included, and returns when all are done. If a
+//				thread can't be started, the others take more of the tasks.
+//
+//==============================================================================
+static void runParallel(int threadCount, int taskCount, void (*work)(void *ref, int task), void *ref)
+{
+	pthread_t		threads[LDRAW_SOFT_RASTER_MAXIMUM_THREADS];
+	SoftParallelJob	job		= { work, ref, taskCount, 0 };
+	int				started	= 0;
+	int				counter	= 0;
+
+	threadCount = MIN(threadCount, taskCount);
+	for(counter = 1; counter < threadCount; counter++)
+	{
+		if(pthread_create(threads + started, NULL, parallelWorker, &job) == 0)
+			started++;
+	}
+
+	parallelWorker(&job);
+
+	for(counter = 0; counter < started; counter++)
+		pthread_join(threads[counter], NULL);
+
+}//end runParallel
+
+
+//========== packColor =========================================================
+//
+// Purpose:		Packs an RGBA color with channels in [0, 1].
+//
+//==============================================================================
+static inline uint32_t packColor(const float color[4])
+{
+	uint32_t	packed	= 0;
+	int			counter	= 0;
+
+	for(counter = 0; counter < 4; counter++)
+	{
+		float channel = color[counter] < 0.0f ? 0.0f : (color[counter] > 1.0f ? 1.0f : color[counter]);
+		packed |= (uint32_t)lrintf(channel * 255.0f) << (8 * counter);
+	}
+
+	return packed;
+
+}//end packColor
+
+
+//========== unpackColor =======================================================
+//
+// Purpose:		Unpacks a color to channels in [0, 1].
+//
+//==============================================================================
+static inline void unpackColor(uint32_t packed, float color[4])
+{
+	int	counter	= 0;
+
+	for(counter = 0; counter < 4; counter++)
+		color[counter] = (float)((packed >> (8 * counter)) & 0xFF) * (1.0f / 255.0f);
+
+}//end unpackColor
+
+
+#pragma mark -
+#pragma mark FRAMEBUFFERS
+#pragma mark -
+
+//========== LDrawSoftFramebufferCreate ========================================
+//
+// Purpose:		Allocates a framebuffer, cleared to transparent black at the
+//				far plane.
+//
+//==============================================================================
+LDrawSoftFramebuffer *LDrawSoftFramebufferCreate(int width, int height)
+{
+	LDrawSoftFramebuffer	*framebuffer	= (LDrawSoftFramebuffer *)calloc(1, sizeof(LDrawSoftFramebuffer));
+	const float				clear[4]		= { 0, 0, 0, 0 };
+
+	framebuffer->width	= width;
+	framebuffer->height	= height;
+	framebuffer->pixels	= (uint8_t *)malloc((size_t)width * height * 4);
+	framebuffer->depths	= (float *)malloc((size_t)width * height * sizeof(float));
+	LDrawSoftFramebufferClear(framebuffer, clear);
+
+	return framebuffer;
+
+}//end LDrawSoftFramebufferCreate
+
+
+//========== LDrawSoftFramebufferClear =========================================
+//
+// Purpose:		Fills the framebuffer with a color, at the far plane.
+//
+//==============================================================================
+void LDrawSoftFramebufferClear(LDrawSoftFramebuffer *framebuffer, const float color[4])
+{
+	size_t		count	= (size_t)framebuffer->width * framebuffer->height;
+	uint32_t	packed	= packColor(color);
+	uint8_t		bytes[4]	= { packed & 0xFF, (packed >> 8) & 0xFF, (packed >> 16) & 0xFF, packed >> 24 };
+	size_t		counter	= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		memcpy(framebuffer->pixels + counter * 4, bytes, 4);
+		framebuffer->depths[counter] = 1.0f;
+	}
+
+}//end LDrawSoftFramebufferClear
+
+
+//========== LDrawSoftFramebufferDestroy =======================================
+//
+// Purpose:		Frees a framebuffer.
+//
+//==============================================================================
+void LDrawSoftFramebufferDestroy(LDrawSoftFramebuffer *framebuffer)
+{
+	if(framebuffer)
+	{
+		free(framebuffer->pixels);
+		free(framebuffer->depths);
+		free(framebuffer);
+	}
+
+}//end LDrawSoftFramebufferDestroy
+
+
+//========== LDrawSoftFramebufferWritePPM ======================================
+//
+// Purpose:		Writes the framebuffer as a binary PPM, dropping alpha.
+//
+//==============================================================================
+bool LDrawSoftFramebufferWritePPM(const LDrawSoftFramebuffer *framebuffer, const char *path)
+{
+	FILE	*file		= fopen(path, "wb");
+	size_t	count		= (size_t)framebuffer->width * framebuffer->height;
+	uint8_t	*row		= NULL;
+	size_t	counter		= 0;
+	bool	success		= false;
+
+	if(file == NULL)
+		return false;
+
+	row = (uint8_t *)malloc(count * 3);
+	for(counter = 0; counter < count; counter++)
+		memcpy(row + counter * 3, framebuffer->pixels + counter * 4, 3);
+
+	success =	fprintf(file, "P6\n%d %d\n255\n", framebuffer->width, framebuffer->height) > 0
+			&&	fwrite(row, 3, count, file) == count;
+	success = (fclose(file) == 0) && success;
+	free(row);
+
+	return success;
+
+}//end LDrawSoftFramebufferWritePPM
+
+
+#pragma mark -
+#pragma mark PNG
+#pragma mark -
+
+// Output bytes, with deflate's LSB-first bit packing.
+typedef struct
+{
+	uint8_t		*bytes;
+	size_t		count;
+	size_t		capacity;
+	uint32_t	bits;
+	int			bitCount;
+
+} PNGStream;
+
+
+//========== pngReserve ========================================================
+//
+// Purpose:		Makes room for more bytes.
+//
+//==============================================================================
+static void pngReserve(PNGStream *stream, size_t more)
+{
+	if(stream->count + more > stream->capacity)
+	{
+		stream->capacity	= MAX(stream->capacity * 2, stream->count + more + 4096);
+		stream->bytes		= (uint8_t *)realloc(stream->bytes, stream->capacity);
+	}
+
+}//end pngReserve
+
+
+//========== pngPutBytes =======================================================
+//
+// Purpose:		Appends whole bytes.
+//
+//==============================================================================
+static void pngPutBytes(PNGStream *stream, const void *bytes, size_t count)
+{
+	pngReserve(stream, count);
+	memcpy(stream->bytes + stream->count, bytes, count);
+	stream->count += count;
+
+}//end pngPutBytes
+
+
+//========== pngPutBig32 =======================================================
+//
+// Purpose:		Appends a big-endian 32-bit value.
+//
+//==============================================================================
+static void pngPutBig32(PNGStream *stream, uint32_t value)
+{
+	uint8_t	bytes[4]	= { value >> 24, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF };
+
+	pngPutBytes(stream, bytes, 4);
+
+}//end pngPutBig32
+
+
+//========== pngPutBits ========================================================
+//
+// Purpose:		Appends count bits of value, low bit first.
+//
+//==============================================================================
+static void pngPutBits(PNGStream *stream, uint32_t value, int count)
+{
+	stream->bits		|= value << stream->bitCount;
+	stream->bitCount	+= count;
+	while(stream->bitCount >= 8)
+	{
+		uint8_t	byte	= stream->bits & 0xFF;
+
+		pngPutBytes(stream, &byte, 1);
+		stream->bits		>>= 8;
+		stream->bitCount	-= 8;
+	}
+
+}//end pngPutBits
+
+
+//========== pngPutCode ========================================================
+//
+// Purpose:		Appends a Huffman code, which deflate packs high bit first.
+//
+//==============================================================================
+static void pngPutCode(PNGStream *stream, uint32_t code, int length)
+{
+	uint32_t	reversed	= 0;
+	int			counter		= 0;
+
+	for(counter = 0; counter < length; counter++)
+		reversed |= ((code >> counter) & 1) << (length - 1 - counter);
+	pngPutBits(stream, reversed, length);
+
+}//end pngPutCode
+
+
+//========== pngPutLiteral =====================================================
+//
+// Purpose:		Appends a literal/length symbol in the fixed Huffman code.
+//
+//==============================================================================
+static void pngPutLiteral(PNGStream *stream, int symbol)
+{
+	if(symbol < 144)
+		pngPutCode(stream, 0x30 + symbol, 8);
+	else if(symbol < 256)
+		pngPutCode(stream, 0x190 + symbol - 144, 9);
+	else if(symbol < 280)
+		pngPutCode(stream, symbol - 256, 7);
+	else
+		pngPutCode(stream, 0xC0 + symbol - 280, 8);
+
+}//end pngPutLiteral
+
+
+//========== pngPutMatch =======================================================
+//
+// Purpose:		Appends a back reference in the fixed Huffman code.
+//
+//==============================================================================
+static void pngPutMatch(PNGStream *stream, int length, int distance)
+{
+	static const int	lengthBases[29]		= { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+												35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const int	lengthExtras[29]	= { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+												3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const int	distanceBases[30]	= { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+												257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+												8193, 12289, 16385, 24577 };
+	static const int	distanceExtras[30]	= { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+												7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	int					code				= 28;
+
+	while(lengthBases[code] > length)
+		code--;
+	pngPutLiteral(stream, 257 + code);
+	pngPutBits(stream, (uint32_t)(length - lengthBases[code]), lengthExtras[code]);
+
+	code = 29;
+	while(distanceBases[code] > distance)
+		code--;
+	pngPutCode(stream, (uint32_t)code, 5);
+	pngPutBits(stream, (uint32_t)(distance - distanceBases[code]), distanceExtras[code]);
+
+}//end pngPutMatch
+
+
+//========== pngDeflate ========================================================
+//
+// Purpose:		Appends data as a zlib stream: one block in the fixed Huffman
+//				code, with greedy matches found through a hash of the next
+//				three bytes.
+//
+//==============================================================================
+static void pngDeflate(PNGStream *stream, const uint8_t *data, size_t count)
+{
+	enum { HASH_BITS = 15, WINDOW = 32768, MAXIMUM_MATCH = 258 };
+
+	int32_t		*heads		= (int32_t *)malloc(sizeof(int32_t) << HASH_BITS);
+	uint32_t	adlerA		= 1;
+	uint32_t	adlerB		= 0;
+	size_t		position	= 0;
+	size_t		counter		= 0;
+
+	for(counter = 0; counter < ((size_t)1 << HASH_BITS); counter++)
+		heads[counter] = -1;
+
+	pngPutBytes(stream, "\x78\x01", 2);
+	pngPutBits(stream, 3, 3);				// final block, fixed codes
+
+	while(position < count)
+	{
+		int	length	= 0;
+		int	distance	= 0;
+
+		if(position + 3 <= count)
+		{
+			uint32_t	hash		= ((uint32_t)data[position] | (uint32_t)data[position + 1] << 8 | (uint32_t)data[position + 2] << 16) * 2654435761u >> (32 - HASH_BITS);
+			int32_t		candidate	= heads[hash];
+
+			heads[hash] = (int32_t)position;
+			if(candidate >= 0 && position - (size_t)candidate <= WINDOW)
+			{
+				size_t	limit	= MIN((size_t)MAXIMUM_MATCH, count - position);
+
+				while((size_t)length < limit && data[candidate + length] == data[position + length])
+					length++;
+				distance = (int)(position - (size_t)candidate);
+			}
+		}
+
+		if(length >= 3)
+		{
+			pngPutMatch(stream, length, distance);
+			position += (size_t)length;
+		}
+		else
+		{
+			pngPutLiteral(stream, data[position]);
+			position++;
+		}
+	}
+	pngPutLiteral(stream, 256);
+	pngPutBits(stream, 0, 7);				// flush to a byte
+
+	for(counter = 0; counter < count; counter++)
+	{
+		adlerA = (adlerA + data[counter]) % 65521;
+		adlerB = (adlerB + adlerA) % 65521;
+	}
+	pngPutBig32(stream, adlerB << 16 | adlerA);
+
+	free(heads);
+
+}//end pngDeflate
+
+
+//========== pngCRC ============================================================
+//
+// Purpose:		The CRC-32 a PNG chunk ends with.
+//
+//==============================================================================
+static uint32_t pngCRC(const uint8_t *bytes, size_t count)
+{
+	uint32_t	crc		= 0xFFFFFFFF;
+	size_t		counter	= 0;
+	int			bit		= 0;
+
+	for(counter = 0; counter < count; counter++)
+	{
+		crc ^= bytes[counter];
+		for(bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+	}
+
+	return crc ^ 0xFFFFFFFF;
+
+}//end pngCRC
+
+
+//========== pngPutChunk =======================================================
+//
+// Purpose:		Appends one chunk of the file.
+//
+//==============================================================================
+static void pngPutChunk(PNGStream *stream, const char *type, const uint8_t *data, size_t count)
+{
+	size_t	start	= 0;
+
+	pngPutBig32(stream, (uint32_t)count);
+	start = stream->count;
+	pngPutBytes(stream, type, 4);
+	if(count)
+		pngPutBytes(stream, data, count);
+	pngPutBig32(stream, pngCRC(stream->bytes + start, count + 4));
+
+}//end pngPutChunk
+
+
+//========== pngPaeth ==========================================================
+//
+// Purpose:		The Paeth predictor.
+//
+//==============================================================================
+static inline int pngPaeth(int left, int up, int upLeft)
+{
+	int	estimate	= left + up - upLeft;
+	int	toLeft		= abs(estimate - left);
+	int	toUp		= abs(estimate - up);
+	int	toUpLeft	= abs(estimate - upLeft);
+
+	if(toLeft <= toUp && toLeft <= toUpLeft)
+		return left;
+	return (toUp <= toUpLeft) ? up : upLeft;
+
+}//end pngPaeth
+
+
+//========== LDrawSoftFramebufferWritePNG ======================================
+//
+// Purpose:		Writes the framebuffer as an RGBA PNG.
+//
+// Notes:		Each row takes whichever filter leaves the smallest residuals,
+//				the usual heuristic.
+//
+//==============================================================================
+bool LDrawSoftFramebufferWritePNG(const LDrawSoftFramebuffer *framebuffer, const char *path)
+{
+	size_t		stride		= (size_t)framebuffer->width * 4;
+	uint8_t		*filtered	= (uint8_t *)malloc((stride + 1) * framebuffer->height);
+	uint8_t		*trial		= (uint8_t *)malloc(stride);
+	PNGStream	file		= { NULL, 0, 0, 0, 0 };
+	PNGStream	image		= { NULL, 0, 0, 0, 0 };
+	uint8_t		header[13];
+	FILE		*output		= NULL;
+	bool		success		= false;
+	int			row			= 0;
+
+	for(row = 0; row < framebuffer->height; row++)
+	{
+		const uint8_t	*line		= framebuffer->pixels + stride * row;
+		const uint8_t	*above		= row ? line - stride : NULL;
+		uint8_t			*out		= filtered + (stride + 1) * row;
+		long			bestScore	= -1;
+		int				filter		= 0;
+		size_t			counter		= 0;
+
+		for(filter = 0; filter < 5; filter++)
+		{
+			long score = 0;
+
+			for(counter = 0; counter < stride; counter++)
+			{
+				int left	= counter >= 4 ? line[counter - 4] : 0;
+				int up		= above ? above[counter] : 0;
+				int upLeft	= (above && counter >= 4) ? above[counter - 4] : 0;
+				int predict	= 0;
+
+				switch(filter)
+				{
+					case 1:	predict = left;								break;
+					case 2:	predict = up;								break;
+					case 3:	predict = (left + up) / 2;					break;
+					case 4:	predict = pngPaeth(left, up, upLeft);		break;
+				}
+				trial[counter] = (uint8_t)(line[counter] - predict);
+				score += abs((int8_t)trial[counter]);
+			}
+			if(bestScore < 0 || score < bestScore)
+			{
+				bestScore	= score;
+				out[0]		= (uint8_t)filter;
+				memcpy(out + 1, trial, stride);
+			}
+		}
+	}
+
+	pngDeflate(&image, filtered, (stride + 1) * framebuffer->height);
+
+	header[0] = framebuffer->width >> 24;	header[1] = (framebuffer->width >> 16) & 0xFF;
+	header[2] = (framebuffer->width >> 8) & 0xFF;	header[3] = framebuffer->width & 0xFF;
+	header[4] = framebuffer->height >> 24;	header[5] = (framebuffer->height >> 16) & 0xFF;
+	header[6] = (framebuffer->height >> 8) & 0xFF;	header[7] = framebuffer->height & 0xFF;
+	header[8]	= 8;						// bits per channel
+	header[9]	= 6;						// RGBA
+	header[10]	= 0;						// deflate
+	header[11]	= 0;						// adaptive filtering
+	header[12]	= 0;						// not interlaced
+
+	pngPutBytes(&file, "\x89PNG\r\n\x1A\n", 8);
+	pngPutChunk(&file, "IHDR", header, sizeof(header));
+	pngPutChunk(&file, "IDAT", image.bytes, image.count);
+	pngPutChunk(&file, "IEND", NULL, 0);
+
+	output = fopen(path, "wb");
+	if(output)
+	{
+		success = fwrite(file.bytes, 1, file.count, output) == file.count;
+		success = (fclose(output) == 0) && success;
+	}
+
+	free(filtered);
+	free(trial);
+	free(image.bytes);
+	free(file.bytes);
+
+	return success;
+
+}//end LDrawSoftFramebufferWritePNG
+
+
+#pragma mark -
+#pragma mark DISPLAY LISTS
+#pragma mark -
+
+//========== LDrawSoftDLBuilderCreate ==========================================
+//
+// Purpose:		Starts a display list.
+//
+//==============================================================================
+LDrawSoftDLBuilder *LDrawSoftDLBuilderCreate(void)
+{
+	LDrawSoftDLBuilder	*builder	= (LDrawSoftDLBuilder *)calloc(1, sizeof(LDrawSoftDLBuilder));
+
+	builder->mesh		= create_growable_mesh();
+	builder->hashing	= LDrawMeshCacheGetDirectory() != NULL;
+	if(builder->hashing)
+		LDrawMeshCacheHasherInit(&builder->hasher, LDrawMeshCacheRemovedTJunctions | LDrawMeshCacheOptimizedVertexCache);
+
+	return builder;
+
+}//end LDrawSoftDLBuilderCreate
+
+
+//========== addBuilderFace ====================================================
+//
+// Purpose:		Hands one primitive to the mesh smoother and the mesh cache's
+//				key, noting what its color needs when it is drawn.
+//
+//==============================================================================
+static void addBuilderFace(LDrawSoftDLBuilder *builder,
+						   const float *p1, const float *p2, const float *p3, const float *p4,
+						   const float c[4])
+{
+	if(c[3] == 0.0f)
+		builder->flags |= SOFT_DL_HAS_META;
+	else if(c[3] != 1.0f)
+		builder->flags |= SOFT_DL_HAS_ALPHA;
+
+	add_face(builder->mesh, p1, p2, p3, p4, c, 0);
+	if(builder->hashing)
+		LDrawMeshCacheHasherAddFace(&builder->hasher, p1, p2, p3, p4, c, 0);
+
+	builder->primitiveCount++;
+	if(p3)
+		builder->faceCount++;
+
+}//end addBuilderFace
+
+
+//========== LDrawSoftDLBuilderAddTri ==========================================
+//
+// Purpose:		Adds one triangle.
+//
+//==============================================================================
+void LDrawSoftDLBuilderAddTri(LDrawSoftDLBuilder *builder, const float v[9], const float c[4])
+{
+	addBuilderFace(builder, v, v + 3, v + 6, NULL, c);
+
+}//end LDrawSoftDLBuilderAddTri
+
+
+//========== LDrawSoftDLBuilderAddQuad =========================================
+//
+// Purpose:		Adds one quad.
+//
+//==============================================================================
+void LDrawSoftDLBuilderAddQuad(LDrawSoftDLBuilder *builder, const float v[12], const float c[4])
+{
+	addBuilderFace(builder, v, v + 3, v + 6, v + 9, c);
+
+}//end LDrawSoftDLBuilderAddQuad
+
+
+//========== LDrawSoftDLBuilderAddLine =========================================
+//
+// Purpose:		Adds one line.
+//
+//==============================================================================
+void LDrawSoftDLBuilderAddLine(LDrawSoftDLBuilder *builder, const float v[6], const float c[4])
+{
+	addBuilderFace(builder, v, v + 3, NULL, NULL, c);
+
+}//end LDrawSoftDLBuilderAddLine
+
+
+//========== LDrawSoftDLBuilderGetFaceCount ====================================
+//
+// Purpose:		Returns the number of tris and quads added, a guide to how long
+//				Prepare will take.
+//
+//==============================================================================
+int LDrawSoftDLBuilderGetFaceCount(LDrawSoftDLBuilder *builder)
+{
+	return builder->faceCount;
+
+}//end LDrawSoftDLBuilderGetFaceCount
+
+
+//========== LDrawSoftDLBuilderPrepare =========================================
+//
+// Purpose:		Bakes the mesh. Safe to call on any thread, and more than once.
+//
+//==============================================================================
+void LDrawSoftDLBuilderPrepare(LDrawSoftDLBuilder *builder)
+{
+	if(builder->prepared)
+		return;
+
+	LDrawDLBakeInit(&builder->bake, builder->mesh, 1, builder->faceCount,
+					builder->hashing ? &builder->hasher : NULL);
+	builder->mesh		= NULL;
+	builder->prepared	= true;
+	LDrawDLBakeRun(&builder->bake);
+
+}//end LDrawSoftDLBuilderPrepare
+
+
+//========== LDrawSoftDLBuilderFinish ==========================================
+//
+// Purpose:		Turns the builder into a display list, or NULL if it is empty.
+//
+//==============================================================================
+LDrawSoftDL *LDrawSoftDLBuilderFinish(LDrawSoftDLBuilder *builder)
+{
+	LDrawSoftDL	*dl	= NULL;
+
+	if(builder->primitiveCount == 0)
+	{
+		LDrawSoftDLBuilderDestroy(builder);
+		return NULL;
+	}
+
+	LDrawSoftDLBuilderPrepare(builder);
+
+	dl = (LDrawSoftDL *)calloc(1, sizeof(LDrawSoftDL));
+	dl->bake				= builder->bake;
+	dl->flags				= builder->flags;
+	dl->lineStart			= builder->bake.lineStarts[0];
+	dl->lineCount			= builder->bake.lineCounts[0];
+	dl->triangleStart		= builder->bake.triangleStarts[0];
+	dl->triangleCount		= builder->bake.triangleCounts[0];
+	dl->quadrilateralStart	= builder->bake.quadrilateralStarts[0];
+	dl->quadrilateralCount	= builder->bake.quadrilateralCounts[0];
+
+	// The display list has the bake now.
+	free(builder);
+
+	return dl;
+
+}//end LDrawSoftDLBuilderFinish
+
+
+//========== LDrawSoftDLBuilderDestroy =========================================
+//
+// Purpose:		Gives up on a display list.
+//
+//==============================================================================
+void LDrawSoftDLBuilderDestroy(LDrawSoftDLBuilder *builder)
+{
+	if(builder->prepared)
+		LDrawDLBakeRelease(&builder->bake);
+	else
+		destroy_mesh(builder->mesh);
+	free(builder);
+
+}//end LDrawSoftDLBuilderDestroy
+
+
+//========== LDrawSoftDLDestroy ================================================
+//
+// Purpose:		Frees a display list.
+//
+//==============================================================================
+void LDrawSoftDLDestroy(LDrawSoftDL *dl)
+{
+	if(dl)
+	{
+		LDrawDLBakeRelease(&dl->bake);
+		free(dl);
+	}
+
+}//end LDrawSoftDLDestroy
+
+
+//========== estimatePrimitives ================================================
+//
+// Purpose:		How many primitives an instance sets up, at most, before
+//				clipping.
+//
+//==============================================================================
+static int estimatePrimitives(const SoftInstance *instance)
+{
+	const LDrawSoftDL	*dl	= instance->dl;
+
+	if(instance->wireFrame)
+		return dl->lineCount / 2 + dl->triangleCount + dl->quadrilateralCount;
+
+	return dl->lineCount / 2 + dl->triangleCount / 3 + dl->quadrilateralCount / 2;
+
+}//end estimatePrimitives
+
+
+#pragma mark -
+#pragma mark SETUP
+#pragma mark -
+
+//========== toScreen ==========================================================
+//
+// Purpose:		Perspective-divides a clip space position into pixels, top row
+//				first, and depth in [0, 1].
+//
+//==============================================================================
+static inline void toScreen(const LDrawSoftFramebuffer *framebuffer, const float clip[4], float screen[3])
+{
+	float	inverse	= 1.0f / clip[3];
+
+	screen[0] = (clip[0] * inverse * 0.5f + 0.5f) * (float)framebuffer->width;
+	screen[1] = (0.5f - clip[1] * inverse * 0.5f) * (float)framebuffer->height;
+	screen[2] = clip[2] * inverse * 0.5f + 0.5f;
+
+}//end toScreen
+
+
+//========== getOutcode ========================================================
+//
+// Purpose:		Which clip planes a clip space position is outside of.
+//
+//==============================================================================
+static inline int getOutcode(const float clip[4])
+{
+	float	x		= clip[0];
+	float	y		= clip[1];
+	float	z		= clip[2];
+	float	w		= clip[3];
+	int		code	= 0;
+
+	if(x < -w)		code |= OUT_LEFT;
+	if(x > w)		code |= OUT_RIGHT;
+	if(y < -w)		code |= OUT_BOTTOM;
+	if(y > w)		code |= OUT_TOP;
+	if(z < -w)		code |= OUT_NEAR;
+	if(z > w)		code |= OUT_FAR;
+	if(fabsf(x) > GUARD_BAND * w || fabsf(y) > GUARD_BAND * w)
+		code |= OUT_GUARD;
+
+	return code;
+
+}//end getOutcode
+
+
+//========== addToBin ==========================================================
+//
+// Purpose:		Appends a primitive to a tile's bin.
+//
+//==============================================================================
+static inline void addToBin(SoftBin *bin, uint32_t primitive)
+{
+	if(bin->count == bin->capacity)
+	{
+		bin->capacity	= MAX(64, bin->capacity * 2);
+		bin->items		= (uint32_t *)realloc(bin->items, sizeof(uint32_t) * bin->capacity);
+	}
+	bin->items[bin->count++] = primitive;
+
+}//end addToBin
+
+
+//========== emitPrimitive =====================================================
+//
+// Purpose:		Queues a screen space line or triangle into the tiles it might
+//				cover - unless it covers no pixel centre at all.
+//
+//==============================================================================
+static void emitPrimitive(SoftPass *pass, SoftSlice *slice,
+						  const float *screen[3], const uint32_t colors[3], int vertexCount)
+{
+	const LDrawSoftFramebuffer	*framebuffer	= pass->framebuffer;
+	float						minX			= screen[0][0];
+	float						maxX			= screen[0][0];
+	float						minY			= screen[0][1];
+	float						maxY			= screen[0][1];
+	SoftPrimitive				*primitive		= NULL;
+	int							left, right, top, bottom;
+	int							tileX, tileY;
+	int							counter			= 0;
+
+	for(counter = 1; counter < vertexCount; counter++)
+	{
+		minX = MIN(minX, screen[counter][0]);
+		maxX = MAX(maxX, screen[counter][0]);
+		minY = MIN(minY, screen[counter][1]);
+		maxY = MAX(maxY, screen[counter][1]);
+	}
+
+	// Pixels whose centres the bounds take in.
+	left	= MAX(0, (int)ceilf(minX - 0.5f));
+	right	= MIN(framebuffer->width - 1, (int)floorf(maxX - 0.5f));
+	top		= MAX(0, (int)ceilf(minY - 0.5f));
+	bottom	= MIN(framebuffer->height - 1, (int)floorf(maxY - 0.5f));
+	if(vertexCount == 2)
+	{
+		// A line lights a pixel per step along its longer axis, in whichever
+		// row or column it crosses.
+		top		= MAX(0, (int)floorf(minY));
+		bottom	= MIN(framebuffer->height - 1, (int)floorf(maxY));
+		left	= MAX(0, MIN(left, (int)floorf(minX)));
+		right	= MIN(framebuffer->width - 1, MAX(right, (int)floorf(maxX)));
+	}
+	if(left > right || top > bottom)
+		return;
+
+	if(slice->primitiveCount == slice->primitiveCapacity)
+	{
+		slice->primitiveCapacity	= MAX(1024, slice->primitiveCapacity * 2);
+		slice->primitives			= (SoftPrimitive *)realloc(slice->primitives, sizeof(SoftPrimitive) * slice->primitiveCapacity);
+	}
+	primitive = slice->primitives + slice->primitiveCount;
+	for(counter = 0; counter < vertexCount; counter++)
+	{
+		primitive->x[counter]		= screen[counter][0];
+		primitive->y[counter]		= screen[counter][1];
+		primitive->z[counter]		= screen[counter][2];
+		primitive->color[counter]	= colors[counter];
+	}
+	primitive->vertexCount = vertexCount;
+
+	for(tileY = top / LDRAW_SOFT_RASTER_TILE_SIZE; tileY <= bottom / LDRAW_SOFT_RASTER_TILE_SIZE; tileY++)
+	for(tileX = left / LDRAW_SOFT_RASTER_TILE_SIZE; tileX <= right / LDRAW_SOFT_RASTER_TILE_SIZE; tileX++)
+		addToBin(slice->bins + tileY * pass->tilesAcross + tileX, (uint32_t)slice->primitiveCount);
+
+	slice->primitiveCount++;
+
+}//end emitPrimitive
+
+
+//========== clipPolygon =======================================================
+//
+// Purpose:		Clips a polygon of clip space positions and colors against the
+//				planes its vertices' outcodes call for. Returns the number of
+//				vertices left.
+//
+//==============================================================================
+static int clipPolygon(float positions[][4], float colors[][4], int count, int outcodes)
+{
+	// Each plane keeps the positions where dot(plane, position) >= 0.
+	const float	planes[5][4]	=
+	{
+		{ 0,  0, 1, 1 },					// near
+		{  1,  0, 0, GUARD_BAND },			// guard band
+		{ -1,  0, 0, GUARD_BAND },
+		{  0,  1, 0, GUARD_BAND },
+		{  0, -1, 0, GUARD_BAND },
+	};
+	float		nextPositions[CLIP_MAXIMUM_VERTICES][4];
+	float		nextColors[CLIP_MAXIMUM_VERTICES][4];
+	int			plane			= 0;
+	int			counter			= 0;
+	int			closed			= (count > 2);
+
+	for(plane = 0; plane < 5 && count > 0; plane++)
+	{
+		const float	*p			= planes[plane];
+		int			nextCount	= 0;
+
+		if(plane == 0 && !(outcodes & OUT_NEAR))
+			continue;
+		if(plane > 0 && !(outcodes & OUT_GUARD))
+			break;
+
+		for(counter = 0; counter < count; counter++)
+		{
+			int		next		= (counter + 1) % count;
+			float	*a			= positions[counter];
+			float	*b			= positions[next];
+			float	distanceA	= p[0] * a[0] + p[1] * a[1] + p[2] * a[2] + p[3] * a[3];
+			float	distanceB	= p[0] * b[0] + p[1] * b[1] + p[2] * b[2] + p[3] * b[3];
+			int		channel		= 0;
+
+			if(distanceA >= 0)
+			{
+				memcpy(nextPositions[nextCount], a, sizeof(float) * 4);
+				memcpy(nextColors[nextCount], colors[counter], sizeof(float) * 4);
+				nextCount++;
+			}
+			if(!closed && next == 0)
+				break;
+			if((distanceA >= 0) != (distanceB >= 0))
+			{
+				float t = distanceA / (distanceA - distanceB);
+
+				for(channel = 0; channel < 4; channel++)
+				{
+					nextPositions[nextCount][channel]	= a[channel] + (b[channel] - a[channel]) * t;
+					nextColors[nextCount][channel]		= colors[counter][channel] + (colors[next][channel] - colors[counter][channel]) * t;
+				}
+				nextCount++;
+			}
+		}
+
+		memcpy(positions, nextPositions, sizeof(float) * 4 * nextCount);
+		memcpy(colors, nextColors, sizeof(float) * 4 * nextCount);
+		count = nextCount;
+	}
+
+	return count;
+
+}//end clipPolygon
+
+
+//========== emitClipped =======================================================
+//
+// Purpose:		Sets up a line or triangle that crosses the near plane or the
+//				guard band: clips it, then emits what is left.
+//
+//==============================================================================
+static void emitClipped(SoftPass *pass, SoftSlice *slice, const SoftVertex *vertices[3], int vertexCount, int outcodes)
+{
+	float		positions[CLIP_MAXIMUM_VERTICES][4];
+	float		colors[CLIP_MAXIMUM_VERTICES][4];
+	float		screens[CLIP_MAXIMUM_VERTICES][3];
+	uint32_t	packed[CLIP_MAXIMUM_VERTICES];
+	int			count		= 0;
+	int			counter		= 0;
+
+	for(counter = 0; counter < vertexCount; counter++)
+	{
+		memcpy(positions[counter], vertices[counter]->clip, sizeof(float) * 4);
+		unpackColor(vertices[counter]->color, colors[counter]);
+	}
+
+	count = clipPolygon(positions, colors, vertexCount, outcodes);
+	for(counter = 0; counter < count; counter++)
+	{
+		toScreen(pass->framebuffer, positions[counter], screens[counter]);
+		packed[counter] = packColor(colors[counter]);
+	}
+
+	if(vertexCount == 2)
+	{
+		if(count == 2)
+		{
+			const float *screen[3] = { screens[0], screens[1], NULL };
+
+			emitPrimitive(pass, slice, screen, packed, 2);
+		}
+	}
+	else
+	{
+		for(counter = 2; counter < count; counter++)
+		{
+			const float	*screen[3]	= { screens[0], screens[counter - 1], screens[counter] };
+			uint32_t	fan[3]		= { packed[0], packed[counter - 1], packed[counter] };
+
+			emitPrimitive(pass, slice, screen, fan, 3);
+		}
+	}
+
+}//end emitClipped
+
+
+//========== emitLine ==========================================================
+//
+// Purpose:		Sets up one line between transformed vertices.
+//
+//==============================================================================
+static void emitLine(SoftPass *pass, SoftSlice *slice, const SoftVertex *a, const SoftVertex *b)
+{
+	const SoftVertex	*vertices[3]	= { a, b, NULL };
+
+	if(a->outcode & b->outcode & OUT_FRUSTUM)
+		return;
+
+	if((a->outcode | b->outcode) & OUT_CLIP)
+		emitClipped(pass, slice, vertices, 2, a->outcode | b->outcode);
+	else
+	{
+		const float	*screen[3]	= { a->screen, b->screen, NULL };
+		uint32_t	colors[3]	= { a->color, b->color, 0 };
+
+		emitPrimitive(pass, slice, screen, colors, 2);
+	}
+
+}//end emitLine
+
+
+//========== emitTriangle ======================================================
+//
+// Purpose:		Sets up one triangle between transformed vertices.
+//
+//==============================================================================
+static void emitTriangle(SoftPass *pass, SoftSlice *slice, const SoftVertex *a, const SoftVertex *b, const SoftVertex *c)
+{
+	const SoftVertex	*vertices[3]	= { a, b, c };
+
+	if(a->outcode & b->outcode & c->outcode & OUT_FRUSTUM)
+		return;
+
+	if((a->outcode | b->outcode | c->outcode) & OUT_CLIP)
+		emitClipped(pass, slice, vertices, 3, a->outcode | b->outcode | c->outcode);
+	else
+	{
+		const float	*screen[3]	= { a->screen, b->screen, c->screen };
+		uint32_t	colors[3]	= { a->color, b->color, c->color };
+
+		emitPrimitive(pass, slice, screen, colors, 3);
+	}
+
+}//end emitTriangle
+
+
+//========== setupInstance =====================================================
+//
+// Purpose:		Transforms and lights an instance's vertices, then sets up its
+//				primitives.
+//
+// Notes:		As in the shaders: normals go through the instance transform and
+//				the model view (and are renormalized), alpha 0 colors mix the
+//				current and complement colors by red, and a zero normal - a line
+//				- means no lighting.
+//
+//==============================================================================
+static void setupInstance(SoftPass *pass, SoftSlice *slice, const SoftInstance *instance)
+{
+	const LDrawSoftDL	*dl			= instance->dl;
+	const float			*table		= dl->bake.vertices;
+	const uint32_t		*indices	= dl->bake.indices;
+	int					vertexCount	= dl->bake.vertexCount;
+	float				eye[16];
+	float				clip[16];
+	SoftVertex			*vertices	= NULL;
+	int					counter		= 0;
+
+	multMatrices(eye, pass->session->modelView, instance->transform);
+	multMatrices(clip, pass->session->projection, eye);
+
+	if(vertexCount > slice->vertexCapacity)
+	{
+		slice->vertexCapacity	= MAX(vertexCount, slice->vertexCapacity * 2);
+		slice->vertices			= (SoftVertex *)realloc(slice->vertices, sizeof(SoftVertex) * slice->vertexCapacity);
+	}
+	vertices = slice->vertices;
+
+	for(counter = 0; counter < vertexCount; counter++)
+	{
+		const float	*source		= table + counter * LDRAW_MESH_CACHE_VERTEX_STRIDE;
+		const float	*normal		= source + 3;
+		const float	*color		= source + 6;
+		SoftVertex	*vertex		= vertices + counter;
+		float		lit[4];
+		float		normalEye[3];
+		float		length		= 0;
+		int			channel		= 0;
+
+		for(channel = 0; channel < 4; channel++)
+			vertex->clip[channel] =		clip[channel] * source[0] + clip[4 + channel] * source[1]
+									+	clip[8 + channel] * source[2] + clip[12 + channel];
+
+		if(color[3] == 0.0f)
+		{
+			for(channel = 0; channel < 4; channel++)
+				lit[channel] = instance->color[channel] + (instance->complement[channel] - instance->color[channel]) * color[0];
+		}
+		else
+			memcpy(lit, color, sizeof(lit));
+
+		for(channel = 0; channel < 3; channel++)
+			normalEye[channel] = eye[channel] * normal[0] + eye[4 + channel] * normal[1] + eye[8 + channel] * normal[2];
+		length = sqrtf(normalEye[0] * normalEye[0] + normalEye[1] * normalEye[1] + normalEye[2] * normalEye[2]);
+		if(normal[0] != 0.0f || normal[1] != 0.0f || normal[2] != 0.0f)
+		{
+			float shade = LIGHT_AMBIENT + (length > 0 ? LIGHT_DIFFUSE * fabsf(normalEye[2]) / length : 0);
+
+			for(channel = 0; channel < 3; channel++)
+				lit[channel] *= shade;
+		}
+
+		vertex->color	= packColor(lit);
+		vertex->outcode	= getOutcode(vertex->clip);
+		if(!(vertex->outcode & OUT_CLIP))
+			toScreen(pass->framebuffer, vertex->clip, vertex->screen);
+	}
+
+	for(counter = 0; counter + 1 < dl->lineCount; counter += 2)
+	{
+		const uint32_t *line = indices + dl->lineStart + counter;
+
+		emitLine(pass, slice, vertices + line[0], vertices + line[1]);
+	}
+
+	for(counter = 0; counter + 2 < dl->triangleCount; counter += 3)
+	{
+		const uint32_t *triangle = indices + dl->triangleStart + counter;
+
+		if(instance->wireFrame)
+		{
+			emitLine(pass, slice, vertices + triangle[0], vertices + triangle[1]);
+			emitLine(pass, slice, vertices + triangle[1], vertices + triangle[2]);
+			emitLine(pass, slice, vertices + triangle[2], vertices + triangle[0]);
+		}
+		else
+			emitTriangle(pass, slice, vertices + triangle[0], vertices + triangle[1], vertices + triangle[2]);
+	}
+
+	for(counter = 0; counter + 3 < dl->quadrilateralCount; counter += 4)
+	{
+		const uint32_t *quad = indices + dl->quadrilateralStart + counter;
+
+		if(instance->wireFrame)
+		{
+			emitLine(pass, slice, vertices + quad[0], vertices + quad[1]);
+			emitLine(pass, slice, vertices + quad[1], vertices + quad[2]);
+			emitLine(pass, slice, vertices + quad[2], vertices + quad[3]);
+			emitLine(pass, slice, vertices + quad[3], vertices + quad[0]);
+		}
+		else
+		{
+			emitTriangle(pass, slice, vertices + quad[0], vertices + quad[1], vertices + quad[2]);
+			emitTriangle(pass, slice, vertices + quad[0], vertices + quad[2], vertices + quad[3]);
+		}
+	}
+
+}//end setupInstance
+
+
+//========== setupSlice ========================================================
+//
+// Purpose:		runParallel task: sets up one slice of a batch.
+//
+//==============================================================================
+static void setupSlice(void *ref, int task)
+{
+	SoftPass	*pass		= (SoftPass *)ref;
+	SoftSlice	*slice		= pass->slices + task;
+	int			tileCount	= pass->tilesAcross * pass->tilesDown;
+	int			counter		= 0;
+
+	slice->primitiveCount = 0;
+	for(counter = 0; counter < tileCount; counter++)
+		slice->bins[counter].count = 0;
+
+	for(counter = slice->firstInstance; counter < slice->endInstance; counter++)
+		setupInstance(pass, slice, pass->instances + counter);
+
+}//end setupSlice
+
+
+#pragma mark -
+#pragma mark FILLING
+#pragma mark -
+
+//========== writePixel ========================================================
+//
+// Purpose:		Stores a color, blending it over what is there if asked.
+//
+//==============================================================================
+static inline void writePixel(uint8_t *pixel, const float color[4], bool blend)
+{
+	float	alpha	= color[3];
+	int		channel	= 0;
+
+	if(blend)
+	{
+		for(channel = 0; channel < 3; channel++)
+			pixel[channel] = (uint8_t)lrintf(color[channel] * 255.0f * alpha + pixel[channel] * (1.0f - alpha));
+		pixel[3] = (uint8_t)lrintf(alpha * 255.0f + pixel[3] * (1.0f - alpha));
+	}
+	else
+	{
+		for(channel = 0; channel < 4; channel++)
+			pixel[channel] = (uint8_t)lrintf(color[channel] * 255.0f);
+	}
+
+}//end writePixel
+
+
+//========== fillTriangle ======================================================
+//
+// Purpose:		Fills the part of a triangle inside one tile.
+//
+// Notes:		Depth and color are interpolated linearly in screen space, which
+//				is right for depth and, at the size of a brick's faces, close
+//				enough for Gouraud shading.
+//
+//==============================================================================
+static void fillTriangle(const SoftPass *pass, const SoftPrimitive *primitive,
+						 int tileLeft, int tileTop, int tileRight, int tileBottom)
+{
+	LDrawSoftFramebuffer	*framebuffer	= pass->framebuffer;
+	int64_t					x[3], y[3];
+	int						order[3]		= { 0, 1, 2 };
+	int64_t					area			= 0;
+	int64_t					stepX[3], stepY[3], bias[3], rowStart[3];
+	float					px[3], py[3];
+	float					values[3][5];
+	float					planeX[5], planeY[5], planeC[5];
+	bool					flat			= false;
+	float					floatArea		= 0;
+	int						left, right, top, bottom;
+	int						row, column;
+	int						counter, channel;
+
+	for(counter = 0; counter < 3; counter++)
+	{
+		x[counter] = (int64_t)llrintf(primitive->x[counter] * SUBPIXEL_ONE);
+		y[counter] = (int64_t)llrintf(primitive->y[counter] * SUBPIXEL_ONE);
+	}
+	area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if(area == 0)
+		return;
+	if(area < 0)
+	{
+		order[1] = 2;
+		order[2] = 1;
+	}
+
+	for(counter = 0; counter < 3; counter++)
+	{
+		int		from	= order[counter];
+		int		to		= order[(counter + 1) % 3];
+		int64_t	dx		= x[to] - x[from];
+		int64_t	dy		= y[to] - y[from];
+		int64_t	centreX	= 0;
+		int64_t	centreY	= 0;
+
+		// The edge function is dx * (py - y) - dy * (px - x), positive inside.
+		// Top-left edges keep the pixels they pass exactly through.
+		stepX[counter]	= -dy * SUBPIXEL_ONE;
+		stepY[counter]	= dx * SUBPIXEL_ONE;
+		bias[counter]	= (dy < 0 || (dy == 0 && dx > 0)) ? 0 : -1;
+
+		centreX = (int64_t)tileLeft * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+		centreY = (int64_t)tileTop * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+		rowStart[counter] = dx * (centreY - y[from]) - dy * (centreX - x[from]) + bias[counter];
+	}
+
+	// Pixels whose centres the triangle's bounds take in, within the tile.
+	left	= tileLeft;
+	top		= tileTop;
+	right	= MIN(tileRight, (int)floorf(MAX(primitive->x[0], MAX(primitive->x[1], primitive->x[2]))) + 1);
+	bottom	= MIN(tileBottom, (int)floorf(MAX(primitive->y[0], MAX(primitive->y[1], primitive->y[2]))) + 1);
+	{
+		int firstColumn	= MAX(tileLeft, (int)floorf(MIN(primitive->x[0], MIN(primitive->x[1], primitive->x[2]))) - 1);
+		int firstRow	= MAX(tileTop, (int)floorf(MIN(primitive->y[0], MIN(primitive->y[1], primitive->y[2]))) - 1);
+
+		for(counter = 0; counter < 3; counter++)
+			rowStart[counter] += stepX[counter] * (firstColumn - tileLeft) + stepY[counter] * (firstRow - tileTop);
+		left	= firstColumn;
+		top		= firstRow;
+	}
+
+	// Planes for depth and color: value = planeX * px + planeY * py + planeC.
+	for(counter = 0; counter < 3; counter++)
+	{
+		px[counter]			= primitive->x[counter];
+		py[counter]			= primitive->y[counter];
+		values[counter][0]	= primitive->z[counter];
+		unpackColor(primitive->color[counter], values[counter] + 1);
+	}
+	flat = (primitive->color[0] == primitive->color[1] && primitive->color[1] == primitive->color[2]);
+	floatArea = (px[1] - px[0]) * (py[2] - py[0]) - (px[2] - px[0]) * (py[1] - py[0]);
+	if(floatArea == 0.0f)
+		return;
+	for(channel = 0; channel < 5; channel++)
+	{
+		float d1 = values[1][channel] - values[0][channel];
+		float d2 = values[2][channel] - values[0][channel];
+
+		planeX[channel] = (d1 * (py[2] - py[0]) - d2 * (py[1] - py[0])) / floatArea;
+		planeY[channel] = (d2 * (px[1] - px[0]) - d1 * (px[2] - px[0])) / floatArea;
+		planeC[channel] = values[0][channel] - planeX[channel] * px[0] - planeY[channel] * py[0];
+	}
+
+	for(row = top; row <= bottom; row++)
+	{
+		int64_t	edge[3]		= { rowStart[0], rowStart[1], rowStart[2] };
+		float	centreY		= (float)row + 0.5f;
+		size_t	offset		= (size_t)row * framebuffer->width + left;
+
+		for(column = left; column <= right; column++, offset++)
+		{
+			if((edge[0] | edge[1] | edge[2]) >= 0)
+			{
+				float	centreX	= (float)column + 0.5f;
+				float	depth	= planeX[0] * centreX + planeY[0] * centreY + planeC[0];
+
+				if(depth < framebuffer->depths[offset] && depth >= 0.0f)
+				{
+					float color[4];
+
+					if(flat)
+						memcpy(color, values[0] + 1, sizeof(color));
+					else
+					{
+						for(channel = 0; channel < 4; channel++)
+							color[channel] = planeX[channel + 1] * centreX + planeY[channel + 1] * centreY + planeC[channel + 1];
+						for(channel = 0; channel < 4; channel++)
+							color[channel] = color[channel] < 0.0f ? 0.0f : (color[channel] > 1.0f ? 1.0f : color[channel]);
+					}
+					framebuffer->depths[offset] = depth;
+					writePixel(framebuffer->pixels + offset * 4, color, pass->blend);
+				}
+			}
+			edge[0] += stepX[0];
+			edge[1] += stepX[1];
+			edge[2] += stepX[2];
+		}
+
+		rowStart[0] += stepY[0];
+		rowStart[1] += stepY[1];
+		rowStart[2] += stepY[2];
+	}
+
+}//end fillTriangle
+
+
+//========== plotLinePixel =====================================================
+//
+// Purpose:		Draws one pixel of a line, t of the way along it.
+//
+//==============================================================================
+static inline void plotLinePixel(const SoftPass *pass, const SoftPrimitive *primitive,
+								 const float colors[2][4], int column, int row, float t)
+{
+	LDrawSoftFramebuffer	*framebuffer	= pass->framebuffer;
+	size_t					offset			= (size_t)row * framebuffer->width + column;
+	float					depth			= primitive->z[0] + (primitive->z[1] - primitive->z[0]) * t;
+	float					color[4];
+	int						channel			= 0;
+
+	if(depth - LINE_DEPTH_BIAS > framebuffer->depths[offset] || depth < 0.0f || depth >= 1.0f)
+		return;
+
+	for(channel = 0; channel < 4; channel++)
+		color[channel] = colors[0][channel] + (colors[1][channel] - colors[0][channel]) * t;
+	framebuffer->depths[offset] = MIN(depth, framebuffer->depths[offset]);
+	writePixel(framebuffer->pixels + offset * 4, color, pass->blend);
+
+}//end plotLinePixel
+
+
+//========== fillLine ==========================================================
+//
+// Purpose:		Draws the part of a one pixel wide line inside one tile: a
+//				pixel per column, or per row if the line is steep.
+//
+//==============================================================================
+static void fillLine(const SoftPass *pass, const SoftPrimitive *primitive,
+					 int tileLeft, int tileTop, int tileRight, int tileBottom)
+{
+	float	dx		= primitive->x[1] - primitive->x[0];
+	float	dy		= primitive->y[1] - primitive->y[0];
+	float	colors[2][4];
+	int		step	= 0;
+
+	unpackColor(primitive->color[0], colors[0]);
+	unpackColor(primitive->color[1], colors[1]);
+
+	if(fabsf(dx) >= fabsf(dy))
+	{
+		int first	= MAX(tileLeft, (int)ceilf(MIN(primitive->x[0], primitive->x[1]) - 0.5f));
+		int last	= MIN(tileRight, (int)floorf(MAX(primitive->x[0], primitive->x[1]) - 0.5f));
+
+		if(dx == 0.0f)
+		{
+			int column	= (int)floorf(primitive->x[0]);
+			int row		= (int)floorf(primitive->y[0]);
+
+			if(column >= tileLeft && column <= tileRight && row >= tileTop && row <= tileBottom)
+				plotLinePixel(pass, primitive, colors, column, row, 0);
+			return;
+		}
+		for(step = first; step <= last; step++)
+		{
+			float	t	= ((float)step + 0.5f - primitive->x[0]) / dx;
+			int		row	= (int)floorf(primitive->y[0] + dy * t);
+
+			if(row >= tileTop && row <= tileBottom)
+				plotLinePixel(pass, primitive, colors, step, row, t);
+		}
+	}
+	else
+	{
+		int first	= MAX(tileTop, (int)ceilf(MIN(primitive->y[0], primitive->y[1]) - 0.5f));
+		int last	= MIN(tileBottom, (int)floorf(MAX(primitive->y[0], primitive->y[1]) - 0.5f));
+
+		for(step = first; step <= last; step++)
+		{
+			float	t		= ((float)step + 0.5f - primitive->y[0]) / dy;
+			int		column	= (int)floorf(primitive->x[0] + dx * t);
+
+			if(column >= tileLeft && column <= tileRight)
+				plotLinePixel(pass, primitive, colors, column, step, t);
+		}
+	}
+
+}//end fillLine
+
+
+//========== fillTile ==========================================================
+//
+// Purpose:		runParallel task: fills one tile with the primitives binned to
+//				it, slice by slice so they go down in session order.
+//
+//==============================================================================
+static void fillTile(void *ref, int task)
+{
+	SoftPass	*pass		= (SoftPass *)ref;
+	int			tileLeft	= (task % pass->tilesAcross) * LDRAW_SOFT_RASTER_TILE_SIZE;
+	int			tileTop		= (task / pass->tilesAcross) * LDRAW_SOFT_RASTER_TILE_SIZE;
+	int			tileRight	= MIN(tileLeft + LDRAW_SOFT_RASTER_TILE_SIZE, pass->framebuffer->width) - 1;
+	int			tileBottom	= MIN(tileTop + LDRAW_SOFT_RASTER_TILE_SIZE, pass->framebuffer->height) - 1;
+	int			slice		= 0;
+	int			counter		= 0;
+
+	for(slice = 0; slice < pass->sliceCount; slice++)
+	{
+		const SoftSlice	*source	= pass->slices + slice;
+		const SoftBin	*bin	= source->bins + task;
+
+		for(counter = 0; counter < bin->count; counter++)
+		{
+			const SoftPrimitive *primitive = source->primitives + bin->items[counter];
+
+			if(primitive->vertexCount == 3)
+				fillTriangle(pass, primitive, tileLeft, tileTop, tileRight, tileBottom);
+			else
+				fillLine(pass, primitive, tileLeft, tileTop, tileRight, tileBottom);
+		}
+	}
+
+}//end fillTile
+
+
+//========== drawInstances =====================================================
+//
+// Purpose:		Draws a list of instances in order, a batch at a time.
+//
+//==============================================================================
+static void drawInstances(LDrawSoftSession *session, const SoftInstance *instances, int count, bool blend)
+{
+	SoftPass	*pass			= NULL;
+	int			threadCount		= getThreadCount();
+	int			tileCount		= 0;
+	int			first			= 0;
+	int			counter			= 0;
+
+	if(count == 0 || session->framebuffer->width <= 0 || session->framebuffer->height <= 0)
+		return;
+
+	pass = (SoftPass *)calloc(1, sizeof(SoftPass));
+	pass->session		= session;
+	pass->framebuffer	= session->framebuffer;
+	pass->instances		= instances;
+	pass->blend			= blend;
+	pass->tilesAcross	= (pass->framebuffer->width + LDRAW_SOFT_RASTER_TILE_SIZE - 1) / LDRAW_SOFT_RASTER_TILE_SIZE;
+	pass->tilesDown		= (pass->framebuffer->height + LDRAW_SOFT_RASTER_TILE_SIZE - 1) / LDRAW_SOFT_RASTER_TILE_SIZE;
+	tileCount			= pass->tilesAcross * pass->tilesDown;
+	for(counter = 0; counter < threadCount; counter++)
+		pass->slices[counter].bins = (SoftBin *)calloc((size_t)tileCount, sizeof(SoftBin));
+
+	while(first < count)
+	{
+		int		end			= first;
+		long	total		= 0;
+		long	share		= 0;
+		long	running		= 0;
+		int		slice		= 0;
+
+		// Take instances until the batch is full - but always at least one.
+		while(end < count && (end == first || total + estimatePrimitives(instances + end) <= BATCH_PRIMITIVES))
+			total += estimatePrimitives(instances + end++);
+
+		// Split the batch into runs of roughly equal work, one per thread.
+		pass->sliceCount	= MIN(threadCount, end - first);
+		share				= total / pass->sliceCount + 1;
+		pass->slices[0].firstInstance = first;
+		for(counter = first; counter < end; counter++)
+		{
+			running += estimatePrimitives(instances + counter);
+			if(running >= share * (slice + 1) && slice + 1 < pass->sliceCount)
+			{
+				pass->slices[slice].endInstance = counter + 1;
+				pass->slices[++slice].firstInstance = counter + 1;
+			}
+		}
+		pass->slices[slice].endInstance = end;
+		pass->sliceCount = slice + 1;
+
+		runParallel(threadCount, pass->sliceCount, setupSlice, pass);
+		runParallel(threadCount, tileCount, fillTile, pass);
+
+		first = end;
+	}
+
+	for(counter = 0; counter < threadCount; counter++)
+	{
+		SoftSlice	*slice	= pass->slices + counter;
+		int			tile	= 0;
+
+		for(tile = 0; tile < tileCount; tile++)
+			free(slice->bins[tile].items);
+		free(slice->bins);
+		free(slice->primitives);
+		free(slice->vertices);
+	}
+	free(pass);
+
+}//end drawInstances
+
+
+#pragma mark -
+#pragma mark SESSIONS
+#pragma mark -
+
+//========== LDrawSoftSessionCreate ============================================
+//
+// Purpose:		Starts collecting instances to draw into a framebuffer.
+//
+//==============================================================================
+LDrawSoftSession *LDrawSoftSessionCreate(LDrawSoftFramebuffer *framebuffer,
+										 const float modelView[16],
+										 const float projection[16])
+{
+	LDrawSoftSession	*session	= (LDrawSoftSession *)calloc(1, sizeof(LDrawSoftSession));
+
+	session->framebuffer = framebuffer;
+	memcpy(session->modelView, modelView, sizeof(session->modelView));
+	memcpy(session->projection, projection, sizeof(session->projection));
+
+	return session;
+
+}//end LDrawSoftSessionCreate
+
+
+//========== LDrawSoftSessionDraw ==============================================
+//
+// Purpose:		Queues one instance of a display list.
+//
+// Notes:		Like the GPU sessions, instances whose colors are translucent -
+//				baked in, or the current colors they pick up - wait to be drawn
+//				back to front after everything else.
+//
+//==============================================================================
+void LDrawSoftSessionDraw(LDrawSoftSession *session,
+						  const LDrawSoftDL *dl,
+						  const float currentColor[4],
+						  const float complementColor[4],
+						  const float transform[16],
+						  bool wireFrame)
+{
+	bool				translucent	=	(dl->flags & SOFT_DL_HAS_ALPHA)
+									||	((dl->flags & SOFT_DL_HAS_META) && (currentColor[3] < 1.0f || complementColor[3] < 1.0f));
+	SoftInstanceList	*list		= (translucent && !wireFrame) ? &session->translucent : &session->opaque;
+	SoftInstance		*instance	= NULL;
+
+	if(list->count == list->capacity)
+	{
+		list->capacity	= MAX(256, list->capacity * 2);
+		list->instances	= (SoftInstance *)realloc(list->instances, sizeof(SoftInstance) * list->capacity);
+	}
+	instance = list->instances + list->count++;
+
+	instance->dl		= dl;
+	instance->wireFrame	= wireFrame;
+	memcpy(instance->color, currentColor, sizeof(instance->color));
+	memcpy(instance->complement, complementColor, sizeof(instance->complement));
+	memcpy(instance->transform, transform, sizeof(instance->transform));
+
+}//end LDrawSoftSessionDraw
+
+
+//========== LDrawSoftSessionDrawAndDestroy ====================================
+//
+// Purpose:		Draws every queued instance, then frees the session.
+//
+//==============================================================================
+void LDrawSoftSessionDrawAndDestroy(LDrawSoftSession *session)
+{
+	int	count	= session->translucent.count;
+	int	counter	= 0;
+
+	drawInstances(session, session->opaque.instances, session->opaque.count, false);
+
+	if(count)
+	{
+		// Order by where each instance's origin is in eye space, as the GPU
+		// sessions do.
+		LDrawDepthSortEntry	*keys		= (LDrawDepthSortEntry *)malloc(sizeof(LDrawDepthSortEntry) * count * 2);
+		SoftInstance		*sorted		= (SoftInstance *)malloc(sizeof(SoftInstance) * count);
+
+		for(counter = 0; counter < count; counter++)
+		{
+			const float	*transform	= session->translucent.instances[counter].transform;
+			float		origin[4]	= { transform[12], transform[13], transform[14], 1.0f };
+			float		eye[4];
+
+			applyMatrix(eye, session->modelView, origin);
+			keys[counter].key	= eye[2];
+			keys[counter].index	= (uint32_t)counter;
+		}
+		LDrawDepthSort(keys, keys + count, count);
+		for(counter = 0; counter < count; counter++)
+			sorted[counter] = session->translucent.instances[keys[counter].index];
+
+		drawInstances(session, sorted, count, true);
+
+		free(sorted);
+		free(keys);
+	}
+
+	free(session->opaque.instances);
+	free(session->translucent.instances);
+	free(session);
+
+}//end LDrawSoftSessionDrawAndDestroy
@@ -0,0 +1,107 @@
+//==============================================================================
+//
+// File:		LDrawSoftRaster.h
+//
+// Purpose:		Drawing display lists without a GPU.
+//
+//				This is the software counterpart of LDrawDisplayList: display
+//				lists are baked through the same pipeline (see
+//				LDrawDLBuildQueue.h), a session collects instances of them with
+//				their colors and transforms, and destroying the session draws
+//				everything - opaque instances in the order they were drawn,
+//				then translucent ones back to front - into a framebuffer.
+//
+//				The rasterizer splits the framebuffer into tiles. Instances are
+//				transformed, lit, clipped and binned into tiles on one thread
+//				each per slice of the session, then the tiles are filled in
+//				parallel. A tile draws its primitives in session order, so the
+//				image is exactly the same whatever the thread count.
+//
+//				Lighting matches the shaders: two opposing headlights, so both
+//				sides of a face are lit, plus ambient. Lines are not lit.
+//				Textures are not drawn; textured faces get their base color.
+//
+//				This is plain C so that it builds - and renders thumbnails and
+//				test baselines - on machines without a GPU or Cocoa.
+//
+//==============================================================================
+#ifndef _LDrawSoftRaster_
+#define _LDrawSoftRaster_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Upper limit on rasterizer threads, however many cores there are.
+#define LDRAW_SOFT_RASTER_MAXIMUM_THREADS	64
+
+// Tiles are squares of this many pixels.
+#define LDRAW_SOFT_RASTER_TILE_SIZE			64
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// What gets drawn into. Pixels are RGBA, 8 bits a channel, top row first;
+// depths run from 0 at the near plane to 1 at the far one.
+typedef struct LDrawSoftFramebufferStruct
+{
+	int						width;
+	int						height;
+	uint8_t					*pixels;
+	float					*depths;
+
+} LDrawSoftFramebuffer;
+
+typedef struct LDrawSoftDLBuilderStruct	LDrawSoftDLBuilder;
+typedef struct LDrawSoftDLStruct		LDrawSoftDL;
+typedef struct LDrawSoftSessionStruct	LDrawSoftSession;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Framebuffers. Writing returns false if the file could not be written.
+LDrawSoftFramebuffer *	LDrawSoftFramebufferCreate(int width, int height);
+void					LDrawSoftFramebufferClear(LDrawSoftFramebuffer *framebuffer, const float color[4]);
+void					LDrawSoftFramebufferDestroy(LDrawSoftFramebuffer *framebuffer);
+bool					LDrawSoftFramebufferWritePPM(const LDrawSoftFramebuffer *framebuffer, const char *path);
+bool					LDrawSoftFramebufferWritePNG(const LDrawSoftFramebuffer *framebuffer, const char *path);
+
+// Display list building, as for the GPU display lists: colors with an alpha
+// of 0 are meta colors, mixed between the current and complement colors by
+// red. Prepare bakes the mesh and may run on any thread, as may Destroy.
+// Finish frees the builder and returns NULL if nothing was added.
+LDrawSoftDLBuilder *	LDrawSoftDLBuilderCreate(void);
+void					LDrawSoftDLBuilderAddTri(LDrawSoftDLBuilder *builder, const float v[9], const float c[4]);
+void					LDrawSoftDLBuilderAddQuad(LDrawSoftDLBuilder *builder, const float v[12], const float c[4]);
+void					LDrawSoftDLBuilderAddLine(LDrawSoftDLBuilder *builder, const float v[6], const float c[4]);
+int						LDrawSoftDLBuilderGetFaceCount(LDrawSoftDLBuilder *builder);
+void					LDrawSoftDLBuilderPrepare(LDrawSoftDLBuilder *builder);
+LDrawSoftDL *			LDrawSoftDLBuilderFinish(LDrawSoftDLBuilder *builder);
+void					LDrawSoftDLBuilderDestroy(LDrawSoftDLBuilder *builder);
+void					LDrawSoftDLDestroy(LDrawSoftDL *dl);
+
+// Sessions. Matrices are column-major, as OpenGL takes them. A display list
+// must outlive every session it is drawn in.
+LDrawSoftSession *		LDrawSoftSessionCreate(LDrawSoftFramebuffer *framebuffer,
+											   const float modelView[16],
+											   const float projection[16]);
+void					LDrawSoftSessionDraw(LDrawSoftSession *session,
+											 const LDrawSoftDL *dl,
+											 const float currentColor[4],
+											 const float complementColor[4],
+											 const float transform[16],
+											 bool wireFrame);
+void					LDrawSoftSessionDrawAndDestroy(LDrawSoftSession *session);
+
+// Pass 0 to use one thread per core (the default) or 1 to draw everything on
+// the calling thread. The image is exactly the same either way.
+void					LDrawSoftRasterSetThreadCount(int threadCount);
+
+#endif // _LDrawSoftRaster_
@@ -0,0 +1,73 @@
+//==============================================================================
+//
+//	LDrawSoftRenderer.h
+//	Bricksmith
+//
+//	Purpose:	an implementation of the LDrawCoreRenderer API that draws into
+//				memory with LDrawSoftRaster instead of on a GPU.
+//
+//				Like LDrawShaderRenderer, it lives for one frame: directives
+//				push their state and draw their display lists into it, and the
+//				collected instances are drawn when it is finished (or
+//				deallocated). Use it for thumbnails, image export and render
+//				baselines on machines with no usable GPU.
+//
+//	Notes:		Directives keep the display lists they were drawn with, so a
+//				directive tree should only ever be drawn by one kind of
+//				renderer.
+//
+//				Textures, conditional lines and drag handles are not drawn.
+//				Background builds are done on the spot, so every frame is
+//				complete.
+//
+//==============================================================================
+
+#import <Foundation/Foundation.h>
+
+#import "LDrawCoreRenderer.h"
+#import "LDrawShaderRenderer.h"
+#import "LDrawSoftRaster.h"
+
+
+@interface LDrawSoftRenderer : NSObject<LDrawCoreRenderer,LDrawCollector> {
+
+	LDrawSoftFramebuffer *			framebuffer;									// Not ours; must outlive the renderer.
+	LDrawSoftSession *				session;										// Draws when we finish.
+
+	float							color_now[4];									// Color stack.
+	float							compl_now[4];
+	float							color_stack[COLOR_STACK_DEPTH*4];
+	int								color_stack_top;
+
+	int								wire_frame_count;								// wire frame stack is just a count.
+
+	int								texture_stack_top;								// Textures are not drawn; this only checks balance.
+
+	float							transform_stack[TRANSFORM_STACK_DEPTH*16];		// Transform stack from push/pop matrix.
+	int								transform_stack_top;
+	float							transform_now[16];
+	float							cull_now[16];
+
+	LDrawSoftDLBuilder *			dl_stack[DL_STACK_DEPTH];						// DL stack from begin/end DL builds.
+	int								dl_stack_top;
+	LDrawSoftDLBuilder *			dl_now;											// This is the DL being built "right now".
+
+	float							mvp[16];
+
+	struct LDrawOcclusionStruct *	occlusion;										// Not ours; culls hidden parts after the BVH, if set.
+}
+
+- (id) initWithFramebuffer:(LDrawSoftFramebuffer *)target
+				 modelView:(float *)mv_matrix
+				projection:(float *)proj_matrix;
+
+// Draws everything collected so far into the framebuffer.  Nothing more can be
+// drawn afterwards.
+- (void) finish;
+
+// Parts cullBVH: finds on screen are then tested against the biggest of them,
+// and the hidden ones dropped; see LDrawOcclusion.h.  The occlusion is not ours.
+// NULL, the default, turns it off.
+- (void) setOcclusion:(struct LDrawOcclusionStruct *)newOcclusion;
+
+@end
@@ -0,0 +1,572 @@
+//==============================================================================
+//
+//	LDrawSoftRenderer.m
+//	Bricksmith
+//
+//	Purpose:	an implementation of the LDrawCoreRenderer API that draws into
+//				memory with LDrawSoftRaster instead of on a GPU.
+//
+//==============================================================================
+
+#import "LDrawSoftRenderer.h"
+
+#import "ColorLibrary.h"
+#import "LDrawBVH.h"
+#import "LDrawDLBuildQueue.h"
+#import "LDrawOcclusion.h"
+#import "MatrixMathEx.h"
+
+
+//========== set_color4fv ========================================================
+//
+// Purpose:	Copies an RGBA color, turning the special ptrs 0L and -1L into the
+//			meta colors 0,0,0,0 and 1,1,1,0 - as LDrawShaderRenderer does.
+//
+//================================================================================
+static void set_color4fv(float * c, float storage[4])
+{
+	if(c == LDrawRenderCurrentColor)
+	{
+		storage[0] = storage[1] = storage[2] = storage[3] = 0;
+	}
+	else if(c == LDrawRenderComplimentColor)
+	{
+		storage[0] = storage[1] = storage[2] = 1;
+		storage[3] = 0;
+	}
+	else
+	{
+		memcpy(storage,c,sizeof(float)*4);
+	}
+}//end set_color4fv
+
+
+//========== prepare_builder =====================================================
+//
+// Purpose:	Build job for a DL: bakes it.
+//
+//================================================================================
+static void prepare_builder(void * ctx)
+{
+	LDrawSoftDLBuilderPrepare((LDrawSoftDLBuilder *) ctx);
+
+}//end prepare_builder
+
+
+//========== discard_builder =====================================================
+//
+// Purpose:	Clean up a DL build that was cancelled.
+//
+//================================================================================
+static void discard_builder(void * ctx)
+{
+	LDrawSoftDLBuilderDestroy((LDrawSoftDLBuilder *) ctx);
+
+}//end discard_builder
+
+
+//========== cancel_build ========================================================
+//
+// Purpose:	The LDrawDLBuildCancel_f for our build handles.
+//
+//================================================================================
+static void cancel_build(LDrawDLBuildHandle who)
+{
+	LDrawDLBuildJobCancel((LDrawDLBuildJob *) who);
+
+}//end cancel_build
+
+
+
+//================================================================================
+@implementation LDrawSoftRenderer
+//================================================================================
+
+
+//========== initWithFramebuffer:modelView:projection: ===========================
+//
+// Purpose:	Start a frame drawn into target with the given camera.
+//
+//================================================================================
+- (id) initWithFramebuffer:(LDrawSoftFramebuffer *)target
+				 modelView:(float *)mv_matrix
+				projection:(float *)proj_matrix
+{
+	self = [super init];
+	if(self)
+	{
+		framebuffer = target;
+		session = LDrawSoftSessionCreate(framebuffer, mv_matrix, proj_matrix);
+
+		[[[ColorLibrary sharedColorLibrary] colorForCode:LDrawCurrentColor] getColorRGBA:color_now];
+		complimentColor(color_now, compl_now);
+
+		buildIdentity(transform_now);
+
+		multMatrices(mvp,proj_matrix,mv_matrix);
+		memcpy(cull_now,mvp,sizeof(mvp));
+	}
+	return self;
+
+}//end initWithFramebuffer:modelView:projection:
+
+
+//========== finish ==============================================================
+//
+// Purpose:	Draw everything collected into the framebuffer.
+//
+//================================================================================
+- (void) finish
+{
+	if(session)
+	{
+		LDrawSoftSessionDrawAndDestroy(session);
+		session = NULL;
+	}
+
+}//end finish
+
+
+//========== pushMatrix: =========================================================
+//
+// Purpose: accumulate a transform temporarily.
+//
+//================================================================================
+- (void) pushMatrix:(float *)matrix
+{
+	assert(transform_stack_top < TRANSFORM_STACK_DEPTH);
+	memcpy(transform_stack + 16 * transform_stack_top, transform_now, sizeof(transform_now));
+	multMatrices(transform_now, transform_stack + 16 * transform_stack_top, matrix);
+	++transform_stack_top;
+	multMatrices(cull_now,mvp,transform_now);
+
+}//end pushMatrix:
+
+
+//========== popMatrix ===========================================================
+//
+// Purpose: reset one level of the matrix stack.
+//
+//================================================================================
+- (void) popMatrix
+{
+	assert(transform_stack_top > 0);
+	--transform_stack_top;
+	memcpy(transform_now, transform_stack + 16 * transform_stack_top, sizeof(transform_now));
+	multMatrices(cull_now,mvp,transform_now);
+
+}//end popMatrix
+
+
+//========== checkCull:to: =======================================================
+//
+// Purpose: cull out bounding boxes that are off-screen or too small to see.
+//
+// Notes:	The same test as LDrawShaderRenderer's, but measured in our own
+//			framebuffer's pixels.  There are no detail levels in software.
+//
+//================================================================================
+- (int) checkCull:(float *)minXYZ to:(float *)maxXYZ
+{
+	if (minXYZ[0] > maxXYZ[0] ||
+		minXYZ[1] > maxXYZ[1] ||
+		minXYZ[2] > maxXYZ[2])		return cull_skip;
+
+	float aabb_model[6] = { minXYZ[0], minXYZ[1], minXYZ[2], maxXYZ[0], maxXYZ[1], maxXYZ[2] };
+	float aabb_ndc[6];
+
+	aabbToClipbox(aabb_model, cull_now, aabb_ndc);
+
+	if(aabb_ndc[3] < -1.0f ||
+	   aabb_ndc[4] < -1.0f ||
+	   aabb_ndc[0] > 1.0f ||
+	   aabb_ndc[1] > 1.0f)
+	{
+		return cull_skip;
+	}
+
+	int x_pix = (aabb_ndc[3] - aabb_ndc[0]) * 0.5f * framebuffer->width;
+	int y_pix = (aabb_ndc[4] - aabb_ndc[1]) * 0.5f * framebuffer->height;
+	int dim = MAX(x_pix,y_pix);
+
+	if(dim < 1)
+		return cull_skip;
+	if(dim < 10)
+		return cull_box;
+
+	return cull_draw;
+
+}//end checkCull:to:
+
+
+//========== cullBVH:visible:dropTiny: ===========================================
+//
+// Purpose: cull a whole BVH of bounding boxes against the current transform at
+//			once, measuring pixels as checkCull does.
+//
+//================================================================================
+- (int) cullBVH:(struct LDrawBVHStruct *)bvh visible:(int *)visible dropTiny:(BOOL)dropTiny
+{
+	float	pixel_scale[2]	= { 0.5f * framebuffer->width, 0.5f * framebuffer->height };
+	int		count			= LDrawBVHCull(bvh, cull_now, dropTiny ? pixel_scale : NULL, visible);
+
+	if(occlusion)
+		count = LDrawOcclusionCull(occlusion, cull_now, LDrawBVHBoxes(bvh), visible, count);
+
+	return count;
+
+}//end cullBVH:visible:dropTiny:
+
+
+//========== setOcclusion: =======================================================
+//
+// Purpose: cull the parts hidden behind other parts in cullBVH:, or stop doing
+//			so if newOcclusion is NULL.
+//
+//================================================================================
+- (void) setOcclusion:(struct LDrawOcclusionStruct *)newOcclusion
+{
+	occlusion = newOcclusion;
+
+}//end setOcclusion:
+
+
+//========== drawBoxFrom:to: =====================================================
+//
+// Purpose: draw an axis-aligned cube of a given size.
+//
+// Notes:	One unit cube is built and kept for good; the session instances it.
+//
+//================================================================================
+- (void) drawBoxFrom:(float *)minXyz to:(float *)maxXyz
+{
+	static LDrawSoftDL * unit_cube = NULL;
+	static dispatch_once_t once;
+
+	dispatch_once(&once, ^{
+		LDrawSoftDLBuilder * builder = LDrawSoftDLBuilderCreate();
+
+		#define LBR 0,0,0
+		#define RBR 1,0,0
+		#define LTR 0,1,0
+		#define RTR 1,1,0
+		#define LBF 0,0,1
+		#define RBF 1,0,1
+		#define LTF 0,1,1
+		#define RTF 1,1,1
+
+		float top[12] = { LTF,RTF,RTR,LTR };
+		float bot[12] = { LBF,LBR,RBR,RBF };
+		float lft[12] = { LBR,LBF,LTF,LTR };
+		float rgt[12] = { RBF,RBR,RTR,RTF };
+		float frt[12] = { LBF,RBF,RTF,LTF };
+		float bak[12] = { RBR,LBR,LTR,RTR };
+
+		float c[4] = { 0 };
+
+		LDrawSoftDLBuilderAddQuad(builder,top,c);
+		LDrawSoftDLBuilderAddQuad(builder,bot,c);
+		LDrawSoftDLBuilderAddQuad(builder,lft,c);
+		LDrawSoftDLBuilderAddQuad(builder,rgt,c);
+		LDrawSoftDLBuilderAddQuad(builder,frt,c);
+		LDrawSoftDLBuilderAddQuad(builder,bak,c);
+
+		unit_cube = LDrawSoftDLBuilderFinish(builder);
+	});
+
+	float dim[3] = {
+		maxXyz[0] - minXyz[0],
+		maxXyz[1] - minXyz[1],
+		maxXyz[2] - minXyz[2] };
+
+	float rescale[16] = {
+		dim[0], 	0,			0,			0,
+		0,			dim[1],		0,			0,
+		0,			0,			dim[2],		0,
+		minXyz[0],	minXyz[1],	minXyz[2],	1 };
+
+	[self pushMatrix:rescale];
+	[self drawDL:unit_cube];
+	[self popMatrix];
+
+}//end drawBoxFrom:to:
+
+
+//========== pushColor: ==========================================================
+//
+// Purpose: push a color change onto the stack.  This sets the RGBA for the
+//			current and compliment color for DLs that use the current color.
+//
+//================================================================================
+- (void) pushColor:(float *)color
+{
+	assert(color_stack_top < COLOR_STACK_DEPTH);
+	memcpy(color_stack + color_stack_top * 4, color_now, sizeof(color_now));
+	++color_stack_top;
+	if(color != LDrawRenderCurrentColor)
+	{
+		if(color == LDrawRenderComplimentColor)
+			color = compl_now;
+		memcpy(color_now, color, sizeof(color_now));
+		complimentColor(color_now, compl_now);
+	}
+
+}//end pushColor:
+
+
+//========== popColor ============================================================
+//
+// Purpose: pop the stack of current colors that has previously been pushed.
+//
+//================================================================================
+- (void) popColor
+{
+	assert(color_stack_top > 0);
+	--color_stack_top;
+	memcpy(color_now, color_stack + color_stack_top * 4, sizeof(color_now));
+	complimentColor(color_now, compl_now);
+
+}//end popColor
+
+
+//========== pushWireFrame =======================================================
+//
+// Purpose: push a change to wire frame mode.  This is nested - when the last
+//			"wire frame" is popped, we are no longer wire frame.
+//
+//================================================================================
+- (void) pushWireFrame
+{
+	++wire_frame_count;
+
+}//end pushWireFrame
+
+
+//========== popWireFrame ========================================================
+//
+// Purpose: undo a previous wire frame command.
+//
+//================================================================================
+- (void) popWireFrame
+{
+	assert(wire_frame_count > 0);
+	--wire_frame_count;
+
+}//end popWireFrame
+
+
+//========== pushTexture: ========================================================
+//
+// Purpose: textures are not drawn in software; faces keep their base colors.
+//
+//================================================================================
+- (void) pushTexture:(struct LDrawTextureSpec *)tex_spec
+{
+	++texture_stack_top;
+
+}//end pushTexture:
+
+
+//========== popTexture ==========================================================
+//
+// Purpose: pop a texture off the stack that was previously pushed.
+//
+//================================================================================
+- (void) popTexture
+{
+	assert(texture_stack_top > 0);
+	--texture_stack_top;
+
+}//end popTexture
+
+
+//========== drawQuad:normal:color: ==============================================
+//
+// Purpose: Adds one quad to the current display list.
+//
+//================================================================================
+- (void) drawQuad:(float *)vertices normal:(float *)normal color:(float *)color
+{
+	assert(dl_stack_top);
+	float c[4];
+
+	set_color4fv(color,c);
+	LDrawSoftDLBuilderAddQuad(dl_now,vertices,c);
+
+}//end drawQuad:normal:color:
+
+
+//========== drawTri:normal:color: ===============================================
+//
+// Purpose: Adds one triangle to the current display list.
+//
+//================================================================================
+- (void) drawTri:(float *)vertices normal:(float *)normal color:(float *)color
+{
+	assert(dl_stack_top);
+	float c[4];
+
+	set_color4fv(color,c);
+	LDrawSoftDLBuilderAddTri(dl_now,vertices,c);
+
+}//end drawTri:normal:color:
+
+
+//========== drawLine:normal:color: ==============================================
+//
+// Purpose: Adds one line to the current display list.
+//
+//================================================================================
+- (void) drawLine:(float *)vertices normal:(float *)normal color:(float *)color
+{
+	assert(dl_stack_top);
+	float c[4];
+
+	set_color4fv(color,c);
+	LDrawSoftDLBuilderAddLine(dl_now,vertices,c);
+
+}//end drawLine:normal:color:
+
+
+//========== drawConditionalLine:normal:color: ===================================
+//
+// Purpose: Conditional lines depend on the view, and are not drawn in
+//			software.
+//
+//================================================================================
+- (void) drawConditionalLine:(float *)vertices normal:(float *)normal color:(float *)color
+{
+	assert(dl_stack_top);
+
+}//end drawConditionalLine:normal:color:
+
+
+//========== drawDragHandle:withSize: ============================================
+//
+// Purpose:	Drag handles are editing aids, not part of the model; images drawn
+//			in software leave them out.
+//
+//================================================================================
+- (void) drawDragHandle:(float *)xyz withSize:(float)size
+{
+}//end drawDragHandle:withSize:
+
+
+//========== beginDL =============================================================
+//
+// Purpose:	This begins accumulating a display list.
+//
+//================================================================================
+- (id<LDrawCollector>) beginDL
+{
+	assert(dl_stack_top < DL_STACK_DEPTH);
+
+	dl_stack[dl_stack_top] = dl_now;
+	++dl_stack_top;
+	dl_now = LDrawSoftDLBuilderCreate();
+
+	return self;
+
+}//end beginDL
+
+
+//========== endDL:cleanupFunc: ==================================================
+//
+// Purpose: close off a DL, returning the display list if there is one.
+//
+//================================================================================
+- (void) endDL:(LDrawDLHandle *)outHandle cleanupFunc:(LDrawDLCleanup_f *)func
+{
+	assert(dl_stack_top > 0);
+	LDrawSoftDL * dl = dl_now ? LDrawSoftDLBuilderFinish(dl_now) : NULL;
+	--dl_stack_top;
+	dl_now = dl_stack[dl_stack_top];
+
+	*outHandle = (LDrawDLHandle)dl;
+	*func = (LDrawDLCleanup_f) LDrawSoftDLDestroy;
+
+}//end endDL:cleanupFunc:
+
+
+//========== endDLInBackground: ==================================================
+//
+// Purpose:	close off a DL through the build queue's interface.
+//
+// Notes:	The build is run on the spot: a software frame is drawn once, not
+//			refined over several, so it must have every display list.
+//
+//================================================================================
+- (LDrawDLBuildHandle) endDLInBackground:(LDrawDLBuildCancel_f *)cancelFunc
+{
+	assert(dl_stack_top > 0);
+	LDrawSoftDLBuilder * builder = dl_now;
+	LDrawDLBuildJob * job = NULL;
+
+	--dl_stack_top;
+	dl_now = dl_stack[dl_stack_top];
+
+	if(builder)
+		job = LDrawDLBuildQueueSubmit(NULL, prepare_builder, discard_builder, builder);
+
+	*cancelFunc = cancel_build;
+	return (LDrawDLBuildHandle) job;
+
+}//end endDLInBackground:
+
+
+//========== takeDL:handle:cleanupFunc: ==========================================
+//
+// Purpose:	Hand back a display list built by endDLInBackground:.
+//
+//================================================================================
+- (BOOL) takeDL:(LDrawDLBuildHandle)build handle:(LDrawDLHandle *)outHandle cleanupFunc:(LDrawDLCleanup_f *)func
+{
+	LDrawDLBuildJob * job = (LDrawDLBuildJob *) build;
+
+	if(!LDrawDLBuildJobIsDone(job))
+		return NO;
+
+	LDrawSoftDLBuilder * builder = (LDrawSoftDLBuilder *) LDrawDLBuildJobFinish(job);
+
+	*outHandle = (LDrawDLHandle)LDrawSoftDLBuilderFinish(builder);
+	*func = (LDrawDLCleanup_f) LDrawSoftDLDestroy;
+
+	return YES;
+
+}//end takeDL:handle:cleanupFunc:
+
+
+//========== drawDL: =============================================================
+//
+// Purpose:	draw a DL using the current state.
+//
+//================================================================================
+- (void) drawDL:(LDrawDLHandle)dl
+{
+	assert(session);
+	if(dl == NULL)
+		return;
+
+	LDrawSoftSessionDraw(session,
+						 (const LDrawSoftDL *) dl,
+						 color_now,
+						 compl_now,
+						 transform_now,
+						 wire_frame_count > 0);
+
+}//end drawDL:
+
+
+//========== dealloc =============================================================
+//
+// Purpose: Draw whatever has not been drawn yet.
+//
+//================================================================================
+- (void) dealloc
+{
+	[self finish];
+
+}//end dealloc
+
+
+@end
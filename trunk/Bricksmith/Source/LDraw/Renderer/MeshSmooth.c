@@ -9,6 +9,18 @@
 
 #include "MeshSmooth.h"
 
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 #pragma mark -
 //==============================================================================
 //	BASIC DATASTRUCTURES
@@ -92,6 +104,37 @@ struct Vertex {
 };
 
 
+// A face handed to a growable mesh, kept as it was given until
+// finish_faces_and_sort knows how many of each kind there are.
+struct StreamedFace {
+	int					degree;				// 2, 3 or 4, as add_face worked out.
+	int					tid;
+	float				color[4];
+	float				points[4][3];
+};
+
+// Streamed faces are kept in blocks that double in size as they fill, and that
+// never move - growing never copies what has already been added.
+struct StreamBlock {
+	struct StreamBlock *	next;
+	int						count;
+	int						capacity;
+	struct StreamedFace		faces[0];
+};
+
+// Everything a growable mesh has been given so far.  Polygons and lines are
+// kept apart, since the mesh needs all of its polygons before any line.
+struct FaceStream {
+	struct StreamBlock *	poly_head;
+	struct StreamBlock *	poly_tail;
+	struct StreamBlock *	line_head;
+	struct StreamBlock *	line_tail;
+	int						tri_count;
+	int						quad_count;
+	int						line_count;
+	int						cond_line_count;
+};
+
 // Our mesh master-container.
 struct Mesh {
 	int					vertex_count;		// Number of vertices so far.
@@ -108,11 +151,17 @@ struct Mesh {
 	int					face_capacity;		// Face capacity reserved in array.
 	struct Face *		faces;				// Malloc'd face memory.
 	
-	struct RTree_node *	index;				// Root node of r-tree that indexes vertices.
+	struct RTree_node *	index;				// Root node of r-tree that indexes vertices while welding, or NULL.
+	enum weld_index		weld_index;			// Which index finds vertices to weld.
 	#if DEBUG
 	int					flags;				// For debugging, we can flag various conditions that aren't errors but are strange (due to LDraw precision issues).
 	#endif
 	int					highest_tid;		// Highest TID - we have this + 1 total textures in this mesh.
+	
+	struct Face **		draw_order;			// Polygons in the order to write them, or NULL to write them in vertex order.
+	int					draw_order_count;	// Number of faces in draw_order.
+	
+	struct FaceStream *	stream;				// Faces given to a growable mesh, until finish_faces_and_sort places them; NULL otherwise.
 };
 
 
@@ -167,9 +216,29 @@ struct RTree_leaf {
 #define EPSI 0.005
 #define EPSI2 (EPSI*EPSI)
 
+// Two faces whose normals are further apart than this cosine (60 degrees) are
+// creased rather than smoothed together.
+#define CREASE_COS 0.5
+
+// Bump this whenever a change alters the smoothed output other than through the
+// constants above, so that saved meshes (see get_smoothing_parameters) go stale.
+#define SMOOTHING_VERSION 2
+
+// A growable mesh's first block holds this many faces; each block after that
+// holds twice as many as the last, up to the maximum.
+#define STREAM_BLOCK_MIN_FACES 256
+#define STREAM_BLOCK_MAX_FACES 65536
+
+// Which index create_mesh uses to find vertices to weld.  The spatial hash is
+// a few flat arrays and does no pointer chasing, so it is much cheaper to build
+// and query than the R-tree, and it welds exactly the same rings.
+#define DEFAULT_WELD_INDEX weld_index_grid
+
 // Turn this on to do a whole bunch of expensive validation of the algorithm.  Good for one-time tests but almost unusable even
 // for a debug test session.
+#ifndef SLOW_CHECKING
 #define SLOW_CHECKING 0
+#endif
 
 #if SLOW_CHECKING
 
@@ -203,6 +272,16 @@ struct RTree_leaf {
 // visualizing normal bugs.
 #define DEBUG_SHOW_NORMALS_AS_COLOR 0
 
+// This uses SSE2 or NEON for the hottest arithmetic where the CPU has it.
+// Set to 0 to build the scalar code only.
+#define WANT_SIMD 1
+
+// Fusing a multiply and an add rounds differently than doing them separately;
+// we never fuse so that the SIMD and scalar code (and every compiler) get the
+// same bits.  Clang honors this pragma; GCC ignores it, so builds with GCC
+// must pass -ffp-contract=off as well (Benchmarks/CMakeLists.txt does).
+#pragma STDC FP_CONTRACT OFF
+
 /*
 todo
 
@@ -213,6 +292,196 @@ todo
 
 */
 
+#pragma mark -
+//==============================================================================
+//	SIMD PRIMITIVES
+//==============================================================================
+//
+//	A thin 4-wide float vector over SSE2 (x86) or NEON (64-bit ARM), just big
+//	enough for the kernels below.  Each op is a single IEEE operation per lane,
+//	exactly as the scalar code does it, so the kernels produce the same bits as
+//	their scalar versions.  Without either instruction set, only the scalar
+//	code is built.
+
+#if WANT_SIMD && defined(__SSE2__)
+
+#include <emmintrin.h>
+#define MESH_SIMD 1
+
+typedef __m128 simd4f;
+
+static inline simd4f simd4f_load(const float * p)			{ return _mm_loadu_ps(p); }
+static inline void   simd4f_store(float * p, simd4f a)		{ _mm_storeu_ps(p, a); }
+static inline simd4f simd4f_splat(float a)					{ return _mm_set1_ps(a); }
+static inline simd4f simd4f_add(simd4f a, simd4f b)		{ return _mm_add_ps(a, b); }
+static inline simd4f simd4f_sub(simd4f a, simd4f b)		{ return _mm_sub_ps(a, b); }
+static inline simd4f simd4f_mul(simd4f a, simd4f b)		{ return _mm_mul_ps(a, b); }
+static inline simd4f simd4f_div(simd4f a, simd4f b)		{ return _mm_div_ps(a, b); }
+static inline simd4f simd4f_sqrt(simd4f a)					{ return _mm_sqrt_ps(a); }
+
+// Bit N of the result is set if lane N of a < b (or a > b).
+static inline int simd4f_lt_bits(simd4f a, simd4f b)		{ return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+static inline int simd4f_gt_bits(simd4f a, simd4f b)		{ return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+
+// Lanes of a where a is not zero (NaN counts as not zero, as in C), else b.
+static inline simd4f simd4f_select_nonzero(simd4f test, simd4f a, simd4f b)
+{
+	__m128 mask = _mm_cmpneq_ps(test, _mm_setzero_ps());
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+#elif WANT_SIMD && defined(__ARM_NEON) && defined(__aarch64__)
+
+#include <arm_neon.h>
+#define MESH_SIMD 1
+
+typedef float32x4_t simd4f;
+
+static inline simd4f simd4f_load(const float * p)			{ return vld1q_f32(p); }
+static inline void   simd4f_store(float * p, simd4f a)		{ vst1q_f32(p, a); }
+static inline simd4f simd4f_splat(float a)					{ return vdupq_n_f32(a); }
+static inline simd4f simd4f_add(simd4f a, simd4f b)		{ return vaddq_f32(a, b); }
+static inline simd4f simd4f_sub(simd4f a, simd4f b)		{ return vsubq_f32(a, b); }
+static inline simd4f simd4f_mul(simd4f a, simd4f b)		{ return vmulq_f32(a, b); }
+static inline simd4f simd4f_div(simd4f a, simd4f b)		{ return vdivq_f32(a, b); }
+static inline simd4f simd4f_sqrt(simd4f a)					{ return vsqrtq_f32(a); }
+
+static inline int simd4_bits(uint32x4_t mask)
+{
+	static const uint32_t weights[4] = { 1, 2, 4, 8 };
+	return (int) vaddvq_u32(vandq_u32(mask, vld1q_u32(weights)));
+}
+static inline int simd4f_lt_bits(simd4f a, simd4f b)		{ return simd4_bits(vcltq_f32(a, b)); }
+static inline int simd4f_gt_bits(simd4f a, simd4f b)		{ return simd4_bits(vcgtq_f32(a, b)); }
+
+static inline simd4f simd4f_select_nonzero(simd4f test, simd4f a, simd4f b)
+{
+	uint32x4_t mask = vmvnq_u32(vceqq_f32(test, vdupq_n_f32(0.0f)));
+	return vbslq_f32(mask, a, b);
+}
+
+#else
+
+#define MESH_SIMD 0
+
+#endif
+
+// Whether the SIMD kernels are used; see set_smoothing_simd_enabled.  Set from
+// any thread while others smooth, so it is atomic; relaxed is enough, as each
+// mesh only needs to see some value of it.
+static _Atomic int smoothing_simd = MESH_SIMD;
+
+void				set_smoothing_simd_enabled(int enabled)
+{
+	atomic_store_explicit(&smoothing_simd, enabled && MESH_SIMD, memory_order_relaxed);
+}
+
+static inline int simd_enabled(void)
+{
+	return atomic_load_explicit(&smoothing_simd, memory_order_relaxed);
+}
+
+
+#pragma mark -
+//==============================================================================
+//	PARALLEL EXECUTION
+//==============================================================================
+//
+//	The expensive stages of smoothing are split across threads for big meshes.
+//	Every parallel path is built so that it does exactly the same arithmetic, on
+//	the same data, in the same order as the serial one - the threads only ever
+//	divide up work whose pieces don't affect each other.  So the output is bit-
+//	for-bit identical no matter how many threads run.
+//
+//	Small meshes (nearly every part) stay on the calling thread; starting
+//	threads would cost more than the work.
+
+// Meshes with fewer vertices than this are smoothed serially.
+#define PARALLEL_MIN_VERTICES 16384
+
+// Most threads we will ever start for one stage.
+#define MAX_SMOOTHING_THREADS 32
+
+// Faces handed to a thread at a time when work is split by face.
+#define PARALLEL_FACE_GRAIN 1024
+
+// Ranges smaller than this are quick-sorted without further splitting.
+#define PARALLEL_SORT_GRAIN 4096
+
+// 0 means one thread per core.  Atomic for the same reason as smoothing_simd.
+static _Atomic int smoothing_thread_count = 0;
+
+// Overrides smoothing_thread_count for meshes smoothed on this thread; 0 means
+// no override.
+static _Thread_local int smoothing_thread_count_here = 0;
+
+// A parallel-for: work(ref, task) is called once for each task in
+// [0, task_count), on any thread.
+struct parallel_job {
+	void	(* work)(void * ref, int task);
+	void *	ref;
+	int		task_count;
+	int		next_task;			// Next unclaimed task; claimed atomically.
+};
+
+void				set_smoothing_thread_count(int thread_count)
+{
+	atomic_store_explicit(&smoothing_thread_count, thread_count, memory_order_relaxed);
+}
+
+void				set_smoothing_thread_count_for_this_thread(int thread_count)
+{
+	smoothing_thread_count_here = thread_count;
+}
+
+// Returns the number of threads a mesh of vertex_count vertices gets.
+static int threads_for_mesh(int vertex_count)
+{
+	int count = smoothing_thread_count_here;
+	if(count <= 0)
+		count = atomic_load_explicit(&smoothing_thread_count, memory_order_relaxed);
+	if(count <= 0)
+		count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if(count > MAX_SMOOTHING_THREADS)
+		count = MAX_SMOOTHING_THREADS;
+	if(count < 1 || vertex_count < PARALLEL_MIN_VERTICES)
+		count = 1;
+	return count;
+}
+
+// Thread body for run_parallel: keep claiming tasks until there are none left.
+static void * parallel_worker(void * ref)
+{
+	struct parallel_job * job = (struct parallel_job *) ref;
+	int task;
+	while((task = __atomic_fetch_add(&job->next_task, 1, __ATOMIC_RELAXED)) < job->task_count)
+		job->work(job->ref, task);
+	return NULL;
+}
+
+// Runs task_count tasks across up to thread_count threads (the calling thread
+// included) and returns when all are done.  If a thread can't be started, the
+// remaining ones simply take more of the tasks.
+static void run_parallel(int thread_count, int task_count, void (* work)(void * ref, int task), void * ref)
+{
+	pthread_t				threads[MAX_SMOOTHING_THREADS];
+	struct parallel_job		job = { work, ref, task_count, 0 };
+	int						started = 0;
+	int						t;
+
+	thread_count = MIN(thread_count, task_count);
+	for(t = 1; t < thread_count; ++t)
+	{
+		if(pthread_create(threads + started, NULL, parallel_worker, &job) == 0)
+			++started;
+	}
+	
+	parallel_worker(&job);
+	
+	for(t = 0; t < started; ++t)
+		pthread_join(threads[t], NULL);
+}
+
 #pragma mark -
 //==============================================================================
 //	SORTING AND COMPARISONS
@@ -267,6 +536,54 @@ static int compare_vertices(const struct Vertex * __restrict v1, const struct Ve
 	
 }
 
+// The SIMD vertex tests read location, normal and color as one run of 10 floats.
+_Static_assert(offsetof(struct Vertex, normal) == 3 * sizeof(float) &&
+			   offsetof(struct Vertex, color) == 6 * sizeof(float),
+			   "vertex location, normal and color must be contiguous");
+
+// Returns true if compare_vertices would return 0 - that is, no component of
+// either vertex is less than or greater than the other's.  With SIMD this is
+// three compares of four lanes each (the last overlapping the second) rather
+// than up to 20 scalar compares and branches.
+static inline int vertices_equal(const struct Vertex * __restrict v1, const struct Vertex * __restrict v2)
+{
+#if MESH_SIMD
+	if(simd_enabled())
+	{
+		const float * a = v1->location;
+		const float * b = v2->location;
+		simd4f a0 = simd4f_load(a), a1 = simd4f_load(a + 4), a2 = simd4f_load(a + 6);
+		simd4f b0 = simd4f_load(b), b1 = simd4f_load(b + 4), b2 = simd4f_load(b + 6);
+		return (simd4f_lt_bits(a0, b0) | simd4f_gt_bits(a0, b0) |
+				simd4f_lt_bits(a1, b1) | simd4f_gt_bits(a1, b1) |
+				simd4f_lt_bits(a2, b2) | simd4f_gt_bits(a2, b2)) == 0;
+	}
+#endif
+	return compare_vertices(v1, v2) == 0;
+}
+
+// compare_vertices with SIMD where we have it: all 10 components are compared
+// at once, and the first one that differs decides.
+static inline int compare_vertices_10(const struct Vertex * __restrict v1, const struct Vertex * __restrict v2)
+{
+#if MESH_SIMD
+	if(simd_enabled())
+	{
+		const float * a = v1->location;
+		const float * b = v2->location;
+		simd4f a0 = simd4f_load(a), a1 = simd4f_load(a + 4), a2 = simd4f_load(a + 6);
+		simd4f b0 = simd4f_load(b), b1 = simd4f_load(b + 4), b2 = simd4f_load(b + 6);
+		int lt = simd4f_lt_bits(a0, b0) | (simd4f_lt_bits(a1, b1) << 4) | ((simd4f_lt_bits(a2, b2) >> 2) << 8);
+		int gt = simd4f_gt_bits(a0, b0) | (simd4f_gt_bits(a1, b1) << 4) | ((simd4f_gt_bits(a2, b2) >> 2) << 8);
+		int differ = lt | gt;
+		if(differ == 0)
+			return 0;
+		return (lt & (differ & -differ)) ? -1 : 1;
+	}
+#endif
+	return compare_vertices(v1, v2);
+}
+
 // Compare only the "Nth" location field, e.g. only x, y, or z.  
 // Used to organize points along a single axis.
 static int compare_nth(const struct Vertex * __restrict v1, const struct Vertex * __restrict v2, int n)
@@ -305,7 +622,7 @@ static void bubble_sort_10(struct Vertex * items, int count)
 		int high_count = 0;
 		swapped = 0;
 		for(i = 1; i < count; ++i)
-		if(compare_vertices(items+i-1,items+i) > 0)
+		if(compare_vertices_10(items+i-1,items+i) > 0)
 		{
 			swap_blocks(items+i-1,items+i,sizeof(struct Vertex) / sizeof(int));
 			swapped = true;
@@ -315,17 +632,79 @@ static void bubble_sort_10(struct Vertex * items, int count)
 	} while (swapped);
 }
 
+// Parallel 10-coordinate sort.  When we get here the vertices are already sorted
+// by location, so only vertices at the same location can trade places.  We cut
+// the array into chunks at location boundaries and bubble-sort each chunk on its
+// own thread.  Bubble sort is stable, and a stable sort has exactly one result,
+// so this is the same as bubble-sorting the whole array.
+struct sort_10_job {
+	struct Vertex *	base;
+	int *			bounds;				// Chunk c is [bounds[c], bounds[c+1]).
+	int				not_presorted;		// Set if a chunk turns out not to be sorted by location.
+};
+
+static void sort_10_chunk(void * ref, int chunk)
+{
+	struct sort_10_job * job = (struct sort_10_job *) ref;
+	int begin = job->bounds[chunk];
+	int end = job->bounds[chunk+1];
+	int i;
+	
+	// Check our assumption first.  (The caller checked the chunk boundaries.)  If
+	// it doesn't hold we leave the chunk alone and the caller sorts the whole
+	// array.  Chunks that did get sorted are still fine: a stable sort never
+	// reorders equal vertices, so the final result is unchanged.
+	for(i = begin + 1; i < end; ++i)
+	if(compare_points(job->base[i-1].location,job->base[i].location) > 0)
+	{
+		__atomic_store_n(&job->not_presorted, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	
+	bubble_sort_10(job->base + begin, end - begin);
+}
+
 // sort APIs are wrapped in functions that don't have an algo, e.g. "just sort by 
 // 10 coords" so we can easily try different algos and see which is fastest.
 static void sort_vertices_10(struct Vertex * base, int count)
 {
+	int thread_count = threads_for_mesh(count);
+	
+	if(thread_count > 1)
+	{
+		int					chunk_count = thread_count * 4;
+		int					bounds[MAX_SMOOTHING_THREADS * 4 + 1];
+		struct sort_10_job	job = { base, bounds, 0 };
+		int					c, b;
+		
+		// Nominally even chunks, each pushed forward to the start of the next
+		// location.
+		bounds[0] = 0;
+		for(c = 1; c < chunk_count; ++c)
+		{
+			b = MAX((int) ((int64_t) count * c / chunk_count), bounds[c-1]);
+			while(b > 0 && b < count && compare_points(base[b-1].location,base[b].location) == 0)
+				++b;
+			if(b > 0 && b < count && compare_points(base[b-1].location,base[b].location) > 0)
+				job.not_presorted = 1;
+			bounds[c] = b;
+		}
+		bounds[chunk_count] = count;
+		
+		if(!job.not_presorted)
+			run_parallel(thread_count, chunk_count, sort_10_chunk, &job);
+		
+		if(!job.not_presorted)
+			return;
+	}
+	
 	bubble_sort_10(base,count);
 }
 
-// 3-coordinate quick-sort.  The range of arr from [left to right] (inclusive!!)
-// is sorted using quick-sort.  For totally unsorted data, this is a good sort 
-// choice.  Only location is used to sort.
-static void quickSort_3(struct Vertex * arr, int left, int right) 
+// One level of quickSort_3: partitions the range of arr from [left to right]
+// (inclusive!!) around its middle element.  What remains to be sorted is
+// [left, *out_j] and [*out_i, right].
+static void partition_3(struct Vertex * arr, int left, int right, int * out_i, int * out_j)
 {
 	int i = left, j = right;
 
@@ -352,6 +731,19 @@ static void quickSort_3(struct Vertex * arr, int left, int right)
 		}
 	}
 
+	*out_i = i;
+	*out_j = j;
+}
+
+// 3-coordinate quick-sort.  The range of arr from [left to right] (inclusive!!)
+// is sorted using quick-sort.  For totally unsorted data, this is a good sort 
+// choice.  Only location is used to sort.
+static void quickSort_3(struct Vertex * arr, int left, int right) 
+{
+	int i, j;
+
+	partition_3(arr, left, right, &i, &j);
+
 	if (left < j)
 		quickSort_3(arr, left, j);
 
@@ -360,6 +752,78 @@ static void quickSort_3(struct Vertex * arr, int left, int right)
 
 }
 
+// Parallel quick-sort.  Once a range is partitioned, its two halves never touch
+// each other again, so they can be sorted on different threads with exactly the
+// same result.  Threads share a stack of ranges still to be partitioned: each
+// takes one, splits it, pushes the right half for anyone to take, and keeps
+// going on the left half until it is small enough to finish with quickSort_3.
+struct sort_3_job {
+	struct Vertex *	arr;
+	pthread_mutex_t	lock;
+	pthread_cond_t	wake;
+	int *			stack;				// Pairs of [left, right] ranges waiting to be taken.
+	int				stack_count;		// Number of pairs.
+	int				busy;				// Threads working on a range.
+};
+
+static void push_range_3(struct sort_3_job * job, int left, int right)
+{
+	pthread_mutex_lock(&job->lock);
+	job->stack[job->stack_count * 2    ] = left;
+	job->stack[job->stack_count * 2 + 1] = right;
+	++job->stack_count;
+	pthread_cond_signal(&job->wake);
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void sort_3_worker(void * ref, int task)
+{
+	struct sort_3_job * job = (struct sort_3_job *) ref;
+	int left, right, i, j;
+	
+	(void) task;		// Every thread pulls ranges off the shared stack.
+
+	pthread_mutex_lock(&job->lock);
+	for(;;)
+	{
+		while(job->stack_count == 0 && job->busy > 0)
+			pthread_cond_wait(&job->wake, &job->lock);
+		if(job->stack_count == 0)
+			break;
+		
+		--job->stack_count;
+		left  = job->stack[job->stack_count * 2    ];
+		right = job->stack[job->stack_count * 2 + 1];
+		++job->busy;
+		pthread_mutex_unlock(&job->lock);
+		
+		while(right - left + 1 >= PARALLEL_SORT_GRAIN)
+		{
+			partition_3(job->arr, left, right, &i, &j);
+			
+			if (i < right)
+			{
+				if(right - i + 1 >= PARALLEL_SORT_GRAIN)
+					push_range_3(job, i, right);
+				else
+					quickSort_3(job->arr, i, right);
+			}
+			
+			if (left >= j)
+				break;
+			right = j;
+		}
+		if(right - left + 1 < PARALLEL_SORT_GRAIN && left < right)
+			quickSort_3(job->arr, left, right);
+		
+		pthread_mutex_lock(&job->lock);
+		--job->busy;
+		if(job->busy == 0 && job->stack_count == 0)
+			pthread_cond_broadcast(&job->wake);
+	}
+	pthread_mutex_unlock(&job->lock);
+}
+
 // Quick-sort, but based only on the "nth" coordinate - lets us rapidly
 // sort by x, y, or z.  We want quicksort because changing the sort axis
 // is likely to radically change the order, and thus we are not near-sorted
@@ -407,7 +871,31 @@ static void quickSort_n(struct Vertex ** arr, int left, int right, int n)
 // logic.
 static void sort_vertices_3(struct Vertex * base, int count)
 {
-	quickSort_3(base,0,count-1);
+	int thread_count = threads_for_mesh(count);
+	
+	if(thread_count > 1)
+	{
+		struct sort_3_job job;
+		
+		// Every range on the stack is at least PARALLEL_SORT_GRAIN long, and
+		// they never overlap.
+		job.arr = base;
+		job.stack = (int *) malloc(sizeof(int) * 2 * (count / PARALLEL_SORT_GRAIN + 1));
+		job.stack[0] = 0;
+		job.stack[1] = count - 1;
+		job.stack_count = 1;
+		job.busy = 0;
+		pthread_mutex_init(&job.lock, NULL);
+		pthread_cond_init(&job.wake, NULL);
+		
+		run_parallel(thread_count, thread_count, sort_3_worker, &job);
+		
+		pthread_cond_destroy(&job.wake);
+		pthread_mutex_destroy(&job.lock);
+		free(job.stack);
+	}
+	else if(count > 1)
+		quickSort_3(base,0,count-1);
 }
 
 // Search primitive.  Given a sorted (by location) array of vertices and a target point (p3) this routine finds the range
@@ -728,6 +1216,144 @@ static inline void proj_onto_line(float * __restrict proj, const float * __restr
 	proj[2] = o[2] + scalar * v[2];	
 }
 
+#pragma mark -
+//==============================================================================
+//	SPATIAL HASH ROUTINES
+//==============================================================================
+
+// The spatial hash is the alternative to the R-tree for welding.  Space is cut
+// into cubes EPSI on a side, so everything within EPSI of a point lies in the
+// 3x3x3 block of cubes around it.  Cubes are hashed into buckets; the points of
+// each bucket sit together in one flat array (put in bucket order by a counting
+// sort), with their locations copied in so that a query can rule points out
+// without touching the vertices themselves.
+//
+// As with the R-tree, only the first of each range of colocated vertices is
+// indexed.
+
+// Defined with the main API below.
+static void visit_vertex_to_snap(struct Vertex * v, void * ref);
+
+struct Grid_entry {
+	float	location[3];
+	int		vertex;					// Index into the mesh's vertex array.
+};
+
+struct Grid {
+	unsigned int		bucket_mask;	// Bucket count - 1; the count is a power of 2.
+	int *				bucket_starts;	// Bucket b is [bucket_starts[b], bucket_starts[b+1]) of entries.
+	struct Grid_entry *	entries;
+};
+
+// Finds the cube containing p.  This only has to be monotonic - a larger
+// coordinate never lands in a smaller cube - so that the cubes spanned by a
+// query box always contain every point inside it.
+static inline void grid_cell(const float p[3], int cell[3])
+{
+	int i;
+	for(i = 0; i < 3; ++i)
+	{
+		float c = floorf(p[i] * (float) (1.0 / EPSI));
+		c = MAX(c, (float) -(1 << 30));
+		c = MIN(c, (float)  (1 << 30));
+		cell[i] = (int) c;
+	}
+}
+
+static inline unsigned int grid_bucket(const struct Grid * grid, const int cell[3])
+{
+	return (((unsigned int) cell[0] * 73856093u) ^
+			((unsigned int) cell[1] * 19349663u) ^
+			((unsigned int) cell[2] * 83492791u)) & grid->bucket_mask;
+}
+
+// Builds the spatial hash over the sorted vertices in base.
+static struct Grid * grid_index_vertices(struct Vertex * base, int count)
+{
+	struct Grid * grid = (struct Grid *) malloc(sizeof(struct Grid));
+	unsigned int * buckets = (unsigned int *) malloc(sizeof(unsigned int) * count);
+	int * cursors;
+	unsigned int bucket_count = 1;
+	int unique = 0;
+	int i;
+	int cell[3];
+	
+	for(i = 0; i < count; ++i)
+	if(i == 0 || compare_points(base[i-1].location,base[i].location) != 0)
+		++unique;
+	
+	while(bucket_count < (unsigned int) unique * 2)
+		bucket_count *= 2;
+	grid->bucket_mask = bucket_count - 1;
+	grid->bucket_starts = (int *) calloc(bucket_count + 1, sizeof(int));
+	grid->entries = (struct Grid_entry *) malloc(sizeof(struct Grid_entry) * MAX(unique,1));
+	
+	// Count, then place, each point in its bucket.
+	for(i = 0; i < count; ++i)
+	if(i == 0 || compare_points(base[i-1].location,base[i].location) != 0)
+	{
+		grid_cell(base[i].location, cell);
+		buckets[i] = grid_bucket(grid, cell);
+		++grid->bucket_starts[buckets[i] + 1];
+	}
+	
+	cursors = (int *) malloc(sizeof(int) * bucket_count);
+	for(i = 0; i < (int) bucket_count; ++i)
+	{
+		grid->bucket_starts[i+1] += grid->bucket_starts[i];
+		cursors[i] = grid->bucket_starts[i];
+	}
+	
+	for(i = 0; i < count; ++i)
+	if(i == 0 || compare_points(base[i-1].location,base[i].location) != 0)
+	{
+		struct Grid_entry * e = grid->entries + cursors[buckets[i]]++;
+		vec3f_copy(e->location, base[i].location);
+		e->vertex = i;
+	}
+	
+	free(cursors);
+	free(buckets);
+	return grid;
+}
+
+static void destroy_grid(struct Grid * grid)
+{
+	free(grid->bucket_starts);
+	free(grid->entries);
+	free(grid);
+}
+
+// Snaps q to every indexed vertex inside min_bounds -> max_bounds (inclusive
+// of edges) - the same vertices scan_rtree would find for the same box.
+static void scan_grid_to_snap(struct Grid * grid, struct Vertex * base, float min_bounds[3], float max_bounds[3], struct Vertex * q)
+{
+	int lo[3], hi[3], cell[3], entry_cell[3];
+	int e;
+	
+	grid_cell(min_bounds, lo);
+	grid_cell(max_bounds, hi);
+	
+	for(cell[0] = lo[0]; cell[0] <= hi[0]; ++cell[0])
+	for(cell[1] = lo[1]; cell[1] <= hi[1]; ++cell[1])
+	for(cell[2] = lo[2]; cell[2] <= hi[2]; ++cell[2])
+	{
+		unsigned int b = grid_bucket(grid, cell);
+		for(e = grid->bucket_starts[b]; e < grid->bucket_starts[b+1]; ++e)
+		{
+			struct Grid_entry * entry = grid->entries + e;
+			if(!inside(min_bounds, max_bounds, entry->location))
+				continue;
+			
+			// Other cubes can share our bucket; a point is only visited from
+			// its own, so it is never visited twice.
+			grid_cell(entry->location, entry_cell);
+			if(entry_cell[0] == cell[0] && entry_cell[1] == cell[1] && entry_cell[2] == cell[2])
+				visit_vertex_to_snap(base + entry->vertex, q);
+		}
+	}
+}
+
 #pragma mark -
 //==============================================================================
 //	TRIANGLE MESH UTILS
@@ -738,6 +1364,18 @@ static inline void proj_onto_line(float * __restrict proj, const float * __restr
 int CCW(const struct Face * f, int i) { assert(i >= 0 && i < f->degree); return (i          +1)%f->degree; }
 int CW (const struct Face * f, int i) { assert(i >= 0 && i < f->degree); return (i+f->degree-1)%f->degree; }
 
+// Predicate: is a face of this degree a polygon (as opposed to a line)?  For
+// Metal, quads are triangulated before they get here, and degree 4 means a
+// conditional line.
+static inline int degree_is_polygon(int degree)
+{
+#ifdef METAL
+	return degree == 3;
+#else
+	return degree >= 3;
+#endif
+}
+
 // Predicate: do the two face normals n1 and n2 form a crease?  Flip should be true if the winding order
 // of the two tris is flipped.
 int is_crease(const float n1[3], const float n2[3], int flip)
@@ -745,10 +1383,10 @@ int is_crease(const float n1[3], const float n2[3], int flip)
 	float dot = vec3f_dot(n1,n2);
 	if(flip)
 	{
-		return (dot > -0.5);
+		return (dot > -CREASE_COS);
 	}
 	else	
-		return (dot < 0.5);
+		return (dot < CREASE_COS);
 }
 
 #define mirror(f,n) ((f)->index[(n)])
@@ -931,9 +1569,37 @@ void validate_neighbors(struct Mesh * mesh)
 //	MAIN API IMPLEMENTATION
 //==============================================================================
 
+// Report the constants and build switches that shape the output, for anyone
+// saving it.
+void				get_smoothing_parameters(struct smoothing_parameters * out_params)
+{
+	out_params->version = SMOOTHING_VERSION;
+	out_params->weld_distance = EPSI;
+	out_params->crease_cosine = CREASE_COS;
+	out_params->flags = 0;
+	#if WANT_CREASE
+	out_params->flags |= smoothing_creases;
+	#endif
+	#if WANT_INVERTS
+	out_params->flags |= smoothing_inverts;
+	#endif
+	#if DEBUG_SHOW_NORMALS_AS_COLOR
+	out_params->flags |= smoothing_normals_as_color;
+	#endif
+	#ifdef METAL
+	out_params->flags |= smoothing_quads_are_cond_lines;
+	#endif
+}
+
 // Create a new mesh to smooth.  You must pass in the _exact_ number of tris,
 // quads and lines that you will later pass in.
 struct Mesh *		create_mesh(int tri_count, int quad_count, int line_count, int cond_line_count)
+{
+	return create_mesh_with_weld_index(tri_count, quad_count, line_count, cond_line_count, DEFAULT_WELD_INDEX);
+}
+
+// Same as create_mesh, but picks the index used to find vertices to weld.
+struct Mesh *		create_mesh_with_weld_index(int tri_count, int quad_count, int line_count, int cond_line_count, enum weld_index weld_index)
 {
 	struct Mesh * ret = (struct Mesh *) malloc(sizeof(struct Mesh));
 	ret->vertex_count = 0;
@@ -949,6 +1615,11 @@ struct Mesh *		create_mesh(int tri_count, int quad_count, int line_count, int co
 	ret->quad_count = quad_count;
 	
 	ret->faces = (struct Face *) malloc(sizeof(struct Face) * ret->face_capacity);
+	ret->index = NULL;
+	ret->weld_index = weld_index;
+	ret->draw_order = NULL;
+	ret->draw_order_count = 0;
+	ret->stream = NULL;
 	#if DEBUG
 	ret->flags = 0;
 	#endif
@@ -956,8 +1627,79 @@ struct Mesh *		create_mesh(int tri_count, int quad_count, int line_count, int co
 	return ret;
 }
 
+// Create a new mesh to smooth without knowing how big it will be.  Faces are
+// held as they come in, and placed when finish_faces_and_sort is called.
+struct Mesh *		create_growable_mesh(void)
+{
+	struct Mesh * ret = create_mesh(0, 0, 0, 0);
+	ret->stream = (struct FaceStream *) calloc(1, sizeof(struct FaceStream));
+	return ret;
+}
+
+// Append one face to a growable mesh's stream, starting a new block (twice the
+// size of the last) when the current one is full.
+static void stream_face(struct FaceStream * stream, const float p1[3], const float p2[3], const float p3[3], const float p4[3], const float color[4], int tid)
+{
+	int degree = p4 ? 4 : (p3 ? 3 : 2);
+	int is_poly = degree_is_polygon(degree);
+	struct StreamBlock ** head = is_poly ? &stream->poly_head : &stream->line_head;
+	struct StreamBlock ** tail = is_poly ? &stream->poly_tail : &stream->line_tail;
+	struct StreamedFace * f;
+
+	if(*tail == NULL || (*tail)->count == (*tail)->capacity)
+	{
+		int capacity = *tail ? MIN((*tail)->capacity * 2, STREAM_BLOCK_MAX_FACES) : STREAM_BLOCK_MIN_FACES;
+		struct StreamBlock * block = (struct StreamBlock *) malloc(sizeof(struct StreamBlock) + sizeof(struct StreamedFace) * capacity);
+		block->next = NULL;
+		block->count = 0;
+		block->capacity = capacity;
+		if(*tail)
+			(*tail)->next = block;
+		else
+			*head = block;
+		*tail = block;
+	}
+
+	f = (*tail)->faces + (*tail)->count++;
+	f->degree = degree;
+	f->tid = tid;
+	vec4f_copy(f->color, color);
+	vec3f_copy(f->points[0], p1);
+	vec3f_copy(f->points[1], p2);
+	if(p3)
+		vec3f_copy(f->points[2], p3);
+	if(p4)
+		vec3f_copy(f->points[3], p4);
+
+	switch(degree) {
+	case 2:	++stream->line_count;	break;
+	case 3:	++stream->tri_count;	break;
+	case 4:	if(is_poly) ++stream->quad_count; else ++stream->cond_line_count;	break;
+	}
+}
+
+// Free a stream's blocks.
+static void destroy_stream(struct FaceStream * stream)
+{
+	struct StreamBlock * b, * k;
+	for(b = stream->poly_head; b; b = k)
+	{
+		k = b->next;
+		free(b);
+	}
+	for(b = stream->line_head; b; b = k)
+	{
+		k = b->next;
+		free(b);
+	}
+	free(stream);
+}
+
+static void insert_face(struct Mesh * mesh, const float p1[3], const float p2[3], const float p3[3], const float p4[3], const float color[4], int tid);
+
 // Add one face to the mesh.  Quads and tris can be added in any order but all 
-// quads and tris (polygons) must be added before all lines.
+// quads and tris (polygons) must be added before all lines - unless the mesh is
+// growable, in which case anything goes.
 // When passing a face, simply pass NULL for any 'extra' vertices - that is,
 // to create a line, pass NULL for p3 and p4; to create a triangle, pass NULL for
 // p3.  The color is the color of the entire face in RGBA; the face normal is
@@ -976,9 +1718,55 @@ struct Mesh *		create_mesh(int tri_count, int quad_count, int line_count, int co
 // that is, faces, quads and lines are ouput in TID order.
 void				add_face(struct Mesh * mesh, const float p1[3], const float p2[3], const float p3[3], const float p4[3], const float color[4], int tid)
 {
-	#if SLOW_CHECKING
-	if(vec3f_length2(p1,p2) <= EPSI2) mesh->flags |= TINY_INITIAL_TRIANGLE;
-	if(p3)
+	if(mesh->stream)
+		stream_face(mesh->stream, p1, p2, p3, p4, color, tid);
+	else
+		insert_face(mesh, p1, p2, p3, p4, color, tid);
+}
+
+// Move a growable mesh's faces into its face and vertex arrays, now that it
+// is known how big they must be - polygons first, then lines, each in the
+// order they were added.
+static void place_streamed_faces(struct Mesh * mesh)
+{
+	struct FaceStream * stream = mesh->stream;
+	struct StreamBlock * b;
+	int pass, i;
+
+	free(mesh->vertices);
+	free(mesh->faces);
+
+	mesh->vertex_capacity = stream->tri_count * 3 + stream->quad_count * 4 + stream->line_count * 2 + stream->cond_line_count * 4;
+	mesh->vertices = (struct Vertex *) malloc(sizeof(struct Vertex) * mesh->vertex_capacity);
+	mesh->face_capacity = stream->tri_count + stream->quad_count + stream->line_count + stream->cond_line_count;
+	mesh->faces = (struct Face *) malloc(sizeof(struct Face) * mesh->face_capacity);
+	mesh->poly_count = stream->tri_count + stream->quad_count;
+	mesh->line_count = stream->line_count;
+	mesh->cond_line_count = stream->cond_line_count;
+	mesh->tri_count = stream->tri_count;
+	mesh->quad_count = stream->quad_count;
+
+	for(pass = 0; pass < 2; ++pass)
+	for(b = pass ? stream->line_head : stream->poly_head; b; b = b->next)
+	for(i = 0; i < b->count; ++i)
+	{
+		const struct StreamedFace * f = b->faces + i;
+		insert_face(mesh, f->points[0], f->points[1],
+					f->degree > 2 ? f->points[2] : NULL,
+					f->degree > 3 ? f->points[3] : NULL,
+					f->color, f->tid);
+	}
+
+	destroy_stream(stream);
+	mesh->stream = NULL;
+}
+
+// Add one face to the face and vertex arrays, which must have room for it.
+static void insert_face(struct Mesh * mesh, const float p1[3], const float p2[3], const float p3[3], const float p4[3], const float color[4], int tid)
+{
+	#if SLOW_CHECKING
+	if(vec3f_length2(p1,p2) <= EPSI2) mesh->flags |= TINY_INITIAL_TRIANGLE;
+	if(p3)
 	{
 		if(vec3f_length2(p1,p3) <= EPSI2) mesh->flags |= TINY_INITIAL_TRIANGLE;
 		if(vec3f_length2(p2,p3) <= EPSI2) mesh->flags |= TINY_INITIAL_TRIANGLE;
@@ -999,25 +1787,7 @@ void				add_face(struct Mesh * mesh, const float p1[3], const float p2[3], const
 	if(tid > mesh->highest_tid) 
 		mesh->highest_tid = tid;
 
-	bool is_polygon;
-#ifdef METAL
-	is_polygon = p3 != NULL && p4 == NULL;
-#else
-	is_polygon = p3 != NULL;
-#endif
-	if(is_polygon)
-	{
-		float	v1[3] = { p2[0]-p1[0],p2[1]-p1[1],p2[2]-p1[2]};
-		float	v2[3] = { p3[0]-p1[0],p3[1]-p1[1],p3[2]-p1[2]};
-		vec3_cross(f->normal,v1,v2);
-		vec3f_normalize(f->normal);
-	}
-	else
-	{
-		f->normal[0] = f->normal[2] = 0.0f;
-		f->normal[1] = 1.0f;
-	}
-	
+	// The face normal is computed by finish_faces_and_sort, for all faces at once.
 	f->degree = p4 ? 4 : (p3 ? 3 : 2);
 	
 	f->vertex[0] = mesh->vertices + mesh->vertex_count++;
@@ -1036,7 +1806,6 @@ void				add_face(struct Mesh * mesh, const float p1[3], const float p2[3], const
 
 	for(i = 0; i < f->degree; ++i)
 	{
-		vec3f_copy(f->vertex[i]->normal,f->normal);
 		vec4f_copy(f->vertex[i]->color,color);
 		f->vertex[i]->prev = f->vertex[i]->next = NULL;
 	}	
@@ -1108,20 +1877,167 @@ static void visit_vertex_to_snap(struct Vertex * v, void * ref)
 	}
 }
 
+// Utility: qsort comparator that puts the members of a snap ring back in
+// vertex-array order.
+static int compare_vertex_addresses(const void * lhs, const void * rhs)
+{
+	const struct Vertex * a = *(const struct Vertex * const *) lhs;
+	const struct Vertex * b = *(const struct Vertex * const *) rhs;
+	return (a > b) - (a < b);
+}
+
+// Whether a face gets a real normal.  Others (lines) get +Y.
+static inline int face_has_normal(const struct Face * f)
+{
+	return degree_is_polygon(f->degree);
+}
+
+// Sets the normal of a face and of each of its vertices.
+static inline void set_face_normal(struct Face * f, const float n[3])
+{
+	int i;
+	vec3f_copy(f->normal, n);
+	for(i = 0; i < f->degree; ++i)
+		vec3f_copy(f->vertex[i]->normal, n);
+}
+
+// Calculates the normal of one face from its first three corners, and starts
+// its vertices off with it.
+static void compute_face_normal(struct Face * fp)
+{
+	static const float up[3] = { 0.0f, 1.0f, 0.0f };
+	if(face_has_normal(fp))
+	{
+		float v1[3], v2[3], normal[3];
+		vec3f_diff(v1, fp->vertex[0]->location, fp->vertex[1]->location);
+		vec3f_diff(v2, fp->vertex[0]->location, fp->vertex[2]->location);
+		vec3_cross(normal, v1, v2);
+		vec3f_normalize(normal);
+		set_face_normal(fp, normal);
+	}
+	else
+		set_face_normal(fp, up);
+}
+
+// The same for every face.
+//
+// With SIMD, four faces go at a time: their corners are transposed into one
+// register of X, one of Y and one of Z (struct-of-arrays), so that every
+// instruction of the cross product and normalize works on all four faces.  The
+// square root and divide, which cost the most, are shared the same way.  The
+// arithmetic is that of vec3_cross and vec3f_normalize, op for op.
+static void compute_face_normals(struct Mesh * mesh)
+{
+	int f = 0;
+	
+#if MESH_SIMD
+	static const float up[3] = { 0.0f, 1.0f, 0.0f };
+	if(simd_enabled())
+	for(; f + 4 <= mesh->face_count; f += 4)
+	{
+		struct Face * faces = mesh->faces + f;
+		float corners[3][3][4] = { { { 0 } } };		// [corner][axis][face]
+		float normals[3][4];						// [axis][face]
+		simd4f p[3][3], e1[3], e2[3], n[3], len, inv;
+		int face, corner, axis;
+		
+		for(face = 0; face < 4; ++face)
+		if(faces[face].degree >= 3)
+		for(corner = 0; corner < 3; ++corner)
+		for(axis = 0; axis < 3; ++axis)
+			corners[corner][axis][face] = faces[face].vertex[corner]->location[axis];
+		
+		for(corner = 0; corner < 3; ++corner)
+		for(axis = 0; axis < 3; ++axis)
+			p[corner][axis] = simd4f_load(corners[corner][axis]);
+		
+		for(axis = 0; axis < 3; ++axis)
+		{
+			e1[axis] = simd4f_sub(p[1][axis], p[0][axis]);
+			e2[axis] = simd4f_sub(p[2][axis], p[0][axis]);
+		}
+		n[0] = simd4f_sub(simd4f_mul(e1[1], e2[2]), simd4f_mul(e1[2], e2[1]));
+		n[1] = simd4f_sub(simd4f_mul(e1[2], e2[0]), simd4f_mul(e1[0], e2[2]));
+		n[2] = simd4f_sub(simd4f_mul(e1[0], e2[1]), simd4f_mul(e1[1], e2[0]));
+		
+		len = simd4f_sqrt(simd4f_add(simd4f_add(simd4f_mul(n[0], n[0]), simd4f_mul(n[1], n[1])), simd4f_mul(n[2], n[2])));
+		inv = simd4f_div(simd4f_splat(1.0f), len);
+		for(axis = 0; axis < 3; ++axis)
+			simd4f_store(normals[axis], simd4f_select_nonzero(len, simd4f_mul(n[axis], inv), n[axis]));
+		
+		for(face = 0; face < 4; ++face)
+		{
+			float normal[3] = { normals[0][face], normals[1][face], normals[2][face] };
+			set_face_normal(faces + face, face_has_normal(faces + face) ? normal : up);
+		}
+	}
+#endif
+	
+	for(; f < mesh->face_count; ++f)
+		compute_face_normal(mesh->faces + f);
+}
+
+// A tri or quad with two corners in the same place is 'creased' on all sides,
+// sealing it off from the smoother (see finish_faces_and_sort).
+static void seal_if_degenerate(struct Face * f)
+{
+	if(f->degree == 3)
+	{
+		float * p1 = f->vertex[0]->location;
+		float * p2 = f->vertex[1]->location;
+		float * p3 = f->vertex[2]->location;
+		if (compare_points(p1,p2)==0 ||
+			compare_points(p2,p3)==0 ||
+			compare_points(p1,p3)==0)
+		{
+			f->neighbor[0] = 
+			f->neighbor[1] = 
+			f->neighbor[2] = 
+			f->neighbor[3] = NULL;
+		}
+
+	}
+	if(f->degree == 4)
+	{
+		float * p1 = f->vertex[0]->location;
+		float * p2 = f->vertex[1]->location;
+		float * p3 = f->vertex[2]->location;
+		float * p4 = f->vertex[3]->location;
+
+		if (compare_points(p1,p2)==0 ||
+			compare_points(p2,p3)==0 ||
+			compare_points(p1,p3)==0 ||
+			compare_points(p3,p4)==0 ||
+			compare_points(p2,p4)==0 ||
+			compare_points(p1,p4)==0)
+		{
+			f->neighbor[0] = 
+			f->neighbor[1] = 
+			f->neighbor[2] = 
+			f->neighbor[3] = NULL;
+		}
+	}
+}
+
 // This function does a bunch of post-geometry-adding processing:
+// 0. It calculates the face normals (see compute_face_normals).
 // 1. It sorts the vertices in XYZ order for correct indexing.  This
 // forces colocated vertices together in the list.
-// 2. It indexes vertices into an R-tree.
+// 2. It indexes vertices into an R-tree or spatial hash, per the mesh's 
+// weld_index.
 // 3. It performs a two-step snapping process by 
 // 3a. Locating rings of too-close vertices and
 // 3b. Setting each member of the ring to the ring's centroid location.
+// The centroid is summed in vertex order, not ring order, so that it comes
+// out the same no matter which index found the ring.
 // 4. Vertices are resorted AGAIN.
 // 5. The links from faces to vertices must be rebuilt due to sorting.
 // 6. Degenerate quads/tris are marked as 'creased' on all sides.
 //
 // Notes:
 // 2 and 4 are BOTH necessary - the first sort is needed to pre-sorted
-// the data for the R-tree interface.  
+// the data for the R-tree interface (and to find colocated ranges for the 
+// spatial hash).
 // The second sort is needed because the order of sort is ruined by 
 // changing XYZ geometry locations.
 //
@@ -1133,11 +2049,22 @@ void				finish_faces_and_sort(struct Mesh * mesh)
 {
 	int v, f;
 	int total_before = 0, total_after = 0;
+	struct Grid * grid = NULL;
+	struct Vertex ** ring = NULL;
+	int ring_capacity = 0;
+
+	if(mesh->stream)
+		place_streamed_faces(mesh);
+
+	compute_face_normals(mesh);
 
 	// sort vertices by 10 params
 	sort_vertices_3(mesh->vertices,mesh->vertex_count);
 
-	mesh->index = index_vertices(mesh->vertices,mesh->vertex_count);
+	if(mesh->weld_index == weld_index_grid)
+		grid = grid_index_vertices(mesh->vertices,mesh->vertex_count);
+	else
+		mesh->index = index_vertices(mesh->vertices,mesh->vertex_count);
 	
 	#if DEBUG
 	validate_vertex_sort_3(mesh);
@@ -1152,10 +2079,23 @@ void				finish_faces_and_sort(struct Mesh * mesh)
 			struct Vertex * vi = mesh->vertices + v;
 			float mib[3] = { vi->location[0] - EPSI, vi->location[1] - EPSI, vi->location[2] - EPSI };
 			float mab[3] = { vi->location[0] + EPSI, vi->location[1] + EPSI, vi->location[2] + EPSI };
-			scan_rtree(mesh->index, mib, mab, visit_vertex_to_snap, vi);
+			if(grid)
+				scan_grid_to_snap(grid, mesh->vertices, mib, mab, vi);
+			else
+				scan_rtree(mesh->index, mib, mab, visit_vertex_to_snap, vi);
 		}
 	}
 	
+	// Both indexes point into the vertex array, which the second sort below
+	// reorders, so neither outlives the snapping.
+	if(grid)
+		destroy_grid(grid);
+	if(mesh->index)
+	{
+		destroy_rtree(mesh->index);
+		mesh->index = NULL;
+	}
+	
 	for(v = 0; v < mesh->vertex_count; ++v)
 	if(v == 0 || compare_points(mesh->vertices[v-1].location,mesh->vertices[v].location) != 0)
 	if(mesh->vertices[v].prev == NULL)
@@ -1165,12 +2105,24 @@ void				finish_faces_and_sort(struct Mesh * mesh)
 			struct Vertex * i;
 			float count = 0.0f;
 			float p[3] = { 0 };
+			int ring_count = 0, r;
 			for(i=mesh->vertices+v;i;i=i->next)
+			{
+				if(ring_count == ring_capacity)
+				{
+					ring_capacity = MAX(ring_capacity * 2, 16);
+					ring = (struct Vertex **) realloc(ring, sizeof(struct Vertex *) * ring_capacity);
+				}
+				ring[ring_count++] = i;
+			}
+			qsort(ring, ring_count, sizeof(struct Vertex *), compare_vertex_addresses);
+			
+			for(r = 0; r < ring_count; ++r)
 			{
 				count += 1.0f;
-				p[0] += i->location[0];
-				p[1] += i->location[1];
-				p[2] += i->location[2];
+				p[0] += ring[r]->location[0];
+				p[1] += ring[r]->location[1];
+				p[2] += ring[r]->location[2];
 			}
 			
 			assert(count > 0.0f);
@@ -1204,6 +2156,7 @@ void				finish_faces_and_sort(struct Mesh * mesh)
 		
 		++total_after;
 	}
+	free(ring);
 	// printf("BEFORE: %d, AFTER: %d\n", total_before, total_after);
 
 	sort_vertices_3(mesh->vertices,mesh->vertex_count);
@@ -1215,44 +2168,7 @@ void				finish_faces_and_sort(struct Mesh * mesh)
 	}
 	
 	for(f = 0; f < mesh->face_count; ++f)
-	{
-		if(mesh->faces[f].degree == 3)
-		{
-			float * p1 = mesh->faces[f].vertex[0]->location;
-			float * p2 = mesh->faces[f].vertex[1]->location;
-			float * p3 = mesh->faces[f].vertex[2]->location;
-			if (compare_points(p1,p2)==0 ||
-				compare_points(p2,p3)==0 ||
-				compare_points(p1,p3)==0)
-			{
-				mesh->faces[f].neighbor[0] = 
-				mesh->faces[f].neighbor[1] = 
-				mesh->faces[f].neighbor[2] = 
-				mesh->faces[f].neighbor[3] = NULL;
-			}
-
-		}
-		if(mesh->faces[f].degree == 4)
-		{
-			float * p1 = mesh->faces[f].vertex[0]->location;
-			float * p2 = mesh->faces[f].vertex[1]->location;
-			float * p3 = mesh->faces[f].vertex[2]->location;
-			float * p4 = mesh->faces[f].vertex[3]->location;
-
-			if (compare_points(p1,p2)==0 ||
-				compare_points(p2,p3)==0 ||
-				compare_points(p1,p3)==0 ||
-				compare_points(p3,p4)==0 ||
-				compare_points(p2,p4)==0 ||
-				compare_points(p1,p4)==0)
-			{
-				mesh->faces[f].neighbor[0] = 
-				mesh->faces[f].neighbor[1] = 
-				mesh->faces[f].neighbor[2] = 
-				mesh->faces[f].neighbor[3] = NULL;
-			}
-		}
-	}
+		seal_if_degenerate(mesh->faces+f);
 
 	#if DEBUG
 	validate_vertex_sort_3(mesh);
@@ -1337,6 +2253,156 @@ void add_creases(struct Mesh * mesh)
 	}
 }
 
+// Joins edge i of face f to a matching, still-unjoined edge of another face, or
+// marks it as a crease if it has none.  This only ever looks at edges whose two
+// end points have the same locations as this one's.
+static void join_edge(struct Mesh * mesh, struct Face * f, int i)
+{
+	if(f->neighbor[i] == UNKNOWN_FACE)
+	{
+		//     CCW(i)/P1
+		//      /   \		The directed edge we want goes FROM i TO ccw.
+		//     /     i		So p2 = ccw, p1 = i, that is, we want our OTHER
+		//	  /       \		neighbor to go FROM cw TO CCW
+		//	 .---------i/P2
+
+		struct Vertex * p1 = f->vertex[CCW(f,i)];
+		struct Vertex * p2 = f->vertex[      i ];
+		struct Vertex * begin, * end, * v;
+//				range_for_point(mesh->vertices,mesh->vertex_count,&begin,&end,p1->location);
+		range_for_vertex(mesh->vertices,mesh->vertices + mesh->vertex_count,&begin,&end,p1);
+		for(v = begin; v != end; ++v)
+		{
+			if(v->face == f)
+				continue;
+				
+			//	P1/v-----x		Normal case - Since p1->p2 is the ideal direction of our
+			//    \     /		neighbor, p2 = ccw(v).  Thus p1(v) names our edge.
+			//     v   /		
+			//      \ /
+			//     P2/CCW(V)
+			
+			//	P1/v-----x		Backward winding case - thus p2 is CW from P1,
+			//    \     /		and P2 (cw(v) names our edge.
+			//   cw(v) /		
+			//      \ /
+			//     P2/CW(V)
+
+			
+			assert(compare_points(p1->location,v->location)==0);
+			
+			struct Face * n = v->face;
+#ifdef METAL
+			if (n->degree == 4) continue;	// skip conditional lines
+#endif
+			struct Vertex * dst = n->vertex[CCW(n,v->index)];
+			#if WANT_INVERTS
+			struct Vertex * inv = n->vertex[ CW(n,v->index)];
+			#endif
+			if(dst->face->degree > 2)
+			if(compare_points(dst->location,p2->location)==0)
+			{
+				int ni = v->index;
+				assert(f->neighbor[i] == UNKNOWN_FACE);
+				if(n->neighbor[ni] == UNKNOWN_FACE)
+				{	
+					#if WANT_CREASE
+					if(is_crease(f->normal,n->normal,false))
+					{
+						f->neighbor[i] = NULL;
+						n->neighbor[ni] = NULL;
+						f->index[i] = -1;
+						n->index[ni] = -1;
+						break;
+					}
+					else
+					#endif
+					{
+						// v->dst matches p1->p2.  We have neighbors.
+						// Store both - avoid half the work when we get to our neighbor.
+						f->neighbor[i] = n;
+						n->neighbor[ni] = f;
+						f->index[i] = ni;
+						n->index[ni] = i;
+						f->flip[i] = 0;
+						n->flip[ni] = 0;
+						break;
+					}							
+				}
+			}				
+			#if WANT_INVERTS
+			if(inv->face->degree > 2)
+			if(compare_points(inv->location,p2->location)==0)
+			{
+				int ni = CW(v->face,v->index);
+				assert(f->neighbor[i] == UNKNOWN_FACE);
+				if(n->neighbor[ni] == UNKNOWN_FACE)
+				{	
+					#if WANT_CREASE
+					if(is_crease(f->normal,n->normal,true))
+					{
+						f->neighbor[i] = NULL;
+						n->neighbor[ni] = NULL;
+						f->index[i] = -1;
+						n->index[ni] = -1;
+						break;
+					}
+					else
+					#endif
+					{
+						// v->dst matches p1->p2.  We have neighbors.
+						// Store both - avoid half the work when we get to our neighbor.
+						f->neighbor[i] = n;
+						n->neighbor[ni] = f;
+						f->index[i] = ni;
+						n->index[ni] = i;
+						f->flip[i] = 1;
+						n->flip[ni] = 1;
+						break;
+					}							
+				} 
+			}				
+			#endif
+
+		}			
+	}
+	if(f->neighbor[i] == UNKNOWN_FACE)
+	{
+		f->neighbor[i] = NULL;
+		f->index[i] = -1;
+	}
+}
+
+// Parallel joining.  Since join_edge only looks at edges between the same two
+// locations as the one it is given, edges can be split into buckets by their
+// end-point locations and each bucket joined on its own thread.  Within a bucket
+// the edges stay in the order the serial loop visits them, and that order is
+// all the result depends on.
+struct join_job {
+	struct Mesh *	mesh;
+	int *			edges;				// face index * 4 + side, grouped by bucket.
+	int *			bucket_starts;		// Bucket b is [bucket_starts[b], bucket_starts[b+1]).
+};
+
+static void join_bucket(void * ref, int bucket)
+{
+	struct join_job * job = (struct join_job *) ref;
+	int e;
+	for(e = job->bucket_starts[bucket]; e < job->bucket_starts[bucket+1]; ++e)
+		join_edge(job->mesh, job->mesh->faces + job->edges[e] / 4, job->edges[e] % 4);
+}
+
+// Picks the bucket for edge i of face f.  run_starts names each vertex's
+// location by the first vertex colocated with it; the edge's two locations are
+// hashed without regard to direction.
+static int bucket_for_edge(struct Mesh * mesh, const int * run_starts, struct Face * f, int i, int bucket_count)
+{
+	unsigned int a = (unsigned int) run_starts[f->vertex[     i ] - mesh->vertices];
+	unsigned int b = (unsigned int) run_starts[f->vertex[CCW(f,i)] - mesh->vertices];
+	unsigned int h = (MIN(a,b) * 0x9E3779B1u + MAX(a,b)) * 0x85EBCA77u;
+	return (int) ((h >> 16) % (unsigned int) bucket_count);
+}
+
 // Once all creases have been marked, this routine locates all colocated mesh
 // edges going in opposite directions (opposite direction colocated edges mean
 // the faces go in the same direction) that are not already marked as neighbors
@@ -1348,127 +2414,74 @@ void				finish_creases_and_join(struct Mesh * mesh)
 	int fi;
 	int i;
 	struct Face * f;
+	int thread_count = threads_for_mesh(mesh->vertex_count);
 	
-	for(fi = 0; fi < mesh->poly_count; ++fi)
+	if(thread_count > 1)
 	{
-		f = mesh->faces+fi;
-		assert(f->degree >= 3);
-		for(i = 0; i < f->degree; ++i)
+		int					bucket_count	= thread_count * 8;
+		int *				run_starts		= (int *) malloc(sizeof(int) * mesh->vertex_count);
+		int *				found_edges		= (int *) malloc(sizeof(int) * mesh->poly_count * 4);
+		int *				found_buckets	= (int *) malloc(sizeof(int) * mesh->poly_count * 4);
+		int *				cursors			= (int *) malloc(sizeof(int) * bucket_count);
+		int					found_count		= 0;
+		int					v, e, b;
+		struct join_job		job;
+		
+		job.mesh			= mesh;
+		job.edges			= (int *) malloc(sizeof(int) * mesh->poly_count * 4);
+		job.bucket_starts	= (int *) calloc(bucket_count + 1, sizeof(int));
+		
+		// Colocated vertices are adjacent, so the first of each run names
+		// its location.
+		for(v = 0; v < mesh->vertex_count; ++v)
 		{
+			if(v > 0 && compare_points(mesh->vertices[v-1].location,mesh->vertices[v].location) == 0)
+				run_starts[v] = run_starts[v-1];
+			else
+				run_starts[v] = v;
+		}
+		
+		// Bucket the edges that need joining, keeping them in face order.
+		for(fi = 0; fi < mesh->poly_count; ++fi)
+		{
+			f = mesh->faces+fi;
+			assert(f->degree >= 3);
+			for(i = 0; i < f->degree; ++i)
 			if(f->neighbor[i] == UNKNOWN_FACE)
 			{
-				//     CCW(i)/P1
-				//      /   \		The directed edge we want goes FROM i TO ccw.
-				//     /     i		So p2 = ccw, p1 = i, that is, we want our OTHER
-				//	  /       \		neighbor to go FROM cw TO CCW
-				//	 .---------i/P2
-
-				struct Vertex * p1 = f->vertex[CCW(f,i)];
-				struct Vertex * p2 = f->vertex[      i ];
-				struct Vertex * begin, * end, * v;
-//				range_for_point(mesh->vertices,mesh->vertex_count,&begin,&end,p1->location);
-				range_for_vertex(mesh->vertices,mesh->vertices + mesh->vertex_count,&begin,&end,p1);
-				for(v = begin; v != end; ++v)
-				{
-					if(v->face == f)
-						continue;
-						
-					//	P1/v-----x		Normal case - Since p1->p2 is the ideal direction of our
-					//    \     /		neighbor, p2 = ccw(v).  Thus p1(v) names our edge.
-					//     v   /		
-					//      \ /
-					//     P2/CCW(V)
-					
-					//	P1/v-----x		Backward winding case - thus p2 is CW from P1,
-					//    \     /		and P2 (cw(v) names our edge.
-					//   cw(v) /		
-					//      \ /
-					//     P2/CW(V)
-
-					
-					assert(compare_points(p1->location,v->location)==0);
-					
-					struct Face * n = v->face;
-#ifdef METAL
-					if (n->degree == 4) continue;	// skip conditional lines
-#endif
-					struct Vertex * dst = n->vertex[CCW(n,v->index)];
-					#if WANT_INVERTS
-					struct Vertex * inv = n->vertex[ CW(n,v->index)];
-					#endif
-					if(dst->face->degree > 2)
-					if(compare_points(dst->location,p2->location)==0)
-					{
-						int ni = v->index;
-						assert(f->neighbor[i] == UNKNOWN_FACE);
-						if(n->neighbor[ni] == UNKNOWN_FACE)
-						{	
-							#if WANT_CREASE
-							if(is_crease(f->normal,n->normal,false))
-							{
-								f->neighbor[i] = NULL;
-								n->neighbor[ni] = NULL;
-								f->index[i] = -1;
-								n->index[ni] = -1;
-								break;
-							}
-							else
-							#endif
-							{
-								// v->dst matches p1->p2.  We have neighbors.
-								// Store both - avoid half the work when we get to our neighbor.
-								f->neighbor[i] = n;
-								n->neighbor[ni] = f;
-								f->index[i] = ni;
-								n->index[ni] = i;
-								f->flip[i] = 0;
-								n->flip[ni] = 0;
-								break;
-							}							
-						}
-					}				
-					#if WANT_INVERTS
-					if(inv->face->degree > 2)
-					if(compare_points(inv->location,p2->location)==0)
-					{
-						int ni = CW(v->face,v->index);
-						assert(f->neighbor[i] == UNKNOWN_FACE);
-						if(n->neighbor[ni] == UNKNOWN_FACE)
-						{	
-							#if WANT_CREASE
-							if(is_crease(f->normal,n->normal,true))
-							{
-								f->neighbor[i] = NULL;
-								n->neighbor[ni] = NULL;
-								f->index[i] = -1;
-								n->index[ni] = -1;
-								break;
-							}
-							else
-							#endif
-							{
-								// v->dst matches p1->p2.  We have neighbors.
-								// Store both - avoid half the work when we get to our neighbor.
-								f->neighbor[i] = n;
-								n->neighbor[ni] = f;
-								f->index[i] = ni;
-								n->index[ni] = i;
-								f->flip[i] = 1;
-								n->flip[ni] = 1;
-								break;
-							}							
-						} 
-					}				
-					#endif
-
-				}			
-			}
-			if(f->neighbor[i] == UNKNOWN_FACE)
-			{
-				f->neighbor[i] = NULL;
-				f->index[i] = -1;
+				b = bucket_for_edge(mesh, run_starts, f, i, bucket_count);
+				found_edges[found_count] = fi * 4 + i;
+				found_buckets[found_count] = b;
+				++found_count;
+				++job.bucket_starts[b+1];
 			}
 		}
+		for(b = 0; b < bucket_count; ++b)
+		{
+			job.bucket_starts[b+1] += job.bucket_starts[b];
+			cursors[b] = job.bucket_starts[b];
+		}
+		for(e = 0; e < found_count; ++e)
+			job.edges[cursors[found_buckets[e]]++] = found_edges[e];
+		
+		run_parallel(thread_count, bucket_count, join_bucket, &job);
+		
+		free(job.bucket_starts);
+		free(job.edges);
+		free(cursors);
+		free(found_buckets);
+		free(found_edges);
+		free(run_starts);
+	}
+	else
+	{
+		for(fi = 0; fi < mesh->poly_count; ++fi)
+		{
+			f = mesh->faces+fi;
+			assert(f->degree >= 3);
+			for(i = 0; i < f->degree; ++i)
+				join_edge(mesh, f, i);
+		}
 	}
 
 	#if DEBUG
@@ -1500,6 +2513,107 @@ static float weight_for_vertex(struct Vertex * v)
 	return acos(d);
 }
 
+// Adds n, weighted by w, to the running normal sum N - or subtracts it if n
+// faces away from ref, which means the face is BFC-flipped from ours.
+// (Subtracting w*n is exactly adding -w*n, so both cases are one multiply-add.)
+//
+// N has a fourth, unused float so that the sum can be kept in one SIMD
+// register.  Loading four floats from a face normal picks up the face's red
+// as well, which only ever lands in that unused lane.
+_Static_assert(offsetof(struct Face, color) == offsetof(struct Face, normal) + 3 * sizeof(float),
+			   "a face's color must follow its normal, so a four-float load of the normal stays inside the face");
+
+static inline void accumulate_normal(float N[4], const float ref[3], const float n[3], float w)
+{
+	if(!(vec3f_dot(ref,n) > 0.0))
+		w = -w;
+#if MESH_SIMD
+	if(simd_enabled())
+	{
+		simd4f_store(N, simd4f_add(simd4f_load(N), simd4f_mul(simd4f_splat(w), simd4f_load(n))));
+		return;
+	}
+#endif
+	N[0] += w*n[0];
+	N[1] += w*n[1];
+	N[2] += w*n[2];
+}
+
+// Smooths one vertex: see smooth_vertices.  This only writes the normal of v
+// itself, and only reads face normals and neighbors, so vertices can be
+// smoothed in any order, or all at once.
+static void smooth_vertex(struct Vertex * v)
+{
+	// For each vertex, we are going to circulate around attached faces, averaging up our normals.
+
+	// First, go clock-wise around, starting at ourselves, until we loop back on ourselves (a closed smooth
+	// circuite - the center vert on a stud top is like this) or we run out of vertices.
+	
+	struct Vertex * c = v;
+	float N[4] = { 0 };
+	int ctr = 0;
+	int circ_dir = -1;
+	float w;
+	do {
+		++ctr;
+		//printf("\tAdd: %f,%f,%f\n",c->normal[0],c->normal[1],c->normal[2]);
+		
+		w = weight_for_vertex(c);
+		
+		accumulate_normal(N, v->face->normal, c->face->normal, w);
+	
+		c = circulate_any(c,&circ_dir);
+
+	} while(c != NULL && c != v);
+	
+	// Now if we did NOT make it back to ourselves it means we are a disconnected circulation.  For example
+	// a semi-circle fan's center will do this if we start from a middle tri.
+	// Circulate in the OTHER direction, skipping ourselves, until we run out.
+	
+	if(c != v)
+	{
+		circ_dir = 1;
+		c = circulate_any(v,&circ_dir);
+		while(c)
+		{
+			++ctr;
+			//printf("\tAdd: %f,%f,%f\n",c->normal[0],c->normal[1],c->normal[2]);
+			w = weight_for_vertex(c);
+			accumulate_normal(N, v->face->normal, c->face->normal, w);
+	
+			c = circulate_any(c,&circ_dir);		
+			
+			// Invariant: if we did NOT close-loop up top, we should NOT close-loop down here - that would imply
+			// a triangulation where our neighbor info was assymetric, which would be "bad".
+			assert(c != v);		
+		}
+	}
+	
+	vec3f_normalize(N);
+	//printf("Final: %f %f %f\t%f %f %f (%d)\n",v->location[0],v->location[1], v->location[2], N[0],N[1],N[2], ctr);
+	v->normal[0] = N[0];
+	v->normal[1] = N[1];
+	v->normal[2] = N[2];
+	#if DEBUG_SHOW_NORMALS_AS_COLOR
+	v->color[0] = N[0] * 0.5 + 0.5;
+	v->color[1] = N[1] * 0.5 + 0.5;
+	v->color[2] = N[2] * 0.5 + 0.5;
+	v->color[3] = 1.0f;
+	#endif
+}
+
+// Parallel smoothing: each thread takes a run of faces at a time.
+static void smooth_vertices_in_chunk(void * ref, int chunk)
+{
+	struct Mesh * mesh = (struct Mesh *) ref;
+	int f = chunk * PARALLEL_FACE_GRAIN;
+	int stop = MIN(f + PARALLEL_FACE_GRAIN, mesh->poly_count);
+	int i;
+	for(; f < stop; ++f)
+	for(i = 0; i < mesh->faces[f].degree; ++i)
+		smooth_vertex(mesh->faces[f].vertex[i]);
+}
+
 // Once all neighbors have been found, this routine calculates the
 // actual per-vertex smooth normals.  This is done by circulating
 // each vertex (via its neighbors) to find all contributing triangles,
@@ -1520,91 +2634,18 @@ void				smooth_vertices(struct Mesh * mesh)
 {
 	int f;
 	int i;
-	for(f = 0; f < mesh->poly_count; ++f)
-	for(i = 0; i < mesh->faces[f].degree; ++i)
-	{
-		// For each vertex, we are going to circulate around attached faces, averaging up our normals.
+	int thread_count = threads_for_mesh(mesh->vertex_count);
 	
-		struct Vertex * v = mesh->faces[f].vertex[i];
-		
-		// First, go clock-wise around, starting at ourselves, until we loop back on ourselves (a closed smooth
-		// circuite - the center vert on a stud top is like this) or we run out of vertices.
-		
-		struct Vertex * c = v;
-		float N[3] = { 0 };
-		int ctr = 0;
-		int circ_dir = -1;
-		float w;
-		do {
-			++ctr;
-			//printf("\tAdd: %f,%f,%f\n",c->normal[0],c->normal[1],c->normal[2]);
-			
-			w = weight_for_vertex(c);
-			
-			if(vec3f_dot(v->face->normal,c->face->normal) > 0.0)
-			{
-				N[0] += w*c->face->normal[0];
-				N[1] += w*c->face->normal[1];
-				N[2] += w*c->face->normal[2];
-			}
-			else
-			{
-				N[0] -= w*c->face->normal[0];
-				N[1] -= w*c->face->normal[1];
-				N[2] -= w*c->face->normal[2];
-			}
-		
-			c = circulate_any(c,&circ_dir);
-
-		} while(c != NULL && c != v);
-		
-		// Now if we did NOT make it back to ourselves it means we are a disconnected circulation.  For example
-		// a semi-circle fan's center will do this if we start from a middle tri.
-		// Circulate in the OTHER direction, skipping ourselves, until we run out.
-		
-		if(c != v)
-		{
-			circ_dir = 1;
-			c = circulate_any(v,&circ_dir);
-			while(c)
-			{
-				++ctr;
-				//printf("\tAdd: %f,%f,%f\n",c->normal[0],c->normal[1],c->normal[2]);
-				w = weight_for_vertex(c);
-				if(vec3f_dot(v->face->normal,c->face->normal) > 0.0)
-				{
-					N[0] += w*c->face->normal[0];
-					N[1] += w*c->face->normal[1];
-					N[2] += w*c->face->normal[2];
-				}
-				else
-				{
-					N[0] -= w*c->face->normal[0];
-					N[1] -= w*c->face->normal[1];
-					N[2] -= w*c->face->normal[2];
-				}
-		
-				c = circulate_any(c,&circ_dir);		
-				
-				// Invariant: if we did NOT close-loop up top, we should NOT close-loop down here - that would imply
-				// a triangulation where our neighbor info was assymetric, which would be "bad".
-				assert(c != v);		
-			}
-		}
-		
-		vec3f_normalize(N);
-		//printf("Final: %f %f %f\t%f %f %f (%d)\n",v->location[0],v->location[1], v->location[2], N[0],N[1],N[2], ctr);
-		v->normal[0] = N[0];
-		v->normal[1] = N[1];
-		v->normal[2] = N[2];
-		#if DEBUG_SHOW_NORMALS_AS_COLOR
-		v->color[0] = N[0] * 0.5 + 0.5;
-		v->color[1] = N[1] * 0.5 + 0.5;
-		v->color[2] = N[2] * 0.5 + 0.5;
-		v->color[3] = 1.0f;
-		#endif
-		
+	if(thread_count > 1)
+	{
+		run_parallel(thread_count, (mesh->poly_count + PARALLEL_FACE_GRAIN - 1) / PARALLEL_FACE_GRAIN,
+					 smooth_vertices_in_chunk, mesh);
+		return;
 	}
+	
+	for(f = 0; f < mesh->poly_count; ++f)
+	for(i = 0; i < mesh->faces[f].degree; ++i)
+		smooth_vertex(mesh->faces[f].vertex[i]);
 }
 
 // This routine merges vertices that have the same complete (10-float)
@@ -1639,7 +2680,7 @@ void				merge_vertices(struct Mesh * mesh)
 	// Re-set the tri ptrs again, but...for each IDENTICAL source vertex, use the FIRST of them as the ptr
 	for(v = 0; v < mesh->vertex_count; ++v)
 	{
-		if(compare_vertices(first_of_equals, mesh->vertices+v) != 0)
+		if(!vertices_equal(first_of_equals, mesh->vertices+v))
 		{
 			first_of_equals = mesh->vertices+v;
 		}
@@ -1682,7 +2723,8 @@ void				destroy_mesh(struct Mesh * mesh)
 	#endif
 	#endif
 
-	destroy_rtree(mesh->index);
+	if(mesh->index)
+		destroy_rtree(mesh->index);
 	
 	for(f = 0; f < mesh->face_count; ++f)
 	{
@@ -1700,6 +2742,9 @@ void				destroy_mesh(struct Mesh * mesh)
 		}
 	}
 	
+	if(mesh->stream)
+		destroy_stream(mesh->stream);
+	free(mesh->draw_order);
 	free(mesh->vertices);
 	free(mesh->faces);
 	free(mesh);
@@ -1769,10 +2814,20 @@ void				write_indexed_mesh(
 	{
 		starts[d][ti] = (int)(index_ptr - io_index_table);
 		
-		for(vi = 0; vi < mesh->vertex_count; ++vi)
+		// With a draw order, polygons go in that order, and vertices still
+		// go in order of first use - which is also the best order to fetch them.
+		int use_draw_order = mesh->draw_order != NULL && degree_is_polygon(d);
+		int walk_count = use_draw_order ? mesh->draw_order_count : mesh->vertex_count;
+		
+		for(vi = 0; vi < walk_count; ++vi)
 		{
-			v = mesh->vertices+vi;
-			f = v->face;
+			if(use_draw_order)
+				f = mesh->draw_order[vi];
+			else
+			{
+				v = mesh->vertices+vi;
+				f = v->face;
+			}
 
 			// For each vertex, we look at its face if it qualifies.
 			// This way we write the faces in sorted vertex order.
@@ -1817,7 +2872,7 @@ void				write_indexed_mesh(
 
 			} // end of face write-out for matched faces
 			
-		} // end of linear vertex walk
+		} // end of linear vertex (or draw order) walk
 
 		counts[d][ti] = (int)(index_ptr - io_index_table) - starts[d][ti];
 	
@@ -1828,17 +2883,1063 @@ void				write_indexed_mesh(
 	assert(index_ptr == index_stop);
 }
 
-
-
-
-
 #pragma mark -
 //==============================================================================
-//	T JUNCTION REMOVAL
+//	COMPACT OUTPUT
 //==============================================================================
-
-// This code attempts to remove "T" junctions from a mesh.  Since an ASCII 
-// picture is worth 1000 words...
+//
+//	write_indexed_mesh's 10-float vertices are 40 bytes, most of it precision
+//	nobody can see.  A compact vertex is 16:
+//
+//	- The position is quantized to 16 bits per axis across the mesh's bounding
+//	  box.  Even a big baseplate's box is under 2000 LDU, so the error stays
+//	  below 0.02 LDU.
+//	- The normal is octahedral-encoded in two signed 16-bit values: the unit
+//	  sphere is projected onto the octahedron |x|+|y|+|z| = 1, whose lower half
+//	  is folded out over the corners of the square.  Lines have a zero normal,
+//	  which the octahedron can't hold, so the position's fourth value is 0 for
+//	  them and 65535 otherwise.
+//	- The color is RGBA8.  LDraw colors are 8-bit anyway; and the meta-color
+//	  flag (alpha 0) and the current/complement choice (red 0 or 1) survive
+//	  exactly.
+//
+//	The shaders undo all of this; decode_compact_vertices does the same on the
+//	CPU for tools and tests.
+
+// Quantizes v in [0,1] to 0...max.
+static inline int quantize_unit(float v, int max)
+{
+	if(v <= 0.0f) return 0;
+	if(v >= 1.0f) return max;
+	return (int) lrintf(v * (float) max);
+}
+
+// Quantizes v in [-1,1] to -32767...32767.
+static inline short quantize_signed_unit(float v)
+{
+	if(v <= -1.0f) return -32767;
+	if(v >= 1.0f) return 32767;
+	return (short) lrintf(v * 32767.0f);
+}
+
+void				get_compact_bounds(
+							const volatile float *		vertex_table,
+							int							vertex_count,
+							struct compact_bounds *		out_bounds)
+{
+	float lo[3] = { 0.0f, 0.0f, 0.0f };
+	float hi[3] = { 0.0f, 0.0f, 0.0f };
+	int v, a;
+
+	for(v = 0; v < vertex_count; ++v)
+	for(a = 0; a < 3; ++a)
+	{
+		float c = vertex_table[v * 10 + a];
+		if(v == 0 || c < lo[a]) lo[a] = c;
+		if(v == 0 || c > hi[a]) hi[a] = c;
+	}
+
+	for(a = 0; a < 3; ++a)
+	{
+		out_bounds->offset[a] = lo[a];
+		// A flat axis still needs a scale that we can divide by.
+		out_bounds->scale[a] = (hi[a] > lo[a]) ? hi[a] - lo[a] : 1.0f;
+	}
+}
+
+void				write_compact_vertices(
+							const volatile float *		vertex_table,
+							int							vertex_count,
+							const struct compact_bounds * bounds,
+							volatile struct compact_vertex * out_vertices)
+{
+	int v, a;
+
+	for(v = 0; v < vertex_count; ++v)
+	{
+		const volatile float * src = vertex_table + v * 10;
+		volatile struct compact_vertex * dst = out_vertices + v;
+		float n[3] = { src[3], src[4], src[5] };
+		float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+
+		for(a = 0; a < 3; ++a)
+			dst->position[a] = (unsigned short) quantize_unit((src[a] - bounds->offset[a]) / bounds->scale[a], 65535);
+
+		if(l1 > 0.0f)
+		{
+			float x = n[0] / l1;
+			float y = n[1] / l1;
+			if(n[2] < 0.0f)
+			{
+				float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+				float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+				x = fx;
+				y = fy;
+			}
+			dst->position[3] = 65535;
+			dst->normal[0] = quantize_signed_unit(x);
+			dst->normal[1] = quantize_signed_unit(y);
+		}
+		else
+		{
+			dst->position[3] = 0;
+			dst->normal[0] = 0;
+			dst->normal[1] = 0;
+		}
+
+		for(a = 0; a < 4; ++a)
+			dst->color[a] = (unsigned char) quantize_unit(src[6 + a], 255);
+	}
+}
+
+void				decode_compact_vertices(
+							const struct compact_vertex * vertices,
+							int							vertex_count,
+							const struct compact_bounds * bounds,
+							float *						out_vertex_table)
+{
+	int v, a;
+
+	for(v = 0; v < vertex_count; ++v)
+	{
+		const struct compact_vertex * src = vertices + v;
+		float * dst = out_vertex_table + v * 10;
+
+		for(a = 0; a < 3; ++a)
+			dst[a] = bounds->offset[a] + (float) src->position[a] / 65535.0f * bounds->scale[a];
+
+		if(src->position[3])
+		{
+			float x = (float) src->normal[0] / 32767.0f;
+			float y = (float) src->normal[1] / 32767.0f;
+			float z = 1.0f - fabsf(x) - fabsf(y);
+			float len;
+			if(z < 0.0f)
+			{
+				float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+				float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+				x = fx;
+				y = fy;
+			}
+			len = sqrtf(x * x + y * y + z * z);
+			dst[3] = x / len;
+			dst[4] = y / len;
+			dst[5] = z / len;
+		}
+		else
+		{
+			dst[3] = dst[4] = dst[5] = 0.0f;
+		}
+
+		for(a = 0; a < 4; ++a)
+			dst[6 + a] = (float) src->color[a] / 255.0f;
+	}
+}
+
+int					get_compact_index_size(int vertex_count)
+{
+	return (vertex_count <= 65536) ? 2 : 4;
+}
+
+void				write_compact_indices(
+							const volatile unsigned int * index_table,
+							int							index_count,
+							int							index_size,
+							volatile void *				out_indices)
+{
+	int i;
+
+	if(index_size == 2)
+	{
+		// Front to back, so that this works in place: we never write past
+		// what we have read.
+		volatile unsigned short * dst = (volatile unsigned short *) out_indices;
+		for(i = 0; i < index_count; ++i)
+			dst[i] = (unsigned short) index_table[i];
+	}
+	else if((const volatile void *) index_table != out_indices)
+	{
+		volatile unsigned int * dst = (volatile unsigned int *) out_indices;
+		for(i = 0; i < index_count; ++i)
+			dst[i] = index_table[i];
+	}
+}
+
+#pragma mark -
+//==============================================================================
+//	VERTEX CACHE OPTIMIZATION
+//==============================================================================
+//
+//	The GPU keeps the last few vertices it transformed in a small cache; a
+//	vertex used again while it is still there isn't transformed again.  Writing
+//	polygons in vertex order (as write_indexed_mesh does by default) keeps
+//	neighbors fairly close, but sweeps back and forth across the mesh, so most
+//	vertices have fallen out of the cache by the time their next polygon comes.
+//
+//	optimize_vertex_cache reorders each TID's tris and quads with Tom Forsyth's
+//	"Linear-Speed Vertex Cache Optimisation": each vertex is scored by how
+//	recently it was used (per a modeled LRU cache) and by how few of its
+//	polygons are left to write, and we greedily write the polygon whose
+//	vertices score highest.
+//
+//	Quads are scored as one polygon of four vertices.  The GPU splits them into
+//	two triangles sharing an edge, so they want all four vertices cached
+//	together anyway.
+
+// Size of the modeled LRU cache.  Forsyth finds that optimizing for 32 does
+// well on real caches of any size.
+#define VCACHE_SIZE 32
+
+// Score tuning, from the paper.
+#define VCACHE_DECAY_POWER 1.5f
+#define VCACHE_LAST_PRIM_SCORE 0.75f
+#define VCACHE_VALENCE_BOOST_SCALE 2.0f
+#define VCACHE_VALENCE_BOOST_POWER 0.5f
+
+// Valences we keep a precomputed score for; higher ones are rare.
+#define VCACHE_MAX_VALENCE 64
+
+struct vcache_vertex {
+	int		first_prim;				// Our polygons are prims[first_prim, first_prim + prim_count).
+	int		prim_count;
+	int		remaining;				// How many of our polygons are not yet written.
+	int		cache_pos;				// Position in the modeled cache, or -1.
+	float	score;
+};
+
+struct vcache_tables {
+	float	position[VCACHE_SIZE];			// Score for each cache position.
+	float	valence[VCACHE_MAX_VALENCE + 1];	// Score for each remaining-polygon count.
+};
+
+static void vcache_init_tables(struct vcache_tables * t, int degree)
+{
+	int i;
+	for(i = 0; i < VCACHE_SIZE; ++i)
+	{
+		// The vertices of the last polygon get a fixed score, so that we don't
+		// prefer any one of its edges.
+		if(i < degree)
+			t->position[i] = VCACHE_LAST_PRIM_SCORE;
+		else
+			t->position[i] = powf(1.0f - (float) (i - degree) / (float) (VCACHE_SIZE - degree), VCACHE_DECAY_POWER);
+	}
+	t->valence[0] = 0.0f;
+	for(i = 1; i <= VCACHE_MAX_VALENCE; ++i)
+		t->valence[i] = VCACHE_VALENCE_BOOST_SCALE * powf((float) i, -VCACHE_VALENCE_BOOST_POWER);
+}
+
+static inline float vcache_score(const struct vcache_tables * t, const struct vcache_vertex * v)
+{
+	float score;
+	if(v->remaining == 0)
+		return -1.0f;
+	score = v->cache_pos >= 0 ? t->position[v->cache_pos] : 0.0f;
+	if(v->remaining <= VCACHE_MAX_VALENCE)
+		return score + t->valence[v->remaining];
+	return score + VCACHE_VALENCE_BOOST_SCALE * powf((float) v->remaining, -VCACHE_VALENCE_BOOST_POWER);
+}
+
+// Reorders faces[0, count), all of the same degree, in place.  verts has an
+// entry per mesh vertex and must be zeroed; it is left zeroed.
+static void vcache_optimize_group(struct Mesh * mesh, struct Face ** faces, int count, int degree, struct vcache_vertex * verts)
+{
+	struct vcache_tables tables;
+	int * touched = (int *) malloc(sizeof(int) * count * degree);
+	int * prims = (int *) malloc(sizeof(int) * count * degree);
+	float * prim_score = (float *) malloc(sizeof(float) * count);
+	char * written = (char *) calloc(count, 1);
+	struct Face ** out = (struct Face **) malloc(sizeof(struct Face *) * count);
+	int cache[VCACHE_SIZE + 4];
+	int new_cache[VCACHE_SIZE + 4];
+	int cache_count = 0;
+	int touched_count = 0;
+	int out_count = 0;
+	int cursor = 0;
+	int best = -1;
+	int p, i, j, k, t;
+
+	vcache_init_tables(&tables, degree);
+
+	// Build each vertex's list of polygons.
+	for(p = 0; p < count; ++p)
+	for(i = 0; i < degree; ++i)
+	{
+		int id = (int) (faces[p]->vertex[i] - mesh->vertices);
+		if(verts[id].prim_count++ == 0)
+			touched[touched_count++] = id;
+	}
+	for(t = 0, k = 0; t < touched_count; ++t)
+	{
+		struct vcache_vertex * v = verts + touched[t];
+		v->first_prim = k;
+		k += v->prim_count;
+		v->cache_pos = -1;
+	}
+	for(p = 0; p < count; ++p)
+	for(i = 0; i < degree; ++i)
+	{
+		struct vcache_vertex * v = verts + (faces[p]->vertex[i] - mesh->vertices);
+		prims[v->first_prim + v->remaining++] = p;
+	}
+	for(t = 0; t < touched_count; ++t)
+		verts[touched[t]].score = vcache_score(&tables, verts + touched[t]);
+
+	for(p = 0; p < count; ++p)
+	{
+		prim_score[p] = 0.0f;
+		for(i = 0; i < degree; ++i)
+			prim_score[p] += verts[faces[p]->vertex[i] - mesh->vertices].score;
+		if(best < 0 || prim_score[p] > prim_score[best])
+			best = p;
+	}
+
+	while(out_count < count)
+	{
+		int new_count = 0;
+		
+		// Nothing in the cache has polygons left: take the next polygon in
+		// the original order.
+		if(best < 0)
+		{
+			while(written[cursor])
+				++cursor;
+			best = cursor;
+		}
+		
+		out[out_count++] = faces[best];
+		written[best] = 1;
+		
+		// Its vertices go to the front of the cache, followed by the rest of
+		// the old cache; anything past the end falls out.
+		for(i = 0; i < degree; ++i)
+		{
+			int id = (int) (faces[best]->vertex[i] - mesh->vertices);
+			for(j = 0; j < new_count; ++j)
+			if(new_cache[j] == id)
+				break;
+			if(j == new_count)
+				new_cache[new_count++] = id;
+			--verts[id].remaining;
+		}
+		for(j = 0; j < cache_count; ++j)
+		{
+			for(k = 0; k < new_count; ++k)
+			if(new_cache[k] == cache[j])
+				break;
+			if(k == new_count)
+				new_cache[new_count++] = cache[j];
+		}
+		
+		// Rescore everything whose position changed, and pass the change on
+		// to its unwritten polygons, noting the best of them.
+		best = -1;
+		for(j = 0; j < new_count; ++j)
+		{
+			struct vcache_vertex * v = verts + new_cache[j];
+			float old_score = v->score;
+			v->cache_pos = j < VCACHE_SIZE ? j : -1;
+			v->score = vcache_score(&tables, v);
+			for(k = v->first_prim; k < v->first_prim + v->prim_count; ++k)
+			if(!written[prims[k]])
+			{
+				prim_score[prims[k]] += v->score - old_score;
+				if(best < 0 || prim_score[prims[k]] > prim_score[best])
+					best = prims[k];
+			}
+		}
+		
+		cache_count = MIN(new_count, VCACHE_SIZE);
+		memcpy(cache, new_cache, sizeof(int) * cache_count);
+	}
+
+	memcpy(faces, out, sizeof(struct Face *) * count);
+	
+	for(t = 0; t < touched_count; ++t)
+		memset(verts + touched[t], 0, sizeof(struct vcache_vertex));
+	
+	free(touched);
+	free(prims);
+	free(prim_score);
+	free(written);
+	free(out);
+}
+
+// This optionally reorders the polygons of a merged mesh for the GPU's vertex
+// cache; call it after merge_vertices and before write_indexed_mesh.  Each TID's
+// tris and quads are still written together - only their order within that
+// group changes.  Since write_indexed_mesh numbers vertices in order of first
+// use, the vertex table comes out in the matching fetch order by itself.
+void				optimize_vertex_cache(struct Mesh * mesh)
+{
+	struct vcache_vertex * verts = (struct vcache_vertex *) calloc(MAX(mesh->vertex_count,1), sizeof(struct vcache_vertex));
+	char * taken = (char *) calloc(MAX(mesh->face_count,1), 1);
+	int ti, d, vi, count = 0;
+	
+	free(mesh->draw_order);
+	mesh->draw_order = (struct Face **) malloc(sizeof(struct Face *) * MAX(mesh->face_count,1));
+	
+	// Start from the order write_indexed_mesh would use, grouped the same way.
+	for(ti = 0; ti <= mesh->highest_tid; ++ti)
+	for(d = 3; d <= 4; ++d)
+	if(degree_is_polygon(d))
+	{
+		int group_start = count;
+		for(vi = 0; vi < mesh->vertex_count; ++vi)
+		{
+			struct Face * f = mesh->vertices[vi].face;
+			if(f->degree == d && f->tid == ti && !taken[f - mesh->faces])
+			{
+				taken[f - mesh->faces] = 1;
+				mesh->draw_order[count++] = f;
+			}
+		}
+		if(count > group_start)
+			vcache_optimize_group(mesh, mesh->draw_order + group_start, count - group_start, d, verts);
+	}
+	
+	mesh->draw_order_count = count;
+	free(taken);
+	free(verts);
+}
+
+
+
+
+
+#pragma mark -
+//==============================================================================
+//	DETAIL LEVELS
+//==============================================================================
+//
+//	simplify_indexed_mesh makes a coarser copy of a finished mesh, for drawing
+//	it small, with Garland and Heckbert's quadric error metric: every position
+//	keeps a quadric that sums the squared distances to the planes of the
+//	triangles around it, and we keep collapsing whichever edge costs least -
+//	moving one end onto the other and adding its quadric in - until the
+//	cheapest collapse would move the surface further than the caller allows.
+//
+//	A few rules keep the part looking like itself:
+//
+//	- Collapses move a position onto a neighbor that already exists, so every
+//	  surviving corner can be pointed back at one of the mesh's own vertices
+//	  (the one of the same color whose normal is closest).  The simplified
+//	  mesh is just more indices into the same vertex table.
+//	- Where the two sides of an edge don't share vertices - a crease, a color
+//	  change, the rim of an open surface - each side adds the plane through
+//	  the edge, perpendicular to itself.  Sliding along the edge is free;
+//	  leaving it costs the distance, so creases and color boundaries stay put.
+//	- Lines add the squared distance to themselves, and a position on a line
+//	  may only collapse onto another position on a line.  Lines get shorter
+//	  but never wander.  Conditional lines just follow their positions.
+//	- A collapse that would turn a triangle over (or nearly) is refused.
+//
+//	The cost of a position only grows as collapses pile onto it, and a sum of
+//	squared distances overstates the largest one, so the limit errs on the
+//	safe side.
+
+// A collapse is refused if it turns any triangle's normal further than this
+// (as a cosine) from where it was.
+#define LOD_MIN_FLIP_COS 0.5
+
+// Normals closer than this (as a cosine) are the same normal.
+#define LOD_SAME_NORMAL_COS 0.9999
+
+struct lod_vertex {
+	float	xyz[3];
+	int		vertex;
+};
+
+struct lod_position {
+	double	q[10];				// Quadric: xx xy xz xw yy yz yw zz zw ww.
+	float	xyz[3];
+	int *	tris;				// Triangles using us; collapsed ones are left in.
+	int		tri_count;
+	int		tri_capacity;
+	int		version;			// Bumped whenever we collapse or are collapsed onto.
+	int		collapsed_to;		// Where we went, or -1.
+	int		on_line;
+	int		first_vertex;		// Our vertices are sorted[first_vertex, first_vertex + vertex_count).
+	int		vertex_count;
+};
+
+struct lod_tri {
+	int		pos[3];
+	int		vertex[3];			// The original corners, to pick vertices by at the end.
+	int		alive;
+};
+
+struct lod_half_edge {
+	int		lo, hi;				// Sort key: the edge's positions, smaller first.
+	int		tri;
+	int		corner;				// The edge runs from this corner of tri to the next.
+};
+
+struct lod_candidate {
+	double	cost;
+	int		from, to;
+	int		from_version, to_version;
+};
+
+struct lod_state {
+	struct lod_vertex *		sorted;
+	struct lod_position *	positions;
+	struct lod_tri *		tris;
+	struct lod_candidate *	heap;
+	int						heap_count;
+	int						heap_capacity;
+	double					limit;			// max_error squared.
+};
+
+static void lod_add_plane(double q[10], double a, double b, double c, double d)
+{
+	q[0] += a * a;	q[1] += a * b;	q[2] += a * c;	q[3] += a * d;
+	q[4] += b * b;	q[5] += b * c;	q[6] += b * d;
+	q[7] += c * c;	q[8] += c * d;
+	q[9] += d * d;
+}
+
+static double lod_evaluate(const double q[10], const float p[3])
+{
+	double x = p[0], y = p[1], z = p[2];
+	return	q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x +
+			q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y +
+			q[7] * z * z + 2.0 * q[8] * z +
+			q[9];
+}
+
+// Unnormalized normal of the triangle a b c.
+static void lod_tri_normal(const float a[3], const float b[3], const float c[3], double n[3])
+{
+	double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	n[0] = u[1] * v[2] - u[2] * v[1];
+	n[1] = u[2] * v[0] - u[0] * v[2];
+	n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+static int lod_compare_vertex(const void * lhs, const void * rhs)
+{
+	const struct lod_vertex * a = (const struct lod_vertex *) lhs;
+	const struct lod_vertex * b = (const struct lod_vertex *) rhs;
+	int i;
+	for(i = 0; i < 3; ++i)
+	{
+		if(a->xyz[i] < b->xyz[i]) return -1;
+		if(a->xyz[i] > b->xyz[i]) return 1;
+	}
+	return a->vertex - b->vertex;
+}
+
+static int lod_compare_half_edge(const void * lhs, const void * rhs)
+{
+	const struct lod_half_edge * a = (const struct lod_half_edge *) lhs;
+	const struct lod_half_edge * b = (const struct lod_half_edge *) rhs;
+	if(a->lo != b->lo) return a->lo - b->lo;
+	if(a->hi != b->hi) return a->hi - b->hi;
+	return a->tri - b->tri;
+}
+
+static void lod_add_tri_ref(struct lod_position * p, int tri)
+{
+	if(p->tri_count == p->tri_capacity)
+	{
+		p->tri_capacity = p->tri_capacity ? p->tri_capacity * 2 : 8;
+		p->tris = (int *) realloc(p->tris, sizeof(int) * p->tri_capacity);
+	}
+	p->tris[p->tri_count++] = tri;
+}
+
+static int lod_find(const struct lod_state * s, int p)
+{
+	while(s->positions[p].collapsed_to >= 0)
+		p = s->positions[p].collapsed_to;
+	return p;
+}
+
+static void lod_heap_push(struct lod_state * s, const struct lod_candidate * c)
+{
+	int i;
+	if(s->heap_count == s->heap_capacity)
+	{
+		s->heap_capacity = s->heap_capacity ? s->heap_capacity * 2 : 256;
+		s->heap = (struct lod_candidate *) realloc(s->heap, sizeof(struct lod_candidate) * s->heap_capacity);
+	}
+	i = s->heap_count++;
+	while(i > 0 && s->heap[(i - 1) / 2].cost > c->cost)
+	{
+		s->heap[i] = s->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	s->heap[i] = *c;
+}
+
+static struct lod_candidate lod_heap_pop(struct lod_state * s)
+{
+	struct lod_candidate top = s->heap[0];
+	struct lod_candidate last = s->heap[--s->heap_count];
+	int i = 0;
+	for(;;)
+	{
+		int child = 2 * i + 1;
+		if(child >= s->heap_count)
+			break;
+		if(child + 1 < s->heap_count && s->heap[child + 1].cost < s->heap[child].cost)
+			++child;
+		if(s->heap[child].cost >= last.cost)
+			break;
+		s->heap[i] = s->heap[child];
+		i = child;
+	}
+	if(s->heap_count > 0)
+		s->heap[i] = last;
+	return top;
+}
+
+// What it costs to collapse from onto to, or HUGE_VAL if it isn't allowed.
+static double lod_collapse_cost(const struct lod_state * s, int from, int to)
+{
+	const struct lod_position * f = s->positions + from;
+	const struct lod_position * t = s->positions + to;
+	double q[10];
+	int i;
+
+	if(f->on_line && !t->on_line)
+		return HUGE_VAL;
+	for(i = 0; i < 10; ++i)
+		q[i] = f->q[i] + t->q[i];
+	return lod_evaluate(q, t->xyz);
+}
+
+// Queues the cheaper direction of collapsing the edge a b, if it is within
+// the limit.
+static void lod_queue_edge(struct lod_state * s, int a, int b)
+{
+	struct lod_candidate c;
+	double ab = lod_collapse_cost(s, a, b);
+	double ba = lod_collapse_cost(s, b, a);
+
+	c.cost = (ab <= ba) ? ab : ba;
+	c.from = (ab <= ba) ? a : b;
+	c.to = (ab <= ba) ? b : a;
+	if(c.cost > s->limit)
+		return;
+	c.from_version = s->positions[c.from].version;
+	c.to_version = s->positions[c.to].version;
+	lod_heap_push(s, &c);
+}
+
+// Whether collapsing from onto to leaves every remaining triangle of from's
+// facing about the way it did, and not squashed flat.
+static int lod_collapse_is_safe(const struct lod_state * s, int from, int to)
+{
+	const struct lod_position * f = s->positions + from;
+	int i, k;
+
+	for(i = 0; i < f->tri_count; ++i)
+	{
+		const struct lod_tri * t = s->tris + f->tris[i];
+		const float * moved[3];
+		double before[3], after[3];
+		double before_len2, after_len2, dot;
+
+		if(!t->alive || t->pos[0] == to || t->pos[1] == to || t->pos[2] == to)
+			continue;
+		for(k = 0; k < 3; ++k)
+			moved[k] = s->positions[t->pos[k] == from ? to : t->pos[k]].xyz;
+
+		lod_tri_normal(s->positions[t->pos[0]].xyz, s->positions[t->pos[1]].xyz, s->positions[t->pos[2]].xyz, before);
+		lod_tri_normal(moved[0], moved[1], moved[2], after);
+		before_len2 = before[0] * before[0] + before[1] * before[1] + before[2] * before[2];
+		after_len2 = after[0] * after[0] + after[1] * after[1] + after[2] * after[2];
+		dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+
+		if(after_len2 <= before_len2 * 1e-6)
+			return 0;
+		if(dot < LOD_MIN_FLIP_COS * sqrt(before_len2 * after_len2))
+			return 0;
+	}
+	return 1;
+}
+
+static void lod_collapse(struct lod_state * s, int from, int to)
+{
+	struct lod_position * f = s->positions + from;
+	struct lod_position * t = s->positions + to;
+	int i, k;
+
+	for(i = 0; i < 10; ++i)
+		t->q[i] += f->q[i];
+	f->collapsed_to = to;
+	++f->version;
+	++t->version;
+
+	for(i = 0; i < f->tri_count; ++i)
+	{
+		struct lod_tri * tri = s->tris + f->tris[i];
+		if(!tri->alive)
+			continue;
+		if(tri->pos[0] == to || tri->pos[1] == to || tri->pos[2] == to)
+		{
+			tri->alive = 0;
+			continue;
+		}
+		for(k = 0; k < 3; ++k)
+		if(tri->pos[k] == from)
+			tri->pos[k] = to;
+		lod_add_tri_ref(t, f->tris[i]);
+	}
+	free(f->tris);
+	f->tris = NULL;
+	f->tri_count = f->tri_capacity = 0;
+
+	// Everything around us has a new cost.
+	for(i = 0; i < t->tri_count; ++i)
+	{
+		const struct lod_tri * tri = s->tris + t->tris[i];
+		if(!tri->alive)
+			continue;
+		for(k = 0; k < 3; ++k)
+		if(tri->pos[k] != to)
+			lod_queue_edge(s, to, tri->pos[k]);
+	}
+}
+
+// The vertex at position p to stand in for vertex v: the one of the same
+// color whose normal is closest.  Unlit vertices (lines) only stand in for
+// unlit ones.  With any_color, a vertex of another color will do rather than
+// none at all.  Returns -1 if nothing will do.
+static int lod_pick_vertex(const struct lod_state * s, const volatile float * vertex_table, int p, int v, int any_color)
+{
+	const volatile float * src = vertex_table + v * 10;
+	const struct lod_position * pos = s->positions + p;
+	int src_lit = src[3] != 0.0f || src[4] != 0.0f || src[5] != 0.0f;
+	double best_score = -HUGE_VAL;
+	int best = -1;
+	int pass, i;
+
+	for(pass = 0; pass < (any_color ? 2 : 1) && best < 0; ++pass)
+	for(i = pos->first_vertex; i < pos->first_vertex + pos->vertex_count; ++i)
+	{
+		int c = s->sorted[i].vertex;
+		const volatile float * cand = vertex_table + c * 10;
+		int lit = cand[3] != 0.0f || cand[4] != 0.0f || cand[5] != 0.0f;
+		double score;
+
+		if(c == v)
+			return v;
+		if(lit != src_lit)
+			continue;
+		if(pass == 0 && (cand[6] != src[6] || cand[7] != src[7] || cand[8] != src[8] || cand[9] != src[9]))
+			continue;
+		score = (double) src[3] * cand[3] + (double) src[4] * cand[4] + (double) src[5] * cand[5];
+		if(score > best_score)
+		{
+			best_score = score;
+			best = c;
+		}
+	}
+	return best;
+}
+
+// Whether two vertices at one position look the same.  The smoother doesn't
+// always merge vertices whose normals differ only by rounding.
+static int lod_same_vertex(const volatile float * vertex_table, int a, int b)
+{
+	const volatile float * va = vertex_table + a * 10;
+	const volatile float * vb = vertex_table + b * 10;
+	if(a == b)
+		return 1;
+	if(va[6] != vb[6] || va[7] != vb[7] || va[8] != vb[8] || va[9] != vb[9])
+		return 0;
+	return (double) va[3] * vb[3] + (double) va[4] * vb[4] + (double) va[5] * vb[5] > LOD_SAME_NORMAL_COS;
+}
+
+int					get_simplified_index_capacity(
+							int							line_count,
+							int							cond_line_count,
+							int							tri_count,
+							int							quad_count)
+{
+	return line_count + cond_line_count + tri_count + quad_count / 4 * 6;
+}
+
+void				simplify_indexed_mesh(
+							const volatile float *		vertex_table,
+							int							vertex_count,
+							const volatile unsigned int * index_table,
+							int							line_start,
+							int							line_count,
+							int							cond_line_start,
+							int							cond_line_count,
+							int							tri_start,
+							int							tri_count,
+							int							quad_start,
+							int							quad_count,
+							float						max_error,
+							unsigned int *				out_indices,
+							int *						out_line_count,
+							int *						out_cond_line_count,
+							int *						out_tri_count)
+{
+	struct lod_state		s;
+	struct lod_half_edge *	edges;
+	int *					position_of;
+	int						position_count = 0;
+	int						total_tris = tri_count / 3 + quad_count / 4 * 2;
+	int						edge_count = 0;
+	int						out_count = 0;
+	int						i, j, k;
+
+	memset(&s, 0, sizeof(s));
+	s.limit = (double) max_error * max_error;
+
+	// Weld vertices that share a position - the smoother split them wherever
+	// normals or colors differ, but they are one point on the surface.
+	s.sorted = (struct lod_vertex *) malloc(sizeof(struct lod_vertex) * MAX(vertex_count, 1));
+	position_of = (int *) malloc(sizeof(int) * MAX(vertex_count, 1));
+	for(i = 0; i < vertex_count; ++i)
+	{
+		for(k = 0; k < 3; ++k)
+			s.sorted[i].xyz[k] = vertex_table[i * 10 + k];
+		s.sorted[i].vertex = i;
+	}
+	qsort(s.sorted, vertex_count, sizeof(struct lod_vertex), lod_compare_vertex);
+
+	s.positions = (struct lod_position *) calloc(MAX(vertex_count, 1), sizeof(struct lod_position));
+	for(i = 0; i < vertex_count; ++i)
+	{
+		struct lod_position * p;
+		if(i == 0 || memcmp(s.sorted[i].xyz, s.sorted[i - 1].xyz, sizeof(float) * 3) != 0)
+		{
+			p = s.positions + position_count++;
+			memcpy(p->xyz, s.sorted[i].xyz, sizeof(float) * 3);
+			p->collapsed_to = -1;
+			p->first_vertex = i;
+		}
+		p = s.positions + position_count - 1;
+		++p->vertex_count;
+		position_of[s.sorted[i].vertex] = position_count - 1;
+	}
+
+	// Gather the triangles, splitting quads; those with a repeated position
+	// can't be seen anyway.
+	s.tris = (struct lod_tri *) malloc(sizeof(struct lod_tri) * MAX(total_tris, 1));
+	for(i = 0; i < total_tris; ++i)
+	{
+		struct lod_tri * t = s.tris + i;
+		static const int quad_corners[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+		double n[3], len;
+
+		for(k = 0; k < 3; ++k)
+		{
+			if(i < tri_count / 3)
+				t->vertex[k] = index_table[tri_start + i * 3 + k];
+			else
+			{
+				int q = i - tri_count / 3;
+				t->vertex[k] = index_table[quad_start + (q / 2) * 4 + quad_corners[q % 2][k]];
+			}
+			t->pos[k] = position_of[t->vertex[k]];
+		}
+		t->alive = t->pos[0] != t->pos[1] && t->pos[1] != t->pos[2] && t->pos[2] != t->pos[0];
+		if(!t->alive)
+			continue;
+
+		lod_tri_normal(s.positions[t->pos[0]].xyz, s.positions[t->pos[1]].xyz, s.positions[t->pos[2]].xyz, n);
+		len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for(k = 0; k < 3; ++k)
+		{
+			struct lod_position * p = s.positions + t->pos[k];
+			if(len > 0.0)
+				lod_add_plane(p->q, n[0] / len, n[1] / len, n[2] / len,
+							  -(n[0] * p->xyz[0] + n[1] * p->xyz[1] + n[2] * p->xyz[2]) / len);
+			lod_add_tri_ref(p, i);
+		}
+	}
+
+	// Find the edges.  One shared by exactly two triangles, running opposite
+	// ways with the same normals and colors at each end, is smooth; any other
+	// is a crease, color change or rim and is held in place.
+	edges = (struct lod_half_edge *) malloc(sizeof(struct lod_half_edge) * MAX(total_tris * 3, 1));
+	for(i = 0; i < total_tris; ++i)
+	if(s.tris[i].alive)
+	for(k = 0; k < 3; ++k)
+	{
+		int a = s.tris[i].pos[k];
+		int b = s.tris[i].pos[(k + 1) % 3];
+		edges[edge_count].lo = MIN(a, b);
+		edges[edge_count].hi = MAX(a, b);
+		edges[edge_count].tri = i;
+		edges[edge_count].corner = k;
+		++edge_count;
+	}
+	qsort(edges, edge_count, sizeof(struct lod_half_edge), lod_compare_half_edge);
+
+	for(i = 0; i < edge_count; i = j)
+	{
+		int smooth = 0;
+		for(j = i + 1; j < edge_count && edges[j].lo == edges[i].lo && edges[j].hi == edges[i].hi; ++j) { }
+
+		if(j - i == 2)
+		{
+			const struct lod_tri * a = s.tris + edges[i].tri;
+			const struct lod_tri * b = s.tris + edges[i + 1].tri;
+			int ak = edges[i].corner, bk = edges[i + 1].corner;
+			smooth =	a->pos[ak] == b->pos[(bk + 1) % 3] &&
+						lod_same_vertex(vertex_table, a->vertex[ak], b->vertex[(bk + 1) % 3]) &&
+						lod_same_vertex(vertex_table, a->vertex[(ak + 1) % 3], b->vertex[bk]);
+		}
+
+		if(!smooth)
+		for(k = i; k < j; ++k)
+		{
+			const struct lod_tri * t = s.tris + edges[k].tri;
+			struct lod_position * a = s.positions + t->pos[edges[k].corner];
+			struct lod_position * b = s.positions + t->pos[(edges[k].corner + 1) % 3];
+			double n[3], e[3], m[3], len;
+
+			lod_tri_normal(s.positions[t->pos[0]].xyz, s.positions[t->pos[1]].xyz, s.positions[t->pos[2]].xyz, n);
+			e[0] = b->xyz[0] - a->xyz[0];
+			e[1] = b->xyz[1] - a->xyz[1];
+			e[2] = b->xyz[2] - a->xyz[2];
+			m[0] = e[1] * n[2] - e[2] * n[1];
+			m[1] = e[2] * n[0] - e[0] * n[2];
+			m[2] = e[0] * n[1] - e[1] * n[0];
+			len = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+			if(len == 0.0)
+				continue;
+			m[0] /= len; m[1] /= len; m[2] /= len;
+			lod_add_plane(a->q, m[0], m[1], m[2], -(m[0] * a->xyz[0] + m[1] * a->xyz[1] + m[2] * a->xyz[2]));
+			lod_add_plane(b->q, m[0], m[1], m[2], -(m[0] * a->xyz[0] + m[1] * a->xyz[1] + m[2] * a->xyz[2]));
+		}
+	}
+
+	// Lines: the squared distance to a line is the sum of squared distances
+	// to two planes through it, at right angles to each other.
+	for(i = 0; i < line_count; i += 2)
+	{
+		struct lod_position * a = s.positions + position_of[index_table[line_start + i]];
+		struct lod_position * b = s.positions + position_of[index_table[line_start + i + 1]];
+		double d[3] = { b->xyz[0] - a->xyz[0], b->xyz[1] - a->xyz[1], b->xyz[2] - a->xyz[2] };
+		double u[3], v[3], len = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		int axis = 0;
+
+		a->on_line = b->on_line = 1;
+		if(len == 0.0)
+			continue;
+		d[0] /= len; d[1] /= len; d[2] /= len;
+
+		// Cross with the axis the line runs least along.
+		if(fabs(d[1]) < fabs(d[axis])) axis = 1;
+		if(fabs(d[2]) < fabs(d[axis])) axis = 2;
+		u[0] = (axis == 0) ? 0.0 : (axis == 1) ? d[2] : -d[1];
+		u[1] = (axis == 0) ? -d[2] : (axis == 1) ? 0.0 : d[0];
+		u[2] = (axis == 0) ? d[1] : (axis == 1) ? -d[0] : 0.0;
+		len = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+		u[0] /= len; u[1] /= len; u[2] /= len;
+		v[0] = d[1] * u[2] - d[2] * u[1];
+		v[1] = d[2] * u[0] - d[0] * u[2];
+		v[2] = d[0] * u[1] - d[1] * u[0];
+
+		for(k = 0; k < 2; ++k)
+		{
+			struct lod_position * p = k ? b : a;
+			lod_add_plane(p->q, u[0], u[1], u[2], -(u[0] * a->xyz[0] + u[1] * a->xyz[1] + u[2] * a->xyz[2]));
+			lod_add_plane(p->q, v[0], v[1], v[2], -(v[0] * a->xyz[0] + v[1] * a->xyz[1] + v[2] * a->xyz[2]));
+		}
+	}
+
+	// Queue every edge, then collapse until nothing within the limit is left.
+	for(i = 0; i < edge_count; ++i)
+	if(i == 0 || edges[i].lo != edges[i - 1].lo || edges[i].hi != edges[i - 1].hi)
+		lod_queue_edge(&s, edges[i].lo, edges[i].hi);
+	free(edges);
+
+	while(s.heap_count > 0)
+	{
+		struct lod_candidate c = lod_heap_pop(&s);
+		if(s.positions[c.from].version != c.from_version || s.positions[c.to].version != c.to_version)
+			continue;
+		if(!lod_collapse_is_safe(&s, c.from, c.to))
+			continue;
+		lod_collapse(&s, c.from, c.to);
+	}
+
+	// Write out what is left: lines, conditional lines, then triangles.
+	*out_line_count = 0;
+	for(i = 0; i < line_count; i += 2)
+	{
+		int a = index_table[line_start + i];
+		int b = index_table[line_start + i + 1];
+		int pa = lod_find(&s, position_of[a]);
+		int pb = lod_find(&s, position_of[b]);
+		int va, vb;
+		if(pa == pb)
+			continue;
+		va = lod_pick_vertex(&s, vertex_table, pa, a, 0);
+		vb = lod_pick_vertex(&s, vertex_table, pb, b, 0);
+		if(va < 0 || vb < 0)
+			continue;
+		out_indices[out_count++] = va;
+		out_indices[out_count++] = vb;
+		*out_line_count += 2;
+	}
+
+	*out_cond_line_count = 0;
+	for(i = 0; i < cond_line_count; i += 4)
+	{
+		int picked[4];
+		for(k = 0; k < 4; ++k)
+		{
+			int v = index_table[cond_line_start + i + k];
+			picked[k] = lod_pick_vertex(&s, vertex_table, lod_find(&s, position_of[v]), v, 0);
+			// The control points are never drawn; they can stay where they were.
+			if(picked[k] < 0 && k >= 2)
+				picked[k] = v;
+		}
+		if(picked[0] < 0 || picked[1] < 0 || position_of[picked[0]] == position_of[picked[1]])
+			continue;
+		for(k = 0; k < 4; ++k)
+			out_indices[out_count++] = picked[k];
+		*out_cond_line_count += 4;
+	}
+
+	*out_tri_count = 0;
+	for(i = 0; i < total_tris; ++i)
+	{
+		const struct lod_tri * t = s.tris + i;
+		int picked[3];
+		if(!t->alive)
+			continue;
+		for(k = 0; k < 3; ++k)
+			picked[k] = lod_pick_vertex(&s, vertex_table, t->pos[k], t->vertex[k], 1);
+		if(picked[0] < 0 || picked[1] < 0 || picked[2] < 0)
+			continue;
+		for(k = 0; k < 3; ++k)
+			out_indices[out_count++] = picked[k];
+		*out_tri_count += 3;
+	}
+
+	for(i = 0; i < position_count; ++i)
+		free(s.positions[i].tris);
+	free(s.positions);
+	free(s.tris);
+	free(s.heap);
+	free(s.sorted);
+	free(position_of);
+}
+
+
+
+
+#pragma mark -
+//==============================================================================
+//	T JUNCTION REMOVAL
+//==============================================================================
+
+// This code attempts to remove "T" junctions from a mesh.  Since an ASCII 
+// picture is worth 1000 words...
 //
 //    B            B
 //   /|\          /|\
@@ -1866,8 +3967,28 @@ void				write_indexed_mesh(
 //
 
 
+// The search works from the edges' side.  Welding has already snapped nearby
+// vertices together, so each location is named exactly by the first vertex of
+// its run in the sorted vertex array - no quantizing is needed.  Every polygon
+// side is hashed by the names of its two ends, without regard to direction.
+// A side that some other polygon shares is closed: the surface has no gap
+// along it that could crack, so it is rejected right away.  That leaves the
+// open sides, which for a typical part are only a small fraction of them.
+//
+// The vertices that could be the foot of a T are the ends of open sides - the
+// C of the picture above ends BC and CD, neither of which has a twin.  These
+// candidates are kept sorted along each axis; an open side binary-searches its
+// slab on all three, and sweeps only the candidates in the emptiest one (with
+// the other two axes checked before the vertex is even looked at).
+//
+// Finally the faces with T junctions are subdivided in place: each is replaced
+// by the triangles of its ear clipping, the rest of the mesh is left alone,
+// and the new vertices are merged into the already-sorted vertex array.  There
+// is no second mesh, so nothing has to be welded, sorted or creased again.
+
+
 // When we are looking for T junctions, we use this structure to 'remember' which
-// edge we are working on from the R-tree visitor.
+// edge we are working on.
 
 struct t_finder_info_t { 
 	int split_quads;			// The number of quads that have been split.  Each quad with a 
@@ -1882,8 +4003,22 @@ struct t_finder_info_t {
 	float line_dir[3];			// A normalized direction vector from v1 to v2, used to order the intrusions.
 };
 
+// A vertex that might be the foot of a T, with its location copied in so that
+// a sweep can rule it out without touching the vertex itself.
+struct t_candidate {
+	float				location[3];
+	struct Vertex *		vert;					// First of its run of colocated vertices.
+};
 
-// This is the call back that gets called once for each vertex V that _might_ be near an edge (e.g. 
+// Everything the search for T junctions needs besides the mesh.
+struct t_candidates {
+	int						count;
+	struct t_candidate *	by_axis[3];			// The candidates, sorted along X, Y and Z.
+	unsigned char *			open_sides;			// Per polygon side (face * 4 + side): 1 if no other polygon shares it.
+};
+
+
+// This is called once for each vertex V that _might_ be near an edge (e.g. 
 // via a bounding box test).  We project the point onto the line and see how far the intruding point
 // is from the projection on the line.  If the point is close, it's a T junction and we record it
 // on a linked list ƒor this side, in order of distanec along the line.
@@ -1936,8 +4071,8 @@ void visit_possible_t_junc(struct Vertex * v, void * ref)
 
 // Given a convex polygon (specified by an interleaved XYZ array "poly" and pt_count points, this routine
 // cuts down the degree of the polygon by cutting off an 'ear' (that is, a non-reflex vertex).  The ear is
-// added as a triangle, and the polygon loses a vertex.  This is done by cutting off the sharpest corners 
-// first.
+// written to "ear" as a triangle, and the polygon loses a vertex.  This is done by cutting off the sharpest
+// corners first.
 //
 // BEFORE:     AFTER
 //
@@ -1948,9 +4083,9 @@ void visit_possible_t_junc(struct Vertex * v, void * ref)
 // |     |    |     |
 // F--G--H    F--G--H
 //
-// (BEC is added as a new trinagle.)
+// (BEC is the ear.)
 
-void add_ear_and_remove(float * poly, int pt_count, struct Mesh * target_mesh, const float * color, int tid)
+static void clip_ear(float * poly, int pt_count, float ear[9])
 {
 	int i, p, n, b = -1;
 	float best_dot = -99.0;
@@ -1986,7 +4121,9 @@ void add_ear_and_remove(float * poly, int pt_count, struct Mesh * target_mesh, c
 	p = (b + pt_count - 1) % pt_count;
 	n = (b + 1) % pt_count;
 	
-	add_face(target_mesh,poly+3*p,poly+3*b,poly+3*n,NULL,color,tid);
+	vec3f_copy(ear  ,poly+3*p);
+	vec3f_copy(ear+3,poly+3*b);
+	vec3f_copy(ear+6,poly+3*n);
 	
 	if(b != pt_count-1)
 	{
@@ -1995,149 +4132,477 @@ void add_ear_and_remove(float * poly, int pt_count, struct Mesh * target_mesh, c
 	
 }
 
+// Utility: qsort comparators that put T candidates in order along one axis.
+static int compare_t_candidates_y(const void * lhs, const void * rhs)
+{
+	float a = ((const struct t_candidate *) lhs)->location[1];
+	float b = ((const struct t_candidate *) rhs)->location[1];
+	return (a > b) - (a < b);
+}
 
-// This routine finds and removes all T junctions from the mesh.  It does this by...
-// For each non-creased edge (we don't de-T creases for speed) we R-tree search for
-// all T-forming vertices and put them in a sorted linked list by edge.
-//
-// Then we build a brand new copy of our mesh and peel off ears for each interference
-// as new triangles.  When done, we're left with triangles that we also add.
-// 
-// Finall we redo a bunch of processing we already did, now that we have a new mesh.
-void find_and_remove_t_junctions(struct Mesh * mesh)
+static int compare_t_candidates_z(const void * lhs, const void * rhs)
 {
-	assert(mesh->vertex_count == mesh->vertex_capacity);
-	assert(mesh->face_count == mesh->face_capacity);
-	struct t_finder_info_t	info;
-	int fi;
-	info.inserted_pts = 0;
-	info.split_quads = 0;
+	float a = ((const struct t_candidate *) lhs)->location[2];
+	float b = ((const struct t_candidate *) rhs)->location[2];
+	return (a > b) - (a < b);
+}
+
+// One entry of the side hash: a side, named by the run starts of its ends
+// (lower first), and how many polygons use it.
+struct t_side {
+	int		a;
+	int		b;
+	int		uses;						// 0 for an empty slot.
+};
+
+// Hash slot for the side from location a to location b, in either direction.
+static inline unsigned int t_side_slot(int a, int b, unsigned int mask)
+{
+	unsigned int h = ((unsigned int) MIN(a,b) * 0x9E3779B1u + (unsigned int) MAX(a,b)) * 0x85EBCA77u;
+	return (h ^ (h >> 16)) & mask;
+}
+
+// Finds the open polygon sides and the T candidates at their ends.  Returns
+// the number of candidates; if it is 0 there can't be any T junctions.
+static int find_t_candidates(struct Mesh * mesh, struct t_candidates * out)
+{
+	int *			run_starts	= (int *) malloc(sizeof(int) * mesh->vertex_count);
+	unsigned char *	is_candidate = (unsigned char *) calloc(mesh->vertex_count, 1);
+	int *			side_slots	= (int *) malloc(sizeof(int) * mesh->poly_count * 4);
+	struct t_side *	sides;
+	unsigned int	slot_count	= 1;
+	unsigned int	mask;
+	int				v, fi, i, axis, c;
+
+	out->count = 0;
+	out->by_axis[0] = out->by_axis[1] = out->by_axis[2] = NULL;
+	out->open_sides = (unsigned char *) calloc(mesh->poly_count * 4, 1);
+
+	for(v = 0; v < mesh->vertex_count; ++v)
+	{
+		if(v > 0 && compare_points(mesh->vertices[v-1].location,mesh->vertices[v].location) == 0)
+			run_starts[v] = run_starts[v-1];
+		else
+			run_starts[v] = v;
+	}
+
+	// Count the uses of each side; open addressing, with at least twice as
+	// many slots as there are sides.
+	while(slot_count < (unsigned int) mesh->poly_count * 8)
+		slot_count *= 2;
+	mask = slot_count - 1;
+	sides = (struct t_side *) calloc(slot_count, sizeof(struct t_side));
 
-	
 	for(fi = 0; fi < mesh->poly_count; ++fi)
 	{
-		info.f = mesh->faces+fi;
-		if(info.f->degree > 2)
-		for(info.i = 0; info.i < info.f->degree; ++info.i)
+		struct Face * f = mesh->faces+fi;
+		for(i = 0; i < f->degree; ++i)
 		{
-			// Sad -- this is not a win - this info is not yet available. :-(
-			if(info.f->neighbor[info.i] == NULL)
+			int a = run_starts[f->vertex[     i ] - mesh->vertices];
+			int b = run_starts[f->vertex[CCW(f,i)] - mesh->vertices];
+			unsigned int s;
+			side_slots[fi * 4 + i] = -1;
+			if(a == b)
 				continue;
-				
-			info.v1 = info.f->vertex[ info.i					 ];
-			info.v2 = info.f->vertex[(info.i+1)%info.f->degree];
-			
-			if(vec3f_eq(info.v1->location,info.v2->location))
-				continue;
-			
-			info.line_dir[0] = info.v2->location[0] - info.v1->location[0];
-			info.line_dir[1] = info.v2->location[1] - info.v1->location[1];
-			info.line_dir[2] = info.v2->location[2] - info.v1->location[2];
-//			vec3f_normalize(info.line_dir);
+			for(s = t_side_slot(a, b, mask); sides[s].uses; s = (s + 1) & mask)
+			if(sides[s].a == MIN(a,b) && sides[s].b == MAX(a,b))
+				break;
+			sides[s].a = MIN(a,b);
+			sides[s].b = MAX(a,b);
+			++sides[s].uses;
+			side_slots[fi * 4 + i] = (int) s;
+		}
+	}
+
+	for(fi = 0; fi < mesh->poly_count; ++fi)
+	{
+		struct Face * f = mesh->faces+fi;
+		for(i = 0; i < f->degree; ++i)
+		if(side_slots[fi * 4 + i] >= 0 && sides[side_slots[fi * 4 + i]].uses == 1)
+		{
+			out->open_sides[fi * 4 + i] = 1;
+			is_candidate[run_starts[f->vertex[     i ] - mesh->vertices]] = 1;
+			is_candidate[run_starts[f->vertex[CCW(f,i)] - mesh->vertices]] = 1;
+		}
+	}
+
+	free(sides);
+	free(side_slots);
+
+	for(v = 0; v < mesh->vertex_count; ++v)
+		out->count += is_candidate[v];
+
+	// The vertices are sorted by X first, so the candidates come out in X
+	// order; the other two axes need sorting.
+	if(out->count > 0)
+	{
+		for(axis = 0; axis < 3; ++axis)
+			out->by_axis[axis] = (struct t_candidate *) malloc(sizeof(struct t_candidate) * out->count);
+		for(v = 0, c = 0; v < mesh->vertex_count; ++v)
+		if(is_candidate[v])
+		{
+			vec3f_copy(out->by_axis[0][c].location, mesh->vertices[v].location);
+			out->by_axis[0][c].vert = mesh->vertices + v;
+			++c;
+		}
+		memcpy(out->by_axis[1], out->by_axis[0], sizeof(struct t_candidate) * out->count);
+		memcpy(out->by_axis[2], out->by_axis[0], sizeof(struct t_candidate) * out->count);
+		qsort(out->by_axis[1], out->count, sizeof(struct t_candidate), compare_t_candidates_y);
+		qsort(out->by_axis[2], out->count, sizeof(struct t_candidate), compare_t_candidates_z);
+	}
+
+	free(run_starts);
+	free(is_candidate);
+	return out->count;
+}
+
+static void destroy_t_candidates(struct t_candidates * candidates)
+{
+	free(candidates->by_axis[0]);
+	free(candidates->by_axis[1]);
+	free(candidates->by_axis[2]);
+	free(candidates->open_sides);
+}
+
+// Binary search of candidates sorted on axis: the first whose location is at
+// or past value, or, if past_equal, the first past it.
+static const struct t_candidate * t_candidate_bound(const struct t_candidate * c, ptrdiff_t len, int axis, float value, int past_equal)
+{
+	while(len > 0)
+	{
+		ptrdiff_t half = len >> 1;
+		if(past_equal ? c[half].location[axis] <= value : c[half].location[axis] < value)
+		{
+			c += half + 1;
+			len -= half + 1;
+		}
+		else
+			len = half;
+	}
+	return c;
+}
+
+// Finds the T junctions along every open side of face f, recording them on the
+// face.  Only f's own lists are changed, so faces can be searched in any order.
+static void find_t_junctions_for_face(struct Mesh * mesh, const struct t_candidates * candidates, struct Face * f, struct t_finder_info_t * info)
+{
+	info->f = f;
+	if(info->f->degree > 2)
+	for(info->i = 0; info->i < info->f->degree; ++info->i)
+	{
+		const struct t_candidate * c, * first[3], * last[3];
+		int axis, best_axis = 0;
+
+		// Creases are not de-T'd, for speed.
+		if(info->f->neighbor[info->i] == NULL)
+			continue;
+		if(!candidates->open_sides[(info->f - mesh->faces) * 4 + info->i])
+			continue;
 			
-			float mib[3] = { 
-								MIN(info.v1->location[0],info.v2->location[0]) - EPSI,
-								MIN(info.v1->location[1],info.v2->location[1]) - EPSI,
-								MIN(info.v1->location[2],info.v2->location[2]) - EPSI };
+		info->v1 = info->f->vertex[ info->i					 ];
+		info->v2 = info->f->vertex[(info->i+1)%info->f->degree];
+		
+		if(vec3f_eq(info->v1->location,info->v2->location))
+			continue;
+		
+		info->line_dir[0] = info->v2->location[0] - info->v1->location[0];
+		info->line_dir[1] = info->v2->location[1] - info->v1->location[1];
+		info->line_dir[2] = info->v2->location[2] - info->v1->location[2];
+//			vec3f_normalize(info->line_dir);
+		
+		float mib[3] = { 
+							MIN(info->v1->location[0],info->v2->location[0]) - EPSI,
+							MIN(info->v1->location[1],info->v2->location[1]) - EPSI,
+							MIN(info->v1->location[2],info->v2->location[2]) - EPSI };
+
+		float mab[3] = { 
+							MAX(info->v1->location[0],info->v2->location[0]) + EPSI,
+							MAX(info->v1->location[1],info->v2->location[1]) + EPSI,
+							MAX(info->v1->location[2],info->v2->location[2]) + EPSI };
+
+		// Find the slab on every axis and sweep the one with the fewest
+		// candidates - the thinnest slab can hold a whole plane of them.
+		for(axis = 0; axis < 3; ++axis)
+		{
+			first[axis] = t_candidate_bound(candidates->by_axis[axis], candidates->count, axis, mib[axis], 0);
+			last[axis] = t_candidate_bound(first[axis], candidates->by_axis[axis] + candidates->count - first[axis], axis, mab[axis], 1);
+			if(last[axis] - first[axis] < last[best_axis] - first[best_axis])
+				best_axis = axis;
+		}
+
+		for(c = first[best_axis]; c < last[best_axis]; ++c)
+		if(c->location[0] >= mib[0] && c->location[0] <= mab[0] &&
+		   c->location[1] >= mib[1] && c->location[1] <= mab[1] &&
+		   c->location[2] >= mib[2] && c->location[2] <= mab[2])
+			visit_possible_t_junc(c->vert, info);
+	}
+}
+
+// Parallel T junction search: each thread takes a run of faces at a time, with
+// its own counts.
+struct t_finder_job {
+	struct Mesh *				mesh;
+	const struct t_candidates *	candidates;
+	int *						split_quads;		// Per chunk.
+	int *						inserted_pts;		// Per chunk.
+};
+
+static void find_t_junctions_in_chunk(void * ref, int chunk)
+{
+	struct t_finder_job * job = (struct t_finder_job *) ref;
+	struct t_finder_info_t info;
+	int fi = chunk * PARALLEL_FACE_GRAIN;
+	int stop = MIN(fi + PARALLEL_FACE_GRAIN, job->mesh->poly_count);
+	info.inserted_pts = 0;
+	info.split_quads = 0;
+	for(; fi < stop; ++fi)
+		find_t_junctions_for_face(job->mesh, job->candidates, job->mesh->faces+fi, &info);
+	job->split_quads[chunk] = info.split_quads;
+	job->inserted_pts[chunk] = info.inserted_pts;
+}
 
-			float mab[3] = { 
-								MAX(info.v1->location[0],info.v2->location[0]) + EPSI,
-								MAX(info.v1->location[1],info.v2->location[1]) + EPSI,
-								MAX(info.v1->location[2],info.v2->location[2]) + EPSI };
-								
-			scan_rtree(mesh->index, mib, mab, visit_possible_t_junc, &info);
+// Marks side i of a new triangle f as a crease if a line runs along it, as
+// add_creases would have.
+static void crease_new_face(struct Mesh * mesh, struct Face * f)
+{
+	int i;
+	for(i = 0; i < f->degree; ++i)
+	{
+		struct Vertex * begin, * end, * v;
+		range_for_vertex(mesh->vertices,mesh->vertices + mesh->vertex_count,&begin,&end,f->vertex[i]);
+		for(v = begin; v != end; ++v)
+		if(v->face->degree == 2)
+		if(compare_points(v->face->vertex[1 - v->index]->location,f->vertex[CCW(f,i)]->location)==0)
+		{
+			f->neighbor[i] = NULL;
+			f->index[i] = -1;
 		}
 	}
+}
 
+// Replaces every polygon with T junctions by the triangles of its ear
+// clipping, keeping the faces in order: the new triangles take their
+// polygon's place.  The other faces and their vertices are moved, not
+// rebuilt, and the new triangles' vertices are sorted among themselves and
+// then merged into the (already sorted) vertex array.
+static void split_t_junction_faces(struct Mesh * mesh, int inserted_pts, int split_quads)
+{
+	int				face_count		= mesh->face_count + inserted_pts + split_quads;
+	int *			new_face_index	= (int *) malloc(sizeof(int) * mesh->face_count);
+	unsigned char *	is_split		= (unsigned char *) calloc(mesh->face_count, 1);
+	struct Face *	faces			= (struct Face *) malloc(sizeof(struct Face) * face_count);
+	int *			new_vertex_index;
+	int *			ear_faces;
+	struct Vertex *	ear_vertices;
+	struct Vertex *	vertices;
+	int				ear_count		= 0;
+	int				split_vertices	= 0;
+	int				vertex_count;
+	int				f, i, n, e, v, w;
+
+	assert(split_quads <= mesh->quad_count);
 
-	//printf("Subdivided %d quads and added %d pts.\n", info.split_quads,info.inserted_pts);
-	if(info.inserted_pts > 0)
+	for(f = 0; f < mesh->poly_count; ++f)
+	{
+		struct Face * fp = mesh->faces+f;
+		if(fp->t_list[0] || fp->t_list[1] || fp->t_list[2] || fp->t_list[3])
+		{
+			struct VertexInsert * vp;
+			is_split[f] = 1;
+			split_vertices += fp->degree;
+			ear_count += fp->degree - 2;
+			for(i = 0; i < fp->degree; ++i)
+			for(vp = fp->t_list[i]; vp; vp = vp->next)
+				++ear_count;
+		}
+	}
+
+	ear_faces = (int *) malloc(sizeof(int) * ear_count);
+	ear_vertices = (struct Vertex *) malloc(sizeof(struct Vertex) * 3 * ear_count);
+
+	// Place every face, clipping each split polygon down to triangles as we go.
+	for(f = 0, n = 0, e = 0; f < mesh->face_count; ++f)
 	{
-		int f;
-		struct Mesh * new_mesh;
-		assert(info.split_quads <= mesh->quad_count);
-		new_mesh = create_mesh(
-							mesh->tri_count + info.inserted_pts + 2 * info.split_quads,
-							mesh->quad_count - info.split_quads,
-							mesh->line_count,
-							mesh->cond_line_count);
-
-		for(f = 0; f < mesh->face_count; ++f)
-		{
-			struct Face * fp = mesh->faces+f;
-			if(fp->t_list[0] == NULL &&
-				fp->t_list[1] == NULL &&
-				fp->t_list[2] == NULL &&
-				fp->t_list[3] == NULL)
+		struct Face * fp = mesh->faces+f;
+		new_face_index[f] = n;
+		if(!is_split[f])
+		{
+			faces[n++] = *fp;
+		}
+		else
+		{
+			int total_pts = 0;
+			struct VertexInsert * vp, * k;
+			float * poly, * write_ptr;
+			float ear[9];
+			for(i = 0; i < fp->degree; ++i)
 			{
-				switch(fp->degree) {
-				case 2:
-					add_face(new_mesh,fp->vertex[0]->location,fp->vertex[1]->location,NULL,NULL,fp->color,fp->tid);
-					break;
-				case 3:
-					add_face(new_mesh,fp->vertex[0]->location,fp->vertex[1]->location,fp->vertex[2]->location,NULL,fp->color,fp->tid);
-					break;
-				case 4:
-					add_face(new_mesh,fp->vertex[0]->location,fp->vertex[1]->location,fp->vertex[2]->location,fp->vertex[3]->location,fp->color,fp->tid);
-					break;
-				default:
-					assert(!"bad degree.");
-				}
+				++total_pts;
+				for(vp = fp->t_list[i]; vp; vp = vp->next)
+					++total_pts;
 			}
-			else
+			
+			poly = (float *) malloc(sizeof(float) * 3 * total_pts);
+			write_ptr = poly;
+
+			for(i = 0; i < fp->degree; ++i)
 			{
-				int i;
-				int total_pts = 0;
-				struct VertexInsert * vp;
-				float * poly, * write_ptr;
-				for(i = 0; i < fp->degree; ++i)
-				{
-					++total_pts;
-					for(vp = fp->t_list[i]; vp; vp = vp->next)
-						++total_pts;
-				}
-				
-				poly = (float *) malloc(sizeof(float) * 3 * total_pts);
-				write_ptr = poly;
+				memcpy(write_ptr, fp->vertex[i]->location,3*sizeof(float));
+				write_ptr += 3;
 
-				for(i = 0; i < fp->degree; ++i)
+				for(vp = fp->t_list[i]; vp; vp = k)
 				{
-					memcpy(write_ptr, fp->vertex[i]->location,3*sizeof(float));
+					memcpy(write_ptr, vp->vert->location,3*sizeof(float));
 					write_ptr += 3;
-
-					for(vp = fp->t_list[i]; vp; vp = vp->next)
-					{
-						memcpy(write_ptr, vp->vert->location,3*sizeof(float));
-						write_ptr += 3;
-					}
+					k = vp->next;
+					free(vp);
 				}
-				
-				while(total_pts > 3)
+				fp->t_list[i] = NULL;
+			}
+			
+			while(total_pts > 2)
+			{
+				struct Face * nf = faces + n;
+				if(total_pts > 3)
+					clip_ear(poly,total_pts,ear);
+				else
+					memcpy(ear,poly,sizeof(ear));
+				--total_pts;
+
+				nf->degree = 3;
+				nf->vertex[3] = NULL;
+				nf->neighbor[0] = nf->neighbor[1] = nf->neighbor[2] = nf->neighbor[3] = UNKNOWN_FACE;
+				nf->t_list[0] = nf->t_list[1] = nf->t_list[2] = nf->t_list[3] = NULL;
+				nf->index[0] = nf->index[1] = nf->index[2] = nf->index[3] = -1;
+				nf->flip[0] = nf->flip[1] = nf->flip[2] = nf->flip[3] = -1;
+				vec4f_copy(nf->color, fp->color);
+				nf->tid = fp->tid;
+
+				for(i = 0; i < 3; ++i)
 				{
-					add_ear_and_remove(poly,total_pts,new_mesh,fp->color, fp->tid);
-					--total_pts;
+					struct Vertex * nv = ear_vertices + 3 * e + i;
+					vec3f_copy(nv->location, ear + 3 * i);
+					vec4f_copy(nv->color, fp->color);
+					nv->index = i;
+					nv->face = nf;
+					nv->prev = nv->next = NULL;
 				}
-				
-				add_face(new_mesh,poly,poly+3,poly+6,NULL,fp->color, fp->tid);
-				free(poly);				
+				ear_faces[e++] = n++;
 			}
+			free(poly);
+		}
+	}
+	assert(n == face_count);
+	assert(e == ear_count);
+
+	if(ear_count > 1)
+		quickSort_3(ear_vertices, 0, 3 * ear_count - 1);
+
+	// Merge the new vertices in.  The moved faces are then pointed at where
+	// their vertices went in face order, which is much kinder to the cache
+	// than following each vertex back to its face.
+	vertex_count = mesh->vertex_count - split_vertices + 3 * ear_count;
+	vertices = (struct Vertex *) malloc(sizeof(struct Vertex) * vertex_count);
+	new_vertex_index = (int *) malloc(sizeof(int) * mesh->vertex_count);
+	for(v = 0, e = 0, w = 0; w < vertex_count; ++w)
+	{
+		while(v < mesh->vertex_count && is_split[mesh->vertices[v].face - mesh->faces])
+			++v;
+		if(e == 3 * ear_count || (v < mesh->vertex_count && compare_points(mesh->vertices[v].location,ear_vertices[e].location) <= 0))
+		{
+			new_vertex_index[v] = w;
+			vertices[w] = mesh->vertices[v++];
+			vertices[w].face = faces + new_face_index[vertices[w].face - mesh->faces];
+		}
+		else
+		{
+			vertices[w] = ear_vertices[e++];
+			vertices[w].face->vertex[vertices[w].index] = vertices + w;
 		}
+	}
 
-		assert(new_mesh->vertex_count == new_mesh->vertex_capacity);
-		assert(new_mesh->face_count == new_mesh->face_capacity);
+	for(f = 0; f < mesh->face_count; ++f)
+	if(!is_split[f])
+	{
+		struct Face * fp = faces + new_face_index[f];
+		for(i = 0; i < fp->degree; ++i)
+			fp->vertex[i] = vertices + new_vertex_index[fp->vertex[i] - mesh->vertices];
+	}
 
-		finish_faces_and_sort(new_mesh);
-		add_creases(new_mesh);
-		
-		struct Mesh temp;
-		
-		memcpy(&temp,mesh,sizeof(struct Mesh));
-		memcpy(mesh,new_mesh,sizeof(struct Mesh));
-		memcpy(new_mesh,&temp,sizeof(struct Mesh));
-		
-		destroy_mesh(new_mesh);
-		
-		
+	free(mesh->faces);
+	free(mesh->vertices);
+	mesh->faces = faces;
+	mesh->vertices = vertices;
+	mesh->face_count = mesh->face_capacity = face_count;
+	mesh->vertex_count = mesh->vertex_capacity = vertex_count;
+	mesh->tri_count += inserted_pts + 2 * split_quads;
+	mesh->quad_count -= split_quads;
+	mesh->poly_count = mesh->tri_count + mesh->quad_count;
+
+	for(e = 0; e < ear_count; ++e)
+	{
+		struct Face * nf = mesh->faces + ear_faces[e];
+		compute_face_normal(nf);
+		seal_if_degenerate(nf);
+		crease_new_face(mesh, nf);
 	}
+
+	free(ear_faces);
+	free(ear_vertices);
+	free(is_split);
+	free(new_face_index);
+	free(new_vertex_index);
+}
+
+// This routine finds and removes all T junctions from the mesh: it finds the
+// open sides and their T candidates, sweeps each open, non-creased side for
+// candidates on it (putting them in a sorted linked list by side), then
+// splits the faces that have any.
+void find_and_remove_t_junctions(struct Mesh * mesh)
+{
+	assert(mesh->vertex_count == mesh->vertex_capacity);
+	assert(mesh->face_count == mesh->face_capacity);
+	struct t_finder_info_t	info;
+	struct t_candidates		candidates;
+	int fi;
+	int thread_count = threads_for_mesh(mesh->vertex_count);
+	info.inserted_pts = 0;
+	info.split_quads = 0;
+
+	if(find_t_candidates(mesh, &candidates) == 0)
+	{
+		destroy_t_candidates(&candidates);
+		return;
+	}
+
+	if(thread_count > 1)
+	{
+		struct t_finder_job job;
+		int chunk_count = (mesh->poly_count + PARALLEL_FACE_GRAIN - 1) / PARALLEL_FACE_GRAIN;
+		int c;
+		job.mesh = mesh;
+		job.candidates = &candidates;
+		job.split_quads = (int *) malloc(sizeof(int) * chunk_count);
+		job.inserted_pts = (int *) malloc(sizeof(int) * chunk_count);
+		run_parallel(thread_count, chunk_count, find_t_junctions_in_chunk, &job);
+		for(c = 0; c < chunk_count; ++c)
+		{
+			info.split_quads += job.split_quads[c];
+			info.inserted_pts += job.inserted_pts[c];
+		}
+		free(job.split_quads);
+		free(job.inserted_pts);
+	}
+	else
+	{
+		for(fi = 0; fi < mesh->poly_count; ++fi)
+			find_t_junctions_for_face(mesh, &candidates, mesh->faces+fi, &info);
+	}
+
+	destroy_t_candidates(&candidates);
+
+	//printf("Subdivided %d quads and added %d pts.\n", info.split_quads,info.inserted_pts);
+	if(info.inserted_pts > 0)
+		split_t_junction_faces(mesh, info.inserted_pts, info.split_quads);
 }
 
@@ -37,7 +37,8 @@
 // Usage:
 //
 // A client creates a mesh structure with a pre-declared count of tris, quads
-// and lines, then adds them.
+// and lines, then adds them.  (Or creates a growable mesh, which needs no
+// counts, and adds faces as it finds them.)
 //
 // Once all data is added, a series of processing functions are called to
 // transform the data.
@@ -59,6 +60,13 @@
 
 struct Mesh;
 
+// The index used to find vertices close enough to weld.  Both weld exactly
+// the same vertices; they differ only in speed.
+enum weld_index {
+	weld_index_rtree,				// An R-tree over the vertices.
+	weld_index_grid					// A spatial hash of EPSI-sized cells.
+};
+
 //==============================================================================
 // Data input API
 //==============================================================================
@@ -71,9 +79,25 @@ struct Mesh *		create_mesh(
 							int					line_count,
 							int					cond_line_count);
 
+// Same as create_mesh, but chooses the weld index rather than taking the
+// default.
+struct Mesh *		create_mesh_with_weld_index(
+							int					tri_count, 
+							int					quad_count, 
+							int					line_count,
+							int					cond_line_count,
+							enum weld_index		weld_index);
+
+// Create a mesh without declaring its counts.  Storage grows as faces are
+// added, and faces may come in any order - lines before or among polygons -
+// so a client can feed faces straight in as it finds them.  The mesh is then
+// processed just like any other.
+struct Mesh *		create_growable_mesh(void);
+
 // Add one face.  Pass NULL for p4 for tris, pass NULL for p3 and p4 for lines.
 // Normals are not needed - the mesh alg calculates them for you.
-// Always submit geometry quads and tris first (in any order), then all lines.
+// Unless the mesh is growable, always submit geometry quads and tris first (in
+// any order), then all lines.
 void				add_face(
 							struct Mesh *		mesh, 
 							const float			p1[3], 
@@ -96,6 +120,43 @@ void				finish_creases_and_join(struct Mesh * mesh);
 void				smooth_vertices(struct Mesh * mesh);
 void				merge_vertices(struct Mesh * mesh);
 
+// Optional, after merge_vertices: reorders each TID's tris and quads so that
+// the GPU's post-transform vertex cache gets more hits.
+void				optimize_vertex_cache(struct Mesh * mesh);
+
+// Big meshes are processed on several threads.  Pass 0 to use one thread per
+// core (the default) or 1 to do everything on the calling thread.  The output
+// is exactly the same either way.
+void				set_smoothing_thread_count(int thread_count);
+
+// The same, for meshes smoothed on the calling thread only; pass 0 to go back
+// to the setting above.  A pool which already keeps every core busy with
+// meshes of its own passes 1, so that its workers don't each start a thread
+// per core on top.
+void				set_smoothing_thread_count_for_this_thread(int thread_count);
+
+// Where the CPU has SSE2 or NEON, the hottest loops use it; pass 0 to run the
+// scalar code instead.  The output is exactly the same either way.
+void				set_smoothing_simd_enabled(int enabled);
+
+// Everything besides its input that decides what the smoother outputs.  Code
+// that saves the output for later should key it on these too.
+enum {
+	smoothing_creases				= 1,	// Sharp edges are creased.
+	smoothing_inverts				= 2,	// Faces are smoothed against BFC-flipped neighbors.
+	smoothing_normals_as_color		= 4,	// Debugging: colors show the normals.
+	smoothing_quads_are_cond_lines	= 8		// Degree 4 faces are conditional lines, not quads.
+};
+
+struct smoothing_parameters {
+	int					version;			// Changes whenever the output would.
+	float				weld_distance;		// Vertices closer than this are welded.
+	float				crease_cosine;		// Faces meeting more sharply than this are creased.
+	int					flags;				// Some of the smoothing_ flags above.
+};
+
+void				get_smoothing_parameters(struct smoothing_parameters * out_params);
+
 //==============================================================================
 // Data output API
 //==============================================================================
@@ -131,6 +192,92 @@ void				write_indexed_mesh(
 							int						out_quad_starts[],
 							int						out_quad_counts[]);
 							
+// Compact output.  Rather than write_indexed_mesh's 10 floats, a vertex can be
+// stored in 16 bytes: the position quantized to 16 bits per axis within the
+// mesh's bounding box, the normal octahedral-encoded in two signed 16-bit
+// values, and the color as RGBA8.  A position's fourth value is 65535, or 0 if
+// the normal is zero (lines).  To decode, with the integers normalized to
+// [0,1] or [-1,1] as GPUs do:
+//
+//	position = offset + position.xyz * scale
+//	normal = (x, y, 1 - |x| - |y|); where z < 0, fold x and y back over
+//	the diagonals, then normalize.
+//
+// Convert write_indexed_mesh's output: get the bounds, then write the vertices.
+struct compact_vertex {
+	unsigned short		position[4];
+	short				normal[2];
+	unsigned char		color[4];
+};
+
+struct compact_bounds {
+	float				offset[3];			// Where position 0 lies.
+	float				scale[3];			// The length that 65535 spans.
+};
+
+void				get_compact_bounds(
+							const volatile float *		vertex_table,
+							int							vertex_count,
+							struct compact_bounds *		out_bounds);
+
+void				write_compact_vertices(
+							const volatile float *		vertex_table,
+							int							vertex_count,
+							const struct compact_bounds * bounds,
+							volatile struct compact_vertex * out_vertices);
+
+// The reverse, for tools and tests: decodes as the shaders do.
+void				decode_compact_vertices(
+							const struct compact_vertex * vertices,
+							int							vertex_count,
+							const struct compact_bounds * bounds,
+							float *						out_vertex_table);
+
+// Indices take 2 bytes each if every vertex can be numbered in 16 bits,
+// otherwise 4.  write_compact_indices narrows write_indexed_mesh's indices to
+// that size, and may write over them in place.
+int					get_compact_index_size(int vertex_count);
+
+void				write_compact_indices(
+							const volatile unsigned int * index_table,
+							int							index_count,
+							int							index_size,
+							volatile void *				out_indices);
+
+// Detail levels.  simplify_indexed_mesh writes a coarser copy of one TID's
+// primitives, as write_indexed_mesh wrote them with an index base of 0, for
+// drawing the mesh small.  Edges are collapsed until the next collapse would
+// move the surface more than max_error; creases, color changes and lines are
+// held in place.  The copy indexes the same vertex table, so it needs no
+// vertices of its own.
+//
+// Lines go to out_indices first, then conditional lines, then triangles
+// (quads come out as two triangles each).  out_indices needs room for
+// get_simplified_index_capacity indices.
+int					get_simplified_index_capacity(
+							int							line_count,
+							int							cond_line_count,
+							int							tri_count,
+							int							quad_count);
+
+void				simplify_indexed_mesh(
+							const volatile float *		vertex_table,
+							int							vertex_count,
+							const volatile unsigned int * index_table,
+							int							line_start,
+							int							line_count,
+							int							cond_line_start,
+							int							cond_line_count,
+							int							tri_start,
+							int							tri_count,
+							int							quad_start,
+							int							quad_count,
+							float						max_error,
+							unsigned int *				out_indices,
+							int *						out_line_count,
+							int *						out_cond_line_count,
+							int *						out_tri_count);
+
 // This releases all internal storage for the mesh when smoothing is complete.
 void				destroy_mesh(struct Mesh * mesh);
 
@@ -14,6 +14,7 @@
 #import <Foundation/Foundation.h>
 
 #import "LDrawColor.h"
+#import "LDrawColorTable.h"
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -41,6 +42,7 @@
 {
 	NSMutableDictionary	*colors;		// keys are LDrawColorT codes; objects are LDrawColors
 	NSMutableDictionary *privateColors;	// colors we might be asked to display, but should NOT be in the color picker
+	LDrawColorTable		*colorTable;	// code -> color lookup for both of the above, plus cached compliments
 }
 
 // Initialization
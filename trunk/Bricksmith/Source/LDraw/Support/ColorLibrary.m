@@ -113,13 +113,26 @@ static ColorLibrary	*sharedColorLibrary	= nil;
 {
 	self = [super init];
 	
-	colors = [[NSMutableDictionary alloc] init];
+	colors		= [[NSMutableDictionary alloc] init];
+	colorTable	= LDrawColorTableCreate();
 	
 	return self;
 
 }//end init
 
 
+//========== dealloc ===========================================================
+//
+// Purpose:		The end is nigh.
+//
+//==============================================================================
+- (void) dealloc
+{
+	LDrawColorTableFree(colorTable);
+	
+}//end dealloc
+
+
 #pragma mark -
 #pragma mark ACCESSORS
 #pragma mark -
@@ -147,16 +160,20 @@ static ColorLibrary	*sharedColorLibrary	= nil;
 //				no such color number is registered. This method also searches 
 //				the shared library, since its colors have global scope. 
 //
+// Notes:		This is called for every line of every file we parse, so it 
+//				goes through the color table rather than boxing the code to 
+//				probe the dictionaries. The table already resolves public colors 
+//				ahead of private ones. 
+//
 //==============================================================================
 - (LDrawColor *) colorForCode:(LDrawColorT)colorCode
 {
-	NSNumber	*key	= [NSNumber numberWithInteger:colorCode];
-	LDrawColor	*color	= [self->colors objectForKey:key];
+	LDrawColorTableEntry	*entry	= LDrawColorTableLookup(self->colorTable, colorCode);
+	LDrawColor				*color	= nil;
 	
-	// Try searching the private colors.
-	if(color == nil)
+	if(entry != NULL)
 	{
-		color = [self->privateColors objectForKey:key];
+		color = (__bridge LDrawColor *)entry->color;
 	}
 	
 	// Try the shared library.
@@ -195,12 +212,23 @@ static ColorLibrary	*sharedColorLibrary	= nil;
 //				visual looks a lot more realistic when red has an edge color of, 
 //				say, pink. 
 //
+//				The answer for each of our own codes is cached in the color 
+//				table, and thrown away whenever a color is registered. Codes we 
+//				only know by way of the shared library are worked out each time, 
+//				since their edge codes still have to resolve against us. 
+//
 //==============================================================================
 - (void) getComplimentRGBA:(float *)complimentRGBA
 				   forCode:(LDrawColorT)colorCode
 {
-	LDrawColor	*mainColor		= [self colorForCode:colorCode];
-	LDrawColorT	 edgeColorCode	= LDrawColorBogus;
+	LDrawColorTableEntry	*entry			= LDrawColorTableLookup(self->colorTable, colorCode);
+	LDrawColor				*mainColor		= nil;
+	LDrawColorT				 edgeColorCode	= LDrawColorBogus;
+	
+	if(entry != NULL && LDrawColorTableGetCompliment(self->colorTable, entry, complimentRGBA))
+		return;
+	
+	mainColor = [self colorForCode:colorCode];
 	
 	if(mainColor != nil)
 	{
@@ -212,6 +240,9 @@ static ColorLibrary	*sharedColorLibrary	= nil;
 			[mainColor getEdgeColorRGBA:complimentRGBA];
 		else
 			[[self colorForCode:edgeColorCode] getColorRGBA:complimentRGBA];
+		
+		if(entry != NULL)
+			LDrawColorTableSetCompliment(self->colorTable, entry, complimentRGBA);
 	}
 	
 }//end complimentColorForCode:
@@ -232,6 +263,7 @@ static ColorLibrary	*sharedColorLibrary	= nil;
 	NSNumber	*key		= [NSNumber numberWithInteger:colorCode];
 
 	[self->colors setObject:newColor forKey:key];
+	LDrawColorTableInsert(self->colorTable, colorCode, (__bridge void *)newColor);
 	
 }//end addColor:
 
@@ -259,6 +291,10 @@ static ColorLibrary	*sharedColorLibrary	= nil;
 
 	[self->privateColors setObject:newColor forKey:key];
 	
+	// A public color with the same code takes precedence.
+	if([self->colors objectForKey:key] == nil)
+		LDrawColorTableInsert(self->colorTable, colorCode, (__bridge void *)newColor);
+	
 }//end addPrivateColor:
 
 
@@ -0,0 +1,117 @@
+//==============================================================================
+//
+// File:		LDrawAtomicWrite.c
+//
+// Purpose:		Saving cache files in one piece, and hashing their names.
+//
+//==============================================================================
+#include "LDrawAtomicWrite.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== writeAll ==========================================================
+//
+// Purpose:		write() which carries on after short writes and interruptions.
+//
+//==============================================================================
+static bool writeAll(int fileDescriptor, const void *bytes, size_t length)
+{
+	const char	*position	= bytes;
+	ssize_t		result		= 0;
+
+	while(length > 0)
+	{
+		result = write(fileDescriptor, position, length);
+		if(result < 0 && errno == EINTR)
+			continue;
+		if(result <= 0)
+			return false;
+
+		position	+= result;
+		length		-= (size_t)result;
+	}
+
+	return true;
+
+}//end writeAll
+
+
+#pragma mark -
+#pragma mark WRITING
+#pragma mark -
+
+//========== LDrawAtomicWrite ==================================================
+//
+// Purpose:		Saves the sections to path, replacing any file already there.
+//
+//==============================================================================
+bool LDrawAtomicWrite(const char *path, const LDrawWriteSection *sections, size_t sectionCount)
+{
+	size_t	pathLength		= strlen(path);
+	char	*temporaryPath	= malloc(pathLength + 16);
+	int		fileDescriptor	= -1;
+	size_t	counter			= 0;
+	bool	success			= false;
+
+	if(temporaryPath == NULL)
+		return false;
+
+	// Another thread or process may be writing the same file; give each
+	// writer its own temporary file. Whoever renames last wins, and both
+	// wrote the same thing.
+	snprintf(temporaryPath, pathLength + 16, "%s.XXXXXX", path);
+	fileDescriptor = mkstemp(temporaryPath);
+
+	if(fileDescriptor >= 0)
+	{
+		success = (fchmod(fileDescriptor, 0644) == 0);
+		for(counter = 0; success && counter < sectionCount; counter++)
+			success = writeAll(fileDescriptor, sections[counter].bytes, sections[counter].length);
+
+		success = (close(fileDescriptor) == 0) && success;
+		success = success && (rename(temporaryPath, path) == 0);
+
+		if(success == false)
+			unlink(temporaryPath);
+	}
+
+	free(temporaryPath);
+
+	return success;
+
+}//end LDrawAtomicWrite
+
+
+#pragma mark -
+#pragma mark HASHING
+#pragma mark -
+
+//========== LDrawFNV1a ========================================================
+//
+// Purpose:		Continues a 64-bit FNV-1a hash with length more bytes.
+//
+//==============================================================================
+uint64_t LDrawFNV1a(uint64_t hash, const void *bytes, size_t length)
+{
+	const uint8_t	*position	= bytes;
+	size_t			counter		= 0;
+
+	for(counter = 0; counter < length; counter++)
+	{
+		hash ^= position[counter];
+		hash *= LDRAW_FNV_PRIME;
+	}
+
+	return hash;
+
+}//end LDrawFNV1a
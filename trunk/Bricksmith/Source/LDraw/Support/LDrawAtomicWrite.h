@@ -0,0 +1,54 @@
+//==============================================================================
+//
+// File:		LDrawAtomicWrite.h
+//
+// Purpose:		What the binary caches (compiled parts, the part catalog and
+//				smoothed meshes) share when saving and naming their files.
+//
+//				A file is written whole under a temporary name and renamed into
+//				place, so a reader never maps a half-written one, and several
+//				writers of the same file don't trip over each other.
+//
+//==============================================================================
+#ifndef _LDrawAtomicWrite_
+#define _LDrawAtomicWrite_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a.
+#define LDRAW_FNV_OFFSET_BASIS		0xCBF29CE484222325ULL
+#define LDRAW_FNV_PRIME				0x00000100000001B3ULL
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// One run of bytes of the file, in the order they are written.
+typedef struct LDrawWriteSectionStruct
+{
+	const void		*bytes;
+	size_t			length;
+
+} LDrawWriteSection;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Saves the sections to path, replacing any file already there. On failure
+// the old file, if any, is left as it was.
+bool		LDrawAtomicWrite(const char *path, const LDrawWriteSection *sections, size_t sectionCount);
+
+// Continues an FNV-1a hash with length more bytes. Start from
+// LDRAW_FNV_OFFSET_BASIS.
+uint64_t	LDrawFNV1a(uint64_t hash, const void *bytes, size_t length);
+
+#endif // _LDrawAtomicWrite_
@@ -0,0 +1,245 @@
+//==============================================================================
+//
+// File:		LDrawColorTable.c
+//
+// Purpose:		Direct-indexed color lookup with an open-addressed overflow.
+//
+// Notes:		Colors are looked up from the parsing threads while the main
+//				thread may be filling in compliments. A compliment is written
+//				first and published by storing the generation with release
+//				semantics; readers load the generation with acquire semantics
+//				before trusting the components. Registering colors is not
+//				thread-safe, same as it never was.
+//
+//==============================================================================
+#include "LDrawColorTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define OVERFLOW_INITIAL_CAPACITY	16
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== overflowSlot ======================================================
+//
+// Purpose:		Returns the first slot to probe for code.
+//
+//==============================================================================
+static inline uint32_t overflowSlot(int32_t code, uint32_t capacity)
+{
+	return ((uint32_t)code * 0x9E3779B1u) & (capacity - 1);
+}
+
+
+//========== insertOverflow ====================================================
+//
+// Purpose:		Puts code in the overflow table, which must have room. Returns
+//				the entry, existing or new.
+//
+//==============================================================================
+static LDrawColorTableEntry *insertOverflow(LDrawColorTable *table, int32_t code)
+{
+	uint32_t				mask	= table->overflowCapacity - 1;
+	uint32_t				slot	= overflowSlot(code, table->overflowCapacity);
+	LDrawColorTableEntry	*entry	= NULL;
+
+	while(true)
+	{
+		entry = &table->overflow[slot];
+
+		if(entry->color == NULL)
+		{
+			entry->code = code;
+			table->overflowCount++;
+			return entry;
+		}
+		if(entry->code == code)
+			return entry;
+
+		slot = (slot + 1) & mask;
+	}
+
+}//end insertOverflow
+
+
+//========== growOverflow ======================================================
+//
+// Purpose:		Doubles the overflow table, keeping it at most half full.
+//
+//==============================================================================
+static bool growOverflow(LDrawColorTable *table)
+{
+	LDrawColorTableEntry	*oldEntries		= table->overflow;
+	uint32_t				oldCapacity		= table->overflowCapacity;
+	uint32_t				newCapacity		= (oldCapacity > 0) ? oldCapacity * 2 : OVERFLOW_INITIAL_CAPACITY;
+	LDrawColorTableEntry	*newEntries		= calloc(newCapacity, sizeof(LDrawColorTableEntry));
+	uint32_t				counter			= 0;
+
+	if(newEntries == NULL)
+		return false;
+
+	table->overflow			= newEntries;
+	table->overflowCapacity	= newCapacity;
+	table->overflowCount	= 0;
+
+	for(counter = 0; counter < oldCapacity; counter++)
+	{
+		if(oldEntries[counter].color != NULL)
+			*insertOverflow(table, oldEntries[counter].code) = oldEntries[counter];
+	}
+	free(oldEntries);
+
+	return true;
+
+}//end growOverflow
+
+
+#pragma mark -
+#pragma mark TABLE
+#pragma mark -
+
+//========== LDrawColorTableCreate =============================================
+//
+// Purpose:		Returns an empty table.
+//
+//==============================================================================
+LDrawColorTable *LDrawColorTableCreate(void)
+{
+	LDrawColorTable *table = calloc(1, sizeof(LDrawColorTable));
+
+	// Zero means "never computed" in the entries.
+	if(table)
+		table->generation = 1;
+
+	return table;
+
+}//end LDrawColorTableCreate
+
+
+//========== LDrawColorTableFree ===============================================
+//
+// Purpose:		Releases the table. The colors themselves are not ours.
+//
+//==============================================================================
+void LDrawColorTableFree(LDrawColorTable *table)
+{
+	if(table != NULL)
+	{
+		free(table->overflow);
+		free(table);
+	}
+}
+
+
+//========== LDrawColorTableInsert =============================================
+//
+// Purpose:		Files color under code, replacing any color already there.
+//				Returns false only if memory ran out.
+//
+// Notes:		A compliment can depend on any other color in the table (its
+//				edge may be given as another code), so changing one color
+//				invalidates all of them. Re-registering the same color, which
+//				happens every time a model's colors are collected, changes
+//				nothing.
+//
+//==============================================================================
+bool LDrawColorTableInsert(LDrawColorTable *table, int32_t code, void *color)
+{
+	LDrawColorTableEntry	*entry	= NULL;
+
+	if((uint32_t)code < LDRAW_COLOR_TABLE_DENSE_COUNT)
+	{
+		entry		= &table->dense[code];
+		entry->code	= code;
+	}
+	else
+	{
+		entry = LDrawColorTableLookupOverflow(table, code);
+		if(entry == NULL)
+		{
+			if(		(table->overflowCount + 1) * 2 > table->overflowCapacity
+			   &&	growOverflow(table) == false )
+			{
+				return false;
+			}
+			entry = insertOverflow(table, code);
+		}
+	}
+
+	if(entry->color != color)
+	{
+		entry->color = color;
+		table->generation++;
+	}
+
+	return true;
+
+}//end LDrawColorTableInsert
+
+
+//========== LDrawColorTableLookupOverflow =====================================
+//
+// Purpose:		Finds a code outside the directly-indexed range.
+//
+//==============================================================================
+LDrawColorTableEntry *LDrawColorTableLookupOverflow(const LDrawColorTable *table, int32_t code)
+{
+	uint32_t				mask	= table->overflowCapacity - 1;
+	uint32_t				slot	= 0;
+	LDrawColorTableEntry	*entry	= NULL;
+
+	if(table->overflowCount == 0)
+		return NULL;
+
+	slot = overflowSlot(code, table->overflowCapacity);
+	while(true)
+	{
+		entry = &table->overflow[slot];
+
+		if(entry->color == NULL)
+			return NULL;
+		if(entry->code == code)
+			return entry;
+
+		slot = (slot + 1) & mask;
+	}
+
+}//end LDrawColorTableLookupOverflow
+
+
+#pragma mark -
+#pragma mark COMPLIMENTS
+#pragma mark -
+
+//========== LDrawColorTableGetCompliment ======================================
+//
+// Purpose:		Copies out the entry's compliment if it has been computed since
+//				the table last changed. Returns false if it must be computed.
+//
+//==============================================================================
+bool LDrawColorTableGetCompliment(const LDrawColorTable *table, const LDrawColorTableEntry *entry, float *complimentRGBA)
+{
+	if(__atomic_load_n(&entry->complimentGeneration, __ATOMIC_ACQUIRE) != table->generation)
+		return false;
+
+	memcpy(complimentRGBA, entry->complimentRGBA, sizeof(entry->complimentRGBA));
+	return true;
+
+}//end LDrawColorTableGetCompliment
+
+
+//========== LDrawColorTableSetCompliment ======================================
+//
+// Purpose:		Remembers the entry's compliment until the table changes.
+//
+//==============================================================================
+void LDrawColorTableSetCompliment(const LDrawColorTable *table, LDrawColorTableEntry *entry, const float *complimentRGBA)
+{
+	memcpy(entry->complimentRGBA, complimentRGBA, sizeof(entry->complimentRGBA));
+	__atomic_store_n(&entry->complimentGeneration, table->generation, __ATOMIC_RELEASE);
+
+}//end LDrawColorTableSetCompliment
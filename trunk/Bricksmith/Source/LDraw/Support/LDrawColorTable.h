@@ -0,0 +1,89 @@
+//==============================================================================
+//
+// File:		LDrawColorTable.h
+//
+// Purpose:		The lookup structure behind ColorLibrary: color code -> color,
+//				plus a cache of each color's compliment (edge) components.
+//
+//				Codes 0-511, which cover ldconfig.ldr's colors and the old
+//				dithered colors, are indexed directly. Anything else (private
+//				codes, file-local colors beyond 511) goes in a small
+//				open-addressed overflow table. A lookup never allocates and
+//				for the common codes is a bounds check and a load.
+//
+//				Colors are stored as borrowed pointers; the owner of the table
+//				keeps them alive.
+//
+//==============================================================================
+#ifndef _LDrawColorTable_
+#define _LDrawColorTable_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LDRAW_COLOR_TABLE_DENSE_COUNT	512
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct LDrawColorTableEntryStruct
+{
+	void		*color;						// NULL if the slot is empty
+	int32_t		code;
+	uint32_t	complimentGeneration;		// complimentRGBA is valid if this
+	float		complimentRGBA[4];			// matches the table's generation
+
+} LDrawColorTableEntry;
+
+
+typedef struct LDrawColorTableStruct
+{
+	LDrawColorTableEntry	dense[LDRAW_COLOR_TABLE_DENSE_COUNT];
+
+	LDrawColorTableEntry	*overflow;
+	uint32_t				overflowCapacity;	// zero or a power of two
+	uint32_t				overflowCount;
+
+	uint32_t				generation;			// bumped whenever a color changes
+
+} LDrawColorTable;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+LDrawColorTable *		LDrawColorTableCreate(void);
+void					LDrawColorTableFree(LDrawColorTable *table);
+
+bool					LDrawColorTableInsert(LDrawColorTable *table, int32_t code, void *color);
+LDrawColorTableEntry *	LDrawColorTableLookupOverflow(const LDrawColorTable *table, int32_t code);
+
+bool					LDrawColorTableGetCompliment(const LDrawColorTable *table, const LDrawColorTableEntry *entry, float *complimentRGBA);
+void					LDrawColorTableSetCompliment(const LDrawColorTable *table, LDrawColorTableEntry *entry, const float *complimentRGBA);
+
+
+//========== LDrawColorTableLookup =============================================
+//
+// Purpose:		Returns the entry for code, or NULL if it has no color.
+//
+//==============================================================================
+static inline LDrawColorTableEntry *LDrawColorTableLookup(const LDrawColorTable *table, int32_t code)
+{
+	if((uint32_t)code < LDRAW_COLOR_TABLE_DENSE_COUNT)
+	{
+		const LDrawColorTableEntry *entry = &table->dense[code];
+		return (entry->color != NULL) ? (LDrawColorTableEntry *)entry : NULL;
+	}
+
+	return LDrawColorTableLookupOverflow(table, code);
+}
+
+#endif // _LDrawColorTable_
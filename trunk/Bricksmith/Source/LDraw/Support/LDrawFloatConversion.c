@@ -0,0 +1,456 @@
+//==============================================================================
+//
+// File:		LDrawFloatConversion.c
+//
+// Purpose:		Exact, locale-independent float parsing and printing.
+//
+// Notes:		Parsing uses Clinger's fast path: up to 2^53 in the significand
+//				and a power of ten no larger than 10^22 are both exact doubles,
+//				so their product (or quotient) is the correctly rounded double.
+//				Rounding that double to a float again is only unsafe when it
+//				sits right on the midpoint between two floats, in which case
+//				(as with anything else out of the fast path's reach) we hand the
+//				text to strtof_l() in the C locale. Real LDraw numbers almost
+//				never get there.
+//
+//				Printing tries 1, 2, ... 9 significant digits. At each length
+//				the two decimals bracketing the value are candidates; the first
+//				length at which one of them reads back as the same float wins.
+//				Nine digits always suffice for a float.
+//
+//==============================================================================
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// strtof_l on glibc
+#endif
+
+#include "LDrawFloatConversion.h"
+
+#include <float.h>
+#include <locale.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+static const double PowersOfTen[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+#define MAX_EXACT_POWER			22
+#define MAX_EXACT_SIGNIFICAND	(1ULL << 53)
+
+// The bits a double has beyond a float's 24-bit significand, and the pattern
+// they have at the midpoint between two floats.
+#define EXTRA_BITS_MASK			((1ULL << 29) - 1)
+#define EXTRA_BITS_MIDPOINT		(1ULL << 28)
+
+static locale_t			CLocale			= (locale_t)0;
+static pthread_once_t	CLocaleOnce		= PTHREAD_ONCE_INIT;
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== createCLocale =====================================================
+//
+// Purpose:		pthread_once callback which makes the locale for strtof_l.
+//
+//==============================================================================
+static void createCLocale(void)
+{
+	CLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+
+//========== slowStringToFloat =================================================
+//
+// Purpose:		Correctly rounded conversion of a NUL-terminated string, for
+//				the cases the fast path can't decide.
+//
+//==============================================================================
+static float slowStringToFloat(const char *string)
+{
+	pthread_once(&CLocaleOnce, createCLocale);
+
+	return strtof_l(string, NULL, CLocale);
+}
+
+
+//========== fastDecimalToFloat ================================================
+//
+// Purpose:		Converts significand * 10^exponent to the nearest float.
+//				Returns false, without setting *floatOut, if that can't be done
+//				exactly in double precision.
+//
+//==============================================================================
+static bool fastDecimalToFloat(uint64_t significand, int exponent, float *floatOut)
+{
+	double		value		= 0;
+	uint64_t	bits		= 0;
+	uint64_t	extraBits	= 0;
+
+	if(significand == 0)
+	{
+		*floatOut = 0;
+		return true;
+	}
+	if(significand > MAX_EXACT_SIGNIFICAND || exponent < -MAX_EXACT_POWER || exponent > MAX_EXACT_POWER)
+		return false;
+
+	value = (double)significand;
+	if(exponent >= 0)
+		value *= PowersOfTen[exponent];
+	else
+		value /= PowersOfTen[-exponent];
+
+	// Denormal floats round at a different bit; overflow is strtof's call.
+	if(value < FLT_MIN || value > FLT_MAX)
+		return false;
+
+	// The true value is within half a double ulp of value. If value is within
+	// one ulp of a float midpoint, the true value may be on the other side.
+	memcpy(&bits, &value, sizeof(bits));
+	extraBits = bits & EXTRA_BITS_MASK;
+	if(extraBits + 1 >= EXTRA_BITS_MIDPOINT && extraBits <= EXTRA_BITS_MIDPOINT + 1)
+		return false;
+
+	*floatOut = (float)value;
+	return true;
+
+}//end fastDecimalToFloat
+
+
+//========== writeUnsigned =====================================================
+//
+// Purpose:		Writes the decimal digits of value; returns how many.
+//
+//==============================================================================
+static size_t writeUnsigned(uint64_t value, char *buffer)
+{
+	char	reversed[24];
+	size_t	length		= 0;
+	size_t	counter		= 0;
+
+	do
+	{
+		reversed[length++]	= (char)('0' + value % 10);
+		value				/= 10;
+	}
+	while(value != 0);
+
+	for(counter = 0; counter < length; counter++)
+		buffer[counter] = reversed[length - 1 - counter];
+
+	return length;
+
+}//end writeUnsigned
+
+
+//========== decimalToFloat ====================================================
+//
+// Purpose:		Exact conversion of significand * 10^exponent, fast path or not.
+//
+//==============================================================================
+static float decimalToFloat(uint64_t significand, int exponent)
+{
+	float	result		= 0;
+	char	string[48];
+	size_t	length		= 0;
+
+	if(fastDecimalToFloat(significand, exponent, &result) == false)
+	{
+		length				= writeUnsigned(significand, string);
+		string[length++]	= 'e';
+		if(exponent < 0)
+		{
+			string[length++]	= '-';
+			exponent			= -exponent;
+		}
+		length			+= writeUnsigned((uint64_t)exponent, string + length);
+		string[length]	= '\0';
+
+		result = slowStringToFloat(string);
+	}
+
+	return result;
+
+}//end decimalToFloat
+
+
+//========== scaleByPowerOfTen =================================================
+//
+// Purpose:		Returns value * 10^exponent, correctly rounded when |exponent|
+//				is 22 or less and close to it otherwise.
+//
+//==============================================================================
+static double scaleByPowerOfTen(double value, int exponent)
+{
+	while(exponent > MAX_EXACT_POWER)
+	{
+		value		*= PowersOfTen[MAX_EXACT_POWER];
+		exponent	-= MAX_EXACT_POWER;
+	}
+	while(exponent < -MAX_EXACT_POWER)
+	{
+		value		/= PowersOfTen[MAX_EXACT_POWER];
+		exponent	+= MAX_EXACT_POWER;
+	}
+
+	if(exponent >= 0)
+		return value * PowersOfTen[exponent];
+	else
+		return value / PowersOfTen[-exponent];
+
+}//end scaleByPowerOfTen
+
+
+#pragma mark -
+#pragma mark CONVERSION
+#pragma mark -
+
+//========== LDrawFloatFromChars ===============================================
+//
+// Purpose:		Reads a decimal number from bytes, which need not be
+//				NUL-terminated.
+//
+//==============================================================================
+float LDrawFloatFromChars(const char *bytes, size_t length, size_t *usedOut)
+{
+	size_t		position		= 0;
+	bool		negative		= false;
+	uint64_t	significand		= 0;
+	int			digitCount		= 0;		// significant digits kept
+	bool		sawDigit		= false;
+	bool		truncated		= false;	// dropped a nonzero digit
+	int			exponent		= 0;
+	float		result			= 0;
+
+	if(position < length && (bytes[position] == '-' || bytes[position] == '+'))
+	{
+		negative = (bytes[position] == '-');
+		position++;
+	}
+
+	// Integer part
+	while(position < length && bytes[position] >= '0' && bytes[position] <= '9')
+	{
+		sawDigit = true;
+		if(digitCount < 19)
+		{
+			significand = significand * 10 + (uint64_t)(bytes[position] - '0');
+			if(significand != 0)
+				digitCount++;
+		}
+		else
+		{
+			truncated	|= (bytes[position] != '0');
+			exponent	+= 1;
+		}
+		position++;
+	}
+
+	// Fraction
+	if(position < length && bytes[position] == '.')
+	{
+		position++;
+		while(position < length && bytes[position] >= '0' && bytes[position] <= '9')
+		{
+			sawDigit = true;
+			if(digitCount < 19)
+			{
+				significand = significand * 10 + (uint64_t)(bytes[position] - '0');
+				if(significand != 0)
+					digitCount++;
+				exponent--;
+			}
+			else
+				truncated |= (bytes[position] != '0');
+			position++;
+		}
+	}
+
+	if(sawDigit == false)
+	{
+		if(usedOut != NULL)
+			*usedOut = 0;
+		return 0;
+	}
+
+	// Exponent. Only consumed if at least one digit follows.
+	if(position + 1 < length && (bytes[position] == 'e' || bytes[position] == 'E'))
+	{
+		size_t	expPosition		= position + 1;
+		bool	expNegative		= false;
+		int		expValue		= 0;
+
+		if(bytes[expPosition] == '-' || bytes[expPosition] == '+')
+		{
+			expNegative = (bytes[expPosition] == '-');
+			expPosition++;
+		}
+		if(expPosition < length && bytes[expPosition] >= '0' && bytes[expPosition] <= '9')
+		{
+			while(expPosition < length && bytes[expPosition] >= '0' && bytes[expPosition] <= '9')
+			{
+				if(expValue < 100000)
+					expValue = expValue * 10 + (bytes[expPosition] - '0');
+				expPosition++;
+			}
+			exponent	+= expNegative ? -expValue : expValue;
+			position	= expPosition;
+		}
+	}
+
+	if(truncated == false)
+		result = decimalToFloat(significand, exponent);
+	else
+	{
+		// More than 19 significant digits. Let the C library see them all.
+		char	stackBuffer[128];
+		char	*string		= (position < sizeof(stackBuffer)) ? stackBuffer : malloc(position + 1);
+
+		memcpy(string, bytes, position);
+		string[position]	= '\0';
+		result				= fabsf(slowStringToFloat(string));
+
+		if(string != stackBuffer)
+			free(string);
+	}
+
+	if(usedOut != NULL)
+		*usedOut = position;
+
+	return negative ? -result : result;
+
+}//end LDrawFloatFromChars
+
+
+//========== LDrawFloatToChars =================================================
+//
+// Purpose:		Writes the shortest decimal which reads back as value.
+//
+// Notes:		Negative zero is written as "0". Trailing zeros and a bare
+//				decimal point are never written, so integers look like "8".
+//
+//==============================================================================
+size_t LDrawFloatToChars(float value, char *buffer)
+{
+	double		magnitude		= fabs((double)value);
+	float		target			= fabsf(value);
+	int			decimalPoint	= 0;	// value is in [10^decimalPoint, 10^(decimalPoint+1))
+	int			precision		= 0;
+	int			scale			= 0;
+	double		scaled			= 0;
+	uint64_t	candidates[2]	= {0, 0};
+	uint64_t	digits			= 0;
+	bool		found			= false;
+	char		digitString[24];
+	size_t		digitCount		= 0;
+	int			exponent		= 0;	// value == digits * 10^exponent
+	size_t		length			= 0;
+	int			counter			= 0;
+
+	if(isnan(value))
+	{
+		strcpy(buffer, "nan");
+		return 3;
+	}
+	if(value == 0)
+	{
+		strcpy(buffer, "0");
+		return 1;
+	}
+	if(value < 0)
+		buffer[length++] = '-';
+	if(isinf(value))
+	{
+		strcpy(buffer + length, "inf");
+		return length + 3;
+	}
+
+	decimalPoint = (int)floor(log10(magnitude));
+	if(scaleByPowerOfTen(magnitude, -decimalPoint) >= 10)
+		decimalPoint++;
+	else if(scaleByPowerOfTen(magnitude, -decimalPoint) < 1)
+		decimalPoint--;
+
+	for(precision = 1; precision <= 9 && found == false; precision++)
+	{
+		scale			= precision - 1 - decimalPoint;
+		scaled			= scaleByPowerOfTen(magnitude, scale);
+		candidates[0]	= (uint64_t)floor(scaled);
+		candidates[1]	= candidates[0] + 1;
+
+		for(counter = 0; counter < 2; counter++)
+		{
+			if(candidates[counter] == 0 || decimalToFloat(candidates[counter], -scale) != target)
+				continue;
+
+			// If both read back correctly, take the nearer one (even on a tie).
+			if(		found == false
+			   ||	fabs(candidates[counter] - scaled) < fabs(digits - scaled)
+			   ||	(fabs(candidates[counter] - scaled) == fabs(digits - scaled) && candidates[counter] % 2 == 0) )
+			{
+				digits		= candidates[counter];
+				exponent	= -scale;
+				found		= true;
+			}
+		}
+	}
+
+	// Can't happen; nine digits always identify a float.
+	if(found == false)
+	{
+		digits		= (uint64_t)llround(scaleByPowerOfTen(magnitude, 8 - decimalPoint));
+		exponent	= decimalPoint - 8;
+	}
+
+	digitCount = writeUnsigned(digits, digitString);
+	while(digitCount > 1 && digitString[digitCount - 1] == '0')
+	{
+		digitCount--;
+		exponent++;
+	}
+
+	// Lay the digits out in plain decimal notation.
+	if(exponent >= 0)
+	{
+		memcpy(buffer + length, digitString, digitCount);
+		length += digitCount;
+		for(counter = 0; counter < exponent; counter++)
+			buffer[length++] = '0';
+	}
+	else
+	{
+		int pointPosition = (int)digitCount + exponent;
+
+		if(pointPosition > 0)
+		{
+			memcpy(buffer + length, digitString, pointPosition);
+			length += pointPosition;
+			buffer[length++] = '.';
+			memcpy(buffer + length, digitString + pointPosition, digitCount - pointPosition);
+			length += digitCount - pointPosition;
+		}
+		else
+		{
+			buffer[length++] = '0';
+			buffer[length++] = '.';
+			for(counter = 0; counter < -pointPosition; counter++)
+				buffer[length++] = '0';
+			memcpy(buffer + length, digitString, digitCount);
+			length += digitCount;
+		}
+	}
+	buffer[length] = '\0';
+
+	return length;
+
+}//end LDrawFloatToChars
@@ -0,0 +1,39 @@
+//==============================================================================
+//
+// File:		LDrawFloatConversion.h
+//
+// Purpose:		Exact, locale-independent conversion between floats and the
+//				decimal text used in LDraw files, in the manner of C++'s
+//				from_chars/to_chars.
+//
+//				* LDrawFloatFromChars always returns the float nearest to the
+//				  decimal number written.
+//				* LDrawFloatToChars writes the shortest plain decimal (never
+//				  exponential notation) which reads back as exactly the same
+//				  float.
+//
+//				Together they guarantee that saving a file, loading it and
+//				saving it again reproduces every number byte for byte.
+//
+//==============================================================================
+#ifndef _LDrawFloatConversion_
+#define _LDrawFloatConversion_
+
+#include <stddef.h>
+
+// Longest string LDrawFloatToChars can write, including the terminating NUL.
+// (The smallest denormal is "0." followed by 44 zeros and two digits.)
+#define LDRAW_FLOAT_CHARS_MAX	64
+
+
+// Reads a decimal number: optional sign, digits, optional fraction, optional
+// exponent. Stops at the first character which doesn't belong; if there is no
+// number at all, returns 0. If usedOut is not NULL, the number of bytes read
+// is returned there.
+float	LDrawFloatFromChars(const char *bytes, size_t length, size_t *usedOut);
+
+// Writes value into buffer, which must hold LDRAW_FLOAT_CHARS_MAX bytes.
+// Returns the length written, not counting the terminating NUL.
+size_t	LDrawFloatToChars(float value, char *buffer);
+
+#endif // _LDrawFloatConversion_
@@ -0,0 +1,306 @@
+//==============================================================================
+//
+// File:		LDrawHeaderScanner.c
+//
+// Purpose:		Reads a model's metadata without parsing the model.
+//
+// Notes:		The rules follow the ones the part catalog and
+//				-[LDrawModel parseHeaderFromLines:beginningAtIndex:] have
+//				always applied:
+//
+//				* The description is the first line, if it is a comment. A
+//				  blank or non-comment first line means there is none.
+//				* A header line is one whose first field is exactly "0", or a
+//				  blank one. Fields are separated by runs of whitespace.
+//				* Values are the rest of the line after their keyword, trimmed.
+//
+//				An MPD file's leading 0 FILE line is not part of its first
+//				model's header; it is reported separately.
+//
+//==============================================================================
+#include "LDrawHeaderScanner.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "LDrawLineTokenizer.h"
+
+// Headers are read in pieces of this size until the first non-header line.
+#define HEADER_READ_SIZE		4096
+
+// Fields before the name on a type 1 line: code, color, x y z, a b c d e f g h i.
+#define TYPE_1_FIELDS_BEFORE_NAME	14
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== restOfLine ========================================================
+//
+// Purpose:		Returns the trimmed span of everything after the first
+//				fieldCount fields of the line, with offsets relative to
+//				lineOffset.
+//
+//==============================================================================
+static LDrawLineSpan restOfLine(const char *line, size_t length, size_t lineOffset, int fieldCount)
+{
+	size_t			position	= 0;
+	size_t			end			= length;
+	int				counter		= 0;
+	LDrawLineSpan	rest;
+
+	for(counter = 0; counter < fieldCount; counter++)
+	{
+		position	= LDrawSkipWhitespace(line, length, position);
+		position	= LDrawFieldEnd(line, length, position);
+	}
+	position = LDrawSkipWhitespace(line, length, position);
+
+	// Trailing whitespace; LDrawSkipWhitespace's idea of it.
+	while(end > position && LDrawSkipWhitespace(line, end, end - 1) == end)
+		end--;
+
+	rest.offset	= lineOffset + position;
+	rest.length	= end - position;
+
+	return rest;
+
+}//end restOfLine
+
+
+//========== fieldIs ===========================================================
+//
+// Purpose:		Returns whether field number fieldIndex (from zero) of the line
+//				is exactly keyword.
+//
+//==============================================================================
+static bool fieldIs(const char *line, size_t length, int fieldIndex, const char *keyword)
+{
+	size_t	start			= 0;
+	size_t	end				= 0;
+	size_t	keywordLength	= strlen(keyword);
+	int		counter			= 0;
+
+	for(counter = 0; counter <= fieldIndex; counter++)
+	{
+		start	= LDrawSkipWhitespace(line, length, end);
+		end		= LDrawFieldEnd(line, length, start);
+	}
+
+	return (end - start == keywordLength && memcmp(line + start, keyword, keywordLength) == 0);
+
+}//end fieldIs
+
+
+#pragma mark -
+#pragma mark HEADER
+#pragma mark -
+
+//========== LDrawScanModelHeader ==============================================
+//
+// Purpose:		Finds the header fields in bytes, which hold the beginning of a
+//				file (or all of it, if isWholeFile).
+//
+//				If the bytes run out before the header does, isComplete is
+//				false and the caller should try again with more of the file. A
+//				last line without a terminator can't be judged either, unless
+//				it is the end of the file.
+//
+//==============================================================================
+void LDrawScanModelHeader(const char *bytes, size_t length, bool isWholeFile, LDrawModelHeader *headerOut)
+{
+	LDrawLineScanner	scanner;
+	LDrawLineSpan		line;
+	LDrawLineSpan		absent			= { LDRAW_HEADER_FIELD_ABSENT, 0 };
+	LDrawLineSpan		*field			= NULL;
+	const char			*lineBytes		= NULL;
+	size_t				modelLineIndex	= 0;
+	size_t				start			= 0;
+	bool				isFirstLine		= true;
+
+	memset(headerOut, 0, sizeof(LDrawModelHeader));
+	headerOut->submodelName	= absent;
+	headerOut->description	= absent;
+	headerOut->name			= absent;
+	headerOut->author		= absent;
+	headerOut->category		= absent;
+	headerOut->ldrawOrg		= absent;
+	headerOut->headerLength	= length;
+	headerOut->isComplete	= isWholeFile;
+
+	LDrawLineScannerInitWithBytes(&scanner, bytes, length, LDrawDetectTextEncoding(bytes, length));
+
+	for(; LDrawLineScannerNext(&scanner, &line); isFirstLine = false)
+	{
+		lineBytes = bytes + line.offset;
+
+		// A partial line might turn out to be anything.
+		if(line.offset + line.length == length && isWholeFile == false)
+		{
+			headerOut->headerLength	= line.offset;
+			headerOut->isComplete	= false;
+			break;
+		}
+
+		// Blank lines belong to the header (but a blank first line means
+		// there is no description).
+		start = LDrawSkipWhitespace(lineBytes, line.length, 0);
+		if(start == line.length)
+		{
+			modelLineIndex++;
+			continue;
+		}
+
+		// Anything but a comment ends it.
+		if(fieldIs(lineBytes, line.length, 0, "0") == false)
+		{
+			headerOut->headerLength	= line.offset;
+			headerOut->isComplete	= true;
+			break;
+		}
+
+		field = NULL;
+
+		if(isFirstLine && fieldIs(lineBytes, line.length, 1, "FILE"))
+		{
+			// The MPD wrapper, not the model.
+			headerOut->submodelName = restOfLine(lineBytes, line.length, line.offset, 2);
+			continue;
+		}
+		else if(modelLineIndex == 0)
+		{
+			headerOut->description = restOfLine(lineBytes, line.length, line.offset, 1);
+		}
+		else if(fieldIs(lineBytes, line.length, 1, "Name:"))
+			field = &headerOut->name;
+		else if(fieldIs(lineBytes, line.length, 1, "Author:"))
+			field = &headerOut->author;
+		else if(fieldIs(lineBytes, line.length, 1, "!CATEGORY"))
+			field = &headerOut->category;
+		else if(fieldIs(lineBytes, line.length, 1, "!LDRAW_ORG"))
+			field = &headerOut->ldrawOrg;
+		else if(	fieldIs(lineBytes, line.length, 1, "!KEYWORDS")
+				&&	headerOut->keywordLineCount < LDRAW_HEADER_MAX_KEYWORD_LINES )
+		{
+			field = &headerOut->keywords[headerOut->keywordLineCount];
+			headerOut->keywordLineCount += 1;
+			*field = absent;
+		}
+
+		// The first of each field wins.
+		if(field != NULL && LDrawHeaderFieldIsPresent(*field) == false)
+			*field = restOfLine(lineBytes, line.length, line.offset, 2);
+
+		modelLineIndex++;
+	}
+
+	// The scan had to guess the encoding from bytes which might stop partway
+	// through a character; the header itself is what gets decoded.
+	headerOut->encoding = LDrawDetectTextEncoding(bytes, headerOut->headerLength);
+
+}//end LDrawScanModelHeader
+
+
+//========== LDrawReadModelHeader ==============================================
+//
+// Purpose:		Reads just enough of the file at path to find its header.
+//				Returns the bytes read, which the header's fields point into;
+//				the caller must free them. Returns NULL if the file can't be
+//				read.
+//
+// Notes:		For nearly every part this is one read of a few hundred bytes.
+//
+//==============================================================================
+char *LDrawReadModelHeader(const char *path, LDrawModelHeader *headerOut, size_t *lengthOut)
+{
+	int			fileDescriptor	= open(path, O_RDONLY | O_CLOEXEC);
+	char		*buffer			= NULL;
+	char		*grownBuffer	= NULL;
+	size_t		capacity		= 0;
+	size_t		length			= 0;
+	ssize_t		bytesRead		= 0;
+
+	if(fileDescriptor < 0)
+		return NULL;
+
+	while(true)
+	{
+		if(capacity - length < HEADER_READ_SIZE)
+		{
+			capacity	= (capacity > 0) ? capacity * 2 : HEADER_READ_SIZE;
+			grownBuffer	= realloc(buffer, capacity);
+			if(grownBuffer == NULL)
+			{
+				free(buffer);
+				buffer = NULL;
+				break;
+			}
+			buffer = grownBuffer;
+		}
+
+		bytesRead = read(fileDescriptor, buffer + length, HEADER_READ_SIZE);
+		if(bytesRead < 0 && errno == EINTR)
+			continue;
+		if(bytesRead < 0)
+		{
+			free(buffer);
+			buffer = NULL;
+			break;
+		}
+		length += (size_t)bytesRead;
+
+		LDrawScanModelHeader(buffer, length, bytesRead == 0, headerOut);
+		if(headerOut->isComplete)
+			break;
+	}
+	close(fileDescriptor);
+
+	*lengthOut = length;
+	return buffer;
+
+}//end LDrawReadModelHeader
+
+
+#pragma mark -
+#pragma mark REFERENCES
+#pragma mark -
+
+//========== LDrawScanReferences ===============================================
+//
+// Purpose:		Reports the name on every type 1 line, and every submodel the
+//				file defines, without tokenizing anything else.
+//
+//==============================================================================
+void LDrawScanReferences(const char *bytes, size_t length, LDrawTextEncodingT encoding, LDrawReferenceCallback callback, void *context)
+{
+	LDrawLineScanner	scanner;
+	LDrawLineSpan		line;
+	LDrawLineSpan		name;
+	const char			*lineBytes	= NULL;
+	int					lineType	= 0;
+
+	LDrawLineScannerInitWithBytes(&scanner, bytes, length, encoding);
+
+	while(LDrawLineScannerNext(&scanner, &line))
+	{
+		lineBytes	= bytes + line.offset;
+		lineType	= LDrawLineTypeOfBytes(lineBytes, line.length);
+
+		if(lineType == 1)
+		{
+			name = restOfLine(lineBytes, line.length, line.offset, TYPE_1_FIELDS_BEFORE_NAME);
+			if(name.length > 0)
+				callback(context, bytes + name.offset, name.length, false);
+		}
+		else if(lineType == 0 && LDrawLineIsMetaCommand(lineBytes, line.length, "FILE"))
+		{
+			name = restOfLine(lineBytes, line.length, line.offset, 2);
+			callback(context, bytes + name.offset, name.length, true);
+		}
+	}
+
+}//end LDrawScanReferences
@@ -0,0 +1,89 @@
+//==============================================================================
+//
+// File:		LDrawHeaderScanner.h
+//
+// Purpose:		Reads a model's metadata without parsing the model.
+//
+//				The header of an LDraw file is its leading run of comment and
+//				blank lines:
+//
+//				0 Brick  2 x  4
+//				0 Name: 3001.dat
+//				0 Author: James Jessiman
+//				0 !LDRAW_ORG Part UPDATE 2004-03
+//				0 !CATEGORY Brick
+//				0 !KEYWORDS Classic, Basic Brick
+//
+//				It ends at the first line which is neither, which in practice
+//				is the first geometry line. The scanner records where each
+//				field's value lies and stops there; from a file it only reads
+//				that far. The files a model references can be listed by a
+//				separate pass which looks at nothing but the names on type 1
+//				lines.
+//
+//==============================================================================
+#ifndef _LDrawHeaderScanner_
+#define _LDrawHeaderScanner_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "LDrawMappedFile.h"
+
+#define LDRAW_HEADER_MAX_KEYWORD_LINES	32
+#define LDRAW_HEADER_FIELD_ABSENT		((size_t)-1)	// offset of a missing field
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Each field is the trimmed span of its value within the scanned bytes.
+typedef struct LDrawModelHeaderStruct
+{
+	LDrawLineSpan		submodelName;		// 0 FILE, if the file is an MPD
+	LDrawLineSpan		description;		// the first line of the model
+	LDrawLineSpan		name;				// 0 Name:
+	LDrawLineSpan		author;				// 0 Author:
+	LDrawLineSpan		category;			// 0 !CATEGORY (the first)
+	LDrawLineSpan		ldrawOrg;			// 0 !LDRAW_ORG (the first)
+	LDrawLineSpan		keywords[LDRAW_HEADER_MAX_KEYWORD_LINES];	// 0 !KEYWORDS, one per line
+	size_t				keywordLineCount;
+
+	size_t				headerLength;		// offset of the first line after the header
+	bool				isComplete;			// false if the bytes ran out inside the header
+	LDrawTextEncodingT	encoding;
+
+} LDrawModelHeader;
+
+
+// Called for each referenced file name (type 1 lines), and for each submodel
+// defined in the file (0 FILE), in file order.
+typedef void (*LDrawReferenceCallback)(void *context, const char *name, size_t length, bool isSubmodel);
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+void	LDrawScanModelHeader(const char *bytes, size_t length, bool isWholeFile, LDrawModelHeader *headerOut);
+char	*LDrawReadModelHeader(const char *path, LDrawModelHeader *headerOut, size_t *lengthOut);
+void	LDrawScanReferences(const char *bytes, size_t length, LDrawTextEncodingT encoding, LDrawReferenceCallback callback, void *context);
+
+
+//========== LDrawHeaderFieldIsPresent =========================================
+//
+// Purpose:		Returns whether the header had the field at all. A present field
+//				can still be empty.
+//
+//==============================================================================
+static inline bool LDrawHeaderFieldIsPresent(LDrawLineSpan field)
+{
+	return field.offset != LDRAW_HEADER_FIELD_ABSENT;
+}
+
+#endif // _LDrawHeaderScanner_
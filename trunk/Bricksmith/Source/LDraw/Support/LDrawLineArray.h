@@ -0,0 +1,76 @@
+//==============================================================================
+//
+// File:		LDrawLineArray.h
+//
+// Purpose:		An immutable array of the lines of an LDraw file, backed
+//				directly by the file's bytes (see LDrawMappedFile.h).
+//
+//				It can go anywhere the parser expects the NSArray of NSStrings
+//				-separateByLine used to produce, but a line only becomes a
+//				string when someone asks for it with -objectAtIndex:. Code which
+//				knows about this class can read the raw bytes of a line instead
+//				and skip the string entirely.
+//
+//				LDrawLineStream reads a file's lines one at a time instead of
+//				indexing them all up front, and hands out runs of them as line
+//				arrays of their own. A large MPD file can then be split into 
+//				its submodels, each parsed as soon as its last line is found, 
+//				without ever holding an index of the whole file.
+//
+//==============================================================================
+#import <Foundation/Foundation.h>
+
+#import "LDrawMappedFile.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// LDrawLineArray
+//
+////////////////////////////////////////////////////////////////////////////////
+@interface LDrawLineArray : NSArray
+{
+	LDrawMappedFile		*file;
+	id					owner;			// keeps borrowed bytes alive
+	NSStringEncoding	stringEncoding;
+}
+
+// Initialization
++ (LDrawLineArray *) linesFromFile:(NSString *)path;
++ (LDrawLineArray *) linesFromData:(NSData *)fileData;
+
+// Accessors
+- (const char *) bytesForLineAtIndex:(NSUInteger)index length:(size_t *)lengthOut;
+- (NSString *) stringWithBytes:(const char *)bytes length:(size_t)length;
+- (NSStringEncoding) stringEncoding;
+
+@end
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// LDrawLineStream
+//
+////////////////////////////////////////////////////////////////////////////////
+@interface LDrawLineStream : NSObject
+{
+	LDrawMappedFile		*file;			// unindexed
+	NSData				*backingData;
+	LDrawLineScanner	scanner;
+	LDrawLineScanner	previousScanner;	// for -putBackLine
+
+	LDrawLineSpan		*pendingLines;	// read since the last -takeLines
+	size_t				pendingCount;
+	size_t				pendingCapacity;
+}
+
+// Initialization
++ (LDrawLineStream *) streamFromFile:(NSString *)path;
++ (LDrawLineStream *) streamFromData:(NSData *)fileData;
+
+// Reading
+- (const char *) nextLineWithLength:(size_t *)lengthOut;
+- (void) putBackLine;
+- (LDrawLineArray *) takeLines;
+
+@end
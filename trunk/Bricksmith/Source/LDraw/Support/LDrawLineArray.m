@@ -0,0 +1,396 @@
+//==============================================================================
+//
+// File:		LDrawLineArray.m
+//
+// Purpose:		An immutable array of the lines of an LDraw file, backed
+//				directly by the file's bytes, and a stream which reads lines
+//				without indexing the whole file.
+//
+//==============================================================================
+#import "LDrawLineArray.h"
+
+
+@interface LDrawLineArray ()
+
+- (id) initWithMappedFile:(LDrawMappedFile *)fileIn owner:(id)ownerIn;
+
+@end
+
+
+@interface LDrawLineStream ()
+
+- (id) initWithMappedFile:(LDrawMappedFile *)fileIn backingData:(NSData *)dataIn;
+
+@end
+
+
+@implementation LDrawLineArray
+
+#pragma mark -
+#pragma mark INITIALIZATION
+#pragma mark -
+
+//---------- linesFromFile: ------------------------------------------[static]--
+//
+// Purpose:		Maps the file at path and indexes its lines. Returns nil if the
+//				file can't be read.
+//
+//------------------------------------------------------------------------------
++ (LDrawLineArray *) linesFromFile:(NSString *)path
+{
+	LDrawMappedFile *mappedFile = NULL;
+
+	if(path != nil)
+		mappedFile = LDrawMappedFileOpen([path fileSystemRepresentation]);
+
+	if(mappedFile == NULL)
+		return nil;
+
+	return [[LDrawLineArray alloc] initWithMappedFile:mappedFile owner:nil];
+
+}//end linesFromFile:
+
+
+//---------- linesFromData: ------------------------------------------[static]--
+//
+// Purpose:		Indexes the lines of file contents which are already in memory.
+//				The data is retained, not copied.
+//
+//------------------------------------------------------------------------------
++ (LDrawLineArray *) linesFromData:(NSData *)fileData
+{
+	LDrawMappedFile *mappedFile = NULL;
+
+	if(fileData != nil)
+		mappedFile = LDrawMappedFileWrapBytes([fileData bytes], [fileData length]);
+
+	if(mappedFile == NULL)
+		return nil;
+
+	return [[LDrawLineArray alloc] initWithMappedFile:mappedFile owner:fileData];
+
+}//end linesFromData:
+
+
+//========== initWithMappedFile:owner: =========================================
+//
+// Purpose:		Designated initializer. Takes ownership of fileIn; ownerIn is 
+//				whatever holds the bytes it borrows, if anything.
+//
+//==============================================================================
+- (id) initWithMappedFile:(LDrawMappedFile *)fileIn owner:(id)ownerIn
+{
+	self = [super init];
+
+	if(self)
+	{
+		file	= fileIn;
+		owner	= ownerIn;
+
+		switch(file->encoding)
+		{
+			case LDrawTextEncodingASCII:	stringEncoding = NSASCIIStringEncoding;			break;
+			case LDrawTextEncodingUTF8:		stringEncoding = NSUTF8StringEncoding;			break;
+			case LDrawTextEncodingLatin1:	stringEncoding = NSISOLatin1StringEncoding;		break;
+		}
+	}
+	else
+		LDrawMappedFileClose(fileIn);
+
+	return self;
+
+}//end initWithMappedFile:owner:
+
+
+#pragma mark -
+#pragma mark ACCESSORS
+#pragma mark -
+
+//========== count =============================================================
+//
+// Purpose:		NSArray primitive.
+//
+//==============================================================================
+- (NSUInteger) count
+{
+	return file->lineCount;
+
+}//end count
+
+
+//========== objectAtIndex: ====================================================
+//
+// Purpose:		NSArray primitive. Decodes the line into a new string.
+//
+//==============================================================================
+- (id) objectAtIndex:(NSUInteger)index
+{
+	const char  *bytes  = NULL;
+	size_t      length  = 0;
+
+	bytes = [self bytesForLineAtIndex:index length:&length];
+
+	return [self stringWithBytes:bytes length:length];
+
+}//end objectAtIndex:
+
+
+//========== bytesForLineAtIndex:length: =======================================
+//
+// Purpose:		Returns the undecoded bytes of the line, without its terminator.
+//				They are NOT NUL-terminated, and stay valid as long as the
+//				receiver does.
+//
+//==============================================================================
+- (const char *) bytesForLineAtIndex:(NSUInteger)index length:(size_t *)lengthOut
+{
+	if(index >= file->lineCount)
+	{
+		[NSException raise:NSRangeException
+					format:@"index %lu beyond bounds [0 .. %lu]", (unsigned long)index, (unsigned long)file->lineCount];
+	}
+
+	*lengthOut = file->lines[index].length;
+
+	return file->bytes + file->lines[index].offset;
+
+}//end bytesForLineAtIndex:length:
+
+
+//========== stringWithBytes:length: ===========================================
+//
+// Purpose:		Decodes part of a line (such as a part name) in the file's
+//				encoding.
+//
+//==============================================================================
+- (NSString *) stringWithBytes:(const char *)bytes length:(size_t)length
+{
+	NSString *string = [[NSString alloc] initWithBytes:bytes length:length encoding:stringEncoding];
+
+	// Can't happen: the encoding was chosen because the whole file decodes.
+	if(string == nil)
+		string = @"";
+
+	return string;
+
+}//end stringWithBytes:length:
+
+
+//========== stringEncoding ====================================================
+//
+// Purpose:		The encoding in which the file was found to be written.
+//
+//==============================================================================
+- (NSStringEncoding) stringEncoding
+{
+	return self->stringEncoding;
+
+}//end stringEncoding
+
+
+#pragma mark -
+#pragma mark DESTRUCTOR
+#pragma mark -
+
+//========== dealloc ===========================================================
+//
+// Purpose:		Unmaps the file.
+//
+//==============================================================================
+- (void) dealloc
+{
+	LDrawMappedFileClose(file);
+
+}//end dealloc
+
+
+@end
+
+
+
+#pragma mark -
+
+
+@implementation LDrawLineStream
+
+#pragma mark -
+#pragma mark INITIALIZATION
+#pragma mark -
+
+//---------- streamFromFile: -----------------------------------------[static]--
+//
+// Purpose:		Maps the file at path, ready to read its lines. Returns nil if 
+//				the file can't be read.
+//
+//------------------------------------------------------------------------------
++ (LDrawLineStream *) streamFromFile:(NSString *)path
+{
+	LDrawMappedFile *mappedFile = NULL;
+
+	if(path != nil)
+		mappedFile = LDrawMappedFileOpenUnindexed([path fileSystemRepresentation]);
+
+	if(mappedFile == NULL)
+		return nil;
+
+	return [[LDrawLineStream alloc] initWithMappedFile:mappedFile backingData:nil];
+
+}//end streamFromFile:
+
+
+//---------- streamFromData: -----------------------------------------[static]--
+//
+// Purpose:		Reads the lines of file contents which are already in memory.
+//				The data is retained, not copied.
+//
+//------------------------------------------------------------------------------
++ (LDrawLineStream *) streamFromData:(NSData *)fileData
+{
+	LDrawMappedFile *mappedFile = NULL;
+
+	if(fileData != nil)
+		mappedFile = LDrawMappedFileWrapBytesUnindexed([fileData bytes], [fileData length]);
+
+	if(mappedFile == NULL)
+		return nil;
+
+	return [[LDrawLineStream alloc] initWithMappedFile:mappedFile backingData:fileData];
+
+}//end streamFromData:
+
+
+//========== initWithMappedFile:backingData: ===================================
+//
+// Purpose:		Designated initializer. Takes ownership of fileIn.
+//
+//==============================================================================
+- (id) initWithMappedFile:(LDrawMappedFile *)fileIn backingData:(NSData *)dataIn
+{
+	self = [super init];
+
+	if(self)
+	{
+		file		= fileIn;
+		backingData	= dataIn;
+
+		LDrawLineScannerInit(&scanner, file);
+		previousScanner = scanner;
+	}
+	else
+		LDrawMappedFileClose(fileIn);
+
+	return self;
+
+}//end initWithMappedFile:backingData:
+
+
+#pragma mark -
+#pragma mark READING
+#pragma mark -
+
+//========== nextLineWithLength: ===============================================
+//
+// Purpose:		Reads the next line and adds it to the pending run. Returns its 
+//				undecoded bytes (not NUL-terminated, without the terminator), or
+//				NULL at the end of the file.
+//
+//==============================================================================
+- (const char *) nextLineWithLength:(size_t *)lengthOut
+{
+	LDrawLineScanner	savedScanner	= scanner;
+	LDrawLineSpan		*grownLines		= NULL;
+	size_t				grownCapacity	= 0;
+	LDrawLineSpan		line;
+
+	if(LDrawLineScannerNext(&scanner, &line) == NO)
+		return NULL;
+
+	if(pendingCount == pendingCapacity)
+	{
+		grownCapacity	= (pendingCapacity > 0) ? pendingCapacity * 2 : 256;
+		grownLines		= realloc(pendingLines, grownCapacity * sizeof(LDrawLineSpan));
+		if(grownLines == NULL)
+			[NSException raise:NSMallocException format:@"Out of memory reading lines"];
+
+		pendingLines	= grownLines;
+		pendingCapacity	= grownCapacity;
+	}
+	pendingLines[pendingCount] = line;
+	pendingCount	+= 1;
+	previousScanner	= savedScanner;
+
+	*lengthOut = line.length;
+	return file->bytes + line.offset;
+
+}//end nextLineWithLength:
+
+
+//========== putBackLine =======================================================
+//
+// Purpose:		Un-reads the line last returned by -nextLineWithLength:, so it 
+//				will be returned again and won't be in the pending run. Only 
+//				one line can be put back.
+//
+//==============================================================================
+- (void) putBackLine
+{
+	if(pendingCount > 0)
+	{
+		pendingCount	-= 1;
+		scanner			= previousScanner;
+	}
+
+}//end putBackLine
+
+
+//========== takeLines =========================================================
+//
+// Purpose:		Returns the lines read since the last call as an array, or nil 
+//				if there weren't any. The array keeps the file open after the 
+//				stream is gone.
+//
+//==============================================================================
+- (LDrawLineArray *) takeLines
+{
+	LDrawLineSpan	*fittedLines	= NULL;
+	LDrawMappedFile	*run			= NULL;
+
+	if(pendingCount == 0)
+		return nil;
+
+	// The run gets the span storage; shrink it to fit.
+	fittedLines = realloc(pendingLines, pendingCount * sizeof(LDrawLineSpan));
+	if(fittedLines == NULL)
+		fittedLines = pendingLines;
+	run = LDrawMappedFileWrapLines(file, fittedLines, pendingCount);
+
+	pendingLines	= NULL;
+	pendingCount	= 0;
+	pendingCapacity	= 0;
+
+	if(run == NULL)
+		return nil;
+
+	return [[LDrawLineArray alloc] initWithMappedFile:run owner:self];
+
+}//end takeLines
+
+
+#pragma mark -
+#pragma mark DESTRUCTOR
+#pragma mark -
+
+//========== dealloc ===========================================================
+//
+// Purpose:		Unmaps the file. Line arrays still using it keep us alive.
+//
+//==============================================================================
+- (void) dealloc
+{
+	free(pendingLines);
+	LDrawMappedFileClose(file);
+
+}//end dealloc
+
+
+@end
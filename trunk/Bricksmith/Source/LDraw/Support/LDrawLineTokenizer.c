@@ -0,0 +1,273 @@
+//==============================================================================
+//
+// File:		LDrawLineTokenizer.c
+//
+// Purpose:		Allocation-free parsing of LDraw geometry lines (types 1-5).
+//
+// Notes:		The scanning rules mirror the ones the Objective-C parsers have
+//				always used via +[LDrawUtilities readNextField:remainder:], so
+//				that files parse exactly as they did before:
+//
+//				* Fields are separated by runs of whitespace of any length.
+//				* A missing or non-numeric field reads as 0, just like
+//				  -[NSString floatValue].
+//				* The name on a type 1 line is everything after the last matrix
+//				  field, trimmed; it may contain spaces (MPD references).
+//
+//==============================================================================
+#include "LDrawLineTokenizer.h"
+
+#include <string.h>
+
+#include "LDrawFloatConversion.h"
+
+
+//========== isLineWhitespace ==================================================
+//
+// Purpose:		The byte-level equivalent of
+//				+[NSCharacterSet whitespaceAndNewlineCharacterSet] for the ASCII
+//				range.
+//
+//==============================================================================
+static inline bool isLineWhitespace(char c)
+{
+	return (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f');
+}
+
+
+//========== LDrawSkipWhitespace ===============================================
+//
+// Purpose:		Returns the index of the first non-whitespace byte at or after
+//				position, or length if there is none.
+//
+//==============================================================================
+size_t LDrawSkipWhitespace(const char *bytes, size_t length, size_t position)
+{
+	while(position < length && isLineWhitespace(bytes[position]))
+		position++;
+
+	return position;
+}
+
+
+//========== LDrawFieldEnd =====================================================
+//
+// Purpose:		Returns the index one past the last byte of the field beginning
+//				at position.
+//
+//==============================================================================
+size_t LDrawFieldEnd(const char *bytes, size_t length, size_t position)
+{
+	while(position < length && isLineWhitespace(bytes[position]) == false)
+		position++;
+
+	return position;
+}
+
+
+//========== LDrawParseIntField ================================================
+//
+// Purpose:		Reads a decimal integer the way -[NSString intValue] does: an
+//				optional sign followed by digits, stopping at the first
+//				character which doesn't belong.
+//
+//==============================================================================
+int LDrawParseIntField(const char *field, size_t length)
+{
+	size_t	position	= 0;
+	bool	negative	= false;
+	long	value		= 0;
+
+	if(position < length && (field[position] == '-' || field[position] == '+'))
+	{
+		negative = (field[position] == '-');
+		position++;
+	}
+	while(position < length && field[position] >= '0' && field[position] <= '9')
+	{
+		value = value * 10 + (field[position] - '0');
+		if(value > INT32_MAX)
+			value = INT32_MAX;
+		position++;
+	}
+
+	return (int)(negative ? -value : value);
+
+}//end LDrawParseIntField
+
+
+//========== LDrawParseFloatField ==============================================
+//
+// Purpose:		Reads a decimal floating-point number: optional sign, digits,
+//				optional fraction, optional exponent. Anything unparseable reads
+//				as 0, as with -[NSString floatValue].
+//
+// Notes:		The result is the nearest float to the text, so that numbers
+//				written by LDrawFloatToChars come back unchanged.
+//
+//==============================================================================
+float LDrawParseFloatField(const char *field, size_t length)
+{
+	return LDrawFloatFromChars(field, length, NULL);
+
+}//end LDrawParseFloatField
+
+
+//========== LDrawLineValueCountForType ========================================
+//
+// Purpose:		Returns the number of numeric fields which follow the color
+//				code on a line of the given type.
+//
+//==============================================================================
+int LDrawLineValueCountForType(int lineType)
+{
+	switch(lineType)
+	{
+		case 1:		return 12;	// x y z a b c d e f g h i
+		case 2:		return 6;	// two vertices
+		case 3:		return 9;	// three vertices
+		case 4:		return 12;	// four vertices
+		case 5:		return 12;	// two vertices and two control points
+		default:	return 0;
+	}
+}
+
+
+//========== LDrawLineTypeOfBytes ==============================================
+//
+// Purpose:		Returns the line code which begins the line, or -1 if it isn't
+//				one of the codes LDraw defines.
+//
+//==============================================================================
+int LDrawLineTypeOfBytes(const char *bytes, size_t length)
+{
+	size_t	start		= LDrawSkipWhitespace(bytes, length, 0);
+	size_t	end			= LDrawFieldEnd(bytes, length, start);
+	int		lineType	= -1;
+
+	if(end > start)
+	{
+		lineType = LDrawParseIntField(bytes + start, end - start);
+		if(lineType < 0 || lineType > 5)
+			lineType = -1;
+	}
+
+	return lineType;
+}
+
+
+//========== LDrawLineIsMetaCommand =============================================
+//
+// Purpose:		Tests the first two fields of the line without decoding it, the
+//				way -lineIsStepTerminator: and friends test them with
+//				-readNextField:remainder:.
+//
+//==============================================================================
+bool LDrawLineIsMetaCommand(const char *bytes, size_t length, const char *command)
+{
+	size_t	start			= LDrawSkipWhitespace(bytes, length, 0);
+	size_t	end				= LDrawFieldEnd(bytes, length, start);
+	size_t	commandLength	= strlen(command);
+
+	if(end - start != 1 || bytes[start] != '0')
+		return false;
+
+	start	= LDrawSkipWhitespace(bytes, length, end);
+	end		= LDrawFieldEnd(bytes, length, start);
+
+	return (end - start == commandLength && memcmp(bytes + start, command, commandLength) == 0);
+}
+
+
+//========== LDrawTokenizeGeometryLine =========================================
+//
+// Purpose:		Parses one line of type 1, 2, 3, 4 or 5 into lineOut.
+//
+//				Line formats:
+//				1 colour x y z a b c d e f g h i part.dat
+//				2 colour x1 y1 z1 x2 y2 z2
+//				3 colour x1 y1 z1 x2 y2 z2 x3 y3 z3
+//				4 colour x1 y1 z1 x2 y2 z2 x3 y3 z3 x4 y4 z4
+//				5 colour x1 y1 z1 x2 y2 z2 x3 y3 z3 x4 y4 z4
+//
+// Notes:		bytes need not be NUL-terminated. For type 1 lines, lineOut->name
+//				points back into bytes, so it is only valid while they are.
+//
+//==============================================================================
+bool LDrawTokenizeGeometryLine(const char *bytes, size_t length, LDrawGeometryLine *lineOut)
+{
+	size_t	position		= 0;
+	size_t	fieldEnd		= 0;
+	int		expectedValues	= 0;
+	int		counter			= 0;
+
+	memset(lineOut, 0, sizeof(LDrawGeometryLine));
+
+	// Line code
+	lineOut->lineType = LDrawLineTypeOfBytes(bytes, length);
+	if(lineOut->lineType < 1)
+		return false;
+
+	position	= LDrawSkipWhitespace(bytes, length, 0);
+	position	= LDrawFieldEnd(bytes, length, position);
+
+	// Color. Either a color code or the 0x2RRGGBB custom RGB extension.
+	position	= LDrawSkipWhitespace(bytes, length, position);
+	fieldEnd	= LDrawFieldEnd(bytes, length, position);
+	if(fieldEnd - position > 2 && bytes[position] == '0' && (bytes[position + 1] == 'x' || bytes[position + 1] == 'X'))
+	{
+		size_t		hexPosition	= position + 2;
+		uint32_t	hexValue	= 0;
+
+		for(; hexPosition < fieldEnd; hexPosition++)
+		{
+			char	c		= bytes[hexPosition];
+			int		digit	= 0;
+
+			if(c >= '0' && c <= '9')		digit = c - '0';
+			else if(c >= 'a' && c <= 'f')	digit = c - 'a' + 10;
+			else if(c >= 'A' && c <= 'F')	digit = c - 'A' + 10;
+			else							break;
+
+			hexValue = (hexValue << 4) | (uint32_t)digit;
+		}
+		lineOut->isCustomRGB	= true;
+		lineOut->customRGB		= hexValue;
+	}
+	else
+	{
+		lineOut->colorCode		= LDrawParseIntField(bytes + position, fieldEnd - position);
+	}
+	position = fieldEnd;
+
+	// Numbers
+	expectedValues = LDrawLineValueCountForType(lineOut->lineType);
+	for(counter = 0; counter < expectedValues; counter++)
+	{
+		position	= LDrawSkipWhitespace(bytes, length, position);
+		if(position >= length)
+			break;
+
+		fieldEnd	= LDrawFieldEnd(bytes, length, position);
+		lineOut->values[counter] = LDrawParseFloatField(bytes + position, fieldEnd - position);
+		lineOut->valueCount += 1;
+		position	= fieldEnd;
+	}
+
+	// Part name -- the whole trimmed rest of the line, since MPD references
+	// can have spaces in them.
+	if(lineOut->lineType == 1)
+	{
+		size_t	nameEnd	= length;
+
+		position = LDrawSkipWhitespace(bytes, length, position);
+		while(nameEnd > position && isLineWhitespace(bytes[nameEnd - 1]))
+			nameEnd--;
+
+		lineOut->name		= bytes + position;
+		lineOut->nameLength	= nameEnd - position;
+	}
+
+	return true;
+
+}//end LDrawTokenizeGeometryLine
@@ -0,0 +1,73 @@
+//==============================================================================
+//
+// File:		LDrawLineTokenizer.h
+//
+// Purpose:		Allocation-free parsing of LDraw geometry lines (types 1-5).
+//
+//				The Objective-C parsers used to peel fields off a line one
+//				NSString at a time, which built two temporary strings per
+//				field. These routines instead scan a raw UTF-8 byte range once
+//				and deposit the results in a packed struct. Nothing is
+//				allocated; the only reference kept into the source bytes is the
+//				span of the part name for type 1 lines.
+//
+//==============================================================================
+#ifndef _LDrawLineTokenizer_
+#define _LDrawLineTokenizer_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Most numeric fields on any geometry line: type 1 has x y z a b c d e f g h i,
+// and conditional lines have four vertices.
+#define LDRAW_LINE_MAX_VALUES	12
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// A tokenized type 1-5 line.
+typedef struct LDrawGeometryLineStruct
+{
+	int				lineType;						// 1 through 5
+	int				colorCode;						// LDraw color code; meaningless if isCustomRGB
+	bool			isCustomRGB;					// color field was written as 0x2RRGGBB etc.
+	uint32_t		customRGB;						// the hex value following 0x, if isCustomRGB
+	int				valueCount;						// numeric fields actually present on the line
+	float			values[LDRAW_LINE_MAX_VALUES];	// in file order; missing fields are 0
+	const char		*name;							// type 1 only: points into the source bytes
+	size_t			nameLength;						// type 1 only
+
+} LDrawGeometryLine;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Number of numeric fields following the color on a line of the given type.
+int		LDrawLineValueCountForType(int lineType);
+
+// Returns the line type code (0-5) at the start of the line, or -1.
+int		LDrawLineTypeOfBytes(const char *bytes, size_t length);
+
+// Returns true if the line is "0 <command>", with nothing after the command
+// word or more fields (e.g. "0 FILE name.ldr" matches "FILE").
+bool	LDrawLineIsMetaCommand(const char *bytes, size_t length, const char *command);
+
+// Parses a type 1-5 line. Returns false if the line is not a geometry line.
+bool	LDrawTokenizeGeometryLine(const char *bytes, size_t length, LDrawGeometryLine *lineOut);
+
+// Primitive field scanners, exposed for other fast-path parsers.
+size_t	LDrawSkipWhitespace(const char *bytes, size_t length, size_t position);
+size_t	LDrawFieldEnd(const char *bytes, size_t length, size_t position);
+float	LDrawParseFloatField(const char *field, size_t length);
+int		LDrawParseIntField(const char *field, size_t length);
+
+#endif // _LDrawLineTokenizer_
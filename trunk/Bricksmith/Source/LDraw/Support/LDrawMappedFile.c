@@ -0,0 +1,551 @@
+//==============================================================================
+//
+// File:		LDrawMappedFile.c
+//
+// Purpose:		Zero-copy ingestion of LDraw files.
+//
+// Notes:		The results must match what we got from decoding the whole file
+//				into an NSString and calling -separateByLine on it:
+//
+//				* The encoding is UTF-8 if the bytes are valid UTF-8, and
+//				  Latin-1 otherwise (which is what +stringFromFileData: settled
+//				  on; every byte sequence is valid Latin-1, so its MacRoman
+//				  fallback was never reached).
+//				* A leading UTF-8 byte order mark is not part of the first line.
+//				* Lines end at LF, CR, CRLF, NEL, LS or PS, like
+//				  -[NSString getLineStart:end:contentsEnd:forRange:]. A final
+//				  terminator does not start an empty last line.
+//
+//==============================================================================
+#include "LDrawMappedFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Below this size a file is simply read into memory. Mapping has a fixed cost
+// (the mmap call itself plus a page fault for every page touched) which is
+// more than a copy of the small .dat files that make up most of the library.
+#define LDRAW_MAP_THRESHOLD		(64 * 1024)
+
+#define HIGH_BITS				0x8080808080808080ULL
+
+
+#pragma mark -
+#pragma mark ENCODING
+#pragma mark -
+
+//========== skipASCII =========================================================
+//
+// Purpose:		Returns the index of the first byte at or after position which
+//				has its high bit set, or length if there is none.
+//
+// Notes:		Checks eight bytes per step (SWAR), which is where nearly all
+//				the time goes: real LDraw files are almost entirely ASCII.
+//
+//==============================================================================
+static size_t skipASCII(const unsigned char *bytes, size_t length, size_t position)
+{
+	uint64_t	word		= 0;
+	uint64_t	highBits	= 0;
+
+	while(position + 8 <= length)
+	{
+		memcpy(&word, bytes + position, sizeof(word));
+		highBits = word & HIGH_BITS;
+		if(highBits != 0)
+		{
+			// Little-endian: the lowest set bit belongs to the first offending
+			// byte.
+			return position + (__builtin_ctzll(highBits) >> 3);
+		}
+		position += 8;
+	}
+	while(position < length && bytes[position] < 0x80)
+		position++;
+
+	return position;
+
+}//end skipASCII
+
+
+//========== utf8SequenceLength ================================================
+//
+// Purpose:		Returns the length of the well-formed UTF-8 sequence beginning
+//				at bytes, or 0 if it is malformed (overlong, surrogate, out of
+//				range or truncated). See Table 3-7 of the Unicode Standard.
+//
+//==============================================================================
+static size_t utf8SequenceLength(const unsigned char *bytes, size_t available)
+{
+	unsigned char	lead		= bytes[0];
+	unsigned char	low			= 0x80;	// bounds for the second byte
+	unsigned char	high		= 0xBF;
+	size_t			length		= 0;
+	size_t			counter		= 0;
+
+	if(lead < 0x80)
+		return 1;
+	else if(lead >= 0xC2 && lead <= 0xDF)
+		length = 2;
+	else if(lead >= 0xE0 && lead <= 0xEF)
+	{
+		length = 3;
+		if(lead == 0xE0)	low  = 0xA0;
+		if(lead == 0xED)	high = 0x9F;
+	}
+	else if(lead >= 0xF0 && lead <= 0xF4)
+	{
+		length = 4;
+		if(lead == 0xF0)	low  = 0x90;
+		if(lead == 0xF4)	high = 0x8F;
+	}
+	else
+		return 0;
+
+	if(available < length)
+		return 0;
+	if(bytes[1] < low || bytes[1] > high)
+		return 0;
+	for(counter = 2; counter < length; counter++)
+	{
+		if(bytes[counter] < 0x80 || bytes[counter] > 0xBF)
+			return 0;
+	}
+
+	return length;
+
+}//end utf8SequenceLength
+
+
+//========== LDrawDetectTextEncoding ===========================================
+//
+// Purpose:		Works out how to decode the file in a single pass: ASCII if
+//				there are no high bytes, UTF-8 if every high byte is part of a
+//				well-formed sequence, Latin-1 otherwise.
+//
+//==============================================================================
+LDrawTextEncodingT LDrawDetectTextEncoding(const char *bytes, size_t length)
+{
+	const unsigned char	*unsignedBytes	= (const unsigned char *)bytes;
+	size_t				position		= 0;
+	size_t				sequenceLength	= 0;
+	LDrawTextEncodingT	encoding		= LDrawTextEncodingASCII;
+
+	while(true)
+	{
+		position = skipASCII(unsignedBytes, length, position);
+		if(position >= length)
+			break;
+
+		sequenceLength = utf8SequenceLength(unsignedBytes + position, length - position);
+		if(sequenceLength == 0)
+		{
+			encoding = LDrawTextEncodingLatin1;
+			break;
+		}
+		encoding	= LDrawTextEncodingUTF8;
+		position	+= sequenceLength;
+	}
+
+	return encoding;
+
+}//end LDrawDetectTextEncoding
+
+
+#pragma mark -
+#pragma mark LINES
+#pragma mark -
+
+//========== terminatorLength ==================================================
+//
+// Purpose:		Returns the length of the line terminator at position, or 0 if
+//				there isn't one there.
+//
+//==============================================================================
+static inline size_t terminatorLength(const unsigned char *bytes, size_t length, size_t position, LDrawTextEncodingT encoding)
+{
+	unsigned char	c	= bytes[position];
+
+	if(c == '\n')
+		return 1;
+
+	else if(c == '\r')
+		return (position + 1 < length && bytes[position + 1] == '\n') ? 2 : 1;
+
+	else if(c == 0x85 && encoding == LDrawTextEncodingLatin1)
+		return 1; // NEL
+
+	else if(encoding == LDrawTextEncodingUTF8)
+	{
+		if(c == 0xC2 && position + 1 < length && bytes[position + 1] == 0x85)
+			return 2; // NEL
+		if(		c == 0xE2 && position + 2 < length && bytes[position + 1] == 0x80
+		   &&	(bytes[position + 2] == 0xA8 || bytes[position + 2] == 0xA9) )
+			return 3; // LS, PS
+	}
+
+	return 0;
+
+}//end terminatorLength
+
+
+//========== LDrawLineScannerInitWithBytes =====================================
+//
+// Purpose:		Positions the scanner at the first line of the bytes, past any
+//				byte order mark.
+//
+//==============================================================================
+void LDrawLineScannerInitWithBytes(LDrawLineScanner *scanner, const char *bytes, size_t length, LDrawTextEncodingT encoding)
+{
+	scanner->bytes		= bytes;
+	scanner->length		= length;
+	scanner->encoding	= encoding;
+	scanner->position	= 0;
+
+	if(		encoding == LDrawTextEncodingUTF8 && length >= 3
+	   &&	memcmp(bytes, "\xEF\xBB\xBF", 3) == 0 )
+	{
+		scanner->position = 3;
+	}
+
+}//end LDrawLineScannerInitWithBytes
+
+
+//========== LDrawLineScannerInit ==============================================
+//
+// Purpose:		Prepares to read the lines of file from the top.
+//
+//==============================================================================
+void LDrawLineScannerInit(LDrawLineScanner *scanner, const LDrawMappedFile *file)
+{
+	LDrawLineScannerInitWithBytes(scanner, file->bytes, file->length, file->encoding);
+
+}//end LDrawLineScannerInit
+
+
+//========== LDrawLineScannerNext ==============================================
+//
+// Purpose:		Finds the next line. Returns false once there are no more.
+//
+// Notes:		The scanner is a plain value: copying it saves the position, and
+//				copying it back returns there.
+//
+//==============================================================================
+bool LDrawLineScannerNext(LDrawLineScanner *scanner, LDrawLineSpan *lineOut)
+{
+	const unsigned char	*unsignedBytes	= (const unsigned char *)scanner->bytes;
+	size_t				length			= scanner->length;
+	size_t				lineStart		= scanner->position;
+	size_t				position		= lineStart;
+	size_t				terminator		= 0;
+	unsigned char		c				= 0;
+
+	// A final terminator does not start an empty last line.
+	if(lineStart >= length)
+		return false;
+
+	while(position < length)
+	{
+		// Fast reject of ordinary text.
+		c = unsignedBytes[position];
+		if(c > '\r' && c < 0x80)
+		{
+			position++;
+			continue;
+		}
+		terminator = terminatorLength(unsignedBytes, length, position, scanner->encoding);
+		if(terminator > 0)
+			break;
+		position++;
+	}
+
+	lineOut->offset		= lineStart;
+	lineOut->length		= position - lineStart;
+	scanner->position	= position + terminator;
+
+	return true;
+
+}//end LDrawLineScannerNext
+
+
+//========== LDrawSplitLines ===================================================
+//
+// Purpose:		Records the span of every line in the bytes. Returns the number
+//				of lines; *linesOut is a malloc'd array the caller must free, or
+//				NULL if memory ran out.
+//
+//==============================================================================
+size_t LDrawSplitLines(const char *bytes, size_t length, LDrawTextEncodingT encoding, LDrawLineSpan **linesOut)
+{
+	LDrawLineScanner	scanner;
+	LDrawLineSpan		*lines			= NULL;
+	LDrawLineSpan		*grownLines		= NULL;
+	size_t				capacity		= length / 32 + 16; // LDraw lines average about 40 bytes
+	size_t				lineCount		= 0;
+
+	lines = malloc(capacity * sizeof(LDrawLineSpan));
+	if(lines == NULL)
+	{
+		*linesOut = NULL;
+		return 0;
+	}
+
+	LDrawLineScannerInitWithBytes(&scanner, bytes, length, encoding);
+	while(true)
+	{
+		if(lineCount == capacity)
+		{
+			capacity	*= 2;
+			grownLines	= realloc(lines, capacity * sizeof(LDrawLineSpan));
+			if(grownLines == NULL)
+			{
+				free(lines);
+				*linesOut = NULL;
+				return 0;
+			}
+			lines = grownLines;
+		}
+		if(LDrawLineScannerNext(&scanner, &lines[lineCount]) == false)
+			break;
+		lineCount += 1;
+	}
+
+	*linesOut = lines;
+	return lineCount;
+
+}//end LDrawSplitLines
+
+
+#pragma mark -
+#pragma mark FILES
+#pragma mark -
+
+//========== finishFile ========================================================
+//
+// Purpose:		Wraps the file's storage and, if asked, indexes its lines.
+//				Releases the storage if that fails.
+//
+//==============================================================================
+static LDrawMappedFile *finishFile(const char *bytes, size_t length, LDrawFileStorageT storage, bool indexLines)
+{
+	LDrawMappedFile	*file	= calloc(1, sizeof(LDrawMappedFile));
+
+	if(file != NULL)
+	{
+		file->bytes		= bytes;
+		file->length	= length;
+		file->storage	= storage;
+		file->encoding	= LDrawDetectTextEncoding(bytes, length);
+
+		if(indexLines)
+			file->lineCount = LDrawSplitLines(bytes, length, file->encoding, &file->lines);
+
+		if(indexLines && file->lines == NULL)
+		{
+			LDrawMappedFileClose(file);
+			file = NULL;
+		}
+	}
+	else if(storage == LDrawFileStorageMapped)
+		munmap((void *)bytes, length);
+	else if(storage == LDrawFileStorageAllocated)
+		free((void *)bytes);
+
+	return file;
+
+}//end finishFile
+
+
+//========== openFile ==========================================================
+//
+// Purpose:		Opens the file at path, mapping it if it is large.
+//
+// Notes:		Large files are mapped rather than read, so the file's pages
+//				are shared with the buffer cache and can be dropped under
+//				memory pressure; peak memory is roughly the file plus 16 bytes
+//				per line. As with any mapping, truncating the file while it is
+//				open faults the reader.
+//
+//==============================================================================
+static LDrawMappedFile *openFile(const char *path, bool indexLines)
+{
+	int			fileDescriptor	= open(path, O_RDONLY | O_CLOEXEC);
+	struct stat	fileInfo;
+	size_t		length			= 0;
+	size_t		bytesRead		= 0;
+	ssize_t		result			= 0;
+	char		*buffer			= NULL;
+	void		*mapping		= MAP_FAILED;
+
+	if(fileDescriptor < 0)
+		return NULL;
+
+	if(fstat(fileDescriptor, &fileInfo) != 0 || S_ISREG(fileInfo.st_mode) == false)
+	{
+		close(fileDescriptor);
+		return NULL;
+	}
+	length = (size_t)fileInfo.st_size;
+
+	if(length >= LDRAW_MAP_THRESHOLD)
+	{
+		mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if(mapping != MAP_FAILED)
+		{
+			madvise(mapping, length, MADV_SEQUENTIAL);
+			close(fileDescriptor);
+			return finishFile(mapping, length, LDrawFileStorageMapped, indexLines);
+		}
+	}
+
+	// Small file, or the mapping failed.
+	buffer = malloc(length > 0 ? length : 1);
+	if(buffer == NULL)
+	{
+		close(fileDescriptor);
+		return NULL;
+	}
+	while(bytesRead < length)
+	{
+		result = read(fileDescriptor, buffer + bytesRead, length - bytesRead);
+		if(result < 0 && errno == EINTR)
+			continue;
+		if(result <= 0)
+			break; // error, or the file shrank underneath us
+		bytesRead += (size_t)result;
+	}
+	close(fileDescriptor);
+
+	if(result < 0)
+	{
+		free(buffer);
+		return NULL;
+	}
+
+	return finishFile(buffer, bytesRead, LDrawFileStorageAllocated, indexLines);
+
+}//end openFile
+
+
+//========== LDrawMappedFileOpen ===============================================
+//
+// Purpose:		Opens the file at path and indexes its lines.
+//
+//==============================================================================
+LDrawMappedFile *LDrawMappedFileOpen(const char *path)
+{
+	return openFile(path, true);
+
+}//end LDrawMappedFileOpen
+
+
+//========== LDrawMappedFileOpenUnindexed ======================================
+//
+// Purpose:		Opens the file at path without looking for its lines. Peak
+//				memory is just the file.
+//
+//==============================================================================
+LDrawMappedFile *LDrawMappedFileOpenUnindexed(const char *path)
+{
+	return openFile(path, false);
+
+}//end LDrawMappedFileOpenUnindexed
+
+
+//========== LDrawMappedFileWrapBytes ==========================================
+//
+// Purpose:		Indexes bytes which are already in memory. They are not copied,
+//				so they must outlive the returned file.
+//
+//==============================================================================
+LDrawMappedFile *LDrawMappedFileWrapBytes(const void *bytes, size_t length)
+{
+	if(bytes == NULL)
+	{
+		bytes	= "";
+		length	= 0;
+	}
+	return finishFile(bytes, length, LDrawFileStorageBorrowed, true);
+
+}//end LDrawMappedFileWrapBytes
+
+
+//========== LDrawMappedFileWrapBytesUnindexed =================================
+//
+// Purpose:		LDrawMappedFileWrapBytes, without looking for the lines.
+//
+//==============================================================================
+LDrawMappedFile *LDrawMappedFileWrapBytesUnindexed(const void *bytes, size_t length)
+{
+	if(bytes == NULL)
+	{
+		bytes	= "";
+		length	= 0;
+	}
+	return finishFile(bytes, length, LDrawFileStorageBorrowed, false);
+
+}//end LDrawMappedFileWrapBytesUnindexed
+
+
+//========== LDrawMappedFileWrapLines ==========================================
+//
+// Purpose:		Makes a file of some of file's lines, as found by a scanner.
+//				Takes ownership of lines (malloc'd, offsets relative to file's
+//				bytes) even on failure. The encoding is file's, not worked out
+//				again: a run of lines can look like UTF-8 when the file as a
+//				whole is Latin-1.
+//
+//==============================================================================
+LDrawMappedFile *LDrawMappedFileWrapLines(const LDrawMappedFile *file, LDrawLineSpan *lines, size_t lineCount)
+{
+	LDrawMappedFile	*part	= calloc(1, sizeof(LDrawMappedFile));
+
+	if(part == NULL)
+	{
+		free(lines);
+		return NULL;
+	}
+
+	part->bytes		= file->bytes;
+	part->length	= file->length;
+	part->storage	= LDrawFileStorageBorrowed;
+	part->encoding	= file->encoding;
+	part->lines		= lines;
+	part->lineCount	= lineCount;
+
+	return part;
+
+}//end LDrawMappedFileWrapLines
+
+
+//========== LDrawMappedFileClose ==============================================
+//
+// Purpose:		Releases the file and everything it owns.
+//
+//==============================================================================
+void LDrawMappedFileClose(LDrawMappedFile *file)
+{
+	if(file == NULL)
+		return;
+
+	switch(file->storage)
+	{
+		case LDrawFileStorageMapped:
+			munmap((void *)file->bytes, file->length);
+			break;
+		case LDrawFileStorageAllocated:
+			free((void *)file->bytes);
+			break;
+		case LDrawFileStorageBorrowed:
+			break;
+	}
+	free(file->lines);
+	free(file);
+
+}//end LDrawMappedFileClose
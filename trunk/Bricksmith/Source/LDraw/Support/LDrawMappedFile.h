@@ -0,0 +1,109 @@
+//==============================================================================
+//
+// File:		LDrawMappedFile.h
+//
+// Purpose:		Zero-copy ingestion of LDraw files.
+//
+//				A file is memory-mapped (or, if it is small, read into a single
+//				buffer), its text encoding is worked out in one pass over the
+//				bytes, and its lines are recorded as spans into that storage.
+//				Nothing is decoded or copied per line; callers materialize
+//				strings only for the lines (or parts of lines) they need.
+//
+//==============================================================================
+#ifndef _LDrawMappedFile_
+#define _LDrawMappedFile_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// The encodings we accept, in the order +[LDrawUtilities stringFromFileData:]
+// has always tried them. Every byte sequence is valid Latin-1, so detection
+// never fails.
+typedef enum
+{
+	LDrawTextEncodingASCII		= 0,	// 7-bit only; also valid UTF-8 and Latin-1
+	LDrawTextEncodingUTF8		= 1,
+	LDrawTextEncodingLatin1		= 2
+
+} LDrawTextEncodingT;
+
+
+// Where a mapped file's bytes live.
+typedef enum
+{
+	LDrawFileStorageMapped		= 0,	// mmap(); unmapped on close
+	LDrawFileStorageAllocated	= 1,	// read() into malloc'd memory; freed on close
+	LDrawFileStorageBorrowed	= 2		// caller's memory; left alone on close
+
+} LDrawFileStorageT;
+
+
+// One line of the file, excluding its terminator.
+typedef struct LDrawLineSpanStruct
+{
+	size_t			offset;
+	size_t			length;
+
+} LDrawLineSpan;
+
+
+typedef struct LDrawMappedFileStruct
+{
+	const char			*bytes;
+	size_t				length;
+	LDrawFileStorageT	storage;
+	LDrawTextEncodingT	encoding;
+
+	LDrawLineSpan		*lines;			// NULL if the file was opened unindexed
+	size_t				lineCount;
+
+} LDrawMappedFile;
+
+
+// Hands out a file's lines one at a time, for readers which don't need the
+// whole index up front. Treat as opaque.
+typedef struct LDrawLineScannerStruct
+{
+	const char			*bytes;
+	size_t				length;
+	LDrawTextEncodingT	encoding;
+	size_t				position;		// start of the next line
+
+} LDrawLineScanner;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Opening and closing. The constructors return NULL on failure.
+LDrawMappedFile		*LDrawMappedFileOpen(const char *path);
+LDrawMappedFile		*LDrawMappedFileWrapBytes(const void *bytes, size_t length);
+void				LDrawMappedFileClose(LDrawMappedFile *file);
+
+// Streaming. An unindexed file has its encoding but no lines; scan them as
+// needed, and wrap runs of them in files of their own which borrow the
+// parent's bytes (so must not outlive it).
+LDrawMappedFile		*LDrawMappedFileOpenUnindexed(const char *path);
+LDrawMappedFile		*LDrawMappedFileWrapBytesUnindexed(const void *bytes, size_t length);
+LDrawMappedFile		*LDrawMappedFileWrapLines(const LDrawMappedFile *file, LDrawLineSpan *lines, size_t lineCount);
+
+void				LDrawLineScannerInit(LDrawLineScanner *scanner, const LDrawMappedFile *file);
+void				LDrawLineScannerInitWithBytes(LDrawLineScanner *scanner, const char *bytes, size_t length, LDrawTextEncodingT encoding);
+bool				LDrawLineScannerNext(LDrawLineScanner *scanner, LDrawLineSpan *lineOut);
+
+// Building blocks, exposed for testing.
+LDrawTextEncodingT	LDrawDetectTextEncoding(const char *bytes, size_t length);
+size_t				LDrawSplitLines(const char *bytes, size_t length, LDrawTextEncodingT encoding, LDrawLineSpan **linesOut);
+
+#endif // _LDrawMappedFile_
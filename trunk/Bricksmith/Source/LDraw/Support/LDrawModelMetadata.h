@@ -0,0 +1,51 @@
+//==============================================================================
+//
+// File:		LDrawModelMetadata.h
+//
+// Purpose:		The header fields of an LDraw file, and optionally the files it
+//				refers to, read without parsing the file (see
+//				LDrawHeaderScanner.h).
+//
+//				This is what the part catalog is built from. It is also meant
+//				for indexing large collections of user models: reading the
+//				header of a typical file is a single small read, and the
+//				batch method spreads the files across all cores.
+//
+//==============================================================================
+#import <Foundation/Foundation.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// class LDrawModelMetadata
+//
+////////////////////////////////////////////////////////////////////////////////
+@interface LDrawModelMetadata : NSObject
+{
+	NSString	*submodelName;
+	NSString	*modelDescription;
+	NSString	*name;
+	NSString	*author;
+	NSString	*category;
+	NSString	*ldrawOrg;
+	NSArray 	*keywordLines;
+	NSArray 	*referencedFileNames;
+}
+
+// Initialization
++ (LDrawModelMetadata *) metadataForFileAtPath:(NSString *)path includeReferences:(BOOL)includeReferences;
++ (LDrawModelMetadata *) metadataFromData:(NSData *)fileData includeReferences:(BOOL)includeReferences;
++ (NSArray *) metadataForFilesAtPaths:(NSArray *)paths includeReferences:(BOOL)includeReferences;
+
+// Accessors
+- (NSString *) submodelName;
+- (NSString *) modelDescription;
+- (NSString *) name;
+- (NSString *) author;
+- (NSString *) category;
+- (NSString *) ldrawOrg;
+- (NSArray *) keywordLines;
+- (NSArray *) keywords;
+- (NSArray *) referencedFileNames;
+
+@end
@@ -0,0 +1,387 @@
+//==============================================================================
+//
+// File:		LDrawModelMetadata.m
+//
+// Purpose:		The header fields of an LDraw file, read without parsing the
+//				file.
+//
+//==============================================================================
+#import "LDrawModelMetadata.h"
+
+#import "LDrawHeaderScanner.h"
+
+
+@interface LDrawModelMetadata ()
+
+- (id) initWithBytes:(const char *)bytes
+			  length:(size_t)length
+			  header:(const LDrawModelHeader *)header
+   includeReferences:(BOOL)includeReferences;
+
+@end
+
+
+//========== stringForSpan =====================================================
+//
+// Purpose:		Decodes one field of the header, or returns nil if the header
+//				didn't have it. Undecodable bytes fall back on MacRoman, as in
+//				+[LDrawUtilities stringFromFileData:].
+//
+//==============================================================================
+static NSString *stringForSpan(const char *bytes, LDrawLineSpan span, LDrawTextEncodingT encoding)
+{
+	NSStringEncoding	stringEncoding	= NSUTF8StringEncoding;
+	NSString			*string 		= nil;
+
+	if(LDrawHeaderFieldIsPresent(span) == false)
+		return nil;
+
+	if(encoding == LDrawTextEncodingLatin1)
+		stringEncoding = NSISOLatin1StringEncoding;
+
+	string = [[NSString alloc] initWithBytes:bytes + span.offset length:span.length encoding:stringEncoding];
+	if(string == nil)
+		string = [[NSString alloc] initWithBytes:bytes + span.offset length:span.length encoding:NSMacOSRomanStringEncoding];
+
+	return string;
+
+}//end stringForSpan
+
+
+// State for collecting references out of LDrawScanReferences.
+typedef struct
+{
+	const char			*bytes;
+	LDrawTextEncodingT	encoding;
+	NSMutableArray		*names;
+	NSMutableSet		*seenNames;
+
+} ReferenceCollector;
+
+
+//========== collectReference ==================================================
+//
+// Purpose:		Records each referenced file the first time it turns up.
+//				Submodels defined in the file itself are not references.
+//
+//==============================================================================
+static void collectReference(void *context, const char *name, size_t length, bool isSubmodel)
+{
+	ReferenceCollector	*collector	= context;
+	LDrawLineSpan		span		= { (size_t)(name - collector->bytes), length };
+	NSString			*nameString	= [stringForSpan(collector->bytes, span, collector->encoding) lowercaseString];
+
+	if(isSubmodel)
+	{
+		[collector->seenNames addObject:nameString];
+		[collector->names removeObject:nameString];
+	}
+	else if([collector->seenNames containsObject:nameString] == NO)
+	{
+		[collector->seenNames addObject:nameString];
+		[collector->names addObject:nameString];
+	}
+
+}//end collectReference
+
+
+@implementation LDrawModelMetadata
+
+#pragma mark -
+#pragma mark INITIALIZATION
+#pragma mark -
+
+//---------- metadataForFileAtPath:includeReferences: ----------------[static]--
+//
+// Purpose:		Returns the metadata of the file at path, or nil if it can't be
+//				read or is empty.
+//
+//				Without references, only the header is read from disk. With
+//				them, the whole file has to be looked at, but only the names on
+//				its type 1 lines are decoded.
+//
+//------------------------------------------------------------------------------
++ (LDrawModelMetadata *) metadataForFileAtPath:(NSString *)path includeReferences:(BOOL)includeReferences
+{
+	LDrawModelMetadata	*metadata	= nil;
+	LDrawModelHeader	header;
+
+	if(includeReferences)
+	{
+		LDrawMappedFile	*file	= LDrawMappedFileOpenUnindexed([path fileSystemRepresentation]);
+
+		if(file)
+		{
+			LDrawScanModelHeader(file->bytes, file->length, true, &header);
+			if(file->length > 0)
+			{
+				metadata = [[LDrawModelMetadata alloc] initWithBytes:file->bytes
+															  length:file->length
+															  header:&header
+												   includeReferences:YES];
+			}
+			LDrawMappedFileClose(file);
+		}
+	}
+	else
+	{
+		size_t	length	= 0;
+		char	*bytes	= LDrawReadModelHeader([path fileSystemRepresentation], &header, &length);
+
+		if(bytes && length > 0)
+		{
+			metadata = [[LDrawModelMetadata alloc] initWithBytes:bytes
+														  length:length
+														  header:&header
+											   includeReferences:NO];
+		}
+		free(bytes);
+	}
+
+	return metadata;
+
+}//end metadataForFileAtPath:includeReferences:
+
+
+//---------- metadataFromData:includeReferences: ---------------------[static]--
+//
+// Purpose:		Returns the metadata of the file contents in fileData, or nil
+//				if there are none.
+//
+//------------------------------------------------------------------------------
++ (LDrawModelMetadata *) metadataFromData:(NSData *)fileData includeReferences:(BOOL)includeReferences
+{
+	LDrawModelHeader	header;
+
+	if([fileData length] == 0)
+		return nil;
+
+	LDrawScanModelHeader([fileData bytes], [fileData length], true, &header);
+
+	return [[LDrawModelMetadata alloc] initWithBytes:[fileData bytes]
+											  length:[fileData length]
+											  header:&header
+								   includeReferences:includeReferences];
+
+}//end metadataFromData:includeReferences:
+
+
+//---------- metadataForFilesAtPaths:includeReferences: --------------[static]--
+//
+// Purpose:		Reads the metadata of many files at once, spread across all
+//				available cores.
+//
+// Returns:		An array parallel to paths. Files which couldn't be read have
+//				NSNull in their place.
+//
+//------------------------------------------------------------------------------
++ (NSArray *) metadataForFilesAtPaths:(NSArray *)paths includeReferences:(BOOL)includeReferences
+{
+	NSUInteger			count		= [paths count];
+	__strong id			*results	= (__strong id *)calloc(count, sizeof(id));
+	NSArray 			*metadata	= nil;
+	NSUInteger			counter 	= 0;
+
+	dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t fileIndex)
+	{
+		@autoreleasepool
+		{
+			results[fileIndex] = [self metadataForFileAtPath:[paths objectAtIndex:fileIndex]
+										   includeReferences:includeReferences];
+		}
+	});
+
+	for(counter = 0; counter < count; counter++)
+	{
+		if(results[counter] == nil)
+			results[counter] = [NSNull null];
+	}
+	metadata = [NSArray arrayWithObjects:results count:count];
+
+	for(counter = 0; counter < count; counter++)
+		results[counter] = nil;
+	free(results);
+
+	return metadata;
+
+}//end metadataForFilesAtPaths:includeReferences:
+
+
+//========== initWithBytes:length:header:includeReferences: ====================
+//
+// Purpose:		Decodes the fields header found in bytes, and if asked, lists
+//				the files the rest of bytes refers to.
+//
+//==============================================================================
+- (id) initWithBytes:(const char *)bytes
+			  length:(size_t)length
+			  header:(const LDrawModelHeader *)header
+   includeReferences:(BOOL)includeReferences
+{
+	self = [super init];
+
+	if(self)
+	{
+		NSMutableArray	*keywords	= [NSMutableArray arrayWithCapacity:header->keywordLineCount];
+		size_t			counter 	= 0;
+
+		submodelName		= stringForSpan(bytes, header->submodelName,	header->encoding);
+		modelDescription	= stringForSpan(bytes, header->description, 	header->encoding);
+		name				= stringForSpan(bytes, header->name,			header->encoding);
+		author				= stringForSpan(bytes, header->author,			header->encoding);
+		category			= stringForSpan(bytes, header->category,		header->encoding);
+		ldrawOrg			= stringForSpan(bytes, header->ldrawOrg,		header->encoding);
+
+		for(counter = 0; counter < header->keywordLineCount; counter++)
+			[keywords addObject:stringForSpan(bytes, header->keywords[counter], header->encoding)];
+		keywordLines = keywords;
+
+		if(includeReferences)
+		{
+			ReferenceCollector	collector;
+
+			collector.bytes 	= bytes;
+			collector.encoding	= LDrawDetectTextEncoding(bytes, length);
+			collector.names 	= [NSMutableArray array];
+			collector.seenNames = [NSMutableSet set];
+
+			LDrawScanReferences(bytes, length, collector.encoding, collectReference, &collector);
+
+			referencedFileNames = collector.names;
+		}
+	}
+
+	return self;
+
+}//end initWithBytes:length:header:includeReferences:
+
+
+#pragma mark -
+#pragma mark ACCESSORS
+#pragma mark -
+
+//========== submodelName ======================================================
+//
+// Purpose:		The name on the 0 FILE line which opens an MPD file, or nil.
+//
+//==============================================================================
+- (NSString *) submodelName
+{
+	return self->submodelName;
+
+}//end submodelName
+
+
+//========== modelDescription ==================================================
+//
+// Purpose:		The first line of the model, or nil if it doesn't begin with a
+//				comment. For parts, this is what the catalog shows.
+//
+//==============================================================================
+- (NSString *) modelDescription
+{
+	return self->modelDescription;
+
+}//end modelDescription
+
+
+//========== name ==============================================================
+//
+// Purpose:		The value of 0 Name:, or nil.
+//
+//==============================================================================
+- (NSString *) name
+{
+	return self->name;
+
+}//end name
+
+
+//========== author ============================================================
+//
+// Purpose:		The value of 0 Author:, or nil.
+//
+//==============================================================================
+- (NSString *) author
+{
+	return self->author;
+
+}//end author
+
+
+//========== category ==========================================================
+//
+// Purpose:		The value of the first 0 !CATEGORY, or nil.
+//
+//==============================================================================
+- (NSString *) category
+{
+	return self->category;
+
+}//end category
+
+
+//========== ldrawOrg ==========================================================
+//
+// Purpose:		The value of the first 0 !LDRAW_ORG, or nil.
+//
+//==============================================================================
+- (NSString *) ldrawOrg
+{
+	return self->ldrawOrg;
+
+}//end ldrawOrg
+
+
+//========== keywordLines ======================================================
+//
+// Purpose:		The value of each 0 !KEYWORDS line, as written.
+//
+//==============================================================================
+- (NSArray *) keywordLines
+{
+	return self->keywordLines;
+
+}//end keywordLines
+
+
+//========== keywords ==========================================================
+//
+// Purpose:		The individual keywords from all the 0 !KEYWORDS lines, split
+//				at commas and trimmed.
+//
+//==============================================================================
+- (NSArray *) keywords
+{
+	NSMutableArray	*keywords	= [NSMutableArray array];
+	NSCharacterSet	*comma		= [NSCharacterSet characterSetWithCharactersInString:@","];
+	NSCharacterSet	*whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+
+	for(NSString *line in self->keywordLines)
+	{
+		for(NSString *keyword in [line componentsSeparatedByCharactersInSet:comma])
+			[keywords addObject:[keyword stringByTrimmingCharactersInSet:whitespace]];
+	}
+
+	return keywords;
+
+}//end keywords
+
+
+//========== referencedFileNames ===============================================
+//
+// Purpose:		The lowercased names of the files the model refers to, each
+//				once, in the order they first appear. Submodels defined within
+//				the file itself are left out.
+//
+//				nil unless the metadata was read with references.
+//
+//==============================================================================
+- (NSArray *) referencedFileNames
+{
+	return self->referencedFileNames;
+
+}//end referencedFileNames
+
+
+@end
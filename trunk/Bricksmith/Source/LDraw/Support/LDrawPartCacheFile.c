@@ -0,0 +1,352 @@
+//==============================================================================
+//
+// File:		LDrawPartCacheFile.c
+//
+// Purpose:		Reading and writing compiled part cache entries.
+//
+// Notes:		Entries are mapped read-only and shared, so loading one costs
+//				little more than the page faults for the primitives actually
+//				copied out of it. Nothing in an entry is trusted until its
+//				sizes have been checked against the length of the file.
+//
+//==============================================================================
+#include "LDrawPartCacheFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "LDrawAtomicWrite.h"
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== sectionLength =====================================================
+//
+// Purpose:		Returns the number of bytes the header says follow it, or
+//				SIZE_MAX if the counts are absurd.
+//
+//==============================================================================
+static size_t sectionLength(const LDrawPartCacheHeader *header)
+{
+	uint64_t	primitiveCount	= 0;
+	uint64_t	total			= 0;
+
+	primitiveCount	=	(uint64_t)header->lineCount
+					+	(uint64_t)header->conditionalLineCount
+					+	(uint64_t)header->triangleCount
+					+	(uint64_t)header->quadrilateralCount;
+
+	total	=	(uint64_t)header->dependencyCount * sizeof(LDrawCachedDependency)
+			+	(uint64_t)header->colorCount * sizeof(LDrawCachedColor)
+			+	primitiveCount * sizeof(LDrawCachedPrimitive)
+			+	header->stringsLength;
+
+	return (total > SIZE_MAX / 2) ? SIZE_MAX : (size_t)total;
+
+}//end sectionLength
+
+
+//========== stringIsValid =====================================================
+//
+// Purpose:		Makes sure a string reference lies inside the string table.
+//
+//==============================================================================
+static bool stringIsValid(const LDrawPartCacheHeader *header, LDrawCachedString string)
+{
+	return (uint64_t)string.offset + string.length <= header->stringsLength;
+}
+
+
+//========== referencesAreValid ================================================
+//
+// Purpose:		Makes sure every dependency path lies inside the string table
+//				and every primitive's color inside the color table, so nothing
+//				read out of the entry afterwards can stray past the mapping.
+//
+//==============================================================================
+static bool referencesAreValid(const LDrawPartCacheHeader *header,
+							   const LDrawCachedDependency *dependencies,
+							   const LDrawCachedPrimitive *primitives)
+{
+	uint32_t	primitiveCount	= 0;
+	uint32_t	counter			= 0;
+
+	for(counter = 0; counter < header->dependencyCount; counter++)
+	{
+		if(stringIsValid(header, dependencies[counter].path) == false)
+			return false;
+	}
+
+	primitiveCount	=	header->lineCount + header->conditionalLineCount
+					+	header->triangleCount + header->quadrilateralCount;
+	for(counter = 0; counter < primitiveCount; counter++)
+	{
+		if(primitives[counter].colorIndex >= header->colorCount)
+			return false;
+	}
+
+	return true;
+
+}//end referencesAreValid
+
+
+#pragma mark -
+#pragma mark FILE STAMPS
+#pragma mark -
+
+//========== LDrawFileStampForPath =============================================
+//
+// Purpose:		Records the size and modification time of the file at path.
+//				Returns false if it doesn't exist.
+//
+//==============================================================================
+bool LDrawFileStampForPath(const char *path, LDrawFileStamp *stampOut)
+{
+	struct stat	fileInfo;
+
+	if(stat(path, &fileInfo) != 0)
+		return false;
+
+	stampOut->size						= (int64_t)fileInfo.st_size;
+#ifdef __APPLE__
+	stampOut->modificationSeconds		= (int64_t)fileInfo.st_mtimespec.tv_sec;
+	stampOut->modificationNanoseconds	= (int64_t)fileInfo.st_mtimespec.tv_nsec;
+#else
+	stampOut->modificationSeconds		= (int64_t)fileInfo.st_mtim.tv_sec;
+	stampOut->modificationNanoseconds	= (int64_t)fileInfo.st_mtim.tv_nsec;
+#endif
+
+	return true;
+
+}//end LDrawFileStampForPath
+
+
+//========== LDrawFileStampsEqual ==============================================
+//
+// Purpose:		Returns true if both stamps describe the same file contents.
+//
+//==============================================================================
+bool LDrawFileStampsEqual(const LDrawFileStamp *stamp1, const LDrawFileStamp *stamp2)
+{
+	return		stamp1->size					== stamp2->size
+			&&	stamp1->modificationSeconds		== stamp2->modificationSeconds
+			&&	stamp1->modificationNanoseconds	== stamp2->modificationNanoseconds;
+}
+
+
+#pragma mark -
+#pragma mark READING
+#pragma mark -
+
+//========== LDrawPartCacheEntryOpen ===========================================
+//
+// Purpose:		Maps the entry at path and locates its sections. Every string
+//				and color reference in it is checked here, so a damaged entry
+//				is never handed out.
+//
+//==============================================================================
+LDrawPartCacheEntry *LDrawPartCacheEntryOpen(const char *path)
+{
+	int							fileDescriptor	= open(path, O_RDONLY | O_CLOEXEC);
+	struct stat					fileInfo;
+	void						*mapping		= MAP_FAILED;
+	size_t						length			= 0;
+	const LDrawPartCacheHeader	*header			= NULL;
+	const char					*section		= NULL;
+	LDrawPartCacheEntry			*entry			= NULL;
+	uint32_t					primitiveCount	= 0;
+
+	if(fileDescriptor < 0)
+		return NULL;
+
+	if(		fstat(fileDescriptor, &fileInfo) != 0
+	   ||	S_ISREG(fileInfo.st_mode) == false
+	   ||	(size_t)fileInfo.st_size < sizeof(LDrawPartCacheHeader) )
+	{
+		close(fileDescriptor);
+		return NULL;
+	}
+	length	= (size_t)fileInfo.st_size;
+	mapping	= mmap(NULL, length, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	close(fileDescriptor);
+
+	if(mapping == MAP_FAILED)
+		return NULL;
+
+	header = mapping;
+	if(		header->magic			!= LDRAW_PART_CACHE_MAGIC
+	   ||	header->version			!= LDRAW_PART_CACHE_VERSION
+	   ||	header->headerSize		!= sizeof(LDrawPartCacheHeader)
+	   ||	header->primitiveSize	!= sizeof(LDrawCachedPrimitive)
+	   ||	sectionLength(header)	!= length - sizeof(LDrawPartCacheHeader)
+	   ||	stringIsValid(header, header->modelName) == false
+	   ||	stringIsValid(header, header->modelDescription) == false
+	   ||	stringIsValid(header, header->fileName) == false
+	   ||	stringIsValid(header, header->author) == false )
+	{
+		munmap(mapping, length);
+		return NULL;
+	}
+
+	entry = calloc(1, sizeof(LDrawPartCacheEntry));
+	if(entry == NULL)
+	{
+		munmap(mapping, length);
+		return NULL;
+	}
+
+	primitiveCount		=	header->lineCount + header->conditionalLineCount
+						+	header->triangleCount + header->quadrilateralCount;
+
+	section				= (const char *)mapping + sizeof(LDrawPartCacheHeader);
+	entry->mapping		= mapping;
+	entry->length		= length;
+	entry->header		= header;
+
+	entry->dependencies	= (const LDrawCachedDependency *)section;
+	section				+= header->dependencyCount * sizeof(LDrawCachedDependency);
+	entry->colors		= (const LDrawCachedColor *)section;
+	section				+= header->colorCount * sizeof(LDrawCachedColor);
+	entry->primitives	= (const LDrawCachedPrimitive *)section;
+	section				+= primitiveCount * sizeof(LDrawCachedPrimitive);
+	entry->strings		= section;
+
+	if(referencesAreValid(header, entry->dependencies, entry->primitives) == false)
+	{
+		LDrawPartCacheEntryClose(entry);
+		return NULL;
+	}
+
+	return entry;
+
+}//end LDrawPartCacheEntryOpen
+
+
+//========== LDrawPartCacheEntryIsCurrent ======================================
+//
+// Purpose:		Returns true if none of the files the entry was built from has
+//				changed.
+//
+//==============================================================================
+bool LDrawPartCacheEntryIsCurrent(const LDrawPartCacheEntry *entry)
+{
+	const LDrawPartCacheHeader	*header			= entry->header;
+	uint32_t					counter			= 0;
+	char						path[1024];
+	LDrawFileStamp				stamp;
+
+	for(counter = 0; counter < header->dependencyCount; counter++)
+	{
+		LDrawCachedString	pathString	= entry->dependencies[counter].path;
+
+		if(pathString.length >= sizeof(path))
+			return false;
+
+		memcpy(path, entry->strings + pathString.offset, pathString.length);
+		path[pathString.length] = '\0';
+
+		if(		LDrawFileStampForPath(path, &stamp) == false
+		   ||	LDrawFileStampsEqual(&stamp, &entry->dependencies[counter].stamp) == false )
+		{
+			return false;
+		}
+	}
+
+	return true;
+
+}//end LDrawPartCacheEntryIsCurrent
+
+
+//========== LDrawPartCacheEntryString =========================================
+//
+// Purpose:		Returns the bytes of a string in the entry's string table.
+//
+//==============================================================================
+const char *LDrawPartCacheEntryString(const LDrawPartCacheEntry *entry, LDrawCachedString string, size_t *lengthOut)
+{
+	*lengthOut = string.length;
+	return entry->strings + string.offset;
+}
+
+
+//========== LDrawPartCacheEntryClose ==========================================
+//
+// Purpose:		Unmaps the entry. Pointers into it are invalid afterwards.
+//
+//==============================================================================
+void LDrawPartCacheEntryClose(LDrawPartCacheEntry *entry)
+{
+	if(entry != NULL)
+	{
+		munmap(entry->mapping, entry->length);
+		free(entry);
+	}
+}
+
+
+#pragma mark -
+#pragma mark WRITING
+#pragma mark -
+
+//========== LDrawPartCacheEntryWrite ==========================================
+//
+// Purpose:		Saves an entry to path, replacing any entry already there.
+//
+//==============================================================================
+bool LDrawPartCacheEntryWrite(const char *path,
+							  const LDrawPartCacheHeader *header,
+							  const LDrawCachedDependency *dependencies,
+							  const LDrawCachedColor *colors,
+							  const LDrawCachedPrimitive *primitives,
+							  const char *strings)
+{
+	LDrawPartCacheHeader	fullHeader		= *header;
+	size_t					primitiveCount	= 0;
+
+	fullHeader.magic			= LDRAW_PART_CACHE_MAGIC;
+	fullHeader.version			= LDRAW_PART_CACHE_VERSION;
+	fullHeader.headerSize		= sizeof(LDrawPartCacheHeader);
+	fullHeader.primitiveSize	= sizeof(LDrawCachedPrimitive);
+	fullHeader.reserved			= 0;
+
+	primitiveCount	=	(size_t)header->lineCount + header->conditionalLineCount
+					+	header->triangleCount + header->quadrilateralCount;
+
+	LDrawWriteSection		sections[]		=
+	{
+		{ &fullHeader,		sizeof(fullHeader) },
+		{ dependencies,		header->dependencyCount * sizeof(LDrawCachedDependency) },
+		{ colors,			header->colorCount * sizeof(LDrawCachedColor) },
+		{ primitives,		primitiveCount * sizeof(LDrawCachedPrimitive) },
+		{ strings,			header->stringsLength },
+	};
+
+	return LDrawAtomicWrite(path, sections, sizeof(sections) / sizeof(sections[0]));
+
+}//end LDrawPartCacheEntryWrite
+
+
+#pragma mark -
+#pragma mark NAMING
+#pragma mark -
+
+//========== LDrawPartCacheKeyForPath ==========================================
+//
+// Purpose:		Returns a 64-bit FNV-1a hash of the part's path, used to name
+//				its entry. (The entry records the path too, as its first
+//				dependency, so a collision just reads as a miss.)
+//
+//==============================================================================
+uint64_t LDrawPartCacheKeyForPath(const char *path)
+{
+	return LDrawFNV1a(LDRAW_FNV_OFFSET_BASIS, path, strlen(path));
+
+}//end LDrawPartCacheKeyForPath
@@ -0,0 +1,170 @@
+//==============================================================================
+//
+// File:		LDrawPartCacheFile.h
+//
+// Purpose:		On-disk format for the compiled part cache.
+//
+//				Each library part, once parsed and flattened by
+//				-[LDrawModel optimizeStructure], can be saved as a single binary
+//				file holding exactly what the optimized model contains: its
+//				lines, conditional lines, triangles and quadrilaterals with their
+//				colors, plus the model's bounding box and header strings. On the
+//				next launch the file is mapped and the model rebuilt from it
+//				without reading a line of LDraw text.
+//
+//				An entry lists every file its contents were derived from (the
+//				part itself, each subpart and primitive it pulled in, and
+//				LDConfig.ldr for the colors) with their size and modification
+//				time. It is only used if all of them are unchanged.
+//
+//				The layout is the native in-memory layout of the structs below,
+//				so a mapped entry is used in place. Entries written by a
+//				different version or on a machine of different byte order are
+//				rejected as stale.
+//
+//==============================================================================
+#ifndef _LDrawPartCacheFile_
+#define _LDrawPartCacheFile_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LDRAW_PART_CACHE_MAGIC		0x43505342		// "BSPC" read little-endian
+#define LDRAW_PART_CACHE_VERSION	1
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Identifies one version of a file on disk.
+typedef struct LDrawFileStampStruct
+{
+	int64_t		size;
+	int64_t		modificationSeconds;
+	int64_t		modificationNanoseconds;
+
+} LDrawFileStamp;
+
+
+// A run of bytes in the entry's string table. Not NUL-terminated.
+typedef struct LDrawCachedStringStruct
+{
+	uint32_t	offset;
+	uint32_t	length;
+
+} LDrawCachedString;
+
+
+// A file the entry was built from.
+typedef struct LDrawCachedDependencyStruct
+{
+	LDrawFileStamp		stamp;
+	LDrawCachedString	path;
+
+} LDrawCachedDependency;
+
+
+// A color used by the entry's primitives. Library colors are looked up again
+// by code when the entry is loaded; anything else (the derived edge colors of
+// explicitly-colored subparts, for instance) is rebuilt from its components.
+typedef struct LDrawCachedColorStruct
+{
+	int32_t		colorCode;
+	int32_t		edgeColorCode;
+	uint32_t	isLibraryColor;
+	float		colorRGBA[4];
+	float		edgeColorRGBA[4];
+
+} LDrawCachedColor;
+
+
+// One primitive. Lines use two vertices; conditional lines use two vertices
+// and two control points (in that order); triangles three; quadrilaterals four.
+typedef struct LDrawCachedPrimitiveStruct
+{
+	uint32_t	colorIndex;
+	float		vertices[4][3];
+	float		normal[3];
+
+} LDrawCachedPrimitive;
+
+
+typedef struct LDrawPartCacheHeaderStruct
+{
+	uint32_t			magic;
+	uint32_t			version;
+	uint32_t			headerSize;
+	uint32_t			primitiveSize;			// catches a struct layout change
+
+	uint32_t			dependencyCount;
+	uint32_t			colorCount;
+	uint32_t			lineCount;
+	uint32_t			conditionalLineCount;
+	uint32_t			triangleCount;
+	uint32_t			quadrilateralCount;
+	uint32_t			stringsLength;
+	uint32_t			reserved;
+
+	float				boundsMinimum[3];
+	float				boundsMaximum[3];
+
+	LDrawCachedString	modelName;
+	LDrawCachedString	modelDescription;
+	LDrawCachedString	fileName;
+	LDrawCachedString	author;
+
+} LDrawPartCacheHeader;
+
+
+// A cache entry, mapped for reading. The sections point into the mapping.
+// Primitives are stored lines first, then conditional lines, triangles and
+// quadrilaterals.
+typedef struct LDrawPartCacheEntryStruct
+{
+	void							*mapping;
+	size_t							length;
+
+	const LDrawPartCacheHeader		*header;
+	const LDrawCachedDependency		*dependencies;
+	const LDrawCachedColor			*colors;
+	const LDrawCachedPrimitive		*primitives;
+	const char						*strings;
+
+} LDrawPartCacheEntry;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// File stamps
+bool					LDrawFileStampForPath(const char *path, LDrawFileStamp *stampOut);
+bool					LDrawFileStampsEqual(const LDrawFileStamp *stamp1, const LDrawFileStamp *stamp2);
+
+// Reading. Open returns NULL if the file is missing, truncated, was written by
+// another version, or has a string or color reference out of range.
+LDrawPartCacheEntry *	LDrawPartCacheEntryOpen(const char *path);
+bool					LDrawPartCacheEntryIsCurrent(const LDrawPartCacheEntry *entry);
+const char *			LDrawPartCacheEntryString(const LDrawPartCacheEntry *entry, LDrawCachedString string, size_t *lengthOut);
+void					LDrawPartCacheEntryClose(LDrawPartCacheEntry *entry);
+
+// Writing. The header's counts must describe the arrays passed in; its magic,
+// version and sizes are filled in here. The entry is written to a temporary
+// file and renamed into place, so readers never see half of it.
+bool					LDrawPartCacheEntryWrite(const char *path,
+												 const LDrawPartCacheHeader *header,
+												 const LDrawCachedDependency *dependencies,
+												 const LDrawCachedColor *colors,
+												 const LDrawCachedPrimitive *primitives,
+												 const char *strings);
+
+// Naming
+uint64_t				LDrawPartCacheKeyForPath(const char *path);
+
+#endif // _LDrawPartCacheFile_
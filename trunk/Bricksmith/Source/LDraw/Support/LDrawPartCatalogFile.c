@@ -0,0 +1,380 @@
+//==============================================================================
+//
+// File:		LDrawPartCatalogFile.c
+//
+// Purpose:		Reading and writing the binary part catalog.
+//
+//==============================================================================
+#include "LDrawPartCatalogFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "LDrawAtomicWrite.h"
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== sectionLength =====================================================
+//
+// Purpose:		Returns the number of bytes the header says follow it, or
+//				SIZE_MAX if the counts are absurd.
+//
+//==============================================================================
+static size_t sectionLength(const LDrawPartCatalogHeader *header)
+{
+	uint64_t	total	= 0;
+
+	total	=	(uint64_t)header->partCount			* sizeof(LDrawCatalogPart)
+			+	(uint64_t)header->categoryCount		* sizeof(LDrawCatalogCategory)
+			+	(uint64_t)header->memberCount		* sizeof(uint32_t)
+			+	(uint64_t)header->keywordCount		* sizeof(LDrawCatalogKeyword)
+			+	(uint64_t)header->postingCount		* sizeof(uint32_t)
+			+	(uint64_t)header->partKeywordCount	* sizeof(uint32_t)
+			+	header->stringsLength;
+
+	return (total > SIZE_MAX / 2) ? SIZE_MAX : (size_t)total;
+
+}//end sectionLength
+
+
+//========== indexRun ==========================================================
+//
+// Purpose:		Returns the run [start, start + count) of an index section of
+//				sectionCount entries, or NULL if it doesn't fit.
+//
+//==============================================================================
+static const uint32_t *indexRun(const uint32_t *section, uint32_t sectionCount,
+								uint32_t start, uint32_t count, uint32_t *countOut)
+{
+	if((uint64_t)start + count > sectionCount)
+	{
+		*countOut = 0;
+		return NULL;
+	}
+
+	*countOut = count;
+	return section + start;
+
+}//end indexRun
+
+
+#pragma mark -
+#pragma mark READING
+#pragma mark -
+
+//========== LDrawPartCatalogOpen ==============================================
+//
+// Purpose:		Maps the catalog at path and locates its sections.
+//
+//==============================================================================
+LDrawPartCatalog *LDrawPartCatalogOpen(const char *path)
+{
+	int								fileDescriptor	= open(path, O_RDONLY | O_CLOEXEC);
+	struct stat						fileInfo;
+	void							*mapping		= MAP_FAILED;
+	size_t							length			= 0;
+	const LDrawPartCatalogHeader	*header			= NULL;
+	const char						*section		= NULL;
+	LDrawPartCatalog				*catalog		= NULL;
+
+	if(fileDescriptor < 0)
+		return NULL;
+
+	if(		fstat(fileDescriptor, &fileInfo) != 0
+	   ||	S_ISREG(fileInfo.st_mode) == false
+	   ||	(size_t)fileInfo.st_size < sizeof(LDrawPartCatalogHeader) )
+	{
+		close(fileDescriptor);
+		return NULL;
+	}
+	length	= (size_t)fileInfo.st_size;
+	mapping	= mmap(NULL, length, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	close(fileDescriptor);
+
+	if(mapping == MAP_FAILED)
+		return NULL;
+
+	header = mapping;
+	if(		header->magic			!= LDRAW_PART_CATALOG_MAGIC
+	   ||	header->version			!= LDRAW_PART_CATALOG_VERSION
+	   ||	header->headerSize		!= sizeof(LDrawPartCatalogHeader)
+	   ||	header->partSize		!= sizeof(LDrawCatalogPart)
+	   ||	sectionLength(header)	!= length - sizeof(LDrawPartCatalogHeader) )
+	{
+		munmap(mapping, length);
+		return NULL;
+	}
+
+	catalog = calloc(1, sizeof(LDrawPartCatalog));
+	if(catalog == NULL)
+	{
+		munmap(mapping, length);
+		return NULL;
+	}
+
+	section					= (const char *)mapping + sizeof(LDrawPartCatalogHeader);
+	catalog->mapping		= mapping;
+	catalog->length			= length;
+	catalog->header			= header;
+
+	catalog->parts			= (const LDrawCatalogPart *)section;
+	section					+= header->partCount * sizeof(LDrawCatalogPart);
+	catalog->categories		= (const LDrawCatalogCategory *)section;
+	section					+= header->categoryCount * sizeof(LDrawCatalogCategory);
+	catalog->members		= (const uint32_t *)section;
+	section					+= header->memberCount * sizeof(uint32_t);
+	catalog->keywords		= (const LDrawCatalogKeyword *)section;
+	section					+= header->keywordCount * sizeof(LDrawCatalogKeyword);
+	catalog->postings		= (const uint32_t *)section;
+	section					+= header->postingCount * sizeof(uint32_t);
+	catalog->partKeywords	= (const uint32_t *)section;
+	section					+= header->partKeywordCount * sizeof(uint32_t);
+	catalog->strings		= section;
+
+	return catalog;
+
+}//end LDrawPartCatalogOpen
+
+
+//========== LDrawPartCatalogClose =============================================
+//
+// Purpose:		Unmaps the catalog. Pointers into it are invalid afterwards.
+//
+//==============================================================================
+void LDrawPartCatalogClose(LDrawPartCatalog *catalog)
+{
+	if(catalog != NULL)
+	{
+		munmap(catalog->mapping, catalog->length);
+		free(catalog);
+	}
+}
+
+
+//========== LDrawPartCatalogString ============================================
+//
+// Purpose:		Returns the bytes of a string in the string table.
+//
+//==============================================================================
+const char *LDrawPartCatalogString(const LDrawPartCatalog *catalog, LDrawCatalogString string, size_t *lengthOut)
+{
+	if((uint64_t)string.offset + string.length > catalog->header->stringsLength)
+	{
+		*lengthOut = 0;
+		return NULL;
+	}
+
+	*lengthOut = string.length;
+	return catalog->strings + string.offset;
+
+}//end LDrawPartCatalogString
+
+
+//========== LDrawPartCatalogPartAtIndex =======================================
+//
+// Purpose:		Returns the part record at index.
+//
+//==============================================================================
+const LDrawCatalogPart *LDrawPartCatalogPartAtIndex(const LDrawPartCatalog *catalog, uint32_t index)
+{
+	return (index < catalog->header->partCount) ? catalog->parts + index : NULL;
+}
+
+
+//========== LDrawPartCatalogCategoryAtIndex ===================================
+//
+// Purpose:		Returns the category record at index.
+//
+//==============================================================================
+const LDrawCatalogCategory *LDrawPartCatalogCategoryAtIndex(const LDrawPartCatalog *catalog, uint32_t index)
+{
+	return (index < catalog->header->categoryCount) ? catalog->categories + index : NULL;
+}
+
+
+//========== LDrawPartCatalogKeywordAtIndex ====================================
+//
+// Purpose:		Returns the keyword record at index.
+//
+//==============================================================================
+const LDrawCatalogKeyword *LDrawPartCatalogKeywordAtIndex(const LDrawPartCatalog *catalog, uint32_t index)
+{
+	return (index < catalog->header->keywordCount) ? catalog->keywords + index : NULL;
+}
+
+
+//========== LDrawPartCatalogCategoryMembers ===================================
+//
+// Purpose:		Returns the indexes of the parts filed in category.
+//
+//==============================================================================
+const uint32_t *LDrawPartCatalogCategoryMembers(const LDrawPartCatalog *catalog, const LDrawCatalogCategory *category, uint32_t *countOut)
+{
+	return indexRun(catalog->members, catalog->header->memberCount,
+					category->membersStart, category->memberCount, countOut);
+}
+
+
+//========== LDrawPartCatalogKeywordPostings ===================================
+//
+// Purpose:		Returns the indexes of the parts which have keyword.
+//
+//==============================================================================
+const uint32_t *LDrawPartCatalogKeywordPostings(const LDrawPartCatalog *catalog, const LDrawCatalogKeyword *keyword, uint32_t *countOut)
+{
+	return indexRun(catalog->postings, catalog->header->postingCount,
+					keyword->postingsStart, keyword->postingCount, countOut);
+}
+
+
+//========== LDrawPartCatalogPartKeywords ======================================
+//
+// Purpose:		Returns the indexes of the keywords of part, in the order the
+//				part lists them.
+//
+//==============================================================================
+const uint32_t *LDrawPartCatalogPartKeywords(const LDrawPartCatalog *catalog, const LDrawCatalogPart *part, uint32_t *countOut)
+{
+	return indexRun(catalog->partKeywords, catalog->header->partKeywordCount,
+					part->keywordsStart, part->keywordCount, countOut);
+}
+
+
+//========== LDrawPartCatalogFindPart ==========================================
+//
+// Purpose:		Returns the index of the part with the given number, or
+//				LDRAW_PART_CATALOG_NOT_FOUND.
+//
+//==============================================================================
+uint32_t LDrawPartCatalogFindPart(const LDrawPartCatalog *catalog, const char *number, size_t length)
+{
+	uint32_t	low		= 0;
+	uint32_t	high	= catalog->header->partCount;
+
+	while(low < high)
+	{
+		uint32_t	middle			= low + (high - low) / 2;
+		size_t		middleLength	= 0;
+		const char	*middleNumber	= LDrawPartCatalogString(catalog, catalog->parts[middle].number, &middleLength);
+		int			order			= 0;
+
+		if(middleNumber == NULL)
+			return LDRAW_PART_CATALOG_NOT_FOUND;
+
+		order = LDrawPartCatalogCompareStrings(middleNumber, middleLength, number, length);
+		if(order == 0)
+			return middle;
+		else if(order < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return LDRAW_PART_CATALOG_NOT_FOUND;
+
+}//end LDrawPartCatalogFindPart
+
+
+//========== LDrawPartCatalogFindCategory ======================================
+//
+// Purpose:		Returns the index of the category with the given name, or
+//				LDRAW_PART_CATALOG_NOT_FOUND.
+//
+//==============================================================================
+uint32_t LDrawPartCatalogFindCategory(const LDrawPartCatalog *catalog, const char *name, size_t length)
+{
+	uint32_t	low		= 0;
+	uint32_t	high	= catalog->header->categoryCount;
+
+	while(low < high)
+	{
+		uint32_t	middle			= low + (high - low) / 2;
+		size_t		middleLength	= 0;
+		const char	*middleName		= LDrawPartCatalogString(catalog, catalog->categories[middle].name, &middleLength);
+		int			order			= 0;
+
+		if(middleName == NULL)
+			return LDRAW_PART_CATALOG_NOT_FOUND;
+
+		order = LDrawPartCatalogCompareStrings(middleName, middleLength, name, length);
+		if(order == 0)
+			return middle;
+		else if(order < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return LDRAW_PART_CATALOG_NOT_FOUND;
+
+}//end LDrawPartCatalogFindCategory
+
+
+//========== LDrawPartCatalogCompareStrings ====================================
+//
+// Purpose:		Orders two byte strings.
+//
+//==============================================================================
+int LDrawPartCatalogCompareStrings(const char *string1, size_t length1, const char *string2, size_t length2)
+{
+	int order = memcmp(string1, string2, (length1 < length2) ? length1 : length2);
+
+	if(order == 0 && length1 != length2)
+		order = (length1 < length2) ? -1 : 1;
+
+	return order;
+
+}//end LDrawPartCatalogCompareStrings
+
+
+#pragma mark -
+#pragma mark WRITING
+#pragma mark -
+
+//========== LDrawPartCatalogWrite =============================================
+//
+// Purpose:		Saves a catalog to path, replacing any catalog already there.
+//
+//==============================================================================
+bool LDrawPartCatalogWrite(const char *path,
+						   const LDrawPartCatalogHeader *header,
+						   const LDrawCatalogPart *parts,
+						   const LDrawCatalogCategory *categories,
+						   const uint32_t *members,
+						   const LDrawCatalogKeyword *keywords,
+						   const uint32_t *postings,
+						   const uint32_t *partKeywords,
+						   const char *strings)
+{
+	LDrawPartCatalogHeader	fullHeader		= *header;
+
+	fullHeader.magic		= LDRAW_PART_CATALOG_MAGIC;
+	fullHeader.version		= LDRAW_PART_CATALOG_VERSION;
+	fullHeader.headerSize	= sizeof(LDrawPartCatalogHeader);
+	fullHeader.partSize		= sizeof(LDrawCatalogPart);
+	fullHeader.reserved		= 0;
+
+	LDrawWriteSection		sections[]		=
+	{
+		{ &fullHeader,		sizeof(fullHeader) },
+		{ parts,			header->partCount * sizeof(LDrawCatalogPart) },
+		{ categories,		header->categoryCount * sizeof(LDrawCatalogCategory) },
+		{ members,			header->memberCount * sizeof(uint32_t) },
+		{ keywords,			header->keywordCount * sizeof(LDrawCatalogKeyword) },
+		{ postings,			header->postingCount * sizeof(uint32_t) },
+		{ partKeywords,		header->partKeywordCount * sizeof(uint32_t) },
+		{ strings,			header->stringsLength },
+	};
+
+	return LDrawAtomicWrite(path, sections, sizeof(sections) / sizeof(sections[0]));
+
+}//end LDrawPartCatalogWrite
@@ -0,0 +1,175 @@
+//==============================================================================
+//
+// File:		LDrawPartCatalogFile.h
+//
+// Purpose:		On-disk format for the part catalog: the index of every part in
+//				the LDraw folder by number, category and keyword that the part
+//				browser shows.
+//
+//				The catalog is a single file, mapped at launch and queried in
+//				place. It holds:
+//
+//				- a record for every part, sorted by part number so a part can
+//				  be found by binary search;
+//				- a record for every category, sorted by name, listing the
+//				  parts filed in it;
+//				- every distinct keyword, sorted, with a postings list of the
+//				  parts carrying it;
+//				- a string table all of the above point into.
+//
+//				Opening a catalog only checks that its sections add up to the
+//				length of the file. Everything read out of it afterwards is
+//				range-checked at the point of use, so a damaged catalog returns
+//				fewer parts rather than crashing, and opening one costs the
+//				same no matter how many parts it holds.
+//
+//				Like the part cache, this is plain C in the native byte order;
+//				catalogs from another version are rejected and rebuilt.
+//
+//==============================================================================
+#ifndef _LDrawPartCatalogFile_
+#define _LDrawPartCatalogFile_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LDRAW_PART_CATALOG_MAGIC		0x54414342		// "BCAT" read little-endian
+#define LDRAW_PART_CATALOG_VERSION		1
+
+#define LDRAW_PART_CATALOG_NOT_FOUND	UINT32_MAX
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Types
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// A run of UTF-8 bytes in the string table. Not NUL-terminated.
+typedef struct LDrawCatalogStringStruct
+{
+	uint32_t	offset;
+	uint32_t	length;
+
+} LDrawCatalogString;
+
+
+// One part. keywordsStart and keywordCount select a run of the part keyword
+// section, which holds indexes of keyword records.
+typedef struct LDrawCatalogPartStruct
+{
+	LDrawCatalogString	number;				// e.g., "3001.dat" or "s\3001s01.dat"
+	LDrawCatalogString	name;				// e.g., "Brick  2 x  4"
+	uint32_t			categoryIndex;
+	uint32_t			keywordsStart;
+	uint32_t			keywordCount;
+	uint32_t			reserved;
+
+} LDrawCatalogPart;
+
+
+// One category. membersStart and memberCount select a run of the member
+// section, which holds part indexes in the order the parts were cataloged.
+typedef struct LDrawCatalogCategoryStruct
+{
+	LDrawCatalogString	name;
+	uint32_t			membersStart;
+	uint32_t			memberCount;
+
+} LDrawCatalogCategory;
+
+
+// One distinct keyword. postingsStart and postingCount select a run of the
+// postings section, which holds the ascending indexes of the parts which have
+// the keyword.
+typedef struct LDrawCatalogKeywordStruct
+{
+	LDrawCatalogString	keyword;
+	uint32_t			postingsStart;
+	uint32_t			postingCount;
+
+} LDrawCatalogKeyword;
+
+
+// The file starts with this header, followed by each section in the order of
+// its count below.
+typedef struct LDrawPartCatalogHeaderStruct
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	headerSize;
+	uint32_t	partSize;					// catches a struct layout change
+
+	uint32_t	partCount;					// LDrawCatalogPart
+	uint32_t	categoryCount;				// LDrawCatalogCategory
+	uint32_t	memberCount;				// uint32_t part indexes
+	uint32_t	keywordCount;				// LDrawCatalogKeyword
+	uint32_t	postingCount;				// uint32_t part indexes
+	uint32_t	partKeywordCount;			// uint32_t keyword indexes
+	uint32_t	stringsLength;
+	uint32_t	reserved;
+
+} LDrawPartCatalogHeader;
+
+
+// A catalog, mapped for reading. The sections point into the mapping.
+typedef struct LDrawPartCatalogStruct
+{
+	void							*mapping;
+	size_t							length;
+
+	const LDrawPartCatalogHeader	*header;
+	const LDrawCatalogPart			*parts;
+	const LDrawCatalogCategory		*categories;
+	const uint32_t					*members;
+	const LDrawCatalogKeyword		*keywords;
+	const uint32_t					*postings;
+	const uint32_t					*partKeywords;
+	const char						*strings;
+
+} LDrawPartCatalog;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Reading. Open returns NULL if the file is missing, truncated, or was written
+// by another version. The accessors return NULL (or NOT_FOUND) for anything
+// out of range.
+LDrawPartCatalog *			LDrawPartCatalogOpen(const char *path);
+void						LDrawPartCatalogClose(LDrawPartCatalog *catalog);
+
+const char *				LDrawPartCatalogString(const LDrawPartCatalog *catalog, LDrawCatalogString string, size_t *lengthOut);
+const LDrawCatalogPart *	LDrawPartCatalogPartAtIndex(const LDrawPartCatalog *catalog, uint32_t index);
+const LDrawCatalogCategory *LDrawPartCatalogCategoryAtIndex(const LDrawPartCatalog *catalog, uint32_t index);
+const LDrawCatalogKeyword *	LDrawPartCatalogKeywordAtIndex(const LDrawPartCatalog *catalog, uint32_t index);
+
+const uint32_t *			LDrawPartCatalogCategoryMembers(const LDrawPartCatalog *catalog, const LDrawCatalogCategory *category, uint32_t *countOut);
+const uint32_t *			LDrawPartCatalogKeywordPostings(const LDrawPartCatalog *catalog, const LDrawCatalogKeyword *keyword, uint32_t *countOut);
+const uint32_t *			LDrawPartCatalogPartKeywords(const LDrawPartCatalog *catalog, const LDrawCatalogPart *part, uint32_t *countOut);
+
+uint32_t					LDrawPartCatalogFindPart(const LDrawPartCatalog *catalog, const char *number, size_t length);
+uint32_t					LDrawPartCatalogFindCategory(const LDrawPartCatalog *catalog, const char *name, size_t length);
+
+// The order parts, categories and keywords must be sorted in: bytewise, with
+// a prefix before anything longer.
+int							LDrawPartCatalogCompareStrings(const char *string1, size_t length1, const char *string2, size_t length2);
+
+// Writing. The header's counts must describe the arrays passed in; its magic,
+// version and sizes are filled in here. The catalog is written to a temporary
+// file and renamed into place, so readers never see half of it.
+bool						LDrawPartCatalogWrite(const char *path,
+												  const LDrawPartCatalogHeader *header,
+												  const LDrawCatalogPart *parts,
+												  const LDrawCatalogCategory *categories,
+												  const uint32_t *members,
+												  const LDrawCatalogKeyword *keywords,
+												  const uint32_t *postings,
+												  const uint32_t *partKeywords,
+												  const char *strings);
+
+#endif // _LDrawPartCatalogFile_
@@ -42,6 +42,7 @@
 #define MLCAD_EXTENSION							@"ini"
 #define MLCAD_INI_FILE_NAME						MLCAD @"." MLCAD_EXTENSION
 
-#define PART_CATALOG_NAME						@"Bricksmith Parts.plist"
+#define PART_CATALOG_NAME						@"Bricksmith Parts.catalog"
+#define PART_CATALOG_SCAN_NAME					@"Bricksmith Parts Scan.plist"
 
 #endif
\ No newline at end of file
@@ -38,6 +38,7 @@ typedef enum
 - (NSString *) ldconfigPath;
 - (NSString *) MLCadIniPath;
 - (NSString *) partCatalogPath;
+- (NSString *) partCatalogScanPath;
 - (NSString *) subpartsPathForDomain:(LDrawDomain)domain;
 
 // Utilities
@@ -281,6 +281,26 @@
 }
 
 
+//========== partCatalogScanPath ===============================================
+//
+// Purpose:		Returns the path of the file in which the catalog builder
+//				remembers what it found in each folder, so that the next
+//				rebuild only has to look at what changed.
+//
+//==============================================================================
+- (NSString *) partCatalogScanPath
+{
+	NSString        *pathToScan = nil;
+	
+	if(self->preferredLDrawPath != nil)
+	{
+		pathToScan = [self->preferredLDrawPath stringByAppendingPathComponent:PART_CATALOG_SCAN_NAME];
+	}
+	
+	return pathToScan;
+}
+
+
 //========== subpartsPathForDomain: ============================================
 //==============================================================================
 - (NSString *) subpartsPathForDomain:(LDrawDomain)domain
@@ -20,6 +20,7 @@
 @class LDrawDragHandle;
 @protocol LDrawRendererDelegate;
 @protocol LDrawCameraScroller;
+struct LDrawOcclusionStruct;
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -76,6 +77,9 @@ typedef enum
 // Initialization
 - (id) initWithBounds:(NSSize)boundsIn;
 
+// Drawing
+- (struct LDrawOcclusionStruct *) occlusionForFrame;	// NULL unless OCCLUSION_CULLING_KEY is set
+
 // Accessors
 - (LDrawDragHandle*) activeDragHandle;
 - (BOOL) didPartSelection;
@@ -29,6 +29,7 @@
 #import "LDrawFile.h"
 #import "LDrawModel.h"
 #import "LDrawMPDModel.h"
+#import "LDrawOcclusion.h"
 #import "LDrawPart.h"
 #import  LDrawShaderRendererGPU_h
 #import "LDrawStep.h"
@@ -58,6 +59,9 @@
 	Vector3                 draggingOffset;			// displacement between part 0's position and the initial click point of the drag
 	Point3                  initialDragLocation;	// point in model where part was positioned at draggingEntered
 	LDrawDragHandle			*activeDragHandle;		// drag handle hit on last mouse-down (or nil)
+
+	// Drawing
+	struct LDrawOcclusionStruct	*occlusion;			// kept between frames while the default is on
 }
 @end
 
@@ -90,6 +94,14 @@
 		
 	[self setViewOrientation:ViewOrientation3D];
 	
+	// Models draw boxes until their display lists are built in the
+	// background, so redraw whenever some are ready.
+	[[NSNotificationCenter defaultCenter]
+			addObserver:self
+			   selector:@selector(displayListsDidFinish:)
+				   name:LDrawDLBuildDidFinishNotification
+				 object:nil ];
+	
 	return self;
 	
 }//end initWithFrame:
@@ -99,6 +111,33 @@
 #pragma mark DRAWING
 #pragma mark -
 
+//========== occlusionForFrame =================================================
+//
+// Purpose:		Returns the occlusion culler the frame about to be drawn should
+//				use, or NULL if hidden parts are not to be culled.
+//
+// Notes:		The culler is approximate, so it is only on when the hidden
+//				default OCCLUSION_CULLING_KEY asks for it. It lives as long as
+//				we do, so its statistics add up over every frame drawn.
+//
+//==============================================================================
+- (struct LDrawOcclusionStruct *) occlusionForFrame
+{
+	BOOL wanted = [[NSUserDefaults standardUserDefaults] boolForKey:OCCLUSION_CULLING_KEY];
+
+	if(wanted && occlusion == NULL)
+		occlusion = LDrawOcclusionCreate(LDRAW_OCCLUSION_WIDTH, LDRAW_OCCLUSION_HEIGHT);
+	else if(!wanted && occlusion != NULL)
+	{
+		LDrawOcclusionDestroy(occlusion);
+		occlusion = NULL;
+	}
+
+	return occlusion;
+
+}//end occlusionForFrame
+
+
 //========== isFlipped =========================================================
 //
 // Purpose:		This lets us appear in the upper-left of scroll views rather 
@@ -1505,6 +1544,19 @@
 }//end displayNeedsUpdating
 
 
+//========== displayListsDidFinish: ============================================
+//
+// Purpose:		Display lists built in the background are ready to be taken,
+//				which happens when they are drawn.
+//
+//==============================================================================
+- (void) displayListsDidFinish:(NSNotification *)notification
+{
+	[self->delegate LDrawRendererNeedsRedisplay:self];
+	
+}//end displayListsDidFinish:
+
+
 //========== rotationCenterChanged: ============================================
 //
 // Purpose:		The active model changed the point around which it is to be spun.
@@ -2238,6 +2290,8 @@
 {
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 
+	LDrawOcclusionDestroy(occlusion);
+
 #ifndef METAL
 	[fileBeingDrawn	release];
 
@@ -11,6 +11,8 @@
 #import <Foundation/Foundation.h>
 
 #import "ColorLibrary.h"
+#import "LDrawLineTokenizer.h"
+#import "LDrawMappedFile.h"
 #import "MatrixMath.h"
 
 @class LDrawDirective;
@@ -53,7 +55,20 @@ typedef enum
 
 // Parsing
 + (Class) classForDirectiveBeginningWithLine:(NSString *)line;
++ (Class) classForGeometryLineAtIndex:(NSUInteger)index
+							  inLines:(NSArray *)lines;
++ (BOOL) lineAtIndex:(NSUInteger)index
+			inLines:(NSArray *)lines
+	  isMetaCommand:(NSString *)command;
 + (LDrawColor *) parseColorFromField:(NSString *)colorField;
++ (LDrawColor *) parseColorFromGeometryLine:(const LDrawGeometryLine *)fields;
++ (BOOL) readGeometryLine:(NSString *)line
+				   fields:(LDrawGeometryLine *)fieldsOut
+					 name:(NSString **)nameOut;
++ (BOOL) readGeometryLineAtIndex:(NSUInteger)index
+						 inLines:(NSArray *)lines
+						  fields:(LDrawGeometryLine *)fieldsOut
+							name:(NSString **)nameOut;
 + (NSString *) readNextField:(NSString *) partialDirective
 				   remainder:(NSString **) remainder;
 + (NSString *) scanQuotableToken:(NSScanner *)scanner;
@@ -13,8 +13,10 @@
 #import "LDrawColor.h"
 #import "LDrawConditionalLine.h"
 #import "LDrawContainer.h"
+#import "LDrawFloatConversion.h"
 #import "LDrawKeywords.h"
 #import "LDrawLine.h"
+#import "LDrawLineArray.h"
 #import "LDrawMetaCommand.h"
 #import "LDrawModel.h"
 #import "LDrawPart.h"
@@ -150,6 +152,105 @@ static NSString				*defaultAuthor		= @"anonymous";
 }//end classForDirectiveBeginningWithLine:
 
 
+//---------- classForGeometryLineAtIndex:inLines: --------------------[static]--
+//
+// Purpose:		Returns the class for a type 1-5 line, or Nil for anything else 
+//				(in which case the caller falls back on 
+//				+classForDirectiveBeginningWithLine:). 
+//
+// Notes:		This only looks at the line code, and never builds a string: 
+//				for an LDrawLineArray it reads straight from the file bytes. 
+//
+//------------------------------------------------------------------------------
++ (Class) classForGeometryLineAtIndex:(NSUInteger)index
+							  inLines:(NSArray *)lines
+{
+	Class       classForType    = Nil;
+	const char  *bytes          = NULL;
+	size_t      length          = 0;
+	NSString    *line           = nil;
+	char        prefix[8];
+	NSUInteger  prefixLength    = 0;
+	int         lineType        = -1;
+	
+	if([lines isKindOfClass:[LDrawLineArray class]])
+	{
+		bytes		= [(LDrawLineArray *)lines bytesForLineAtIndex:index length:&length];
+		lineType	= LDrawLineTypeOfBytes(bytes, length);
+	}
+	else
+	{
+		// The line code is all we need, and it is ASCII.
+		line			= [lines objectAtIndex:index];
+		prefixLength	= MIN([line length], sizeof(prefix));
+		for(length = 0; length < prefixLength; length++)
+		{
+			unichar character = [line characterAtIndex:length];
+			prefix[length] = (character < 0x80) ? (char)character : 'x';
+		}
+		lineType = LDrawLineTypeOfBytes(prefix, prefixLength);
+		
+		// A line code which runs to the end of the prefix might not end there.
+		if(LDrawFieldEnd(prefix, prefixLength, LDrawSkipWhitespace(prefix, prefixLength, 0)) == sizeof(prefix))
+			lineType = -1;
+	}
+	
+	switch(lineType)
+	{
+		case 1:		classForType = [LDrawPart class];				break;
+		case 2:		classForType = [LDrawLine class];				break;
+		case 3:		classForType = [LDrawTriangle class];			break;
+		case 4:		classForType = [LDrawQuadrilateral class];		break;
+		case 5:		classForType = [LDrawConditionalLine class];	break;
+		default:	classForType = Nil;								break;
+	}
+	
+	return classForType;
+	
+}//end classForGeometryLineAtIndex:inLines:
+
+
+//---------- lineAtIndex:inLines:isMetaCommand: ----------------------[static]--
+//
+// Purpose:		Returns YES if the line is "0 command ...", such as 0 STEP or 
+//				0 FILE name.ldr. 
+//
+// Notes:		Range detection runs this on every line of a file, so for an 
+//				LDrawLineArray it compares the file bytes rather than decoding 
+//				the line and splitting it into fields. 
+//
+//------------------------------------------------------------------------------
++ (BOOL) lineAtIndex:(NSUInteger)index
+			inLines:(NSArray *)lines
+	  isMetaCommand:(NSString *)command
+{
+	const char	*bytes			= NULL;
+	size_t		length			= 0;
+	NSString	*workingLine	= nil;
+	NSString	*parsedField	= nil;
+	BOOL		isCommand		= NO;
+	
+	if([lines isKindOfClass:[LDrawLineArray class]])
+	{
+		bytes		= [(LDrawLineArray *)lines bytesForLineAtIndex:index length:&length];
+		isCommand	= LDrawLineIsMetaCommand(bytes, length, [command UTF8String]);
+	}
+	else
+	{
+		workingLine = [lines objectAtIndex:index];
+		parsedField = [LDrawUtilities readNextField:workingLine remainder:&workingLine];
+		if([parsedField isEqualToString:@"0"])
+		{
+			parsedField	= [LDrawUtilities readNextField:workingLine remainder:&workingLine];
+			isCommand	= [parsedField isEqualToString:command];
+		}
+	}
+	
+	return isCommand;
+	
+}//end lineAtIndex:inLines:isMetaCommand:
+
+
 //---------- parseColorFromField: ------------------------------------[static]--
 //
 // Purpose:		Returns the color code which is represented by the field.
@@ -163,85 +264,232 @@ static NSString				*defaultAuthor		= @"anonymous";
 + (LDrawColor *) parseColorFromField:(NSString *)colorField
 {
 	NSScanner   *scanner        = [NSScanner scannerWithString:colorField];
-	LDrawColorT colorCode       = LDrawColorBogus;
 	unsigned	hexBytes        = 0;
-	int			customCodeType  = 0;
-	float		components[4]   = {};
 	LDrawColor	*color			= nil;
 
 	// Custom RGB?
 	if([scanner scanString:@"0x" intoString:nil] == YES)
 	{
-		// The integer should be of the format:
-		// 0x2RRGGBB for opaque colors
-		// 0x3RRGGBB for transparent colors
-		// 0x4RGBRGB for a dither of two 12-bit RGB colors
-		// 0x5RGBxxx as a dither of one 12-bit RGB color with clear (for transparency).
-
 		[scanner scanHexInt:&hexBytes];
-		customCodeType = (hexBytes >> 3*8) & 0xFF;
+		color = [self colorForCustomRGB:hexBytes];
+	}
+	else
+	{
+		// Regular, standards-compliant LDraw color code
+		color = [self colorForParsedCode:[colorField intValue]];
+	}
 		
-		switch(customCodeType)
-		{
-			// Solid color
-			case 2:
-				components[0] = (float) ((hexBytes >> 2*8) & 0xFF) / 255; // Red
-				components[1] = (float) ((hexBytes >> 1*8) & 0xFF) / 255; // Green
-				components[2] = (float) ((hexBytes >> 0*8) & 0xFF) / 255; // Blue
-				components[3] = (float) 1.0; // alpha
-				break;
-			
-			// Transparent color
-			case 3:
-				components[0] = (float) ((hexBytes >> 2*8) & 0xFF) / 255; // Red
-				components[1] = (float) ((hexBytes >> 1*8) & 0xFF) / 255; // Green
-				components[2] = (float) ((hexBytes >> 0*8) & 0xFF) / 255; // Blue
-				components[3] = (float) 0.5; // alpha
-				break;
-			
-			// combined opaque color
-			case 4:
-				components[0] = (float) (((hexBytes >> 5*4) & 0xF) + ((hexBytes >> 2*4) & 0xF))/2 / 255; // Red
-				components[0] = (float) (((hexBytes >> 4*4) & 0xF) + ((hexBytes >> 1*4) & 0xF))/2 / 255; // Green
-				components[0] = (float) (((hexBytes >> 3*4) & 0xF) + ((hexBytes >> 0*4) & 0xF))/2 / 255; // Blue
-				components[3] = (float) 1.0; // alpha
-				break;
-				
-			// bad-looking transparent color
-			case 5:
-				components[0] = (float) ((hexBytes >> 5*4) & 0xF) / 15; // Red
-				components[0] = (float) ((hexBytes >> 4*4) & 0xF) / 15; // Green
-				components[0] = (float) ((hexBytes >> 3*4) & 0xF) / 15; // Blue
-				components[3] = (float) 0.5; // alpha
-				break;
+	return color;
+	
+}//end parseColorFromField:
+
+
+//---------- parseColorFromGeometryLine: -----------------------------[static]--
+//
+// Purpose:		Returns the color of a line already broken up by 
+//				LDrawTokenizeGeometryLine(). 
+//
+//------------------------------------------------------------------------------
++ (LDrawColor *) parseColorFromGeometryLine:(const LDrawGeometryLine *)fields
+{
+	LDrawColor	*color	= nil;
+	
+	if(fields->isCustomRGB)
+		color = [self colorForCustomRGB:fields->customRGB];
+	else
+		color = [self colorForParsedCode:fields->colorCode];
+	
+	return color;
+	
+}//end parseColorFromGeometryLine:
+
+
+//---------- colorForCustomRGB: --------------------------------------[static]--
+//
+// Purpose:		Creates a color for the hex value which followed "0x" in a 
+//				color field.
+//
+//------------------------------------------------------------------------------
++ (LDrawColor *) colorForCustomRGB:(unsigned)hexBytes
+{
+	int			customCodeType  = 0;
+	float		components[4]   = {};
+	LDrawColor	*color			= nil;
+
+	// The integer should be of the format:
+	// 0x2RRGGBB for opaque colors
+	// 0x3RRGGBB for transparent colors
+	// 0x4RGBRGB for a dither of two 12-bit RGB colors
+	// 0x5RGBxxx as a dither of one 12-bit RGB color with clear (for transparency).
+
+	customCodeType = (hexBytes >> 3*8) & 0xFF;
+	
+	switch(customCodeType)
+	{
+		// Solid color
+		case 2:
+			components[0] = (float) ((hexBytes >> 2*8) & 0xFF) / 255; // Red
+			components[1] = (float) ((hexBytes >> 1*8) & 0xFF) / 255; // Green
+			components[2] = (float) ((hexBytes >> 0*8) & 0xFF) / 255; // Blue
+			components[3] = (float) 1.0; // alpha
+			break;
+		
+		// Transparent color
+		case 3:
+			components[0] = (float) ((hexBytes >> 2*8) & 0xFF) / 255; // Red
+			components[1] = (float) ((hexBytes >> 1*8) & 0xFF) / 255; // Green
+			components[2] = (float) ((hexBytes >> 0*8) & 0xFF) / 255; // Blue
+			components[3] = (float) 0.5; // alpha
+			break;
+		
+		// combined opaque color
+		case 4:
+			components[0] = (float) (((hexBytes >> 5*4) & 0xF) + ((hexBytes >> 2*4) & 0xF))/2 / 255; // Red
+			components[0] = (float) (((hexBytes >> 4*4) & 0xF) + ((hexBytes >> 1*4) & 0xF))/2 / 255; // Green
+			components[0] = (float) (((hexBytes >> 3*4) & 0xF) + ((hexBytes >> 0*4) & 0xF))/2 / 255; // Blue
+			components[3] = (float) 1.0; // alpha
+			break;
 			
-			default:
-				break;
-		}
+		// bad-looking transparent color
+		case 5:
+			components[0] = (float) ((hexBytes >> 5*4) & 0xF) / 15; // Red
+			components[0] = (float) ((hexBytes >> 4*4) & 0xF) / 15; // Green
+			components[0] = (float) ((hexBytes >> 3*4) & 0xF) / 15; // Blue
+			components[3] = (float) 0.5; // alpha
+			break;
 		
+		default:
+			break;
+	}
+	
+	color = [[LDrawColor alloc] init];
+	[color setColorCode:LDrawColorCustomRGB];
+	[color setEdgeColorCode:LDrawBlack];
+	[color setColorRGBA:components];
+	
+	return color;
+	
+}//end colorForCustomRGB:
+
+
+//---------- colorForParsedCode: -------------------------------------[static]--
+//
+// Purpose:		Returns the library color for a code read out of a file, 
+//				making up a placeholder if the code isn't one we know.
+//
+//------------------------------------------------------------------------------
++ (LDrawColor *) colorForParsedCode:(LDrawColorT)colorCode
+{
+	LDrawColor	*color	= [[ColorLibrary sharedColorLibrary] colorForCode:colorCode];
+	
+	if(color == nil)
+	{
+		// This is probably a file-local color. Or a file from the future.
 		color = [[LDrawColor alloc] init];
-		[color setColorCode:LDrawColorCustomRGB];
+		[color setColorCode:colorCode];
 		[color setEdgeColorCode:LDrawBlack];
-		[color setColorRGBA:components];
 	}
-	else
+	
+	return color;
+	
+}//end colorForParsedCode:
+
+
+//---------- readGeometryLine:fields:name: ---------------------------[static]--
+//
+// Purpose:		Breaks a type 1-5 line into its fields in one pass, without 
+//				creating a string for each field the way -readNextField: does. 
+//
+//				If nameOut is not NULL, the trimmed remainder of a type 1 line 
+//				(the part name) is returned by indirection. It is the only 
+//				string this method allocates. 
+//
+// Notes:		The line's bytes are borrowed directly from the string whenever 
+//				CoreFoundation can hand them over; otherwise they are copied 
+//				into a stack buffer. 
+//
+//------------------------------------------------------------------------------
++ (BOOL) readGeometryLine:(NSString *)line
+				   fields:(LDrawGeometryLine *)fieldsOut
+					 name:(NSString **)nameOut
+{
+	CFStringRef	lineRef			= (__bridge CFStringRef)line;
+	const char	*bytes			= CFStringGetCStringPtr(lineRef, kCFStringEncodingUTF8);
+	char		stackBuffer[512];
+	BOOL		success			= NO;
+	
+	if(bytes == NULL)
 	{
-		// Regular, standards-compliant LDraw color code
-		colorCode   = [colorField intValue];
-		color       = [[ColorLibrary sharedColorLibrary] colorForCode:colorCode];
-		
-		if(color == nil)
+		if(CFStringGetCString(lineRef, stackBuffer, sizeof(stackBuffer), kCFStringEncodingUTF8))
+			bytes = stackBuffer;
+		else
+			bytes = [line UTF8String]; // absurdly long line
+	}
+	
+	success = LDrawTokenizeGeometryLine(bytes, strlen(bytes), fieldsOut);
+	
+	if(nameOut != NULL)
+	{
+		if(success && fieldsOut->name != NULL)
 		{
-			// This is probably a file-local color. Or a file from the future.
-			color = [[LDrawColor alloc] init];
-			[color setColorCode:colorCode];
-			[color setEdgeColorCode:LDrawBlack];
+			*nameOut = [[NSString alloc] initWithBytes:fieldsOut->name
+												length:fieldsOut->nameLength
+											  encoding:NSUTF8StringEncoding];
 		}
+		else
+			*nameOut = @"";
 	}
-		
-	return color;
 	
-}//end parseColorFromField:
+	// The name span may point into our stack buffer; don't let it escape.
+	fieldsOut->name = NULL;
+	
+	return success;
+	
+}//end readGeometryLine:fields:name:
+
+
+//---------- readGeometryLineAtIndex:inLines:fields:name: ------------[static]--
+//
+// Purpose:		Same as +readGeometryLine:fields:name:, but for a line of a 
+//				file. If lines is an LDrawLineArray, the line is tokenized in 
+//				place in the file bytes and never becomes a string. 
+//
+//------------------------------------------------------------------------------
++ (BOOL) readGeometryLineAtIndex:(NSUInteger)index
+						 inLines:(NSArray *)lines
+						  fields:(LDrawGeometryLine *)fieldsOut
+							name:(NSString **)nameOut
+{
+	LDrawLineArray  *lineArray  = nil;
+	const char      *bytes      = NULL;
+	size_t          length      = 0;
+	BOOL            success     = NO;
+	
+	if([lines isKindOfClass:[LDrawLineArray class]] == NO)
+	{
+		return [self readGeometryLine:[lines objectAtIndex:index]
+							   fields:fieldsOut
+								 name:nameOut];
+	}
+	
+	lineArray	= (LDrawLineArray *)lines;
+	bytes		= [lineArray bytesForLineAtIndex:index length:&length];
+	success		= LDrawTokenizeGeometryLine(bytes, length, fieldsOut);
+	
+	if(nameOut != NULL)
+	{
+		if(success && fieldsOut->name != NULL)
+			*nameOut = [lineArray stringWithBytes:fieldsOut->name length:fieldsOut->nameLength];
+		else
+			*nameOut = @"";
+	}
+	
+	// Keep the same contract as the string version.
+	fieldsOut->name = NULL;
+	
+	return success;
+	
+}//end readGeometryLineAtIndex:inLines:fields:name:
 
 
 //---------- readNextField:remainder: --------------------------------[static]--
@@ -356,7 +604,11 @@ static NSString				*defaultAuthor		= @"anonymous";
 //------------------------------------------------------------------------------
 + (NSString *) stringFromFile:(NSString *)path
 {
-	NSData      *fileData   = [NSData dataWithContentsOfFile:path];
+	// Mapped rather than copied; the string decoded from it is the only copy 
+	// of the contents we make. 
+	NSData      *fileData   = [NSData dataWithContentsOfFile:path
+												 options:NSDataReadingMappedIfSafe
+												   error:NULL];
 	NSString    *fileString = [self stringFromFileData:fileData];
 	
 	return fileString;
@@ -367,23 +619,37 @@ static NSString				*defaultAuthor		= @"anonymous";
 //---------- stringFromFileData: -------------------------------------[static]--
 //
 // Purpose:		Reads the contents of the file with the given data into a 
-//				string. We try a few different encodings. 
+//				string. We accept UTF-8, and fall back on Windows Latin. 
+//
+// Notes:		We used to just try decoding with one encoding after another. 
+//				Now the encoding is worked out with one scan of the bytes, so 
+//				the data is decoded exactly once. 
 //
 //------------------------------------------------------------------------------
 + (NSString *) stringFromFileData:(NSData *)fileData
 {
-	NSString    *fileString = nil;
+	NSString            *fileString = nil;
+	LDrawTextEncodingT  encoding    = LDrawTextEncodingASCII;
 	
 	if(fileData)
 	{
-		// Try UTF-8 first, because it's so nice.
-		fileString = [[NSString alloc] initWithData:fileData
-										   encoding:NSUTF8StringEncoding ];
+		encoding = LDrawDetectTextEncoding([fileData bytes], [fileData length]);
 		
-		// Uh-oh. Maybe Windows Latin?
-		if(fileString == nil)
-			fileString = [[NSString alloc] initWithData:fileData
-											   encoding:NSISOLatin1StringEncoding ];
+		switch(encoding)
+		{
+			case LDrawTextEncodingASCII:
+			case LDrawTextEncodingUTF8:
+				// Try UTF-8 first, because it's so nice.
+				fileString = [[NSString alloc] initWithData:fileData
+												   encoding:NSUTF8StringEncoding ];
+				break;
+				
+			case LDrawTextEncodingLatin1:
+				// Uh-oh. Maybe Windows Latin?
+				fileString = [[NSString alloc] initWithData:fileData
+												   encoding:NSISOLatin1StringEncoding ];
+				break;
+		}
 		
 		// Yikes. Not even Windows. MacRoman will do it, even if it doesn't look 
 		// right. 
@@ -489,32 +755,15 @@ static NSString				*defaultAuthor		= @"anonymous";
 	}
 	else
 	{
-		// Remove all trailing zeroes (and the decimal point if an integer).
-		
-		char    formattedFloat[16]  = "";
-		char    *endOfString        = NULL;
-		size_t  fullLength          = 0;
-		
-		// First format the number into a string. We could wind up with 
-		// something like "50.090000".
-		snprintf(formattedFloat, sizeof(formattedFloat), "%f", number);
-		fullLength  = strlen(formattedFloat);
-		endOfString = &formattedFloat[fullLength - 1];
-		
-		// Back up past all the zeroes that may be at the end of the number
-		while(*endOfString == '0')
-		{
-			endOfString--;
-		}
-		if(*endOfString != '.')
-		{
-			// We must be pointing at a non-zero digit, so lop off the 
-			// subsequent character that is a zero. 
-			endOfString++;
-		}
+		// The shortest text which reads back as exactly this number, with no
+		// trailing zeroes (and no decimal point if an integer). That keeps a
+		// file's numbers byte-for-byte stable across save and reload.
+		char    formattedFloat[LDRAW_FLOAT_CHARS_MAX]   = "";
+		size_t  length                                  = LDrawFloatToChars(number, formattedFloat);
 		
-		*endOfString = '\0';
-		outputString = [NSString stringWithUTF8String:formattedFloat];
+		outputString = [[NSString alloc] initWithBytes:formattedFloat
+		                                        length:length
+		                                      encoding:NSASCIIStringEncoding];
 	}
 	
 	return outputString;
@@ -9,6 +9,10 @@
 
 #include "MatrixMathEx.h"
 
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
 
 #if !defined(MIN)
     #define MIN(A,B)	({ __typeof__(A) __a = (A); __typeof__(B) __b = (B); __a < __b ? __a : __b; })
@@ -12,6 +12,7 @@
 #import "ModelManager.h"
 #import "StringCategory.h"
 #import "LDrawFile.h"
+#import "LDrawLineArray.h"
 #import "LDrawMPDModel.h"
 #import "LDrawUtilities.h"
 
@@ -152,17 +153,15 @@
 	if (![fileManager fileExistsAtPath:fullPath])
 		return nil;
 	
-	NSString *	fileContents	= [LDrawUtilities stringFromFile:fullPath];
-	NSArray *	lines			= [fileContents separateByLine];		
+	LDrawLineStream *	stream	= [LDrawLineStream streamFromFile:fullPath];
 	
 	dispatch_group_t group = NULL;
 #if USE_BLOCKS
 	group           = dispatch_group_create();
 #endif
 	
-	LDrawFile * parsedFile = [[LDrawFile alloc] initWithLines:lines
-												   inRange:NSMakeRange(0, [lines count])
-											   parentGroup:group];
+	LDrawFile * parsedFile = [[LDrawFile alloc] initWithLineStream:stream
+											        parentGroup:group];
 	
 #if USE_BLOCKS
 	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
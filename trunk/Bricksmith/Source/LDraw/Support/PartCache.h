@@ -0,0 +1,56 @@
+//==============================================================================
+//
+// File:		PartCache.h
+//
+// Purpose:		A persistent cache of library parts in their parsed, flattened
+//				and optimized form, so that the parts used by a model only have
+//				to be parsed the first time Bricksmith ever sees them.
+//
+//				The part library asks the cache for a part before reading it
+//				from disk, and hands each part it does read back to the cache.
+//				Entries are stored one per part (see LDrawPartCacheFile.h) and
+//				are discarded automatically when the part, anything it pulls
+//				in, or LDConfig.ldr changes.
+//
+//				Parts containing anything other than lines, conditional lines,
+//				triangles and quadrilaterals after flattening (textures, for
+//				instance) are simply not cached, nor are parts which refer to
+//				files that couldn't be found.
+//
+//==============================================================================
+#import <Foundation/Foundation.h>
+
+@class LDrawFile;
+@class LDrawModel;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// class PartCache
+//
+////////////////////////////////////////////////////////////////////////////////
+@interface PartCache : NSObject
+{
+	NSString				*directory;
+	dispatch_queue_t		accessQueue;		// serializes the members below
+	NSMutableDictionary		*dependencyPaths;	// part path -> every file it was built from
+	NSUInteger				hitCount;
+	NSUInteger				missCount;
+}
+
+// Initialization
++ (NSString *) defaultDirectory;
++ (NSString *) defaultMeshDirectory;
+- (id) initWithDirectory:(NSString *)directoryPath;
+
+// Accessors
+- (NSString *) directory;
+- (NSUInteger) hitCount;
+- (NSUInteger) missCount;
+
+// Caching
+- (LDrawModel *) modelForPath:(NSString *)partPath;
+- (NSArray *) referencedPathsInFile:(LDrawFile *)file;
+- (void) storeModel:(LDrawModel *)model forPath:(NSString *)partPath referencedPaths:(NSArray *)referencedPaths;
+
+@end
@@ -0,0 +1,664 @@
+//==============================================================================
+//
+// File:		PartCache.m
+//
+// Purpose:		A persistent cache of library parts in their parsed, flattened
+//				and optimized form.
+//
+// Notes:		A flattened part contains the geometry of every subpart and
+//				primitive it refers to, so its entry must go stale when any of
+//				them changes. Each entry therefore lists all the files it was
+//				built from, not just the ones it names directly. We learn a
+//				part's full list when we load or store it, and since a part's
+//				references are always loaded before the part itself is
+//				finished, the lists of its references are on hand when it is
+//				stored.
+//
+//==============================================================================
+#import "PartCache.h"
+
+#import "ColorLibrary.h"
+#import "LDrawColor.h"
+#import "LDrawConditionalLine.h"
+#import "LDrawFile.h"
+#import "LDrawLine.h"
+#import "LDrawMPDModel.h"
+#import "LDrawPart.h"
+#import "LDrawPartCacheFile.h"
+#import "LDrawPaths.h"
+#import "LDrawQuadrilateral.h"
+#import "LDrawStep.h"
+#import "LDrawTriangle.h"
+
+#define PART_CACHE_FOLDER_NAME		@"Parts"
+#define MESH_CACHE_FOLDER_NAME		@"Meshes"
+#define PART_CACHE_EXTENSION		@"bspc"
+
+
+@implementation PartCache
+
+#pragma mark -
+#pragma mark INITIALIZATION
+#pragma mark -
+
+//---------- defaultDirectory ----------------------------------------[static]--
+//
+// Purpose:		Returns the folder in the user's Caches directory where part
+//				entries are kept.
+//
+//------------------------------------------------------------------------------
++ (NSString *) defaultDirectory
+{
+	NSString	*caches				= [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+	NSString	*bundleIdentifier	= [[NSBundle mainBundle] bundleIdentifier];
+
+	if(bundleIdentifier == nil)
+		bundleIdentifier = @"Bricksmith";
+
+	return [[caches stringByAppendingPathComponent:bundleIdentifier] stringByAppendingPathComponent:PART_CACHE_FOLDER_NAME];
+
+}//end defaultDirectory
+
+
+//---------- defaultMeshDirectory ------------------------------------[static]--
+//
+// Purpose:		Returns the folder beside the part entries where the display
+//				lists keep their smoothed meshes (see LDrawMeshCache.h).
+//
+//------------------------------------------------------------------------------
++ (NSString *) defaultMeshDirectory
+{
+	NSString	*cachesFolder	= [[self defaultDirectory] stringByDeletingLastPathComponent];
+
+	return [cachesFolder stringByAppendingPathComponent:MESH_CACHE_FOLDER_NAME];
+
+}//end defaultMeshDirectory
+
+
+//========== initWithDirectory: ================================================
+//
+// Purpose:		Creates a cache which keeps its entries in directoryPath,
+//				creating the folder if necessary.
+//
+//==============================================================================
+- (id) initWithDirectory:(NSString *)directoryPath
+{
+	self = [super init];
+
+	if(self)
+	{
+		directory		= [directoryPath copy];
+		accessQueue		= dispatch_queue_create("com.AllenSmith.Bricksmith.PartCache", NULL);
+		dependencyPaths	= [[NSMutableDictionary alloc] init];
+		hitCount		= 0;
+		missCount		= 0;
+
+		[[NSFileManager defaultManager] createDirectoryAtPath:directory
+								  withIntermediateDirectories:YES
+												   attributes:nil
+														error:NULL];
+	}
+
+	return self;
+
+}//end initWithDirectory:
+
+
+#pragma mark -
+#pragma mark ACCESSORS
+#pragma mark -
+
+//========== directory =========================================================
+//
+// Purpose:		The folder where entries are kept.
+//
+//==============================================================================
+- (NSString *) directory
+{
+	return self->directory;
+
+}//end directory
+
+
+//========== hitCount ==========================================================
+//
+// Purpose:		Number of parts which have been loaded from the cache.
+//
+//==============================================================================
+- (NSUInteger) hitCount
+{
+	__block NSUInteger count = 0;
+
+	dispatch_sync(self->accessQueue, ^{ count = self->hitCount; });
+
+	return count;
+
+}//end hitCount
+
+
+//========== missCount =========================================================
+//
+// Purpose:		Number of parts which had to be parsed because they weren't in
+//				the cache or their entry was stale.
+//
+//==============================================================================
+- (NSUInteger) missCount
+{
+	__block NSUInteger count = 0;
+
+	dispatch_sync(self->accessQueue, ^{ count = self->missCount; });
+
+	return count;
+
+}//end missCount
+
+
+#pragma mark -
+#pragma mark CACHING
+#pragma mark -
+
+//========== modelForPath: =====================================================
+//
+// Purpose:		Returns the optimized model for the part at partPath, or nil if
+//				there is no current entry for it.
+//
+//==============================================================================
+- (LDrawModel *) modelForPath:(NSString *)partPath
+{
+	NSString				*entryPath		= [self entryPathForPartPath:partPath];
+	LDrawPartCacheEntry		*entry			= LDrawPartCacheEntryOpen([entryPath fileSystemRepresentation]);
+	LDrawModel				*model			= nil;
+	NSMutableArray			*dependencies	= nil;
+	NSUInteger				counter			= 0;
+
+	if(entry != NULL)
+	{
+		// The first dependency is always the part itself; it guards against
+		// two paths which happen to hash alike.
+		if(		entry->header->dependencyCount > 0
+		   &&	[[self stringInEntry:entry string:entry->dependencies[0].path] isEqualToString:partPath]
+		   &&	LDrawPartCacheEntryIsCurrent(entry) )
+		{
+			model = [self modelFromEntry:entry];
+		}
+
+		if(model != nil)
+		{
+			dependencies = [NSMutableArray arrayWithCapacity:entry->header->dependencyCount];
+			for(counter = 1; counter < entry->header->dependencyCount; counter++)
+			{
+				[dependencies addObject:[self stringInEntry:entry string:entry->dependencies[counter].path]];
+			}
+		}
+
+		LDrawPartCacheEntryClose(entry);
+	}
+
+	dispatch_sync(self->accessQueue,
+	^{
+		if(model != nil)
+		{
+			[self->dependencyPaths setObject:dependencies forKey:partPath];
+			self->hitCount += 1;
+		}
+		else
+			self->missCount += 1;
+	});
+
+	return model;
+
+}//end modelForPath:
+
+
+//========== referencedPathsInFile: ============================================
+//
+// Purpose:		Returns the paths of the library files a freshly-parsed part
+//				refers to. This must be called before the file is optimized,
+//				since that flattens the references away.
+//
+//				Returns nil if any reference can't be found; such a part must
+//				not be cached, as it would change when the missing file turns
+//				up.
+//
+//==============================================================================
+- (NSArray *) referencedPathsInFile:(LDrawFile *)file
+{
+	NSMutableArray	*paths		= [NSMutableArray array];
+	__block BOOL	complete	= YES;
+
+	[file applyToAllParts:^(LDrawPart *part)
+	{
+		NSString *path = nil;
+
+		// References to other models in the same file are part of this file.
+		if([part referencedMPDSubmodel] == nil)
+		{
+			path = [[LDrawPaths sharedPaths] pathForPartName:[part referenceName]];
+			if(path != nil)
+				[paths addObject:path];
+			else
+				complete = NO;
+		}
+	}];
+
+	return complete ? paths : nil;
+
+}//end referencedPathsInFile:
+
+
+//========== storeModel:forPath:referencedPaths: ===============================
+//
+// Purpose:		Saves an optimized part read from partPath. referencedPaths
+//				comes from -referencedPathsInFile:, called before the part was
+//				optimized.
+//
+//==============================================================================
+- (void) storeModel:(LDrawModel *)model
+			forPath:(NSString *)partPath
+	referencedPaths:(NSArray *)referencedPaths
+{
+	NSMutableArray			*allPaths			= nil;
+	NSMutableArray			*lines				= [NSMutableArray array];
+	NSMutableArray			*conditionalLines	= [NSMutableArray array];
+	NSMutableArray			*triangles			= [NSMutableArray array];
+	NSMutableArray			*quadrilaterals		= [NSMutableArray array];
+	NSMutableArray			*colors				= [NSMutableArray array];
+	NSMutableDictionary		*colorIndexes		= [NSMutableDictionary dictionary];
+	NSMutableData			*dependencyData		= [NSMutableData data];
+	NSMutableData			*colorData			= [NSMutableData data];
+	NSMutableData			*primitiveData		= [NSMutableData data];
+	NSMutableData			*strings			= [NSMutableData data];
+	LDrawPartCacheHeader	header;
+	Box3					bounds				= [model boundingBox3];
+	BOOL					cacheable			= YES;
+
+	if(model == nil || partPath == nil || referencedPaths == nil)
+		return;
+
+	// Sort the directives exactly as -optimizeStructure left them.
+	for(LDrawStep *step in [model subdirectives])
+	{
+		for(LDrawDirective *directive in [step subdirectives])
+		{
+			if([directive class] == [LDrawLine class])
+				[lines addObject:directive];
+			else if([directive class] == [LDrawConditionalLine class])
+				[conditionalLines addObject:directive];
+			else if([directive class] == [LDrawTriangle class])
+				[triangles addObject:directive];
+			else if([directive class] == [LDrawQuadrilateral class])
+				[quadrilaterals addObject:directive];
+			else
+				cacheable = NO;
+		}
+	}
+
+	// Everything this part was built from.
+	allPaths = [self dependencyPathsForPartPath:partPath referencedPaths:referencedPaths];
+	if(allPaths == nil)
+		cacheable = NO;
+
+	if(cacheable == NO)
+		return;
+
+	memset(&header, 0, sizeof(header));
+
+	for(NSString *path in allPaths)
+	{
+		LDrawCachedDependency dependency;
+
+		if(LDrawFileStampForPath([path fileSystemRepresentation], &dependency.stamp) == false)
+			return;
+		dependency.path = [self appendString:path toStrings:strings];
+		[dependencyData appendBytes:&dependency length:sizeof(dependency)];
+	}
+
+	[self appendPrimitives:lines			vertexCount:2 data:primitiveData colors:colors indexes:colorIndexes];
+	[self appendPrimitives:conditionalLines	vertexCount:4 data:primitiveData colors:colors indexes:colorIndexes];
+	[self appendPrimitives:triangles		vertexCount:3 data:primitiveData colors:colors indexes:colorIndexes];
+	[self appendPrimitives:quadrilaterals	vertexCount:4 data:primitiveData colors:colors indexes:colorIndexes];
+
+	for(LDrawColor *color in colors)
+	{
+		LDrawCachedColor cachedColor;
+
+		memset(&cachedColor, 0, sizeof(cachedColor));
+		cachedColor.colorCode		= [color colorCode];
+		cachedColor.edgeColorCode	= [color edgeColorCode];
+		cachedColor.isLibraryColor	= ([[ColorLibrary sharedColorLibrary] colorForCode:[color colorCode]] == color);
+		[color getColorRGBA:cachedColor.colorRGBA];
+		[color getEdgeColorRGBA:cachedColor.edgeColorRGBA];
+
+		[colorData appendBytes:&cachedColor length:sizeof(cachedColor)];
+	}
+
+	header.dependencyCount		= (uint32_t)[allPaths count];
+	header.colorCount			= (uint32_t)[colors count];
+	header.lineCount			= (uint32_t)[lines count];
+	header.conditionalLineCount	= (uint32_t)[conditionalLines count];
+	header.triangleCount		= (uint32_t)[triangles count];
+	header.quadrilateralCount	= (uint32_t)[quadrilaterals count];
+
+	header.boundsMinimum[0]		= bounds.min.x;
+	header.boundsMinimum[1]		= bounds.min.y;
+	header.boundsMinimum[2]		= bounds.min.z;
+	header.boundsMaximum[0]		= bounds.max.x;
+	header.boundsMaximum[1]		= bounds.max.y;
+	header.boundsMaximum[2]		= bounds.max.z;
+
+	if([model isKindOfClass:[LDrawMPDModel class]])
+		header.modelName		= [self appendString:[(LDrawMPDModel *)model modelName] toStrings:strings];
+	header.modelDescription		= [self appendString:[model modelDescription] toStrings:strings];
+	header.fileName				= [self appendString:[model fileName] toStrings:strings];
+	header.author				= [self appendString:[model author] toStrings:strings];
+	header.stringsLength		= (uint32_t)[strings length];
+
+	LDrawPartCacheEntryWrite([[self entryPathForPartPath:partPath] fileSystemRepresentation],
+							 &header,
+							 [dependencyData bytes],
+							 [colorData bytes],
+							 [primitiveData bytes],
+							 [strings bytes]);
+
+	// Even if writing failed, parts which use this one can still be cached.
+	dispatch_sync(self->accessQueue,
+	^{
+		[self->dependencyPaths setObject:[allPaths subarrayWithRange:NSMakeRange(1, [allPaths count] - 1)]
+								  forKey:partPath];
+	});
+
+}//end storeModel:forPath:referencedPaths:
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== appendPrimitives:vertexCount:data:colors:indexes: =================
+//
+// Purpose:		Packs primitives into cache records, assigning each new color
+//				the next slot in the color table.
+//
+//==============================================================================
+- (void) appendPrimitives:(NSArray *)primitives
+			  vertexCount:(NSUInteger)vertexCount
+					 data:(NSMutableData *)data
+				   colors:(NSMutableArray *)colors
+				  indexes:(NSMutableDictionary *)colorIndexes
+{
+	LDrawCachedPrimitive	record;
+	Point3					vertices[4];
+	Vector3					normal			= ZeroPoint3;
+	NSValue					*colorKey		= nil;
+	NSNumber				*colorIndex		= nil;
+	NSUInteger				counter			= 0;
+
+	for(id primitive in primitives)
+	{
+		LDrawColor *color = [primitive LDrawColor];
+
+		colorKey	= [NSValue valueWithNonretainedObject:color];
+		colorIndex	= [colorIndexes objectForKey:colorKey];
+		if(colorIndex == nil)
+		{
+			colorIndex = [NSNumber numberWithUnsignedInteger:[colors count]];
+			[colors addObject:color];
+			[colorIndexes setObject:colorIndex forKey:colorKey];
+		}
+
+		normal		= ZeroPoint3;
+		vertices[0]	= [primitive vertex1];
+		vertices[1]	= [primitive vertex2];
+		if([primitive isKindOfClass:[LDrawConditionalLine class]])
+		{
+			vertices[2]	= [primitive conditionalVertex1];
+			vertices[3]	= [primitive conditionalVertex2];
+		}
+		else if([primitive isKindOfClass:[LDrawTriangle class]])
+		{
+			vertices[2]	= [primitive vertex3];
+			normal		= [primitive normal];
+		}
+		else if([primitive isKindOfClass:[LDrawQuadrilateral class]])
+		{
+			vertices[2]	= [primitive vertex3];
+			vertices[3]	= [primitive vertex4];
+			normal		= [primitive normal];
+		}
+
+		memset(&record, 0, sizeof(record));
+		record.colorIndex = (uint32_t)[colorIndex unsignedIntegerValue];
+		for(counter = 0; counter < vertexCount; counter++)
+		{
+			record.vertices[counter][0] = vertices[counter].x;
+			record.vertices[counter][1] = vertices[counter].y;
+			record.vertices[counter][2] = vertices[counter].z;
+		}
+		record.normal[0] = normal.x;
+		record.normal[1] = normal.y;
+		record.normal[2] = normal.z;
+
+		[data appendBytes:&record length:sizeof(record)];
+	}
+
+}//end appendPrimitives:vertexCount:data:colors:indexes:
+
+
+//========== appendString:toStrings: ===========================================
+//
+// Purpose:		Adds string's UTF-8 bytes to the string table.
+//
+//==============================================================================
+- (LDrawCachedString) appendString:(NSString *)string toStrings:(NSMutableData *)strings
+{
+	LDrawCachedString	cachedString;
+	const char			*bytes			= [string UTF8String];
+
+	cachedString.offset	= (uint32_t)[strings length];
+	cachedString.length	= (bytes != NULL) ? (uint32_t)strlen(bytes) : 0;
+
+	if(cachedString.length > 0)
+		[strings appendBytes:bytes length:cachedString.length];
+
+	return cachedString;
+
+}//end appendString:toStrings:
+
+
+//========== colorFromCachedColor: =============================================
+//
+// Purpose:		Resolves a color table entry. Returns nil if a library color has
+//				vanished, which can't happen unless LDConfig.ldr changed.
+//
+//==============================================================================
+- (LDrawColor *) colorFromCachedColor:(const LDrawCachedColor *)cachedColor
+{
+	LDrawColor	*color	= nil;
+
+	if(cachedColor->isLibraryColor)
+		color = [[ColorLibrary sharedColorLibrary] colorForCode:cachedColor->colorCode];
+	else
+	{
+		float colorRGBA[4];
+		float edgeColorRGBA[4];
+
+		memcpy(colorRGBA,		cachedColor->colorRGBA,		sizeof(colorRGBA));
+		memcpy(edgeColorRGBA,	cachedColor->edgeColorRGBA,	sizeof(edgeColorRGBA));
+
+		color = [[LDrawColor alloc] init];
+		[color setColorCode:cachedColor->colorCode];
+		[color setEdgeColorCode:cachedColor->edgeColorCode];
+		[color setColorRGBA:colorRGBA];
+		[color setEdgeColorRGBA:edgeColorRGBA];
+	}
+
+	return color;
+
+}//end colorFromCachedColor:
+
+
+//========== dependencyPathsForPartPath:referencedPaths: =======================
+//
+// Purpose:		Returns partPath, LDConfig.ldr, and every file the referenced
+//				files were themselves built from, without repeats. Returns nil
+//				if one of the references was never cached.
+//
+//==============================================================================
+- (NSMutableArray *) dependencyPathsForPartPath:(NSString *)partPath
+								referencedPaths:(NSArray *)referencedPaths
+{
+	NSMutableOrderedSet	*paths			= [NSMutableOrderedSet orderedSetWithObject:partPath];
+	NSString			*ldconfigPath	= [[LDrawPaths sharedPaths] ldconfigPath];
+	__block BOOL		complete		= YES;
+
+	if(ldconfigPath != nil)
+		[paths addObject:ldconfigPath];
+
+	dispatch_sync(self->accessQueue,
+	^{
+		for(NSString *referencedPath in referencedPaths)
+		{
+			NSArray *nestedPaths = [self->dependencyPaths objectForKey:referencedPath];
+
+			if(nestedPaths == nil)
+			{
+				complete = NO;
+				break;
+			}
+			[paths addObject:referencedPath];
+			[paths addObjectsFromArray:nestedPaths];
+		}
+	});
+
+	return complete ? [[paths array] mutableCopy] : nil;
+
+}//end dependencyPathsForPartPath:referencedPaths:
+
+
+//========== entryPathForPartPath: =============================================
+//
+// Purpose:		Where the entry for a part lives.
+//
+//==============================================================================
+- (NSString *) entryPathForPartPath:(NSString *)partPath
+{
+	uint64_t	key			= LDrawPartCacheKeyForPath([partPath fileSystemRepresentation]);
+	NSString	*fileName	= [NSString stringWithFormat:@"%016llx.%@", (unsigned long long)key, PART_CACHE_EXTENSION];
+
+	return [self->directory stringByAppendingPathComponent:fileName];
+
+}//end entryPathForPartPath:
+
+
+//========== modelFromEntry: ===================================================
+//
+// Purpose:		Rebuilds the optimized model an entry describes, arranged the
+//				same way -[LDrawModel optimizeStructure] arranges it.
+//
+//==============================================================================
+- (LDrawModel *) modelFromEntry:(const LDrawPartCacheEntry *)entry
+{
+	const LDrawPartCacheHeader	*header				= entry->header;
+	const LDrawCachedPrimitive	*record				= entry->primitives;
+	NSMutableArray				*colors				= [NSMutableArray arrayWithCapacity:header->colorCount];
+	NSMutableArray				*steps				= [NSMutableArray array];
+	LDrawStep					*linesStep			= [LDrawStep emptyStepWithFlavor:LDrawStepLines];
+	LDrawStep					*trianglesStep		= [LDrawStep emptyStepWithFlavor:LDrawStepTriangles];
+	LDrawStep					*quadrilateralsStep	= [LDrawStep emptyStepWithFlavor:LDrawStepQuadrilaterals];
+	LDrawMPDModel				*model				= [[LDrawMPDModel alloc] init];
+	Box3						bounds				= InvalidBox;
+	uint32_t					counter				= 0;
+
+	for(counter = 0; counter < header->colorCount; counter++)
+	{
+		LDrawColor *color = [self colorFromCachedColor:entry->colors + counter];
+
+		if(color == nil)
+			return nil;
+		[colors addObject:color];
+	}
+
+	for(counter = 0; counter < header->lineCount; counter++, record++)
+	{
+		LDrawLine *line = [[LDrawLine alloc] init];
+
+		[line setLDrawColor:[colors objectAtIndex:record->colorIndex]];
+		[line setVertex1:V3Make(record->vertices[0][0], record->vertices[0][1], record->vertices[0][2])];
+		[line setVertex2:V3Make(record->vertices[1][0], record->vertices[1][1], record->vertices[1][2])];
+		[linesStep addDirective:line];
+	}
+	for(counter = 0; counter < header->conditionalLineCount; counter++, record++)
+	{
+		LDrawConditionalLine *line = [[LDrawConditionalLine alloc] init];
+
+		[line setLDrawColor:[colors objectAtIndex:record->colorIndex]];
+		[line setVertex1:V3Make(record->vertices[0][0], record->vertices[0][1], record->vertices[0][2])];
+		[line setVertex2:V3Make(record->vertices[1][0], record->vertices[1][1], record->vertices[1][2])];
+		[line setConditionalVertex1:V3Make(record->vertices[2][0], record->vertices[2][1], record->vertices[2][2])];
+		[line setConditionalVertex2:V3Make(record->vertices[3][0], record->vertices[3][1], record->vertices[3][2])];
+		[linesStep addDirective:line];
+	}
+	for(counter = 0; counter < header->triangleCount; counter++, record++)
+	{
+		LDrawTriangle *triangle = [[LDrawTriangle alloc] init];
+
+		[triangle setLDrawColor:[colors objectAtIndex:record->colorIndex]];
+		[triangle setVertex1:V3Make(record->vertices[0][0], record->vertices[0][1], record->vertices[0][2])];
+		[triangle setVertex2:V3Make(record->vertices[1][0], record->vertices[1][1], record->vertices[1][2])];
+		[triangle setVertex3:V3Make(record->vertices[2][0], record->vertices[2][1], record->vertices[2][2])];
+		[triangle setNormal:V3Make(record->normal[0], record->normal[1], record->normal[2])];
+		[trianglesStep addDirective:triangle];
+	}
+	for(counter = 0; counter < header->quadrilateralCount; counter++, record++)
+	{
+		LDrawQuadrilateral *quadrilateral = [[LDrawQuadrilateral alloc] init];
+
+		[quadrilateral setLDrawColor:[colors objectAtIndex:record->colorIndex]];
+		[quadrilateral setVertex1:V3Make(record->vertices[0][0], record->vertices[0][1], record->vertices[0][2])];
+		[quadrilateral setVertex2:V3Make(record->vertices[1][0], record->vertices[1][1], record->vertices[1][2])];
+		[quadrilateral setVertex3:V3Make(record->vertices[2][0], record->vertices[2][1], record->vertices[2][2])];
+		[quadrilateral setVertex4:V3Make(record->vertices[3][0], record->vertices[3][1], record->vertices[3][2])];
+		[quadrilateral setNormal:V3Make(record->normal[0], record->normal[1], record->normal[2])];
+		[quadrilateralsStep addDirective:quadrilateral];
+	}
+
+	if(header->lineCount > 0 || header->conditionalLineCount > 0)
+		[steps addObject:linesStep];
+	if(header->triangleCount > 0)
+		[steps addObject:trianglesStep];
+	if(header->quadrilateralCount > 0)
+		[steps addObject:quadrilateralsStep];
+	if([steps count] == 0)
+		[steps addObject:[LDrawStep emptyStepWithFlavor:LDrawStepAnyDirectives]];
+
+	bounds.min = V3Make(header->boundsMinimum[0], header->boundsMinimum[1], header->boundsMinimum[2]);
+	bounds.max = V3Make(header->boundsMaximum[0], header->boundsMaximum[1], header->boundsMaximum[2]);
+
+	[model setModelName:[self stringInEntry:entry string:header->modelName]];
+	[model setModelDescription:[self stringInEntry:entry string:header->modelDescription]];
+	[model setFileName:[self stringInEntry:entry string:header->fileName]];
+	[model setAuthor:[self stringInEntry:entry string:header->author]];
+	[model setOptimizedSteps:steps boundingBox:bounds];
+
+	return model;
+
+}//end modelFromEntry:
+
+
+//========== stringInEntry:string: =============================================
+//
+// Purpose:		Decodes a string from an entry's string table.
+//
+//==============================================================================
+- (NSString *) stringInEntry:(const LDrawPartCacheEntry *)entry string:(LDrawCachedString)cachedString
+{
+	size_t		length	= 0;
+	const char	*bytes	= LDrawPartCacheEntryString(entry, cachedString, &length);
+	NSString	*string	= [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+
+	return (string != nil) ? string : @"";
+
+}//end stringInEntry:string:
+
+
+@end
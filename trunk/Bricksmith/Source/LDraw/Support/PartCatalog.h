@@ -0,0 +1,51 @@
+//==============================================================================
+//
+// File:		PartCatalog.h
+//
+// Purpose:		The index of all parts in the LDraw folder, read straight out
+//				of the memory-mapped catalog file (see LDrawPartCatalogFile.h).
+//
+//				Part records are handed out as dictionaries with the catalog
+//				info keys declared in PartLibrary.h, just as they were when the
+//				catalog was a property list. But they are lightweight views
+//				into the mapped file: nothing is decoded until it is asked for,
+//				and opening the catalog costs the same however many parts it
+//				holds.
+//
+//==============================================================================
+#import <Foundation/Foundation.h>
+
+#import "LDrawPartCatalogFile.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// class PartCatalog
+//
+////////////////////////////////////////////////////////////////////////////////
+@interface PartCatalog : NSObject
+{
+	LDrawPartCatalog	*catalog;			// NULL for an empty catalog
+	NSArray 			*categoryNames;
+	NSArray 			*searchableKeywords;	// keywords without whitespace
+}
+
+// Initialization
++ (PartCatalog *) catalogWithContentsOfFile:(NSString *)path;
++ (BOOL) writeCatalog:(NSDictionary *)catalogDictionary toFile:(NSString *)path;
+
+// Accessors
+- (NSUInteger) partCount;
+- (NSArray *) categories;
+- (NSString *) categoryForPartName:(NSString *)partName;
+- (NSString *) descriptionForPartName:(NSString *)partName;
+
+// Records
+- (NSArray *) allRecords;
+- (NSDictionary *) recordForPartName:(NSString *)partName;
+- (NSArray *) recordsInCategory:(NSString *)categoryName;
+
+// Searching
+- (NSSet *) partNamesWithKeywordContaining:(NSString *)searchFragment;
+
+@end
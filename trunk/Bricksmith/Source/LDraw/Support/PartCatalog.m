@@ -0,0 +1,635 @@
+//==============================================================================
+//
+// File:		PartCatalog.m
+//
+// Purpose:		The index of all parts in the LDraw folder, read straight out
+//				of the memory-mapped catalog file.
+//
+//==============================================================================
+#import "PartCatalog.h"
+
+#import "PartLibrary.h"
+#import "StringCategory.h"
+
+
+@interface PartCatalog ()
+
+- (const LDrawCatalogPart *) partAtIndex:(uint32_t)index;
+- (const LDrawCatalogCategory *) categoryAtIndex:(uint32_t)index;
+- (NSString *) stringForCatalogString:(LDrawCatalogString)string;
+- (NSArray *) keywordsForPart:(const LDrawCatalogPart *)part;
+
+@end
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// class PartCatalogRecord
+//
+//		A part's catalog info, as a read-only dictionary. Strings are decoded
+//		from the catalog the first time they are asked for.
+//
+////////////////////////////////////////////////////////////////////////////////
+@interface PartCatalogRecord : NSDictionary
+{
+	PartCatalog	*catalog;
+	uint32_t	index;
+	NSString	*partNumber;
+	NSString	*partName;
+	NSString	*category;
+}
+
+- (id) initWithCatalog:(PartCatalog *)catalogIn index:(uint32_t)indexIn;
+
+@end
+
+
+@implementation PartCatalogRecord
+
+//========== initWithCatalog:index: ============================================
+//
+// Purpose:		Creates the record for the part at index.
+//
+//==============================================================================
+- (id) initWithCatalog:(PartCatalog *)catalogIn index:(uint32_t)indexIn
+{
+	self = [super init];
+
+	if(self)
+	{
+		catalog	= catalogIn;
+		index	= indexIn;
+	}
+
+	return self;
+
+}//end initWithCatalog:index:
+
+
+//========== count =============================================================
+//
+// Purpose:		Number, name and category, plus keywords if the part has any.
+//
+//==============================================================================
+- (NSUInteger) count
+{
+	const LDrawCatalogPart *part = [catalog partAtIndex:index];
+
+	return (part != NULL && part->keywordCount > 0) ? 4 : 3;
+
+}//end count
+
+
+//========== keyEnumerator =====================================================
+//
+// Purpose:		Enumerates the keys the record has.
+//
+//==============================================================================
+- (NSEnumerator *) keyEnumerator
+{
+	NSArray *keys = [NSArray arrayWithObjects:PART_NUMBER_KEY, PART_NAME_KEY, PART_CATEGORY_KEY, PART_KEYWORDS_KEY, nil];
+
+	return [[keys subarrayWithRange:NSMakeRange(0, [self count])] objectEnumerator];
+
+}//end keyEnumerator
+
+
+//========== objectForKey: =====================================================
+//
+// Purpose:		Returns the part's info for one of the catalog info keys.
+//
+//==============================================================================
+- (id) objectForKey:(id)key
+{
+	const LDrawCatalogPart	*part	= [catalog partAtIndex:index];
+	id						value	= nil;
+
+	if(part == NULL)
+		return nil;
+
+	if([key isEqualToString:PART_NUMBER_KEY])
+	{
+		if(partNumber == nil)
+			partNumber = [catalog stringForCatalogString:part->number];
+		value = partNumber;
+	}
+	else if([key isEqualToString:PART_NAME_KEY])
+	{
+		if(partName == nil)
+			partName = [catalog stringForCatalogString:part->name];
+		value = partName;
+	}
+	else if([key isEqualToString:PART_CATEGORY_KEY])
+	{
+		if(category == nil)
+		{
+			const LDrawCatalogCategory *record = [catalog categoryAtIndex:part->categoryIndex];
+			if(record)
+				category = [catalog stringForCatalogString:record->name];
+		}
+		value = category;
+	}
+	else if([key isEqualToString:PART_KEYWORDS_KEY] && part->keywordCount > 0)
+	{
+		// Only searched, and only by the old way of searching; not worth
+		// keeping around.
+		value = [catalog keywordsForPart:part];
+	}
+
+	return value;
+
+}//end objectForKey:
+
+@end
+
+
+@implementation PartCatalog
+
+#pragma mark -
+#pragma mark INITIALIZATION
+#pragma mark -
+
+//---------- catalogWithContentsOfFile: ------------------------------[static]--
+//
+// Purpose:		Maps the catalog saved at path. Returns nil if there isn't one,
+//				or it was written by a different version.
+//
+//------------------------------------------------------------------------------
++ (PartCatalog *) catalogWithContentsOfFile:(NSString *)path
+{
+	LDrawPartCatalog	*mappedCatalog	= LDrawPartCatalogOpen([path fileSystemRepresentation]);
+	PartCatalog 		*newCatalog 	= nil;
+
+	if(mappedCatalog)
+	{
+		newCatalog			= [[PartCatalog alloc] init];
+		newCatalog->catalog	= mappedCatalog;
+	}
+
+	return newCatalog;
+
+}//end catalogWithContentsOfFile:
+
+
+//---------- writeCatalog:toFile: ------------------------------------[static]--
+//
+// Purpose:		Saves a catalog given in the dictionary form the catalog
+//				builder collects it in:
+//
+//				PARTS_CATALOG_KEY	category name -> array of
+//									{ PART_NUMBER_KEY }, in display order
+//				PARTS_LIST_KEY		part number -> { PART_NUMBER_KEY,
+//									PART_NAME_KEY, PART_CATEGORY_KEY,
+//									PART_KEYWORDS_KEY (optional) }
+//
+//------------------------------------------------------------------------------
++ (BOOL) writeCatalog:(NSDictionary *)catalogDictionary toFile:(NSString *)path
+{
+	NSDictionary			*partList			= [catalogDictionary objectForKey:PARTS_LIST_KEY];
+	NSDictionary			*categoryLists		= [catalogDictionary objectForKey:PARTS_CATALOG_KEY];
+	NSComparator			byteOrder			= ^NSComparisonResult(NSString *string1, NSString *string2)
+	{
+		const char	*bytes1 = [string1 UTF8String];
+		const char	*bytes2 = [string2 UTF8String];
+		int 		order	= LDrawPartCatalogCompareStrings(bytes1, strlen(bytes1), bytes2, strlen(bytes2));
+
+		return (order < 0) ? NSOrderedAscending : (order > 0) ? NSOrderedDescending : NSOrderedSame;
+	};
+	NSArray 				*partNumbers		= [[partList allKeys] sortedArrayUsingComparator:byteOrder];
+	NSMutableSet			*categorySet		= [NSMutableSet setWithArray:[categoryLists allKeys]];
+	NSMutableSet			*keywordSet 		= [NSMutableSet set];
+	NSArray 				*categoryNames		= nil;
+	NSArray 				*keywords			= nil;
+	NSMutableDictionary 	*partIndexes		= [NSMutableDictionary dictionary];
+	NSMutableDictionary 	*categoryIndexes	= [NSMutableDictionary dictionary];
+	NSMutableDictionary 	*keywordIndexes 	= [NSMutableDictionary dictionary];
+	NSMutableArray			*postingLists		= [NSMutableArray array];
+
+	NSMutableData			*parts				= [NSMutableData data];
+	NSMutableData			*categories 		= [NSMutableData data];
+	NSMutableData			*members			= [NSMutableData data];
+	NSMutableData			*keywordRecords 	= [NSMutableData data];
+	NSMutableData			*postings			= [NSMutableData data];
+	NSMutableData			*partKeywords		= [NSMutableData data];
+	NSMutableData			*strings			= [NSMutableData data];
+	LDrawPartCatalogHeader	header;
+	uint32_t				counter 			= 0;
+
+	LDrawCatalogString (^addString)(NSString *) = ^LDrawCatalogString(NSString *string)
+	{
+		const char			*bytes	= [string UTF8String];
+		LDrawCatalogString	entry	= { (uint32_t)[strings length], (uint32_t)strlen(bytes) };
+
+		[strings appendBytes:bytes length:entry.length];
+		return entry;
+	};
+
+	// Assign indexes. Everything which can be looked up by name is sorted.
+	for(NSString *partNumber in partNumbers)
+	{
+		NSDictionary *record = [partList objectForKey:partNumber];
+
+		[partIndexes setObject:@([partIndexes count]) forKey:partNumber];
+		if([record objectForKey:PART_CATEGORY_KEY])
+			[categorySet addObject:[record objectForKey:PART_CATEGORY_KEY]];
+		[keywordSet addObjectsFromArray:[record objectForKey:PART_KEYWORDS_KEY]];
+	}
+	categoryNames	= [[categorySet allObjects] sortedArrayUsingComparator:byteOrder];
+	keywords		= [[keywordSet allObjects] sortedArrayUsingComparator:byteOrder];
+	for(NSString *name in categoryNames)
+		[categoryIndexes setObject:@([categoryIndexes count]) forKey:name];
+	for(NSString *keyword in keywords)
+	{
+		[keywordIndexes setObject:@([keywordIndexes count]) forKey:keyword];
+		[postingLists addObject:[NSMutableArray array]];
+	}
+
+	// Parts, and the postings of their keywords. Parts are visited in index
+	// order, so each postings list comes out ascending.
+	for(counter = 0; counter < [partNumbers count]; counter++)
+	{
+		NSString			*partNumber = [partNumbers objectAtIndex:counter];
+		NSDictionary		*record 	= [partList objectForKey:partNumber];
+		NSString			*category	= [record objectForKey:PART_CATEGORY_KEY];
+		LDrawCatalogPart	part;
+
+		memset(&part, 0, sizeof(part));
+		part.number 		= addString(partNumber);
+		part.name			= addString([record objectForKey:PART_NAME_KEY] ? [record objectForKey:PART_NAME_KEY] : @"");
+		part.categoryIndex	= category ? [[categoryIndexes objectForKey:category] unsignedIntValue] : LDRAW_PART_CATALOG_NOT_FOUND;
+		part.keywordsStart	= (uint32_t)([partKeywords length] / sizeof(uint32_t));
+
+		for(NSString *keyword in [record objectForKey:PART_KEYWORDS_KEY])
+		{
+			uint32_t		keywordIndex	= [[keywordIndexes objectForKey:keyword] unsignedIntValue];
+			NSMutableArray	*postingList	= [postingLists objectAtIndex:keywordIndex];
+
+			[partKeywords appendBytes:&keywordIndex length:sizeof(uint32_t)];
+			part.keywordCount++;
+
+			if([[postingList lastObject] unsignedIntValue] != counter || [postingList count] == 0)
+				[postingList addObject:@(counter)];
+		}
+		[parts appendBytes:&part length:sizeof(part)];
+	}
+
+	// Categories, with their parts in the order the builder filed them.
+	for(NSString *name in categoryNames)
+	{
+		LDrawCatalogCategory	categoryRecord;
+
+		categoryRecord.name 		= addString(name);
+		categoryRecord.membersStart	= (uint32_t)([members length] / sizeof(uint32_t));
+		categoryRecord.memberCount	= 0;
+
+		for(NSDictionary *entry in [categoryLists objectForKey:name])
+		{
+			NSNumber *partIndex = [partIndexes objectForKey:[entry objectForKey:PART_NUMBER_KEY]];
+
+			if(partIndex)
+			{
+				uint32_t memberIndex = [partIndex unsignedIntValue];
+				[members appendBytes:&memberIndex length:sizeof(uint32_t)];
+				categoryRecord.memberCount++;
+			}
+		}
+		[categories appendBytes:&categoryRecord length:sizeof(categoryRecord)];
+	}
+
+	// Keywords
+	for(counter = 0; counter < [keywords count]; counter++)
+	{
+		LDrawCatalogKeyword	keywordRecord;
+
+		keywordRecord.keyword		= addString([keywords objectAtIndex:counter]);
+		keywordRecord.postingsStart	= (uint32_t)([postings length] / sizeof(uint32_t));
+		keywordRecord.postingCount	= (uint32_t)[[postingLists objectAtIndex:counter] count];
+
+		for(NSNumber *partIndex in [postingLists objectAtIndex:counter])
+		{
+			uint32_t posting = [partIndex unsignedIntValue];
+			[postings appendBytes:&posting length:sizeof(uint32_t)];
+		}
+		[keywordRecords appendBytes:&keywordRecord length:sizeof(keywordRecord)];
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.partCount		= (uint32_t)[partNumbers count];
+	header.categoryCount	= (uint32_t)[categoryNames count];
+	header.memberCount		= (uint32_t)([members length] / sizeof(uint32_t));
+	header.keywordCount 	= (uint32_t)[keywords count];
+	header.postingCount 	= (uint32_t)([postings length] / sizeof(uint32_t));
+	header.partKeywordCount	= (uint32_t)([partKeywords length] / sizeof(uint32_t));
+	header.stringsLength	= (uint32_t)[strings length];
+
+	return LDrawPartCatalogWrite([path fileSystemRepresentation], &header,
+								 [parts bytes], [categories bytes], [members bytes],
+								 [keywordRecords bytes], [postings bytes], [partKeywords bytes],
+								 [strings bytes]);
+
+}//end writeCatalog:toFile:
+
+
+//========== dealloc ===========================================================
+//
+// Purpose:		The end of the line. Records hold on to the catalog, so none
+//				are left looking at the mapping.
+//
+//==============================================================================
+- (void) dealloc
+{
+	LDrawPartCatalogClose(self->catalog);
+
+}//end dealloc
+
+
+#pragma mark -
+#pragma mark ACCESSORS
+#pragma mark -
+
+//========== partCount =========================================================
+//
+// Purpose:		Number of parts in the catalog.
+//
+//==============================================================================
+- (NSUInteger) partCount
+{
+	return (self->catalog) ? self->catalog->header->partCount : 0;
+
+}//end partCount
+
+
+//========== categories ========================================================
+//
+// Purpose:		Returns the names of all categories, in no particular order.
+//
+//==============================================================================
+- (NSArray *) categories
+{
+	@synchronized(self)
+	{
+		if(self->categoryNames == nil)
+		{
+			NSMutableArray	*names		= [NSMutableArray array];
+			uint32_t		counter 	= 0;
+
+			for(counter = 0; self->catalog && counter < self->catalog->header->categoryCount; counter++)
+			{
+				NSString *name = [self stringForCatalogString:self->catalog->categories[counter].name];
+				if(name)
+					[names addObject:name];
+			}
+			self->categoryNames = names;
+		}
+	}
+
+	return self->categoryNames;
+
+}//end categories
+
+
+//========== categoryForPartName: ==============================================
+//
+// Purpose:		Returns the category the part is filed under, or nil if the
+//				part isn't in the catalog.
+//
+//==============================================================================
+- (NSString *) categoryForPartName:(NSString *)partName
+{
+	return [[self recordForPartName:partName] objectForKey:PART_CATEGORY_KEY];
+
+}//end categoryForPartName:
+
+
+//========== descriptionForPartName: ===========================================
+//
+// Purpose:		Returns the part's description, or nil if the part isn't in the
+//				catalog.
+//
+//==============================================================================
+- (NSString *) descriptionForPartName:(NSString *)partName
+{
+	return [[self recordForPartName:partName] objectForKey:PART_NAME_KEY];
+
+}//end descriptionForPartName:
+
+
+#pragma mark -
+#pragma mark RECORDS
+#pragma mark -
+
+//========== allRecords ========================================================
+//
+// Purpose:		Returns the records of every part, ordered by part number.
+//
+// Notes:		Records keep the catalog alive, so the catalog doesn't keep
+//				them; they are cheap to make and hold nothing until asked.
+//
+//==============================================================================
+- (NSArray *) allRecords
+{
+	NSUInteger		partCount	= [self partCount];
+	NSMutableArray	*records	= [NSMutableArray arrayWithCapacity:partCount];
+	uint32_t		counter 	= 0;
+
+	for(counter = 0; counter < partCount; counter++)
+	{
+		[records addObject:[[PartCatalogRecord alloc] initWithCatalog:self index:counter]];
+	}
+
+	return records;
+
+}//end allRecords
+
+
+//========== recordForPartName: ================================================
+//
+// Purpose:		Returns the record for the named part (e.g., "3001.dat"), or
+//				nil if it isn't in the catalog.
+//
+//==============================================================================
+- (NSDictionary *) recordForPartName:(NSString *)partName
+{
+	const char	*bytes		= [partName UTF8String];
+	uint32_t	partIndex	= LDRAW_PART_CATALOG_NOT_FOUND;
+
+	if(self->catalog && bytes)
+		partIndex = LDrawPartCatalogFindPart(self->catalog, bytes, strlen(bytes));
+
+	if(partIndex == LDRAW_PART_CATALOG_NOT_FOUND)
+		return nil;
+
+	return [[PartCatalogRecord alloc] initWithCatalog:self index:partIndex];
+
+}//end recordForPartName:
+
+
+//========== recordsInCategory: ================================================
+//
+// Purpose:		Returns the records of the parts in the category, or nil if
+//				there is no such category.
+//
+//==============================================================================
+- (NSArray *) recordsInCategory:(NSString *)categoryName
+{
+	const char					*bytes			= [categoryName UTF8String];
+	uint32_t					categoryIndex	= LDRAW_PART_CATALOG_NOT_FOUND;
+	const LDrawCatalogCategory	*category		= NULL;
+	const uint32_t				*members		= NULL;
+	uint32_t					memberCount 	= 0;
+	uint32_t					counter 		= 0;
+	NSMutableArray				*partsInCategory	= nil;
+
+	if(self->catalog && bytes)
+		categoryIndex = LDrawPartCatalogFindCategory(self->catalog, bytes, strlen(bytes));
+
+	category = (self->catalog) ? LDrawPartCatalogCategoryAtIndex(self->catalog, categoryIndex) : NULL;
+	if(category == NULL)
+		return nil;
+
+	members 		= LDrawPartCatalogCategoryMembers(self->catalog, category, &memberCount);
+	partsInCategory	= [NSMutableArray arrayWithCapacity:memberCount];
+
+	for(counter = 0; counter < memberCount; counter++)
+	{
+		if(members[counter] < self->catalog->header->partCount)
+			[partsInCategory addObject:[[PartCatalogRecord alloc] initWithCatalog:self index:members[counter]]];
+	}
+
+	return partsInCategory;
+
+}//end recordsInCategory:
+
+
+#pragma mark -
+#pragma mark SEARCHING
+#pragma mark -
+
+//========== partNamesWithKeywordContaining: ===================================
+//
+// Purpose:		Returns the numbers of all parts with a keyword containing the
+//				search fragment, ignoring case and whitespace.
+//
+// Notes:		Each distinct keyword is examined once, however many parts
+//				share it; the postings list then says which parts those are.
+//
+//==============================================================================
+- (NSSet *) partNamesWithKeywordContaining:(NSString *)searchFragment
+{
+	NSMutableSet	*partNames	= [NSMutableSet set];
+	uint32_t		counter 	= 0;
+
+	@synchronized(self)
+	{
+		if(self->searchableKeywords == nil)
+		{
+			NSMutableArray *keywords = [NSMutableArray array];
+
+			for(counter = 0; self->catalog && counter < self->catalog->header->keywordCount; counter++)
+			{
+				NSString *keyword = [self stringForCatalogString:self->catalog->keywords[counter].keyword];
+				[keywords addObject:keyword ? [keyword ams_stringByRemovingWhitespace] : @""];
+			}
+			self->searchableKeywords = keywords;
+		}
+	}
+
+	for(counter = 0; counter < [self->searchableKeywords count]; counter++)
+	{
+		if([[self->searchableKeywords objectAtIndex:counter] ams_containsString:searchFragment options:NSCaseInsensitiveSearch])
+		{
+			uint32_t		postingCount	= 0;
+			const uint32_t	*postings		= LDrawPartCatalogKeywordPostings(self->catalog, &self->catalog->keywords[counter], &postingCount);
+			uint32_t		postingIndex	= 0;
+
+			for(postingIndex = 0; postingIndex < postingCount; postingIndex++)
+			{
+				const LDrawCatalogPart	*part		= [self partAtIndex:postings[postingIndex]];
+				NSString				*partNumber = (part) ? [self stringForCatalogString:part->number] : nil;
+
+				if(partNumber)
+					[partNames addObject:partNumber];
+			}
+		}
+	}
+
+	return partNames;
+
+}//end partNamesWithKeywordContaining:
+
+
+#pragma mark -
+#pragma mark UTILITIES
+#pragma mark -
+
+//========== partAtIndex: ======================================================
+//
+// Purpose:		Returns the part record in the mapped catalog.
+//
+//==============================================================================
+- (const LDrawCatalogPart *) partAtIndex:(uint32_t)index
+{
+	return (self->catalog) ? LDrawPartCatalogPartAtIndex(self->catalog, index) : NULL;
+
+}//end partAtIndex:
+
+
+//========== categoryAtIndex: ==================================================
+//
+// Purpose:		Returns the category record in the mapped catalog.
+//
+//==============================================================================
+- (const LDrawCatalogCategory *) categoryAtIndex:(uint32_t)index
+{
+	return (self->catalog) ? LDrawPartCatalogCategoryAtIndex(self->catalog, index) : NULL;
+
+}//end categoryAtIndex:
+
+
+//========== stringForCatalogString: ===========================================
+//
+// Purpose:		Decodes a string from the string table.
+//
+//==============================================================================
+- (NSString *) stringForCatalogString:(LDrawCatalogString)string
+{
+	size_t		length	= 0;
+	const char	*bytes	= LDrawPartCatalogString(self->catalog, string, &length);
+
+	if(bytes == NULL)
+		return nil;
+
+	return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+
+}//end stringForCatalogString:
+
+
+//========== keywordsForPart: ==================================================
+//
+// Purpose:		Returns the part's keywords, in the order it lists them.
+//
+//==============================================================================
+- (NSArray *) keywordsForPart:(const LDrawCatalogPart *)part
+{
+	NSMutableArray				*keywords		= [NSMutableArray array];
+	uint32_t					keywordCount	= 0;
+	const uint32_t				*keywordIndexes = LDrawPartCatalogPartKeywords(self->catalog, part, &keywordCount);
+	const LDrawCatalogKeyword	*keyword		= NULL;
+	NSString					*string 		= nil;
+	uint32_t					counter 		= 0;
+
+	for(counter = 0; counter < keywordCount; counter++)
+	{
+		keyword = LDrawPartCatalogKeywordAtIndex(self->catalog, keywordIndexes[counter]);
+		string	= (keyword) ? [self stringForCatalogString:keyword->keyword] : nil;
+
+		if(string)
+			[keywords addObject:string];
+	}
+
+	return keywords;
+
+}//end keywordsForPart:
+
+
+@end
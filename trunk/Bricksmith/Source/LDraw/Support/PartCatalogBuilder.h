@@ -7,6 +7,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class PartCatalog;
+
 //------------------------------------------------------------------------------
 ///
 /// @class		PartCatalogBuilder
@@ -19,6 +21,6 @@
 
 - (void) makePartCatalogWithMaxLoadCountHandler:(void (^)(NSUInteger maxPartCount))maxLoadCountHandler
 					   progressIncrementHandler:(void (^)(void))progressIncrementHandler
-							  completionHandler:(void (^)(NSDictionary<NSString*, id> *newCatalog))completionHandler;
+							  completionHandler:(void (^)(PartCatalog *newCatalog))completionHandler;
 
 @end
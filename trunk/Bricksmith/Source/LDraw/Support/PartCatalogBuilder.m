@@ -8,12 +8,23 @@
 #import "PartCatalogBuilder.h"
 
 #import "LDrawKeywords.h"
+#import "LDrawModelMetadata.h"
 #import "LDrawPathNames.h"
 #import "LDrawPaths.h"
+#import "LDrawPartCacheFile.h"
 #import "LDrawUtilities.h"
+#import "PartCatalog.h"
 #import "PartLibrary.h"
 #import "StringCategory.h"
 
+// Scan records saved alongside the catalog, so the next scan can skip
+// unchanged files.
+static NSString	*FOLDERS_KEY		= @"Folders";		// folder path -> folder record
+static NSString	*FOLDER_STAMP_KEY	= @"Stamp";
+static NSString	*FOLDER_FILES_KEY	= @"Files";			// file name -> file record
+static NSString	*FILE_STAMP_KEY		= @"Stamp";
+static NSString	*FILE_RECORD_KEY	= @"Record";
+
 @implementation PartCatalogBuilder
 
 //========== makePartCatalogWithDelegate: ======================================
@@ -23,7 +34,10 @@
 ///
 ///				Executed on a background thread.
 ///
-///				Is it fast? No. Is it easy to code? Yes.
+///				Only the headers of the part files are read, on as many
+///				threads as there are cores, and only for files which have
+///				changed since the last catalog was built. See
+///				-scanFolders:previousFolders:...
 ///
 ///				Someday in the rosy future, this method should be recoded to
 ///				simply traverse the directory tree and deal with subfolders on
@@ -49,12 +63,12 @@
 ///
 /// @param 		maxLoadCountHandler			Will be called (on a background
 /// 										thread) to indicate the total number
-/// 										of objects to be loaded.
+/// 										of files to be read.
 ///
-/// @param 		progressIncrementHandler	Will be called (on a background
-/// 										thread) to indicate an object has
-/// 										been processed toward the max load
-/// 										count.
+/// @param 		progressIncrementHandler	Will be called (on background
+/// 										threads, concurrently) to indicate a
+/// 										file has been read toward the max
+/// 										load count.
 ///
 /// @param 		completionHandler 			Will be called (on a background
 /// 										thread) to when the catalog has
@@ -64,7 +78,7 @@
 //==============================================================================
 - (void) makePartCatalogWithMaxLoadCountHandler:(void (^)(NSUInteger maxPartCount))maxLoadCountHandler
 					   progressIncrementHandler:(void (^)(void))progressIncrementHandler
-							  completionHandler:(void (^)(NSDictionary<NSString*, id> *newCatalog))completionHandler
+							  completionHandler:(void (^)(PartCatalog *newCatalog))completionHandler
 {
 	NSFileManager	*fileManager			= [[NSFileManager alloc] init];
 	LDrawPaths		*paths					= [[LDrawPaths alloc] init];
@@ -173,33 +187,12 @@
 									nil]];
 
 		NSString							*partCatalogPath	= [paths partCatalogPath];
-		NSMutableDictionary<NSString*, id>	*newPartCatalog 	= [NSMutableDictionary dictionary];
-		
-		NSUInteger							partCount			= 0;
-
-		// Start the progress bar so that we know what's happening.
-		for(NSString *path in [searchPaths valueForKey:@"path"])
-		{
-			partCount += [[fileManager contentsOfDirectoryAtPath:path error:NULL] count];
-		}
-		if(maxLoadCountHandler)
-		{
-			maxLoadCountHandler(partCount);
-		}
-		
-		// Create the new part catalog. We will then fill it with folder contents.
-		[newPartCatalog setObject:[NSMutableDictionary dictionary] forKey:PARTS_CATALOG_KEY];
-		[newPartCatalog setObject:[NSMutableDictionary dictionary] forKey:PARTS_LIST_KEY];
-		
-		// Scan for each part folder.
-		for(NSDictionary *record in searchPaths)
-		{
-			[self addPartsInFolder:[record objectForKey:@"path"]
-						 toCatalog:newPartCatalog
-					 underCategory:[record objectForKey:@"category"] //override all internal categories
-						namePrefix:[record objectForKey:@"prefix"]
-		  progressIncrementHandler:progressIncrementHandler];
-		}
+		NSString							*scanRecordPath 	= [paths partCatalogScanPath];
+		NSMutableDictionary<NSString*, id>	*newPartCatalog 	= nil;
+		NSDictionary						*previousScan		= nil;
+		NSDictionary						*previousFolders	= nil;
+		NSArray 							*folders			= nil;
+		PartCatalog 						*mappedCatalog		= nil;
 		
 		NSDictionary *infoDict = [[NSBundle mainBundle] infoDictionary];
 		NSString *version = [infoDict objectForKey:@"CFBundleVersion"];
@@ -213,146 +206,353 @@
 		{
 			version = @"1.0";
 		}
-		[newPartCatalog setObject:version forKey:VERSION_KEY];
-		[newPartCatalog setObject:@"1.0"  forKey:COMPATIBILITY_VERSION_KEY];
 		
-		//Save the part catalog out for future reference.
-		[newPartCatalog writeToFile:partCatalogPath atomically:YES];
+		// Anything the last catalog learned about folders which haven't changed
+		// since can be reused, provided it was this version which learned it.
+		if(		scanRecordPath != nil
+		   &&	[fileManager fileExistsAtPath:scanRecordPath]
+		   &&	[PartCatalog catalogWithContentsOfFile:partCatalogPath] != nil )
+		{
+			previousScan = [NSDictionary dictionaryWithContentsOfFile:scanRecordPath];
+			if([[previousScan objectForKey:VERSION_KEY] isEqual:version])
+				previousFolders = [previousScan objectForKey:FOLDERS_KEY];
+		}
+		
+		folders = [self scanFolders:searchPaths
+					previousFolders:previousFolders
+				maxLoadCountHandler:maxLoadCountHandler
+		   progressIncrementHandler:progressIncrementHandler];
+		
+		newPartCatalog = [self partCatalogForFolders:folders];
+		
+		NSMutableDictionary *folderRecords = [NSMutableDictionary dictionary];
+		for(NSUInteger counter = 0; counter < [folders count]; counter++)
+		{
+			NSString *folderPath = [[searchPaths objectAtIndex:counter] objectForKey:@"path"];
+			if(folderPath != nil)
+				[folderRecords setObject:[folders objectAtIndex:counter] forKey:folderPath];
+		}
+		
+		//Save the part catalog out for future reference, and use it from
+		// there. If the LDraw folder can't be written to, a temporary copy will
+		// do for this session; the mapping outlives the file.
+		if([PartCatalog writeCatalog:newPartCatalog toFile:partCatalogPath])
+		{
+			mappedCatalog = [PartCatalog catalogWithContentsOfFile:partCatalogPath];
+			
+			[[NSDictionary dictionaryWithObjectsAndKeys:
+								version,				VERSION_KEY,
+								@"1.0", 				COMPATIBILITY_VERSION_KEY,
+								folderRecords,			FOLDERS_KEY,
+								nil ]
+				writeToFile:scanRecordPath atomically:YES];
+		}
+		else
+		{
+			NSString *temporaryPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+			
+			if([PartCatalog writeCatalog:newPartCatalog toFile:temporaryPath])
+				mappedCatalog = [PartCatalog catalogWithContentsOfFile:temporaryPath];
+			[fileManager removeItemAtPath:temporaryPath error:NULL];
+		}
 		
 		// We succeeded in loading the parts!
-		completionHandler(newPartCatalog);
+		completionHandler(mappedCatalog);
 	});
 	
 }//end reloadParts:
 
 
-//========== addPartsInFolder:toCatalog:underCategory: =========================
+//========== scanFolders:previousFolders:... ===================================
 //
-// Purpose:		Scans all the parts in folderPath and adds them to the given
-//				catalog, filing them under the given category. Pass nil for
-//				category if you wish to use the categories defined in the parts
-//				themselves.
+// Purpose:		Returns a folder record for each of the search paths, in the
+//				same order:
 //
-// Parameters:	categoryOverride	- force all parts in the folder to be filed
-//									  under this category, rather than the one
-//									  defined inside the part.
-//				namePrefix			- appends this prefix to each part scanned.
-//									  Part references in LDraw/parts/s should be
-//									  prefixed with the DOS path "s\". Pass nil
-//									  to ignore the prefix.
+//				FOLDER_STAMP_KEY	size and modification date of the folder
+//				FOLDER_FILES_KEY	file name -> file record
+//
+//				where each file record holds the file's FILE_STAMP_KEY and, if
+//				it is a valid part, its FILE_RECORD_KEY catalog info (with the
+//				folder's category and name prefix already applied).
+//
+//				A folder whose stamp matches its record in previousFolders is
+//				taken over whole, without even being listed. Otherwise, only
+//				the files which are new or whose size or date changed are
+//				read. Files are read concurrently, and only up to the end of
+//				their headers.
+//
+// Notes:		A folder's date changes when files are added, removed or
+//				replaced in it. Editors which save by overwriting a file in
+//				place don't change it; such edits are picked up the next time
+//				anything else in the folder changes, or by a new version of
+//				Bricksmith, which always rebuilds from scratch.
+//
+//				The progress handler is called once per file actually read,
+//				possibly on several threads at once.
 //
 //==============================================================================
-- (void) addPartsInFolder:(NSString *)folderPath
-				toCatalog:(NSMutableDictionary *)catalog
-			underCategory:(NSString *)categoryOverride
-			   namePrefix:(NSString *)namePrefix
+- (NSArray *) scanFolders:(NSArray *)searchPaths
+		  previousFolders:(NSDictionary *)previousFolders
+	  maxLoadCountHandler:(void (^)(NSUInteger maxPartCount))maxLoadCountHandler
  progressIncrementHandler:(void (^)(void))progressIncrementHandler
 {
-	NSFileManager		*fileManager			= [[NSFileManager alloc] init];
-// Not working for some reason. Why?
-//	NSArray 			*readableFileTypes = [NSDocument readableTypes];
-//	NSLog(@"readable types: %@", readableFileTypes);
-	NSArray 			*readableFileTypes		= [NSArray arrayWithObjects:@"dat", @"ldr", nil];
+	NSUInteger				folderCount		= [searchPaths count];
+	NSMutableArray			*folders		= [NSMutableArray arrayWithCapacity:folderCount];
+	NSMutableArray			*pendingFiles	= [NSMutableArray array];
+	NSArray 				*readableTypes	= [NSArray arrayWithObjects:@"dat", @"ldr", nil];
+	__strong NSDictionary	**folderRecords	= (__strong NSDictionary **)calloc(folderCount, sizeof(NSDictionary *));
+	__strong NSArray		**folderPending	= (__strong NSArray **)calloc(folderCount, sizeof(NSArray *));
+	__strong NSDictionary	**fileRecords	= NULL;
+	NSUInteger				counter			= 0;
+	
+	// Compare each folder, and each file in a changed folder, with what we
+	// knew before. Stat calls are cheap but there are tens of thousands of
+	// them, so the folders are examined concurrently too.
+	dispatch_apply(folderCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t folderIndex)
+	{
+		@autoreleasepool
+		{
+			NSDictionary			*searchRecord	= [searchPaths objectAtIndex:folderIndex];
+			NSString				*folderPath		= [searchRecord objectForKey:@"path"];
+			NSDictionary			*previous		= (folderPath != nil) ? [previousFolders objectForKey:folderPath] : nil;
+			NSDictionary			*previousFiles	= [previous objectForKey:FOLDER_FILES_KEY];
+			NSArray 				*folderStamp	= [self stampForPath:folderPath];
+			NSFileManager			*fileManager	= [[NSFileManager alloc] init];
+			NSMutableDictionary 	*files			= [NSMutableDictionary dictionary];
+			NSMutableArray			*pending		= [NSMutableArray array];
+			
+			if(folderStamp != nil && [folderStamp isEqual:[previous objectForKey:FOLDER_STAMP_KEY]])
+			{
+				folderRecords[folderIndex] = previous;
+			}
+			else
+			{
+				for(NSString *fileName in [fileManager contentsOfDirectoryAtPath:folderPath error:NULL])
+				{
+					if([readableTypes containsObject:[fileName pathExtension]] == NO)
+						continue;
+					
+					NSString		*filePath		= [folderPath stringByAppendingPathComponent:fileName];
+					NSArray 		*fileStamp		= [self stampForPath:filePath];
+					NSDictionary	*previousFile	= [previousFiles objectForKey:fileName];
+					
+					if(fileStamp == nil)
+						continue;
+					
+					if([fileStamp isEqual:[previousFile objectForKey:FILE_STAMP_KEY]])
+						[files setObject:previousFile forKey:fileName];
+					else
+						[pending addObject:@[ fileName, filePath, fileStamp ]];
+				}
+				
+				folderRecords[folderIndex] = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+													files,						FOLDER_FILES_KEY,
+													folderStamp,				FOLDER_STAMP_KEY,	// may be nil
+													nil ];
+				folderPending[folderIndex] = pending;
+			}
+		}
+	});
+	
+	for(counter = 0; counter < folderCount; counter++)
+	{
+		for(NSArray *file in folderPending[counter])
+		{
+			[pendingFiles addObject:@[ @(counter), [file objectAtIndex:0], [file objectAtIndex:1], [file objectAtIndex:2] ]];
+		}
+	}
+	
+	// Start the progress bar so that we know what's happening.
+	if(maxLoadCountHandler)
+	{
+		maxLoadCountHandler([pendingFiles count]);
+	}
+	
+	// Read the new and changed files.
+	fileRecords = (__strong NSDictionary **)calloc([pendingFiles count], sizeof(NSDictionary *));
 	
-	NSArray 			*partNames				= [fileManager contentsOfDirectoryAtPath:folderPath error:NULL];
-	NSUInteger			numberOfParts			= [partNames count];
-	NSUInteger			counter;
+	dispatch_apply([pendingFiles count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t fileIndex)
+	{
+		@autoreleasepool
+		{
+			NSArray 			*file			= [pendingFiles objectAtIndex:fileIndex];
+			NSDictionary		*searchRecord	= [searchPaths objectAtIndex:[[file objectAtIndex:0] unsignedIntegerValue]];
+			NSDictionary		*catalogInfo	= [self catalogInfoForFileAtPath:[file objectAtIndex:2]
+																underCategory:[searchRecord objectForKey:@"category"] //override all internal categories
+																   namePrefix:[searchRecord objectForKey:@"prefix"]];
+			
+			fileRecords[fileIndex] = [NSDictionary dictionaryWithObjectsAndKeys:
+											[file objectAtIndex:3],		FILE_STAMP_KEY,
+											catalogInfo,				FILE_RECORD_KEY,	// nil if not a valid part
+											nil ];
+			if(progressIncrementHandler)
+			{
+				progressIncrementHandler();
+			}
+		}
+	});
 	
-	NSString			*currentPath			= nil;
-	NSMutableDictionary *categoryRecord 		= nil;
+	for(counter = 0; counter < [pendingFiles count]; counter++)
+	{
+		NSArray 			*file		= [pendingFiles objectAtIndex:counter];
+		NSDictionary		*folder 	= folderRecords[[[file objectAtIndex:0] unsignedIntegerValue]];
+		
+		[[folder objectForKey:FOLDER_FILES_KEY] setObject:fileRecords[counter] forKey:[file objectAtIndex:1]];
+		fileRecords[counter] = nil;
+	}
 	
+	for(counter = 0; counter < folderCount; counter++)
+	{
+		[folders addObject:folderRecords[counter]];
+		folderRecords[counter] = nil;
+		folderPending[counter] = nil;
+	}
+	
+	free(fileRecords);
+	free(folderRecords);
+	free(folderPending);
+	
+	return folders;
+	
+}//end scanFolders:previousFolders:...
+
+
+//========== partCatalogForFolders: ============================================
+//
+// Purpose:		Returns a new part catalog holding the part records of the
+//				given folder records (see -scanFolders:previousFolders:...).
+//
+//				Folders are taken in order, and their files in name order, so
+//				that the first folder to define a part wins and the catalog
+//				doesn't depend on which records were reused.
+//
+//==============================================================================
+- (NSMutableDictionary *) partCatalogForFolders:(NSArray *)folders
+{
+	NSMutableDictionary *catalog = [NSMutableDictionary dictionary];
+	
+	[catalog setObject:[NSMutableDictionary dictionary] forKey:PARTS_CATALOG_KEY];
+	[catalog setObject:[NSMutableDictionary dictionary] forKey:PARTS_LIST_KEY];
+	
+	for(NSDictionary *folder in folders)
+	{
+		NSDictionary	*files		= [folder objectForKey:FOLDER_FILES_KEY];
+		NSArray 		*fileNames	= [[files allKeys] sortedArrayUsingSelector:@selector(compare:)];
+		
+		for(NSString *fileName in fileNames)
+		{
+			[self addRecord:[[files objectForKey:fileName] objectForKey:FILE_RECORD_KEY]
+				  toCatalog:catalog];
+		}
+	}
+	
+	return catalog;
+	
+}//end partCatalogForFolders:
+
+
+//========== addRecord:toCatalog: ==============================================
+//
+// Purpose:		Files one part's catalog info under its number and category.
+//				A part which is already in the catalog (from an earlier search
+//				folder) is left alone.
+//
+//==============================================================================
+- (void) addRecord:(NSDictionary *)categoryRecord
+		 toCatalog:(NSMutableDictionary *)catalog
+{
 	//Get the subreference tables out of the main catalog (they should already exist!).
 	NSMutableDictionary *catalog_partNumbers	= [catalog objectForKey:PARTS_LIST_KEY]; //lookup parts by number
 	NSMutableDictionary *catalog_categories 	= [catalog objectForKey:PARTS_CATALOG_KEY]; //lookup parts by category
 	NSMutableArray		*catalog_category		= nil;
+	NSString			*partNumber 			= [categoryRecord objectForKey:PART_NUMBER_KEY];
+	NSString			*category				= [categoryRecord objectForKey:PART_CATEGORY_KEY];
 	
-	
-	
-	//Loop through the entire contents of the directory and extract the
-	// information for every part therein.
-	for(counter = 0; counter < numberOfParts; counter++)
+	// Make sure the part file was valid!
+	if(partNumber != nil && category != nil)
 	{
-		currentPath = [folderPath stringByAppendingPathComponent:[partNames objectAtIndex:counter]];
-		
-		if([readableFileTypes containsObject:[currentPath pathExtension]] == YES)
+		// Check for dupe parts and reject later ones.  If we don't and the unofficial
+		// library has a part that has had its category edited, we'll end up with the
+		// part in BOTH categories.  This can hose us when the library changes which
+		// part is canonical vs alias.
+		if([catalog_partNumbers objectForKey:partNumber] == nil)
 		{
-			categoryRecord		= [self catalogInfoForFileAtPath:currentPath];
-			
-			// Make sure the part file was valid!
-			if(categoryRecord != nil && [categoryRecord count] > 0)
+			catalog_category = [catalog_categories objectForKey:category];
+			if(catalog_category == nil)
 			{
-				// Ensure PART_NUMBER_KEY exists before proceeding
-				NSString *partNumber = [categoryRecord objectForKey:PART_NUMBER_KEY];
-				if(partNumber == nil)
-				{
-					// Skip this record if it doesn't have a part number
-					continue;
-				}
-				
-				//---------- Alter catalog info --------------------------------
-				
-				if(categoryOverride)
-					[categoryRecord setObject:categoryOverride forKey:PART_CATEGORY_KEY];
-				
-				// Parts in subfolders of LDraw/parts must have a name prefix of
-				// their subpath, e.g., "s\partname.dat" for a part in the
-				// LDraw/parts/s folder.
-				if(namePrefix != nil)
-				{
-					partNumber	= [namePrefix stringByAppendingString:partNumber];
-					[categoryRecord setObject:partNumber forKey:PART_NUMBER_KEY];
-				}
-				
-				//---------- Catalog the part ----------------------------------
-				
-				NSString *category = [categoryRecord objectForKey:PART_CATEGORY_KEY];
-				if(category)
-				{
-					// Check for dupe parts and reject later ones.  If we don't and the unofficial
-					// library has a part that has had its category edited, we'll end up with the
-					// part in BOTH categories.  This can hose us when the library changes which
-					// part is canonical vs alias.
-					// Ensure we have valid partNumber and categoryRecord before proceeding
-					if(partNumber != nil && categoryRecord != nil && [catalog_partNumbers objectForKey:partNumber] == nil)
-					{
-						catalog_category = [catalog_categories objectForKey:category];
-						if(catalog_category == nil)
-						{
-							//We haven't encountered this category yet. Initialize it now.
-							catalog_category = [NSMutableArray array];
-							[catalog_categories setObject:catalog_category forKey:category ];
-						}
-						
-						// For some reason, I made each entry in the category a
-						// dictionary with part info. This was a database design
-						// mistake; it should have been an array of part reference
-						// numbers, if not just built up at runtime.
-						NSDictionary *categoryEntry = [NSDictionary dictionaryWithObject:partNumber
-																			  forKey:PART_NUMBER_KEY];
-																			  
-						[catalog_category addObject:categoryEntry];
-						
-						// Also file the part in a master list by reference name.
-						[catalog_partNumbers setObject:categoryRecord
-												forKey:partNumber];
-					}
-					else
-					{
-						//NSLog(@"Skipped part %s at path %s - duplicate part ID.\n", [partNumber UTF8String],[currentPath UTF8String]);
-					}
-				}
-										
-//				NSLog(@"processed %@", [partNames objectAtIndex:counter]);
+				//We haven't encountered this category yet. Initialize it now.
+				catalog_category = [NSMutableArray array];
+				[catalog_categories setObject:catalog_category forKey:category ];
 			}
+			
+			// For some reason, I made each entry in the category a
+			// dictionary with part info. This was a database design
+			// mistake; it should have been an array of part reference
+			// numbers, if not just built up at runtime.
+			NSDictionary *categoryEntry = [NSDictionary dictionaryWithObject:partNumber
+																	  forKey:PART_NUMBER_KEY];
+																	  
+			[catalog_category addObject:categoryEntry];
+			
+			// Also file the part in a master list by reference name.
+			[catalog_partNumbers setObject:categoryRecord
+									forKey:partNumber];
 		}
-		if(progressIncrementHandler)
+		else
 		{
-			progressIncrementHandler();
+			//NSLog(@"Skipped part %s - duplicate part ID.\n", [partNumber UTF8String]);
 		}
-		
-	}//end loop through files
+	}
 	
-}//end addPartsInFolder:toCatalog:underCategory:
+}//end addRecord:toCatalog:
+
+
+//========== catalogInfoForFileAtPath:underCategory:namePrefix: ================
+//
+// Purpose:		Returns the catalog info of the file at path, as filed in a
+//				search folder.
+//
+// Parameters:	categoryOverride	- force all parts in the folder to be filed
+//									  under this category, rather than the one
+//									  defined inside the part.
+//				namePrefix			- appends this prefix to each part scanned.
+//									  Part references in LDraw/parts/s should be
+//									  prefixed with the DOS path "s\". Pass nil
+//									  to ignore the prefix.
+//
+// Returns:		nil if the file is not a valid part.
+//
+//==============================================================================
+- (NSDictionary *) catalogInfoForFileAtPath:(NSString *)filepath
+							  underCategory:(NSString *)categoryOverride
+								 namePrefix:(NSString *)namePrefix
+{
+	NSMutableDictionary *categoryRecord = [self catalogInfoForFileAtPath:filepath];
+	NSString			*partNumber 	= [categoryRecord objectForKey:PART_NUMBER_KEY];
+	
+	// Skip records without a part number.
+	if(partNumber == nil)
+		return nil;
+	
+	if(categoryOverride)
+		[categoryRecord setObject:categoryOverride forKey:PART_CATEGORY_KEY];
+	
+	// Nor can a part be filed without a category.
+	if([categoryRecord objectForKey:PART_CATEGORY_KEY] == nil)
+		return nil;
+	
+	// Parts in subfolders of LDraw/parts must have a name prefix of
+	// their subpath, e.g., "s\partname.dat" for a part in the
+	// LDraw/parts/s folder.
+	if(namePrefix != nil)
+	{
+		partNumber	= [namePrefix stringByAppendingString:partNumber];
+		[categoryRecord setObject:partNumber forKey:PART_NUMBER_KEY];
+	}
+	
+	return categoryRecord;
+	
+}//end catalogInfoForFileAtPath:underCategory:namePrefix:
 
 
 //========== catalogInfoForFileAtPath: =========================================
@@ -366,6 +566,8 @@
 //				This part is thus in the category "Brick", and has the
 //				description "Brick  2 x  4".
 //
+//				Only the file's header is read (see LDrawModelMetadata.h).
+//
 // Returns:		nil if the file is not valid.
 //
 //				PART_NUMBER_KEY		string
@@ -376,33 +578,21 @@
 //==============================================================================
 - (NSMutableDictionary *) catalogInfoForFileAtPath:(NSString *)filepath
 {
-    NSMutableDictionary *catalogInfo        = nil;
-    
+	NSMutableDictionary *catalogInfo		= nil;
+	
 	@autoreleasepool {
 
-		NSString			*fileContents		= [LDrawUtilities stringFromFile:filepath];
+		LDrawModelMetadata	*metadata			= [LDrawModelMetadata metadataForFileAtPath:filepath includeReferences:NO];
 		NSCharacterSet		*whitespace 		= [NSCharacterSet whitespaceAndNewlineCharacterSet];
 		
 		NSString            *partNumber         = nil;
 		NSString			*partDescription	= nil;
 		NSString			*category			= nil;
-		NSMutableArray		*keywords			= nil;
-		
+		NSString			*implicitCategory	= nil;
 		
-		// Read the first line of the file. Make sure the file is parsable.
-		if(		fileContents != nil
-		   &&	[fileContents length] > 0 )
+		// Make sure the file is parsable.
+		if(metadata != nil)
 		{
-			NSUInteger	stringLength		= [fileContents length];
-			NSUInteger	lineStartIndex		= 0;
-			NSUInteger	nextlineStartIndex	= 0;
-			NSUInteger	newlineIndex		= 0; //index of the first newline character in the line.
-			NSInteger	lineLength			= 0;
-			NSString	*line				= nil;
-			NSString	*lineCode			= nil;
-			NSString	*lineRemainder		= nil;
-			NSString	*implicitCategory	= nil;
-			
 			catalogInfo = [NSMutableDictionary dictionary];
 			
 			// Get the name of the part.
@@ -411,103 +601,52 @@
 			partNumber = [[filepath lastPathComponent] lowercaseString];
 			[catalogInfo setObject:partNumber forKey:PART_NUMBER_KEY];
 			
-			while(nextlineStartIndex < stringLength)
+			// A file which doesn't open with a comment is not a valid LDraw
+			// header; all we know about it is its name.
+			if([metadata modelDescription] != nil)
 			{
-				// LDraw uses DOS lineendings
-				[fileContents getLineStart: &lineStartIndex
-									   end: &nextlineStartIndex
-							   contentsEnd: &newlineIndex
-								  forRange: NSMakeRange(nextlineStartIndex,1) ]; //that is, contains the first character.
+				partDescription = [[metadata modelDescription] stringByTrimmingCharactersInSet:whitespace];
+				implicitCategory = [self categoryForDescription:partDescription];
+				[catalogInfo setObject:partDescription forKey:PART_NAME_KEY];
 				
-				lineLength	= newlineIndex - lineStartIndex;
-				line		= [fileContents substringWithRange:NSMakeRange(lineStartIndex, lineLength)];
-				lineCode	= [LDrawUtilities readNextField:line remainder:&lineRemainder ];
-
-				//Check to see if this is a valid LDraw header.
-				if(lineStartIndex == 0)
+				// Force alias parts into a ghetto category which will keep
+				// them far away from normal building.
+				// !LDRAW_ORG: optional qualifier Alias can appear with Part/Shortcut/etc https://www.ldraw.org/article/398.html
+				if([[metadata ldrawOrg] ams_containsString:@"Alias" options:kNilOptions])
 				{
-					if([lineCode isEqualToString:@"0"] == NO)
-						break;
-						
-					partDescription = [lineRemainder stringByTrimmingCharactersInSet:whitespace];
-					implicitCategory = [self categoryForDescription:partDescription];
-					[catalogInfo setObject:partDescription forKey:PART_NAME_KEY];
-				}
-				else if([lineCode isEqualToString:@"0"] == YES)
-				{
-					// Try to find keywords or category
-					NSString *meta = [LDrawUtilities readNextField:lineRemainder remainder:&lineRemainder];
-					
-					if([meta isEqualToString:LDRAW_CATEGORY])
-					{
-						// Turns out !CATEGORY is not as reliable as it ought to be.
-						// In typical LDraw fashion, the feature was not have a
-						// simultaneous, universal deployment. Circa 2014, the only
-						// categories I deemed to be consistent and advantageous
-						// under the current system are the two-word categories that
-						// couldn't be represented under the old system.
-						//
-						// 2020 update: I am not going to fight !CATEGORY anymore.
-						// With one exception: Duplo parts should not be mixed in,
-						// and LDraw is making no attempt to separate them. So if
-						// the description begins with Duplo, I'm ignoring the
-						// !CATEGORY, which will cause implicitCategory (Duplo) to
-						// win.
-						//
-						// Also, allow the !LDRAW_ORG Part Alias to take precedence
-						// if it has already been found.
-						if(		[implicitCategory hasPrefix:@"Duplo"] == NO
-						   &&	[catalogInfo objectForKey:PART_CATEGORY_KEY] == nil )
-						{
-							category = [lineRemainder stringByTrimmingCharactersInSet:whitespace];
-							[catalogInfo setObject:category forKey:PART_CATEGORY_KEY];
-						}
-					}
-					else if([meta isEqualToString:LDRAW_KEYWORDS])
-					{
-						if(keywords == nil)
-						{
-							keywords = [NSMutableArray array];
-							[catalogInfo setObject:keywords forKey:PART_KEYWORDS_KEY];
-						}
-						// Keywords can be multiline, so must add to any we've already collected!
-						NSArray *newKeywords = [lineRemainder componentsSeparatedByCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@","]];
-						for(NSString *keyword in newKeywords)
-						{
-							[keywords addObject:[keyword stringByTrimmingCharactersInSet:whitespace]];
-						}
-					}
-					else if([meta isEqualToString:LDRAW_ORG])
-					{
-						// Force alias parts into a ghetto category which will keep
-						// them far away from normal building.
-						// !LDRAW_ORG: optional qualifier Alias can appear with Part/Shortcut/etc https://www.ldraw.org/article/398.html
-						if([lineRemainder ams_containsString:@"Alias" options:kNilOptions])
-						{
-							category = Category_Alias;
-							[catalogInfo setObject:category forKey:PART_CATEGORY_KEY];
-						}
-					}
+					category = Category_Alias;
 				}
-				else if([lineCode length] == 0)
+				// Turns out !CATEGORY is not as reliable as it ought to be.
+				// In typical LDraw fashion, the feature was not have a
+				// simultaneous, universal deployment. Circa 2014, the only
+				// categories I deemed to be consistent and advantageous
+				// under the current system are the two-word categories that
+				// couldn't be represented under the old system.
+				//
+				// 2020 update: I am not going to fight !CATEGORY anymore.
+				// With one exception: Duplo parts should not be mixed in,
+				// and LDraw is making no attempt to separate them. So if
+				// the description begins with Duplo, I'm ignoring the
+				// !CATEGORY, which will cause implicitCategory (Duplo) to
+				// win.
+				else if(	[metadata category] != nil
+						&&	[implicitCategory hasPrefix:@"Duplo"] == NO )
 				{
-					// line is blank. Skip.
+					category = [metadata category];
 				}
+				// If no !CATEGORY directive, the the category is to be derived
+				// from the first word of the description.
 				else
 				{
-					// Non-comment, non-blank line. This cannot be part of the header.
-					break;
+					category = implicitCategory;
 				}
-			}
-			
-			// If no !CATEGORY directive, the the category is to be derived from the
-			// first word of the description.
-			if(		[catalogInfo objectForKey:PART_NAME_KEY]
-			   &&	[catalogInfo objectForKey:PART_CATEGORY_KEY] == nil)
-			{
-				partDescription = [catalogInfo objectForKey:PART_NAME_KEY];
-				category		= implicitCategory;
 				[catalogInfo setObject:category forKey:PART_CATEGORY_KEY];
+				
+				// Keywords can be multiline; they have all been collected.
+				if([[metadata keywordLines] count] > 0)
+				{
+					[catalogInfo setObject:[metadata keywords] forKey:PART_KEYWORDS_KEY];
+				}
 			}
 		}
 		else
@@ -522,6 +661,25 @@
 }//end catalogInfoForFileAtPath
 
 
+//========== stampForPath: =====================================================
+//
+// Purpose:		Returns the size and modification date of the file or folder at
+//				path, in a form which can be compared with -isEqual: and saved
+//				in a property list, or nil if there is nothing there.
+//
+//==============================================================================
+- (NSArray *) stampForPath:(NSString *)path
+{
+	LDrawFileStamp	stamp;
+	
+	if(path == nil || LDrawFileStampForPath([path fileSystemRepresentation], &stamp) == false)
+		return nil;
+	
+	return @[ @(stamp.size), @(stamp.modificationSeconds), @(stamp.modificationNanoseconds) ];
+	
+}//end stampForPath:
+
+
 //========== categoryForDescription: ===========================================
 //
 // Purpose:		Returns the category for the given modelDescription. This is
@@ -16,6 +16,8 @@
 @class LDrawModel;
 @class LDrawPart;
 @class LDrawTexture;
+@class PartCache;
+@class PartCatalog;
 @protocol PartLibraryDelegate;
 
 //The part catalog was regenerated from disk.
@@ -52,7 +54,7 @@ extern NSString	*Category_Subparts;
 @interface PartLibrary : NSObject
 {
 	id<PartLibraryDelegate> delegate;
-	NSDictionary            *partCatalog;
+	PartCatalog             *partCatalog;				// memory-mapped index of the LDraw folder
 	NSMutableArray          *favorites;					// parts names in the "Favorites" pseduocategory
 	NSMutableDictionary     *loadedFiles;				// list of LDrawFiles which have been read off disk.
 	NSMutableDictionary		*loadedImages;
@@ -60,6 +62,7 @@ extern NSString	*Category_Subparts;
 	NSMutableDictionary     *optimizedRepresentations;	// access stored vertex objects by part name, then color.
 	dispatch_queue_t        catalogAccessQueue;			// serial queue to mutex changes to the part catalog
 	NSMutableDictionary     *parsingGroups;				// arrays of dispatch_group_t's which have requested each file currently being parsed
+	PartCache				*partCache;					// parsed parts saved between launches
 }
 
 // Accessors
@@ -71,10 +74,12 @@ extern NSString	*Category_Subparts;
 - (NSArray *) favoritePartCatalogRecords;
 - (NSArray *) partCatalogRecordsInCategory:(NSString *)category;
 - (NSString *) categoryForPartName:(NSString *)partName;
+- (NSSet *) partNamesWithKeywordContaining:(NSString *)searchFragment;
+- (PartCache *) partCache;
 
 - (void) setDelegate:(id<PartLibraryDelegate>)delegateIn;
 - (void) setFavorites:(NSArray *)favoritesIn;
-- (void) setPartCatalog:(NSDictionary *)newCatalog;
+- (void) setPartCatalog:(PartCatalog *)newCatalog;
 
 // Actions
 - (BOOL) load;
@@ -18,6 +18,8 @@
 
 #import "LDrawFile.h"
 #import "LDrawKeywords.h"
+#import "LDrawLineArray.h"
+#import "LDrawMeshCache.h"
 #import "LDrawModel.h"
 #import "LDrawPart.h"
 #import "LDrawPathNames.h"
@@ -26,9 +28,14 @@
 #import "LDrawTexture.h"
 #import "LDrawUtilities.h"
 #import "MacLDraw.h"
+#import "PartCache.h"
+#import "PartCatalog.h"
 #import "PartCatalogBuilder.h"
 #import "StringCategory.h"
 
+// How much disk the saved display list meshes may take up.
+#define MESH_CACHE_MAXIMUM_BYTES	(512ULL * 1024 * 1024)
+
 
 //The part catalog was regenerated from disk.
 // Object is the new catalog. No userInfo.
@@ -90,8 +97,18 @@ NSString	*Category_Subparts			= @"Subparts";
 	catalogAccessQueue          = dispatch_queue_create("com.AllenSmith.Bricksmith.CatalogAccess", NULL);
 #endif
 	parsingGroups               = [[NSMutableDictionary alloc] init];
+	partCache					= [[PartCache alloc] initWithDirectory:[PartCache defaultDirectory]];
 	
-	[self setPartCatalog:[NSDictionary dictionary]];
+	// Display lists save their smoothed meshes too. Entries are never stale,
+	// only unused, so trim the least recently used ones in the background.
+	NSString *meshDirectory = [PartCache defaultMeshDirectory];
+	LDrawMeshCacheSetDirectory([meshDirectory fileSystemRepresentation]);
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0),
+	^{
+		LDrawMeshCachePrune([meshDirectory fileSystemRepresentation], MESH_CACHE_MAXIMUM_BYTES);
+	});
+	
+	[self setPartCatalog:[[PartCatalog alloc] init]];
 	
 	return self;
 	
@@ -109,10 +126,7 @@ NSString	*Category_Subparts			= @"Subparts";
 //==============================================================================
 - (NSArray *) allPartCatalogRecords
 {
-	NSDictionary	*partList	= [self->partCatalog objectForKey:PARTS_LIST_KEY];
-	
-	// all the reference numbers for parts.
-	return [partList allValues];
+	return [self->partCatalog allRecords];
 	
 }//end allPartCatalogRecords
 
@@ -125,7 +139,7 @@ NSString	*Category_Subparts			= @"Subparts";
 //==============================================================================
 - (NSArray *) categories
 {
-	return [[self->partCatalog objectForKey:PARTS_CATALOG_KEY] allKeys];
+	return [self->partCatalog categories];
 	
 }//end categories
 
@@ -220,14 +234,36 @@ NSString	*Category_Subparts			= @"Subparts";
 //==============================================================================
 - (NSString *) categoryForPartName:(NSString *)partName
 {
-	NSDictionary	*partList		= [self->partCatalog objectForKey:PARTS_LIST_KEY];
-	NSDictionary	*catalogInfo	= [partList objectForKey:partName];
-	NSString		*category		= [catalogInfo objectForKey:PART_CATEGORY_KEY];
-	
-	return category;
+	return [self->partCatalog categoryForPartName:partName];
 }
 
 
+//========== partNamesWithKeywordContaining: ===================================
+//
+// Purpose:		Returns the names of all parts with a keyword containing the 
+//				search fragment, ignoring case and whitespace. 
+//
+//==============================================================================
+- (NSSet *) partNamesWithKeywordContaining:(NSString *)searchFragment
+{
+	return [self->partCatalog partNamesWithKeywordContaining:searchFragment];
+	
+}//end partNamesWithKeywordContaining:
+
+
+//========== partCache =========================================================
+//
+// Purpose:		Returns the on-disk cache of parsed parts. Its hit and miss 
+//				counts tell how many parts were loaded without parsing.
+//
+//==============================================================================
+- (PartCache *) partCache
+{
+	return self->partCache;
+	
+}//end partCache
+
+
 //========== favoritePartNames =================================================
 //
 // Purpose:		Returns all the part names the user has bookmarked as his 
@@ -274,13 +310,12 @@ NSString	*Category_Subparts			= @"Subparts";
 //==============================================================================
 - (NSArray *) favoritePartCatalogRecords
 {
-	NSDictionary	*partList		= [self->partCatalog objectForKey:PARTS_LIST_KEY];
 	NSMutableArray	*parts			= [NSMutableArray array];
 	NSDictionary	*partInfo		= nil;
 	
 	for(NSString *partName in self->favorites)
 	{
-		partInfo = [partList objectForKey:partName];
+		partInfo = [self->partCatalog recordForPartName:partName];
 		
 		if(partInfo)
 			[parts addObject:partInfo];
@@ -303,9 +338,7 @@ NSString	*Category_Subparts			= @"Subparts";
 	
 	if([categoryName isEqualToString:Category_All])
 	{
-		// Retrieve all parts. We can do this by getting the entire (unsorted) 
-		// contents of PARTS_LIST_KEY in the partCatalog, which is actually 
-		// a dictionary of all parts.
+		// Retrieve all parts.
 		parts = [self allPartCatalogRecords];
 		
 	}
@@ -315,22 +348,7 @@ NSString	*Category_Subparts			= @"Subparts";
 	}
 	else
 	{
-		NSArray 		*category			= [[partCatalog objectForKey:PARTS_CATALOG_KEY] objectForKey:categoryName];
-		NSDictionary	*partList			= [self->partCatalog objectForKey:PARTS_LIST_KEY];
-		NSMutableArray	*partsInCategory	= [NSMutableArray array];
-		NSString		*partName			= nil;
-		NSDictionary	*partInfo			= nil;
-
-		for(NSDictionary* categoryRecord in category)
-		{
-			partName = [categoryRecord objectForKey:PART_NUMBER_KEY];
-			partInfo = [partList objectForKey:partName];
-			
-			if(partInfo)
-				[partsInCategory addObject:partInfo];
-		}
-		
-		parts = partsInCategory;
+		parts = [self->partCatalog recordsInCategory:categoryName];
 	}
 	
 	return parts;
@@ -372,30 +390,16 @@ NSString	*Category_Subparts			= @"Subparts";
 //				the only copy of it in the program. Use +setSharedPartCatalog to 
 //				update it outside this class.
 //
-// Notes:		The Part Catalog is structured as follows:
-//
-//				partCatalog
-//				|
-//				|--> PARTS_CATALOG_KEY <NSDictionary>
-//				|		|
-//				|		Keys  are category names, e.g., "Brick"
-//				|		<NSArray>
-//				|			|
-//				|			<NSDictionary>
-//				|				|--> PART_NUMBER_KEY <NSString> (e.g., "3001.dat")
-//				|
-//				|--> PARTS_LIST_KEY <NSDictionary>
-//						|
-//						Keys are part reference numbers, e.g., "3001.dat"
-//						<NSDictionary>
-//							|--> PART_NUMBER_KEY
-//							|--> PART_NAME_KEY
+// Notes:		The Part Catalog is a memory-mapped file (see PartCatalog.h). 
+//				Its records are dictionaries with the keys PART_NUMBER_KEY, 
+//				PART_NAME_KEY, PART_CATEGORY_KEY and, if the part has any, 
+//				PART_KEYWORDS_KEY. 
 //
 //				This data structure is PRIVATE. There is no get accessor. Query 
 //				this object for its part lists and build your own records.
 //
 //==============================================================================
-- (void) setPartCatalog:(NSDictionary *)newCatalog
+- (void) setPartCatalog:(PartCatalog *)newCatalog
 {
 	partCatalog = newCatalog;
 	
@@ -425,8 +429,7 @@ NSString	*Category_Subparts			= @"Subparts";
 	NSFileManager   *fileManager    = [[NSFileManager alloc] init];
 	NSString        *catalogPath    = [[LDrawPaths sharedPaths] partCatalogPath];
 	BOOL            partsListExists = NO;
-	NSString		*version		= nil;
-	NSDictionary    *newCatalog     = nil;
+	PartCatalog     *newCatalog     = nil;
 	
 	// Do we have an LDraw folder?
 	if(catalogPath != nil)
@@ -438,16 +441,16 @@ NSString	*Category_Subparts			= @"Subparts";
 	// Do we have a part list already? 
 	if(partsListExists == YES)
 	{
-		newCatalog	= [NSDictionary dictionaryWithContentsOfFile:catalogPath];
-		version 	= [newCatalog objectForKey:VERSION_KEY];
+		// Mapping is all it takes; nothing is read until it's asked for.
+		newCatalog	= [PartCatalog catalogWithContentsOfFile:catalogPath];
 		
-		if(version)
+		if(newCatalog)
 		{
 			[self setPartCatalog:newCatalog];
 		}
 		else
 		{
-			// Older part catalogs don't have enough info in them
+			// Damaged, or written by another version
 			partsListExists = NO;
 		}
 
@@ -473,7 +476,7 @@ NSString	*Category_Subparts			= @"Subparts";
 	[catalogBuilder makePartCatalogWithMaxLoadCountHandler:maxLoadCountHandler
 								  progressIncrementHandler:progressIncrementHandler
 										 completionHandler:
-	 ^(NSDictionary<NSString *,id> *newPartCatalog)
+	 ^(PartCatalog *newPartCatalog)
 	 {
 		dispatch_async(dispatch_get_main_queue(), ^{
 			if(newPartCatalog)
@@ -1001,9 +1004,7 @@ NSString	*Category_Subparts			= @"Subparts";
 - (NSString *) descriptionForPart:(LDrawPart *)part
 {
 	//Look up the verbose part description in the scanned part catalog.
-	NSDictionary	*partList			= [self->partCatalog	objectForKey:PARTS_LIST_KEY];
-	NSDictionary	*partRecord			= [partList				objectForKey:[part referenceName]];
-	NSString		*partDescription	= [partRecord			objectForKey:PART_NAME_KEY];
+	NSString		*partDescription	= [self->partCatalog descriptionForPartName:[part referenceName]];
 	
 	// Maybe it's an MPD reference?
 	if(partDescription == nil)
@@ -1036,9 +1037,7 @@ NSString	*Category_Subparts			= @"Subparts";
 - (NSString *) descriptionForPartName:(NSString *)name
 {
 	//Look up the verbose part description in the scanned part catalog.
-	NSDictionary	*partList			= [self->partCatalog	objectForKey:PARTS_LIST_KEY];
-	NSDictionary	*partRecord			= [partList				objectForKey:name];
-	NSString		*partDescription	= [partRecord			objectForKey:PART_NAME_KEY];
+	NSString		*partDescription	= [self->partCatalog descriptionForPartName:name];
 	//If the part isn't known, all we can really do is just display the number.
 	if(partDescription == nil)
 		partDescription = name;
@@ -1111,9 +1110,9 @@ NSString	*Category_Subparts			= @"Subparts";
 				  asynchronously:(BOOL)asynchronous
 			   completionHandler:(void (^)(LDrawModel *))completionBlock
 {
-	NSString            *fileContents   = nil;
-	NSArray             *lines          = nil;
+	LDrawLineStream     *stream         = nil;
 	LDrawFile           *parsedFile     = nil;
+	NSArray             *references     = nil;
 	dispatch_group_t    group           = NULL;
 #if USE_BLOCKS
 	__block
@@ -1126,14 +1125,27 @@ NSString	*Category_Subparts			= @"Subparts";
 
 	if(partPath != nil)
 	{
+		// A part we've seen on a previous launch needn't be parsed at all.
+		model = [self->partCache modelForPath:partPath];
+		if(model != nil)
+		{
+#if USE_BLOCKS
+			if(asynchronous == YES)
+			{
+				if(completionBlock)
+					completionBlock(model);
+				return nil;
+			}
+#endif
+			return model;
+		}
+		
 		// We found it in the LDraw folder; now all we need to do is get the 
 		// model for it. 
-		fileContents    = [LDrawUtilities stringFromFile:partPath];
-		lines           = [fileContents separateByLine];
+		stream          = [LDrawLineStream streamFromFile:partPath];
 		
-		parsedFile      = [[LDrawFile alloc] initWithLines:lines
-												   inRange:NSMakeRange(0, [lines count])
-											   parentGroup:group];
+		parsedFile      = [[LDrawFile alloc] initWithLineStream:stream
+												        parentGroup:group];
 	}
 	
 #if USE_BLOCKS
@@ -1141,8 +1153,10 @@ NSString	*Category_Subparts			= @"Subparts";
 	{
 		dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
 #endif
+		references = [self->partCache referencedPathsInFile:parsedFile];
 		[parsedFile optimizeStructure];
 		model = [[parsedFile submodels] objectAtIndex:0];
+		[self->partCache storeModel:model forPath:partPath referencedPaths:references];
 		// We are "leaking" the enclosing file, but returning an internal model 
 		// without disconnecting it from its file is pretty dodgy and it would 
 		// be easy to code a bug in. We'd be better off returning the file 
@@ -1155,8 +1169,11 @@ NSString	*Category_Subparts			= @"Subparts";
 	{
 		dispatch_group_notify(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
 							  ^{
+								  NSArray *references = [self->partCache referencedPathsInFile:parsedFile];
+								  
 								  [parsedFile optimizeStructure];
 								  model = [[[[parsedFile submodels] objectAtIndex:0] retain] autorelease];
+								  [self->partCache storeModel:model forPath:partPath referencedPaths:references];
 								  
 								  if(completionBlock)
 									  completionBlock(model);
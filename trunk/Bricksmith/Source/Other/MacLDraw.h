@@ -37,6 +37,7 @@
 #define RIGHT_BUTTON_BEHAVIOR_KEY					@"Right Button Behavior"
 #define ROTATE_MODE_KEY								@"Rotate Mode"
 #define MOUSE_WHEEL_BEHAVIOR_KEY					@"Mouse Wheel Behavior"
+#define OCCLUSION_CULLING_KEY						@"Occlusion Culling"		// hidden; see LDrawOcclusion.h
 #define PART_BROWSER_PANEL_SHOW_AT_LAUNCH			@"Part Browser Panel Show at Launch"
 #define PART_BROWSER_PREVIOUS_CATEGORY				@"Part Browser Previous Category"
 #define PART_BROWSER_PREVIOUS_SELECTED_ROW			@"Part Browser Previous Selected Row"
@@ -0,0 +1,186 @@
+//
+//  LDrawGeometryBatch_Tests.m
+//  UnitTests
+//
+
+#import "LDrawGeometryBatch.h"
+
+#import <XCTest/XCTest.h>
+#import "LDrawColor.h"
+#import "LDrawDrawableElement.h"
+#import "LDrawLineArray.h"
+#import "LDrawModel.h"
+#import "LDrawPart.h"
+#import "LDrawStep.h"
+
+// A step on its own stays well under the batch's minimum chunk (128 lines), so
+// it is parsed on the calling thread. All the steps of the model together are
+// several times over it, so the model is parsed on many threads.
+#define STEP_COUNT				6
+#define GEOMETRY_PER_STEP		80
+
+
+@interface LDrawGeometryBatch_Tests : XCTestCase
+
+@end
+
+
+@implementation LDrawGeometryBatch_Tests
+
+//========== modelLines ========================================================
+//
+// Purpose:		A model of several steps, each a mix of type 1-5 lines in
+//				varied colors, with some of the parts in MLCAD groups and some
+//				comments in between.
+//
+//==============================================================================
+- (LDrawLineArray *) modelLines
+{
+	NSMutableString *contents	= [NSMutableString stringWithString:@"0 Batch Test\r\n0 Name: batchtest.ldr\r\n0 Author: Unit Tests\r\n"];
+	NSArray 		*colors 	= @[ @"16", @"24", @"4", @"1", @"14", @"72", @"0x2FF8000" ];
+	NSArray 		*names		= @[ @"BatchPart1.dat", @"batchpart2.dat", @"s\\batchstud.dat", @"Batch Sub Model.ldr" ];
+	int 			line		= 0;
+
+	for(int step = 0; step < STEP_COUNT; step++)
+	{
+		for(int counter = 0; counter < GEOMETRY_PER_STEP; counter++, line++)
+		{
+			NSString	*color	= [colors objectAtIndex:line % [colors count]];
+			float		angle	= line * 0.3f;
+			float		x		= line * 20.0f;
+			float		y		= -8.0f * (line % 5);
+			float		z		= 0.5f * line;
+
+			switch(line % 5)
+			{
+				case 0:
+					if(line % 3 == 0)
+						[contents appendFormat:@"0 MLCAD BTG Group %d\r\n", line / 15];
+					[contents appendFormat:@"1 %@ %g %g %g %.6g 0 %.6g 0 1 0 %.6g 0 %.6g %@\r\n",
+						color, x, y, z, cosf(angle), sinf(angle), -sinf(angle), cosf(angle),
+						[names objectAtIndex:(line / 5) % [names count]] ];
+					break;
+				case 1:
+					[contents appendFormat:@"2 %@ %g %g %g %g %g %g\r\n", color, x, y, z, x + 10, y, z - 10];
+					break;
+				case 2:
+					[contents appendFormat:@"3 %@ %g %g %g %g %g %g %g %g %g\r\n", color, x, y, z, x + 10, y, z, x, y + 10, z];
+					break;
+				case 3:
+					[contents appendFormat:@"4 %@ %g %g %g %g %g %g %g %g %g %g %g %g\r\n",
+						color, x, y, z, x + 10, y, z, x + 10, y + 10, z, x, y + 10, z];
+					break;
+				case 4:
+					[contents appendFormat:@"5 %@ %g %g %g %g %g %g %g %g %g %g %g %g\r\n",
+						color, x, y, z, x, y + 24, z, x - 6, y, z + 6, x + 6, y, z + 6];
+					break;
+			}
+			if(line % 17 == 0)
+				[contents appendFormat:@"0 // note %d\r\n", line];
+		}
+		if(step < STEP_COUNT - 1)
+			[contents appendString:@"0 STEP\r\n"];
+	}
+
+	return [LDrawLineArray linesFromData:[contents dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+
+//========== serialModelFromLines: =============================================
+//
+// Purpose:		Parses the model one step at a time. Each step is too small to
+//				be split across threads, so this is the serial parse.
+//
+//==============================================================================
+- (LDrawModel *) serialModelFromLines:(NSArray *)lines
+{
+	LDrawModel	*model		= [[LDrawModel alloc] init];
+	NSUInteger	maxIndex	= [lines count] - 1;
+	NSUInteger	index		= [model parseHeaderFromLines:lines beginningAtIndex:0];
+	NSRange 	stepRange	= NSMakeRange(0, 0);
+
+	while(index <= maxIndex)
+	{
+		stepRange = [LDrawStep rangeOfDirectiveBeginningAtIndex:index inLines:lines maxIndex:maxIndex];
+		[model addStep:[[LDrawStep alloc] initWithLines:lines inRange:stepRange parentGroup:NULL]];
+		index = NSMaxRange(stepRange);
+	}
+
+	return model;
+}
+
+
+//========== assertDirective:matches: ==========================================
+//
+// Purpose:		Checks a directive from the concurrent parse against the one
+//				the serial parse made of the same line.
+//
+//==============================================================================
+- (void) assertDirective:(LDrawDirective *)directive matches:(LDrawDirective *)expected
+{
+	XCTAssertEqualObjects([directive class], [expected class]);
+	XCTAssertEqualObjects([directive write], [expected write]);
+
+	if([expected isKindOfClass:[LDrawDrawableElement class]])
+	{
+		XCTAssertEqual([[(LDrawDrawableElement *)directive LDrawColor] colorCode],
+					   [[(LDrawDrawableElement *)expected LDrawColor] colorCode]);
+	}
+
+	if([expected isKindOfClass:[LDrawPart class]])
+	{
+		LDrawPart	*part			= (LDrawPart *)directive;
+		LDrawPart	*expectedPart	= (LDrawPart *)expected;
+		Matrix4 	matrix			= [part transformationMatrix];
+		Matrix4 	expectedMatrix	= [expectedPart transformationMatrix];
+
+		XCTAssertEqualObjects([part displayName], [expectedPart displayName]);
+		XCTAssertEqualObjects([part referenceName], [expectedPart referenceName]);
+		XCTAssertEqualObjects([part group], [expectedPart group]);
+		XCTAssertTrue(memcmp(&matrix, &expectedMatrix, sizeof(Matrix4)) == 0, @"%@", [expected write]);
+	}
+}
+
+
+- (void)test_ConcurrentParse_MatchesSerialParse
+{
+	LDrawLineArray	*lines		= [self modelLines];
+	LDrawModel		*serial 	= [self serialModelFromLines:lines];
+	NSArray 		*steps		= [serial steps];
+	NSUInteger		groupCount	= 0;
+
+	XCTAssertEqual([steps count], (NSUInteger)STEP_COUNT);
+
+	// Which thread gets which chunk varies from run to run.
+	for(int attempt = 0; attempt < 4; attempt++)
+	{
+		LDrawModel	*model	= [[LDrawModel alloc] initWithLines:lines inRange:NSMakeRange(0, [lines count]) parentGroup:NULL];
+
+		XCTAssertEqual([[model steps] count], [steps count]);
+
+		for(NSUInteger stepIndex = 0; stepIndex < [steps count] && stepIndex < [[model steps] count]; stepIndex++)
+		{
+			NSArray *directives 		= [[[model steps] objectAtIndex:stepIndex] subdirectives];
+			NSArray *expectedDirectives = [[steps objectAtIndex:stepIndex] subdirectives];
+
+			XCTAssertEqual([directives count], [expectedDirectives count]);
+			for(NSUInteger counter = 0; counter < [directives count] && counter < [expectedDirectives count]; counter++)
+				[self assertDirective:[directives objectAtIndex:counter] matches:[expectedDirectives objectAtIndex:counter]];
+		}
+
+		XCTAssertEqualObjects([model write], [serial write]);
+	}
+
+	// The groups really were picked up, so the comparison covers them.
+	for(LDrawStep *step in steps)
+	{
+		for(LDrawDirective *directive in [step subdirectives])
+		{
+			if([directive isKindOfClass:[LDrawPart class]] && [[(LDrawPart *)directive group] length] > 0)
+				groupCount++;
+		}
+	}
+	XCTAssertEqual(groupCount, (NSUInteger)(STEP_COUNT * GEOMETRY_PER_STEP / 15));
+}
+
+@end
@@ -0,0 +1,168 @@
+//
+//  LDrawDLBuildQueue_Tests.m
+//  UnitTests
+//
+
+#import "LDrawDLBuildQueue.h"
+#import "MeshSmooth.h"
+
+#import <XCTest/XCTest.h>
+
+// What one job owns, and what the queue did with it.
+typedef struct
+{
+	LDrawDLBake	bake;
+	int			builds;
+	int			discards;
+
+} TestBuild;
+
+@interface LDrawDLBuildQueue_Tests : XCTestCase
+
+@end
+
+
+//========== buildTestJob ======================================================
+//
+// Purpose:		The queue's build function.
+//
+//==============================================================================
+static void buildTestJob(void *ref)
+{
+	TestBuild *build = ref;
+
+	LDrawDLBakeRun(&build->bake);
+	build->builds++;
+}
+
+
+//========== discardTestJob ====================================================
+//
+// Purpose:		The queue's discard function.
+//
+//==============================================================================
+static void discardTestJob(void *ref)
+{
+	TestBuild *build = ref;
+
+	build->discards++;
+}
+
+
+@implementation LDrawDLBuildQueue_Tests
+
+//========== startBake:size: ===================================================
+//
+// Purpose:		Collects a grid of quads, outlined along one edge, into build
+//				the way a display list builder does.
+//
+//==============================================================================
+- (void) startBake:(TestBuild *)build size:(int)size
+{
+	const float 	color[4]	= { 0, 0, 1, 1 };
+	struct Mesh 	*mesh		= create_growable_mesh();
+	int 			x, z;
+
+	memset(build, 0, sizeof(*build));
+
+	for(x = 0; x < size; x++)
+	for(z = 0; z < size; z++)
+	{
+		float points[4][3] =
+		{
+			{ x, 		0,	z },
+			{ x, 		0,	z + 1 },
+			{ x + 1,	0,	z + 1 },
+			{ x + 1,	0,	z },
+		};
+		add_face(mesh, points[0], points[1], points[2], points[3], color, 0);
+		if(z == 0)
+			add_face(mesh, points[0], points[3], NULL, NULL, color, 0);
+	}
+
+	LDrawDLBakeInit(&build->bake, mesh, 1, size * size, NULL);
+}
+
+
+- (void)test_QueuedBake_MatchesInlineBake
+{
+	LDrawDLBuildQueue	*queue	= LDrawDLBuildQueueCreate(2);
+	TestBuild			inlined;
+	TestBuild			queued;
+	LDrawDLBuildJob 	*job	= NULL;
+
+	[self startBake:&inlined size:16];
+	[self startBake:&queued size:16];
+
+	LDrawDLBakeRun(&inlined.bake);
+	job = LDrawDLBuildQueueSubmit(queue, buildTestJob, discardTestJob, &queued);
+	XCTAssertEqual(LDrawDLBuildJobFinish(job), (void *)&queued);
+
+	XCTAssertEqual(queued.builds, 1);
+	XCTAssertEqual(queued.discards, 0);
+	XCTAssertGreaterThan(inlined.bake.indexCount, 0);
+	XCTAssertEqual(queued.bake.vertexCount, inlined.bake.vertexCount);
+	XCTAssertEqual(queued.bake.indexCount, inlined.bake.indexCount);
+	XCTAssertEqual(memcmp(queued.bake.vertices, inlined.bake.vertices,
+						  sizeof(float) * LDRAW_MESH_CACHE_VERTEX_STRIDE * inlined.bake.vertexCount), 0);
+	XCTAssertEqual(memcmp(queued.bake.indices, inlined.bake.indices, sizeof(uint32_t) * inlined.bake.indexCount), 0);
+	XCTAssertEqual(queued.bake.lineCounts[0], inlined.bake.lineCounts[0]);
+	XCTAssertEqual(queued.bake.quadrilateralCounts[0], inlined.bake.quadrilateralCounts[0]);
+
+	LDrawDLBakeRelease(&inlined.bake);
+	LDrawDLBakeRelease(&queued.bake);
+	LDrawDLBuildQueueDestroy(queue);
+}
+
+
+- (void)test_NullQueue_RunsInline
+{
+	TestBuild		build;
+	LDrawDLBuildJob	*job	= NULL;
+
+	[self startBake:&build size:4];
+
+	job = LDrawDLBuildQueueSubmit(NULL, buildTestJob, discardTestJob, &build);
+	XCTAssertTrue(LDrawDLBuildJobIsDone(job));
+	XCTAssertEqual(build.builds, 1);
+	XCTAssertEqual(LDrawDLBuildJobFinish(job), (void *)&build);
+
+	LDrawDLBakeRelease(&build.bake);
+}
+
+
+- (void)test_Cancel_DiscardsEveryJobOnce
+{
+	enum { jobCount = 16 };
+
+	LDrawDLBuildQueue	*queue	= LDrawDLBuildQueueCreate(1);
+	TestBuild			builds[jobCount];
+	LDrawDLBuildJob 	*jobs[jobCount];
+	int 				counter = 0;
+
+	for(counter = 0; counter < jobCount; counter++)
+	{
+		[self startBake:builds + counter size:24];
+		jobs[counter] = LDrawDLBuildQueueSubmit(queue, buildTestJob, discardTestJob, builds + counter);
+	}
+
+	// With one worker, the last jobs are still queued and must never be
+	// built. Cancel from the back so the worker cannot reach them first.
+	for(counter = jobCount - 1; counter >= 0; counter--)
+		LDrawDLBuildJobCancel(jobs[counter]);
+
+	// A job that was running is discarded once its build returns; destroying
+	// the queue joins the worker, so by then every discard has happened.
+	LDrawDLBuildQueueDestroy(queue);
+
+	for(counter = 0; counter < jobCount; counter++)
+	{
+		XCTAssertEqual(builds[counter].discards, 1);
+		XCTAssertLessThanOrEqual(builds[counter].builds, 1);
+		LDrawDLBakeRelease(&builds[counter].bake);
+	}
+	XCTAssertEqual(builds[jobCount - 1].builds, 0);
+}
+
+
+@end
@@ -0,0 +1,160 @@
+//
+//  LDrawMeshCache_Tests.m
+//  UnitTests
+//
+
+#import "LDrawMeshCache.h"
+
+#import <XCTest/XCTest.h>
+
+@interface LDrawMeshCache_Tests : XCTestCase
+{
+	NSString	*folder;
+}
+
+@end
+
+
+@implementation LDrawMeshCache_Tests
+
+- (void)setUp
+{
+	[super setUp];
+
+	folder = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+	[[NSFileManager defaultManager] createDirectoryAtPath:folder withIntermediateDirectories:YES attributes:nil error:NULL];
+}
+
+
+- (void)tearDown
+{
+	[[NSFileManager defaultManager] removeItemAtPath:folder error:NULL];
+	[super tearDown];
+}
+
+
+//========== keyForTriangleAt:color:tid: =======================================
+//
+// Purpose:		The key of a mesh holding one triangle.
+//
+//==============================================================================
+- (LDrawMeshCacheKey) keyForTriangleAt:(float)x color:(float)red tid:(int)tid
+{
+	const float				p1[3]		= { x, 0, 0 };
+	const float				p2[3]		= { x + 1, 0, 0 };
+	const float				p3[3]		= { x, 1, 0 };
+	const float				color[4]	= { red, 0, 0, 1 };
+	LDrawMeshCacheHasher	hasher;
+
+	LDrawMeshCacheHasherInit(&hasher, LDrawMeshCacheRemovedTJunctions);
+	LDrawMeshCacheHasherAddFace(&hasher, p1, p2, p3, NULL, color, tid);
+
+	return LDrawMeshCacheHasherFinish(&hasher);
+}
+
+
+- (void)test_Key_DependsOnEveryInput
+{
+	LDrawMeshCacheKey	key			= [self keyForTriangleAt:0 color:1 tid:0];
+	LDrawMeshCacheKey	same		= [self keyForTriangleAt:0 color:1 tid:0];
+	LDrawMeshCacheKey	moved		= [self keyForTriangleAt:0.001f color:1 tid:0];
+	LDrawMeshCacheKey	recolored	= [self keyForTriangleAt:0 color:0.5f tid:0];
+	LDrawMeshCacheKey	retextured	= [self keyForTriangleAt:0 color:1 tid:1];
+
+	XCTAssertTrue(key.low == same.low && key.high == same.high);
+	XCTAssertFalse(key.low == moved.low && key.high == moved.high);
+	XCTAssertFalse(key.low == recolored.low && key.high == recolored.high);
+	XCTAssertFalse(key.low == retextured.low && key.high == retextured.high);
+}
+
+
+- (void)test_Entry_RoundTrips
+{
+	LDrawMeshCacheKey	key				= [self keyForTriangleAt:0 color:1 tid:0];
+	LDrawMeshCacheKey	otherKey		= [self keyForTriangleAt:5 color:1 tid:0];
+	float				vertices[30];
+	uint32_t			indices[5]		= { 0, 1, 0, 1, 2 };
+	int					lineStarts[1]	= { 0 };
+	int					lineCounts[1]	= { 2 };
+	int					triStarts[1]	= { 2 };
+	int					triCounts[1]	= { 3 };
+	int					zero[1]			= { 0 };
+	int					ranges[8];
+	char				path[1024];
+	LDrawMeshCacheEntry	*entry			= NULL;
+	int					counter			= 0;
+
+	for(counter = 0; counter < 30; counter++)
+		vertices[counter] = counter * 0.25f;
+
+	XCTAssertTrue(LDrawMeshCachePathForKey([folder fileSystemRepresentation], key, path, sizeof(path)));
+	XCTAssertTrue(LDrawMeshCacheEntryWrite(path, key, 3, vertices, 5, indices, 1,
+										   lineStarts, lineCounts, zero, zero, triStarts, triCounts, zero, zero));
+
+	entry = LDrawMeshCacheEntryOpen(path, key, 1);
+	XCTAssertTrue(entry != NULL);
+	XCTAssertEqual(entry->header->vertexCount, 3u);
+	XCTAssertEqual(entry->header->indexCount, 5u);
+	XCTAssertEqual(memcmp(entry->vertices, vertices, sizeof(vertices)), 0);
+	XCTAssertEqual(memcmp(entry->indices, indices, sizeof(indices)), 0);
+
+	LDrawMeshCacheEntryGetRanges(entry, ranges + 0, ranges + 1, ranges + 2, ranges + 3, ranges + 4, ranges + 5, ranges + 6, ranges + 7);
+	XCTAssertEqual(ranges[1], 2);
+	XCTAssertEqual(ranges[4], 2);
+	XCTAssertEqual(ranges[5], 3);
+	LDrawMeshCacheEntryClose(entry);
+
+	// A file under the right name but for another mesh or texture count is a miss.
+	XCTAssertTrue(LDrawMeshCacheEntryOpen(path, otherKey, 1) == NULL);
+	XCTAssertTrue(LDrawMeshCacheEntryOpen(path, key, 2) == NULL);
+}
+
+
+- (void)test_Entry_WithBadIndex_IsRejected
+{
+	LDrawMeshCacheKey	key				= [self keyForTriangleAt:0 color:1 tid:0];
+	const float			vertices[30]	= { 0 };
+	const uint32_t		indices[3]		= { 0, 1, 3 };		// only 3 vertices
+	const int			triStarts[1]	= { 0 };
+	const int			triCounts[1]	= { 3 };
+	const int			zero[1]			= { 0 };
+	char				path[1024];
+
+	XCTAssertTrue(LDrawMeshCachePathForKey([folder fileSystemRepresentation], key, path, sizeof(path)));
+	XCTAssertTrue(LDrawMeshCacheEntryWrite(path, key, 3, vertices, 3, indices, 1,
+										   zero, zero, zero, zero, triStarts, triCounts, zero, zero));
+
+	XCTAssertTrue(LDrawMeshCacheEntryOpen(path, key, 1) == NULL);
+}
+
+
+- (void)test_Prune_KeepsNewestEntries
+{
+	const float			vertices[10]	= { 0 };
+	const uint32_t		indices[1]		= { 0 };
+	const int			zero[1]			= { 0 };
+	LDrawMeshCacheKey	key				= [self keyForTriangleAt:0 color:1 tid:0];
+	char				path[1024];
+	NSArray				*remaining		= nil;
+	int					counter			= 0;
+
+	for(counter = 0; counter < 4; counter++)
+	{
+		key.low += 1;
+		LDrawMeshCachePathForKey([folder fileSystemRepresentation], key, path, sizeof(path));
+		LDrawMeshCacheEntryWrite(path, key, 1, vertices, 1, indices, 1, zero, zero, zero, zero, zero, zero, zero, zero);
+
+		// Modification times only have to be in order.
+		[[NSFileManager defaultManager] setAttributes:@{ NSFileModificationDate: [NSDate dateWithTimeIntervalSinceNow:counter - 10] }
+										 ofItemAtPath:[NSString stringWithUTF8String:path]
+												error:NULL];
+	}
+
+	LDrawMeshCachePrune([folder fileSystemRepresentation], 2 * (sizeof(LDrawMeshCacheHeader) + sizeof(vertices) + sizeof(indices) + sizeof(LDrawMeshCacheRanges)));
+
+	remaining = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:folder error:NULL];
+	XCTAssertEqual([remaining count], (NSUInteger)2);
+	XCTAssertTrue([remaining containsObject:[[NSString stringWithUTF8String:path] lastPathComponent]]);
+}
+
+@end
@@ -0,0 +1,105 @@
+//
+//  LDrawSoftRaster_Tests.m
+//  UnitTests
+//
+
+#import "LDrawSoftRaster.h"
+#import "MatrixMathEx.h"
+
+#import <XCTest/XCTest.h>
+
+@interface LDrawSoftRaster_Tests : XCTestCase
+
+@end
+
+
+@implementation LDrawSoftRaster_Tests
+
+//========== drawFan:into: =====================================================
+//
+// Purpose:		Draws a translucent disc, made of a fan of triangles, with a
+//				pixel-for-unit camera over a black framebuffer.
+//
+//==============================================================================
+- (void) drawFan:(int)sides into:(LDrawSoftFramebuffer *)framebuffer
+{
+	const float 		black[4]	= { 0, 0, 0, 1 };
+	const float 		half[4]		= { 0.5f, 0.5f, 0.5f, 0.5f };
+	LDrawSoftDLBuilder	*builder	= LDrawSoftDLBuilderCreate();
+	LDrawSoftDL 		*disc		= NULL;
+	LDrawSoftSession	*session	= NULL;
+	float				identity[16];
+	float				projection[16];
+	int 				side;
+
+	for(side = 0; side < sides; side++)
+	{
+		float a0		= 2 * (float)M_PI * side / sides;
+		float a1		= 2 * (float)M_PI * (side + 1) / sides;
+		float tri[9]	= { 32.3f, 31.9f, 0,
+							32.3f + 28.1f * cosf(a1), 31.9f + 28.1f * sinf(a1), 0,
+							32.3f + 28.1f * cosf(a0), 31.9f + 28.1f * sinf(a0), 0 };
+
+		LDrawSoftDLBuilderAddTri(builder, tri, half);
+	}
+	disc = LDrawSoftDLBuilderFinish(builder);
+
+	buildIdentity(identity);
+	buildOrthoMatrix(projection, 0, framebuffer->width, framebuffer->height, 0, -1, 1);
+
+	LDrawSoftFramebufferClear(framebuffer, black);
+	session = LDrawSoftSessionCreate(framebuffer, identity, projection);
+	LDrawSoftSessionDraw(session, disc, half, half, identity, false);
+	LDrawSoftSessionDrawAndDestroy(session);
+
+	LDrawSoftDLDestroy(disc);
+}
+
+
+- (void)test_SharedEdges_DrawEachPixelOnce
+{
+	LDrawSoftFramebuffer	*framebuffer	= LDrawSoftFramebufferCreate(64, 64);
+	const uint8_t			*first			= NULL;
+	int 					lit 			= 0;
+	int 					counter 		= 0;
+
+	[self drawFan:29 into:framebuffer];
+
+	// Blending twice would make a pixel brighter than the rest.
+	for(counter = 0; counter < 64 * 64; counter++)
+	{
+		const uint8_t *pixel = framebuffer->pixels + counter * 4;
+
+		if(pixel[0] == 0)
+			continue;
+		if(first == NULL)
+			first = pixel;
+		XCTAssertEqual(memcmp(pixel, first, 4), 0);
+		lit++;
+	}
+	XCTAssertGreaterThan(lit, 2000);
+
+	LDrawSoftFramebufferDestroy(framebuffer);
+}
+
+
+- (void)test_ThreadCount_DoesNotChangeImage
+{
+	LDrawSoftFramebuffer	*single 	= LDrawSoftFramebufferCreate(200, 150);
+	LDrawSoftFramebuffer	*multiple	= LDrawSoftFramebufferCreate(200, 150);
+
+	LDrawSoftRasterSetThreadCount(1);
+	[self drawFan:61 into:single];
+	LDrawSoftRasterSetThreadCount(4);
+	[self drawFan:61 into:multiple];
+	LDrawSoftRasterSetThreadCount(0);
+
+	XCTAssertEqual(memcmp(single->pixels, multiple->pixels, 200 * 150 * 4), 0);
+	XCTAssertEqual(memcmp(single->depths, multiple->depths, 200 * 150 * sizeof(float)), 0);
+
+	LDrawSoftFramebufferDestroy(single);
+	LDrawSoftFramebufferDestroy(multiple);
+}
+
+
+@end
@@ -0,0 +1,469 @@
+//
+//  MeshSmooth_Tests.m
+//  UnitTests
+//
+
+#import "MeshSmooth.h"
+
+#import <XCTest/XCTest.h>
+
+@interface MeshSmooth_Tests : XCTestCase
+
+@end
+
+
+@implementation MeshSmooth_Tests
+
+//========== smoothedGridWithWeldIndex: ========================================
+//
+// Purpose:		Smooths a grid of quads whose shared corners are each nudged by
+//				less than the weld distance, so that every corner has to be
+//				welded, and returns the vertex table.
+//
+//==============================================================================
+- (NSData *) smoothedGridWithWeldIndex:(enum weld_index)weldIndex
+{
+	const int		size		= 24;
+	const float 	color[4]	= { 1, 0, 0, 1 };
+	uint32_t		seed		= 12345;
+	struct Mesh 	*mesh		= create_mesh_with_weld_index(0, size * size, 0, 0, weldIndex);
+	NSMutableData	*vertices	= nil;
+	int 			vertexCount = 0;
+	int 			indexCount	= 0;
+	int 			starts[4];
+	int 			counts[4];
+	int 			x, z, corner, axis;
+
+	for(x = 0; x < size; x++)
+	for(z = 0; z < size; z++)
+	{
+		float points[4][3] =
+		{
+			{ x * 4.0f, 		0,	z * 4.0f },
+			{ x * 4.0f, 		0,	(z + 1) * 4.0f },
+			{ (x + 1) * 4.0f,	0,	(z + 1) * 4.0f },
+			{ (x + 1) * 4.0f,	0,	z * 4.0f },
+		};
+		for(corner = 0; corner < 4; corner++)
+		for(axis = 0; axis < 3; axis++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			points[corner][axis] += ((float)(seed >> 8) / (float)(1 << 24) - 0.5f) * 0.002f;
+		}
+		add_face(mesh, points[0], points[1], points[2], points[3], color, 0);
+	}
+
+	finish_faces_and_sort(mesh);
+	add_creases(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+
+	get_final_mesh_counts(mesh, &vertexCount, &indexCount);
+	vertices = [NSMutableData dataWithLength:sizeof(float) * 10 * vertexCount];
+	unsigned int *indices = malloc(sizeof(unsigned int) * indexCount);
+	write_indexed_mesh(mesh, vertexCount, [vertices mutableBytes], indexCount, indices, 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+	free(indices);
+	destroy_mesh(mesh);
+
+	return vertices;
+}
+
+
+//========== trianglesOfBumpyGridOptimized: ====================================
+//
+// Purpose:		Smooths a bumpy grid of triangles and returns each triangle
+//				that was written, as its three corner locations.
+//
+//==============================================================================
+- (NSCountedSet *) trianglesOfBumpyGridOptimized:(BOOL)optimize
+{
+	const int		size		= 32;
+	const float 	color[4]	= { 0, 0, 1, 1 };
+	struct Mesh 	*mesh		= create_mesh(size * size * 2, 0, 0, 0);
+	NSCountedSet	*triangles	= [NSCountedSet set];
+	int 			vertexCount = 0;
+	int 			indexCount	= 0;
+	int 			starts[4];
+	int 			counts[4];
+	int 			x, z, i, corner;
+
+	for(x = 0; x < size; x++)
+	for(z = 0; z < size; z++)
+	{
+		float p1[3] = { x,		sinf(x * 0.3f) * cosf(z * 0.3f),				z };
+		float p2[3] = { x,		sinf(x * 0.3f) * cosf((z + 1) * 0.3f),			z + 1 };
+		float p3[3] = { x + 1,	sinf((x + 1) * 0.3f) * cosf((z + 1) * 0.3f),	z + 1 };
+		float p4[3] = { x + 1,	sinf((x + 1) * 0.3f) * cosf(z * 0.3f),			z };
+		add_face(mesh, p1, p2, p3, NULL, color, 0);
+		add_face(mesh, p1, p3, p4, NULL, color, 0);
+	}
+
+	finish_faces_and_sort(mesh);
+	add_creases(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+	if(optimize)
+		optimize_vertex_cache(mesh);
+
+	get_final_mesh_counts(mesh, &vertexCount, &indexCount);
+	float			*vertices	= malloc(sizeof(float) * 10 * vertexCount);
+	unsigned int	*indices	= malloc(sizeof(unsigned int) * indexCount);
+	write_indexed_mesh(mesh, vertexCount, vertices, indexCount, indices, 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+
+	for(i = starts[2]; i < starts[2] + counts[2]; i += 3)
+	{
+		float triangle[9];
+		for(corner = 0; corner < 3; corner++)
+			memcpy(triangle + corner * 3, vertices + indices[i + corner] * 10, sizeof(float) * 3);
+		[triangles addObject:[NSData dataWithBytes:triangle length:sizeof(triangle)]];
+	}
+
+	free(vertices);
+	free(indices);
+	destroy_mesh(mesh);
+
+	return triangles;
+}
+
+
+//========== smoothedGridWithLinesGrowable: ====================================
+//
+// Purpose:		Smooths a bumpy grid of triangles outlined by lines, and returns
+//				the vertex table followed by the index table.
+//
+//				A growable mesh gets each line as soon as the triangle it
+//				borders; a counted one has to get every line last.
+//
+//==============================================================================
+- (NSData *) smoothedGridWithLinesGrowable:(BOOL)growable
+{
+	const int		size		= 16;
+	const float 	color[4]	= { 0, 1, 0, 1 };
+	struct Mesh 	*mesh		= NULL;
+	NSMutableData	*output 	= nil;
+	int 			vertexCount = 0;
+	int 			indexCount	= 0;
+	int 			starts[4];
+	int 			counts[4];
+	int 			passes		= growable ? 1 : 2;
+	int 			pass, x, z;
+
+	if(growable)
+		mesh = create_growable_mesh();
+	else
+		mesh = create_mesh(size * size * 2, 0, size * 2, 0);
+
+	for(pass = 0; pass < passes; pass++)
+	for(x = 0; x < size; x++)
+	for(z = 0; z < size; z++)
+	{
+		float p1[3] = { x,		sinf(x * 0.3f) * cosf(z * 0.3f),				z };
+		float p2[3] = { x,		sinf(x * 0.3f) * cosf((z + 1) * 0.3f),			z + 1 };
+		float p3[3] = { x + 1,	sinf((x + 1) * 0.3f) * cosf((z + 1) * 0.3f),	z + 1 };
+		float p4[3] = { x + 1,	sinf((x + 1) * 0.3f) * cosf(z * 0.3f),			z };
+
+		if(pass == 0)
+		{
+			add_face(mesh, p1, p2, p3, NULL, color, 0);
+			add_face(mesh, p1, p3, p4, NULL, color, 0);
+		}
+		if(pass == 1 || growable)
+		{
+			if(x == 0)	add_face(mesh, p1, p2, NULL, NULL, color, 0);
+			if(z == 0)	add_face(mesh, p1, p4, NULL, NULL, color, 0);
+		}
+	}
+
+	finish_faces_and_sort(mesh);
+	add_creases(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+
+	get_final_mesh_counts(mesh, &vertexCount, &indexCount);
+	output = [NSMutableData dataWithLength:sizeof(float) * 10 * vertexCount + sizeof(unsigned int) * indexCount];
+	write_indexed_mesh(mesh, vertexCount, [output mutableBytes], indexCount, (unsigned int *)((float *)[output mutableBytes] + 10 * vertexCount), 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+	destroy_mesh(mesh);
+
+	return output;
+}
+
+
+- (void)test_WeldIndexes_WeldIdenticalRings
+{
+	NSData	*rtree	= [self smoothedGridWithWeldIndex:weld_index_rtree];
+	NSData	*grid	= [self smoothedGridWithWeldIndex:weld_index_grid];
+
+	// Corners were welded: fewer vertices than the 4 per quad that went in.
+	XCTAssertLessThan([rtree length], sizeof(float) * 10 * 4 * 24 * 24);
+	XCTAssertEqualObjects(rtree, grid);
+}
+
+
+- (void)test_SIMD_MatchesScalar
+{
+	NSData	*simd	= [self smoothedGridWithWeldIndex:weld_index_grid];
+	NSData	*scalar = nil;
+
+	set_smoothing_simd_enabled(0);
+	scalar = [self smoothedGridWithWeldIndex:weld_index_grid];
+	set_smoothing_simd_enabled(1);
+
+	XCTAssertEqualObjects(simd, scalar);
+}
+
+
+- (void)test_VertexCacheOptimization_KeepsEveryTriangle
+{
+	NSCountedSet	*original	= [self trianglesOfBumpyGridOptimized:NO];
+	NSCountedSet	*optimized	= [self trianglesOfBumpyGridOptimized:YES];
+
+	XCTAssertEqual([original count], (NSUInteger)(32 * 32 * 2));
+	XCTAssertEqualObjects(original, optimized);
+}
+
+
+- (void)test_GrowableMesh_MatchesCountedMesh
+{
+	NSData	*counted	= [self smoothedGridWithLinesGrowable:NO];
+	NSData	*growable	= [self smoothedGridWithLinesGrowable:YES];
+
+	XCTAssertGreaterThan([counted length], (NSUInteger)0);
+	XCTAssertEqualObjects(counted, growable);
+}
+
+
+- (void)test_CompactVertices_RoundTrip
+{
+	const int				count		= 200;
+	float					original[200 * 10];
+	float					decoded[200 * 10];
+	struct compact_vertex	compact[200];
+	struct compact_bounds	bounds;
+	int 					i, axis;
+
+	// Points on a 2000 x 24 x 300 box, normals all around the sphere (every
+	// tenth one zero, as for lines) and colors both real and meta.
+	for(i = 0; i < count; i++)
+	{
+		float	*v		= original + i * 10;
+		float	theta	= i * 0.37f;
+		float	phi		= i * 0.11f;
+
+		v[0] = -1000.0f + 2000.0f * (i % 17) / 16.0f;
+		v[1] = 24.0f * sinf(i * 0.5f);
+		v[2] = 150.0f * cosf(i * 0.7f);
+		if(i % 10 == 0)
+		{
+			v[3] = v[4] = v[5] = 0.0f;
+		}
+		else
+		{
+			v[3] = cosf(theta) * sinf(phi);
+			v[4] = sinf(theta) * sinf(phi);
+			v[5] = cosf(phi);
+		}
+		v[6] = (i % 2) ? 1.0f : 0.0f;
+		v[7] = (i % 255) / 255.0f;
+		v[8] = 0.5f;
+		v[9] = (i % 3) ? 1.0f : 0.0f;
+	}
+
+	get_compact_bounds(original, count, &bounds);
+	write_compact_vertices(original, count, &bounds, compact);
+	decode_compact_vertices(compact, count, &bounds, decoded);
+
+	XCTAssertEqual(sizeof(struct compact_vertex), (size_t)16);
+
+	for(i = 0; i < count; i++)
+	{
+		const float *a = original + i * 10;
+		const float *b = decoded + i * 10;
+
+		for(axis = 0; axis < 3; axis++)
+			XCTAssertEqualWithAccuracy(a[axis], b[axis], bounds.scale[axis] / 65535.0f);
+
+		if(i % 10 == 0)
+		{
+			XCTAssertEqual(b[3], 0.0f);
+			XCTAssertEqual(b[4], 0.0f);
+			XCTAssertEqual(b[5], 0.0f);
+		}
+		else
+			XCTAssertGreaterThan(a[3] * b[3] + a[4] * b[4] + a[5] * b[5], 0.9999f);
+
+		for(axis = 6; axis < 10; axis++)
+			XCTAssertEqualWithAccuracy(a[axis], b[axis], 1.0f / 255.0f);
+		XCTAssertEqual(b[9] == 0.0f, a[9] == 0.0f);		// The meta-color flag survives exactly.
+	}
+}
+
+
+- (void)test_CompactIndices_NarrowInPlace
+{
+	unsigned int	indices[6]	= { 0, 65535, 7, 40000, 1, 2 };
+	unsigned short	*narrow 	= (unsigned short *)indices;
+	int 			i;
+
+	XCTAssertEqual(get_compact_index_size(65536), 2);
+	XCTAssertEqual(get_compact_index_size(65537), 4);
+
+	write_compact_indices(indices, 6, 2, indices);
+
+	XCTAssertEqual(narrow[0], 0);
+	XCTAssertEqual(narrow[1], 65535);
+	XCTAssertEqual(narrow[2], 7);
+	XCTAssertEqual(narrow[3], 40000);
+	for(i = 4; i < 6; i++)
+		XCTAssertEqual(narrow[i], (unsigned short)(i - 3));
+}
+
+
+- (void)test_DetailLevels_FlatGridKeepsItsShape
+{
+	const int		size		= 16;
+	const float 	color[4]	= { 0, 1, 0, 1 };
+	struct Mesh 	*mesh		= create_growable_mesh();
+	int 			vertexCount = 0;
+	int 			indexCount	= 0;
+	int 			starts[4]	= { 0 };
+	int 			counts[4]	= { 0 };
+	int 			lineCount	= 0;
+	int 			condCount	= 0;
+	int 			triCount	= 0;
+	float			area		= 0;
+	float			length		= 0;
+	int 			x, z, i;
+
+	// A flat square of triangles with lines along two of its sides: simplified
+	// it needs only a couple of triangles, and the lines only their ends.
+	for(x = 0; x < size; x++)
+	for(z = 0; z < size; z++)
+	{
+		float p1[3] = { x,		0,	z };
+		float p2[3] = { x,		0,	z + 1 };
+		float p3[3] = { x + 1,	0,	z + 1 };
+		float p4[3] = { x + 1,	0,	z };
+
+		add_face(mesh, p1, p2, p3, NULL, color, 0);
+		add_face(mesh, p1, p3, p4, NULL, color, 0);
+		if(x == 0)	add_face(mesh, p1, p2, NULL, NULL, color, 0);
+		if(z == 0)	add_face(mesh, p1, p4, NULL, NULL, color, 0);
+	}
+
+	finish_faces_and_sort(mesh);
+	add_creases(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+
+	get_final_mesh_counts(mesh, &vertexCount, &indexCount);
+	float			*vertices	= malloc(sizeof(float) * 10 * vertexCount);
+	unsigned int	*indices	= malloc(sizeof(unsigned int) * indexCount);
+	write_indexed_mesh(mesh, vertexCount, vertices, indexCount, indices, 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+	destroy_mesh(mesh);
+
+	unsigned int	*simple 	= malloc(sizeof(unsigned int) * get_simplified_index_capacity(counts[0], 0, counts[2], 0));
+	simplify_indexed_mesh(vertices, vertexCount, indices, starts[0], counts[0], 0, 0, starts[2], counts[2], 0, 0,
+						  0.01f, simple, &lineCount, &condCount, &triCount);
+
+	XCTAssertEqual(counts[2], size * size * 2 * 3);
+	XCTAssertLessThan(triCount, counts[2] / 10);
+	XCTAssertEqual(condCount, 0);
+
+	for(i = 0; i < lineCount + triCount; i++)
+		XCTAssertLessThan(simple[i], (unsigned int)vertexCount);
+
+	for(i = 0; i < lineCount; i += 2)
+	{
+		const float *a = vertices + simple[i] * 10;
+		const float *b = vertices + simple[i + 1] * 10;
+		length += sqrtf((b[0] - a[0]) * (b[0] - a[0]) + (b[2] - a[2]) * (b[2] - a[2]));
+	}
+	for(i = lineCount; i < lineCount + triCount; i += 3)
+	{
+		const float *a = vertices + simple[i] * 10;
+		const float *b = vertices + simple[i + 1] * 10;
+		const float *c = vertices + simple[i + 2] * 10;
+		area += 0.5f * fabsf((b[0] - a[0]) * (c[2] - a[2]) - (b[2] - a[2]) * (c[0] - a[0]));
+		XCTAssertEqual(a[1], 0.0f);
+		XCTAssertEqual(b[1], 0.0f);
+		XCTAssertEqual(c[1], 0.0f);
+	}
+	XCTAssertEqualWithAccuracy(area, (float)(size * size), 0.001f);
+	XCTAssertEqualWithAccuracy(length, (float)(size * 2), 0.001f);
+
+	free(vertices);
+	free(indices);
+	free(simple);
+}
+
+
+- (void)test_TJunctions_SplitTheOpenSide
+{
+	const float 	color[4]	= { 1, 1, 0, 1 };
+	struct Mesh 	*mesh		= create_mesh(6, 0, 0, 0);
+	int 			vertexCount = 0;
+	int 			indexCount	= 0;
+	int 			starts[4]	= { 0 };
+	int 			counts[4]	= { 0 };
+	int 			atT 		= 0;
+	float			area		= 0;
+	int 			i, corner;
+
+	// A square of two triangles beside one cut in half across: the corner in
+	// the middle of the cut sits on the first square's side, a T.
+	float coarse[4][3]	= { { 0, 0, 0 }, { 0, 0, 2 }, { 2, 0, 2 }, { 2, 0, 0 } };
+	float fine[6][3]	= { { 2, 0, 0 }, { 2, 0, 1 }, { 2, 0, 2 }, { 4, 0, 2 }, { 4, 0, 1 }, { 4, 0, 0 } };
+
+	add_face(mesh, coarse[0], coarse[1], coarse[2], NULL, color, 0);
+	add_face(mesh, coarse[0], coarse[2], coarse[3], NULL, color, 0);
+	add_face(mesh, fine[0], fine[1], fine[4], NULL, color, 0);
+	add_face(mesh, fine[0], fine[4], fine[5], NULL, color, 0);
+	add_face(mesh, fine[1], fine[2], fine[3], NULL, color, 0);
+	add_face(mesh, fine[1], fine[3], fine[4], NULL, color, 0);
+
+	finish_faces_and_sort(mesh);
+	add_creases(mesh);
+	find_and_remove_t_junctions(mesh);
+	finish_creases_and_join(mesh);
+	smooth_vertices(mesh);
+	merge_vertices(mesh);
+
+	get_final_mesh_counts(mesh, &vertexCount, &indexCount);
+	float			*vertices	= malloc(sizeof(float) * 10 * vertexCount);
+	unsigned int	*indices	= malloc(sizeof(unsigned int) * indexCount);
+	write_indexed_mesh(mesh, vertexCount, vertices, indexCount, indices, 0,
+					   starts + 0, counts + 0, starts + 1, counts + 1, starts + 2, counts + 2, starts + 3, counts + 3);
+	destroy_mesh(mesh);
+
+	// Only the triangle along the open side is split; the shared diagonals
+	// are left alone.
+	XCTAssertEqual(counts[2], 7 * 3);
+	for(i = starts[2]; i < starts[2] + counts[2]; i += 3)
+	{
+		const float *a = vertices + indices[i] * 10;
+		const float *b = vertices + indices[i + 1] * 10;
+		const float *c = vertices + indices[i + 2] * 10;
+		area += 0.5f * fabsf((b[0] - a[0]) * (c[2] - a[2]) - (b[2] - a[2]) * (c[0] - a[0]));
+		for(corner = 0; corner < 3; corner++)
+		{
+			const float *p = vertices + indices[i + corner] * 10;
+			if(p[0] == 2 && p[1] == 0 && p[2] == 1)
+				++atT;
+		}
+	}
+	XCTAssertEqualWithAccuracy(area, 8.0f, 0.001f);
+	XCTAssertEqual(atT, 4);
+
+	free(vertices);
+	free(indices);
+}
+
+@end
@@ -0,0 +1,76 @@
+//
+//  ColorLibrary_Tests.m
+//  UnitTests
+//
+
+#import "ColorLibrary.h"
+#import "LDrawColor.h"
+
+#import <XCTest/XCTest.h>
+
+@interface ColorLibrary_Tests : XCTestCase
+{
+	ColorLibrary	*library;
+}
+
+@end
+
+
+@implementation ColorLibrary_Tests
+
+- (LDrawColor *)colorWithCode:(LDrawColorT)code red:(float)red
+{
+	LDrawColor	*color			= [[LDrawColor alloc] init];
+	float		components[4]	= { red, 0.5, 0.5, 1.0 };
+
+	[color setColorCode:code];
+	[color setColorRGBA:components];
+	return color;
+}
+
+
+- (void)setUp
+{
+	[super setUp];
+	library = [[ColorLibrary alloc] init];
+}
+
+
+- (void)test_PublicColor_HidesPrivateColor
+{
+	LDrawColor *publicColor		= [self colorWithCode:300 red:0.1];
+	LDrawColor *privateColor	= [self colorWithCode:300 red:0.2];
+	LDrawColor *directColor		= [self colorWithCode:0x2FF0000 red:1.0];
+
+	[library addPrivateColor:privateColor];
+	XCTAssertEqual([library colorForCode:300], privateColor);
+
+	[library addColor:publicColor];
+	[library addPrivateColor:privateColor];
+	XCTAssertEqual([library colorForCode:300], publicColor);
+	XCTAssertEqual([[library colors] count], 1u);
+
+	[library addColor:directColor];
+	XCTAssertEqual([library colorForCode:0x2FF0000], directColor);
+}
+
+
+- (void)test_Compliment_FollowsEdgeColor
+{
+	LDrawColor	*red			= [self colorWithCode:4 red:0.8];
+	float		compliment[4]	= {};
+
+	[red setEdgeColorCode:5];
+	[library addColor:red];
+	[library addColor:[self colorWithCode:5 red:0.3]];
+
+	[library getComplimentRGBA:compliment forCode:4];
+	XCTAssertEqualWithAccuracy(compliment[0], 0.3, 1e-6);
+
+	// Replacing the edge color must not leave a stale compliment behind.
+	[library addColor:[self colorWithCode:5 red:0.6]];
+	[library getComplimentRGBA:compliment forCode:4];
+	XCTAssertEqualWithAccuracy(compliment[0], 0.6, 1e-6);
+}
+
+@end
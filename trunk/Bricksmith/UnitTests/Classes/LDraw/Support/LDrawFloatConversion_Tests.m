@@ -0,0 +1,106 @@
+//
+//  LDrawFloatConversion_Tests.m
+//  UnitTests
+//
+
+#import "LDrawFile.h"
+#import "LDrawFloatConversion.h"
+#import "LDrawUtilities.h"
+
+#import <XCTest/XCTest.h>
+
+@interface LDrawFloatConversion_Tests : XCTestCase
+
+@end
+
+
+@implementation LDrawFloatConversion_Tests
+
+- (void)test_ToChars_TypicalValues_ShortestPlainDecimal
+{
+	char buffer[LDRAW_FLOAT_CHARS_MAX];
+
+	LDrawFloatToChars(50.09f, buffer);		XCTAssertEqual(strcmp(buffer, "50.09"), 0);
+	LDrawFloatToChars(-8.0f, buffer);		XCTAssertEqual(strcmp(buffer, "-8"), 0);
+	LDrawFloatToChars(-0.0f, buffer);		XCTAssertEqual(strcmp(buffer, "0"), 0);
+	LDrawFloatToChars(0.707107f, buffer);	XCTAssertEqual(strcmp(buffer, "0.707107"), 0);
+	LDrawFloatToChars(1.0f / 3.0f, buffer);	XCTAssertEqual(strcmp(buffer, "0.33333334"), 0);
+	LDrawFloatToChars(1e-7f, buffer);		XCTAssertEqual(strcmp(buffer, "0.0000001"), 0);
+	LDrawFloatToChars(123456792.0f, buffer);XCTAssertEqual(strcmp(buffer, "123456790"), 0);
+}
+
+
+- (void)test_FromChars_FieldSyntax_MatchesFloatValue
+{
+	size_t used = 0;
+
+	XCTAssertEqual(LDrawFloatFromChars("-12.5e-1", 8, &used), -1.25f);
+	XCTAssertEqual(used, 8u);
+	XCTAssertEqual(LDrawFloatFromChars(".5", 2, &used), 0.5f);
+	XCTAssertEqual(LDrawFloatFromChars("abc", 3, &used), 0.0f);
+	XCTAssertEqual(used, 0u);
+	XCTAssertEqual(LDrawFloatFromChars("3e", 2, &used), 3.0f);
+	XCTAssertEqual(used, 1u);
+}
+
+
+- (void)test_RoundTrip_RandomBitPatterns_ExactlyRecovered
+{
+	uint32_t seed = 12345;
+
+	for(int counter = 0; counter < 200000; counter++)
+	{
+		char		buffer[LDRAW_FLOAT_CHARS_MAX];
+		uint32_t	bits	= 0;
+		float		value	= 0;
+		float		parsed	= 0;
+		size_t		length	= 0;
+
+		seed	= seed * 1664525 + 1013904223;
+		bits	= seed;
+		memcpy(&value, &bits, sizeof(value));
+		if(isfinite(value) == NO)
+			continue;
+
+		length	= LDrawFloatToChars(value, buffer);
+		parsed	= LDrawFloatFromChars(buffer, length, NULL);
+
+		XCTAssertEqual(parsed, value, @"%s", buffer);
+		XCTAssertEqual(parsed, strtof(buffer, NULL), @"%s", buffer);
+	}
+}
+
+
+- (void)test_SaveLoadSave_ComputedGeometry_IdenticalBytes
+{
+	NSMutableString	*contents	= [NSMutableString stringWithString:@"0 Round trip\r\n"];
+	LDrawFile		*file		= nil;
+	NSString		*firstSave	= nil;
+	NSString		*secondSave	= nil;
+
+	// Values which only exist as the result of arithmetic: the kind a rotation
+	// or a drag leaves behind, with no short decimal form.
+	for(int counter = 1; counter <= 50; counter++)
+	{
+		float angle = counter * 0.1234567f;
+
+		[contents appendFormat:@"2 24 %@ %@ %@ %@ %@ %@\r\n",
+			[LDrawUtilities outputStringForFloat:cosf(angle) * 20],
+			[LDrawUtilities outputStringForFloat:sinf(angle) / 3],
+			[LDrawUtilities outputStringForFloat:angle * 1e-6f],
+			[LDrawUtilities outputStringForFloat:angle * 1e6f],
+			[LDrawUtilities outputStringForFloat:-angle],
+			[LDrawUtilities outputStringForFloat:1 / angle] ];
+		[contents appendFormat:@"3 16 %.9g %.9g %.9g 1 0 0 0 1 0\r\n", 1 / angle, angle * angle, -angle / 7];
+		[contents appendFormat:@"4 16 0.1 0.2 0.3 %.9g 0 0 0 1 0 1 0 %.9g\r\n", angle, 100 * angle];
+	}
+
+	file		= [LDrawFile parseFromFileContents:contents];
+	firstSave	= [file write];
+	file		= [LDrawFile parseFromFileContents:firstSave];
+	secondSave	= [file write];
+
+	XCTAssertEqualObjects(secondSave, firstSave);
+}
+
+@end
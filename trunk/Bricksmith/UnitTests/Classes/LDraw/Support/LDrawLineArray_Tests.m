@@ -0,0 +1,97 @@
+//
+//  LDrawLineArray_Tests.m
+//  UnitTests
+//
+
+#import "LDrawLineArray.h"
+#import "LDrawMPDModel.h"
+#import "LDrawUtilities.h"
+#import "StringCategory.h"
+
+#import <XCTest/XCTest.h>
+
+@interface LDrawLineArray_Tests : XCTestCase
+
+@end
+
+
+@implementation LDrawLineArray_Tests
+
+- (void)test_Lines_MixedTerminators_MatchSeparateByLine
+{
+	const char *contents = "0 Untitled\r\n1 16 0 0 0 1 0 0 0 1 0 0 0 1 3001.dat\r\r\n2 24 0 0 0 1 1 1\n\n3 16 0 0 0 1 0 0 0 1 0\r";
+	NSData *data = [NSData dataWithBytes:contents length:strlen(contents)];
+	NSArray *expected = [[LDrawUtilities stringFromFileData:data] separateByLine];
+	LDrawLineArray *lines = [LDrawLineArray linesFromData:data];
+
+	XCTAssertEqualObjects(lines, expected);
+	XCTAssertEqual([lines stringEncoding], NSASCIIStringEncoding);
+}
+
+
+- (void)test_Lines_InvalidUTF8_FallsBackToLatin1
+{
+	const char *contents = "0 Caf\xE9 model\n0 Author: J\xF6rg\n";
+	NSData *data = [NSData dataWithBytes:contents length:strlen(contents)];
+	LDrawLineArray *lines = [LDrawLineArray linesFromData:data];
+
+	XCTAssertEqual([lines count], 2u);
+	XCTAssertEqual([lines stringEncoding], NSISOLatin1StringEncoding);
+	XCTAssertEqualObjects([lines objectAtIndex:0], @"0 Café model");
+	XCTAssertEqualObjects([lines objectAtIndex:1], @"0 Author: Jörg");
+}
+
+
+- (void)test_Lines_UTF8WithByteOrderMark_SkipsMark
+{
+	const char *contents = "\xEF\xBB\xBF" "0 FILE \xE2\x98\x83.ldr\n";
+	NSData *data = [NSData dataWithBytes:contents length:strlen(contents)];
+	LDrawLineArray *lines = [LDrawLineArray linesFromData:data];
+
+	XCTAssertEqual([lines count], 1u);
+	XCTAssertEqual([lines stringEncoding], NSUTF8StringEncoding);
+	XCTAssertEqualObjects([lines objectAtIndex:0], @"0 FILE ☃.ldr");
+}
+
+
+- (void)test_Lines_GeometryLine_TokenizedInPlace
+{
+	const char *contents = "0 header\n1 4 10 20 30 1 0 0 0 1 0 0 0 1 My Model.ldr\n";
+	NSData *data = [NSData dataWithBytes:contents length:strlen(contents)];
+	LDrawLineArray *lines = [LDrawLineArray linesFromData:data];
+	LDrawGeometryLine fields;
+	NSString *name = nil;
+
+	XCTAssertTrue([LDrawUtilities readGeometryLineAtIndex:1 inLines:lines fields:&fields name:&name]);
+	XCTAssertEqual(fields.lineType, 1);
+	XCTAssertEqual(fields.colorCode, 4);
+	XCTAssertEqual(fields.values[2], 30.0f);
+	XCTAssertEqualObjects(name, @"My Model.ldr");
+
+	XCTAssertFalse([LDrawUtilities readGeometryLineAtIndex:0 inLines:lines fields:&fields name:NULL]);
+}
+
+
+
+- (void)test_Stream_SplitsModels_LikeRangeOfDirective
+{
+	const char *contents = "0 FILE main.ldr\n1 16 0 0 0 1 0 0 0 1 0 0 0 1 sub.ldr\n0 NOFILE\n"
+						   "0 FILE sub.ldr\n0 STEP\n  0   FILE   last.ldr\n3 16 0 0 0 1 0 0 0 1 0\n";
+	NSData *data = [NSData dataWithBytes:contents length:strlen(contents)];
+	LDrawLineArray *allLines = [LDrawLineArray linesFromData:data];
+	LDrawLineStream *stream = [LDrawLineStream streamFromData:data];
+	NSUInteger index = 0;
+	LDrawLineArray *modelLines = nil;
+
+	while((modelLines = [LDrawMPDModel linesOfModelFromStream:stream]) != nil)
+	{
+		NSRange range = [LDrawMPDModel rangeOfDirectiveBeginningAtIndex:index inLines:allLines maxIndex:[allLines count] - 1];
+
+		XCTAssertEqualObjects(modelLines, [allLines subarrayWithRange:range]);
+		index = NSMaxRange(range);
+	}
+	XCTAssertEqual(index, [allLines count]);
+	XCTAssertEqual(index, 7u);
+}
+
+@end
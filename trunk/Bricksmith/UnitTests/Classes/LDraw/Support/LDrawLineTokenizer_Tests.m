@@ -0,0 +1,89 @@
+//
+//  LDrawLineTokenizer_Tests.m
+//  UnitTests
+//
+
+#import "LDrawLineTokenizer.h"
+
+#import <XCTest/XCTest.h>
+
+@interface LDrawLineTokenizer_Tests : XCTestCase
+
+@end
+
+
+@implementation LDrawLineTokenizer_Tests
+
+- (void)test_Tokenize_Part_ReadsMatrixAndNameWithSpaces
+{
+	const char *line = "1 16 -150 -8 20 0 0 -1 0 1 0 1 0 0   My Sub Model.ldr \r";
+	LDrawGeometryLine fields;
+	
+	XCTAssertTrue(LDrawTokenizeGeometryLine(line, strlen(line), &fields));
+	
+	XCTAssertEqual(fields.lineType, 1);
+	XCTAssertEqual(fields.colorCode, 16);
+	XCTAssertFalse(fields.isCustomRGB);
+	XCTAssertEqual(fields.valueCount, 12);
+	XCTAssertEqual(fields.values[0], -150.0f);
+	XCTAssertEqual(fields.values[5], -1.0f);
+	XCTAssertEqual(fields.values[11], 0.0f);
+	XCTAssertEqual(fields.nameLength, strlen("My Sub Model.ldr"));
+	XCTAssertEqual(strncmp(fields.name, "My Sub Model.ldr", fields.nameLength), 0);
+}
+
+
+- (void)test_Tokenize_CustomRGB_ReadsHexValue
+{
+	const char *line = "3 0x2FF8000 1.5 -2e2 .25 1 2 3 4 5 6";
+	LDrawGeometryLine fields;
+	
+	XCTAssertTrue(LDrawTokenizeGeometryLine(line, strlen(line), &fields));
+	
+	XCTAssertEqual(fields.lineType, 3);
+	XCTAssertTrue(fields.isCustomRGB);
+	XCTAssertEqual(fields.customRGB, 0x2FF8000u);
+	XCTAssertEqual(fields.values[0], 1.5f);
+	XCTAssertEqual(fields.values[1], -200.0f);
+	XCTAssertEqual(fields.values[2], 0.25f);
+}
+
+
+- (void)test_Tokenize_MissingFields_ReadAsZero
+{
+	const char *line = "  2   24 1 2";
+	LDrawGeometryLine fields;
+	
+	XCTAssertTrue(LDrawTokenizeGeometryLine(line, strlen(line), &fields));
+	
+	XCTAssertEqual(fields.lineType, 2);
+	XCTAssertEqual(fields.colorCode, 24);
+	XCTAssertEqual(fields.valueCount, 2);
+	XCTAssertEqual(fields.values[1], 2.0f);
+	XCTAssertEqual(fields.values[5], 0.0f);
+}
+
+
+- (void)test_Tokenize_MetaCommand_IsRejected
+{
+	const char *line = "0 STEP";
+	LDrawGeometryLine fields;
+	
+	XCTAssertFalse(LDrawTokenizeGeometryLine(line, strlen(line), &fields));
+	XCTAssertEqual(LDrawLineTypeOfBytes(line, strlen(line)), 0);
+}
+
+
+- (void)test_Tokenize_UnterminatedBytes_StopsAtLength
+{
+	const char *line = "2 4 1 2 3 4 5 6 7 8 9";
+	LDrawGeometryLine fields;
+	
+	// Only "2 4 1 2 3" is inside the range.
+	XCTAssertTrue(LDrawTokenizeGeometryLine(line, 9, &fields));
+	
+	XCTAssertEqual(fields.valueCount, 3);
+	XCTAssertEqual(fields.values[2], 3.0f);
+}
+
+@end
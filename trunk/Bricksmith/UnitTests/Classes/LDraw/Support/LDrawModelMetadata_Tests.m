@@ -0,0 +1,61 @@
+//
+//  LDrawModelMetadata_Tests.m
+//  UnitTests
+//
+
+#import "LDrawModelMetadata.h"
+
+#import <XCTest/XCTest.h>
+
+@interface LDrawModelMetadata_Tests : XCTestCase
+
+@end
+
+
+@implementation LDrawModelMetadata_Tests
+
+- (void)test_Header_StopsAtFirstGeometryLine
+{
+	NSString *file =	@"0 Brick  2 x  4 \r\n"
+						@"0 Name: 3001.dat\r\n"
+						@"0 Author: James Jessiman\r\n"
+						@"0 !LDRAW_ORG Part UPDATE 2004-03\r\n"
+						@"\r\n"
+						@"0 !CATEGORY Brick\r\n"
+						@"0 !KEYWORDS Classic, Basic Brick\r\n"
+						@"0 !KEYWORDS Bricks\r\n"
+						@"1 16 0 0 0 1 0 0 0 1 0 0 0 1 s\\3001s01.dat\r\n"
+						@"0 !CATEGORY Not This\r\n";
+	LDrawModelMetadata *metadata = [LDrawModelMetadata metadataFromData:[file dataUsingEncoding:NSUTF8StringEncoding]
+													  includeReferences:NO];
+
+	XCTAssertNil([metadata submodelName]);
+	XCTAssertEqualObjects([metadata modelDescription], @"Brick  2 x  4");
+	XCTAssertEqualObjects([metadata name], @"3001.dat");
+	XCTAssertEqualObjects([metadata author], @"James Jessiman");
+	XCTAssertEqualObjects([metadata ldrawOrg], @"Part UPDATE 2004-03");
+	XCTAssertEqualObjects([metadata category], @"Brick");
+	XCTAssertEqualObjects([metadata keywords], (@[ @"Classic", @"Basic Brick", @"Bricks" ]));
+	XCTAssertNil([metadata referencedFileNames]);
+}
+
+
+- (void)test_References_ExcludeOwnSubmodels
+{
+	NSString *file =	@"0 FILE Main.ldr\n"
+						@"0 Main\n"
+						@"1 16 0 0 0 1 0 0 0 1 0 0 0 1 Wing Assembly.ldr\n"
+						@"1 4 0 0 0 1 0 0 0 1 0 0 0 1 3001.DAT\n"
+						@"1 1 0 8 0 1 0 0 0 1 0 0 0 1 3001.dat\n"
+						@"0 FILE Wing Assembly.ldr\n"
+						@"0 Wing\n"
+						@"1 16 0 0 0 1 0 0 0 1 0 0 0 1 3023.dat\n";
+	LDrawModelMetadata *metadata = [LDrawModelMetadata metadataFromData:[file dataUsingEncoding:NSUTF8StringEncoding]
+													  includeReferences:YES];
+
+	XCTAssertEqualObjects([metadata submodelName], @"Main.ldr");
+	XCTAssertEqualObjects([metadata modelDescription], @"Main");
+	XCTAssertEqualObjects([metadata referencedFileNames], (@[ @"3001.dat", @"3023.dat" ]));
+}
+
+@end
@@ -0,0 +1,127 @@
+//
+//  PartCache_Tests.m
+//  UnitTests
+//
+
+#import "LDrawFile.h"
+#import "LDrawModel.h"
+#import "LDrawPartCacheFile.h"
+#import "PartCache.h"
+
+#import <XCTest/XCTest.h>
+
+@interface PartCache_Tests : XCTestCase
+{
+	NSString	*folder;
+	NSString	*partPath;
+	PartCache	*cache;
+}
+
+@end
+
+
+@implementation PartCache_Tests
+
+- (void)setUp
+{
+	[super setUp];
+
+	folder		= [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+	partPath	= [folder stringByAppendingPathComponent:@"test.dat"];
+	cache		= [[PartCache alloc] initWithDirectory:[folder stringByAppendingPathComponent:@"Cache"]];
+
+	[@"0 Test Part\r\n0 Name: test.dat\r\n0 Author: Nobody\r\n"
+	  "2 24 0 0 0 10 0 0\r\n"
+	  "5 24 0 0 0 0 10 0 1 0 1 -1 0 1\r\n"
+	  "3 16 0 0 0 10 0 0 0 10 0\r\n"
+	  "3 4 0 0 0 0 10 0 10 0 0\r\n"
+	  "4 16 0 0 0 10 0 0 10 10 0 0 10 0\r\n"
+		writeToFile:partPath atomically:YES encoding:NSASCIIStringEncoding error:NULL];
+}
+
+
+- (void)tearDown
+{
+	[[NSFileManager defaultManager] removeItemAtPath:folder error:NULL];
+	[super tearDown];
+}
+
+
+- (LDrawModel *)parsedModel
+{
+	LDrawFile	*file	= [LDrawFile fileFromContentsAtPath:partPath];
+	NSArray		*paths	= [cache referencedPathsInFile:file];
+	LDrawModel	*model	= nil;
+
+	[file optimizeStructure];
+	model = [[file submodels] objectAtIndex:0];
+	[cache storeModel:model forPath:partPath referencedPaths:paths];
+
+	return model;
+}
+
+
+- (void)test_StoredPart_LoadsIdentically
+{
+	LDrawModel	*parsed	= [self parsedModel];
+	LDrawModel	*cached	= [cache modelForPath:partPath];
+
+	XCTAssertNotNil(cached);
+	XCTAssertEqualObjects([cached write], [parsed write]);
+	XCTAssertEqualObjects([cached modelDescription], @"Test Part");
+	XCTAssertEqual([cached boundingBox3].max.x, [parsed boundingBox3].max.x);
+	XCTAssertEqual([cache hitCount], 1u);
+}
+
+
+- (void)test_EditedPart_Misses
+{
+	[self parsedModel];
+
+	[@"0 Test Part\r\n3 16 0 0 0 20 0 0 0 20 0\r\n"
+		writeToFile:partPath atomically:YES encoding:NSASCIIStringEncoding error:NULL];
+
+	XCTAssertNil([cache modelForPath:partPath]);
+	XCTAssertEqual([cache missCount], 1u);
+}
+
+
+- (void)test_DamagedEntry_IsRejected
+{
+	NSString				*cacheFolder	= [folder stringByAppendingPathComponent:@"Cache"];
+	NSString				*entryPath		= nil;
+	NSMutableData			*bytes			= nil;
+	LDrawCachedDependency	*dependencies	= NULL;
+
+	[self parsedModel];
+
+	for(NSString *name in [[NSFileManager defaultManager] subpathsAtPath:cacheFolder])
+	{
+		NSString	*path		= [cacheFolder stringByAppendingPathComponent:name];
+		BOOL		isFolder	= NO;
+
+		if([[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isFolder] && isFolder == NO)
+			entryPath = path;
+	}
+	XCTAssertNotNil(entryPath);
+
+	// Point the part's own path far past the end of the string table; the
+	// entry's size still adds up.
+	bytes			= [NSMutableData dataWithContentsOfFile:entryPath];
+	dependencies	= (LDrawCachedDependency *)((char *)[bytes mutableBytes] + sizeof(LDrawPartCacheHeader));
+	dependencies[0].path.offset = 0x7FFFFFF0;
+	[bytes writeToFile:entryPath atomically:YES];
+
+	XCTAssertTrue(LDrawPartCacheEntryOpen([entryPath fileSystemRepresentation]) == NULL);
+	XCTAssertNil([cache modelForPath:partPath]);
+	XCTAssertEqual([cache missCount], 1u);
+}
+
+
+- (void)test_UnknownPart_Misses
+{
+	XCTAssertNil([cache modelForPath:[folder stringByAppendingPathComponent:@"never.dat"]]);
+	XCTAssertEqual([cache hitCount], 0u);
+}
+
+@end
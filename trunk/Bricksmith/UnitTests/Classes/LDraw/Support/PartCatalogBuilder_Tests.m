@@ -0,0 +1,195 @@
+//
+//  PartCatalogBuilder_Tests.m
+//  UnitTests
+//
+
+#import "PartCatalogBuilder.h"
+
+#import <XCTest/XCTest.h>
+#import "PartLibrary.h"
+
+
+// MARK: Private -
+
+@interface PartCatalogBuilder ()
+
+- (NSArray *) scanFolders:(NSArray *)searchPaths
+		  previousFolders:(NSDictionary *)previousFolders
+	  maxLoadCountHandler:(void (^)(NSUInteger maxPartCount))maxLoadCountHandler
+ progressIncrementHandler:(void (^)(void))progressIncrementHandler;
+
+- (NSMutableDictionary *) partCatalogForFolders:(NSArray *)folders;
+
+@end
+
+
+// MARK: - Tests -
+
+@interface PartCatalogBuilder_Tests : XCTestCase
+{
+	NSString			*folder;
+	NSString			*officialPath;
+	NSString			*unofficialPath;
+	PartCatalogBuilder	*builder;
+}
+
+@end
+
+
+@implementation PartCatalogBuilder_Tests
+
+- (void)setUp
+{
+	[super setUp];
+
+	folder			= [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+	officialPath	= [folder stringByAppendingPathComponent:@"parts"];
+	unofficialPath	= [folder stringByAppendingPathComponent:@"Unofficial"];
+	builder 		= [[PartCatalogBuilder alloc] init];
+
+	[[NSFileManager defaultManager] createDirectoryAtPath:officialPath withIntermediateDirectories:YES attributes:nil error:NULL];
+	[[NSFileManager defaultManager] createDirectoryAtPath:unofficialPath withIntermediateDirectories:YES attributes:nil error:NULL];
+
+	[self writePart:@"3001.dat" description:@"Brick  2 x  4" inFolder:officialPath];
+	[self writePart:@"3003.dat" description:@"Brick  2 x  2" inFolder:officialPath];
+	[self writePart:@"3001.dat" description:@"Brick  2 x  4 (Unofficial)" inFolder:unofficialPath];
+	[self writePart:@"3020.dat" description:@"Plate  2 x  4" inFolder:unofficialPath];
+	[self touchFolder:officialPath secondsAgo:100];
+	[self touchFolder:unofficialPath secondsAgo:100];
+}
+
+
+- (void)tearDown
+{
+	[[NSFileManager defaultManager] removeItemAtPath:folder error:NULL];
+	[super tearDown];
+}
+
+
+//========== writePart:description:inFolder: ==================================
+//
+// Purpose:		Saves a minimal part file.
+//
+//==============================================================================
+- (void) writePart:(NSString *)name description:(NSString *)description inFolder:(NSString *)folderPath
+{
+	NSString *contents = [NSString stringWithFormat:@"0 %@\n0 Name: %@\n0 Author: Unit Tests\n0 !LDRAW_ORG Part\n\n"
+													 "4 16 0 0 0 1 0 0 1 1 0 0 1 0\n", description, name];
+
+	XCTAssertTrue([contents writeToFile:[folderPath stringByAppendingPathComponent:name] atomically:YES encoding:NSUTF8StringEncoding error:NULL]);
+}
+
+
+//========== touchFolder:secondsAgo: ===========================================
+//
+// Purpose:		Gives the folder a known date, so that a change shows up even
+//				on file systems with coarse timestamps.
+//
+//==============================================================================
+- (void) touchFolder:(NSString *)folderPath secondsAgo:(NSTimeInterval)seconds
+{
+	[[NSFileManager defaultManager] setAttributes:@{ NSFileModificationDate: [NSDate dateWithTimeIntervalSinceNow:-seconds] }
+									 ofItemAtPath:folderPath
+											error:NULL];
+}
+
+
+//========== scanWithPreviousFolders:readCount: ================================
+//
+// Purpose:		Scans the official and then the unofficial folder, and reports
+//				how many files had to be read.
+//
+//==============================================================================
+- (NSArray *) scanWithPreviousFolders:(NSArray *)previous readCount:(NSUInteger *)readCount
+{
+	NSArray 			*searchPaths	= @[ @{ @"path" : officialPath }, @{ @"path" : unofficialPath } ];
+	NSMutableDictionary *previousByPath = nil;
+
+	if(previous != nil)
+	{
+		previousByPath = [NSMutableDictionary dictionary];
+		[previousByPath setObject:[previous objectAtIndex:0] forKey:officialPath];
+		[previousByPath setObject:[previous objectAtIndex:1] forKey:unofficialPath];
+	}
+
+	return [builder scanFolders:searchPaths
+				previousFolders:previousByPath
+			maxLoadCountHandler:^(NSUInteger maxPartCount) { *readCount = maxPartCount; }
+	   progressIncrementHandler:nil];
+}
+
+
+- (void)test_UnchangedFolder_IsReused
+{
+	NSUInteger	readCount	= 0;
+	NSArray 	*first		= [self scanWithPreviousFolders:nil readCount:&readCount];
+	NSArray 	*second 	= nil;
+
+	XCTAssertEqual(readCount, 4u);
+
+	second = [self scanWithPreviousFolders:first readCount:&readCount];
+	XCTAssertEqual(readCount, 0u);
+	XCTAssertTrue([second objectAtIndex:0] == [first objectAtIndex:0]);
+	XCTAssertTrue([second objectAtIndex:1] == [first objectAtIndex:1]);
+}
+
+
+- (void)test_ChangedFolder_ReadsOnlyChangedFiles
+{
+	NSUInteger		readCount	= 0;
+	NSArray 		*first		= [self scanWithPreviousFolders:nil readCount:&readCount];
+	NSArray 		*second 	= nil;
+	NSDictionary	*catalog	= nil;
+
+	[self writePart:@"3003.dat" description:@"Brick  2 x  2 with Longer Name" inFolder:officialPath];
+	[self writePart:@"3004.dat" description:@"Brick  1 x  2" inFolder:officialPath];
+	[self touchFolder:officialPath secondsAgo:50];
+
+	second = [self scanWithPreviousFolders:first readCount:&readCount];
+	XCTAssertEqual(readCount, 2u);
+	XCTAssertTrue([second objectAtIndex:1] == [first objectAtIndex:1]);
+	XCTAssertTrue(    [[[second objectAtIndex:0] objectForKey:@"Files"] objectForKey:@"3001.dat"]
+				  ==  [[[first objectAtIndex:0] objectForKey:@"Files"] objectForKey:@"3001.dat"] );
+
+	catalog = [[builder partCatalogForFolders:second] objectForKey:PARTS_LIST_KEY];
+	XCTAssertEqual([catalog count], 4u);
+	XCTAssertEqualObjects([[catalog objectForKey:@"3003.dat"] objectForKey:PART_NAME_KEY], @"Brick  2 x  2 with Longer Name");
+	XCTAssertEqualObjects([[catalog objectForKey:@"3004.dat"] objectForKey:PART_NAME_KEY], @"Brick  1 x  2");
+}
+
+
+- (void)test_FirstFolder_Wins
+{
+	NSUInteger		readCount	= 0;
+	NSArray 		*folders	= [self scanWithPreviousFolders:nil readCount:&readCount];
+	NSDictionary	*catalog	= [builder partCatalogForFolders:folders];
+	NSDictionary	*partList	= [catalog objectForKey:PARTS_LIST_KEY];
+	NSArray 		*bricks 	= [[catalog objectForKey:PARTS_CATALOG_KEY] objectForKey:@"Brick"];
+
+	XCTAssertEqual([partList count], 3u);
+	XCTAssertEqualObjects([[partList objectForKey:@"3001.dat"] objectForKey:PART_NAME_KEY], @"Brick  2 x  4");
+	XCTAssertEqualObjects([[partList objectForKey:@"3020.dat"] objectForKey:PART_CATEGORY_KEY], @"Plate");
+	XCTAssertEqualObjects([bricks valueForKey:PART_NUMBER_KEY], (@[ @"3001.dat", @"3003.dat" ]));
+}
+
+
+- (void)test_IncrementalScan_MatchesFullRebuild
+{
+	NSUInteger	readCount		= 0;
+	NSArray 	*first			= [self scanWithPreviousFolders:nil readCount:&readCount];
+	NSArray 	*incremental	= nil;
+	NSArray 	*rebuilt		= nil;
+
+	[self writePart:@"3001.dat" description:@"Brick  2 x  4 Revised" inFolder:unofficialPath];
+	[self writePart:@"3004.dat" description:@"Brick  1 x  2" inFolder:unofficialPath];
+	[[NSFileManager defaultManager] removeItemAtPath:[unofficialPath stringByAppendingPathComponent:@"3020.dat"] error:NULL];
+	[self touchFolder:unofficialPath secondsAgo:50];
+
+	incremental	= [self scanWithPreviousFolders:first readCount:&readCount];
+	rebuilt		= [self scanWithPreviousFolders:nil readCount:&readCount];
+
+	XCTAssertEqualObjects([builder partCatalogForFolders:incremental], [builder partCatalogForFolders:rebuilt]);
+	XCTAssertNil([[[builder partCatalogForFolders:incremental] objectForKey:PARTS_LIST_KEY] objectForKey:@"3020.dat"]);
+}
+
+@end
@@ -0,0 +1,96 @@
+//
+//  PartCatalog_Tests.m
+//  UnitTests
+//
+
+#import "PartCatalog.h"
+#import "PartLibrary.h"
+
+#import <XCTest/XCTest.h>
+
+@interface PartCatalog_Tests : XCTestCase
+{
+	NSString	*catalogPath;
+	PartCatalog	*catalog;
+}
+
+@end
+
+
+@implementation PartCatalog_Tests
+
+- (void)setUp
+{
+	[super setUp];
+
+	NSDictionary *partList = @{
+		@"3001.dat"		: @{ PART_NUMBER_KEY : @"3001.dat", PART_NAME_KEY : @"Brick  2 x  4", PART_CATEGORY_KEY : @"Brick" },
+		@"3003.dat"		: @{ PART_NUMBER_KEY : @"3003.dat", PART_NAME_KEY : @"Brick  2 x  2", PART_CATEGORY_KEY : @"Brick",
+							 PART_KEYWORDS_KEY : @[ @"Classic", @"Basic Brick" ] },
+		@"s\\3001s01.dat"	: @{ PART_NUMBER_KEY : @"s\\3001s01.dat", PART_NAME_KEY : @"~Brick  2 x  4 without Front Face", PART_CATEGORY_KEY : @"Subparts",
+							 PART_KEYWORDS_KEY : @[ @"Classic" ] },
+	};
+	NSDictionary *categories = @{
+		@"Brick"	: @[ @{ PART_NUMBER_KEY : @"3003.dat" }, @{ PART_NUMBER_KEY : @"3001.dat" } ],
+		@"Subparts"	: @[ @{ PART_NUMBER_KEY : @"s\\3001s01.dat" } ],
+	};
+
+	catalogPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+	XCTAssertTrue([PartCatalog writeCatalog:@{ PARTS_LIST_KEY : partList, PARTS_CATALOG_KEY : categories } toFile:catalogPath]);
+
+	catalog = [PartCatalog catalogWithContentsOfFile:catalogPath];
+	XCTAssertNotNil(catalog);
+}
+
+
+- (void)tearDown
+{
+	[[NSFileManager defaultManager] removeItemAtPath:catalogPath error:NULL];
+	[super tearDown];
+}
+
+
+- (void)test_Records
+{
+	NSDictionary *record = [catalog recordForPartName:@"3003.dat"];
+
+	XCTAssertEqual([catalog partCount], 3u);
+	XCTAssertEqualObjects([record objectForKey:PART_NAME_KEY], @"Brick  2 x  2");
+	XCTAssertEqualObjects([record objectForKey:PART_CATEGORY_KEY], @"Brick");
+	XCTAssertEqualObjects([record objectForKey:PART_KEYWORDS_KEY], (@[ @"Classic", @"Basic Brick" ]));
+	XCTAssertNil([[catalog recordForPartName:@"3001.dat"] objectForKey:PART_KEYWORDS_KEY]);
+	XCTAssertNil([catalog recordForPartName:@"3002.dat"]);
+	XCTAssertEqualObjects([catalog descriptionForPartName:@"s\\3001s01.dat"], @"~Brick  2 x  4 without Front Face");
+}
+
+
+- (void)test_Categories
+{
+	NSArray *bricks = [catalog recordsInCategory:@"Brick"];
+
+	XCTAssertEqualObjects([[catalog categories] sortedArrayUsingSelector:@selector(compare:)], (@[ @"Brick", @"Subparts" ]));
+	XCTAssertEqualObjects([bricks valueForKey:PART_NUMBER_KEY], (@[ @"3003.dat", @"3001.dat" ]));
+	XCTAssertNil([catalog recordsInCategory:@"Plate"]);
+	XCTAssertEqual([[catalog allRecords] count], 3u);
+}
+
+
+- (void)test_KeywordSearch
+{
+	NSSet *expected = [NSSet setWithObjects:@"3003.dat", @"s\\3001s01.dat", nil];
+
+	XCTAssertEqualObjects([catalog partNamesWithKeywordContaining:@"classic"], expected);
+	XCTAssertEqualObjects([catalog partNamesWithKeywordContaining:@"basicbrick"], [NSSet setWithObject:@"3003.dat"]);
+	XCTAssertEqual([[catalog partNamesWithKeywordContaining:@"technic"] count], 0u);
+}
+
+
+- (void)test_DamagedCatalog_IsRejected
+{
+	NSData *data = [NSData dataWithContentsOfFile:catalogPath];
+
+	[[data subdataWithRange:NSMakeRange(0, [data length] - 1)] writeToFile:catalogPath atomically:NO];
+	XCTAssertNil([PartCatalog catalogWithContentsOfFile:catalogPath]);
+}
+
+@end